@@ -0,0 +1,126 @@
+//! Pamięć etapów: `cargo bench -p hl-bench --bench footprint [-- OPCJE]`
+//!
+//!   --save-baseline NAZWA   zapisz wyniki do target/hl-bench/NAZWA.json
+//!   --baseline NAZWA        porównaj z zapisanym baseline (zmiana w %)
+//!
+//! Dla każdego etapu: liczba alokacji, zaalokowane bajty, szczyt sterty ponad
+//! stan sprzed etapu i przyrost szczytowego RSS procesu. RSS rośnie tylko
+//! w górę, więc etapy idą od najlżejszych; zimny cache przed ciepłym.
+
+use hl_bench::alloc::{self, CountingAlloc};
+use hl_bench::baseline::{self, Baseline, Entry};
+use hl_bench::corpus::{self, Shape};
+use hl_compiler::{lower_ast, optimize_module};
+use hl_parser::parse_source_with_meta;
+use std::path::Path;
+
+#[global_allocator]
+static GLOBAL: CountingAlloc = CountingAlloc;
+
+const LARGE_BLOCKS: usize = 2000;
+const EXEC_ITERS:   usize = 20_000;
+
+struct Run {
+    results: Baseline,
+}
+
+impl Run {
+    fn stage<T>(&mut self, name: impl Into<String>, f: impl FnOnce() -> T) -> T {
+        let rss0 = alloc::peak_rss_kb();
+        let (out, s) = alloc::measure(f);
+        let e = Entry {
+            allocs:    s.allocs,
+            bytes:     s.bytes,
+            peak_heap: s.peak_heap,
+            rss_kb:    alloc::peak_rss_kb().saturating_sub(rss0),
+        };
+        self.results.insert(name.into(), e);
+        out
+    }
+}
+
+fn arg_value(args: &[String], flag: &str) -> Option<String> {
+    args.iter().position(|a| a == flag).and_then(|i| args.get(i + 1)).cloned()
+}
+
+fn main() {
+    let args: Vec<String> = std::env::args().collect();
+    let save = arg_value(&args, "--save-baseline");
+    let cmp  = arg_value(&args, "--baseline");
+    hl_bench::isolate_cache("footprint");
+
+    let mut run = Run { results: Baseline::new() };
+    let path = Path::new("bench.hl");
+
+    // ── front-end na korpusach ─────────────────────────────────────────────
+    let mut inputs: Vec<(String, Vec<String>)> = corpus::corpora().into_iter()
+    .map(|(n, ss)| (n.to_string(), ss.into_iter().map(|s| s.source)
+        .filter(|s| parse_source_with_meta(s).is_ok()).collect()))
+    .collect();
+    inputs.push(("large".into(), vec![corpus::generate_large(LARGE_BLOCKS)]));
+
+    for (name, sources) in &inputs {
+        let parsed = run.stage(format!("parse/{}", name), || {
+            sources.iter().map(|s| parse_source_with_meta(s).unwrap()).collect::<Vec<_>>()
+        });
+        let mut modules = run.stage(format!("lower/{}", name), || {
+            parsed.iter().map(|m| lower_ast(&m.nodes, path, m.gen.number())).collect::<Vec<_>>()
+        });
+        run.stage(format!("optimize/{}", name), || for m in &mut modules { optimize_module(m); });
+    }
+
+    // ── cache .bc: zimny (kompilacja + zapis) vs ciepły (trafienie) ───────
+    let src = corpus::generate_large(200);
+    run.stage("cache/cold", || hl_compiler::compile_to_cache(&src, path).unwrap());
+    run.stage("cache/warm", || hl_compiler::compile_to_cache(&src, path).unwrap());
+    run.stage("cache/warm+load", || {
+        let bc = hl_compiler::compile_to_cache(&src, path).unwrap();
+        hl_compiler::read_bc_file(&bc).unwrap()
+    });
+
+    // ── wykonanie: AST, interpreter bez JIT, interpreter z JIT ─────────────
+    for shape in Shape::ALL {
+        let src = corpus::generate(shape, EXEC_ITERS);
+        run.stage(format!("exec/ast/{}", shape.name()), || {
+            let mut env = hl_core::env::Env::new();
+            hl_core::run_source(&src, &mut env).unwrap().exit_code
+        });
+        let meta = parse_source_with_meta(&src).unwrap();
+        let mut module = lower_ast(&meta.nodes, path, meta.gen.number());
+        optimize_module(&mut module);
+        for (label, no_jit) in [("interp", true), ("jit", false)] {
+            if no_jit { std::env::set_var("HL_NO_JIT", "1"); } else { std::env::remove_var("HL_NO_JIT"); }
+            run.stage(format!("exec/{}/{}", label, shape.name()), || {
+                hl_jit::BytecodeInterpreter::new(&module).unwrap().run().unwrap()
+            });
+        }
+        std::env::remove_var("HL_NO_JIT");
+    }
+
+    let old = cmp.as_deref().map(|n| baseline::load(n).unwrap_or_else(|e| {
+        eprintln!("baseline {}: {}", n, e);
+        std::process::exit(1);
+    }));
+    report(&run.results, old.as_ref());
+    println!("szczyt RSS procesu: {} KiB", alloc::peak_rss_kb());
+
+    if let Some(name) = save {
+        match baseline::save(&name, &run.results) {
+            Ok(p)  => println!("baseline zapisany: {}", p.display()),
+            Err(e) => { eprintln!("baseline {}: {}", name, e); std::process::exit(1); }
+        }
+    }
+}
+
+fn report(results: &Baseline, old: Option<&Baseline>) {
+    println!("{:<28} {:>10} {:>12} {:>12} {:>8}", "etap", "alokacje", "bajty", "szczyt", "RSS KiB");
+    for (name, e) in results {
+        print!("{:<28} {:>10} {:>12} {:>12} {:>8}", name, e.allocs, e.bytes, e.peak_heap, e.rss_kb);
+        if let Some(o) = old.and_then(|b| b.get(name)) {
+            let pct = |a: u64, b: u64| baseline::delta(a, b)
+                .map_or_else(|| "—".to_string(), |d| format!("{:+.1}%", d));
+            print!("   alok. {}  szczyt {}", pct(o.allocs, e.allocs), pct(o.peak_heap, e.peak_heap));
+        }
+        println!();
+    }
+}
@@ -0,0 +1,155 @@
+//! Czasy etapów: `cargo bench -p hl-bench --bench pipeline`
+//!
+//!  frontend/*  — lekser, parser, lower, optymalizator na korpusach repo
+//!                i na generowanym dużym skrypcie
+//!  bc/*        — zapis i odczyt .bc (bincode i flat)
+//!  cache/*     — compile_to_cache: zimny (nowa treść co iterację) vs ciepły (trafienie)
+//!  exec/*      — wykonanie generowanych skryptów: AST, interpreter bytecode
+//!                bez JIT (HL_NO_JIT) i z JIT
+//!
+//! Baseline: `cargo bench -p hl-bench --bench pipeline -- --save-baseline main`,
+//! potem `-- --baseline main` pokazuje zmianę względem zapisanego przebiegu.
+
+use criterion::{criterion_group, criterion_main, BatchSize, Criterion, Throughput};
+use hl_bench::corpus::{self, Script, Shape};
+use hl_compiler::{lower_ast, optimize_module, BcFormat, HlModule, MappedBc};
+use hl_parser::{parse_source_with_meta, Lexer};
+use std::path::Path;
+use std::sync::atomic::{AtomicU64, Ordering};
+
+/// Rozmiar dużego skryptu front-endu (bloków po ~16 linii)
+const LARGE_BLOCKS: usize = 2000;
+/// Obroty pętli w skryptach wykonawczych
+const EXEC_ITERS: usize = 20_000;
+
+fn front_inputs() -> Vec<(String, Vec<Script>)> {
+    let mut v: Vec<(String, Vec<Script>)> = corpus::corpora().into_iter()
+    .map(|(n, s)| (n.to_string(), s))
+    .collect();
+    v.push(("large".into(), vec![Script { name: "large".into(), source: corpus::generate_large(LARGE_BLOCKS) }]));
+    v
+}
+
+fn module_of(src: &str) -> HlModule {
+    let meta = parse_source_with_meta(src).expect("parse");
+    lower_ast(&meta.nodes, Path::new("bench.hl"), meta.gen.number())
+}
+
+fn bench_frontend(c: &mut Criterion) {
+    let mut g = c.benchmark_group("frontend");
+    for (name, scripts) in front_inputs() {
+        // Skrypty, których parser nie przyjmuje, pomijamy (mierzymy ścieżkę udaną)
+        let scripts: Vec<Script> = scripts.into_iter()
+        .filter(|s| parse_source_with_meta(&s.source).is_ok())
+        .collect();
+        g.throughput(Throughput::Bytes(corpus::bytes(&scripts)));
+
+        g.bench_function(format!("lex/{}", name), |b| b.iter(|| {
+            for s in &scripts { let _ = Lexer::new(&s.source).tokenize(); }
+        }));
+        g.bench_function(format!("parse/{}", name), |b| b.iter(|| {
+            for s in &scripts { let _ = parse_source_with_meta(&s.source); }
+        }));
+
+        let parsed: Vec<_> = scripts.iter().map(|s| parse_source_with_meta(&s.source).unwrap()).collect();
+        g.bench_function(format!("lower/{}", name), |b| b.iter(|| {
+            for m in &parsed { let _ = lower_ast(&m.nodes, Path::new("bench.hl"), m.gen.number()); }
+        }));
+
+        let lowered: Vec<HlModule> = scripts.iter().map(|s| module_of(&s.source)).collect();
+        g.bench_function(format!("optimize/{}", name), |b| b.iter_batched(
+            || lowered.clone(),
+            |mut ms| for m in &mut ms { optimize_module(m); },
+            BatchSize::LargeInput,
+        ));
+    }
+    g.finish();
+}
+
+fn bench_bc(c: &mut Criterion) {
+    let mut module = module_of(&corpus::generate_large(LARGE_BLOCKS));
+    optimize_module(&mut module);
+    let dir = hl_bench::target_dir().join("hl-bench");
+    let _ = std::fs::create_dir_all(&dir);
+
+    let mut g = c.benchmark_group("bc");
+    for (fmt, ext) in [(BcFormat::Bincode, "bincode"), (BcFormat::Flat, "flat")] {
+        let path = dir.join(format!("large.{}.bc", ext));
+        g.bench_function(format!("write/{}", ext), |b| b.iter(|| {
+            hl_compiler::write_bc_file_as(&module, &path, fmt).unwrap()
+        }));
+        g.throughput(Throughput::Bytes(std::fs::metadata(&path).unwrap().len()));
+        // Tak jak `hl run plik.bc`: flat — mmap i widok w miejscu, bincode — pełny odczyt
+        g.bench_function(format!("read/{}", ext), |b| b.iter(|| match fmt {
+            BcFormat::Flat => {
+                let mapped = MappedBc::open(&path).unwrap();
+                mapped.flat().unwrap().main_regs
+            }
+            _ => hl_compiler::read_bc_file(&path).unwrap().main_regs,
+        }));
+    }
+    g.finish();
+}
+
+fn bench_cache(c: &mut Criterion) {
+    let src = corpus::generate_large(200);
+    let path = Path::new("bench.hl");
+    let mut g = c.benchmark_group("cache");
+
+    // Zimny: każda iteracja ma inną treść (inny hash) → pełna kompilacja i zapis
+    let n = AtomicU64::new(0);
+    g.bench_function("compile_to_cache/cold", |b| b.iter_batched(
+        || format!("{};; {}\n", src, n.fetch_add(1, Ordering::Relaxed)),
+        |s| hl_compiler::compile_to_cache(&s, path).unwrap(),
+        BatchSize::SmallInput,
+    ));
+
+    // Ciepły: ta sama treść — tylko hash i sprawdzenie wpisu
+    hl_compiler::compile_to_cache(&src, path).unwrap();
+    g.bench_function("compile_to_cache/warm", |b| b.iter(|| {
+        hl_compiler::compile_to_cache(&src, path).unwrap()
+    }));
+    g.bench_function("compile_to_cache/warm+load", |b| b.iter(|| {
+        let bc = hl_compiler::compile_to_cache(&src, path).unwrap();
+        hl_compiler::read_bc_file(&bc).unwrap()
+    }));
+    g.finish();
+}
+
+fn bench_exec(c: &mut Criterion) {
+    let mut g = c.benchmark_group("exec");
+    g.sample_size(20);
+    for shape in Shape::ALL {
+        let src = corpus::generate(shape, EXEC_ITERS);
+        g.throughput(Throughput::Elements(EXEC_ITERS as u64));
+
+        g.bench_function(format!("ast/{}", shape.name()), |b| b.iter(|| {
+            let mut env = hl_core::env::Env::new();
+            hl_core::run_source(&src, &mut env).unwrap()
+        }));
+
+        let mut module = module_of(&src);
+        optimize_module(&mut module);
+        for (label, no_jit) in [("interp", true), ("jit", false)] {
+            // JitEngine czyta HL_NO_JIT przy tworzeniu interpretera
+            if no_jit { std::env::set_var("HL_NO_JIT", "1"); } else { std::env::remove_var("HL_NO_JIT"); }
+            g.bench_function(format!("{}/{}", label, shape.name()), |b| b.iter(|| {
+                let mut interp = hl_jit::BytecodeInterpreter::new(&module).unwrap();
+                interp.run().unwrap()
+            }));
+        }
+        std::env::remove_var("HL_NO_JIT");
+    }
+    g.finish();
+}
+
+fn all(c: &mut Criterion) {
+    hl_bench::isolate_cache("pipeline");
+    bench_frontend(c);
+    bench_bc(c);
+    bench_cache(c);
+    bench_exec(c);
+}
+
+criterion_group!(benches, all);
+criterion_main!(benches);
@@ -0,0 +1,110 @@
+//! Licznik alokacji i szczyt RSS
+//!
+//! `CountingAlloc` owija alokator systemowy; benchmark rejestruje go przez
+//! `#[global_allocator]` i czyta `snapshot()` wokół mierzonego etapu.
+//! Liczniki są globalne (atomiki, Relaxed) — etapy mierzymy sekwencyjnie.
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::sync::atomic::{AtomicU64, Ordering::Relaxed};
+
+pub struct CountingAlloc;
+
+static ALLOCS:  AtomicU64 = AtomicU64::new(0);
+static BYTES:   AtomicU64 = AtomicU64::new(0);
+static CURRENT: AtomicU64 = AtomicU64::new(0);
+static PEAK:    AtomicU64 = AtomicU64::new(0);
+
+#[inline]
+fn grow(size: u64) {
+    let now = CURRENT.fetch_add(size, Relaxed) + size;
+    PEAK.fetch_max(now, Relaxed);
+}
+
+// SAFETY: deleguje do System, tylko liczy
+unsafe impl GlobalAlloc for CountingAlloc {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        let p = System.alloc(layout);
+        if !p.is_null() {
+            ALLOCS.fetch_add(1, Relaxed);
+            BYTES.fetch_add(layout.size() as u64, Relaxed);
+            grow(layout.size() as u64);
+        }
+        p
+    }
+
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        let p = System.alloc_zeroed(layout);
+        if !p.is_null() {
+            ALLOCS.fetch_add(1, Relaxed);
+            BYTES.fetch_add(layout.size() as u64, Relaxed);
+            grow(layout.size() as u64);
+        }
+        p
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout);
+        CURRENT.fetch_sub(layout.size() as u64, Relaxed);
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        let p = System.realloc(ptr, layout, new_size);
+        if !p.is_null() {
+            ALLOCS.fetch_add(1, Relaxed);
+            let (old, new) = (layout.size() as u64, new_size as u64);
+            if new > old {
+                BYTES.fetch_add(new - old, Relaxed);
+                grow(new - old);
+            } else {
+                CURRENT.fetch_sub(old - new, Relaxed);
+            }
+        }
+        p
+    }
+}
+
+/// Stan liczników (alokacje i bajty od ostatniego `reset()`)
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct AllocStats {
+    /// Liczba alokacji (realloc liczy się jako jedna)
+    pub allocs:    u64,
+    /// Zaalokowane bajty łącznie
+    pub bytes:     u64,
+    /// Szczyt zajętej sterty (z `measure` — ponad stan sprzed etapu)
+    pub peak_heap: u64,
+}
+
+/// Wyzeruj liczniki; szczyt liczony od bieżącego zajęcia sterty
+pub fn reset() {
+    ALLOCS.store(0, Relaxed);
+    BYTES.store(0, Relaxed);
+    PEAK.store(CURRENT.load(Relaxed), Relaxed);
+}
+
+pub fn snapshot() -> AllocStats {
+    AllocStats {
+        allocs:    ALLOCS.load(Relaxed),
+        bytes:     BYTES.load(Relaxed),
+        peak_heap: PEAK.load(Relaxed),
+    }
+}
+
+/// Zmierz `f`: (wynik, alokacje w trakcie). `peak_heap` — ponad stan przed `f`
+pub fn measure<T>(f: impl FnOnce() -> T) -> (T, AllocStats) {
+    let before = CURRENT.load(Relaxed);
+    reset();
+    let out = f();
+    let mut s = snapshot();
+    s.peak_heap = s.peak_heap.saturating_sub(before);
+    (out, s)
+}
+
+/// Szczyt RSS procesu w KiB (getrusage, ru_maxrss)
+pub fn peak_rss_kb() -> u64 {
+    // SAFETY: getrusage wypełnia przekazaną strukturę
+    unsafe {
+        let mut ru: libc::rusage = std::mem::zeroed();
+        if libc::getrusage(libc::RUSAGE_SELF, &mut ru) != 0 { return 0; }
+        ru.ru_maxrss as u64
+    }
+}
@@ -0,0 +1,66 @@
+//! Baseline benchmarku pamięci: target/hl-bench/<nazwa>.json
+//!
+//! Criterion ma własne baseline dla czasów (`--save-baseline`/`--baseline`);
+//! tu trzymamy alokacje i RSS, których criterion nie mierzy.
+
+use anyhow::{Context, Result};
+use serde::{Deserialize, Serialize};
+use std::collections::BTreeMap;
+use std::path::PathBuf;
+
+/// Wynik jednego etapu
+#[derive(Debug, Clone, Default, PartialEq, Serialize, Deserialize)]
+pub struct Entry {
+    pub allocs:    u64,
+    pub bytes:     u64,
+    pub peak_heap: u64,
+    /// Przyrost szczytowego RSS procesu w KiB (0, gdy szczyt był wcześniej)
+    pub rss_kb:    u64,
+}
+
+/// Etap → wynik; BTreeMap trzyma stałą kolejność w pliku
+pub type Baseline = BTreeMap<String, Entry>;
+
+pub fn path(name: &str) -> PathBuf {
+    crate::target_dir().join("hl-bench").join(format!("{}.json", name))
+}
+
+pub fn save(name: &str, b: &Baseline) -> Result<PathBuf> {
+    let p = path(name);
+    if let Some(dir) = p.parent() { std::fs::create_dir_all(dir)?; }
+    std::fs::write(&p, serde_json::to_vec_pretty(b)?)
+    .with_context(|| format!("zapis {}", p.display()))?;
+    Ok(p)
+}
+
+pub fn load(name: &str) -> Result<Baseline> {
+    let p = path(name);
+    let raw = std::fs::read(&p).with_context(|| format!("odczyt {}", p.display()))?;
+    Ok(serde_json::from_slice(&raw)?)
+}
+
+/// Zmiana względem baseline w procentach (None — brak punktu odniesienia)
+pub fn delta(old: u64, new: u64) -> Option<f64> {
+    (old > 0).then(|| (new as f64 - old as f64) * 100.0 / old as f64)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_delta() {
+        assert_eq!(delta(100, 150), Some(50.0));
+        assert_eq!(delta(200, 100), Some(-50.0));
+        assert_eq!(delta(0, 10), None);
+    }
+
+    #[test]
+    fn test_roundtrip_json() {
+        let mut b = Baseline::new();
+        b.insert("parse/tests".into(), Entry { allocs: 3, bytes: 64, peak_heap: 32, rss_kb: 0 });
+        let raw = serde_json::to_vec(&b).unwrap();
+        let back: Baseline = serde_json::from_slice(&raw).unwrap();
+        assert_eq!(back, b);
+    }
+}
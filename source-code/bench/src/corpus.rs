@@ -0,0 +1,162 @@
+//! Korpusy skryptów dla benchmarków
+//!
+//! Skrypty z repozytorium wywołują komendy systemowe, więc mierzymy na nich
+//! tylko front-end (lekser, parser, lower, optymalizator, serializacja).
+//! Wykonanie mierzymy na skryptach generowanych — czysta arytmetyka, funkcje,
+//! switch i napisy, bez komend i bez wyjścia (wynik zostaje w `@acc`).
+
+use std::fmt::Write;
+use std::path::{Path, PathBuf};
+
+pub struct Script {
+    /// Ścieżka względem korzenia repozytorium (albo nazwa generatora)
+    pub name:   String,
+    pub source: String,
+}
+
+pub fn repo_root() -> PathBuf {
+    Path::new(env!("CARGO_MANIFEST_DIR")).join("../..")
+}
+
+/// Wszystkie pliki .hl z katalogu (rekurencyjnie), posortowane po ścieżce
+pub fn load(dir: &str) -> Vec<Script> {
+    let root = repo_root();
+    let mut paths = Vec::new();
+    collect(&root.join(dir), &mut paths);
+    paths.sort();
+    paths.into_iter().filter_map(|p| {
+        let source = std::fs::read_to_string(&p).ok()?;
+        let name = p.strip_prefix(&root).unwrap_or(&p).display().to_string();
+        Some(Script { name, source })
+    }).collect()
+}
+
+fn collect(dir: &Path, out: &mut Vec<PathBuf>) {
+    let Ok(rd) = std::fs::read_dir(dir) else { return };
+    for e in rd.flatten() {
+        let p = e.path();
+        if p.is_dir() { collect(&p, out); }
+        else if p.extension().and_then(|e| e.to_str()) == Some("hl") { out.push(p); }
+    }
+}
+
+/// Korpusy front-endu: (nazwa, skrypty)
+pub fn corpora() -> Vec<(&'static str, Vec<Script>)> {
+    vec![
+        ("tests",     load("tests")),
+        ("examples",  load("examples")),
+        ("main-libs", load("main-libs")),
+    ]
+}
+
+/// Łączny rozmiar korpusu w bajtach (przepustowość w criterion)
+pub fn bytes(scripts: &[Script]) -> u64 {
+    scripts.iter().map(|s| s.source.len() as u64).sum()
+}
+
+/// Kształt generowanego skryptu wykonawczego
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Shape {
+    /// Pętla while z arytmetyką na intach
+    Arith,
+    /// Wywołania funkcji w pętli
+    Calls,
+    /// switch/case i napisy z interpolacją
+    Strings,
+}
+
+impl Shape {
+    pub const ALL: [Shape; 3] = [Shape::Arith, Shape::Calls, Shape::Strings];
+
+    pub fn name(self) -> &'static str {
+        match self {
+            Shape::Arith   => "arith",
+            Shape::Calls   => "calls",
+            Shape::Strings => "strings",
+        }
+    }
+}
+
+/// Skrypt wykonawczy: `iters` obrotów pętli danego kształtu
+pub fn generate(shape: Shape, iters: usize) -> String {
+    let mut s = String::from("using <gen 2>\n\n% i: int = 0\n% acc: int = 0\n");
+    match shape {
+        Shape::Arith => {
+            let _ = write!(s, "?~ @i < {}\n", iters);
+            s.push_str("    $( (@acc + @i * 3) % 1000003 ) -> @acc\n");
+            s.push_str("    $( @i + 1 ) -> @i\n");
+            s.push_str("done\n");
+        }
+        Shape::Calls => {
+            s.push_str(": step def\n    $( (@acc * 31 + @i) % 65521 ) -> @acc\ndone\n\n");
+            let _ = write!(s, "?~ @i < {}\n", iters);
+            s.push_str("    -- step\n");
+            s.push_str("    $( @i + 1 ) -> @i\n");
+            s.push_str("done\n");
+        }
+        Shape::Strings => {
+            let _ = write!(s, "?~ @i < {}\n", iters);
+            s.push_str("    $( @i % 3 ) -> @k\n");
+            s.push_str("    ? switch @k\n");
+            s.push_str("    | 0\n        % tag = zero-@i\n");
+            s.push_str("    | 1\n        % tag = jeden-@i\n");
+            s.push_str("    | *\n        % tag = inny-@i\n");
+            s.push_str("    done\n");
+            s.push_str("    $( @acc + 1 ) -> @acc\n");
+            s.push_str("    $( @i + 1 ) -> @i\n");
+            s.push_str("done\n");
+        }
+    }
+    s
+}
+
+/// Duży skrypt dla front-endu: `blocks` powtórzeń bloku ze zmiennymi,
+/// funkcją, warunkiem, switch, for-in i komendami (~16 linii na blok)
+pub fn generate_large(blocks: usize) -> String {
+    let mut s = String::from("#!/usr/bin/hl\nusing <gen 2>\n\n");
+    for b in 0..blocks {
+        let _ = write!(s, "\
+;; ── blok {b} ──
+% n{b}: int = {b}
+% name{b}: str = element-{b}
+: fn{b} def
+    $( @n{b} * 2 + 1 ) -> @r{b}
+    ~> fn{b}: @r{b} @name{b}
+done
+?~ @n{b} < 10 && -n @name{b}
+    $( @n{b} + 1 ) -> @n{b}
+done
+? switch @name{b}
+| element-0
+    ::green pierwszy
+| *
+    >> echo @name{b}
+done
+@ it in a b c
+    -- fn{b}
+done
+");
+    }
+    s
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_repo_corpora_present() {
+        let c = corpora();
+        assert!(c.iter().all(|(_, s)| !s.is_empty()), "brak skryptów w korpusie");
+        assert!(c[0].1.iter().all(|s| s.name.starts_with("tests")));
+    }
+
+    #[test]
+    fn test_generated_scripts_parse() {
+        for shape in Shape::ALL {
+            let src = generate(shape, 10);
+            hl_parser::parse_source(&src).unwrap_or_else(|e| panic!("{}: {:?}", shape.name(), e));
+        }
+        hl_parser::parse_source(&generate_large(20)).unwrap();
+    }
+}
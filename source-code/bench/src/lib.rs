@@ -0,0 +1,33 @@
+//! Benchmarki Hacker Lang — wspólne elementy dla `benches/`
+//!
+//!  - `corpus`   — skrypty z tests/, examples/, main-libs/ i generowane duże skrypty
+//!  - `alloc`    — licznik alokacji (globalny alokator w benchmarku) i szczyt RSS
+//!  - `baseline` — zapis/porównanie wyników w target/hl-bench/<nazwa>.json
+//!
+//! Czasy etapów mierzy criterion (`cargo bench -p hl-bench --bench pipeline`,
+//! baseline: `-- --save-baseline main` / `-- --baseline main`); pamięć —
+//! `--bench footprint`, z własnym formatem baseline.
+
+pub mod alloc;
+pub mod baseline;
+pub mod corpus;
+
+use std::path::PathBuf;
+
+/// Izolowany HOME dla benchmarków: cache .bc i fragmentów JIT trafiają do
+/// świeżego katalogu w target/, a nie do ~/.hackeros użytkownika.
+/// Wołać na początku benchmarku, zanim cokolwiek odczyta `cache_dir()`.
+pub fn isolate_cache(tag: &str) -> PathBuf {
+    let home = target_dir().join("hl-bench").join(format!("home-{}", tag));
+    let _ = std::fs::remove_dir_all(&home);
+    let _ = std::fs::create_dir_all(&home);
+    std::env::set_var("HOME", &home);
+    home
+}
+
+/// Katalog target/ workspace (CARGO_TARGET_DIR ma pierwszeństwo)
+pub fn target_dir() -> PathBuf {
+    std::env::var_os("CARGO_TARGET_DIR")
+    .map(PathBuf::from)
+    .unwrap_or_else(|| corpus::repo_root().join("target"))
+}
@@ -0,0 +1,224 @@
+//! `hl bench` — wielokrotne uruchomienie skryptu z rozbiciem na start i wykonanie
+//!
+//! Każdy przebieg to świeży `fork()` procesu `hl`: dziecko mierzy start
+//! (odczyt, lint i parsowanie — albo kompilacja do cache i załadowanie .bc
+//! z `--jit`) oraz wykonanie, i oddaje oba czasy rodzicowi przez pipe.
+//! Rodzic mierzy całość (fork → waitpid). Stan po jednym przebiegu (zmienne,
+//! goroutines, areny) nie przecieka do następnego, a skrypt kończący się
+//! przez `exit` nie przerywa pomiaru — jego wykonanie liczymy wtedy jako
+//! całość minus start.
+//!
+//! Przebiegi rozgrzewające (`--warmup`) nie trafiają do statystyk; przy
+//! `--jit` pierwszy z nich wypełnia cache .bc i fragmentów JIT.
+
+use anyhow::{bail, Result};
+use colored::Colorize;
+use std::io::{self, Read, Write};
+use std::os::unix::io::FromRawFd;
+use std::path::Path;
+use std::time::{Duration, Instant};
+
+/// Opcje `hl bench`
+#[derive(Debug, Clone)]
+pub struct BenchOpts {
+    pub runs:        usize,
+    pub warmup:      usize,
+    pub jit:         bool,
+    pub show_output: bool,
+}
+
+/// Jeden przebieg; `start`/`exec` = None, gdy dziecko zakończyło się przed pomiarem
+#[derive(Debug, Clone, Copy)]
+struct Sample {
+    start: Option<Duration>,
+    exec:  Option<Duration>,
+    total: Duration,
+    code:  i32,
+}
+
+pub fn run(file: &Path, args: &[String], opts: &BenchOpts) -> Result<i32> {
+    if !file.exists() {
+        bail!("Plik nie istnieje: {:?}", file);
+    }
+    if opts.runs == 0 {
+        bail!("--runs musi być większe od 0");
+    }
+    let path = if opts.jit { "jit" } else { "ast" };
+    eprintln!("{} {} — {} przebiegów (+{} rozgrzewki), ścieżka: {}",
+              "[hl bench]".bright_cyan().bold(), file.display(), opts.runs, opts.warmup, path);
+
+    for _ in 0..opts.warmup {
+        one(file, args, opts)?;
+    }
+    let mut samples = Vec::with_capacity(opts.runs);
+    for _ in 0..opts.runs {
+        samples.push(one(file, args, opts)?);
+    }
+
+    let failed = samples.iter().filter(|s| s.code != 0).count();
+    let start: Vec<Duration> = samples.iter().filter_map(|s| s.start).collect();
+    let exec: Vec<Duration> = samples.iter()
+        .filter_map(|s| s.exec.or_else(|| s.start.map(|st| s.total.saturating_sub(st))))
+        .collect();
+    let total: Vec<Duration> = samples.iter().map(|s| s.total).collect();
+
+    eprintln!("  {:<10} {:>10} {:>10} {:>10} {:>10} {:>10}", "", "p50", "p99", "średnio", "min", "max");
+    print_row("start", start);
+    print_row("wykonanie", exec);
+    print_row("całość", total);
+    if failed > 0 {
+        eprintln!("  {} {} z {} przebiegów zakończyło się kodem ≠ 0",
+                  "uwaga:".yellow().bold(), failed, samples.len());
+    }
+    Ok(samples.last().map_or(0, |s| s.code))
+}
+
+/// Percentyl metodą najbliższej rangi; `xs` posortowane rosnąco
+fn percentile(xs: &[Duration], p: f64) -> Duration {
+    let rank = (p * xs.len() as f64).ceil() as usize;
+    xs[rank.clamp(1, xs.len()) - 1]
+}
+
+fn print_row(label: &str, mut xs: Vec<Duration>) {
+    if xs.is_empty() {
+        eprintln!("  {:<10} {:>10}", label, "—");
+        return;
+    }
+    xs.sort_unstable();
+    let mean = xs.iter().sum::<Duration>() / xs.len() as u32;
+    eprintln!("  {:<10} {:>10} {:>10} {:>10} {:>10} {:>10}", label,
+              fmt_dur(percentile(&xs, 0.50)), fmt_dur(percentile(&xs, 0.99)),
+              fmt_dur(mean), fmt_dur(xs[0]), fmt_dur(xs[xs.len() - 1]));
+}
+
+fn fmt_dur(d: Duration) -> String {
+    let us = d.as_secs_f64() * 1e6;
+    if us < 1000.0 { format!("{:.1} µs", us) }
+    else if us < 1e6 { format!("{:.2} ms", us / 1000.0) }
+    else { format!("{:.3} s", us / 1e6) }
+}
+
+fn one(file: &Path, args: &[String], opts: &BenchOpts) -> Result<Sample> {
+    let mut fds = [0; 2];
+    // SAFETY: fds to tablica dwóch int, jak wymaga pipe(2)
+    if unsafe { libc::pipe(fds.as_mut_ptr()) } != 0 {
+        bail!("pipe: {}", io::Error::last_os_error());
+    }
+    let _ = io::stdout().flush();
+    let _ = io::stderr().flush();
+
+    let t0 = Instant::now();
+    // SAFETY: `hl bench` jest jednowątkowy w chwili forka
+    let pid = unsafe { libc::fork() };
+    if pid < 0 {
+        // SAFETY: oba fd pochodzą z pipe() wyżej
+        unsafe { libc::close(fds[0]); libc::close(fds[1]); }
+        bail!("fork: {}", io::Error::last_os_error());
+    }
+    if pid == 0 {
+        // SAFETY: w dziecku zamykamy koniec do odczytu; zapis przejmuje File
+        unsafe { libc::close(fds[0]); }
+        let report = unsafe { std::fs::File::from_raw_fd(fds[1]) };
+        if !opts.show_output { silence_stdio(); }
+        let code = child(file, args, opts.jit, report);
+        let _ = io::stdout().flush();
+        // SAFETY: _exit bez atexit — bufory rodzica skopiowane przy forku nie są
+        // wypisywane drugi raz
+        unsafe { libc::_exit(code) }
+    }
+
+    // SAFETY: rodzic zamyka koniec do zapisu, odczyt przejmuje File
+    unsafe { libc::close(fds[1]); }
+    let mut report = unsafe { std::fs::File::from_raw_fd(fds[0]) };
+    let mut buf = Vec::with_capacity(16);
+    let _ = report.read_to_end(&mut buf);
+
+    let mut status = 0;
+    // SAFETY: pid to nasze dziecko, czekamy na nie dokładnie raz
+    let code = match unsafe { libc::waitpid(pid, &mut status, 0) } {
+        -1 => 1,
+        _ if libc::WIFEXITED(status)   => libc::WEXITSTATUS(status),
+        _ if libc::WIFSIGNALED(status) => 128 + libc::WTERMSIG(status),
+        _ => 1,
+    };
+    let total = t0.elapsed();
+
+    let nanos = |i: usize| buf.get(i * 8..i * 8 + 8)
+        .map(|b| Duration::from_nanos(u64::from_le_bytes(b.try_into().unwrap())));
+    Ok(Sample { start: nanos(0), exec: nanos(1), total, code })
+}
+
+/// stdout/stderr skryptu → /dev/null (nie mieszają się z raportem)
+fn silence_stdio() {
+    // SAFETY: open/dup2/close na deskryptorach tego procesu
+    unsafe {
+        let null = libc::open(c"/dev/null".as_ptr(), libc::O_WRONLY);
+        if null >= 0 {
+            libc::dup2(null, 1);
+            libc::dup2(null, 2);
+            libc::close(null);
+        }
+    }
+}
+
+/// Proces dziecka: start → raport, wykonanie → raport
+fn child(file: &Path, args: &[String], jit: bool, mut report: std::fs::File) -> i32 {
+    let t0 = Instant::now();
+    if jit { child_jit(file, args, t0, &mut report) } else { child_ast(file, args, t0, &mut report) }
+}
+
+fn send(report: &mut std::fs::File, d: Duration) {
+    let _ = report.write_all(&(d.as_nanos() as u64).to_le_bytes());
+}
+
+/// Domyślna ścieżka `hl run`: prepare_file (odczyt, lint, parsowanie) + executor AST
+fn child_ast(file: &Path, args: &[String], t0: Instant, report: &mut std::fs::File) -> i32 {
+    let prepared = match hl_shell::prepare_file(file) {
+        Ok(p)  => p,
+        Err(e) => { eprintln!("{} {}", "BŁĄD:".red().bold(), e); return 1; }
+    };
+    send(report, t0.elapsed());
+    let t1 = Instant::now();
+    let code = crate::run_warm(file, &prepared, args);
+    send(report, t1.elapsed());
+    code
+}
+
+/// `hl run --jit`: compile_to_cache + odczyt .bc + linkowanie bibliotek
+/// + interpreter bytecode z JIT
+fn child_jit(file: &Path, args: &[String], t0: Instant, report: &mut std::fs::File) -> i32 {
+    let loaded = (|| -> Result<_> {
+        let source = std::fs::read_to_string(file)?;
+        let bc     = hl_compiler::compile_to_cache(&source, file)?;
+        let module = hl_compiler::read_bc_file(&bc)?;
+        let hash   = hl_compiler::source_hash(&source);
+        Ok(match hl_jit::libs::link_imports(&module, Some(hash))? {
+            Some((linked, key)) => (linked, key.unwrap_or(hash)),
+            None                => (module, hash),
+        })
+    })();
+    let (module, hash) = match loaded {
+        Ok(m)  => m,
+        Err(e) => { eprintln!("{} {}", "BŁĄD JIT:".red().bold(), e); return 1; }
+    };
+    hl_core::spawn::set_env("argc", &args.len().to_string());
+    for (i, arg) in args.iter().enumerate() {
+        hl_core::spawn::set_env(&format!("arg{}", i), arg);
+    }
+    let mut interp = match hl_jit::BytecodeInterpreter::new(&module) {
+        Ok(i)  => i,
+        Err(e) => { eprintln!("{} {}", "BŁĄD JIT:".red().bold(), e); return 1; }
+    };
+    interp.set_module_hash(hash);
+    send(report, t0.elapsed());
+
+    let t1 = Instant::now();
+    let code = interp.run().unwrap_or_else(|e| {
+        eprintln!("{} {}", "BŁĄD JIT:".red().bold(), e);
+        1
+    });
+    hl_jit::jit_cache::flush_stats();
+    send(report, t1.elapsed());
+    code
+}
+
@@ -0,0 +1,424 @@
+//! `hl daemon` — ciepły proces dla krótkich uruchomień `hl run`
+//!
+//! Demon trzyma sparsowane i zlintowane skrypty (do zmiany mtime/rozmiaru),
+//! AST main libs i stan leniwych cache (PATH, envp) w jednym procesie.
+//! `hl run` łączy się z gniazdem Unix, wysyła argv, cwd, środowisko i swoje
+//! fd 0/1/2 (SCM_RIGHTS), a demon forkuje workera: ten dziedziczy ciepły stan,
+//! podpina przekazane fd jako stdio i wykonuje skrypt. Klient czeka na kod
+//! wyjścia i przekazuje workerowi sygnały (Ctrl-C trafia do klienta, nie do
+//! workera spoza grupy procesów terminala). Worker zakłada własną sesję bez
+//! terminala sterującego, więc `/dev/tty` i sygnały zadań nie sięgają terminala,
+//! z którego wystartował demon. Skrypty interaktywne (stdin to terminal) idą
+//! dlatego lokalnie — dopiero tam mają swój terminal sterujący.
+//!
+//! Protokół (wszystkie liczby u32/i32 little-endian):
+//!   klient → demon: [len][rodzaj u8, flagi u8, plik, cwd, n_args, args..., n_env, k=v...]
+//!                   napis = [len][bajty], ramka `len` idzie razem z fd
+//!   demon → klient: [pid workera] … [kod wyjścia]
+//!
+//! Brak demona albo `HL_NO_DAEMON=1` — `hl run` działa jak dotąd, w swoim procesie.
+
+use anyhow::{bail, Context, Result};
+use hl_shell::{prepare_file, PreparedScript};
+use std::collections::HashMap;
+use std::ffi::OsString;
+use std::io::{self, Read, Write};
+use std::os::unix::ffi::{OsStrExt, OsStringExt};
+use std::os::unix::fs::PermissionsExt;
+use std::os::unix::io::{AsRawFd, RawFd};
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicI32, Ordering};
+use std::time::{Duration, SystemTime};
+
+const KIND_RUN:  u8 = 0;
+const KIND_STOP: u8 = 1;
+
+const FLAG_JIT:         u8 = 1 << 0;
+const FLAG_ARENA_STATS: u8 = 1 << 1;
+
+/// Górna granica ramki żądania (argv + środowisko)
+const MAX_REQUEST: usize = 4 << 20;
+
+/// Ile demon czeka na całe żądanie (SO_RCVTIMEO). Klient wysyła je od razu po
+/// połączeniu — połączenie, które milczy dłużej, nie może zablokować pętli accept.
+const REQUEST_TIMEOUT: Duration = Duration::from_secs(5);
+
+/// Ścieżka gniazda: `HL_DAEMON_SOCKET`, potem `$XDG_RUNTIME_DIR/hl-daemon.sock`,
+/// potem `~/.hackeros/hacker-lang/daemon.sock`
+pub fn socket_path() -> PathBuf {
+    if let Some(p) = std::env::var_os("HL_DAEMON_SOCKET") { return PathBuf::from(p); }
+    if let Some(d) = std::env::var_os("XDG_RUNTIME_DIR") { return Path::new(&d).join("hl-daemon.sock"); }
+    dirs::home_dir().unwrap_or_default().join(".hackeros/hacker-lang/daemon.sock")
+}
+
+// ── Klient ────────────────────────────────────────────────────────────────────
+
+/// Uruchomienie `hl run` do przekazania demonowi
+pub struct RunRequest<'a> {
+    pub file:        &'a Path,
+    pub args:        &'a [String],
+    pub jit:         bool,
+    pub arena_stats: bool,
+}
+
+/// Pid workera, któremu klient przekazuje sygnały
+static WORKER: AtomicI32 = AtomicI32::new(0);
+
+extern "C" fn forward_signal(sig: libc::c_int) {
+    let pid = WORKER.load(Ordering::Relaxed);
+    // SAFETY: kill jest async-signal-safe
+    if pid > 0 { unsafe { libc::kill(pid, sig); } }
+}
+
+/// Wykonaj skrypt przez demona. None — demon nie działa (albo wyłączony przez
+/// `HL_NO_DAEMON`), wołający uruchamia skrypt sam. Przy `HL_METRICS` też
+/// lokalnie — metryki mają opisywać ten skrypt, a nie proces demona. Tak samo,
+/// gdy stdin to terminal: worker nie ma terminala sterującego, więc `read`,
+/// `sudo` czy edytor działają poprawnie tylko w procesie klienta.
+pub fn try_run(req: &RunRequest) -> Option<i32> {
+    if std::env::var_os("HL_NO_DAEMON").is_some_and(|v| v != "0") { return None; }
+    if hl_core::metrics::enabled() { return None; }
+    // SAFETY: isatty tylko sprawdza fd 0
+    if unsafe { libc::isatty(0) } == 1 { return None; }
+    let mut sock = UnixStream::connect(socket_path()).ok()?;
+    let cwd = std::env::current_dir().ok()?;
+
+    let mut body = Vec::with_capacity(1024);
+    body.push(KIND_RUN);
+    body.push(if req.jit { FLAG_JIT } else { 0 } | if req.arena_stats { FLAG_ARENA_STATS } else { 0 });
+    put_bytes(&mut body, req.file.as_os_str().as_bytes());
+    put_bytes(&mut body, cwd.as_os_str().as_bytes());
+    body.extend_from_slice(&(req.args.len() as u32).to_le_bytes());
+    for a in req.args { put_bytes(&mut body, a.as_bytes()); }
+    let vars: Vec<(OsString, OsString)> = std::env::vars_os().collect();
+    body.extend_from_slice(&(vars.len() as u32).to_le_bytes());
+    for (k, v) in &vars {
+        let mut kv = k.as_bytes().to_vec();
+        kv.push(b'=');
+        kv.extend_from_slice(v.as_bytes());
+        put_bytes(&mut body, &kv);
+    }
+
+    let len = (body.len() as u32).to_le_bytes();
+    if send_with_fds(sock.as_raw_fd(), &len, &[0, 1, 2]).is_err() { return None; }
+    if sock.write_all(&body).is_err() { return None; }
+
+    // Od teraz skrypt należy do demona — brak odpowiedzi to błąd, nie fallback
+    let Ok(pid) = read_i32(&mut sock) else {
+        eprintln!("\x1b[31m[hl daemon]\x1b[0m Demon zamknął połączenie przed startem skryptu");
+        return Some(1);
+    };
+    WORKER.store(pid, Ordering::Relaxed);
+    for sig in [libc::SIGINT, libc::SIGTERM, libc::SIGHUP, libc::SIGQUIT] {
+        // SAFETY: handler tylko czyta atomik i woła kill
+        unsafe { libc::signal(sig, forward_signal as libc::sighandler_t); }
+    }
+    Some(read_i32(&mut sock).unwrap_or(1))
+}
+
+/// `hl daemon --stop`
+pub fn stop() -> Result<()> {
+    let path = socket_path();
+    let mut sock = UnixStream::connect(&path)
+        .with_context(|| format!("Demon nie działa ({})", path.display()))?;
+    let body = [KIND_STOP, 0];
+    send_with_fds(sock.as_raw_fd(), &(body.len() as u32).to_le_bytes(), &[])?;
+    sock.write_all(&body)?;
+    // Demon zamyka połączenie po usunięciu gniazda
+    let _ = sock.read(&mut [0u8; 1]);
+    Ok(())
+}
+
+// ── Serwer ────────────────────────────────────────────────────────────────────
+
+/// Ciepły wpis skryptu .hl — ważny, dopóki plik ma ten sam mtime i rozmiar
+struct Warm {
+    mtime:    SystemTime,
+    len:      u64,
+    prepared: PreparedScript,
+}
+
+struct Request {
+    kind:  u8,
+    flags: u8,
+    file:  PathBuf,
+    cwd:   PathBuf,
+    args:  Vec<String>,
+    env:   Vec<(OsString, OsString)>,
+    fds:   Vec<RawFd>,
+}
+
+/// `hl daemon` — pętla akceptująca połączenia (na pierwszym planie)
+pub fn serve() -> Result<()> {
+    let path = socket_path();
+    if UnixStream::connect(&path).is_ok() {
+        bail!("Demon już działa ({})", path.display());
+    }
+    // Gniazdo po poprzednim demonie, który nie posprzątał
+    let _ = std::fs::remove_file(&path);
+    if let Some(dir) = path.parent() { std::fs::create_dir_all(dir)?; }
+    let listener = UnixListener::bind(&path)
+        .with_context(|| format!("Nie można utworzyć gniazda {}", path.display()))?;
+    std::fs::set_permissions(&path, std::fs::Permissions::from_mode(0o600))?;
+
+    let libs = hl_core::preload_main_libs();
+    eprintln!("\x1b[36m[hl daemon]\x1b[0m Nasłuchuję na {} (main libs w cache: {})", path.display(), libs);
+
+    let mut warm: HashMap<PathBuf, Warm> = HashMap::new();
+    for conn in listener.incoming() {
+        let mut conn = match conn {
+            Ok(c)  => c,
+            Err(e) => { tracing::warn!("[hl daemon] accept: {}", e); continue; }
+        };
+        // recvmsg i read_exact na tym gnieździe kończą się EAGAIN po czasie
+        if let Err(e) = conn.set_read_timeout(Some(REQUEST_TIMEOUT)) {
+            tracing::warn!("[hl daemon] SO_RCVTIMEO: {}", e);
+            continue;
+        }
+        let req = match read_request(&mut conn) {
+            Ok(r)  => r,
+            Err(e) => { tracing::warn!("[hl daemon] błędne żądanie: {}", e); continue; }
+        };
+        if req.kind == KIND_STOP {
+            let _ = std::fs::remove_file(&path);
+            eprintln!("\x1b[36m[hl daemon]\x1b[0m Zatrzymany");
+            return Ok(());
+        }
+        if let Err(e) = dispatch(req, conn, &listener, &mut warm) {
+            tracing::warn!("[hl daemon] {}", e);
+        }
+    }
+    Ok(())
+}
+
+/// Rozgrzej skrypt, sforkuj workera i oddaj jego kod wyjścia klientowi
+fn dispatch(req: Request, mut conn: UnixStream, listener: &UnixListener, warm: &mut HashMap<PathBuf, Warm>) -> Result<()> {
+    let abs = req.cwd.join(&req.file);
+    let is_bc = abs.extension().and_then(|e| e.to_str()) == Some("bc");
+    if !is_bc && req.flags & FLAG_JIT == 0 {
+        refresh(warm, &abs);
+    }
+
+    // SAFETY: demon nie trzyma blokad między wątkami — wątki oczekujące na
+    // workerów robią tylko waitpid i zapis do swojego połączenia
+    let pid = unsafe { libc::fork() };
+    if pid < 0 {
+        close_all(&req.fds);
+        bail!("fork: {}", io::Error::last_os_error());
+    }
+    if pid == 0 {
+        let code = worker(&req, warm.get(&abs).map(|w| &w.prepared), listener, &conn);
+        let _ = io::stdout().flush();
+        std::process::exit(code);
+    }
+
+    close_all(&req.fds);
+    conn.write_all(&pid.to_le_bytes())?;
+    std::thread::spawn(move || {
+        let mut status = 0;
+        // SAFETY: pid to nasze dziecko, czekamy na nie dokładnie raz
+        let code = match unsafe { libc::waitpid(pid, &mut status, 0) } {
+            -1 => 1,
+            _ if libc::WIFEXITED(status)   => libc::WEXITSTATUS(status),
+            _ if libc::WIFSIGNALED(status) => 128 + libc::WTERMSIG(status),
+            _ => 1,
+        };
+        let _ = conn.write_all(&code.to_le_bytes());
+    });
+    Ok(())
+}
+
+fn refresh(warm: &mut HashMap<PathBuf, Warm>, abs: &Path) {
+    let Ok(meta) = std::fs::metadata(abs) else { warm.remove(abs); return };
+    let (Ok(mtime), len) = (meta.modified(), meta.len()) else { return };
+    if warm.get(abs).is_some_and(|w| w.mtime == mtime && w.len == len) { return; }
+    match prepare_file(abs) {
+        Ok(prepared) => { warm.insert(abs.to_path_buf(), Warm { mtime, len, prepared }); }
+        Err(_)       => { warm.remove(abs); }
+    }
+}
+
+/// Proces workera: stdio klienta, jego cwd i środowisko, potem zwykłe `hl run`
+fn worker(req: &Request, warm: Option<&PreparedScript>, listener: &UnixListener, conn: &UnixStream) -> i32 {
+    // SAFETY: fd odebrane przez SCM_RIGHTS należą do tego procesu; setsid
+    // w dziecku po fork zawsze się udaje (nie jest liderem grupy procesów)
+    unsafe {
+        // Nowa sesja bez terminala sterującego — `/dev/tty`, SIGHUP i sygnały
+        // zadań nie mogą dotknąć terminala demona
+        libc::setsid();
+        libc::close(listener.as_raw_fd());
+        libc::close(conn.as_raw_fd());
+        for (i, &fd) in req.fds.iter().take(3).enumerate() {
+            libc::dup2(fd, i as RawFd);
+        }
+    }
+    close_all(&req.fds);
+    if let Err(e) = std::env::set_current_dir(&req.cwd) {
+        eprintln!("\x1b[31m[hl daemon]\x1b[0m cwd {}: {}", req.cwd.display(), e);
+        return 1;
+    }
+    // Przez hl_core::spawn — unieważnia cache envp i PATH odziedziczone po demonie
+    let keep: std::collections::HashSet<&OsString> = req.env.iter().map(|(k, _)| k).collect();
+    for (k, _) in std::env::vars_os() {
+        if !keep.contains(&k) { hl_core::spawn::remove_env(&k.to_string_lossy()); }
+    }
+    for (k, v) in &req.env {
+        hl_core::spawn::set_env(&k.to_string_lossy(), &v.to_string_lossy());
+    }
+
+    let arena_stats = req.flags & FLAG_ARENA_STATS != 0;
+    if arena_stats { hl_core::arena::enable_stats(); }
+    let code = match warm {
+        Some(p) => crate::run_warm(&req.file, p, &req.args),
+        None    => crate::run_script(&req.file, &req.args, req.flags & FLAG_JIT != 0, false),
+    };
+    if arena_stats { crate::print_arena_stats(); }
+    code
+}
+
+fn read_request(conn: &mut UnixStream) -> Result<Request> {
+    let mut len = [0u8; 4];
+    let fds = recv_with_fds(conn.as_raw_fd(), &mut len, 3)?;
+    let len = u32::from_le_bytes(len) as usize;
+    if len > MAX_REQUEST || len < 2 {
+        close_all(&fds);
+        bail!("ramka {} B", len);
+    }
+    let mut body = vec![0u8; len];
+    if let Err(e) = conn.read_exact(&mut body) {
+        close_all(&fds);
+        return Err(e.into());
+    }
+    let mut req = Request {
+        kind: body[0], flags: body[1],
+        file: PathBuf::new(), cwd: PathBuf::new(), args: Vec::new(), env: Vec::new(),
+        fds,
+    };
+    if req.kind == KIND_STOP { return Ok(req); }
+    let parsed = (|| {
+        let mut rd = &body[2..];
+        req.file = PathBuf::from(OsString::from_vec(take_bytes(&mut rd)?));
+        req.cwd  = PathBuf::from(OsString::from_vec(take_bytes(&mut rd)?));
+        for _ in 0..take_u32(&mut rd)? {
+            req.args.push(String::from_utf8_lossy(&take_bytes(&mut rd)?).into_owned());
+        }
+        for _ in 0..take_u32(&mut rd)? {
+            let kv = take_bytes(&mut rd)?;
+            let eq = kv.iter().position(|&b| b == b'=').unwrap_or(kv.len());
+            let (k, v) = kv.split_at(eq);
+            req.env.push((OsString::from_vec(k.to_vec()), OsString::from_vec(v.get(1..).unwrap_or_default().to_vec())));
+        }
+        Some(())
+    })();
+    if parsed.is_none() || req.fds.len() != 3 {
+        close_all(&req.fds);
+        bail!("niepełne żądanie");
+    }
+    Ok(req)
+}
+
+// ── Kodowanie i SCM_RIGHTS ────────────────────────────────────────────────────
+
+fn put_bytes(out: &mut Vec<u8>, b: &[u8]) {
+    out.extend_from_slice(&(b.len() as u32).to_le_bytes());
+    out.extend_from_slice(b);
+}
+
+fn take_u32(rd: &mut &[u8]) -> Option<u32> {
+    let (head, tail) = rd.split_first_chunk::<4>()?;
+    *rd = tail;
+    Some(u32::from_le_bytes(*head))
+}
+
+fn take_bytes(rd: &mut &[u8]) -> Option<Vec<u8>> {
+    let n = take_u32(rd)? as usize;
+    if rd.len() < n { return None; }
+    let (b, tail) = rd.split_at(n);
+    *rd = tail;
+    Some(b.to_vec())
+}
+
+fn read_i32(r: &mut impl Read) -> io::Result<i32> {
+    let mut b = [0u8; 4];
+    r.read_exact(&mut b)?;
+    Ok(i32::from_le_bytes(b))
+}
+
+fn close_all(fds: &[RawFd]) {
+    // SAFETY: zamykamy tylko fd odebrane w tym procesie
+    for &fd in fds { unsafe { libc::close(fd); } }
+}
+
+/// Bufor na nagłówki cmsg — wyrównany jak `cmsghdr`
+fn cmsg_buf(n_fds: usize) -> Vec<u64> {
+    // SAFETY: CMSG_SPACE to czysta arytmetyka
+    let space = unsafe { libc::CMSG_SPACE((n_fds * std::mem::size_of::<RawFd>()) as u32) } as usize;
+    vec![0u64; space.div_ceil(8)]
+}
+
+fn send_with_fds(sock: RawFd, data: &[u8], fds: &[RawFd]) -> io::Result<()> {
+    let mut iov = libc::iovec { iov_base: data.as_ptr() as *mut _, iov_len: data.len() };
+    let mut cbuf = cmsg_buf(fds.len());
+    // SAFETY: msghdr wskazuje na iov i cbuf, które żyją do końca sendmsg
+    let n = unsafe {
+        let mut msg: libc::msghdr = std::mem::zeroed();
+        msg.msg_iov    = &mut iov;
+        msg.msg_iovlen = 1;
+        if !fds.is_empty() {
+            let bytes = std::mem::size_of_val(fds);
+            msg.msg_control    = cbuf.as_mut_ptr() as *mut _;
+            msg.msg_controllen = libc::CMSG_SPACE(bytes as u32) as _;
+            let cmsg = libc::CMSG_FIRSTHDR(&msg);
+            (*cmsg).cmsg_level = libc::SOL_SOCKET;
+            (*cmsg).cmsg_type  = libc::SCM_RIGHTS;
+            (*cmsg).cmsg_len   = libc::CMSG_LEN(bytes as u32) as _;
+            std::ptr::copy_nonoverlapping(fds.as_ptr(), libc::CMSG_DATA(cmsg) as *mut RawFd, fds.len());
+        }
+        libc::sendmsg(sock, &msg, 0)
+    };
+    if n < 0 { return Err(io::Error::last_os_error()); }
+    if n as usize != data.len() { return Err(io::Error::new(io::ErrorKind::WriteZero, "sendmsg: niepełny zapis")); }
+    Ok(())
+}
+
+/// Odbierz dokładnie `buf.len()` bajtów; fd przychodzą z pierwszym fragmentem
+fn recv_with_fds(sock: RawFd, buf: &mut [u8], max_fds: usize) -> io::Result<Vec<RawFd>> {
+    let mut cbuf = cmsg_buf(max_fds);
+    let mut fds = Vec::new();
+    let mut got = 0;
+    while got < buf.len() {
+        let mut iov = libc::iovec { iov_base: buf[got..].as_mut_ptr() as *mut _, iov_len: buf.len() - got };
+        // SAFETY: msghdr wskazuje na iov i cbuf, które żyją do końca recvmsg
+        let n = unsafe {
+            let mut msg: libc::msghdr = std::mem::zeroed();
+            msg.msg_iov        = &mut iov;
+            msg.msg_iovlen     = 1;
+            msg.msg_control    = cbuf.as_mut_ptr() as *mut _;
+            msg.msg_controllen = (cbuf.len() * 8) as _;
+            let n = libc::recvmsg(sock, &mut msg, libc::MSG_CMSG_CLOEXEC);
+            if n > 0 {
+                let mut cmsg = libc::CMSG_FIRSTHDR(&msg);
+                while !cmsg.is_null() {
+                    if (*cmsg).cmsg_level == libc::SOL_SOCKET && (*cmsg).cmsg_type == libc::SCM_RIGHTS {
+                        let data = libc::CMSG_DATA(cmsg) as *const RawFd;
+                        let count = ((*cmsg).cmsg_len as usize - libc::CMSG_LEN(0) as usize) / std::mem::size_of::<RawFd>();
+                        for i in 0..count { fds.push(*data.add(i)); }
+                    }
+                    cmsg = libc::CMSG_NXTHDR(&msg, cmsg);
+                }
+            }
+            n
+        };
+        if n < 0 {
+            close_all(&fds);
+            return Err(io::Error::last_os_error());
+        }
+        if n == 0 {
+            close_all(&fds);
+            return Err(io::ErrorKind::UnexpectedEof.into());
+        }
+        got += n as usize;
+    }
+    Ok(fds)
+}
@@ -14,6 +14,9 @@ use hl_shell::{run_interactive, run_as_shell};
 use std::path::{Path, PathBuf};
 use tracing_subscriber::{EnvFilter, fmt};
 
+mod bench;
+mod daemon;
+
 const HL_SCRIPTS_DIR: &str = "/usr/share/HackerOS/Scripts/Bin";
 const HL_MAIN_LIBS_DIR: &str = "/usr/lib/HackerOS/Hacker-Lang/main-libs";
 
@@ -53,9 +56,30 @@ BYTECODE / JIT:
 hl run plik.hl       Uruchom skrypt (domyślnie: tree-walk interpreter)
 hl run --jit plik.hl Uruchom przez JIT pipeline (eksperymentalny)
 hl run plik.bc       Uruchom bytecode bezpośrednio przez JIT
+hl run --arena-stats plik.hl   Statystyki aren po zakończeniu
+hl run --profile plik.hl       Profil linii/funkcji/tras JIT + plik folded (flamegraph)
+hl bench plik.hl     N przebiegów (fork na przebieg): p50/p99 startu i wykonania
+hl bench -n 100 --jit plik.hl  To samo dla ścieżki JIT (cache .bc po rozgrzewce)
 hl compile plik.hl   Kompiluj .hl → .bc (do katalogu źródłowego)
+hl compile --format=flat plik.hl   Płaski .bc (mmap, szybszy start)
+hl compile -O0 plik.hl   Bez optymalizacji (-O1: bez LICM i łączenia rejestrów)
+hl compile src/ 'lib/**/*.hl'   Wiele plików równolegle; niezmienione pomijane (.hl-build.json)
+hl compile --native plik.hl     Natywny plik wykonywalny (pętle AOT, link z libhl_rt.a)
+hl compile --native --shared plik.hl   Biblioteka .so z eksportem hl_main
+hl check src/ 'lib/**/*.hl'     Składnia + lint równolegle; wyniki w cache wg treści pliku
+hl check --watch src/           Sprawdzaj ponownie zmienione pliki (inotify)
 hl clean             Wyczyść cache .bc (~/.hackeros/hacker-lang/cache/)
 
+DEMON:
+hl daemon            Ciepły proces dla `hl run` (gniazdo w $XDG_RUNTIME_DIR)
+hl daemon --stop     Zatrzymaj demona
+HL_NO_DAEMON=1       Uruchamiaj lokalnie mimo działającego demona
+
+METRYKI:
+HL_METRICS=json|openmetrics   Liczniki i histogramy runtime przy wyjściu
+HL_METRICS_ADDR=<ścieżka|unix:ścieżka|tcp:host:port>   Cel zrzutu (domyślnie stderr)
+HL_METRICS_INTERVAL=<sekundy>  Dodatkowo zrzucaj okresowo (długie skrypty)
+
 PRZYKŁADY:
 hl run skrypt.hl
 hl exec update-system
@@ -88,17 +112,69 @@ enum Commands {
         /// Użyj JIT pipeline zamiast tree-walk (eksperymentalny)
         #[arg(long)]
         jit: bool,
+        /// Po zakończeniu wypisz statystyki aren (`:: nazwa <rozmiar> def`)
+        #[arg(long)]
+        arena_stats: bool,
+        /// Profiluj (interpreter bytecode): raport linii/funkcji/tras na stderr + plik folded
+        #[arg(long)]
+        profile: bool,
+        /// Plik folded dla --profile (domyślnie <nazwa>.folded)
+        #[arg(long, value_name = "FILE")]
+        profile_out: Option<PathBuf>,
+        /// Liczba wierszy w tabelach --profile
+        #[arg(long, value_name = "N", default_value_t = 20)]
+        profile_top: usize,
         #[arg(last = true)]
         args: Vec<String>,
     },
 
-    /// Kompiluj .hl → .bc
-    Compile {
+    /// Zmierz skrypt: N przebiegów, p50/p99 czasu startu i wykonania
+    Bench {
         file: PathBuf,
+        /// Liczba mierzonych przebiegów
+        #[arg(short = 'n', long, value_name = "N", default_value_t = 20)]
+        runs: usize,
+        /// Przebiegi rozgrzewające (poza statystykami)
+        #[arg(long, value_name = "N", default_value_t = 2)]
+        warmup: usize,
+        /// Mierz ścieżkę JIT (compile_to_cache + interpreter bytecode)
+        #[arg(long)]
+        jit: bool,
+        /// Nie wyciszaj stdout/stderr skryptu
         #[arg(long)]
+        show_output: bool,
+        #[arg(last = true)]
+        args: Vec<String>,
+    },
+
+    /// Kompiluj .hl → .bc (plik, katalog albo glob; wiele wejść — równolegle)
+    Compile {
+        #[arg(required = true, value_name = "FILE|DIR|GLOB")]
+        inputs: Vec<PathBuf>,
+        /// Natywny plik wykonywalny zamiast .bc (pętle skompilowane zawczasu)
+        #[arg(long)]
+        native: bool,
+        /// Z --native: biblioteka współdzielona .so (eksport hl_main)
+        #[arg(long, requires = "native")]
         shared: bool,
+        /// Plik wyjściowy; przy wielu wejściach — katalog wyjściowy
         #[arg(short, long)]
         output: Option<PathBuf>,
+        /// Liczba wątków kompilacji (domyślnie wszystkie rdzenie)
+        #[arg(short = 'j', long, value_name = "N", default_value_t = 0)]
+        jobs: usize,
+        /// Manifest budowania (domyślnie .hl-build.json w bieżącym katalogu)
+        #[arg(long, value_name = "FILE")]
+        manifest: Option<PathBuf>,
+        /// Kompiluj wszystko, ignorując manifest
+        #[arg(long)]
+        force: bool,
+        /// Format .bc: bincode (domyślny) lub flat (mmap, odczyt w miejscu)
+        #[arg(long, value_name = "FORMAT", default_value = "bincode")]
+        format: String,
+        /// Poziom optymalizacji: 0, 1 lub 2 (domyślny)
+        #[arg(short = 'O', value_name = "LEVEL", default_value = "2")]
+        opt: String,
     },
 
     /// Uruchom skrypt z /usr/share/HackerOS/Scripts/Bin/ po nazwie (bez .hl)
@@ -122,11 +198,21 @@ enum Commands {
         command: Option<String>,
     },
 
-    /// Sprawdź składnię (bez uruchamiania)
+    /// Sprawdź składnię i lint (bez uruchamiania); wiele wejść — równolegle
     Check {
-        file: PathBuf,
+        #[arg(required = true, value_name = "FILE|DIR|GLOB")]
+        inputs: Vec<PathBuf>,
         #[arg(long)]
         meta: bool,
+        /// Liczba wątków (domyślnie wszystkie rdzenie)
+        #[arg(short = 'j', long, value_name = "N", default_value_t = 0)]
+        jobs: usize,
+        /// Po sprawdzeniu obserwuj pliki i sprawdzaj ponownie zmienione
+        #[arg(long)]
+        watch: bool,
+        /// Nie używaj cache wyników (check.json)
+        #[arg(long)]
+        no_cache: bool,
     },
 
     /// Wydrukuj AST jako JSON
@@ -135,6 +221,13 @@ enum Commands {
     /// Wyczyść cache bytecode + bibliotek
     Clean,
 
+    /// Ciepły demon dla `hl run` (parsowanie i main libs raz, fork na skrypt)
+    Daemon {
+        /// Zatrzymaj działającego demona
+        #[arg(long)]
+        stop: bool,
+    },
+
     /// Informacje o cache bytecode
     CacheInfo,
 
@@ -196,6 +289,8 @@ fn main() -> Result<()> {
     fmt().with_env_filter(
         if cli.verbose { EnvFilter::new("debug") } else { EnvFilter::new("warn") }
     ).without_time().compact().init();
+    hl_core::metrics::init();
+    hl_core::metrics::add_collector(hl_jit::collect_metrics);
 
     match cli.command {
 
@@ -207,8 +302,20 @@ fn main() -> Result<()> {
             cmd_search(&query);
         }
 
-        Some(Commands::Compile { file, shared: _, output }) => {
-            cmd_compile(&file, output.as_deref())?;
+        Some(Commands::Compile { inputs, native, shared, output, jobs, manifest, force, format, opt }) => {
+            let single = inputs.len() == 1 && inputs[0].is_file();
+            if native {
+                if !single {
+                    eprintln!("{} --native przyjmuje dokładnie jeden plik .hl lub .bc", "BŁĄD".red().bold());
+                    std::process::exit(1);
+                }
+                cmd_compile_native(&inputs[0], output.as_deref(), shared, &opt);
+            } else if single {
+                cmd_compile(&inputs[0], output.as_deref(), &format, &opt)?;
+            } else {
+                let manifest = manifest.unwrap_or_else(|| PathBuf::from(hl_compiler::MANIFEST_FILE));
+                std::process::exit(cmd_compile_many(&inputs, output.as_deref(), jobs, &manifest, force, &format, &opt));
+            }
         }
 
         Some(Commands::Docs) => run_docs(),
@@ -288,58 +395,42 @@ fn main() -> Result<()> {
         // ── hl run ───────────────────────────────────────────────────────────
         // Domyślnie: tree-walk interpreter (sprawdzony, poprawnie obsługuje @VAR)
         // --jit: eksperymentalny JIT pipeline (compile→cache→bytecode)
-        Some(Commands::Run { file, jit, args }) => {
-            let exit_code = if jit && file.extension().and_then(|e| e.to_str()) != Some("bc") {
-                // JIT pipeline — tylko gdy jawnie włączony i plik nie jest .bc
-                run_file_jit(&file, &args, cli.verbose)
-            } else if file.extension().and_then(|e| e.to_str()) == Some("bc") {
-                // .bc plik — zawsze przez JIT interpreter
-                run_bc_direct(&file, &args)
-            } else {
-                // Tree-walk interpreter — domyślny, stabilny
-                let mut env = Env::new();
-                inject_args(&mut env, &args);
-                run_file_with_diag(&file, &mut env, cli.verbose)
-            };
+        // Działający `hl daemon` przejmuje uruchomienie (poza --verbose)
+        Some(Commands::Run { file, jit, arena_stats, profile, profile_out, profile_top, args }) => {
+            // Profil zawsze lokalnie — demon nie odda próbek
+            if profile {
+                let opts = hl_jit::ProfileOpts { out: profile_out, top: profile_top };
+                let code = hl_jit::run_profiled(&file, &args, &opts).unwrap_or_else(|e| {
+                    eprintln!("{} {}", "BŁĄD profilu:".red().bold(), e);
+                    1
+                });
+                std::process::exit(code);
+            }
+            if !cli.verbose {
+                let req = daemon::RunRequest { file: &file, args: &args, jit, arena_stats };
+                if let Some(code) = daemon::try_run(&req) { std::process::exit(code); }
+            }
+            if arena_stats { hl_core::arena::enable_stats(); }
+            let exit_code = run_script(&file, &args, jit, cli.verbose);
+            if arena_stats { print_arena_stats(); }
             std::process::exit(exit_code);
         }
 
-        Some(Commands::Check { file, meta: show_meta }) => {
-            let source = std::fs::read_to_string(&file)?;
-            let fname  = file.file_name().and_then(|n| n.to_str()).unwrap_or("<unknown>");
-            let renderer = DiagRenderer::new(fname, &source);
-            let mut exit_code = 0i32;
-
-            let mut lint_diags = lint_source(&source);
-            lint_diags.extend(lint_gen(&source));
-
-            if !lint_diags.is_empty() {
-                renderer.emit_all(&lint_diags);
-                let sum = DiagSummary::from_diags(&lint_diags);
-                sum.print();
-                if sum.has_errors() { exit_code = 2; }
-            }
+        Some(Commands::Bench { file, runs, warmup, jit, show_output, args }) => {
+            let opts = bench::BenchOpts { runs, warmup, jit, show_output };
+            let code = bench::run(&file, &args, &opts).unwrap_or_else(|e| {
+                eprintln!("{} {}", "BŁĄD bench:".red().bold(), e);
+                1
+            });
+            std::process::exit(code);
+        }
 
-            if exit_code == 0 {
-                match parse_source_with_meta(&source) {
-                    Ok(meta) => {
-                        println!("{} {} ({} węzłów, gen {}, {} ostrzeżeń)",
-                                 "OK".green().bold(),
-                                 file.display().to_string().bright_white(),
-                                 meta.nodes.len(),
-                                 meta.gen.number(),
-                                 lint_diags.len());
-                        if show_meta {
-                            println!("  Gen:     {}", format!("gen {}", meta.gen.number()).bright_magenta());
-                            if let Some(sb) = &meta.shebang {
-                                println!("  Shebang: {}", sb.raw.bright_black());
-                            }
-                        }
-                    }
-                    Err(e) => { renderer.emit(&parse_error_to_diag(&e)); exit_code = 1; }
-                }
-            }
-            std::process::exit(exit_code);
+        Some(Commands::Daemon { stop }) => {
+            if stop { daemon::stop()?; } else { daemon::serve()?; }
+        }
+
+        Some(Commands::Check { inputs, meta: show_meta, jobs, watch, no_cache }) => {
+            std::process::exit(cmd_check(&inputs, show_meta, jobs, watch, !no_cache));
         }
 
         Some(Commands::Ast { file }) => {
@@ -400,13 +491,11 @@ fn main() -> Result<()> {
                     eprintln!("{} Plik nie istnieje: {}", "BŁĄD".red().bold(), file.display());
                     std::process::exit(1);
                 }
-                // .bc → JIT, wszystko inne → tree-walk
-                if file.extension().and_then(|e| e.to_str()) == Some("bc") {
-                    std::process::exit(run_bc_direct(&file, &cli.script_args));
+                if !cli.verbose {
+                    let req = daemon::RunRequest { file: &file, args: &cli.script_args, jit: false, arena_stats: false };
+                    if let Some(code) = daemon::try_run(&req) { std::process::exit(code); }
                 }
-                let mut env = Env::new();
-                inject_args(&mut env, &cli.script_args);
-                std::process::exit(run_file_with_diag(&file, &mut env, cli.verbose));
+                std::process::exit(run_script(&file, &cli.script_args, false, cli.verbose));
             } else {
                 let mut env = Env::new();
                 run_interactive(&mut env)?;
@@ -419,12 +508,14 @@ fn main() -> Result<()> {
 
 // ── hl compile ────────────────────────────────────────────────────────────────
 
-fn cmd_compile(file: &Path, output: Option<&Path>) -> Result<()> {
+fn cmd_compile(file: &Path, output: Option<&Path>, format: &str, opt: &str) -> Result<()> {
     if !file.exists() {
         eprintln!("{} Plik nie istnieje: {}", "BŁĄD".red().bold(), file.display());
         std::process::exit(1);
     }
 
+    let opts = compile_opts(format, opt);
+
     let ext = file.extension().and_then(|e| e.to_str()).unwrap_or("");
 
     match ext {
@@ -434,7 +525,7 @@ fn cmd_compile(file: &Path, output: Option<&Path>) -> Result<()> {
                       file.display().to_string().bright_white());
 
             let t0 = std::time::Instant::now();
-            match hl_compiler::compile_hl_to_bc(file, output) {
+            match hl_compiler::compile_hl_to_bc_with(file, output, &opts) {
                 Ok(bc_path) => {
                     let elapsed = t0.elapsed();
                     println!("{} {} ({:.1}ms)",
@@ -449,9 +540,11 @@ fn cmd_compile(file: &Path, output: Option<&Path>) -> Result<()> {
             }
         }
         "bc" => {
-            eprintln!("{} Kompilacja .bc → ELF nie jest jeszcze dostępna w gen 2.",
-                      "hl compile:".bright_magenta().bold());
-            eprintln!("  Użyj {} aby uruchomić bytecode.",
+            eprintln!("{} {} jest już skompilowany do .bc.",
+                      "hl compile:".bright_magenta().bold(),
+                      file.display().to_string().bright_white());
+            eprintln!("  Użyj {} (plik wykonywalny) lub {} (uruchomienie).",
+                      "hl compile --native plik.bc".bright_cyan(),
                       "hl run plik.bc".bright_cyan());
             std::process::exit(1);
         }
@@ -464,8 +557,254 @@ fn cmd_compile(file: &Path, output: Option<&Path>) -> Result<()> {
     Ok(())
 }
 
+/// `hl compile --native` — .hl lub .bc → plik wykonywalny / .so
+/// (patrz `hl_jit::aot`); błąd kończy proces
+fn cmd_compile_native(file: &Path, output: Option<&Path>, shared: bool, opt: &str) {
+    if !file.exists() {
+        eprintln!("{} Plik nie istnieje: {}", "BŁĄD".red().bold(), file.display());
+        std::process::exit(1);
+    }
+    let opts = compile_opts("bincode", opt);
+
+    let module = match file.extension().and_then(|e| e.to_str()).unwrap_or("") {
+        "hl" => std::fs::read_to_string(file)
+            .map_err(anyhow::Error::from)
+            .and_then(|src| hl_compiler::compile_source_to_module(&src, file, opts.opt_level)),
+        "bc" => hl_compiler::read_bc_file(file),
+        other => {
+            eprintln!("{} Nieznane rozszerzenie: .{}", "BŁĄD".red().bold(), other);
+            std::process::exit(1);
+        }
+    };
+    let module = module.unwrap_or_else(|e| {
+        eprintln!("{} {}", "BŁĄD kompilacji:".red().bold(), e);
+        std::process::exit(1);
+    });
+
+    let stem = file.file_stem().and_then(|s| s.to_str()).unwrap_or("a.out");
+    let out = output.map(Path::to_path_buf).unwrap_or_else(|| {
+        file.with_file_name(if shared { format!("{}.so", stem) } else { stem.to_string() })
+    });
+
+    eprintln!("{} {} → {}",
+              "hl compile:".bright_magenta().bold(),
+              file.display().to_string().bright_white(),
+              if shared { ".so" } else { "ELF" });
+
+    let t0 = std::time::Instant::now();
+    match hl_jit::aot::build_native(&module, &out, shared) {
+        Ok(traces) => {
+            println!("{} {} ({} {}, {:.1}ms)",
+                     "✓".green().bold(),
+                     out.display().to_string().bright_white(),
+                     traces,
+                     if traces == 1 { "pętla natywnie" } else { "pętli natywnie" },
+                     t0.elapsed().as_secs_f64() * 1000.0);
+        }
+        Err(e) => {
+            eprintln!("{} {}", "BŁĄD kompilacji:".red().bold(), e);
+            std::process::exit(1);
+        }
+    }
+}
+
+/// `--format` i `-O` → opcje kompilatora; nieznana wartość kończy proces
+fn compile_opts(format: &str, opt: &str) -> hl_compiler::CompileOptions {
+    let Some(format) = hl_compiler::BcFormat::from_str(format) else {
+        eprintln!("{} Nieznany format .bc: {} (dostępne: bincode, flat)",
+                  "BŁĄD".red().bold(), format.bright_yellow());
+        std::process::exit(1);
+    };
+    let Some(opt_level) = hl_compiler::OptLevel::from_str(opt) else {
+        eprintln!("{} Nieznany poziom optymalizacji: -O{} (dostępne: -O0, -O1, -O2)",
+                  "BŁĄD".red().bold(), opt.bright_yellow());
+        std::process::exit(1);
+    };
+    hl_compiler::CompileOptions { format, opt_level }
+}
+
+/// `hl compile <katalog|glob>...` — równolegle, z grafem importów i manifestem
+/// (patrz `hl_compiler::batch`). Zwraca kod wyjścia.
+fn cmd_compile_many(
+    args:     &[PathBuf],
+    out_dir:  Option<&Path>,
+    jobs:     usize,
+    manifest: &Path,
+    force:    bool,
+    format:   &str,
+    opt:      &str,
+) -> i32 {
+    use hl_compiler::batch::Status;
+    let compile = compile_opts(format, opt);
+    let inputs = match hl_compiler::expand_inputs(args, out_dir) {
+        Ok(i)  => i,
+        Err(e) => { eprintln!("{} {}", "BŁĄD".red().bold(), e); return 1; }
+    };
+    if inputs.is_empty() {
+        eprintln!("{} brak plików .hl", "hl compile:".bright_magenta().bold());
+        return 1;
+    }
+
+    // Biblioteki spoza budowania: main/ i bit/ z dysku; GitHub bez klonowania
+    let resolve = |spec: &str| match hl_core::libs::parse_import_spec(spec) {
+        Some(hl_core::libs::ImportSource::GitHub { .. }) | None => None,
+        Some(_) => hl_core::locate_import(spec).ok().and_then(|t| t.file),
+    };
+    let opts = hl_compiler::BatchOptions { compile, jobs, manifest: manifest.to_path_buf(), force, resolve: &resolve };
+
+    let t0 = std::time::Instant::now();
+    let report = match hl_compiler::compile_batch(&inputs, &opts) {
+        Ok(r)  => r,
+        Err(e) => { eprintln!("{} {}", "BŁĄD kompilacji:".red().bold(), e); return 1; }
+    };
+
+    let (mut fresh, mut cached, mut compiled) = (0, 0, 0);
+    for (input, status) in &report.results {
+        let path = input.path.display().to_string();
+        match status {
+            Status::Fresh    => fresh += 1,
+            Status::Cached   => { cached += 1; println!("{} {} (cache)", "✓".green().bold(), input.out.display()); }
+            Status::Compiled => { compiled += 1; println!("{} {}", "✓".green().bold(), input.out.display()); }
+            Status::Failed(e)  => eprintln!("{} {}: {}", "✗".red().bold(), path.bright_white(), e),
+            Status::Blocked(d) => eprintln!("{} {}: pominięty, zależność {} się nie skompilowała",
+                                            "✗".red().bold(), path.bright_white(), d.display()),
+        }
+    }
+    if !report.cycles.is_empty() {
+        eprintln!("{} cykl importów: {}", "UWAGA".yellow().bold(),
+                  report.cycles.iter().map(|p| p.display().to_string()).collect::<Vec<_>>().join(", "));
+    }
+    let failed = report.failed();
+    eprintln!("{} {} plików: {} skompilowanych, {} z cache, {} aktualnych, {} błędów ({} fal, {:.1}ms)",
+              "hl compile:".bright_magenta().bold(), report.results.len(),
+              compiled, cached, fresh, failed, report.waves, t0.elapsed().as_secs_f64() * 1000.0);
+    if failed > 0 { 1 } else { 0 }
+}
+
+/// `hl check` dla plików, katalogów i globów. Kod wyjścia: 2 — błędy lint,
+/// 1 — błąd składni albo odczytu, 0 — OK. `--watch` nie kończy się sam.
+fn cmd_check(args: &[PathBuf], show_meta: bool, jobs: usize, watch: bool, cache: bool) -> i32 {
+    use hl_core::check::{check_files, CheckOptions, Watcher};
+    let opts = CheckOptions { jobs, cache };
+    let single = args.len() == 1 && args[0].is_file();
+    let expand = || hl_compiler::expand_inputs(args, None)
+    .map(|inputs| inputs.into_iter().map(|i| i.path).collect::<Vec<_>>());
+    let paths = match expand() {
+        Ok(p)  => p,
+        Err(e) => { eprintln!("{} {}", "BŁĄD".red().bold(), e); return 1; }
+    };
+    if paths.is_empty() && !watch {
+        eprintln!("{} brak plików .hl", "hl check:".bright_magenta().bold());
+        return 1;
+    }
+
+    let code = report_check(&check_files(&paths, &opts), single, show_meta);
+    if !watch { return code; }
+
+    let mut watcher = match Watcher::new(args) {
+        Ok(w)  => w,
+        Err(e) => { eprintln!("{} {}", "BŁĄD".red().bold(), e); return 1; }
+    };
+    eprintln!("{} obserwuję {} plików (Ctrl+C kończy)", "hl check:".bright_magenta().bold(), paths.len());
+    // Ścieżki z inotify i z `expand_inputs` mogą różnić się prefiksem `./`
+    let key = |p: &Path| p.components().filter(|c| *c != std::path::Component::CurDir).collect::<PathBuf>();
+    loop {
+        let changed = match watcher.wait(std::time::Duration::from_millis(100)) {
+            Ok(c)  => c,
+            Err(e) => { eprintln!("{} {}", "BŁĄD".red().bold(), e); return 1; }
+        };
+        // Ponowne rozwinięcie wejść: nowe pliki w katalogach i globach
+        let current = expand().unwrap_or_default();
+        let mut live = Vec::new();
+        for p in &changed {
+            match current.iter().find(|c| key(c.as_path()) == key(p.as_path())) {
+                Some(c) => live.push(c.clone()),
+                None if !p.exists() => eprintln!("{} {} usunięty", "-".bright_black(), p.display()),
+                None => {}
+            }
+        }
+        if !live.is_empty() { report_check(&check_files(&live, &opts), single, show_meta); }
+    }
+}
+
+/// Wypisz diagnostyki w kolejności plików; przy wielu plikach — podsumowanie
+/// zamiast linii OK dla każdego
+fn report_check(results: &[hl_core::check::Checked], single: bool, show_meta: bool) -> i32 {
+    let mut exit_code = 0i32;
+    let (mut failed, mut cached, mut diags) = (0usize, 0usize, 0usize);
+    for c in results {
+        let name = if single {
+            c.path.file_name().and_then(|n| n.to_str()).unwrap_or("<unknown>").to_string()
+        } else {
+            c.path.display().to_string()
+        };
+        let check = match &c.result {
+            Ok(r)  => r,
+            Err(e) => {
+                eprintln!("{} {}: {}", "✗".red().bold(), name.bright_white(), e);
+                failed += 1;
+                exit_code = exit_code.max(1);
+                continue;
+            }
+        };
+        let renderer = DiagRenderer::new(&name, &c.source);
+        if !check.lint.is_empty() {
+            renderer.emit_all(&check.lint);
+            DiagSummary::from_diags(&check.lint).print();
+        }
+        if let Some(d) = &check.syntax { renderer.emit(d); }
+        diags += check.lint.len();
+        if c.cached { cached += 1; }
+
+        let code = check.exit_code();
+        exit_code = exit_code.max(code);
+        if code != 0 { failed += 1; continue; }
+        if single {
+            println!("{} {} ({} węzłów, gen {}, {} ostrzeżeń)",
+                     "OK".green().bold(),
+                     c.path.display().to_string().bright_white(),
+                     check.nodes,
+                     check.gen,
+                     check.lint.len());
+            if show_meta {
+                println!("  Gen:     {}", format!("gen {}", check.gen).bright_magenta());
+                if let Some(sb) = &check.shebang {
+                    println!("  Shebang: {}", sb.bright_black());
+                }
+            }
+        }
+    }
+    if !single {
+        eprintln!("{} {} plików: {} z błędami, {} diagnostyk, {} z cache",
+                  "hl check:".bright_magenta().bold(), results.len(), failed, diags, cached);
+    }
+    exit_code
+}
+
 // ── Uruchamianie plików ───────────────────────────────────────────────────────
 
+/// `hl run` bez demona: .bc → JIT interpreter, --jit → JIT pipeline,
+/// wszystko inne → tree-walk (domyślny, stabilny)
+fn run_script(file: &Path, args: &[String], jit: bool, verbose: bool) -> i32 {
+    if file.extension().and_then(|e| e.to_str()) == Some("bc") {
+        run_bc_direct(file, args)
+    } else if jit {
+        run_file_jit(file, args, verbose)
+    } else {
+        let mut env = Env::new();
+        inject_args(&mut env, args);
+        run_file_with_diag(file, &mut env, verbose)
+    }
+}
+
+/// Worker demona: skrypt już zlintowany i sparsowany w procesie demona
+fn run_warm(file: &Path, prepared: &hl_shell::PreparedScript, args: &[String]) -> i32 {
+    let mut env = Env::new();
+    inject_args(&mut env, args);
+    env.set_var("HL_SCRIPT", hl_core::Value::String(file.display().to_string()));
+    hl_shell::run_prepared(prepared, &mut env)
+}
+
 /// Uruchom plik .bc bezpośrednio przez JIT (bez kompilacji)
 fn run_bc_direct(file: &Path, args: &[String]) -> i32 {
     match hl_jit::run_bc_file(file, args) {
@@ -644,10 +983,13 @@ fn run_source_with_diag(fname: &str, source: &str, env: &mut Env) -> i32 {
         if sum.has_errors() { return 2; }
     }
     if let Err(e) = check_source(source) { renderer.emit(&parse_error_to_diag(&e)); return 2; }
-    match run_source(source, env) {
+    let code = match run_source(source, env) {
         Ok(r)  => r.exit_code,
         Err(e) => { renderer.emit(&hl_core::Diag::error(e.to_string())); 1 }
-    }
+    };
+    // Skrypt kończy się razem z ostatnią goroutine
+    if let Err(e) = hl_core::goroutine::wait_all() { renderer.emit(&hl_core::Diag::error(e.to_string())); }
+    code
 }
 
 fn inject_args(env: &mut Env, args: &[String]) {
@@ -661,6 +1003,27 @@ fn inject_args_env(env: &mut Env, args: &[String]) {
     inject_args(env, args);
 }
 
+/// `hl run --arena-stats` — podsumowanie aren na stderr (żeby nie mieszać
+/// się z wyjściem skryptu)
+fn print_arena_stats() {
+    let report = hl_core::arena::take_report();
+    eprintln!("{}", "=== Areny ===".bright_cyan().bold());
+    if report.is_empty() {
+        eprintln!("  {}", "Brak wywołań arena functions.".bright_black());
+        return;
+    }
+    for (name, t) in report {
+        eprintln!("  {} {} wywołań, rozmiar {} B, szczyt {} B, średnio {} B",
+                  format!("::{}", name).bright_white().bold(),
+                  t.calls, t.capacity, t.peak_used, t.total_used / t.calls.max(1));
+        eprintln!("      {} alokacji, {} B skopiowane na heap{}",
+                  t.alloc_count, t.escaped,
+                  if t.overflows > 0 {
+                      format!(", {} przepełnień → heap", t.overflows).yellow().to_string()
+                  } else { String::new() });
+    }
+}
+
 fn run_docs() {
     const DOCS_BIN: &str = "/usr/lib/HackerOS/Hacker-Lang/hl-docs";
     if !std::path::Path::new(DOCS_BIN).exists() {
@@ -704,6 +1067,7 @@ fn print_version() {
     println!();
     println!("{}", "Bytecode:".bright_yellow());
     println!("  hl compile plik.hl    -- .hl → .bc");
+    println!("  hl compile -O1 plik.hl -- poziom optymalizacji 0/1/2");
     println!("  hl run plik.bc        -- uruchom .bc przez JIT");
     println!("  hl run --jit plik.hl  -- JIT pipeline (eksperymentalny)");
     println!("  hl clean              -- wyczyść cache .bc");
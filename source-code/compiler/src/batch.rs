@@ -0,0 +1,526 @@
+//! Kompilacja wielu plików: `hl compile <katalog|glob>...`
+//!
+//! 1. Wejścia: katalogi (rekurencyjnie `*.hl`), globy (`src/**/*.hl`) i pliki.
+//! 2. Skan (równolegle): odczyt, hash treści, importy z leksera — `# <main/x>`
+//!    i `<< plik.hl` — rozwiązane do plików (graf zależności).
+//! 3. Kompilacja falami: plik trafia do fali po wszystkich swoich zależnościach
+//!    z tego samego budowania; każda fala idzie równolegle na `jobs` wątkach.
+//!    Plik, którego zależność się nie skompilowała, jest pomijany (`Blocked`).
+//! 4. Manifest (`.hl-build.json`): hash treści, opcje, wyjście i zależności
+//!    każdego pliku. Plik zgodny z manifestem i z istniejącym wyjściem nie jest
+//!    nawet parsowany; przy domyślnym poziomie optymalizacji moduł bierzemy
+//!    z cache treści (`compile_to_cache`), więc skrypt skompilowany wcześniej
+//!    przez `hl run` albo pod inną ścieżką nie jest kompilowany drugi raz.
+//!
+//! Importy wykonują się w czasie uruchomienia (linker, executor AST), więc .bc
+//! pliku nie zależy od treści bibliotek — graf wyznacza kolejność i blokady,
+//! a `inputs_hash` w manifeście pozwala hbuild stwierdzić, że cały cel
+//! (plik + biblioteki) się nie zmienił.
+
+use crate::{cache, compile_source_to_bc_with, compile_to_cache, read_bc_file, source_hash,
+            write_bc_file_as, BcFormat, CompileOptions, OptLevel};
+use anyhow::{bail, Context, Result};
+use hl_parser::{Lexer, Token};
+use serde::{Deserialize, Serialize};
+use std::collections::{BTreeMap, HashMap};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+/// Domyślna nazwa manifestu (w bieżącym katalogu)
+pub const MANIFEST_FILE: &str = ".hl-build.json";
+const MANIFEST_VERSION: u32 = 1;
+
+/// Plik do skompilowania i jego wyjście
+#[derive(Debug, Clone, PartialEq)]
+pub struct Input {
+    pub path: PathBuf,
+    pub out:  PathBuf,
+}
+
+/// Opcje budowania wielu plików
+pub struct BatchOptions<'a> {
+    pub compile:  CompileOptions,
+    /// Liczba wątków (0 — wszystkie rdzenie)
+    pub jobs:     usize,
+    pub manifest: PathBuf,
+    /// Kompiluj wszystko, ignorując manifest
+    pub force:    bool,
+    /// Plik biblioteki dla specu importu (`main/json`); None — brak pliku
+    /// (wbudowany fallback, nieściągnięta biblioteka GitHub)
+    pub resolve:  &'a (dyn Fn(&str) -> Option<PathBuf> + Sync),
+}
+
+/// Wynik dla jednego pliku
+#[derive(Debug, Clone, PartialEq)]
+pub enum Status {
+    /// Zgodny z manifestem — bez kompilacji
+    Fresh,
+    /// Moduł z cache treści, zapisany do wyjścia
+    Cached,
+    Compiled,
+    Failed(String),
+    /// Nie kompilowany — zależność się nie skompilowała
+    Blocked(PathBuf),
+}
+
+impl Status {
+    pub fn is_ok(&self) -> bool {
+        matches!(self, Status::Fresh | Status::Cached | Status::Compiled)
+    }
+}
+
+#[derive(Debug)]
+pub struct BatchReport {
+    /// W kolejności wejść
+    pub results: Vec<(Input, Status)>,
+    /// Liczba fal kompilacji (głębokość grafu)
+    pub waves:   usize,
+    /// Pliki w cyklach importów (kompilowane w ostatniej fali)
+    pub cycles:  Vec<PathBuf>,
+}
+
+impl BatchReport {
+    pub fn failed(&self) -> usize {
+        self.results.iter().filter(|(_, s)| !s.is_ok()).count()
+    }
+}
+
+// ── Manifest ──────────────────────────────────────────────────────────────────
+
+#[derive(Debug, Clone, Default, PartialEq, Serialize, Deserialize)]
+pub struct Manifest {
+    pub version: u32,
+    /// Ścieżka źródła → wpis; BTreeMap trzyma stałą kolejność w pliku
+    pub files:   BTreeMap<String, ManifestEntry>,
+}
+
+#[derive(Debug, Clone, Default, PartialEq, Serialize, Deserialize)]
+pub struct ManifestEntry {
+    /// `source_hash` treści (hex) — ten sam klucz co cache .bc
+    pub hash:        String,
+    /// Format i poziom optymalizacji, np. `bincode -O2`
+    pub opts:        String,
+    pub output:      String,
+    /// Importy (spec albo ścieżka `<<`), także te bez pliku
+    pub imports:     Vec<String>,
+    /// Pliki, na które wskazują importy
+    pub deps:        Vec<String>,
+    /// Hash treści pliku i wszystkich jego zależności (przechodnio)
+    pub inputs_hash: String,
+}
+
+impl Manifest {
+    /// Brak pliku albo inna wersja — pusty manifest (pełne budowanie)
+    pub fn load(path: &Path) -> Self {
+        std::fs::read(path).ok()
+        .and_then(|raw| serde_json::from_slice::<Manifest>(&raw).ok())
+        .filter(|m| m.version == MANIFEST_VERSION)
+        .unwrap_or_default()
+    }
+
+    pub fn save(&self, path: &Path) -> Result<()> {
+        let raw = serde_json::to_vec_pretty(self)?;
+        let tmp = path.with_extension(format!("tmp.{}", std::process::id()));
+        std::fs::write(&tmp, raw).with_context(|| format!("Zapis manifestu: {:?}", tmp))?;
+        std::fs::rename(&tmp, path).with_context(|| format!("Zapis manifestu: {:?}", path))?;
+        Ok(())
+    }
+}
+
+fn opts_key(o: &CompileOptions) -> String {
+    let fmt = match o.format { BcFormat::Bincode => "bincode", BcFormat::Flat => "flat" };
+    let lvl = match o.opt_level { OptLevel::O0 => 0, OptLevel::O1 => 1, OptLevel::O2 => 2 };
+    format!("{} -O{}", fmt, lvl)
+}
+
+// ── Wejścia ───────────────────────────────────────────────────────────────────
+
+/// Rozwiń argumenty `hl compile` do listy plików. `out_dir` — katalog wyjściowy
+/// (ścieżki względem katalogu/prefiksu globu); None — `.bc` obok źródła.
+pub fn expand_inputs(args: &[PathBuf], out_dir: Option<&Path>) -> Result<Vec<Input>> {
+    let mut out: Vec<Input> = Vec::new();
+    for arg in args {
+        let s = arg.to_string_lossy();
+        let (base, found): (PathBuf, Vec<PathBuf>) = if s.contains(['*', '?']) {
+            let (base, pattern) = split_glob(&s);
+            let mut all = Vec::new();
+            collect_hl(&base, &mut all);
+            let found = all.into_iter()
+            .filter(|p| p.strip_prefix(&base).ok()
+                .map_or(false, |rel| glob_match(&pattern, &rel.to_string_lossy())))
+            .collect();
+            (base, found)
+        } else if arg.is_dir() {
+            let mut all = Vec::new();
+            collect_hl(arg, &mut all);
+            (arg.clone(), all)
+        } else if arg.is_file() {
+            (arg.parent().map(Path::to_path_buf).unwrap_or_default(), vec![arg.clone()])
+        } else {
+            bail!("Plik nie istnieje: {}", arg.display());
+        };
+
+        let mut found = found;
+        found.sort();
+        for path in found {
+            if out.iter().any(|i| i.path == path) { continue; }
+            let rel = path.strip_prefix(&base).unwrap_or(&path).to_path_buf();
+            let out_path = match out_dir {
+                Some(d) => d.join(rel).with_extension("bc"),
+                None    => path.with_extension("bc"),
+            };
+            out.push(Input { path, out: out_path });
+        }
+    }
+    Ok(out)
+}
+
+/// Podział globu na stały prefiks katalogu i wzorzec reszty
+fn split_glob(s: &str) -> (PathBuf, String) {
+    let parts: Vec<&str> = s.split('/').collect();
+    let first = parts.iter().position(|p| p.contains(['*', '?'])).unwrap_or(parts.len());
+    let base = parts[..first].join("/");
+    let base = if base.is_empty() && s.starts_with('/') { "/".to_string() } else { base };
+    let base = if base.is_empty() { PathBuf::from(".") } else { PathBuf::from(base) };
+    (base, parts[first..].join("/"))
+}
+
+/// Pliki .hl w katalogu (rekurencyjnie); pomija ukryte katalogi i `target`
+fn collect_hl(dir: &Path, out: &mut Vec<PathBuf>) {
+    let Ok(rd) = std::fs::read_dir(dir) else { return };
+    for e in rd.flatten() {
+        let p = e.path();
+        let name = e.file_name();
+        let name = name.to_string_lossy();
+        if p.is_dir() {
+            if !name.starts_with('.') && name != "target" { collect_hl(&p, out); }
+        } else if p.extension().and_then(|e| e.to_str()) == Some("hl") {
+            out.push(p);
+        }
+    }
+}
+
+/// Dopasowanie ścieżki względnej do wzorca: `*` i `?` w obrębie segmentu,
+/// `**` — dowolna liczba segmentów
+pub fn glob_match(pattern: &str, path: &str) -> bool {
+    let pat: Vec<&str> = pattern.split('/').filter(|s| !s.is_empty()).collect();
+    let segs: Vec<&str> = path.split('/').filter(|s| !s.is_empty()).collect();
+    match_segs(&pat, &segs)
+}
+
+fn match_segs(pat: &[&str], segs: &[&str]) -> bool {
+    match pat.first() {
+        None        => segs.is_empty(),
+        Some(&"**") => (0..=segs.len()).any(|i| match_segs(&pat[1..], &segs[i..])),
+        Some(p)     => !segs.is_empty() && match_seg(p.as_bytes(), segs[0].as_bytes())
+                       && match_segs(&pat[1..], &segs[1..]),
+    }
+}
+
+fn match_seg(p: &[u8], s: &[u8]) -> bool {
+    match (p.first(), s.first()) {
+        (None, None)          => true,
+        (Some(b'*'), _)       => match_seg(&p[1..], s) || (!s.is_empty() && match_seg(p, &s[1..])),
+        (Some(b'?'), Some(_)) => match_seg(&p[1..], &s[1..]),
+        (Some(a), Some(b))    => a == b && match_seg(&p[1..], &s[1..]),
+        _                     => false,
+    }
+}
+
+// ── Graf zależności ───────────────────────────────────────────────────────────
+
+/// Importy z tokenów: spec biblioteki (`main/json`) albo ścieżka `<< plik`
+#[derive(Debug, Clone, PartialEq)]
+pub enum ImportRef {
+    Lib(String),
+    File(String),
+}
+
+impl ImportRef {
+    fn label(&self) -> String {
+        match self { ImportRef::Lib(s) => s.clone(), ImportRef::File(p) => format!("<< {}", p) }
+    }
+}
+
+/// Importy pliku z leksera (bez parsowania); błąd leksera — brak importów,
+/// kompilacja i tak go zgłosi
+pub fn scan_imports(source: &str) -> Vec<ImportRef> {
+    let Ok(tokens) = Lexer::new(source).tokenize() else { return Vec::new() };
+    let mut out = Vec::new();
+    for t in tokens {
+        let r = match t {
+            Token::Import { lib, .. }      => ImportRef::Lib(lib.trim_matches(['<', '>']).to_string()),
+            Token::FileImport { path, .. } => ImportRef::File(path.to_string()),
+            _ => continue,
+        };
+        if !out.contains(&r) { out.push(r); }
+    }
+    out
+}
+
+/// Plik dla importu: `<<` względem katalogu pliku (bez interpolacji `@VAR`);
+/// `main/x` najpierw wśród wejść z katalogu `main-libs` (budowanie samych
+/// bibliotek), potem przez `resolve`
+fn resolve_ref(r: &ImportRef, from: &Path, inputs: &[Input], resolve: &dyn Fn(&str) -> Option<PathBuf>) -> Option<PathBuf> {
+    match r {
+        ImportRef::File(p) if p.contains('@') => None,
+        ImportRef::File(p) => {
+            let path = from.parent().unwrap_or(Path::new("")).join(p);
+            path.exists().then_some(path)
+        }
+        ImportRef::Lib(spec) => {
+            if let Some(lib) = spec.strip_prefix("main/") {
+                let sibling = inputs.iter().find(|i| {
+                    i.path.file_stem().and_then(|s| s.to_str()) == Some(lib)
+                    && i.path.parent().and_then(|d| d.file_name()).and_then(|d| d.to_str()) == Some("main-libs")
+                });
+                if let Some(i) = sibling { return Some(i.path.clone()); }
+            }
+            resolve(spec)
+        }
+    }
+}
+
+/// Fale kompilacji (algorytm Kahna po krawędziach między wejściami).
+/// Węzły w cyklach lądują razem w ostatniej fali.
+fn waves(deps: &[Vec<usize>]) -> (Vec<Vec<usize>>, Vec<usize>) {
+    let n = deps.len();
+    let mut pending: Vec<usize> = deps.iter().map(Vec::len).collect();
+    let mut users: Vec<Vec<usize>> = vec![Vec::new(); n];
+    for (i, ds) in deps.iter().enumerate() {
+        for &d in ds { users[d].push(i); }
+    }
+    let mut out = Vec::new();
+    let mut cur: Vec<usize> = (0..n).filter(|&i| pending[i] == 0).collect();
+    let mut done = 0;
+    while !cur.is_empty() {
+        done += cur.len();
+        let mut next = Vec::new();
+        for &i in &cur {
+            for &u in &users[i] {
+                pending[u] -= 1;
+                if pending[u] == 0 { next.push(u); }
+            }
+        }
+        out.push(std::mem::replace(&mut cur, next));
+    }
+    let cyclic: Vec<usize> = (0..n).filter(|&i| pending[i] > 0).collect();
+    if done < n { out.push(cyclic.clone()); }
+    (out, cyclic)
+}
+
+// ── Budowanie ─────────────────────────────────────────────────────────────────
+
+struct Scanned {
+    source:  String,
+    hash:    u64,
+    imports: Vec<ImportRef>,
+}
+
+/// Zbuduj pliki; manifest zapisywany na końcu (także przy błędach — udane
+/// pliki nie będą kompilowane ponownie)
+pub fn compile_batch(inputs: &[Input], opts: &BatchOptions) -> Result<BatchReport> {
+    let jobs = match opts.jobs {
+        0 => std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1),
+        j => j,
+    };
+    let okey = opts_key(&opts.compile);
+    let old  = if opts.force { Manifest::default() } else { Manifest::load(&opts.manifest) };
+
+    // Skan: odczyt + hash + importy
+    let scanned: Vec<Result<Scanned, String>> = par_map(inputs, jobs, |i| {
+        let source = std::fs::read_to_string(&i.path).map_err(|e| format!("{}: {}", i.path.display(), e))?;
+        let hash = source_hash(&source);
+        let imports = scan_imports(&source);
+        Ok(Scanned { source, hash, imports })
+    });
+
+    // Graf: krawędzie do innych wejść + pliki bibliotek spoza budowania
+    let index: HashMap<&Path, usize> = inputs.iter().enumerate().map(|(i, inp)| (inp.path.as_path(), i)).collect();
+    let mut edges: Vec<Vec<usize>> = vec![Vec::new(); inputs.len()];
+    let mut dep_files: Vec<Vec<PathBuf>> = vec![Vec::new(); inputs.len()];
+    for (i, s) in scanned.iter().enumerate() {
+        let Ok(s) = s else { continue };
+        for r in &s.imports {
+            let Some(p) = resolve_ref(r, &inputs[i].path, inputs, opts.resolve) else { continue };
+            if let Some(&j) = index.get(p.as_path()) {
+                if j != i && !edges[i].contains(&j) { edges[i].push(j); }
+            }
+            if !dep_files[i].contains(&p) { dep_files[i].push(p); }
+        }
+    }
+    let inputs_hash = inputs_hashes(&scanned, inputs, &dep_files, &index);
+
+    let (waves, cyclic) = waves(&edges);
+    let mut status: Vec<Option<Status>> = vec![None; inputs.len()];
+    for wave in &waves {
+        // Zablokowane przez nieudaną zależność (cykl: tylko spoza cyklu)
+        let mut todo = Vec::new();
+        for &i in wave {
+            let bad = edges[i].iter().copied()
+            .find(|&d| status[d].as_ref().map_or(false, |s| !s.is_ok()));
+            match bad {
+                Some(d) => status[i] = Some(Status::Blocked(inputs[d].path.clone())),
+                None    => todo.push(i),
+            }
+        }
+        let built = par_map(&todo, jobs, |&i| match &scanned[i] {
+            Err(e) => Status::Failed(e.clone()),
+            Ok(s)  => {
+                let key = inputs[i].path.display().to_string();
+                let fresh = old.files.get(&key).map_or(false, |e| {
+                    e.hash == format!("{:016x}", s.hash) && e.opts == okey
+                    && Path::new(&e.output) == inputs[i].out && inputs[i].out.exists()
+                });
+                if fresh { return Status::Fresh; }
+                build_one(s, &inputs[i], &opts.compile).unwrap_or_else(|e| Status::Failed(format!("{:#}", e)))
+            }
+        });
+        for (&i, st) in todo.iter().zip(built) { status[i] = Some(st); }
+    }
+
+    // Manifest: stare wpisy spoza tego budowania zostają
+    let mut manifest = Manifest { version: MANIFEST_VERSION, files: old.files };
+    let results: Vec<(Input, Status)> = inputs.iter().cloned()
+    .zip(status.into_iter().map(|s| s.unwrap_or(Status::Failed("pominięty".into()))))
+    .collect();
+    for (i, (inp, st)) in results.iter().enumerate() {
+        let key = inp.path.display().to_string();
+        match (&scanned[i], st.is_ok()) {
+            (Ok(s), true) => {
+                manifest.files.insert(key, ManifestEntry {
+                    hash:        format!("{:016x}", s.hash),
+                    opts:        okey.clone(),
+                    output:      inp.out.display().to_string(),
+                    imports:     s.imports.iter().map(ImportRef::label).collect(),
+                    deps:        dep_files[i].iter().map(|p| p.display().to_string()).collect(),
+                    inputs_hash: format!("{:016x}", inputs_hash[i]),
+                });
+            }
+            _ => { manifest.files.remove(&key); }
+        }
+    }
+    manifest.save(&opts.manifest)?;
+
+    Ok(BatchReport {
+        results,
+        waves:  waves.len(),
+        cycles: cyclic.into_iter().map(|i| inputs[i].path.clone()).collect(),
+    })
+}
+
+/// Hash pliku i jego zależności (przechodnio, w kolejności ścieżek)
+fn inputs_hashes(
+    scanned:   &[Result<Scanned, String>],
+    inputs:    &[Input],
+    dep_files: &[Vec<PathBuf>],
+    index:     &HashMap<&Path, usize>,
+) -> Vec<u64> {
+    let mut external: HashMap<PathBuf, u64> = HashMap::new();
+    (0..inputs.len()).map(|i| {
+        let mut seen: BTreeMap<PathBuf, u64> = BTreeMap::new();
+        let mut stack = vec![inputs[i].path.clone()];
+        while let Some(p) = stack.pop() {
+            if seen.contains_key(&p) { continue; }
+            let (h, deps) = match index.get(p.as_path()) {
+                Some(&j) => (scanned[j].as_ref().map_or(0, |s| s.hash), dep_files[j].clone()),
+                None => {
+                    let h = *external.entry(p.clone()).or_insert_with(|| {
+                        std::fs::read_to_string(&p).map_or(0, |s| source_hash(&s))
+                    });
+                    (h, Vec::new())
+                }
+            };
+            seen.insert(p, h);
+            stack.extend(deps);
+        }
+        let joined: String = seen.iter().map(|(p, h)| format!("{}={:016x};", p.display(), h)).collect();
+        source_hash(&joined)
+    }).collect()
+}
+
+/// Skompiluj jeden plik. Przy domyślnym poziomie optymalizacji moduł idzie
+/// przez cache treści (ten sam .bc co `hl run`), potem zapis w żądanym formacie.
+fn build_one(s: &Scanned, input: &Input, opts: &CompileOptions) -> Result<Status> {
+    if let Some(dir) = input.out.parent().filter(|d| !d.as_os_str().is_empty()) {
+        std::fs::create_dir_all(dir)?;
+    }
+    if opts.opt_level != OptLevel::default() {
+        compile_source_to_bc_with(&s.source, &input.path, Some(&input.out), opts)?;
+        return Ok(Status::Compiled);
+    }
+    let hit = cache::bc_cache_path(&format!("{:016x}", s.hash)).exists();
+    let bc = compile_to_cache(&s.source, &input.path)?;
+    let mut module = read_bc_file(&bc)?;
+    module.header.source_path = input.path.display().to_string();
+    write_bc_file_as(&module, &input.out, opts.format)?;
+    Ok(if hit { Status::Cached } else { Status::Compiled })
+}
+
+/// `f` na każdym elemencie, `jobs` wątków pobiera kolejne indeksy; wyniki
+/// w kolejności wejścia
+fn par_map<T: Sync, R: Send>(items: &[T], jobs: usize, f: impl Fn(&T) -> R + Sync) -> Vec<R> {
+    let jobs = jobs.clamp(1, items.len().max(1));
+    if jobs == 1 { return items.iter().map(&f).collect(); }
+    let next = AtomicUsize::new(0);
+    let mut parts: Vec<Vec<(usize, R)>> = std::thread::scope(|sc| {
+        let handles: Vec<_> = (0..jobs).map(|_| sc.spawn(|| {
+            let mut got = Vec::new();
+            loop {
+                let i = next.fetch_add(1, Ordering::Relaxed);
+                if i >= items.len() { break; }
+                got.push((i, f(&items[i])));
+            }
+            got
+        })).collect();
+        handles.into_iter().map(|h| h.join().expect("wątek kompilacji spanikował")).collect()
+    });
+    let mut out: Vec<(usize, R)> = parts.iter_mut().flat_map(std::mem::take).collect();
+    out.sort_by_key(|(i, _)| *i);
+    out.into_iter().map(|(_, r)| r).collect()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_glob_match() {
+        assert!(glob_match("*.hl", "a.hl"));
+        assert!(!glob_match("*.hl", "d/a.hl"));
+        assert!(glob_match("**/*.hl", "a.hl"));
+        assert!(glob_match("**/*.hl", "d/e/a.hl"));
+        assert!(glob_match("d/?.hl", "d/a.hl"));
+        assert!(!glob_match("d/?.hl", "d/ab.hl"));
+    }
+
+    #[test]
+    fn test_split_glob() {
+        assert_eq!(split_glob("src/**/*.hl"), (PathBuf::from("src"), "**/*.hl".to_string()));
+        assert_eq!(split_glob("*.hl"), (PathBuf::from("."), "*.hl".to_string()));
+    }
+
+    #[test]
+    fn test_scan_imports() {
+        let src = "# <main/json>\n# <std/net>\n<< util.hl\n<< util.hl\n";
+        assert_eq!(scan_imports(src), vec![
+            ImportRef::Lib("main/json".into()),
+            ImportRef::Lib("main/net".into()),
+            ImportRef::File("util.hl".into()),
+        ]);
+    }
+
+    #[test]
+    fn test_waves_order_and_cycles() {
+        // 0 ← 1 ← 2, 3 ↔ 4
+        let (w, cyc) = waves(&[vec![], vec![0], vec![1], vec![4], vec![3]]);
+        assert_eq!(w, vec![vec![0], vec![1], vec![2], vec![3, 4]]);
+        assert_eq!(cyc, vec![3, 4]);
+    }
+
+    #[test]
+    fn test_par_map_keeps_order() {
+        let v: Vec<u32> = (0..100).collect();
+        assert_eq!(par_map(&v, 4, |x| x * 2), v.iter().map(|x| x * 2).collect::<Vec<_>>());
+    }
+}
@@ -1,4 +1,6 @@
 use serde::{Deserialize, Serialize};
+pub use hl_parser::expr::TestOp;
+pub use hl_parser::quick_fn::QuickFn;
 
 /// Identyfikator rejestru (wirtualny, nieograniczony)
 pub type Reg = u32;
@@ -103,6 +105,11 @@ pub struct HlModule {
     pub instructions: Vec<Instruction>,
     /// Liczba rejestrów potrzebnych do wykonania głównego bloku
     pub main_regs:    u32,
+    /// Tablica linii: (pierwsza instrukcja, linia źródła), rosnąco po offsecie.
+    /// Wypełnia ją optymalizator ze znaczników `SourceLine` — tylko w pamięci
+    /// (profiler), nie trafia do .bc
+    #[serde(skip)]
+    pub lines:        Vec<(InsnOff, u32)>,
 }
 
 #[derive(Debug, Clone, Serialize, Deserialize)]
@@ -131,6 +138,7 @@ impl HlModule {
             funcs:        FuncTable::default(),
             instructions: Vec::new(),
             main_regs:    0,
+            lines:        Vec::new(),
         }
     }
 }
@@ -184,8 +192,14 @@ pub enum Instruction {
     ToString { dst: Reg, src: Reg },
     /// dst = to_f64(src)
     ToNumber { dst: Reg, src: Reg },
-    /// dst = truthy(src)
+    /// dst = int(src): liczba obcięta do i32 (nasycenie), tekst parsowany, reszta → 0
+    ToInt    { dst: Reg, src: Reg },
+    /// dst = is_truthy(src)
     Truthy   { dst: Reg, src: Reg },
+    /// dst = !is_truthy(src)
+    Not      { dst: Reg, src: Reg },
+    /// dst = test(src): `-z`/`-n` na stringu albo test pliku (`-f`, `-d`…)
+    Test     { dst: Reg, src: Reg, op: TestOp },
 
     // ── String interpolation ─────────────────────────────────────
     /// dst = concat(parts[0..n]) — parts to lista Reg
@@ -204,8 +218,12 @@ pub enum Instruction {
     // ── Wywołania ────────────────────────────────────────────────
     /// wywołaj funkcję HL zdefiniowaną w module
     CallFunc    { name: ConstIdx },
-    /// wywołaj quick-function (::upper itd.)
-    CallQuick   { name: ConstIdx, arg: Reg, dst: Reg },
+    /// wywołaj arena function (`__arena__nazwa`) we własnym regionie `size` bajtów;
+    /// stringi z ciała żyją w arenie, przy powrocie kopiowane jest tylko to, co ucieka
+    ArenaCall   { name: ConstIdx, size: u32 },
+    /// wywołaj quick-function (::upper itd.); `func` rozwiązane przy lowering,
+    /// `name` zostaje dla komunikatu o nieznanej funkcji
+    CallQuick   { name: ConstIdx, func: Option<QuickFn>, arg: Reg, dst: Reg },
 
     // ── Komendy systemowe ────────────────────────────────────────
     /// uruchom komendę; dst = exit_code (i32 jako f64)
@@ -221,26 +239,86 @@ pub enum Instruction {
         dst_ec:  Reg,
         dst_out: Reg,
     },
+    /// ExecCmd ze stokenizowanym szablonem — runtime wypełnia tylko dziury
+    ExecTpl     { tpl: Box<CmdTemplate>, mode: CmdMode, dst: Reg },
+    /// ExecCapture ze stokenizowanym szablonem
+    CaptureTpl  { tpl: Box<CmdTemplate>, mode: CmdMode, dst_ec: Reg, dst_out: Reg },
     /// wypisz na stdout
     Print       { src: Reg },
 
     // ── Pętle ────────────────────────────────────────────────────
-    /// for-in: iteruj po słowach w src; iterator state w rejestrze iter_reg
-    ForInStart  { iter_reg: Reg, src: Reg },
+    /// for-in: iteruj po słowach (`lines` — liniach) w src; stan iteratora
+    /// w slocie rejestru iter_reg, src dzielony leniwie w ForInNext
+    ForInStart  { iter_reg: Reg, src: Reg, lines: bool },
+    /// for-in po wyjściu komendy: uruchom cmd, iterator czyta stdout strumieniowo.
+    /// Po wyczerpaniu ForInNext ustawia _last_exit_code na kod wyjścia komendy
+    ForInCmd    { iter_reg: Reg, cmd: Reg, mode: CmdMode, lines: bool },
+    /// ForInCmd ze stokenizowanym szablonem
+    ForInTpl    { iter_reg: Reg, tpl: Box<CmdTemplate>, mode: CmdMode, lines: bool },
     /// for-in next: dst = następne słowo lub skocz do end_off
     ForInNext   { iter_reg: Reg, dst: Reg, end_off: InsnOff },
+    /// `@ i in a..b`: skocz do end_off, gdy licznik (int) > end albo nie jest
+    /// intem (ForRangeStep przekroczył i32)
+    ForRangeNext { ctr: Reg, end: Reg, end_off: InsnOff },
+    /// dst = src + 1 na tagu int (krok licznika, dst == src); po i32::MAX → nil
+    ForRangeStep { dst: Reg, src: Reg },
+
+    // ── Goroutines i kanały ──────────────────────────────────────
+    /// uruchom funkcję `func` (nazwa ukrytej funkcji __go_N) jako goroutine
+    /// w grupie `tag` ("" = bez nazwy)
+    GoSpawn     { func: ConstIdx, tag: ConstIdx },
+    /// czekaj na goroutines z grupy `tag` (GO_TAG_ALL = wszystkie); dst = kod wyjścia
+    GoWait      { tag: ConstIdx, dst: Reg },
+    /// otwórz kanał `name` o pojemności `cap` (0 = domyślna)
+    ChanOpen    { name: ConstIdx, cap: u32 },
+    /// wyślij src do kanału (blokuje przy pełnym)
+    ChanSend    { name: ConstIdx, src: Reg },
+    /// odbierz z kanału do dst (blokuje przy pustym)
+    ChanRecv    { name: ConstIdx, dst: Reg },
 
     // ── HackerOS API ─────────────────────────────────────────────
     /// wywołaj narzędzie HackerOS; args_reg = string argumentów
     HackerOsCall { tool: ConstIdx, args: Reg, dst: Reg },
 
     // ── Debugowanie / metadata ───────────────────────────────────
-    /// marker źródłowy (usuwany przez optymalizator w release)
+    /// marker źródłowy (optymalizator przenosi go do `HlModule::lines`)
     SourceLine  { line: u32 },
     /// noop (po usuniętych instrukcjach)
     Nop,
 }
 
+/// `GoWait::tag` oznaczający wszystkie goroutines (`:*~` bez nazwy)
+pub const GO_TAG_ALL: ConstIdx = u32::MAX;
+
+/// Fragment szablonu komendy
+#[derive(Debug, Clone, Copy, Serialize, Deserialize, PartialEq)]
+pub enum TplPart {
+    /// literał z puli stałych
+    Lit(ConstIdx),
+    /// interpolowana wartość (rejestr ze stringiem)
+    Hole(Reg),
+}
+
+/// Komenda podzielona na słowa argv przy kompilacji (`lower::cmd_template`).
+/// Lowering emituje szablon tylko dla komend, które nie idą przez `sh -c`
+/// na podstawie samych literałów; w runtime słowo to sklejenie jego części,
+/// puste słowa odpadają (jak w `split_cmd`).
+#[derive(Debug, Clone, Serialize, Deserialize, PartialEq)]
+pub struct CmdTemplate {
+    /// treść komendy w kolejności źródła — z niej sklejamy string, gdy wartość
+    /// dziury zawiera biały znak, cudzysłów albo znak powłoki
+    pub raw:   Vec<TplPart>,
+    /// słowa argv (cudzysłowy zdjęte); każda dziura z `raw` występuje tu raz
+    pub words: Vec<Vec<TplPart>>,
+}
+
+impl CmdTemplate {
+    /// Rejestry dziur w kolejności źródła
+    pub fn holes(&self) -> impl Iterator<Item = Reg> + '_ {
+        self.raw.iter().filter_map(|p| match p { TplPart::Hole(r) => Some(*r), TplPart::Lit(_) => None })
+    }
+}
+
 /// Tryb wykonania komendy (odpowiada CommandMode z AST)
 #[derive(Debug, Clone, Copy, Serialize, Deserialize, PartialEq)]
 pub enum CmdMode {
@@ -1,8 +1,57 @@
-use anyhow::Result;
-use std::path::PathBuf;
+//! Cache bytecode (~/.hackeros/hacker-lang/cache)
+//!
+//! Klucz wpisu to hash treści skryptu (xxh3, ziarno z wersji formatu .bc) —
+//! ten sam skrypt pod dwiema ścieżkami kompiluje się raz. Pliki `<hash>.bc`
+//! opisuje jeden indeks `index.hlx` mapowany przez mmap:
+//!
+//!  - nagłówek: wersja, liczba wpisów, zajęte bajty, trafienia/chybienia, zegar LRU
+//!  - tablica slotów (adresowanie otwarte): hash → rozmiar, ostatnie użycie
+//!
+//! Każda zmiana indeksu odbywa się pod `flock` na pliku indeksu, więc równoległe
+//! procesy (np. dwa zadania cron) widzą spójne liczniki. Kompilacja tego samego
+//! hasha jest dodatkowo serializowana blokadą wpisu — drugi proces czeka i
+//! dostaje gotowy plik zamiast kompilować ponownie. Sam .bc zapisujemy przez
+//! plik tymczasowy + rename (`write_bc_file_as`).
+//!
+//! Rozmiar cache ograniczamy budżetem bajtów (nie liczbą plików); po przekroczeniu
+//! usuwamy najdawniej używane wpisy razem z ich fragmentami JIT.
+
+use anyhow::{Context, Result};
+use std::fs::{File, OpenOptions};
+use std::os::unix::fs::MetadataExt;
+use std::os::unix::io::AsRawFd;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU64, Ordering};
 
-pub const CACHE_MAX_FILES: usize = 30;
 pub const CACHE_DIR_NAME: &str = ".hackeros/hacker-lang/cache";
+/// Domyślny budżet cache (.bc + fragmenty JIT); `HL_CACHE_MAX_MB` nadpisuje
+pub const CACHE_MAX_BYTES: u64 = 64 << 20;
+/// Limit wpisów — 3/4 tablicy indeksu, żeby sondowanie zostało krótkie
+pub const CACHE_MAX_ENTRIES: usize = INDEX_SLOTS * 3 / 4;
+
+const INDEX_FILE: &str = "index.hlx";
+const INDEX_MAGIC: &[u8; 4] = b"HLCX";
+const INDEX_VERSION: u32 = 1;
+const INDEX_SLOTS: usize = 4096;
+const HEADER_SIZE: usize = 64;
+const SLOT_SIZE: usize = 32;
+const INDEX_SIZE: usize = HEADER_SIZE + INDEX_SLOTS * SLOT_SIZE;
+
+// Nagłówek indeksu
+const H_VERSION:   usize = 4;
+const H_SLOTS:     usize = 8;
+const H_COUNT:     usize = 12;
+const H_BYTES:     usize = 16;
+const H_HITS:      usize = 24;
+const H_MISSES:    usize = 32;
+const H_CLOCK:     usize = 40;
+const H_EVICTIONS: usize = 48;
+
+// Slot: hash (0 = pusty), rozmiar, zegar LRU, czas ostatniego użycia (unix)
+const S_KEY:  usize = 0;
+const S_SIZE: usize = 8;
+const S_TICK: usize = 16;
+const S_TIME: usize = 24;
 
 pub fn cache_dir() -> PathBuf {
     dirs::home_dir()
@@ -22,36 +71,351 @@ pub fn ensure_cache_dir() -> Result<()> {
     Ok(())
 }
 
-/// Jeśli liczba plików .bc w cache > CACHE_MAX_FILES, usuń najstarsze
-pub fn cache_cleanup_if_needed() -> Result<()> {
-    let dir = cache_dir();
-    if !dir.exists() { return Ok(()); }
+/// Budżet bajtów cache
+pub fn budget_bytes() -> u64 {
+    std::env::var("HL_CACHE_MAX_MB").ok()
+    .and_then(|v| v.trim().parse::<u64>().ok())
+    .map(|mb| mb << 20)
+    .unwrap_or(CACHE_MAX_BYTES)
+}
 
-    let mut entries: Vec<(std::time::SystemTime, PathBuf)> = std::fs::read_dir(&dir)?
-    .flatten()
-    .filter_map(|e| {
-        let path = e.path();
-        if path.extension().and_then(|x| x.to_str()) != Some("bc") { return None; }
-        let mtime = e.metadata().ok()?.modified().ok()?;
-        Some((mtime, path))
-    })
-    .collect();
+/// Hash treści skryptu — klucz cache. Ziarno zależy od wersji formatu .bc,
+/// optymalizatora i hl, więc nowy kompilator nie trafia w stare pliki. Nigdy 0 (pusty slot indeksu).
+pub fn source_hash(source: &str) -> u64 {
+    const SEED: u64 = ((crate::BC_VERSION as u64) << 32)
+    ^ ((crate::optimize::OPT_VERSION as u64) << 16)
+    ^ crate::BC_FLAT_VERSION as u64;
+    let seed = xxhash_rust::xxh3::xxh3_64_with_seed(env!("CARGO_PKG_VERSION").as_bytes(), SEED);
+    xxhash_rust::xxh3::xxh3_64_with_seed(source.as_bytes(), seed).max(1)
+}
+
+/// Trafienie: plik `<hash>.bc` istnieje. Odświeża LRU (albo dopisuje wpis,
+/// jeśli indeks go nie zna) i liczy trafienie.
+pub fn lookup(hash: u64, bc_path: &Path) -> bool {
+    let Ok(meta) = std::fs::metadata(bc_path) else { return false };
+    PROC_HITS.fetch_add(1, Ordering::Relaxed);
+    if let Err(e) = CacheIndex::open().map(|mut ix| {
+        ix.bump(H_HITS, 1);
+        if !ix.touch(hash) { ix.insert(hash, meta.len()); }
+    }) {
+        tracing::debug!("cache index: {}", e);
+    }
+    true
+}
 
-    if entries.len() <= CACHE_MAX_FILES {
-        return Ok(());
+/// Zarejestruj świeżo skompilowany wpis i przytnij cache do budżetu
+pub fn record_compiled(hash: u64, bc_path: &Path) {
+    PROC_MISSES.fetch_add(1, Ordering::Relaxed);
+    let size = std::fs::metadata(bc_path).map(|m| m.len()).unwrap_or(0);
+    if let Err(e) = CacheIndex::open().map(|mut ix| {
+        ix.bump(H_MISSES, 1);
+        ix.insert(hash, size);
+        ix.evict_to_budget(budget_bytes(), CACHE_MAX_ENTRIES, hash);
+    }) {
+        tracing::debug!("cache index: {}", e);
     }
+}
+
+/// Trafienia i chybienia tego procesu (liczniki w indeksie są wspólne dla
+/// wszystkich uruchomień) — zerowane przy odczycie, dla `HL_METRICS`
+static PROC_HITS:   AtomicU64 = AtomicU64::new(0);
+static PROC_MISSES: AtomicU64 = AtomicU64::new(0);
 
-    // Posortuj od najstarszych
-    entries.sort_by_key(|(t, _)| *t);
+pub fn take_process_stats() -> (u64, u64) {
+    (PROC_HITS.swap(0, Ordering::Relaxed), PROC_MISSES.swap(0, Ordering::Relaxed))
+}
 
-    let to_remove = entries.len() - CACHE_MAX_FILES;
-    for (_, path) in entries.iter().take(to_remove) {
-        tracing::debug!("cache cleanup: usuwam {:?}", path);
-        let _ = std::fs::remove_file(path);
+/// Dolicz bajty do wpisu (fragmenty JIT zapisane obok `<hash>.bc`)
+pub fn add_entry_bytes(hash: u64, bytes: u64) {
+    if let Err(e) = CacheIndex::open().map(|mut ix| ix.add_bytes(hash, bytes)) {
+        tracing::debug!("cache index: {}", e);
     }
+}
 
-    tracing::info!("cache cleanup: usunięto {} starych plików .bc", to_remove);
-    Ok(())
+/// Blokada kompilacji jednego hasha. Plik blokady znika razem z blokadą;
+/// proces, który na nią czekał, zastaje już gotowy .bc.
+pub struct EntryLock {
+    _file: File,
+    path: PathBuf,
+}
+
+impl EntryLock {
+    pub fn acquire(hash: u64) -> Result<Self> {
+        Self::acquire_in(&cache_dir(), hash)
+    }
+
+    fn acquire_in(dir: &Path, hash: u64) -> Result<Self> {
+        let path = dir.join(format!(".{:016x}.lock", hash));
+        loop {
+            let file = OpenOptions::new().create(true).write(true).open(&path)
+            .with_context(|| format!("Blokada cache: {:?}", path))?;
+            flock(&file)?;
+            // Poprzedni właściciel usuwa plik przed zwolnieniem blokady — jeśli
+            // czekaliśmy na już usunięty inode, następny proces utworzy nowy plik
+            // i zablokuje go obok nas. Blokada liczy się tylko na pliku spod `path`.
+            let held = file.metadata()?;
+            match std::fs::metadata(&path) {
+                Ok(m) if m.dev() == held.dev() && m.ino() == held.ino() => {
+                    return Ok(Self { _file: file, path });
+                }
+                _ => continue,
+            }
+        }
+    }
+}
+
+impl Drop for EntryLock {
+    fn drop(&mut self) {
+        // unlink przed zamknięciem — zamknięcie deskryptora zwalnia flock
+        let _ = std::fs::remove_file(&self.path);
+    }
+}
+
+/// Blokada wyłączna na pliku (zwalnia ją zamknięcie deskryptora)
+pub fn flock(file: &File) -> Result<()> {
+    loop {
+        // SAFETY: poprawny deskryptor należący do `file`
+        if unsafe { libc::flock(file.as_raw_fd(), libc::LOCK_EX) } == 0 { return Ok(()); }
+        let err = std::io::Error::last_os_error();
+        if err.kind() != std::io::ErrorKind::Interrupted {
+            return Err(err).context("flock");
+        }
+    }
+}
+
+/// Zmapowany indeks cache. Blokada wyłączna trzymana przez cały czas życia —
+/// zwalnia ją zamknięcie pliku w Drop (pola zwalniane w kolejności deklaracji).
+struct CacheIndex {
+    map:  memmap2::MmapMut,
+    _file: File,
+    dir:  PathBuf,
+}
+
+impl CacheIndex {
+    fn open() -> Result<Self> {
+        ensure_cache_dir()?;
+        Self::open_in(&cache_dir())
+    }
+
+    fn open_in(dir: &Path) -> Result<Self> {
+        let path = dir.join(INDEX_FILE);
+        let file = OpenOptions::new().read(true).write(true).create(true).open(&path)
+        .with_context(|| format!("Indeks cache: {:?}", path))?;
+        flock(&file)?;
+        let fresh = file.metadata()?.len() != INDEX_SIZE as u64;
+        if fresh { file.set_len(INDEX_SIZE as u64)?; }
+        // SAFETY: plik ma stały rozmiar INDEX_SIZE, a każdy proces zmienia go
+        // tylko pod flock — nikt nie skraca mapowania pod nami
+        let map = unsafe { memmap2::MmapMut::map_mut(&file) }
+        .with_context(|| format!("mmap indeksu cache: {:?}", path))?;
+        let mut ix = Self { map, _file: file, dir: dir.to_path_buf() };
+        if fresh || !ix.valid() {
+            ix.rebuild()?;
+        }
+        Ok(ix)
+    }
+
+    #[inline] fn u32_at(&self, o: usize) -> u32 { u32::from_le_bytes(self.map[o..o + 4].try_into().unwrap()) }
+    #[inline] fn u64_at(&self, o: usize) -> u64 { u64::from_le_bytes(self.map[o..o + 8].try_into().unwrap()) }
+    #[inline] fn put_u32(&mut self, o: usize, v: u32) { self.map[o..o + 4].copy_from_slice(&v.to_le_bytes()); }
+    #[inline] fn put_u64(&mut self, o: usize, v: u64) { self.map[o..o + 8].copy_from_slice(&v.to_le_bytes()); }
+    #[inline] fn slot(i: usize) -> usize { HEADER_SIZE + i * SLOT_SIZE }
+    #[inline] fn key(&self, i: usize) -> u64 { self.u64_at(Self::slot(i) + S_KEY) }
+
+    fn bump(&mut self, field: usize, n: u64) {
+        let v = self.u64_at(field).wrapping_add(n);
+        self.put_u64(field, v);
+    }
+
+    fn valid(&self) -> bool {
+        &self.map[0..4] == INDEX_MAGIC
+            && self.u32_at(H_VERSION) == INDEX_VERSION
+            && self.u32_at(H_SLOTS) as usize == INDEX_SLOTS
+    }
+
+    /// Nowy albo uszkodzony indeks: odtwórz wpisy z plików .bc (kolejność LRU wg mtime)
+    fn rebuild(&mut self) -> Result<()> {
+        self.map.fill(0);
+        self.map[0..4].copy_from_slice(INDEX_MAGIC);
+        self.put_u32(H_VERSION, INDEX_VERSION);
+        self.put_u32(H_SLOTS, INDEX_SLOTS as u32);
+
+        let mut found: Vec<(std::time::SystemTime, u64, u64)> = std::fs::read_dir(&self.dir)?
+        .flatten()
+        .filter_map(|e| {
+            let path = e.path();
+            if path.extension().and_then(|x| x.to_str()) != Some("bc") { return None; }
+            let hash = u64::from_str_radix(path.file_stem()?.to_str()?, 16).ok()?;
+            let meta = e.metadata().ok()?;
+            Some((meta.modified().ok()?, hash, meta.len()))
+        })
+        .collect();
+        found.sort_by_key(|(t, ..)| *t);
+        for (_, hash, size) in found {
+            self.insert(hash, size);
+        }
+        tracing::debug!("cache index: odtworzony ({} wpisów)", self.u32_at(H_COUNT));
+        Ok(())
+    }
+
+    /// Slot z kluczem albo pierwszy pusty slot sondowania
+    fn probe(&self, hash: u64) -> (usize, bool) {
+        let mask = INDEX_SLOTS - 1;
+        let mut i = hash as usize & mask;
+        loop {
+            match self.key(i) {
+                0 => return (i, false),
+                k if k == hash => return (i, true),
+                _ => i = (i + 1) & mask,
+            }
+        }
+    }
+
+    fn tick(&mut self, i: usize) {
+        let clock = self.u64_at(H_CLOCK) + 1;
+        self.put_u64(H_CLOCK, clock);
+        let s = Self::slot(i);
+        self.put_u64(s + S_TICK, clock);
+        self.put_u64(s + S_TIME, unix_now());
+    }
+
+    fn touch(&mut self, hash: u64) -> bool {
+        let (i, found) = self.probe(hash);
+        if found { self.tick(i); }
+        found
+    }
+
+    fn insert(&mut self, hash: u64, size: u64) {
+        let (i, found) = self.probe(hash);
+        let s = Self::slot(i);
+        if found {
+            let old = self.u64_at(s + S_SIZE);
+            self.put_u64(H_BYTES, self.u64_at(H_BYTES).saturating_sub(old) + size);
+        } else {
+            // Pełna tablica — nie powinno się zdarzyć przy CACHE_MAX_ENTRIES < INDEX_SLOTS
+            if self.u32_at(H_COUNT) as usize >= INDEX_SLOTS - 1 { return; }
+            self.put_u64(s + S_KEY, hash);
+            self.put_u32(H_COUNT, self.u32_at(H_COUNT) + 1);
+            self.bump(H_BYTES, size);
+        }
+        self.put_u64(s + S_SIZE, size);
+        self.tick(i);
+    }
+
+    fn add_bytes(&mut self, hash: u64, bytes: u64) {
+        let (i, found) = self.probe(hash);
+        if !found { return; }
+        let s = Self::slot(i);
+        self.put_u64(s + S_SIZE, self.u64_at(s + S_SIZE) + bytes);
+        self.bump(H_BYTES, bytes);
+    }
+
+    /// Usuń slot `i` i przesuń w tył kolejne wpisy łańcucha sondowania
+    /// (bez nagrobków — wyszukiwanie zawsze kończy się na pustym slocie)
+    fn remove_at(&mut self, mut i: usize) {
+        let mask = INDEX_SLOTS - 1;
+        let s = Self::slot(i);
+        self.put_u64(H_BYTES, self.u64_at(H_BYTES).saturating_sub(self.u64_at(s + S_SIZE)));
+        self.put_u32(H_COUNT, self.u32_at(H_COUNT) - 1);
+        let mut j = i;
+        loop {
+            j = (j + 1) & mask;
+            let k = self.key(j);
+            if k == 0 { break; }
+            let home = k as usize & mask;
+            // Wpis j może zostać, jeśli jego slot domowy leży cyklicznie w (i, j]
+            let stays = if i <= j { i < home && home <= j } else { i < home || home <= j };
+            if !stays {
+                self.map.copy_within(Self::slot(j)..Self::slot(j) + SLOT_SIZE, Self::slot(i));
+                i = j;
+            }
+        }
+        self.map[Self::slot(i)..Self::slot(i) + SLOT_SIZE].fill(0);
+    }
+
+    /// Usuwaj najdawniej używane wpisy, aż zajętość spadnie do 90% budżetu
+    /// (zapas, żeby nie przycinać przy każdej kompilacji). `keep` nie jest usuwany.
+    fn evict_to_budget(&mut self, budget: u64, max_entries: usize, keep: u64) {
+        let count = self.u32_at(H_COUNT) as usize;
+        if self.u64_at(H_BYTES) <= budget && count <= max_entries { return; }
+
+        let mut lru: Vec<(u64, u64)> = (0..INDEX_SLOTS)
+        .filter(|&i| self.key(i) != 0 && self.key(i) != keep)
+        .map(|i| (self.u64_at(Self::slot(i) + S_TICK), self.key(i)))
+        .collect();
+        lru.sort_unstable();
+
+        let target_bytes   = budget / 10 * 9;
+        let target_entries = max_entries / 10 * 9;
+        let mut victims = Vec::new();
+        for (_, hash) in lru {
+            if self.u64_at(H_BYTES) <= target_bytes && self.u32_at(H_COUNT) as usize <= target_entries {
+                break;
+            }
+            let (i, found) = self.probe(hash);
+            if !found { continue; }
+            self.remove_at(i);
+            let _ = std::fs::remove_file(self.dir.join(format!("{:016x}.bc", hash)));
+            victims.push(format!("{:016x}.", hash));
+        }
+        if victims.is_empty() { return; }
+        self.bump(H_EVICTIONS, victims.len() as u64);
+        remove_jit_fragments(&self.dir, &victims);
+        tracing::info!("cache: usunięto {} najdawniej używanych wpisów", victims.len());
+    }
+
+    fn stats(&self) -> CacheStats {
+        CacheStats {
+            entries:   self.u32_at(H_COUNT) as usize,
+            bytes:     self.u64_at(H_BYTES),
+            budget:    budget_bytes(),
+            hits:      self.u64_at(H_HITS),
+            misses:    self.u64_at(H_MISSES),
+            evictions: self.u64_at(H_EVICTIONS),
+        }
+    }
+}
+
+fn unix_now() -> u64 {
+    std::time::SystemTime::now()
+    .duration_since(std::time::UNIX_EPOCH)
+    .map(|d| d.as_secs())
+    .unwrap_or(0)
+}
+
+/// Usuń fragmenty kodu maszynowego JIT (`<hash>.*.jit`) usuniętych wpisów
+fn remove_jit_fragments(dir: &Path, prefixes: &[String]) {
+    let Ok(rd) = std::fs::read_dir(dir) else { return };
+    for e in rd.flatten() {
+        let name = e.file_name();
+        let Some(name) = name.to_str() else { continue };
+        if name.ends_with(".jit") && prefixes.iter().any(|p| name.starts_with(p.as_str())) {
+            let _ = std::fs::remove_file(e.path());
+        }
+    }
+}
+
+/// Statystyki z indeksu (dla `hl cache-info`)
+#[derive(Debug, Clone, Copy, Default)]
+pub struct CacheStats {
+    pub entries:   usize,
+    pub bytes:     u64,
+    pub budget:    u64,
+    pub hits:      u64,
+    pub misses:    u64,
+    pub evictions: u64,
+}
+
+impl CacheStats {
+    pub fn hit_rate(&self) -> f64 {
+        let total = self.hits + self.misses;
+        if total == 0 { 0.0 } else { self.hits as f64 * 100.0 / total as f64 }
+    }
+}
+
+pub fn cache_stats() -> Result<CacheStats> {
+    if !cache_dir().exists() { return Ok(CacheStats { budget: budget_bytes(), ..Default::default() }); }
+    Ok(CacheIndex::open()?.stats())
 }
 
 /// Wyczyść cały cache
@@ -99,3 +463,97 @@ pub struct CacheEntry {
     pub size:     u64,
     pub modified: std::time::SystemTime,
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn temp_dir(tag: &str) -> PathBuf {
+        let dir = std::env::temp_dir().join(format!("hl-cache-{}-{}", tag, std::process::id()));
+        let _ = std::fs::remove_dir_all(&dir);
+        std::fs::create_dir_all(&dir).unwrap();
+        dir
+    }
+
+    #[test]
+    fn test_source_hash_ignores_path() {
+        let a = source_hash("echo hello\n");
+        assert_eq!(a, source_hash("echo hello\n"));
+        assert_ne!(a, source_hash("echo hello!\n"));
+        assert_ne!(a, 0);
+    }
+
+    #[test]
+    fn test_index_insert_remove_keeps_probe_chain() {
+        let dir = temp_dir("chain");
+        let mut ix = CacheIndex::open_in(&dir).unwrap();
+        // Trzy klucze z tym samym slotem domowym + jeden sąsiad
+        let keys = [5u64, 5 + INDEX_SLOTS as u64, 5 + 2 * INDEX_SLOTS as u64, 6];
+        for (n, &k) in keys.iter().enumerate() { ix.insert(k, 100 + n as u64); }
+        assert_eq!(ix.stats().entries, 4);
+        assert_eq!(ix.stats().bytes, 100 + 101 + 102 + 103);
+
+        let (i, found) = ix.probe(keys[0]);
+        assert!(found);
+        ix.remove_at(i);
+        for &k in &keys[1..] { assert!(ix.probe(k).1, "zgubiony klucz {}", k); }
+        assert!(!ix.probe(keys[0]).1);
+        assert_eq!(ix.stats().bytes, 101 + 102 + 103);
+        drop(ix);
+
+        // Indeks przetrwał zamknięcie
+        let ix = CacheIndex::open_in(&dir).unwrap();
+        assert_eq!(ix.stats().entries, 3);
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+
+    #[test]
+    fn test_evict_least_recently_used() {
+        let dir = temp_dir("lru");
+        let mut ix = CacheIndex::open_in(&dir).unwrap();
+        for k in 1..=4u64 {
+            std::fs::write(dir.join(format!("{:016x}.bc", k)), [0u8; 10]).unwrap();
+            std::fs::write(dir.join(format!("{:016x}.0-4.0000000000000000.jit", k)), [0u8]).unwrap();
+            ix.insert(k, 10);
+        }
+        ix.touch(1);
+        ix.evict_to_budget(30, CACHE_MAX_ENTRIES, 4);
+        // 40 B > 30 B → do 27 B: wylatują 2 i 3 (1 odświeżony, 4 chroniony)
+        assert!(ix.probe(1).1 && ix.probe(4).1);
+        assert!(!ix.probe(2).1 && !ix.probe(3).1);
+        assert!(!dir.join(format!("{:016x}.bc", 2)).exists());
+        assert!(!dir.join(format!("{:016x}.0-4.0000000000000000.jit", 3)).exists());
+        assert!(dir.join(format!("{:016x}.bc", 1)).exists());
+        assert_eq!(ix.stats().evictions, 2);
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+
+    #[test]
+    fn test_entry_lock_retries_after_unlink() {
+        let dir = temp_dir("lock");
+        let path = dir.join(format!(".{:016x}.lock", 7u64));
+        let open = || OpenOptions::new().create(true).write(true).open(&path).unwrap();
+
+        // Właściciel A; B czeka na jego inode
+        let a = open();
+        flock(&a).unwrap();
+        let waiter = {
+            let dir = dir.clone();
+            std::thread::spawn(move || drop(EntryLock::acquire_in(&dir, 7).unwrap()))
+        };
+        std::thread::sleep(std::time::Duration::from_millis(100));
+
+        // A sprząta jak EntryLock::drop, C tworzy nowy plik i go blokuje
+        std::fs::remove_file(&path).unwrap();
+        let c = open();
+        flock(&c).unwrap();
+        drop(a);
+
+        // B dostał blokadę usuniętego inode — musi poczekać na C
+        std::thread::sleep(std::time::Duration::from_millis(200));
+        assert!(!waiter.is_finished(), "dwie blokady tego samego wpisu naraz");
+        drop(c);
+        waiter.join().unwrap();
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+}
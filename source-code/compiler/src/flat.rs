@@ -0,0 +1,948 @@
+//! Płaski, mapowalny format .bc („flat")
+//!
+//! Zamiast nagłówka JSON + bincode całego `HlModule` plik ma stały układ
+//! binarny, który można zmapować (`mmap`) i czytać w miejscu:
+//!
+//! ```text
+//! #!/usr/bin/env -S /usr/bin/hl run\n     shebang (jak w formacie bincode)
+//! "HLBC"  u32 BC_FLAT_VERSION             magic + wersja układu
+//! u32 liczba_sekcji  u32 zarezerwowane
+//! [SectionEntry; liczba_sekcji]           kind, offset, len (offsety od początku pliku)
+//! ... sekcje, każda wyrównana do 8 bajtów
+//! ```
+//!
+//! Wszystkie liczby są little-endian. Instrukcje to rekordy 16-bajtowe
+//! (`FlatInsn`), operandy `Concat` i szablony komend leżą w osobnej tabeli
+//! `EXTRA`, a wszystkie
+//! stringi (stałe, nazwy funkcji, ścieżka źródła) w jednym blobie UTF-8.
+//! Odczyt nie alokuje per-stała — `FlatBc` zwraca `&str` wprost z bufora.
+
+use anyhow::{bail, Context, Result};
+use crate::bytecode::{CmdMode, CmdTemplate, FuncEntry, HlBcHeader, HlModule, Instruction, QuickFn, TestOp, TplPart};
+use crate::serialize::BC_MAGIC;
+use hl_parser::quick_fn::QUICK_UNKNOWN;
+
+/// Wersja płaskiego układu. Górne 16 bitów = rodzaj formatu (1 = flat),
+/// dolne = rewizja układu. Nie koliduje z `BC_VERSION` formatu bincode.
+pub const BC_FLAT_VERSION: u32 = 0x0001_0009;
+
+/// Rozmiar jednego wpisu tablicy sekcji
+const SECTION_ENTRY_SIZE: usize = 24;
+/// Rozmiar sekcji META
+const META_SIZE: usize = 32;
+
+/// Rodzaje sekcji
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[repr(u32)]
+pub enum SectionKind {
+    /// hl_gen, main_regs, compiled_at, source_path/hl_version (offsety w STR_BLOB)
+    Meta     = 1,
+    /// (u32 off, u32 len) na każdą stałą string
+    StrTable = 2,
+    /// Wszystkie stringi UTF-8 sklejone
+    StrBlob  = 3,
+    /// f64 LE
+    Numbers  = 4,
+    /// u8 (0/1)
+    Bools    = 5,
+    /// (u32 name_off, u32 name_len, u32 start_insn, u32 insn_count)
+    Funcs    = 6,
+    /// [FlatInsn]
+    Code     = 7,
+    /// u32 — operandy zmiennej długości (Concat, szablony komend)
+    Extra    = 8,
+}
+
+impl SectionKind {
+    fn from_u32(v: u32) -> Option<Self> {
+        Some(match v {
+            1 => Self::Meta,
+            2 => Self::StrTable,
+            3 => Self::StrBlob,
+            4 => Self::Numbers,
+            5 => Self::Bools,
+            6 => Self::Funcs,
+            7 => Self::Code,
+            8 => Self::Extra,
+            _ => return None,
+        })
+    }
+}
+
+/// Kody operacji w rekordach `FlatInsn`
+pub mod op {
+    pub const LOAD_STR:      u8 = 0;
+    pub const LOAD_NUM:      u8 = 1;
+    pub const LOAD_BOOL:     u8 = 2;
+    pub const LOAD_NIL:      u8 = 3;
+    pub const GET_VAR:       u8 = 4;
+    pub const GET_VAR_DYN:   u8 = 5;
+    pub const SET_VAR:       u8 = 6;
+    pub const SET_ENV:       u8 = 7;
+    pub const ADD:           u8 = 8;
+    pub const SUB:           u8 = 9;
+    pub const MUL:           u8 = 10;
+    pub const DIV:           u8 = 11;
+    pub const MOD:           u8 = 12;
+    pub const NEG:           u8 = 13;
+    pub const CMP_EQ:        u8 = 14;
+    pub const CMP_NE:        u8 = 15;
+    pub const CMP_LT:        u8 = 16;
+    pub const CMP_LE:        u8 = 17;
+    pub const CMP_GT:        u8 = 18;
+    pub const CMP_GE:        u8 = 19;
+    pub const TO_STRING:     u8 = 20;
+    pub const TO_NUMBER:     u8 = 21;
+    pub const TRUTHY:        u8 = 22;
+    pub const CONCAT:        u8 = 23;
+    pub const JUMP_IF_FALSE: u8 = 24;
+    pub const JUMP_IF_TRUE:  u8 = 25;
+    pub const JUMP:          u8 = 26;
+    pub const RETURN:        u8 = 27;
+    pub const CALL_FUNC:     u8 = 28;
+    pub const CALL_QUICK:    u8 = 29;
+    pub const EXEC_CMD:      u8 = 30;
+    pub const EXEC_CAPTURE:  u8 = 31;
+    pub const PRINT:         u8 = 32;
+    pub const FOR_IN_START:  u8 = 33;
+    pub const FOR_IN_NEXT:   u8 = 34;
+    pub const HACKEROS_CALL: u8 = 35;
+    pub const SOURCE_LINE:   u8 = 36;
+    pub const NOP:           u8 = 37;
+    pub const FOR_IN_CMD:    u8 = 38;
+    pub const GO_SPAWN:      u8 = 39;
+    pub const GO_WAIT:       u8 = 40;
+    pub const CHAN_OPEN:     u8 = 41;
+    pub const CHAN_SEND:     u8 = 42;
+    pub const CHAN_RECV:     u8 = 43;
+    pub const ARENA_CALL:    u8 = 44;
+    pub const EXEC_TPL:      u8 = 45;
+    pub const CAPTURE_TPL:   u8 = 46;
+    pub const FOR_IN_TPL:    u8 = 47;
+    pub const NOT:           u8 = 48;
+    pub const TEST:          u8 = 49;
+    pub const TO_INT:        u8 = 50;
+    pub const FOR_RANGE_NEXT: u8 = 51;
+    pub const FOR_RANGE_STEP: u8 = 52;
+}
+
+/// Rekord instrukcji o stałej szerokości (16 bajtów).
+///
+/// `aux` przechowuje małe operandy: `CmdMode`, `TestOp`, `QuickFn`, wartość `LoadBool`,
+/// flagę „jest src" dla `Return`. Znaczenie `a`/`b`/`c` zależy od `op`,
+/// dla `Concat` `b`/`c` to (start, len) w tabeli EXTRA. Instrukcje `*_TPL`
+/// mają układ swoich odpowiedników, z początkiem szablonu w EXTRA w miejscu
+/// rejestru komendy (patrz `TplView`).
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct FlatInsn {
+    pub op:  u8,
+    pub aux: u8,
+    pub pad: u16,
+    pub a:   u32,
+    pub b:   u32,
+    pub c:   u32,
+}
+
+pub const FLAT_INSN_SIZE: usize = std::mem::size_of::<FlatInsn>();
+
+impl FlatInsn {
+    #[inline]
+    pub fn new(op: u8, aux: u8, a: u32, b: u32, c: u32) -> Self {
+        Self { op, aux, pad: 0, a, b, c }
+    }
+
+    #[inline]
+    fn write_le(&self, out: &mut Vec<u8>) {
+        out.push(self.op);
+        out.push(self.aux);
+        out.extend_from_slice(&self.pad.to_le_bytes());
+        out.extend_from_slice(&self.a.to_le_bytes());
+        out.extend_from_slice(&self.b.to_le_bytes());
+        out.extend_from_slice(&self.c.to_le_bytes());
+    }
+
+    #[inline]
+    fn read_le(b: &[u8]) -> Self {
+        Self {
+            op:  b[0],
+            aux: b[1],
+            pad: u16::from_le_bytes([b[2], b[3]]),
+            a:   rd_u32(b, 4),
+            b:   rd_u32(b, 8),
+            c:   rd_u32(b, 12),
+        }
+    }
+}
+
+pub fn cmd_mode_to_u8(m: CmdMode) -> u8 {
+    match m {
+        CmdMode::Plain            => 0,
+        CmdMode::Sudo             => 1,
+        CmdMode::Isolated         => 2,
+        CmdMode::IsolatedSudo     => 3,
+        CmdMode::WithVars         => 4,
+        CmdMode::WithVarsSudo     => 5,
+        CmdMode::WithVarsIsolated => 6,
+    }
+}
+
+pub fn cmd_mode_from_u8(v: u8) -> Option<CmdMode> {
+    Some(match v {
+        0 => CmdMode::Plain,
+        1 => CmdMode::Sudo,
+        2 => CmdMode::Isolated,
+        3 => CmdMode::IsolatedSudo,
+        4 => CmdMode::WithVars,
+        5 => CmdMode::WithVarsSudo,
+        6 => CmdMode::WithVarsIsolated,
+        _ => return None,
+    })
+}
+
+pub fn test_op_to_u8(t: TestOp) -> u8 {
+    match t {
+        TestOp::Empty       => 0,
+        TestOp::NonEmpty    => 1,
+        TestOp::Exists      => 2,
+        TestOp::File        => 3,
+        TestOp::Dir         => 4,
+        TestOp::Symlink     => 5,
+        TestOp::Readable    => 6,
+        TestOp::Writable    => 7,
+        TestOp::Executable  => 8,
+        TestOp::NonZeroSize => 9,
+    }
+}
+
+pub fn test_op_from_u8(v: u8) -> Option<TestOp> {
+    Some(match v {
+        0 => TestOp::Empty,
+        1 => TestOp::NonEmpty,
+        2 => TestOp::Exists,
+        3 => TestOp::File,
+        4 => TestOp::Dir,
+        5 => TestOp::Symlink,
+        6 => TestOp::Readable,
+        7 => TestOp::Writable,
+        8 => TestOp::Executable,
+        9 => TestOp::NonZeroSize,
+        _ => return None,
+    })
+}
+
+/// Zakoduj instrukcję do rekordu; operandy zmiennej długości trafiają do `extra`
+pub fn encode_insn(insn: &Instruction, extra: &mut Vec<u32>) -> FlatInsn {
+    use Instruction as I;
+    match insn {
+        I::LoadStr  { dst, idx }       => FlatInsn::new(op::LOAD_STR,  0, *dst, *idx, 0),
+        I::LoadNum  { dst, idx }       => FlatInsn::new(op::LOAD_NUM,  0, *dst, *idx, 0),
+        I::LoadBool { dst, val }       => FlatInsn::new(op::LOAD_BOOL, *val as u8, *dst, 0, 0),
+        I::LoadNil  { dst }            => FlatInsn::new(op::LOAD_NIL,  0, *dst, 0, 0),
+        I::GetVar    { dst, name }     => FlatInsn::new(op::GET_VAR,     0, *dst, *name, 0),
+        I::GetVarDyn { dst, name }     => FlatInsn::new(op::GET_VAR_DYN, 0, *dst, *name, 0),
+        I::SetVar   { name, src }      => FlatInsn::new(op::SET_VAR, 0, *name, *src, 0),
+        I::SetEnv   { name, src }      => FlatInsn::new(op::SET_ENV, 0, *name, *src, 0),
+        I::Add { dst, a, b }           => FlatInsn::new(op::ADD, 0, *dst, *a, *b),
+        I::Sub { dst, a, b }           => FlatInsn::new(op::SUB, 0, *dst, *a, *b),
+        I::Mul { dst, a, b }           => FlatInsn::new(op::MUL, 0, *dst, *a, *b),
+        I::Div { dst, a, b }           => FlatInsn::new(op::DIV, 0, *dst, *a, *b),
+        I::Mod { dst, a, b }           => FlatInsn::new(op::MOD, 0, *dst, *a, *b),
+        I::Neg { dst, src }            => FlatInsn::new(op::NEG, 0, *dst, *src, 0),
+        I::CmpEq { dst, a, b }         => FlatInsn::new(op::CMP_EQ, 0, *dst, *a, *b),
+        I::CmpNe { dst, a, b }         => FlatInsn::new(op::CMP_NE, 0, *dst, *a, *b),
+        I::CmpLt { dst, a, b }         => FlatInsn::new(op::CMP_LT, 0, *dst, *a, *b),
+        I::CmpLe { dst, a, b }         => FlatInsn::new(op::CMP_LE, 0, *dst, *a, *b),
+        I::CmpGt { dst, a, b }         => FlatInsn::new(op::CMP_GT, 0, *dst, *a, *b),
+        I::CmpGe { dst, a, b }         => FlatInsn::new(op::CMP_GE, 0, *dst, *a, *b),
+        I::ToString { dst, src }       => FlatInsn::new(op::TO_STRING, 0, *dst, *src, 0),
+        I::ToNumber { dst, src }       => FlatInsn::new(op::TO_NUMBER, 0, *dst, *src, 0),
+        I::ToInt    { dst, src }       => FlatInsn::new(op::TO_INT,    0, *dst, *src, 0),
+        I::Truthy   { dst, src }       => FlatInsn::new(op::TRUTHY,    0, *dst, *src, 0),
+        I::Not      { dst, src }       => FlatInsn::new(op::NOT,       0, *dst, *src, 0),
+        I::Test { dst, src, op: t }    => FlatInsn::new(op::TEST, test_op_to_u8(*t), *dst, *src, 0),
+        I::Concat { dst, parts }       => {
+            let start = extra.len() as u32;
+            extra.extend_from_slice(parts);
+            FlatInsn::new(op::CONCAT, 0, *dst, start, parts.len() as u32)
+        }
+        I::JumpIfFalse { cond, offset } => FlatInsn::new(op::JUMP_IF_FALSE, 0, *cond, *offset, 0),
+        I::JumpIfTrue  { cond, offset } => FlatInsn::new(op::JUMP_IF_TRUE,  0, *cond, *offset, 0),
+        I::Jump { offset }              => FlatInsn::new(op::JUMP, 0, 0, *offset, 0),
+        I::Return { src }               => match src {
+            Some(r) => FlatInsn::new(op::RETURN, 1, *r, 0, 0),
+            None    => FlatInsn::new(op::RETURN, 0, 0, 0, 0),
+        },
+        I::CallFunc  { name }           => FlatInsn::new(op::CALL_FUNC, 0, *name, 0, 0),
+        I::ArenaCall { name, size }     => FlatInsn::new(op::ARENA_CALL, 0, *name, *size, 0),
+        I::CallQuick { name, func, arg, dst } => {
+            FlatInsn::new(op::CALL_QUICK, func.map_or(QUICK_UNKNOWN, QuickFn::id), *name, *arg, *dst)
+        }
+        I::ExecCmd { cmd, mode, dst }   => FlatInsn::new(op::EXEC_CMD, cmd_mode_to_u8(*mode), *cmd, *dst, 0),
+        I::ExecCapture { cmd, mode, dst_ec, dst_out } =>
+            FlatInsn::new(op::EXEC_CAPTURE, cmd_mode_to_u8(*mode), *cmd, *dst_ec, *dst_out),
+        I::ExecTpl { tpl, mode, dst }   =>
+            FlatInsn::new(op::EXEC_TPL, cmd_mode_to_u8(*mode), encode_tpl(tpl, extra), *dst, 0),
+        I::CaptureTpl { tpl, mode, dst_ec, dst_out } =>
+            FlatInsn::new(op::CAPTURE_TPL, cmd_mode_to_u8(*mode), encode_tpl(tpl, extra), *dst_ec, *dst_out),
+        I::Print { src }                => FlatInsn::new(op::PRINT, 0, *src, 0, 0),
+        I::ForInStart { iter_reg, src, lines } =>
+            FlatInsn::new(op::FOR_IN_START, 0, *iter_reg, *src, *lines as u32),
+        I::ForInCmd { iter_reg, cmd, mode, lines } =>
+            FlatInsn::new(op::FOR_IN_CMD, cmd_mode_to_u8(*mode), *iter_reg, *cmd, *lines as u32),
+        I::ForInTpl { iter_reg, tpl, mode, lines } =>
+            FlatInsn::new(op::FOR_IN_TPL, cmd_mode_to_u8(*mode), *iter_reg, encode_tpl(tpl, extra), *lines as u32),
+        I::ForInNext { iter_reg, dst, end_off } =>
+            FlatInsn::new(op::FOR_IN_NEXT, 0, *iter_reg, *dst, *end_off),
+        I::ForRangeNext { ctr, end, end_off } =>
+            FlatInsn::new(op::FOR_RANGE_NEXT, 0, *ctr, *end, *end_off),
+        I::ForRangeStep { dst, src }    => FlatInsn::new(op::FOR_RANGE_STEP, 0, *dst, *src, 0),
+        I::GoSpawn  { func, tag }       => FlatInsn::new(op::GO_SPAWN,  0, *func, *tag, 0),
+        I::GoWait   { tag, dst }        => FlatInsn::new(op::GO_WAIT,   0, *tag, *dst, 0),
+        I::ChanOpen { name, cap }       => FlatInsn::new(op::CHAN_OPEN, 0, *name, *cap, 0),
+        I::ChanSend { name, src }       => FlatInsn::new(op::CHAN_SEND, 0, *name, *src, 0),
+        I::ChanRecv { name, dst }       => FlatInsn::new(op::CHAN_RECV, 0, *name, *dst, 0),
+        I::HackerOsCall { tool, args, dst } => FlatInsn::new(op::HACKEROS_CALL, 0, *tool, *args, *dst),
+        I::SourceLine { line }          => FlatInsn::new(op::SOURCE_LINE, 0, *line, 0, 0),
+        I::Nop                          => FlatInsn::new(op::NOP, 0, 0, 0, 0),
+    }
+}
+
+/// Zdekoduj rekord z powrotem do `Instruction`
+pub fn decode_insn(r: FlatInsn, extra: &[u32]) -> Result<Instruction> {
+    use Instruction as I;
+    let mode = || cmd_mode_from_u8(r.aux)
+        .ok_or_else(|| anyhow::anyhow!("Nieznany CmdMode {} w .bc", r.aux));
+    Ok(match r.op {
+        op::LOAD_STR      => I::LoadStr  { dst: r.a, idx: r.b },
+        op::LOAD_NUM      => I::LoadNum  { dst: r.a, idx: r.b },
+        op::LOAD_BOOL     => I::LoadBool { dst: r.a, val: r.aux != 0 },
+        op::LOAD_NIL      => I::LoadNil  { dst: r.a },
+        op::GET_VAR       => I::GetVar    { dst: r.a, name: r.b },
+        op::GET_VAR_DYN   => I::GetVarDyn { dst: r.a, name: r.b },
+        op::SET_VAR       => I::SetVar { name: r.a, src: r.b },
+        op::SET_ENV       => I::SetEnv { name: r.a, src: r.b },
+        op::ADD           => I::Add { dst: r.a, a: r.b, b: r.c },
+        op::SUB           => I::Sub { dst: r.a, a: r.b, b: r.c },
+        op::MUL           => I::Mul { dst: r.a, a: r.b, b: r.c },
+        op::DIV           => I::Div { dst: r.a, a: r.b, b: r.c },
+        op::MOD           => I::Mod { dst: r.a, a: r.b, b: r.c },
+        op::NEG           => I::Neg { dst: r.a, src: r.b },
+        op::CMP_EQ        => I::CmpEq { dst: r.a, a: r.b, b: r.c },
+        op::CMP_NE        => I::CmpNe { dst: r.a, a: r.b, b: r.c },
+        op::CMP_LT        => I::CmpLt { dst: r.a, a: r.b, b: r.c },
+        op::CMP_LE        => I::CmpLe { dst: r.a, a: r.b, b: r.c },
+        op::CMP_GT        => I::CmpGt { dst: r.a, a: r.b, b: r.c },
+        op::CMP_GE        => I::CmpGe { dst: r.a, a: r.b, b: r.c },
+        op::TO_STRING     => I::ToString { dst: r.a, src: r.b },
+        op::TO_NUMBER     => I::ToNumber { dst: r.a, src: r.b },
+        op::TO_INT        => I::ToInt    { dst: r.a, src: r.b },
+        op::TRUTHY        => I::Truthy   { dst: r.a, src: r.b },
+        op::NOT           => I::Not      { dst: r.a, src: r.b },
+        op::TEST          => {
+            let t = test_op_from_u8(r.aux).ok_or_else(|| anyhow::anyhow!("Nieznany TestOp {} w .bc", r.aux))?;
+            I::Test { dst: r.a, src: r.b, op: t }
+        }
+        op::CONCAT        => {
+            let (start, len) = (r.b as usize, r.c as usize);
+            let parts = extra.get(start..start + len)
+                .ok_or_else(|| anyhow::anyhow!("Concat poza tabelą EXTRA ({}+{})", start, len))?;
+            I::Concat { dst: r.a, parts: parts.to_vec() }
+        }
+        op::JUMP_IF_FALSE => I::JumpIfFalse { cond: r.a, offset: r.b },
+        op::JUMP_IF_TRUE  => I::JumpIfTrue  { cond: r.a, offset: r.b },
+        op::JUMP          => I::Jump { offset: r.b },
+        op::RETURN        => I::Return { src: if r.aux != 0 { Some(r.a) } else { None } },
+        op::CALL_FUNC     => I::CallFunc  { name: r.a },
+        op::ARENA_CALL    => I::ArenaCall { name: r.a, size: r.b },
+        op::CALL_QUICK    => I::CallQuick { name: r.a, func: QuickFn::from_id(r.aux), arg: r.b, dst: r.c },
+        op::EXEC_CMD      => I::ExecCmd { cmd: r.a, mode: mode()?, dst: r.b },
+        op::EXEC_CAPTURE  => I::ExecCapture { cmd: r.a, mode: mode()?, dst_ec: r.b, dst_out: r.c },
+        op::EXEC_TPL      => I::ExecTpl { tpl: decode_tpl(extra, r.a)?, mode: mode()?, dst: r.b },
+        op::CAPTURE_TPL   => I::CaptureTpl { tpl: decode_tpl(extra, r.a)?, mode: mode()?, dst_ec: r.b, dst_out: r.c },
+        op::PRINT         => I::Print { src: r.a },
+        op::FOR_IN_START  => I::ForInStart { iter_reg: r.a, src: r.b, lines: r.c != 0 },
+        op::FOR_IN_NEXT   => I::ForInNext  { iter_reg: r.a, dst: r.b, end_off: r.c },
+        op::FOR_IN_CMD    => I::ForInCmd   { iter_reg: r.a, cmd: r.b, mode: mode()?, lines: r.c != 0 },
+        op::FOR_IN_TPL    => I::ForInTpl   { iter_reg: r.a, tpl: decode_tpl(extra, r.b)?, mode: mode()?, lines: r.c != 0 },
+        op::FOR_RANGE_NEXT => I::ForRangeNext { ctr: r.a, end: r.b, end_off: r.c },
+        op::FOR_RANGE_STEP => I::ForRangeStep { dst: r.a, src: r.b },
+        op::GO_SPAWN      => I::GoSpawn  { func: r.a, tag: r.b },
+        op::GO_WAIT       => I::GoWait   { tag: r.a, dst: r.b },
+        op::CHAN_OPEN     => I::ChanOpen { name: r.a, cap: r.b },
+        op::CHAN_SEND     => I::ChanSend { name: r.a, src: r.b },
+        op::CHAN_RECV     => I::ChanRecv { name: r.a, dst: r.b },
+        op::HACKEROS_CALL => I::HackerOsCall { tool: r.a, args: r.b, dst: r.c },
+        op::SOURCE_LINE   => I::SourceLine { line: r.a },
+        op::NOP           => I::Nop,
+        other             => bail!("Nieznany opcode {} w .bc", other),
+    })
+}
+
+// ── Szablony komend w EXTRA ──────────────────────────────────────────────────
+//
+// [n_raw, raw..., n_words, (n_parts, parts...) * n_words], część to ConstIdx
+// literału albo rejestr dziury z bitem `TPL_HOLE`.
+
+/// Bit części szablonu oznaczający dziurę (rejestr) zamiast stałej
+pub const TPL_HOLE: u32 = 1 << 31;
+
+#[inline]
+pub fn tpl_part(v: u32) -> TplPart {
+    if v & TPL_HOLE != 0 { TplPart::Hole(v & !TPL_HOLE) } else { TplPart::Lit(v) }
+}
+
+fn tpl_code(p: &TplPart) -> u32 {
+    match p {
+        TplPart::Lit(i)  => *i,
+        TplPart::Hole(r) => *r | TPL_HOLE,
+    }
+}
+
+fn encode_tpl(tpl: &CmdTemplate, extra: &mut Vec<u32>) -> u32 {
+    let start = extra.len() as u32;
+    extra.push(tpl.raw.len() as u32);
+    extra.extend(tpl.raw.iter().map(tpl_code));
+    extra.push(tpl.words.len() as u32);
+    for w in &tpl.words {
+        extra.push(w.len() as u32);
+        extra.extend(w.iter().map(tpl_code));
+    }
+    start
+}
+
+fn decode_tpl(extra: &[u32], start: u32) -> Result<Box<CmdTemplate>> {
+    let v = TplView::parse(extra, start as usize)
+        .ok_or_else(|| anyhow::anyhow!("Szablon komendy poza tabelą EXTRA (@{})", start))?;
+    Ok(Box::new(CmdTemplate {
+        raw:   v.raw.iter().map(|&p| tpl_part(p)).collect(),
+        words: v.words().map(|w| w.iter().map(|&p| tpl_part(p)).collect()).collect(),
+    }))
+}
+
+/// Widok na szablon komendy w tabeli EXTRA — interpreter czyta go w miejscu
+#[derive(Debug, Clone, Copy)]
+pub struct TplView<'e> {
+    /// części w kolejności źródła (zakodowane, patrz `tpl_part`)
+    pub raw: &'e [u32],
+    words:   &'e [u32],
+}
+
+impl<'e> TplView<'e> {
+    /// Odczytaj szablon zaczynający się w `extra[start]`; None = poza tabelą
+    pub fn parse(extra: &'e [u32], start: usize) -> Option<Self> {
+        let n_raw = *extra.get(start)? as usize;
+        let raw = extra.get(start + 1..start + 1 + n_raw)?;
+        let mut at = start + 1 + n_raw;
+        let n_words = *extra.get(at)? as usize;
+        at += 1;
+        let words_at = at;
+        for _ in 0..n_words {
+            let n = *extra.get(at)? as usize;
+            extra.get(at + 1..at + 1 + n)?;
+            at += 1 + n;
+        }
+        Some(Self { raw, words: &extra[words_at..at] })
+    }
+
+    /// Słowa argv — każde jako zakodowane części
+    pub fn words(&self) -> impl Iterator<Item = &'e [u32]> + 'e {
+        let mut rest = self.words;
+        std::iter::from_fn(move || {
+            let (&n, tail) = rest.split_first()?;
+            let (w, r) = tail.split_at(n as usize);
+            rest = r;
+            Some(w)
+        })
+    }
+
+    /// Rejestry dziur — z `raw` i ze słów (walidacja nie ufa, że to te same)
+    pub fn holes(&self) -> impl Iterator<Item = u32> + 'e {
+        self.raw.iter().copied().chain(self.words().flatten().copied())
+            .filter(|&p| p & TPL_HOLE != 0)
+            .map(|p| p & !TPL_HOLE)
+    }
+}
+
+// ── Zapis ────────────────────────────────────────────────────────────────────
+
+#[inline]
+fn rd_u32(b: &[u8], at: usize) -> u32 {
+    u32::from_le_bytes([b[at], b[at + 1], b[at + 2], b[at + 3]])
+}
+
+#[inline]
+fn rd_u64(b: &[u8], at: usize) -> u64 {
+    let mut w = [0u8; 8];
+    w.copy_from_slice(&b[at..at + 8]);
+    u64::from_le_bytes(w)
+}
+
+fn pad_to_8(buf: &mut Vec<u8>) {
+    while buf.len() % 8 != 0 { buf.push(0); }
+}
+
+/// Dopisz string do bloba i zwróć (offset, długość)
+fn blob_push(blob: &mut Vec<u8>, s: &str) -> (u32, u32) {
+    let off = blob.len() as u32;
+    blob.extend_from_slice(s.as_bytes());
+    (off, s.len() as u32)
+}
+
+/// Zbuduj płaski obraz modułu. `prefix` (shebang) trafia na początek bufora,
+/// offsety sekcji liczone są od początku całego pliku.
+pub fn write_flat_bytes(module: &HlModule, prefix: &[u8]) -> Vec<u8> {
+    // Blob stringów: stałe, potem nazwy funkcji i metadane
+    let mut blob: Vec<u8> = Vec::with_capacity(4096);
+    let mut str_table: Vec<u8> = Vec::with_capacity(module.consts.strings.len() * 8);
+    for s in &module.consts.strings {
+        let (off, len) = blob_push(&mut blob, s);
+        str_table.extend_from_slice(&off.to_le_bytes());
+        str_table.extend_from_slice(&len.to_le_bytes());
+    }
+
+    let mut funcs: Vec<u8> = Vec::with_capacity(module.funcs.entries.len() * 16);
+    for f in &module.funcs.entries {
+        let (off, len) = blob_push(&mut blob, &f.name);
+        funcs.extend_from_slice(&off.to_le_bytes());
+        funcs.extend_from_slice(&len.to_le_bytes());
+        funcs.extend_from_slice(&f.start_insn.to_le_bytes());
+        funcs.extend_from_slice(&f.insn_count.to_le_bytes());
+    }
+
+    let (src_off, src_len) = blob_push(&mut blob, &module.header.source_path);
+    let (ver_off, ver_len) = blob_push(&mut blob, &module.header.hl_version);
+    let mut meta: Vec<u8> = Vec::with_capacity(META_SIZE);
+    meta.extend_from_slice(&module.header.hl_gen.to_le_bytes());
+    meta.extend_from_slice(&module.main_regs.to_le_bytes());
+    meta.extend_from_slice(&module.header.compiled_at.to_le_bytes());
+    meta.extend_from_slice(&src_off.to_le_bytes());
+    meta.extend_from_slice(&src_len.to_le_bytes());
+    meta.extend_from_slice(&ver_off.to_le_bytes());
+    meta.extend_from_slice(&ver_len.to_le_bytes());
+
+    let mut numbers: Vec<u8> = Vec::with_capacity(module.consts.numbers.len() * 8);
+    for n in &module.consts.numbers {
+        numbers.extend_from_slice(&n.to_bits().to_le_bytes());
+    }
+    let bools: Vec<u8> = module.consts.bools.iter().map(|&b| b as u8).collect();
+
+    let mut extra_ops: Vec<u32> = Vec::new();
+    let mut code: Vec<u8> = Vec::with_capacity(module.instructions.len() * FLAT_INSN_SIZE);
+    for insn in &module.instructions {
+        encode_insn(insn, &mut extra_ops).write_le(&mut code);
+    }
+    let mut extra: Vec<u8> = Vec::with_capacity(extra_ops.len() * 4);
+    for r in &extra_ops {
+        extra.extend_from_slice(&r.to_le_bytes());
+    }
+
+    let sections: [(SectionKind, &[u8]); 8] = [
+        (SectionKind::Meta,     &meta),
+        (SectionKind::Code,     &code),
+        (SectionKind::Extra,    &extra),
+        (SectionKind::StrTable, &str_table),
+        (SectionKind::Numbers,  &numbers),
+        (SectionKind::Funcs,    &funcs),
+        (SectionKind::Bools,    &bools),
+        (SectionKind::StrBlob,  &blob),
+    ];
+
+    let total: usize = sections.iter().map(|(_, d)| d.len() + 8).sum();
+    let mut buf: Vec<u8> = Vec::with_capacity(prefix.len() + 16 + sections.len() * SECTION_ENTRY_SIZE + total);
+    buf.extend_from_slice(prefix);
+    buf.extend_from_slice(BC_MAGIC);
+    buf.extend_from_slice(&BC_FLAT_VERSION.to_le_bytes());
+    buf.extend_from_slice(&(sections.len() as u32).to_le_bytes());
+    buf.extend_from_slice(&0u32.to_le_bytes());
+
+    // Tablica sekcji — najpierw zarezerwuj miejsce, offsety uzupełnimy po zapisie danych
+    let table_at = buf.len();
+    buf.resize(table_at + sections.len() * SECTION_ENTRY_SIZE, 0);
+
+    for (i, (kind, data)) in sections.iter().enumerate() {
+        pad_to_8(&mut buf);
+        let off = buf.len() as u64;
+        buf.extend_from_slice(data);
+        let e = table_at + i * SECTION_ENTRY_SIZE;
+        buf[e..e + 4].copy_from_slice(&(*kind as u32).to_le_bytes());
+        buf[e + 8..e + 16].copy_from_slice(&off.to_le_bytes());
+        buf[e + 16..e + 24].copy_from_slice(&(data.len() as u64).to_le_bytes());
+    }
+
+    buf
+}
+
+// ── Odczyt ───────────────────────────────────────────────────────────────────
+
+/// Widok na płaski .bc — nie kopiuje danych, wszystkie akcesory czytają
+/// bezpośrednio z bufora (np. zmapowanego pliku).
+#[derive(Debug, Clone, Copy)]
+pub struct FlatBc<'a> {
+    blob:        &'a str,
+    str_table:   &'a [u8],
+    numbers:     &'a [u8],
+    bools:       &'a [u8],
+    funcs:       &'a [u8],
+    code:        &'a [u8],
+    extra:       &'a [u8],
+    pub hl_gen:      u32,
+    pub main_regs:   u32,
+    pub compiled_at: u64,
+    source_path: &'a str,
+    hl_version:  &'a str,
+}
+
+impl<'a> FlatBc<'a> {
+    /// Otwórz widok. `raw` to cały plik (z shebangiem), `base` — offset magic.
+    pub fn parse(raw: &'a [u8], base: usize) -> Result<Self> {
+        if raw.len() < base + 16 {
+            bail!("Urwany nagłówek płaskiego .bc");
+        }
+        if &raw[base..base + 4] != BC_MAGIC {
+            bail!("Nieprawidłowy magic w płaskim .bc");
+        }
+        let ver = rd_u32(raw, base + 4);
+        if ver != BC_FLAT_VERSION {
+            bail!("Niezgodna wersja płaskiego .bc: {:#x} (oczekiwano {:#x})", ver, BC_FLAT_VERSION);
+        }
+        let count = rd_u32(raw, base + 8) as usize;
+        let table_at = base + 16;
+        if raw.len() < table_at + count * SECTION_ENTRY_SIZE {
+            bail!("Urwana tablica sekcji w płaskim .bc");
+        }
+
+        let mut sect: [Option<&'a [u8]>; 9] = [None; 9];
+        for i in 0..count {
+            let e = table_at + i * SECTION_ENTRY_SIZE;
+            let kind = rd_u32(raw, e);
+            let off  = rd_u64(raw, e + 8) as usize;
+            let len  = rd_u64(raw, e + 16) as usize;
+            let data = off.checked_add(len)
+                .and_then(|end| raw.get(off..end))
+                .ok_or_else(|| anyhow::anyhow!("Sekcja {} poza plikiem ({}+{})", kind, off, len))?;
+            // Nieznane sekcje pomijamy — pozwala dodawać nowe bez zmiany wersji
+            if let Some(k) = SectionKind::from_u32(kind) {
+                sect[k as usize] = Some(data);
+            }
+        }
+        let need = |k: SectionKind| sect[k as usize]
+            .ok_or_else(|| anyhow::anyhow!("Brak sekcji {:?} w płaskim .bc", k));
+
+        // Blob walidujemy raz w całości — potem wycinki `get(..)` sprawdzają już tylko granice znaków
+        let blob = std::str::from_utf8(need(SectionKind::StrBlob)?)
+            .context("Blob stringów .bc nie jest poprawnym UTF-8")?;
+
+        let meta = need(SectionKind::Meta)?;
+        if meta.len() < META_SIZE {
+            bail!("Za krótka sekcja META w płaskim .bc");
+        }
+        let slice_blob = |off: u32, len: u32| -> Result<&'a str> {
+            let (o, l) = (off as usize, len as usize);
+            blob.get(o..o + l).ok_or_else(|| anyhow::anyhow!("String poza blobem ({}+{})", o, l))
+        };
+        let source_path = slice_blob(rd_u32(meta, 16), rd_u32(meta, 20))?;
+        let hl_version  = slice_blob(rd_u32(meta, 24), rd_u32(meta, 28))?;
+
+        let fc = Self {
+            blob,
+            str_table: need(SectionKind::StrTable)?,
+            numbers:   need(SectionKind::Numbers)?,
+            bools:     need(SectionKind::Bools)?,
+            funcs:     need(SectionKind::Funcs)?,
+            code:      need(SectionKind::Code)?,
+            extra:     need(SectionKind::Extra)?,
+            hl_gen:      rd_u32(meta, 0),
+            main_regs:   rd_u32(meta, 4),
+            compiled_at: rd_u64(meta, 8),
+            source_path,
+            hl_version,
+        };
+        if fc.code.len() % FLAT_INSN_SIZE != 0 || fc.str_table.len() % 8 != 0
+            || fc.numbers.len() % 8 != 0 || fc.funcs.len() % 16 != 0 || fc.extra.len() % 4 != 0
+        {
+            bail!("Niewyrównany rozmiar sekcji w płaskim .bc");
+        }
+        Ok(fc)
+    }
+
+    pub fn header(&self) -> HlBcHeader {
+        HlBcHeader {
+            hl_gen:      self.hl_gen,
+            source_path: self.source_path.to_string(),
+            compiled_at: self.compiled_at,
+            hl_version:  self.hl_version.to_string(),
+        }
+    }
+
+    #[inline] pub fn string_count(&self) -> usize { self.str_table.len() / 8 }
+    #[inline] pub fn number_count(&self) -> usize { self.numbers.len() / 8 }
+    #[inline] pub fn func_count(&self)   -> usize { self.funcs.len() / 16 }
+    #[inline] pub fn insn_count(&self)   -> usize { self.code.len() / FLAT_INSN_SIZE }
+
+    /// Stała string — `&str` wprost z bloba, bez alokacji
+    #[inline]
+    pub fn string(&self, idx: u32) -> Option<&'a str> {
+        let at = idx as usize * 8;
+        if at + 8 > self.str_table.len() { return None; }
+        let off = rd_u32(self.str_table, at) as usize;
+        let len = rd_u32(self.str_table, at + 4) as usize;
+        self.blob.get(off..off + len)
+    }
+
+    #[inline]
+    pub fn number(&self, idx: u32) -> Option<f64> {
+        let at = idx as usize * 8;
+        if at + 8 > self.numbers.len() { return None; }
+        Some(f64::from_bits(rd_u64(self.numbers, at)))
+    }
+
+    #[inline]
+    pub fn bool_const(&self, idx: u32) -> Option<bool> {
+        self.bools.get(idx as usize).map(|&b| b != 0)
+    }
+
+    /// (nazwa, start_insn, insn_count)
+    pub fn func(&self, idx: usize) -> Option<(&'a str, u32, u32)> {
+        let at = idx * 16;
+        if at + 16 > self.funcs.len() { return None; }
+        let off = rd_u32(self.funcs, at) as usize;
+        let len = rd_u32(self.funcs, at + 4) as usize;
+        let name = self.blob.get(off..off + len)?;
+        Some((name, rd_u32(self.funcs, at + 8), rd_u32(self.funcs, at + 12)))
+    }
+
+    #[inline]
+    pub fn insn(&self, pc: usize) -> Option<FlatInsn> {
+        let at = pc * FLAT_INSN_SIZE;
+        self.code.get(at..at + FLAT_INSN_SIZE).map(FlatInsn::read_le)
+    }
+
+    #[inline]
+    pub fn extra_operand(&self, idx: usize) -> Option<u32> {
+        let at = idx * 4;
+        if at + 4 > self.extra.len() { return None; }
+        Some(rd_u32(self.extra, at))
+    }
+
+    /// Strumień instrukcji jako `&[FlatInsn]` bez kopiowania — tylko gdy bufor
+    /// jest wyrównany (mmap zawsze jest) i host jest little-endian.
+    pub fn insn_slice(&self) -> Option<&'a [FlatInsn]> {
+        if cfg!(target_endian = "big") { return None; }
+        // SAFETY: FlatInsn to #[repr(C)] z samych liczb całkowitych — każdy wzorzec
+        // bitów jest poprawny; align_to zwraca pusty prefix tylko przy wyrównaniu.
+        let (pre, mid, post) = unsafe { self.code.align_to::<FlatInsn>() };
+        if pre.is_empty() && post.is_empty() { Some(mid) } else { None }
+    }
+
+    /// Tabela EXTRA jako `&[u32]` bez kopiowania (warunki jak w `insn_slice`)
+    pub fn extra_slice(&self) -> Option<&'a [u32]> {
+        if cfg!(target_endian = "big") { return None; }
+        // SAFETY: u32 nie ma niepoprawnych wzorców bitów
+        let (pre, mid, post) = unsafe { self.extra.align_to::<u32>() };
+        if pre.is_empty() && post.is_empty() { Some(mid) } else { None }
+    }
+
+    pub fn extra_vec(&self) -> Vec<u32> {
+        (0..self.extra.len() / 4).map(|i| rd_u32(self.extra, i * 4)).collect()
+    }
+
+    /// Zmaterializuj pełny `HlModule` (dla ścieżek, które wciąż go wymagają)
+    pub fn to_module(&self) -> Result<HlModule> {
+        let mut module = HlModule::new(self.source_path, self.hl_gen);
+        module.header    = self.header();
+        module.main_regs = self.main_regs;
+
+        module.consts.strings = (0..self.string_count() as u32)
+            .map(|i| self.string(i).map(str::to_string)
+                .ok_or_else(|| anyhow::anyhow!("Uszkodzona stała string #{}", i)))
+            .collect::<Result<_>>()?;
+        module.consts.numbers = (0..self.number_count() as u32)
+            .map(|i| self.number(i).unwrap_or(0.0))
+            .collect();
+        module.consts.bools = self.bools.iter().map(|&b| b != 0).collect();
+        module.consts.rebuild_index();
+
+        for i in 0..self.func_count() {
+            let (name, start_insn, insn_count) = self.func(i)
+                .ok_or_else(|| anyhow::anyhow!("Uszkodzony wpis funkcji #{}", i))?;
+            module.funcs.entries.push(FuncEntry { name: name.to_string(), start_insn, insn_count });
+        }
+
+        let extra = self.extra_vec();
+        module.instructions.reserve_exact(self.insn_count());
+        for pc in 0..self.insn_count() {
+            let rec = self.insn(pc).expect("pc < insn_count");
+            module.instructions.push(decode_insn(rec, &extra)?);
+        }
+        Ok(module)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::bytecode::FuncEntry;
+
+    fn sample_module(n_loops: usize) -> HlModule {
+        let mut m = HlModule::new("test.hl", 2);
+        let hello = m.consts.add_str("hello @name");
+        let name  = m.consts.add_str("name");
+        let one   = m.consts.add_num(1.0);
+        m.consts.bools = vec![false, true];
+        for i in 0..n_loops {
+            let base = (i * 4) as u32;
+            m.instructions.push(Instruction::LoadStr { dst: base, idx: hello });
+            m.instructions.push(Instruction::GetVar { dst: base + 1, name });
+            m.instructions.push(Instruction::Concat { dst: base + 2, parts: vec![base, base + 1] });
+            m.instructions.push(Instruction::LoadNum { dst: base + 3, idx: one });
+            m.instructions.push(Instruction::ExecCapture {
+                cmd: base + 2, mode: CmdMode::WithVarsSudo, dst_ec: base + 3, dst_out: base,
+            });
+            m.instructions.push(Instruction::JumpIfFalse { cond: base + 3, offset: 0 });
+        }
+        m.instructions.push(Instruction::Return { src: None });
+        m.funcs.entries.push(FuncEntry { name: "main_fn".into(), start_insn: 0, insn_count: 3 });
+        m.main_regs = (n_loops * 4) as u32;
+        m
+    }
+
+    fn same(a: &Instruction, b: &Instruction) -> bool {
+        format!("{:?}", a) == format!("{:?}", b)
+    }
+
+    #[test]
+    fn test_flat_roundtrip() {
+        let m = sample_module(3);
+        let bytes = write_flat_bytes(&m, b"#!/usr/bin/env -S /usr/bin/hl run\n");
+        let base = bytes.iter().position(|&b| b == b'\n').unwrap() + 1;
+        let fc = FlatBc::parse(&bytes, base).unwrap();
+        assert_eq!(fc.string(0), Some("hello @name"));
+        assert_eq!(fc.func(0).map(|f| f.0), Some("main_fn"));
+        let back = fc.to_module().unwrap();
+        assert_eq!(back.main_regs, m.main_regs);
+        assert_eq!(back.consts.strings, m.consts.strings);
+        assert_eq!(back.instructions.len(), m.instructions.len());
+        assert!(m.instructions.iter().zip(&back.instructions).all(|(a, b)| same(a, b)));
+    }
+
+    #[test]
+    fn test_flat_roundtrip_goroutine_ops() {
+        use crate::bytecode::GO_TAG_ALL;
+        let mut m = HlModule::new("go.hl", 2);
+        let chan = m.consts.add_str("wyniki");
+        let func = m.consts.add_str("__go_0");
+        m.instructions = vec![
+            Instruction::ChanOpen { name: chan, cap: 8 },
+            Instruction::GoSpawn  { func, tag: chan },
+            Instruction::ChanSend { name: chan, src: 1 },
+            Instruction::ChanRecv { name: chan, dst: 2 },
+            Instruction::GoWait   { tag: GO_TAG_ALL, dst: 3 },
+            Instruction::ArenaCall { name: func, size: 64 * 1024 },
+        ];
+        let bytes = write_flat_bytes(&m, b"");
+        let back = FlatBc::parse(&bytes, 0).unwrap().to_module().unwrap();
+        assert!(m.instructions.iter().zip(&back.instructions).all(|(a, b)| same(a, b)));
+    }
+
+    #[test]
+    fn test_flat_roundtrip_cmd_templates() {
+        let mut m = HlModule::new("tpl.hl", 2);
+        let (ping, c1) = (m.consts.add_str("ping"), m.consts.add_str("-c1"));
+        let raw = m.consts.add_str("ping -c1 ");
+        let tpl = Box::new(CmdTemplate {
+            raw:   vec![TplPart::Lit(raw), TplPart::Hole(4)],
+            words: vec![vec![TplPart::Lit(ping)], vec![TplPart::Lit(c1)], vec![TplPart::Hole(4)]],
+        });
+        m.instructions = vec![
+            Instruction::ExecTpl { tpl: tpl.clone(), mode: CmdMode::WithVars, dst: 5 },
+            Instruction::CaptureTpl { tpl: tpl.clone(), mode: CmdMode::Plain, dst_ec: 6, dst_out: 7 },
+            Instruction::ForInTpl { iter_reg: 8, tpl, mode: CmdMode::WithVarsSudo, lines: true },
+        ];
+        let bytes = write_flat_bytes(&m, b"");
+        let fc = FlatBc::parse(&bytes, 0).unwrap();
+        let back = fc.to_module().unwrap();
+        assert!(m.instructions.iter().zip(&back.instructions).all(|(a, b)| same(a, b)));
+        let extra = fc.extra_vec();
+        let v = TplView::parse(&extra, fc.insn(0).unwrap().a as usize).unwrap();
+        assert_eq!(v.words().count(), 3);
+        assert_eq!(tpl_part(v.raw[1]), TplPart::Hole(4));
+        assert!(TplView::parse(&extra[..extra.len() - 1], fc.insn(2).unwrap().b as usize).is_none());
+    }
+
+    #[test]
+    fn test_flat_roundtrip_not_and_tests() {
+        let mut m = HlModule::new("expr.hl", 2);
+        m.instructions = vec![
+            Instruction::Not  { dst: 1, src: 0 },
+            Instruction::Test { dst: 2, src: 0, op: TestOp::Dir },
+            Instruction::Test { dst: 3, src: 0, op: TestOp::NonZeroSize },
+        ];
+        let bytes = write_flat_bytes(&m, b"");
+        let back = FlatBc::parse(&bytes, 0).unwrap().to_module().unwrap();
+        assert!(m.instructions.iter().zip(&back.instructions).all(|(a, b)| same(a, b)));
+    }
+
+    #[test]
+    fn test_flat_rejects_truncated() {
+        let m = sample_module(1);
+        let bytes = write_flat_bytes(&m, b"");
+        assert!(FlatBc::parse(&bytes[..bytes.len() - 8], 0).is_err());
+    }
+
+    #[test]
+    fn test_flat_sections_aligned() {
+        let m = sample_module(2);
+        let bytes = write_flat_bytes(&m, b"#!x\n");
+        let fc = FlatBc::parse(&bytes, 4).unwrap();
+        let code_off = fc.code.as_ptr() as usize - bytes.as_ptr() as usize;
+        assert_eq!(code_off % 8, 0);
+    }
+
+    /// Porównanie czasu dekodowania: płaski widok vs JSON + bincode.
+    /// `cargo test -p hl-compiler --release -- --ignored bench_decode --nocapture`
+    #[test]
+    #[ignore]
+    fn bench_decode_flat_vs_bincode() {
+        use std::path::Path;
+        use std::time::Instant;
+        let m = sample_module(20_000);
+        let dir = std::env::temp_dir();
+        let p_bin  = dir.join("hl_bench_bincode.bc");
+        let p_flat = dir.join("hl_bench_flat.bc");
+        crate::serialize::write_bc_file_as(&m, &p_bin,  crate::serialize::BcFormat::Bincode).unwrap();
+        crate::serialize::write_bc_file_as(&m, &p_flat, crate::serialize::BcFormat::Flat).unwrap();
+        let raw_bin  = std::fs::read(&p_bin).unwrap();
+        let raw_flat = std::fs::read(&p_flat).unwrap();
+        let base = raw_flat.iter().position(|&b| b == b'\n').unwrap() + 1;
+        const ITERS: u32 = 50;
+
+        let t0 = Instant::now();
+        for _ in 0..ITERS {
+            let m = crate::serialize::parse_bc_bytes(&raw_bin, Path::new("bench")).unwrap();
+            std::hint::black_box(m.instructions.len());
+        }
+        let bin = t0.elapsed() / ITERS;
+
+        let t1 = Instant::now();
+        for _ in 0..ITERS {
+            let fc = FlatBc::parse(&raw_flat, base).unwrap();
+            std::hint::black_box(fc.insn(fc.insn_count() - 1));
+        }
+        let flat_view = t1.elapsed() / ITERS;
+
+        let t2 = Instant::now();
+        for _ in 0..ITERS {
+            let m = crate::serialize::parse_bc_bytes(&raw_flat, Path::new("bench")).unwrap();
+            std::hint::black_box(m.instructions.len());
+        }
+        let flat_full = t2.elapsed() / ITERS;
+
+        println!("insns={} bincode={}B flat={}B", m.instructions.len(), raw_bin.len(), raw_flat.len());
+        println!("bincode decode:       {:?}", bin);
+        println!("flat view (mmap-ready): {:?}", flat_view);
+        println!("flat -> HlModule:     {:?}", flat_full);
+        let _ = std::fs::remove_file(p_bin);
+        let _ = std::fs::remove_file(p_flat);
+    }
+}
@@ -2,13 +2,19 @@ pub mod bytecode;
 pub mod lower;
 pub mod optimize;
 pub mod serialize;
+pub mod flat;
 pub mod cache;
+pub mod link;
+pub mod batch;
 
 pub use bytecode::{HlModule, HlBcHeader, Instruction, ConstPool, FuncTable};
 pub use lower::lower_ast;
-pub use optimize::optimize_module;
-pub use serialize::{write_bc_file, read_bc_file, BC_MAGIC, BC_VERSION};
-pub use cache::{bc_cache_path, ensure_cache_dir, cache_cleanup_if_needed, CACHE_MAX_FILES};
+pub use optimize::{optimize_module, optimize_module_at, OptLevel};
+pub use serialize::{write_bc_file, write_bc_file_as, read_bc_file, BcFormat, MappedBc, BC_MAGIC, BC_VERSION};
+pub use flat::{FlatBc, FlatInsn, BC_FLAT_VERSION};
+pub use link::{link, LinkLib, InitVal, LIB_INIT_PREFIX};
+pub use batch::{compile_batch, expand_inputs, BatchOptions, BatchReport, Manifest, MANIFEST_FILE};
+pub use cache::{bc_cache_path, ensure_cache_dir, source_hash, CacheStats, CACHE_MAX_BYTES};
 
 use anyhow::Result;
 use hl_parser::{parse_source_with_meta, ParseMeta};
@@ -18,8 +24,26 @@ use std::path::Path;
 /// Kompiluje plik źródłowy do zoptymalizowanego bytecode.
 /// Zwraca ścieżkę do pliku .bc.
 pub fn compile_hl_to_bc(source_path: &Path, out_path: Option<&Path>) -> Result<std::path::PathBuf> {
+    compile_hl_to_bc_with(source_path, out_path, &CompileOptions::default())
+}
+
+/// Opcje `hl compile`
+#[derive(Debug, Clone, Default)]
+pub struct CompileOptions {
+    /// Format pliku wyjściowego (`--format=bincode|flat`)
+    pub format: BcFormat,
+    /// Poziom optymalizacji (`-O0/-O1/-O2`)
+    pub opt_level: OptLevel,
+}
+
+/// Jak `compile_hl_to_bc`, z jawnymi opcjami
+pub fn compile_hl_to_bc_with(
+    source_path: &Path,
+    out_path: Option<&Path>,
+    opts: &CompileOptions,
+) -> Result<std::path::PathBuf> {
     let source = std::fs::read_to_string(source_path)?;
-    compile_source_to_bc(&source, source_path, out_path)
+    compile_source_to_bc_with(&source, source_path, out_path, opts)
 }
 
 /// Kompiluj kod źródłowy (string) do .bc
@@ -28,14 +52,17 @@ pub fn compile_source_to_bc(
     source_path: &Path,
     out_path: Option<&Path>,
 ) -> Result<std::path::PathBuf> {
-    // 1. Parse
-    let meta: ParseMeta = parse_source_with_meta(source)?;
-
-    // 2. Lower AST → HlModule (nasz IR bytecode)
-    let mut module = lower_ast(&meta.nodes, source_path, meta.gen.number());
+    compile_source_to_bc_with(source, source_path, out_path, &CompileOptions::default())
+}
 
-    // 3. Optymalizuj
-    optimize_module(&mut module);
+pub fn compile_source_to_bc_with(
+    source: &str,
+    source_path: &Path,
+    out_path: Option<&Path>,
+    opts: &CompileOptions,
+) -> Result<std::path::PathBuf> {
+    // 1-3. Parse, lower, optymalizacja
+    let module = compile_source_to_module(source, source_path, opts.opt_level)?;
 
     // 4. Wyznacz ścieżkę wyjściową
     let bc_path = match out_path {
@@ -49,56 +76,59 @@ pub fn compile_source_to_bc(
     };
 
     // 5. Serializuj do pliku
-    write_bc_file(&module, &bc_path)?;
+    write_bc_file_as(&module, &bc_path, opts.format)?;
 
     Ok(bc_path)
 }
 
+/// .hl → zoptymalizowany `HlModule` w pamięci (bez zapisu .bc) — np. wejście
+/// `hl compile --native`
+pub fn compile_source_to_module(source: &str, source_path: &Path, level: OptLevel) -> Result<HlModule> {
+    // 1. Parse
+    let meta: ParseMeta = parse_source_with_meta(source)?;
+
+    // 2. Lower AST → HlModule (nasz IR bytecode)
+    let mut module = lower_ast(&meta.nodes, source_path, meta.gen.number());
+
+    // 3. Optymalizuj
+    optimize_module_at(&mut module, level);
+    Ok(module)
+}
+
+/// .hl → `HlModule` w pamięci, z tablicą linii (`HlModule::lines`) — dla
+/// `hl run --profile`. Nie zapisuje .bc i omija cache.
+pub fn compile_source_with_lines(source: &str, source_path: &Path, level: OptLevel) -> Result<HlModule> {
+    let meta = hl_parser::parse_source_with_lines(source)?;
+    let mut module = lower_ast(&meta.nodes, source_path, meta.gen.number());
+    optimize_module_at(&mut module, level);
+    Ok(module)
+}
+
 /// Kompiluj do cache (~/.hackeros/hacker-lang/cache/<hash>.bc)
+/// Klucz to hash treści — ścieżka skryptu nie ma znaczenia.
 /// Zwraca ścieżkę do pliku cache.
 pub fn compile_to_cache(source: &str, source_path: &Path) -> Result<std::path::PathBuf> {
     ensure_cache_dir()?;
-    cache_cleanup_if_needed()?;
 
-    // Hash jakości produkcyjnej: FNV-1a zamiast DefaultHasher (stabilny między procesami)
-    let hash = fnv1a_hash_source(source, source_path);
+    let hash = source_hash(source);
     let cache_path = bc_cache_path(&format!("{:016x}", hash));
 
-    // Jeśli cache trafiony i plik .bc nowszy niż źródło — zwróć od razu
-    if cache_path.exists() {
-        let src_mtime  = std::fs::metadata(source_path).ok()
-            .and_then(|m| m.modified().ok());
-        let bc_mtime   = std::fs::metadata(&cache_path).ok()
-            .and_then(|m| m.modified().ok());
-        if let (Some(src_m), Some(bc_m)) = (src_mtime, bc_mtime) {
-            if bc_m >= src_m {
-                tracing::debug!("cache hit: {:?}", cache_path);
-                return Ok(cache_path);
-            }
-        } else if cache_path.exists() {
-            // Brak mtime (np. FAT) — ufaj cache
-            tracing::debug!("cache hit (no mtime): {:?}", cache_path);
-            return Ok(cache_path);
-        }
+    // Plik o tym hashu istnieje = ta sama treść i wersja kompilatora
+    if cache::lookup(hash, &cache_path) {
+        tracing::debug!("cache hit: {:?}", cache_path);
+        return Ok(cache_path);
+    }
+
+    // Równoległa kompilacja tego samego skryptu: czekamy na blokadę wpisu
+    // i sprawdzamy ponownie — drugi proces dostaje gotowy plik
+    let _lock = cache::EntryLock::acquire(hash)?;
+    if cache::lookup(hash, &cache_path) {
+        tracing::debug!("cache hit (po blokadzie): {:?}", cache_path);
+        return Ok(cache_path);
     }
 
     tracing::debug!("cache miss, kompiluje: {:?}", source_path);
     compile_source_to_bc(source, source_path, Some(&cache_path))?;
+    cache::record_compiled(hash, &cache_path);
     Ok(cache_path)
 }
-
-/// FNV-1a hash — stabilny między procesami, szybszy niż sha256 dla małych danych
-fn fnv1a_hash_source(source: &str, path: &Path) -> u64 {
-    const FNV_OFFSET: u64 = 14695981039346656037;
-    const FNV_PRIME:  u64 = 1099511628211;
-    let mut hash = FNV_OFFSET;
-    for byte in source.as_bytes() {
-        hash ^= *byte as u64;
-        hash = hash.wrapping_mul(FNV_PRIME);
-    }
-    for byte in path.as_os_str().as_encoded_bytes() {
-        hash ^= *byte as u64;
-        hash = hash.wrapping_mul(FNV_PRIME);
-    }
-    hash
-}
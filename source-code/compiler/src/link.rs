@@ -0,0 +1,504 @@
+//! Linker bibliotek: moduł skryptu + moduły bibliotek z importów → jeden `HlModule`
+//!
+//! Lowering zamienia import `# <main/json>` na `CallFunc "__lib__main/json"`.
+//! Linker dokleja na koniec modułu tylko to, co jest osiągalne z kodu skryptu:
+//!  - inicjalizację biblioteki (jej główny blok bez ciał funkcji, plus zmienne
+//!    z `LinkLib::vars`) jako funkcję `__lib__<spec>`,
+//!  - funkcje bibliotek, które ktoś woła (`CallFunc`/`ArenaCall`/`GoSpawn`),
+//!    przechodnio.
+//! Nieużywane funkcje biblioteki nie trafiają do programu — interpreter ich
+//! nie tłumaczy, a JIT nie liczy ich wykonań.
+//!
+//! Kod skryptu zostaje na swoich offsetach, z tymi samymi indeksami stałych
+//! i rejestrami. Kod biblioteki dostaje własny zakres rejestrów (za
+//! najwyższym rejestrem modułu), stałe przepisane do wspólnej puli i skoki
+//! przesunięte na nowe miejsce. Nazwę funkcji rozwiązuje kolejno: skrypt,
+//! potem biblioteki od ostatnio importowanej (jak w executorze AST, gdzie
+//! późniejsza definicja nadpisuje wcześniejszą). Wyjątkiem są ukryte ciała
+//! `:*` (`__go_N`, numerowane per moduł): w bibliotece dostają sufiks
+//! `@<spec>`, więc jej `GoSpawn` zawsze trafia we własne ciało.
+
+use crate::bytecode::{ConstIdx, FuncEntry, HlModule, InsnOff, Instruction, Reg, TplPart, GO_TAG_ALL};
+use crate::optimize::{jump_targets, rename_regs, visit_regs};
+use anyhow::{bail, Result};
+use std::collections::{HashMap, HashSet};
+
+/// Prefiks funkcji inicjalizacji biblioteki
+pub const LIB_INIT_PREFIX: &str = "__lib__";
+
+/// Nazwa funkcji inicjalizacji dla importu (`<main/json>` i `main/json` → to samo)
+pub fn lib_init_name(lib: &str) -> String {
+    let lib = lib.trim();
+    let spec = lib.strip_prefix('<').and_then(|s| s.strip_suffix('>')).unwrap_or(lib);
+    format!("{}{}", LIB_INIT_PREFIX, spec.trim())
+}
+
+/// Spec importu z nazwy funkcji inicjalizacji
+pub fn lib_of_init(name: &str) -> Option<&str> {
+    name.strip_prefix(LIB_INIT_PREFIX)
+}
+
+/// Stała wartość zmiennej ustawianej przy inicjalizacji (wbudowane fallbacki,
+/// `BIT_<X>_LOADED` itp.)
+#[derive(Debug, Clone, PartialEq)]
+pub enum InitVal {
+    Str(String),
+    Num(f64),
+    Bool(bool),
+}
+
+/// Biblioteka do zlinkowania
+#[derive(Debug, Clone)]
+pub struct LinkLib {
+    /// Nazwa funkcji inicjalizacji (`lib_init_name`)
+    pub init:   String,
+    pub module: HlModule,
+    /// Zmienne ustawiane na końcu inicjalizacji
+    pub vars:   Vec<(String, InitVal)>,
+}
+
+/// Funkcje inicjalizacji bibliotek wołane przez moduł, w kolejności pierwszego użycia
+pub fn imports(module: &HlModule) -> Vec<String> {
+    let mut seen = HashSet::new();
+    module.instructions.iter()
+    .filter_map(|i| match i { Instruction::CallFunc { name } => Some(*name), _ => None })
+    .filter_map(|idx| module.consts.strings.get(idx as usize))
+    .filter(|s| s.starts_with(LIB_INIT_PREFIX) && seen.insert(s.as_str()))
+    .cloned()
+    .collect()
+}
+
+/// Czy moduł importuje jakąkolwiek bibliotekę
+pub fn has_imports(module: &HlModule) -> bool {
+    !imports(module).is_empty()
+}
+
+/// Najwyższy rejestr użyty w module + 1
+pub fn reg_limit(module: &HlModule) -> Reg {
+    let mut max = module.main_regs;
+    for insn in &module.instructions {
+        visit_regs(insn, &mut |r, _| max = max.max(r + 1));
+    }
+    max
+}
+
+/// Nazwy funkcji wołanych przez instrukcję (ConstIdx w puli jej modułu)
+fn called(insn: &Instruction) -> Option<ConstIdx> {
+    match insn {
+        Instruction::CallFunc { name } | Instruction::ArenaCall { name, .. } => Some(*name),
+        Instruction::GoSpawn { func, .. } => Some(*func),
+        _ => None,
+    }
+}
+
+/// Pula stałych, do której odnosi się indeks
+#[derive(Clone, Copy)]
+enum Pool { Str, Num }
+
+/// Przepisz indeksy stałych instrukcji
+fn remap_consts(insn: &mut Instruction, f: &mut dyn FnMut(Pool, ConstIdx) -> ConstIdx) {
+    use Instruction as I;
+    match insn {
+        I::LoadStr { idx, .. } => *idx = f(Pool::Str, *idx),
+        I::LoadNum { idx, .. } => *idx = f(Pool::Num, *idx),
+        I::GetVar { name, .. } | I::SetVar { name, .. } | I::SetEnv { name, .. }
+        | I::CallFunc { name } | I::ArenaCall { name, .. } | I::CallQuick { name, .. }
+        | I::ChanOpen { name, .. } | I::ChanSend { name, .. } | I::ChanRecv { name, .. } => {
+            *name = f(Pool::Str, *name)
+        }
+        I::GoSpawn { func, tag } => { *func = f(Pool::Str, *func); *tag = f(Pool::Str, *tag) }
+        I::GoWait { tag, .. } => if *tag != GO_TAG_ALL { *tag = f(Pool::Str, *tag) },
+        I::HackerOsCall { tool, .. } => *tool = f(Pool::Str, *tool),
+        I::ExecTpl { tpl, .. } | I::CaptureTpl { tpl, .. } | I::ForInTpl { tpl, .. } => {
+            for part in tpl.raw.iter_mut().chain(tpl.words.iter_mut().flatten()) {
+                if let TplPart::Lit(i) = part { *i = f(Pool::Str, *i); }
+            }
+        }
+        _ => {}
+    }
+}
+
+fn set_target(insn: &mut Instruction, to: InsnOff) {
+    match insn {
+        Instruction::Jump { offset }
+        | Instruction::JumpIfFalse { offset, .. }
+        | Instruction::JumpIfTrue { offset, .. } => *offset = to,
+        Instruction::ForInNext { end_off, .. }
+        | Instruction::ForRangeNext { end_off, .. } => *end_off = to,
+        _ => {}
+    }
+}
+
+/// Stan biblioteki w trakcie linkowania: przydzielony zakres rejestrów
+/// i przepisane stałe (tworzone przy pierwszym doklejonym fragmencie)
+struct LibState {
+    reg_base: Option<Reg>,
+    strs:     HashMap<ConstIdx, ConstIdx>,
+    nums:     HashMap<ConstIdx, ConstIdx>,
+}
+
+struct Linker<'l> {
+    out:      HlModule,
+    libs:     &'l [LinkLib],
+    state:    Vec<LibState>,
+    next_reg: Reg,
+}
+
+/// Ciało `:*` biblioteki po linkowaniu: `__go_N@<spec>`
+fn lib_go_name(name: &str, init: &str) -> String {
+    format!("{}@{}", name, lib_of_init(init).unwrap_or(init))
+}
+
+impl<'l> Linker<'l> {
+    /// Dostawca funkcji `name`: (biblioteka, Some(indeks w jej FuncTable) albo None = inicjalizacja)
+    fn provider(&self, name: &str) -> Option<(usize, Option<usize>)> {
+        if let Some(li) = self.libs.iter().position(|l| l.init == name) {
+            return Some((li, None));
+        }
+        // Ciało goroutine biblioteki — tylko z jej własnego modułu
+        if let Some((go, spec)) = name.strip_prefix(GO_PREFIX).and_then(|_| name.split_once('@')) {
+            let li = self.libs.iter().position(|l| lib_of_init(&l.init) == Some(spec))?;
+            let fi = self.libs[li].module.funcs.entries.iter().position(|e| e.name == go)?;
+            return Some((li, Some(fi)));
+        }
+        self.libs.iter().enumerate().rev().find_map(|(li, l)| {
+            l.module.funcs.entries.iter().position(|e| e.name == name).map(|fi| (li, Some(fi)))
+        })
+    }
+
+    /// Doklej instrukcje biblioteki `li` oznaczone w `keep` jako funkcję `name`.
+    /// Zwraca nazwy funkcji, które fragment woła.
+    fn append(&mut self, li: usize, name: &str, keep: &[bool], vars: &[(String, InitVal)]) -> Vec<String> {
+        let libs = self.libs;
+        let lib = &libs[li].module;
+        let n = lib.instructions.len();
+        let base = self.out.instructions.len() as InsnOff;
+        if self.state[li].reg_base.is_none() {
+            self.state[li].reg_base = Some(self.next_reg);
+            self.next_reg += reg_limit(lib);
+        }
+        let st = &mut self.state[li];
+        let reg_base = st.reg_base.unwrap_or(0);
+        let init = libs[li].init.as_str();
+        // `__go_N` tej biblioteki → `__go_N@<spec>` (w stałych i w wołanych nazwach)
+        let go_names: HashSet<&str> = lib.funcs.entries.iter()
+            .map(|e| e.name.as_str())
+            .filter(|n| n.starts_with(GO_PREFIX))
+            .collect();
+        let name_of = |s: &str| if go_names.contains(s) { lib_go_name(s, init) } else { s.to_string() };
+        // Zmienne inicjalizacji wchodzą przed ostatni Return głównego bloku
+        let vars_at = if vars.is_empty() { None } else { (0..n).rev().find(|&i| keep[i]) };
+
+        // Stary offset → nowy; usunięte instrukcje wskazują na następną zachowaną
+        let mut pos = vec![0 as InsnOff; n + 1];
+        let mut at = base;
+        for i in 0..n {
+            pos[i] = at;
+            if keep[i] {
+                if vars_at == Some(i) { at += 2 * vars.len() as InsnOff; }
+                at += 1;
+            }
+        }
+        pos[n] = at;
+        for i in (0..n).rev() {
+            if !keep[i] { pos[i] = pos[i + 1]; }
+        }
+
+        let mut calls = Vec::new();
+        let (code, consts) = (&mut self.out.instructions, &mut self.out.consts);
+        for i in (0..n).filter(|&i| keep[i]) {
+            if vars_at == Some(i) {
+                let r = reg_base;
+                for (var, val) in vars {
+                    code.push(match val {
+                        InitVal::Str(s)  => Instruction::LoadStr { dst: r, idx: consts.add_str(s.as_str()) },
+                        InitVal::Num(v)  => Instruction::LoadNum { dst: r, idx: consts.add_num(*v) },
+                        InitVal::Bool(b) => Instruction::LoadBool { dst: r, val: *b },
+                    });
+                    code.push(Instruction::SetVar { name: consts.add_str(var.as_str()), src: r });
+                }
+            }
+            let mut insn = lib.instructions[i].clone();
+            if let Some(c) = called(&insn) {
+                if let Some(s) = lib.consts.strings.get(c as usize) { calls.push(name_of(s)); }
+            }
+            rename_regs(&mut insn, &mut |r, _| r + reg_base);
+            remap_consts(&mut insn, &mut |pool, idx| match pool {
+                Pool::Str => *st.strs.entry(idx).or_insert_with(|| {
+                    consts.add_str(name_of(lib.consts.strings.get(idx as usize).map_or("", |s| s.as_str())))
+                }),
+                Pool::Num => *st.nums.entry(idx).or_insert_with(|| {
+                    consts.add_num(lib.consts.numbers.get(idx as usize).copied().unwrap_or(0.0))
+                }),
+            });
+            if let Some(t) = jump_targets(&insn) {
+                set_target(&mut insn, pos[(t as usize).min(n)]);
+            }
+            code.push(insn);
+        }
+
+        let end = self.out.instructions.len() as InsnOff;
+        self.out.funcs.entries.push(FuncEntry { name: name.to_string(), start_insn: base, insn_count: end - base });
+        calls
+    }
+}
+
+/// Zlinkuj moduł skryptu z bibliotekami. Nazwy, których nikt nie dostarcza,
+/// zostają nierozwiązane (błąd „Niezdefiniowana funkcja” dopiero przy wywołaniu),
+/// poza inicjalizacją biblioteki — brak modułu dla importu to błąd linkowania.
+pub fn link(main: &HlModule, libs: &[LinkLib]) -> Result<HlModule> {
+    let mut out = main.clone();
+    out.consts.rebuild_index();
+    let next_reg = reg_limit(&out);
+    let mut defined: HashSet<String> = out.funcs.entries.iter().map(|e| e.name.clone()).collect();
+    let mut work: Vec<String> = out.instructions.iter()
+    .filter_map(called)
+    .filter_map(|c| out.consts.strings.get(c as usize).cloned())
+    .collect();
+
+    let state = libs.iter().map(|_| LibState { reg_base: None, strs: HashMap::new(), nums: HashMap::new() }).collect();
+    let mut lk = Linker { out, libs, state, next_reg };
+
+    while let Some(name) = work.pop() {
+        if !defined.insert(name.clone()) { continue; }
+        let Some((li, func)) = lk.provider(&name) else {
+            if let Some(spec) = lib_of_init(&name) {
+                bail!("Brak modułu biblioteki dla importu '{}'", spec);
+            }
+            continue;
+        };
+        let lib = &libs[li].module;
+        let n = lib.instructions.len();
+        let (keep, vars) = match func {
+            Some(fi) => {
+                let e = &lib.funcs.entries[fi];
+                let (s, c) = (e.start_insn as usize, e.insn_count as usize);
+                ((0..n).map(|i| i >= s && i < s + c).collect::<Vec<_>>(), &[][..])
+            }
+            None => {
+                // Główny blok: wszystko poza ciałami funkcji
+                let mut keep = vec![true; n];
+                for e in &lib.funcs.entries {
+                    let s = (e.start_insn as usize).min(n);
+                    let end = (s + e.insn_count as usize).min(n);
+                    keep[s..end].iter_mut().for_each(|k| *k = false);
+                }
+                (keep, &libs[li].vars[..])
+            }
+        };
+        work.extend(lk.append(li, &name, &keep, vars));
+    }
+    Ok(lk.out)
+}
+
+/// Prefiks ukrytych funkcji ciał `:*` (`__go_N`) — numeracja per moduł
+const GO_PREFIX: &str = "__go_";
+
+/// Doklej fragment (linię REPL) na koniec modułu sesji. Kod sesji zostaje na
+/// swoich offsetach, więc przetłumaczony program i skompilowane trasy JIT
+/// pozostają ważne — interpreter tłumaczy tylko nowy ogon.
+///
+/// Rejestry fragmentu zaczynają się od `reg_base`, stałe trafiają do
+/// wspólnej puli (tylko dopisywanie — wcześniejsze ConstIdx się nie zmieniają),
+/// a skoki są przesuwane. Funkcja zdefiniowana ponownie zastępuje wpis
+/// w `FuncTable` (jak w executorze AST). Ukryte `__go_N` dostają sufiks
+/// offsetu, żeby nie nadpisać ciał goroutines z wcześniejszych fragmentów.
+/// Zwraca offset pierwszej instrukcji fragmentu.
+pub fn append(session: &mut HlModule, chunk: &HlModule, reg_base: Reg) -> InsnOff {
+    let base = session.instructions.len() as InsnOff;
+    let renames: HashMap<&str, String> = chunk.funcs.entries.iter()
+    .filter(|e| e.name.starts_with(GO_PREFIX))
+    .map(|e| (e.name.as_str(), format!("{}@{}", e.name, base)))
+    .collect();
+    let name_of = |n: &str| renames.get(n).cloned().unwrap_or_else(|| n.to_string());
+
+    let (code, consts) = (&mut session.instructions, &mut session.consts);
+    let mut strs: HashMap<ConstIdx, ConstIdx> = HashMap::new();
+    let mut nums: HashMap<ConstIdx, ConstIdx> = HashMap::new();
+    for insn in &chunk.instructions {
+        let mut insn = insn.clone();
+        rename_regs(&mut insn, &mut |r, _| r + reg_base);
+        remap_consts(&mut insn, &mut |pool, idx| match pool {
+            Pool::Str => *strs.entry(idx).or_insert_with(|| {
+                consts.add_str(name_of(chunk.consts.strings.get(idx as usize).map_or("", |s| s.as_str())))
+            }),
+            Pool::Num => *nums.entry(idx).or_insert_with(|| {
+                consts.add_num(chunk.consts.numbers.get(idx as usize).copied().unwrap_or(0.0))
+            }),
+        });
+        if let Some(t) = jump_targets(&insn) {
+            set_target(&mut insn, base + t);
+        }
+        code.push(insn);
+    }
+
+    for e in &chunk.funcs.entries {
+        let name = name_of(&e.name);
+        session.funcs.entries.retain(|f| f.name != name);
+        session.funcs.entries.push(FuncEntry { name, start_insn: base + e.start_insn, insn_count: e.insn_count });
+    }
+    session.lines.extend(chunk.lines.iter().map(|&(off, line)| (base + off, line)));
+    session.main_regs = session.main_regs.max(reg_base + chunk.main_regs);
+    base
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::bytecode::ConstPool;
+
+    fn module(code: Vec<Instruction>, strings: &[&str], funcs: &[(&str, u32, u32)]) -> HlModule {
+        let mut m = HlModule::new("t.hl", 2);
+        let mut consts = ConstPool::default();
+        for s in strings { consts.add_str(*s); }
+        m.consts = consts;
+        m.instructions = code;
+        m.funcs.entries = funcs.iter()
+            .map(|&(n, s, c)| FuncEntry { name: n.into(), start_insn: s, insn_count: c })
+            .collect();
+        m
+    }
+
+    fn lib() -> HlModule {
+        // 0: Jump 3 | 1: LoadStr r0 "a" | 2: Return   ← used
+        // 3: Jump 6 | 4: Print r0       | 5: Return   ← unused
+        // 6: LoadStr r1 "init" | 7: SetVar LIBVAR r1 | 8: Return
+        module(vec![
+            Instruction::Jump { offset: 3 },
+            Instruction::LoadStr { dst: 0, idx: 0 },
+            Instruction::Return { src: None },
+            Instruction::Jump { offset: 6 },
+            Instruction::Print { src: 0 },
+            Instruction::Return { src: None },
+            Instruction::LoadStr { dst: 1, idx: 3 },
+            Instruction::SetVar { name: 4, src: 1 },
+            Instruction::Return { src: None },
+        ], &["a", "used", "unused", "init", "LIBVAR"], &[("used", 1, 2), ("unused", 4, 2)])
+    }
+
+    #[test]
+    fn test_lib_init_name() {
+        assert_eq!(lib_init_name("<main/json>"), "__lib__main/json");
+        assert_eq!(lib_init_name("main/json"), "__lib__main/json");
+        assert_eq!(lib_of_init("__lib__bit/x"), Some("bit/x"));
+    }
+
+    #[test]
+    fn test_link_pulls_only_reachable_functions() {
+        let main = module(vec![
+            Instruction::CallFunc { name: 0 },
+            Instruction::CallFunc { name: 1 },
+            Instruction::LoadStr { dst: 2, idx: 2 },
+            Instruction::Return { src: None },
+        ], &["__lib__main/t", "used", "x"], &[]);
+        assert_eq!(imports(&main), vec!["__lib__main/t".to_string()]);
+
+        let libs = [LinkLib {
+            init: "__lib__main/t".into(), module: lib(),
+            vars: vec![("T_LOADED".into(), InitVal::Bool(true))],
+        }];
+        let out = link(&main, &libs).unwrap();
+        let names: Vec<&str> = out.funcs.entries.iter().map(|e| e.name.as_str()).collect();
+        assert!(names.contains(&"__lib__main/t") && names.contains(&"used"));
+        assert!(!names.contains(&"unused"), "{:?}", names);
+        // Kod skryptu nietknięty
+        assert_eq!(out.instructions[..4].len(), 4);
+        assert!(matches!(out.instructions[2], Instruction::LoadStr { dst: 2, idx: 2 }));
+
+        // Inicjalizacja: skoki nad funkcjami wskazują na następną zachowaną
+        // instrukcję, zmienne przed końcowym Return, rejestry za rejestrami skryptu
+        let init = out.funcs.entries.iter().find(|e| e.name == "__lib__main/t").unwrap();
+        let body = &out.instructions[init.start_insn as usize..(init.start_insn + init.insn_count) as usize];
+        assert_eq!(body.len(), 7);
+        let s = init.start_insn;
+        assert!(matches!(body[0], Instruction::Jump { offset } if offset == s + 1));
+        assert!(matches!(body[1], Instruction::Jump { offset } if offset == s + 2));
+        assert!(matches!(body[2], Instruction::LoadStr { dst: 4, .. }));
+        assert!(matches!(body[4], Instruction::LoadBool { val: true, .. }));
+        let Instruction::SetVar { name, .. } = body[5] else { panic!("{:?}", body[5]) };
+        assert_eq!(out.consts.strings[name as usize], "T_LOADED");
+        assert!(matches!(body[6], Instruction::Return { .. }));
+
+        let used = out.funcs.entries.iter().find(|e| e.name == "used").unwrap();
+        let Instruction::LoadStr { dst, idx } = out.instructions[used.start_insn as usize] else { panic!() };
+        assert_eq!((dst, out.consts.strings[idx as usize].as_str()), (3, "a"));
+    }
+
+    #[test]
+    fn test_link_keeps_goroutine_bodies_per_module() {
+        // Skrypt i biblioteka mają własne `__go_0`
+        let main = module(vec![
+            Instruction::GoSpawn { func: 0, tag: 1 },
+            Instruction::CallFunc { name: 2 },
+            Instruction::Return { src: None },
+            Instruction::LoadStr { dst: 0, idx: 3 },
+            Instruction::Return { src: None },
+        ], &["__go_0", "", "__lib__main/t", "script"], &[("__go_0", 3, 2)]);
+        let lib = module(vec![
+            Instruction::Jump { offset: 3 },
+            Instruction::LoadStr { dst: 0, idx: 0 },
+            Instruction::Return { src: None },
+            Instruction::GoSpawn { func: 1, tag: 2 },
+            Instruction::Return { src: None },
+        ], &["lib", "__go_0", ""], &[("__go_0", 1, 2)]);
+        let libs = [LinkLib { init: "__lib__main/t".into(), module: lib, vars: vec![] }];
+        let out = link(&main, &libs).unwrap();
+
+        let body_str = |func: ConstIdx| {
+            let name = &out.consts.strings[func as usize];
+            let e = out.funcs.entries.iter().find(|e| &e.name == name).unwrap();
+            let Instruction::LoadStr { idx, .. } = out.instructions[e.start_insn as usize] else { panic!() };
+            out.consts.strings[idx as usize].as_str()
+        };
+        let Instruction::GoSpawn { func, .. } = out.instructions[0] else { panic!() };
+        assert_eq!(body_str(func), "script");
+
+        let init = out.funcs.entries.iter().find(|e| e.name == "__lib__main/t").unwrap();
+        let spawn = out.instructions[init.start_insn as usize..].iter()
+            .find_map(|i| match i { Instruction::GoSpawn { func, .. } => Some(*func), _ => None })
+            .unwrap();
+        assert_eq!(out.consts.strings[spawn as usize], "__go_0@main/t");
+        assert_eq!(body_str(spawn), "lib");
+    }
+
+    #[test]
+    fn test_append_relocates_chunk() {
+        let mut session = HlModule::new("<repl>", 2);
+        let first = module(vec![
+            Instruction::Jump { offset: 3 },
+            Instruction::LoadStr { dst: 0, idx: 0 },
+            Instruction::Return { src: None },
+            Instruction::Return { src: None },
+        ], &["a", "f"], &[("f", 1, 2), ("__go_0", 1, 2)]);
+        assert_eq!(append(&mut session, &first, 0), 0);
+
+        let second = module(vec![
+            Instruction::LoadStr { dst: 1, idx: 0 },
+            Instruction::JumpIfFalse { cond: 1, offset: 3 },
+            Instruction::CallFunc { name: 1 },
+            Instruction::GoSpawn { func: 2, tag: 3 },
+            Instruction::Return { src: None },
+        ], &["b", "f", "__go_0", ""], &[("f", 2, 1), ("__go_0", 2, 1)]);
+        assert_eq!(append(&mut session, &second, 4), 4);
+
+        let code = &session.instructions;
+        assert!(matches!(code[1], Instruction::LoadStr { dst: 0, idx: 0 }));
+        let Instruction::LoadStr { dst, idx } = code[4] else { panic!("{:?}", code[4]) };
+        assert_eq!((dst, session.consts.strings[idx as usize].as_str()), (5, "b"));
+        assert!(matches!(code[5], Instruction::JumpIfFalse { cond: 5, offset: 7 }));
+        let Instruction::GoSpawn { func, .. } = code[7] else { panic!("{:?}", code[7]) };
+        assert_eq!(session.consts.strings[func as usize], "__go_0@4");
+
+        // `f` zastąpione, oba ciała goroutines zostają
+        let names: Vec<(&str, u32)> = session.funcs.entries.iter().map(|e| (e.name.as_str(), e.start_insn)).collect();
+        assert_eq!(names, vec![("__go_0@0", 1), ("f", 6), ("__go_0@4", 6)]);
+        assert_eq!(session.main_regs, 4);
+    }
+
+    #[test]
+    fn test_link_missing_library_is_error() {
+        let main = module(vec![Instruction::CallFunc { name: 0 }, Instruction::Return { src: None }],
+                          &["__lib__main/none"], &[]);
+        assert!(link(&main, &[]).is_err());
+    }
+}
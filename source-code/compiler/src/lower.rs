@@ -1,21 +1,36 @@
 use hl_parser::ast::*;
+use hl_parser::expr::{BinOp, Expr, UnOp};
 use crate::bytecode::*;
+use std::collections::HashMap;
 use std::path::Path;
 
 /// Stan lowering — trzyma kontekst kompilacji
 struct Lowerer {
     module:    HlModule,
     reg_alloc: u32,
+    /// Licznik ukrytych funkcji __go_N z ciałami goroutines
+    go_count:  u32,
+    /// Rozmiary aren z `:: nazwa <rozmiar> def` dla ArenaCall
+    arena_sizes: HashMap<String, u32>,
 }
 
+/// Rozmiar areny, gdy wywołanie poprzedza definicję
+const DEFAULT_ARENA_SIZE: u32 = 4096;
+
 /// Maksymalna liczba rejestrów — zapobiega przepełnieniu przy dużych skryptach
 const MAX_REGS: u32 = 65536;
 
+/// Znaki, przy których interpreter uruchamia komendę przez `sh -c`
+/// (`build_cmd_parts` w hl-jit) — takich komend nie dzielimy na argv
+pub const SHELL_CHARS: &[char] = &['|', ';', '&', '>', '<', '$', '`', '*', '~'];
+
 impl Lowerer {
     fn new(source_path: &str, gen: u32) -> Self {
         Self {
             module:    HlModule::new(source_path, gen),
             reg_alloc: 0,
+            go_count:  0,
+            arena_sizes: HashMap::new(),
         }
     }
 
@@ -66,6 +81,7 @@ impl Lowerer {
     fn lower_node(&mut self, node: &Node) {
         match node {
             Node::LineComment(_) | Node::DocComment(_) | Node::BlockComment(_) => {}
+            Node::SourceLine(line) => self.emit(Instruction::SourceLine { line: *line }),
 
             Node::Print { parts } => {
                 let dst = self.lower_string_parts(parts);
@@ -110,8 +126,8 @@ impl Lowerer {
                 self.emit(Instruction::SetEnv { name: name_idx, src });
             }
 
-            Node::Arithmetic { expr, assign_to } => {
-                let dst = self.lower_arithmetic(expr);
+            Node::Arithmetic { expr, parsed, assign_to } => {
+                let dst = self.lower_arithmetic(expr, parsed.as_ref());
                 if let Some(var) = assign_to {
                     let name_idx = self.module.consts.add_str(var.as_str());
                     self.emit(Instruction::SetVar { name: name_idx, src: dst });
@@ -123,10 +139,20 @@ impl Lowerer {
             Node::Command { raw, mode, .. } => {
                 // Interpoluj @VAR w komendzie — parse_string_parts rozbija na literały i zmienne
                 let parts = hl_parser::ast::parse_string_parts(raw);
-                let cmd_reg = self.lower_string_parts(&parts);
-                let dst = self.alloc_reg();
                 let mode = lower_cmd_mode(mode);
-                self.emit(Instruction::ExecCmd { cmd: cmd_reg, mode, dst });
+                let dst = match self.cmd_template(&parts, mode) {
+                    Some(tpl) => {
+                        let dst = self.alloc_reg();
+                        self.emit(Instruction::ExecTpl { tpl, mode, dst });
+                        dst
+                    }
+                    None => {
+                        let cmd_reg = self.lower_string_parts(&parts);
+                        let dst = self.alloc_reg();
+                        self.emit(Instruction::ExecCmd { cmd: cmd_reg, mode, dst });
+                        dst
+                    }
+                };
                 let le_idx = self.module.consts.add_str("_last_exit_code");
                 self.emit(Instruction::SetVar { name: le_idx, src: dst });
             }
@@ -134,11 +160,22 @@ impl Lowerer {
             Node::PipeToVar { command, mode, var_name } => {
                 // Interpoluj @VAR w komendzie
                 let parts = hl_parser::ast::parse_string_parts(command);
-                let cmd_reg = self.lower_string_parts(&parts);
-                let dst_ec  = self.alloc_reg();
-                let dst_out = self.alloc_reg();
                 let mode = lower_cmd_mode(mode);
-                self.emit(Instruction::ExecCapture { cmd: cmd_reg, mode, dst_ec, dst_out });
+                let dst_out = match self.cmd_template(&parts, mode) {
+                    Some(tpl) => {
+                        let dst_ec  = self.alloc_reg();
+                        let dst_out = self.alloc_reg();
+                        self.emit(Instruction::CaptureTpl { tpl, mode, dst_ec, dst_out });
+                        dst_out
+                    }
+                    None => {
+                        let cmd_reg = self.lower_string_parts(&parts);
+                        let dst_ec  = self.alloc_reg();
+                        let dst_out = self.alloc_reg();
+                        self.emit(Instruction::ExecCapture { cmd: cmd_reg, mode, dst_ec, dst_out });
+                        dst_out
+                    }
+                };
                 let name_idx = self.module.consts.add_str(var_name.as_str());
                 self.emit(Instruction::SetVar { name: name_idx, src: dst_out });
             }
@@ -165,44 +202,63 @@ impl Lowerer {
                 self.patch_jump(jump_ph, after);
             }
 
-            Node::ForIn { var, iterable, body } => {
+            Node::ForIn { var, iterable, lines, body } => {
                 let src = self.lower_string_parts(iterable);
                 let iter_reg = self.alloc_reg();
-                self.emit(Instruction::ForInStart { iter_reg, src });
+                self.emit(Instruction::ForInStart { iter_reg, src, lines: *lines });
+                self.lower_for_in_body(iter_reg, var, body);
+            }
 
+            Node::ForRange { var, from, to, body } => {
+                // Licznik i granica jako int (NanVal::int) w rejestrach — pętla
+                // bez zmiennych i stringów w nagłówku, trasa JIT liczy natywnie
+                let ctr = self.lower_range_bound(from);
+                let end = self.lower_range_bound(to);
                 let loop_start = self.current_offset();
-                let item_reg = self.alloc_reg();
-                // placeholder dla końca pętli — patched po kompilacji body
-                let end_ph_off = self.current_offset();
-                self.emit(Instruction::ForInNext { iter_reg, dst: item_reg, end_off: 0 });
-
+                self.emit(Instruction::ForRangeNext { ctr, end, end_off: 0 });
                 let var_idx = self.module.consts.add_str(var.as_str());
-                self.emit(Instruction::SetVar { name: var_idx, src: item_reg });
+                self.emit(Instruction::SetVar { name: var_idx, src: ctr });
 
                 self.lower_nodes(body);
-                // Skok z powrotem na początek iteratora
+                self.emit(Instruction::ForRangeStep { dst: ctr, src: ctr });
                 self.emit(Instruction::Jump { offset: loop_start });
 
-                let after_loop = self.current_offset();
-                // Patch ForInNext.end_off
-                if let Instruction::ForInNext { end_off, .. } =
-                    &mut self.module.instructions[end_ph_off as usize]
-                    {
-                        *end_off = after_loop;
+                let after = self.current_offset();
+                if let Instruction::ForRangeNext { end_off, .. } =
+                    &mut self.module.instructions[loop_start as usize]
+                {
+                    *end_off = after;
+                }
+            }
+
+            Node::ForInCmd { var, command, mode, lines, body } => {
+                let parts = hl_parser::ast::parse_string_parts(command);
+                let mode = lower_cmd_mode(mode);
+                let iter_reg = match self.cmd_template(&parts, mode) {
+                    Some(tpl) => {
+                        let iter_reg = self.alloc_reg();
+                        self.emit(Instruction::ForInTpl { iter_reg, tpl, mode, lines: *lines });
+                        iter_reg
                     }
+                    None => {
+                        let cmd = self.lower_string_parts(&parts);
+                        let iter_reg = self.alloc_reg();
+                        self.emit(Instruction::ForInCmd { iter_reg, cmd, mode, lines: *lines });
+                        iter_reg
+                    }
+                };
+                self.lower_for_in_body(iter_reg, var, body);
             }
 
-            Node::WhileLoop { condition, body } => {
+            Node::WhileLoop { parsed, body, .. } => {
+                // Porównania i testy jako instrukcje — warunek nigdy nie jest tekstem
                 let loop_start = self.current_offset();
-                let cond_reg = self.lower_string_parts(condition);
-                // ewaluacja warunku — truthy check
-                let bool_reg = self.alloc_reg();
-                self.emit(Instruction::Truthy { dst: bool_reg, src: cond_reg });
-                let exit_ph = self.emit_jump_placeholder(Some(bool_reg));
+                let mut exits = Vec::new();
+                self.lower_cond_jumps(parsed, &mut exits);
                 self.lower_nodes(body);
                 self.emit(Instruction::Jump { offset: loop_start });
                 let after = self.current_offset();
-                self.patch_jump(exit_ph, after);
+                for ph in exits { self.patch_jump(ph, after); }
             }
 
             Node::MatchExpr { subject, arms } => {
@@ -242,10 +298,13 @@ impl Lowerer {
             }
 
             Node::FuncDef { name, body } => {
+                // Ciało leży w strumieniu głównego kodu — główny blok je przeskakuje
+                let skip = self.emit_jump_placeholder(None);
                 let start = self.current_offset();
                 self.lower_nodes(body);
                 self.emit(Instruction::Return { src: None });
                 let end = self.current_offset();
+                self.patch_jump(skip, end);
                 self.module.funcs.entries.push(FuncEntry {
                     name:       name.clone(),
                                                start_insn: start,
@@ -258,20 +317,20 @@ impl Lowerer {
                 self.emit(Instruction::CallFunc { name: name_idx });
             }
 
-            Node::QuickCall { name, args } => {
+            Node::QuickCall { name, func, args } => {
                 let arg_reg  = self.lower_string_parts(args);
                 let dst      = self.alloc_reg();
                 let name_idx = self.module.consts.add_str(name.as_str());
-                self.emit(Instruction::CallQuick { name: name_idx, arg: arg_reg, dst });
+                self.emit(Instruction::CallQuick { name: name_idx, func: *func, arg: arg_reg, dst });
             }
 
             // :: name args |> @var — QuickCall z przechwyceniem do zmiennej
-            Node::QuickPipeToVar { name, args, var_name } => {
+            Node::QuickPipeToVar { name, func, args, var_name } => {
                 let arg_reg  = self.lower_string_parts(args);
                 let dst      = self.alloc_reg();
                 let name_idx = self.module.consts.add_str(name.as_str());
                 let var_idx  = self.module.consts.add_str(var_name.as_str());
-                self.emit(Instruction::CallQuick { name: name_idx, arg: arg_reg, dst });
+                self.emit(Instruction::CallQuick { name: name_idx, func: *func, arg: arg_reg, dst });
                 // Po wykonaniu: wynik quickcall jest w dst (jako string z captured output)
                 // Zapisz do zmiennej
                 self.emit(Instruction::SetVar { name: var_idx, src: dst });
@@ -359,7 +418,14 @@ impl Lowerer {
                 self.emit(Instruction::ExecCmd { cmd: cmd_reg, mode: CmdMode::Plain, dst });
             }
 
-            Node::Import { .. } | Node::Dependency { .. } => {
+            // Import biblioteki: wywołanie jej inicjalizacji, ciało dokleja
+            // linker (`link.rs`) z prekompilowanego modułu biblioteki
+            Node::Import { lib, .. } => {
+                let name = self.module.consts.add_str(crate::link::lib_init_name(lib));
+                self.emit(Instruction::CallFunc { name });
+            }
+
+            Node::Dependency { .. } => {
                 // Resolved at load-time przez JIT runtime
             }
 
@@ -373,30 +439,58 @@ impl Lowerer {
                 self.emit(Instruction::ExecCmd { cmd: cmd_reg, mode: CmdMode::Plain, dst });
             }
 
-            Node::Goroutine { name: _, body } => {
-                // Goroutines są emitowane jako osobne bloki — JIT spawnuje wątek
+            Node::Goroutine { name, body } => {
+                // Ciało staje się ukrytą funkcją (jak FuncDef), którą GoSpawn
+                // uruchamia w puli goroutines
+                let func = format!("__go_{}", self.go_count);
+                self.go_count += 1;
+                let skip = self.emit_jump_placeholder(None);
+                let start = self.current_offset();
                 self.lower_nodes(body);
+                self.emit(Instruction::Return { src: None });
+                let end = self.current_offset();
+                self.patch_jump(skip, end);
+                self.module.funcs.entries.push(FuncEntry {
+                    name:       func.clone(),
+                    start_insn: start,
+                    insn_count: end - start,
+                });
+                let func = self.module.consts.add_str(&func);
+                let tag  = self.module.consts.add_str(name.as_deref().unwrap_or(""));
+                self.emit(Instruction::GoSpawn { func, tag });
+            }
+
+            Node::GoroutineWait { name } => {
+                let tag = match name {
+                    Some(n) => self.module.consts.add_str(n),
+                    None    => GO_TAG_ALL,
+                };
+                let dst = self.alloc_reg();
+                self.emit(Instruction::GoWait { tag, dst });
+                let le_idx = self.module.consts.add_str("_last_exit_code");
+                self.emit(Instruction::SetVar { name: le_idx, src: dst });
             }
 
-            Node::Channel { name } => {
-                let chan_reg = self.alloc_reg();
-                let nil_idx = self.module.consts.add_str("");
-                self.emit(Instruction::LoadStr { dst: chan_reg, idx: nil_idx });
-                let chan_var = format!("__chan_{}", name);
-                let name_idx = self.module.consts.add_str(&chan_var);
-                self.emit(Instruction::SetVar { name: name_idx, src: chan_reg });
+            Node::Channel { name, cap } => {
+                let name = self.module.consts.add_str(name);
+                self.emit(Instruction::ChanOpen { name, cap: cap.map_or(0, |c| c.max(1)) as u32 });
             }
 
-            Node::ChannelOp { name, value } => {
-                let chan_var = format!("__chan_{}", name);
-                let name_idx = self.module.consts.add_str(&chan_var);
+            Node::ChannelOp { name, value, var_name } => {
+                let name_idx = self.module.consts.add_str(name);
                 if let Some(parts) = value {
                     let src = self.lower_string_parts(parts);
-                    self.emit(Instruction::SetVar { name: name_idx, src });
+                    self.emit(Instruction::ChanSend { name: name_idx, src });
                 } else {
                     let dst = self.alloc_reg();
-                    self.emit(Instruction::GetVar { dst, name: name_idx });
-                    self.emit(Instruction::Print { src: dst });
+                    self.emit(Instruction::ChanRecv { name: name_idx, dst });
+                    match var_name {
+                        Some(v) => {
+                            let var_idx = self.module.consts.add_str(v.as_str());
+                            self.emit(Instruction::SetVar { name: var_idx, src: dst });
+                        }
+                        None => self.emit(Instruction::Print { src: dst }),
+                    }
                 }
             }
 
@@ -405,12 +499,15 @@ impl Lowerer {
             // ── Arena functions (gen 2) ──────────────────────────────────────
             //
             // ArenaFuncDef: kompilujemy ciało jak zwykłą funkcję.
-            // Arena allocation dzieje się w runtime (executor), nie w bytecode.
-            Node::ArenaFuncDef { name, body, .. } => {
+            // Region areny otwiera wywołanie (ArenaCall), nie definicja.
+            Node::ArenaFuncDef { name, body, arena_size } => {
+                self.arena_sizes.insert(name.clone(), arena_size.bytes().min(u32::MAX as usize) as u32);
+                let skip = self.emit_jump_placeholder(None);
                 let start = self.current_offset();
                 self.lower_nodes(body);
                 self.emit(Instruction::Return { src: None });
                 let end = self.current_offset();
+                self.patch_jump(skip, end);
                 self.module.funcs.entries.push(FuncEntry {
                     name:       format!("__arena__{}", name),
                                                start_insn: start,
@@ -418,7 +515,8 @@ impl Lowerer {
                 });
             }
 
-            // ArenaFuncCall: wywołujemy skompilowane ciało jak funkcję.
+            // ArenaFuncCall: ArenaCall z rozmiarem z definicji (zapamiętanym
+            // w `arena_sizes`); nieznana definicja → domyślne 4k.
             // Prefiks __arena__ odróżnia od zwykłych funkcji (dla JIT/runtime).
             Node::ArenaFuncCall { name, args } => {
                 let arg_reg = self.lower_string_parts(args);
@@ -426,7 +524,8 @@ impl Lowerer {
                 self.emit(Instruction::SetVar { name: args_idx, src: arg_reg });
                 let fn_name = format!("__arena__{}", name);
                 let name_idx = self.module.consts.add_str(&fn_name);
-                self.emit(Instruction::CallFunc { name: name_idx });
+                let size = self.arena_sizes.get(name.as_str()).copied().unwrap_or(DEFAULT_ARENA_SIZE);
+                self.emit(Instruction::ArenaCall { name: name_idx, size });
             }
 
             // ExternDef — zewnętrzne runtimes (shell/python/java/elf/so)
@@ -465,6 +564,53 @@ impl Lowerer {
 
     // ── Pomocniki ────────────────────────────────────────────────
 
+    /// Wspólna część for-in: ForInNext → SetVar → ciało → skok wstecz
+    fn lower_for_in_body(&mut self, iter_reg: Reg, var: &str, body: &[Node]) {
+        let loop_start = self.current_offset();
+        let item_reg = self.alloc_reg();
+        // placeholder dla końca pętli — patched po kompilacji body
+        let end_ph_off = self.current_offset();
+        self.emit(Instruction::ForInNext { iter_reg, dst: item_reg, end_off: 0 });
+
+        let var_idx = self.module.consts.add_str(var);
+        self.emit(Instruction::SetVar { name: var_idx, src: item_reg });
+
+        self.lower_nodes(body);
+        // Skok z powrotem na początek iteratora
+        self.emit(Instruction::Jump { offset: loop_start });
+
+        let after_loop = self.current_offset();
+        // Patch ForInNext.end_off
+        if let Instruction::ForInNext { end_off, .. } =
+            &mut self.module.instructions[end_ph_off as usize]
+            {
+                *end_off = after_loop;
+            }
+    }
+
+    /// Granica `a..b` jako int w świeżym rejestrze; literał bez parsowania w runtime
+    fn lower_range_bound(&mut self, parts: &[StringPart]) -> Reg {
+        let src = match parts {
+            [StringPart::Literal(l)] if l.parse::<f64>().is_ok() => {
+                let dst = self.alloc_reg();
+                let idx = self.module.consts.add_num(l.parse().unwrap_or(0.0));
+                self.emit(Instruction::LoadNum { dst, idx });
+                dst
+            }
+            // Zmienna bez ToString — ToInt przyjmuje liczbę i tekst
+            [StringPart::Var(v)] => {
+                let dst  = self.alloc_reg();
+                let name = self.module.consts.add_str(v.as_str());
+                self.emit(Instruction::GetVar { dst, name });
+                dst
+            }
+            _ => self.lower_string_parts(parts),
+        };
+        let dst = self.alloc_reg();
+        self.emit(Instruction::ToInt { dst, src });
+        dst
+    }
+
     fn lower_string_parts(&mut self, parts: &[StringPart]) -> Reg {
         if parts.is_empty() {
             let dst = self.alloc_reg();
@@ -513,6 +659,59 @@ impl Lowerer {
         }
     }
 
+    /// Szablon argv dla komendy, którą interpreter uruchomiłby bez `sh -c`
+    /// (te same reguły co `build_cmd_parts`/`split_cmd`). Literały dzielimy na
+    /// słowa tutaj; dziury to rejestry z interpolowanymi wartościami. None —
+    /// komenda zostaje zwykłym ExecCmd ze sklejonym stringiem.
+    fn cmd_template(&mut self, parts: &[StringPart], mode: CmdMode) -> Option<Box<CmdTemplate>> {
+        // Tryby izolowane zawsze idą przez `unshare ... sh -c`
+        if matches!(mode, CmdMode::Isolated | CmdMode::IsolatedSudo | CmdMode::WithVarsIsolated) {
+            return None;
+        }
+        let shell = parts.iter().any(|p| matches!(p, StringPart::Literal(s) if s.contains(SHELL_CHARS)));
+        if shell || matches!(parts.first(), Some(StringPart::Literal(s)) if s.starts_with("__hl_import__")) {
+            return None;
+        }
+
+        let mut tpl = CmdTemplate { raw: Vec::with_capacity(parts.len()), words: Vec::new() };
+        let mut word: Vec<TplPart> = Vec::new();
+        let mut lit = String::new();
+        let (mut in_sq, mut in_dq) = (false, false);
+        for part in parts {
+            match part {
+                StringPart::Literal(s) => {
+                    tpl.raw.push(TplPart::Lit(self.module.consts.add_str(s.as_str())));
+                    for c in s.chars() {
+                        match c {
+                            '\'' if !in_dq => in_sq = !in_sq,
+                            '"'  if !in_sq => in_dq = !in_dq,
+                            ' ' | '\t' if !in_sq && !in_dq => {
+                                self.flush_tpl_lit(&mut lit, &mut word);
+                                if !word.is_empty() { tpl.words.push(std::mem::take(&mut word)); }
+                            }
+                            _ => lit.push(c),
+                        }
+                    }
+                }
+                StringPart::Var(_) | StringPart::DynVar(_) => {
+                    let reg = self.lower_string_part(part);
+                    tpl.raw.push(TplPart::Hole(reg));
+                    self.flush_tpl_lit(&mut lit, &mut word);
+                    word.push(TplPart::Hole(reg));
+                }
+            }
+        }
+        self.flush_tpl_lit(&mut lit, &mut word);
+        if !word.is_empty() { tpl.words.push(word); }
+        Some(Box::new(tpl))
+    }
+
+    fn flush_tpl_lit(&mut self, lit: &mut String, word: &mut Vec<TplPart>) {
+        if !lit.is_empty() {
+            word.push(TplPart::Lit(self.module.consts.add_str(std::mem::take(lit))));
+        }
+    }
+
     fn lower_var_value(&mut self, value: &VarValue) -> Reg {
         match value {
             VarValue::String(s) => {
@@ -541,8 +740,8 @@ impl Lowerer {
             VarValue::Interpolated(parts) => {
                 self.lower_string_parts(parts)
             }
-            VarValue::Arithmetic(expr) => {
-                self.lower_arithmetic(expr)
+            VarValue::Arithmetic(expr, parsed) => {
+                self.lower_arithmetic(expr, parsed.as_ref())
             }
             VarValue::CmdOutput(cmd) => {
                 // Interpoluj @VAR w komendzie
@@ -565,113 +764,145 @@ impl Lowerer {
         }
     }
 
-    /// Kompiluj wyrażenie arytmetyczne do rejestru wynikowego
-    /// Obsługuje: liczby, @zmienne, +, -, *, /, %, nawiasy
-    fn lower_arithmetic(&mut self, expr: &str) -> Reg {
-        let expr = expr.trim();
-        // Spróbuj skompilować wyrażenie do instrukcji arytmetycznych
-        if let Some(reg) = self.try_compile_arith_expr(expr) {
-            return reg;
+    /// `$( ... )` → rejestr z liczbą. Drzewo z `expr::parse_arith`; tekst spoza
+    /// gramatyki zostaje stringiem (jak dotąd)
+    fn lower_arithmetic(&mut self, expr: &str, parsed: Option<&Expr>) -> Reg {
+        if let Some(e) = parsed {
+            return self.lower_expr_num(e);
         }
-        // Fallback: traktuj jako string (shell fallback w runtime)
         let dst = self.alloc_reg();
-        let idx = self.module.consts.add_str(expr);
+        let idx = self.module.consts.add_str(expr.trim());
         self.emit(Instruction::LoadStr { dst, idx });
         dst
     }
 
-    fn try_compile_arith_expr(&mut self, expr: &str) -> Option<Reg> {
-        let expr = expr.trim();
-
-        // Liczba literalna
-        if let Ok(n) = expr.parse::<f64>() {
-            let dst = self.alloc_reg();
-            let idx = self.module.consts.add_num(n);
-            self.emit(Instruction::LoadNum { dst, idx });
-            return Some(dst);
-        }
-
-        // Zmienna @name
-        if expr.starts_with('@') {
-            let name = &expr[1..];
-            let dst = self.alloc_reg();
-            let name_idx = self.module.consts.add_str(name);
-            self.emit(Instruction::GetVar { dst, name: name_idx });
-            let num_dst = self.alloc_reg();
-            self.emit(Instruction::ToNumber { dst: num_dst, src: dst });
-            return Some(num_dst);
-        }
-
-        // Nawiasy
-        if expr.starts_with('(') && expr.ends_with(')') {
-            return self.try_compile_arith_expr(&expr[1..expr.len()-1]);
-        }
-
-        // Szukaj operatora na najniższym poziomie priorytetu (additive)
-        if let Some((left, op, right)) = find_binary_op_split(expr) {
-            let l = self.try_compile_arith_expr(left)?;
-            let r = self.try_compile_arith_expr(right)?;
-            let dst = self.alloc_reg();
-            let insn = match op {
-                '+' => Instruction::Add { dst, a: l, b: r },
-                '-' => Instruction::Sub { dst, a: l, b: r },
-                '*' => Instruction::Mul { dst, a: l, b: r },
-                '/' => Instruction::Div { dst, a: l, b: r },
-                '%' => Instruction::Mod { dst, a: l, b: r },
-                _   => return None,
-            };
-            self.emit(insn);
-            return Some(dst);
+    /// Wartość wyrażenia: liczba, bool albo string (`Str`)
+    fn lower_expr(&mut self, e: &Expr) -> Reg {
+        match e {
+            Expr::Num(n) => {
+                let dst = self.alloc_reg();
+                let idx = self.module.consts.add_num(*n);
+                self.emit(Instruction::LoadNum { dst, idx });
+                dst
+            }
+            Expr::Bool(b) => {
+                let dst = self.alloc_reg();
+                self.emit(Instruction::LoadBool { dst, val: *b });
+                dst
+            }
+            // Sama zmienna — surowa wartość (liczba zostaje liczbą dla CmpEq)
+            Expr::Str(parts) => match parts.as_slice() {
+                [StringPart::Var(name)] => {
+                    let dst = self.alloc_reg();
+                    let name_idx = self.module.consts.add_str(name.as_str());
+                    self.emit(Instruction::GetVar { dst, name: name_idx });
+                    dst
+                }
+                _ => self.lower_string_parts(parts),
+            },
+            Expr::Unary { op: UnOp::Neg, arg } => {
+                let src = self.lower_expr_num(arg);
+                let dst = self.alloc_reg();
+                self.emit(Instruction::Neg { dst, src });
+                dst
+            }
+            Expr::Unary { op: UnOp::Not, arg } => {
+                let src = self.lower_expr(arg);
+                let dst = self.alloc_reg();
+                self.emit(Instruction::Not { dst, src });
+                dst
+            }
+            Expr::Test { op, arg } => {
+                let src = self.lower_expr(arg);
+                let dst = self.alloc_reg();
+                self.emit(Instruction::Test { dst, src, op: *op });
+                dst
+            }
+            // && / || jako wartość: false, skoki warunku, true
+            Expr::Binary { op: BinOp::And | BinOp::Or, .. } => {
+                let dst = self.alloc_reg();
+                self.emit(Instruction::LoadBool { dst, val: false });
+                let mut on_false = Vec::new();
+                self.lower_cond_jumps(e, &mut on_false);
+                self.emit(Instruction::LoadBool { dst, val: true });
+                let after = self.current_offset();
+                for ph in on_false { self.patch_jump(ph, after); }
+                dst
+            }
+            Expr::Binary { op, lhs, rhs } => {
+                // `==`/`!=` porównują wartości (CmpEq: dwie liczby — liczbowo,
+                // inaczej tekst), reszta działa na liczbach
+                let (a, b) = if matches!(op, BinOp::Eq | BinOp::Ne) {
+                    (self.lower_expr(lhs), self.lower_expr(rhs))
+                } else {
+                    (self.lower_expr_num(lhs), self.lower_expr_num(rhs))
+                };
+                let dst = self.alloc_reg();
+                self.emit(match op {
+                    BinOp::Add => Instruction::Add   { dst, a, b },
+                    BinOp::Sub => Instruction::Sub   { dst, a, b },
+                    BinOp::Mul => Instruction::Mul   { dst, a, b },
+                    BinOp::Div => Instruction::Div   { dst, a, b },
+                    BinOp::Mod => Instruction::Mod   { dst, a, b },
+                    BinOp::Eq  => Instruction::CmpEq { dst, a, b },
+                    BinOp::Ne  => Instruction::CmpNe { dst, a, b },
+                    BinOp::Lt  => Instruction::CmpLt { dst, a, b },
+                    BinOp::Le  => Instruction::CmpLe { dst, a, b },
+                    BinOp::Gt  => Instruction::CmpGt { dst, a, b },
+                    BinOp::Ge  => Instruction::CmpGe { dst, a, b },
+                    BinOp::And | BinOp::Or => unreachable!(),
+                });
+                dst
+            }
         }
-
-        None
     }
-}
 
-/// Znajdź binarny operator z uwzględnieniem priorytetu i nawiasów
-fn find_binary_op_split(expr: &str) -> Option<(&str, char, &str)> {
-    let bytes = expr.as_bytes();
-    let mut depth = 0i32;
-
-    // Additive (najniższy priorytet — szukamy od końca)
-    let mut best_add: Option<usize> = None;
-    let mut best_sub: Option<usize> = None;
-
-    for i in (0..bytes.len()).rev() {
-        match bytes[i] {
-            b')' => depth += 1,
-            b'(' => depth -= 1,
-            b'+' if depth == 0 && i > 0 => { best_add = Some(i); break; }
-            b'-' if depth == 0 && i > 0 => { best_sub = Some(i); break; }
-            _ => {}
+    /// Wartość jako liczba — ToNumber tylko tam, gdzie wynik może być tekstem
+    fn lower_expr_num(&mut self, e: &Expr) -> Reg {
+        let src = self.lower_expr(e);
+        match e {
+            Expr::Num(_) | Expr::Unary { op: UnOp::Neg, .. } => src,
+            Expr::Binary { op, .. } if op.is_arith() => src,
+            _ => {
+                let dst = self.alloc_reg();
+                self.emit(Instruction::ToNumber { dst, src });
+                dst
+            }
         }
     }
 
-    let additive = match (best_add, best_sub) {
-        (Some(a), Some(b)) => if a > b { Some((a, '+')) } else { Some((b, '-')) },
-        (Some(a), None)    => Some((a, '+')),
-        (None, Some(b))    => Some((b, '-')),
-        _                  => None,
-    };
-
-    if let Some((pos, op)) = additive {
-        return Some((&expr[..pos], op, &expr[pos+1..]));
-    }
-
-    // Multiplicative
-    depth = 0;
-    for i in (0..bytes.len()).rev() {
-        match bytes[i] {
-            b')' => depth += 1,
-            b'(' => depth -= 1,
-            b'*' if depth == 0 => return Some((&expr[..i], '*', &expr[i+1..])),
-            b'/' if depth == 0 => return Some((&expr[..i], '/', &expr[i+1..])),
-            b'%' if depth == 0 => return Some((&expr[..i], '%', &expr[i+1..])),
-            _ => {}
+    /// Warunek jako skoki: kod przechodzi dalej, gdy `e` jest prawdziwe;
+    /// skoki do wyjścia „fałsz" trafiają do `on_false` (do załatania).
+    /// `&&`/`||`/`!` nie materializują boola — short-circuit to zwykłe skoki.
+    fn lower_cond_jumps(&mut self, e: &Expr, on_false: &mut Vec<InsnOff>) {
+        match e {
+            Expr::Binary { op: BinOp::And, lhs, rhs } => {
+                self.lower_cond_jumps(lhs, on_false);
+                self.lower_cond_jumps(rhs, on_false);
+            }
+            Expr::Binary { op: BinOp::Or, lhs, rhs } => {
+                let mut lhs_false = Vec::new();
+                self.lower_cond_jumps(lhs, &mut lhs_false);
+                let on_true = self.emit_jump_placeholder(None);
+                let rhs_start = self.current_offset();
+                for ph in lhs_false { self.patch_jump(ph, rhs_start); }
+                self.lower_cond_jumps(rhs, on_false);
+                let after = self.current_offset();
+                self.patch_jump(on_true, after);
+            }
+            Expr::Unary { op: UnOp::Not, arg } => {
+                let mut arg_false = Vec::new();
+                self.lower_cond_jumps(arg, &mut arg_false);
+                on_false.push(self.emit_jump_placeholder(None));
+                let after = self.current_offset();
+                for ph in arg_false { self.patch_jump(ph, after); }
+            }
+            _ => {
+                let cond = self.lower_expr(e);
+                on_false.push(self.emit_jump_placeholder(Some(cond)));
+            }
         }
     }
-
-    None
 }
 
 fn lower_cmd_mode(mode: &CommandMode) -> CmdMode {
@@ -1,85 +1,712 @@
+//! Optymalizator bytecode
+//!
+//! Przebiegi działają na grafie przepływu (CFG) zbudowanym nad liniowym
+//! strumieniem instrukcji. Lowering nadaje świeży rejestr każdemu
+//! tymczasowemu wynikowi, więc prawie wszystkie rejestry mają jedną definicję —
+//! taki rejestr, którego definicja dominuje wszystkie użycia, jest wartością
+//! SSA. Wyjątki (liczniki `RepeatN` i `ForRange*`, rejestry iteratorów for-in) mają kilka
+//! definicji i przebiegi oparte na SSA ich nie dotykają. Funkcji φ nie
+//! potrzebujemy: wartości łączące gałęzie lowering przenosi przez zmienne.
+//!
+//! Poziomy (`hl compile -O0/-O1/-O2`):
+//!  - O0 — bez zmian (znaczniki `SourceLine` zostają w kodzie)
+//!  - O1 — zwijanie stałych, propagacja kopii, sklejanie stałych `Concat`, DCE
+//!  - O2 — O1 + wyciąganie niezmienników z pętli for-in (LICM) i łączenie
+//!    rejestrów (linear scan), które zmniejsza `main_regs`
+
 use crate::bytecode::*;
+use std::collections::HashMap;
+
+/// Wersja przebiegów — wchodzi do klucza cache .bc. Podbij, gdy optymalizator
+/// zaczyna emitować inny kod dla tego samego źródła.
+pub const OPT_VERSION: u32 = 1;
+
+/// Poziom optymalizacji
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Default)]
+pub enum OptLevel {
+    O0,
+    O1,
+    #[default]
+    O2,
+}
+
+impl OptLevel {
+    /// "0" / "1" / "2" (z `-O<n>`)
+    pub fn from_str(s: &str) -> Option<Self> {
+        match s {
+            "0" => Some(Self::O0),
+            "1" => Some(Self::O1),
+            "2" => Some(Self::O2),
+            _   => None,
+        }
+    }
+}
 
 pub fn optimize_module(module: &mut HlModule) {
+    optimize_module_at(module, OptLevel::default());
+    // Deduplacja stałych jest już wbudowana w ConstPool
+}
+
+pub fn optimize_module_at(module: &mut HlModule, level: OptLevel) {
+    if level == OptLevel::O0 { return; }
+    pass_line_table(module);
     pass_constant_folding(module);
+    pass_copy_propagation(module);
+    pass_concat_folding(module);
+    pass_dead_code_elimination(module);
+    if level >= OptLevel::O2 {
+        pass_licm(module);
+    }
     pass_nop_elimination(module);
-    pass_source_line_strip(module);
-    // Deduplacja stałych jest już wbudowana w ConstPool
+    if level >= OptLevel::O2 {
+        pass_register_coalescing(module);
+    }
 }
 
-/// Constant folding: dwa LoadNum + Add/Sub/Mul/Div → jeden LoadNum
-fn pass_constant_folding(module: &mut HlModule) {
-    // Śledź jakie rejestry są wynikiem LoadNum i ich wartości
-    // (prosty jednoprzebiegowy model — bez analizy flow)
-    use std::collections::HashMap;
-    let mut reg_consts: HashMap<Reg, f64> = HashMap::new();
-
-    let len = module.instructions.len();
-    for i in 0..len {
-        match module.instructions[i].clone() {
-            Instruction::LoadNum { dst, idx } => {
-                let val = module.consts.numbers.get(idx as usize).copied().unwrap_or(0.0);
-                reg_consts.insert(dst, val);
-            }
-            Instruction::Add { dst, a, b } => {
-                if let (Some(&va), Some(&vb)) = (reg_consts.get(&a), reg_consts.get(&b)) {
-                    let result = va + vb;
-                    let new_idx = module.consts.add_num(result);
-                    module.instructions[i] = Instruction::LoadNum { dst, idx: new_idx };
-                    reg_consts.insert(dst, result);
-                } else {
-                    reg_consts.remove(&dst);
-                }
+// ── Operandy ─────────────────────────────────────────────────────────────────
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(crate) enum Role { Def, Use }
+
+/// Odwiedź rejestry instrukcji. Rejestr iteratora w `ForInNext` to użycie —
+/// stan iteratora żyje poza rejestrem, `ForInStart`/`ForInCmd` go definiują.
+pub(crate) fn visit_regs(insn: &Instruction, f: &mut dyn FnMut(Reg, Role)) {
+    use Instruction as I;
+    use Role::*;
+    match insn {
+        I::LoadStr { dst, .. } | I::LoadNum { dst, .. } | I::LoadBool { dst, .. }
+        | I::LoadNil { dst } | I::GetVar { dst, .. } | I::GoWait { dst, .. }
+        | I::ChanRecv { dst, .. } => f(*dst, Def),
+        I::GetVarDyn { dst, name } => { f(*name, Use); f(*dst, Def) }
+        I::SetVar { src, .. } | I::SetEnv { src, .. } | I::Print { src }
+        | I::ChanSend { src, .. } => f(*src, Use),
+        I::Add { dst, a, b } | I::Sub { dst, a, b } | I::Mul { dst, a, b }
+        | I::Div { dst, a, b } | I::Mod { dst, a, b }
+        | I::CmpEq { dst, a, b } | I::CmpNe { dst, a, b } | I::CmpLt { dst, a, b }
+        | I::CmpLe { dst, a, b } | I::CmpGt { dst, a, b } | I::CmpGe { dst, a, b } => {
+            f(*a, Use); f(*b, Use); f(*dst, Def)
+        }
+        I::Neg { dst, src } | I::ToString { dst, src } | I::ToNumber { dst, src }
+        | I::ToInt { dst, src } | I::ForRangeStep { dst, src } | I::Truthy { dst, src }
+        | I::Not { dst, src } | I::Test { dst, src, .. } => {
+            f(*src, Use); f(*dst, Def)
+        }
+        I::Concat { dst, parts } => {
+            for p in parts { f(*p, Use); }
+            f(*dst, Def)
+        }
+        I::JumpIfFalse { cond, .. } | I::JumpIfTrue { cond, .. } => f(*cond, Use),
+        I::Return { src } => if let Some(s) = src { f(*s, Use) },
+        I::CallQuick { arg, dst, .. } => { f(*arg, Use); f(*dst, Def) }
+        I::ExecCmd { cmd, dst, .. } => { f(*cmd, Use); f(*dst, Def) }
+        I::ExecCapture { cmd, dst_ec, dst_out, .. } => {
+            f(*cmd, Use); f(*dst_ec, Def); f(*dst_out, Def)
+        }
+        I::ForInStart { iter_reg, src, .. } => { f(*src, Use); f(*iter_reg, Def) }
+        I::ForInCmd { iter_reg, cmd, .. } => { f(*cmd, Use); f(*iter_reg, Def) }
+        I::ExecTpl { tpl, dst, .. } => { tpl.holes().for_each(|h| f(h, Use)); f(*dst, Def) }
+        I::CaptureTpl { tpl, dst_ec, dst_out, .. } => {
+            tpl.holes().for_each(|h| f(h, Use)); f(*dst_ec, Def); f(*dst_out, Def)
+        }
+        I::ForInTpl { iter_reg, tpl, .. } => { tpl.holes().for_each(|h| f(h, Use)); f(*iter_reg, Def) }
+        I::ForInNext { iter_reg, dst, .. } => { f(*iter_reg, Use); f(*dst, Def) }
+        I::ForRangeNext { ctr, end, .. } => { f(*ctr, Use); f(*end, Use) }
+        I::HackerOsCall { args, dst, .. } => { f(*args, Use); f(*dst, Def) }
+        I::Jump { .. } | I::CallFunc { .. } | I::ArenaCall { .. } | I::GoSpawn { .. }
+        | I::ChanOpen { .. } | I::SourceLine { .. } | I::Nop => {}
+    }
+}
+
+/// Przepisz rejestry instrukcji (ta sama kolejność i role co `visit_regs`)
+pub(crate) fn rename_regs(insn: &mut Instruction, f: &mut dyn FnMut(Reg, Role) -> Reg) {
+    use Instruction as I;
+    use Role::*;
+    match insn {
+        I::LoadStr { dst, .. } | I::LoadNum { dst, .. } | I::LoadBool { dst, .. }
+        | I::LoadNil { dst } | I::GetVar { dst, .. } | I::GoWait { dst, .. }
+        | I::ChanRecv { dst, .. } => *dst = f(*dst, Def),
+        I::GetVarDyn { dst, name } => { *name = f(*name, Use); *dst = f(*dst, Def) }
+        I::SetVar { src, .. } | I::SetEnv { src, .. } | I::Print { src }
+        | I::ChanSend { src, .. } => *src = f(*src, Use),
+        I::Add { dst, a, b } | I::Sub { dst, a, b } | I::Mul { dst, a, b }
+        | I::Div { dst, a, b } | I::Mod { dst, a, b }
+        | I::CmpEq { dst, a, b } | I::CmpNe { dst, a, b } | I::CmpLt { dst, a, b }
+        | I::CmpLe { dst, a, b } | I::CmpGt { dst, a, b } | I::CmpGe { dst, a, b } => {
+            *a = f(*a, Use); *b = f(*b, Use); *dst = f(*dst, Def)
+        }
+        I::Neg { dst, src } | I::ToString { dst, src } | I::ToNumber { dst, src }
+        | I::ToInt { dst, src } | I::ForRangeStep { dst, src } | I::Truthy { dst, src }
+        | I::Not { dst, src } | I::Test { dst, src, .. } => {
+            *src = f(*src, Use); *dst = f(*dst, Def)
+        }
+        I::Concat { dst, parts } => {
+            for p in parts.iter_mut() { *p = f(*p, Use); }
+            *dst = f(*dst, Def)
+        }
+        I::JumpIfFalse { cond, .. } | I::JumpIfTrue { cond, .. } => *cond = f(*cond, Use),
+        I::Return { src } => if let Some(s) = src { *s = f(*s, Use) },
+        I::CallQuick { arg, dst, .. } => { *arg = f(*arg, Use); *dst = f(*dst, Def) }
+        I::ExecCmd { cmd, dst, .. } => { *cmd = f(*cmd, Use); *dst = f(*dst, Def) }
+        I::ExecCapture { cmd, dst_ec, dst_out, .. } => {
+            *cmd = f(*cmd, Use); *dst_ec = f(*dst_ec, Def); *dst_out = f(*dst_out, Def)
+        }
+        I::ForInStart { iter_reg, src, .. } => { *src = f(*src, Use); *iter_reg = f(*iter_reg, Def) }
+        I::ForInCmd { iter_reg, cmd, .. } => { *cmd = f(*cmd, Use); *iter_reg = f(*iter_reg, Def) }
+        I::ExecTpl { tpl, dst, .. } => { rename_tpl(tpl, f); *dst = f(*dst, Def) }
+        I::CaptureTpl { tpl, dst_ec, dst_out, .. } => {
+            rename_tpl(tpl, f); *dst_ec = f(*dst_ec, Def); *dst_out = f(*dst_out, Def)
+        }
+        I::ForInTpl { iter_reg, tpl, .. } => { rename_tpl(tpl, f); *iter_reg = f(*iter_reg, Def) }
+        I::ForInNext { iter_reg, dst, .. } => { *iter_reg = f(*iter_reg, Use); *dst = f(*dst, Def) }
+        I::ForRangeNext { ctr, end, .. } => { *ctr = f(*ctr, Use); *end = f(*end, Use) }
+        I::HackerOsCall { args, dst, .. } => { *args = f(*args, Use); *dst = f(*dst, Def) }
+        I::Jump { .. } | I::CallFunc { .. } | I::ArenaCall { .. } | I::GoSpawn { .. }
+        | I::ChanOpen { .. } | I::SourceLine { .. } | I::Nop => {}
+    }
+}
+
+/// Dziury szablonu komendy: `raw` odwiedzane raz (jak w `visit_regs`), słowa
+/// dostają to samo przemianowanie — to te same rejestry w innym podziale.
+fn rename_tpl(tpl: &mut CmdTemplate, f: &mut dyn FnMut(Reg, Role) -> Reg) {
+    let mut map: Vec<(Reg, Reg)> = Vec::new();
+    for part in tpl.raw.iter_mut() {
+        if let TplPart::Hole(r) = part {
+            let new = f(*r, Role::Use);
+            map.push((*r, new));
+            *r = new;
+        }
+    }
+    for part in tpl.words.iter_mut().flatten() {
+        if let TplPart::Hole(r) = part {
+            if let Some(&(_, new)) = map.iter().find(|(old, _)| old == r) { *r = new; }
+        }
+    }
+}
+
+/// Instrukcja bez efektów ubocznych — można ją usunąć, gdy wynik jest nieużywany.
+/// `Truthy`, `Not` i `Test` tylko czytają wartość / metadane pliku.
+fn is_pure(insn: &Instruction) -> bool {
+    use Instruction as I;
+    matches!(insn,
+        I::LoadStr { .. } | I::LoadNum { .. } | I::LoadBool { .. } | I::LoadNil { .. }
+        | I::GetVar { .. } | I::GetVarDyn { .. }
+        | I::Add { .. } | I::Sub { .. } | I::Mul { .. } | I::Div { .. } | I::Mod { .. }
+        | I::Neg { .. } | I::Truthy { .. } | I::Not { .. } | I::Test { .. }
+        | I::CmpEq { .. } | I::CmpNe { .. } | I::CmpLt { .. } | I::CmpLe { .. }
+        | I::CmpGt { .. } | I::CmpGe { .. }
+        | I::ToString { .. } | I::ToNumber { .. } | I::ToInt { .. } | I::ForRangeStep { .. }
+        | I::Concat { .. })
+}
+
+/// Cele skoku instrukcji
+pub(crate) fn jump_targets(insn: &Instruction) -> Option<InsnOff> {
+    match insn {
+        Instruction::Jump { offset }
+        | Instruction::JumpIfFalse { offset, .. }
+        | Instruction::JumpIfTrue { offset, .. } => Some(*offset),
+        Instruction::ForInNext { end_off, .. }
+        | Instruction::ForRangeNext { end_off, .. } => Some(*end_off),
+        _ => None,
+    }
+}
+
+/// Czy po instrukcji sterowanie może przejść do następnej
+fn falls_through(insn: &Instruction) -> bool {
+    !matches!(insn, Instruction::Jump { .. } | Instruction::Return { .. })
+}
+
+// ── CFG + dominatory ─────────────────────────────────────────────────────────
+
+/// Graf przepływu modułu. Każde ciało funkcji to osobny region z własnym
+/// wejściem; blok nigdy nie przekracza granicy regionu.
+struct Cfg {
+    /// Region instrukcji: 0 = główny kod, k = ciało `funcs.entries[k-1]`
+    region:   Vec<u32>,
+    /// Blok instrukcji
+    block_of: Vec<usize>,
+    /// Zakres instrukcji bloku [start, end)
+    blocks:   Vec<(usize, usize)>,
+    succs:    Vec<Vec<usize>>,
+    preds:    Vec<Vec<usize>>,
+    /// Bezpośredni dominator (None = blok nieosiągalny albo wejście)
+    idom:     Vec<Option<usize>>,
+    /// Numer bloku w RPO (usize::MAX = nieosiągalny)
+    rpo_num:  Vec<usize>,
+    /// Bloki wejściowe (główny kod + funkcje)
+    entries:  Vec<usize>,
+}
+
+impl Cfg {
+    fn build(module: &HlModule) -> Self {
+        let code = &module.instructions;
+        let n = code.len();
+
+        // Region = najmniejsze ciało funkcji zawierające instrukcję
+        let mut region = vec![0u32; n];
+        let mut best = vec![u32::MAX; n];
+        for (k, e) in module.funcs.entries.iter().enumerate() {
+            let (s, c) = (e.start_insn as usize, e.insn_count);
+            for i in s..(s + c as usize).min(n) {
+                if c < best[i] { best[i] = c; region[i] = k as u32 + 1; }
             }
-            Instruction::Sub { dst, a, b } => {
-                if let (Some(&va), Some(&vb)) = (reg_consts.get(&a), reg_consts.get(&b)) {
-                    let result = va - vb;
-                    let new_idx = module.consts.add_num(result);
-                    module.instructions[i] = Instruction::LoadNum { dst, idx: new_idx };
-                    reg_consts.insert(dst, result);
-                } else {
-                    reg_consts.remove(&dst);
+        }
+
+        let mut leader = vec![false; n + 1];
+        if n > 0 { leader[0] = true; }
+        for e in &module.funcs.entries {
+            if (e.start_insn as usize) < n { leader[e.start_insn as usize] = true; }
+        }
+        for (i, insn) in code.iter().enumerate() {
+            if let Some(t) = jump_targets(insn) {
+                leader[(t as usize).min(n)] = true;
+                leader[i + 1] = true;
+            }
+            if !falls_through(insn) { leader[i + 1] = true; }
+            if i + 1 < n && region[i + 1] != region[i] { leader[i + 1] = true; }
+        }
+
+        let mut blocks = Vec::new();
+        let mut block_of = vec![0usize; n];
+        let mut start = 0;
+        for i in 1..=n {
+            if leader[i] || i == n {
+                if start < i {
+                    for j in start..i { block_of[j] = blocks.len(); }
+                    blocks.push((start, i));
                 }
+                start = i;
             }
-            Instruction::Mul { dst, a, b } => {
-                if let (Some(&va), Some(&vb)) = (reg_consts.get(&a), reg_consts.get(&b)) {
-                    let result = va * vb;
-                    let new_idx = module.consts.add_num(result);
-                    module.instructions[i] = Instruction::LoadNum { dst, idx: new_idx };
-                    reg_consts.insert(dst, result);
+        }
+
+        let nb = blocks.len();
+        let mut succs = vec![Vec::new(); nb];
+        let mut preds = vec![Vec::new(); nb];
+        for (b, &(_, end)) in blocks.iter().enumerate() {
+            let last = &code[end - 1];
+            let add = |t: usize, succs: &mut Vec<Vec<usize>>| {
+                if t < n && region[t] == region[end - 1] && !succs[b].contains(&block_of[t]) {
+                    succs[b].push(block_of[t]);
+                }
+            };
+            if let Some(t) = jump_targets(last) { add(t as usize, &mut succs); }
+            if falls_through(last) { add(end, &mut succs); }
+        }
+        for b in 0..nb {
+            for &s in &succs[b].clone() { preds[s].push(b); }
+        }
+
+        let mut entries = Vec::new();
+        if nb > 0 { entries.push(0); }
+        for e in &module.funcs.entries {
+            let s = e.start_insn as usize;
+            if s < n && !entries.contains(&block_of[s]) { entries.push(block_of[s]); }
+        }
+
+        let mut cfg = Self {
+            region, block_of, blocks, succs, preds,
+            idom: vec![None; nb], rpo_num: vec![usize::MAX; nb], entries,
+        };
+        cfg.compute_dominators();
+        cfg
+    }
+
+    /// Cooper–Harvey–Kennedy nad wirtualnym korzeniem łączącym wszystkie wejścia
+    fn compute_dominators(&mut self) {
+        let nb = self.blocks.len();
+        let root = nb;
+        let mut order = Vec::with_capacity(nb);
+        let mut seen = vec![false; nb];
+        for &e in &self.entries {
+            // DFS postorder (iteracyjnie — długie skrypty dają głębokie grafy)
+            if seen[e] { continue; }
+            seen[e] = true;
+            let mut stack = vec![(e, 0usize)];
+            while let Some((b, k)) = stack.pop() {
+                if k < self.succs[b].len() {
+                    stack.push((b, k + 1));
+                    let s = self.succs[b][k];
+                    if !seen[s] { seen[s] = true; stack.push((s, 0)); }
                 } else {
-                    reg_consts.remove(&dst);
+                    order.push(b);
                 }
             }
-            Instruction::Div { dst, a, b } => {
-                if let (Some(&va), Some(&vb)) = (reg_consts.get(&a), reg_consts.get(&b)) {
-                    let result = if vb == 0.0 { 0.0 } else { va / vb };
-                    let new_idx = module.consts.add_num(result);
-                    module.instructions[i] = Instruction::LoadNum { dst, idx: new_idx };
-                    reg_consts.insert(dst, result);
-                } else {
-                    reg_consts.remove(&dst);
+        }
+        order.reverse();
+        for (i, &b) in order.iter().enumerate() { self.rpo_num[b] = i; }
+
+        // idom[root] = root; wejścia mają za dominatora korzeń
+        let mut idom: Vec<usize> = vec![usize::MAX; nb + 1];
+        idom[root] = root;
+        let rpo_of = |b: usize, rpo: &Vec<usize>| if b == root { 0 } else { rpo[b] + 1 };
+        let mut changed = true;
+        while changed {
+            changed = false;
+            for &b in &order {
+                let mut preds: Vec<usize> = self.preds[b].iter().copied()
+                .filter(|&p| idom[p] != usize::MAX).collect();
+                if self.entries.contains(&b) { preds.push(root); }
+                let Some(&first) = preds.first() else { continue };
+                let mut new = first;
+                for &p in &preds[1..] {
+                    let (mut x, mut y) = (p, new);
+                    while x != y {
+                        while rpo_of(x, &self.rpo_num) > rpo_of(y, &self.rpo_num) { x = idom[x]; }
+                        while rpo_of(y, &self.rpo_num) > rpo_of(x, &self.rpo_num) { y = idom[y]; }
+                    }
+                    new = x;
                 }
+                if idom[b] != new { idom[b] = new; changed = true; }
             }
-            Instruction::Mod { dst, a, b } => {
-                if let (Some(&va), Some(&vb)) = (reg_consts.get(&a), reg_consts.get(&b)) {
-                    let result = if vb == 0.0 { 0.0 } else { (va as i64 % vb as i64) as f64 };
-                    let new_idx = module.consts.add_num(result);
-                    module.instructions[i] = Instruction::LoadNum { dst, idx: new_idx };
-                    reg_consts.insert(dst, result);
-                } else {
-                    reg_consts.remove(&dst);
+        }
+        for b in 0..nb {
+            self.idom[b] = (idom[b] != usize::MAX && idom[b] != root).then_some(idom[b]);
+        }
+    }
+
+    fn reachable(&self, b: usize) -> bool { self.rpo_num[b] != usize::MAX }
+
+    /// Czy blok `a` dominuje blok `b`
+    fn dominates(&self, a: usize, mut b: usize) -> bool {
+        if !self.reachable(a) || !self.reachable(b) { return false; }
+        loop {
+            if a == b { return true; }
+            match self.idom[b] {
+                Some(d) => b = d,
+                None    => return false,
+            }
+        }
+    }
+
+    /// Czy instrukcja `p` wykonuje się przed `q` na każdej ścieżce do `q`
+    fn dominates_insn(&self, p: usize, q: usize) -> bool {
+        let (bp, bq) = (self.block_of[p], self.block_of[q]);
+        if bp == bq { p < q && self.reachable(bp) } else { self.dominates(bp, bq) }
+    }
+}
+
+/// Widok SSA: rejestr z jedną definicją dominującą wszystkie użycia
+struct Ssa {
+    /// Pozycja jedynej definicji (brak wpisu = brak albo kilka definicji)
+    def: HashMap<Reg, usize>,
+}
+
+impl Ssa {
+    fn build(module: &HlModule, cfg: &Cfg) -> Self {
+        let mut def: HashMap<Reg, usize> = HashMap::new();
+        let mut multi = std::collections::HashSet::new();
+        let mut uses: HashMap<Reg, Vec<usize>> = HashMap::new();
+        for (i, insn) in module.instructions.iter().enumerate() {
+            visit_regs(insn, &mut |r, role| match role {
+                Role::Def => if def.insert(r, i).is_some() { multi.insert(r); },
+                Role::Use => uses.entry(r).or_default().push(i),
+            });
+        }
+        for r in &multi { def.remove(r); }
+        // Definicja musi dominować każde użycie
+        def.retain(|r, &mut d| {
+            uses.get(r).map_or(true, |us| us.iter().all(|&u| cfg.dominates_insn(d, u)))
+        });
+        Self { def }
+    }
+
+    /// Definicja rejestru widoczna w `pos` jako wartość SSA
+    fn value_at(&self, r: Reg, pos: usize, cfg: &Cfg) -> Option<usize> {
+        let d = *self.def.get(&r)?;
+        cfg.dominates_insn(d, pos).then_some(d)
+    }
+
+    fn is_ssa(&self, r: Reg) -> bool { self.def.contains_key(&r) }
+}
+
+// ── Przebiegi ────────────────────────────────────────────────────────────────
+
+/// Constant folding: dwa LoadNum + Add/Sub/Mul/Div/Mod → jeden LoadNum.
+/// Operandy muszą być wartościami SSA — licznik pętli (kilka definicji)
+/// nie jest stałą, mimo że jego pierwsza definicja to LoadNum.
+fn pass_constant_folding(module: &mut HlModule) {
+    let cfg = Cfg::build(module);
+    let ssa = Ssa::build(module, &cfg);
+
+    for i in 0..module.instructions.len() {
+        let (dst, a, b, op) = match module.instructions[i] {
+            Instruction::Add { dst, a, b } => (dst, a, b, '+'),
+            Instruction::Sub { dst, a, b } => (dst, a, b, '-'),
+            Instruction::Mul { dst, a, b } => (dst, a, b, '*'),
+            Instruction::Div { dst, a, b } => (dst, a, b, '/'),
+            Instruction::Mod { dst, a, b } => (dst, a, b, '%'),
+            _ => continue,
+        };
+        let num_of = |r: Reg, insns: &[Instruction], consts: &ConstPool| -> Option<f64> {
+            match insns[ssa.value_at(r, i, &cfg)?] {
+                Instruction::LoadNum { idx, .. } => consts.numbers.get(idx as usize).copied(),
+                _ => None,
+            }
+        };
+        let (Some(va), Some(vb)) = (num_of(a, &module.instructions, &module.consts),
+                                    num_of(b, &module.instructions, &module.consts)) else { continue };
+        // Ta sama semantyka co interpreter (dzielenie przez 0 → 0)
+        let result = match op {
+            '+' => va + vb,
+            '-' => va - vb,
+            '*' => va * vb,
+            '/' => if vb == 0.0 { 0.0 } else { va / vb },
+            _   => { let (x, y) = (va as i64, vb as i64); if y == 0 { 0.0 } else { (x % y) as f64 } }
+        };
+        let idx = module.consts.add_num(result);
+        module.instructions[i] = Instruction::LoadNum { dst, idx };
+    }
+}
+
+/// Propagacja kopii: `ToString` wartości, która już jest stringiem, i `ToNumber`
+/// liczby to kopie — użycia wyniku czytają wprost źródło (martwą kopię usuwa DCE)
+fn pass_copy_propagation(module: &mut HlModule) {
+    use Instruction as I;
+    let cfg = Cfg::build(module);
+    let ssa = Ssa::build(module, &cfg);
+
+    let mut repl: HashMap<Reg, Reg> = HashMap::new();
+    let find = |r: Reg, repl: &HashMap<Reg, Reg>| {
+        let mut r = r;
+        while let Some(&n) = repl.get(&r) { r = n; }
+        r
+    };
+
+    for i in 0..module.instructions.len() {
+        let (dst, src, want_str) = match module.instructions[i] {
+            I::ToString { dst, src } => (dst, src, true),
+            I::ToNumber { dst, src } => (dst, src, false),
+            _ => continue,
+        };
+        if !ssa.is_ssa(dst) { continue; }
+        let src = find(src, &repl);
+        let Some(d) = ssa.value_at(src, i, &cfg) else { continue };
+        let is_copy = match &module.instructions[d] {
+            // CallQuick nie jest tu kopią: `::len`, `::max`… dają liczbę, predykaty bool
+            I::LoadStr { .. } | I::Concat { .. } | I::ToString { .. } | I::ChanRecv { .. } => want_str,
+            I::ExecCapture { dst_out, .. } | I::CaptureTpl { dst_out, .. } => want_str && *dst_out == src,
+            I::LoadNum { .. } | I::Add { .. } | I::Sub { .. } | I::Mul { .. } | I::Div { .. }
+            | I::Mod { .. } | I::Neg { .. } | I::ToNumber { .. } => !want_str,
+            _ => false,
+        };
+        if is_copy { repl.insert(dst, src); }
+    }
+    if repl.is_empty() { return; }
+
+    for insn in &mut module.instructions {
+        rename_regs(insn, &mut |r, role| if role == Role::Use { find(r, &repl) } else { r });
+    }
+}
+
+/// `Concat` samych stałych → jeden `LoadStr` ze sklejonym stringiem
+fn pass_concat_folding(module: &mut HlModule) {
+    let cfg = Cfg::build(module);
+    let ssa = Ssa::build(module, &cfg);
+
+    for i in 0..module.instructions.len() {
+        let Instruction::Concat { dst, parts } = &module.instructions[i] else { continue };
+        let dst = *dst;
+        let mut joined = String::new();
+        let all_const = parts.iter().all(|&p| {
+            match ssa.value_at(p, i, &cfg).map(|d| &module.instructions[d]) {
+                Some(Instruction::LoadStr { idx, .. }) => {
+                    joined.push_str(&module.consts.strings[*idx as usize]);
+                    true
                 }
+                _ => false,
+            }
+        });
+        if !all_const { continue; }
+        let idx = module.consts.add_str(joined);
+        module.instructions[i] = Instruction::LoadStr { dst, idx };
+    }
+}
+
+/// DCE: czysta instrukcja, której wynik nigdy nie jest czytany → Nop.
+/// Usunięcie zwalnia jej operandy, więc iterujemy do punktu stałego.
+fn pass_dead_code_elimination(module: &mut HlModule) {
+    let mut use_count: HashMap<Reg, u32> = HashMap::new();
+    for insn in &module.instructions {
+        visit_regs(insn, &mut |r, role| if role == Role::Use { *use_count.entry(r).or_default() += 1; });
+    }
+
+    let mut changed = true;
+    while changed {
+        changed = false;
+        for insn in module.instructions.iter_mut() {
+            if !is_pure(insn) { continue; }
+            let mut dead = true;
+            visit_regs(insn, &mut |r, role| {
+                if role == Role::Def && use_count.get(&r).copied().unwrap_or(0) > 0 { dead = false; }
+            });
+            if !dead { continue; }
+            visit_regs(insn, &mut |r, role| {
+                if role == Role::Use { if let Some(c) = use_count.get_mut(&r) { *c -= 1; } }
+            });
+            *insn = Instruction::Nop;
+            changed = true;
+        }
+    }
+}
+
+/// Co instrukcja może zapisać w zmiennych (dla LICM)
+enum VarWrite {
+    None,
+    Name(ConstIdx),
+    Any,
+}
+
+fn var_write(insn: &Instruction, le_idx: Option<ConstIdx>) -> VarWrite {
+    use Instruction as I;
+    let le = || le_idx.map_or(VarWrite::None, VarWrite::Name);
+    match insn {
+        I::SetVar { name, .. } | I::SetEnv { name, .. } => VarWrite::Name(*name),
+        // ExecCmd / for-in po komendzie ustawiają _last_exit_code
+        I::ExecCmd { .. } | I::ExecTpl { .. } | I::ForInCmd { .. } | I::ForInTpl { .. }
+        | I::ForInNext { .. } => le(),
+        // Funkcje i quick-funkcje (::set) mogą pisać dowolne zmienne
+        I::CallFunc { .. } | I::ArenaCall { .. } | I::CallQuick { .. }
+        | I::GoSpawn { .. } | I::GoWait { .. } => VarWrite::Any,
+        _ => VarWrite::None,
+    }
+}
+
+/// LICM dla pętli for-in i zakresów: `LoadStr` i `GetVar` zmiennej, której ciało nie
+/// zapisuje, przenosimy przed nagłówek `ForInNext`/`ForRangeNext` — wykonują się raz zamiast
+/// w każdej iteracji. Zagnieżdżone pętle: kolejne rundy wynoszą dalej.
+fn pass_licm(module: &mut HlModule) {
+    for _ in 0..8 {
+        if !licm_round(module) { break; }
+    }
+}
+
+fn licm_round(module: &mut HlModule) -> bool {
+    let cfg = Cfg::build(module);
+    let ssa = Ssa::build(module, &cfg);
+    let code = &module.instructions;
+    let n = code.len();
+    let le_idx = module.consts.strings.iter().position(|s| s == "_last_exit_code").map(|i| i as ConstIdx);
+
+    // Źródła skoków do każdej instrukcji
+    let mut jumps_to: HashMap<usize, Vec<usize>> = HashMap::new();
+    for (i, insn) in code.iter().enumerate() {
+        if let Some(t) = jump_targets(insn) { jumps_to.entry(t as usize).or_default().push(i); }
+    }
+
+    let mut moves: Vec<(usize, usize)> = Vec::new();
+    for h in 0..n {
+        let end_off = match code[h] {
+            Instruction::ForInNext { end_off, .. } | Instruction::ForRangeNext { end_off, .. } => end_off,
+            _ => continue,
+        };
+        let e = end_off as usize;
+        if e < h + 2 || e > n || h == 0 { continue; }
+        if !matches!(code[e - 1], Instruction::Jump { offset } if offset as usize == h) { continue; }
+        // Do nagłówka wchodzi się tylko z góry i krawędzią powrotną,
+        // do ciała — tylko z wnętrza pętli
+        if jumps_to.get(&h).map_or(false, |v| v.iter().any(|&s| s != e - 1)) { continue; }
+        if !falls_through(&code[h - 1]) || cfg.region[h - 1] != cfg.region[h] { continue; }
+        let escapes = (h + 1..e).any(|t| {
+            jumps_to.get(&t).map_or(false, |v| v.iter().any(|&s| s < h || s >= e))
+        });
+        if escapes { continue; }
+
+        let mut any_write = false;
+        let mut written: Vec<ConstIdx> = Vec::new();
+        for insn in &code[h..e] {
+            match var_write(insn, le_idx) {
+                VarWrite::None    => {}
+                VarWrite::Name(c) => written.push(c),
+                VarWrite::Any     => any_write = true,
             }
-            // Peephole: ToString(LoadStr src) → LoadStr src (już jest stringiem)
-            Instruction::ToString { dst, src } => {
-                // Jeśli src jest znanym num-rejestrem, zamień na formatowanie
-                // (nie robimy tutaj — to wymagałoby bardziej skomplikowanej analizy)
-                let _ = (dst, src);
+        }
+
+        for i in h + 1..e - 1 {
+            if cfg.region[i] != cfg.region[h] { continue; }
+            let dst = match code[i] {
+                Instruction::LoadStr { dst, .. } => dst,
+                Instruction::GetVar { dst, name } if !any_write && !written.contains(&name) => dst,
+                _ => continue,
+            };
+            if ssa.is_ssa(dst) && !moves.iter().any(|&(m, _)| m == i) {
+                moves.push((i, h));
+            }
+        }
+    }
+    if moves.is_empty() { return false; }
+    // Zagnieżdżone pętle: instrukcję zgłasza też pętla zewnętrzna — zostawiamy
+    // najbliższy nagłówek (największe `h`), kolejna runda wyniesie ją wyżej
+    moves.sort_by_key(|&(i, h)| (i, std::cmp::Reverse(h)));
+    moves.dedup_by_key(|m| m.0);
+    relayout(module, &moves);
+    true
+}
+
+/// Przenieś instrukcje `(from, before)` bezpośrednio przed `before` i popraw
+/// skoki oraz tablicę funkcji. Skok do `before` trafia za przeniesiony kod.
+fn relayout(module: &mut HlModule, moves: &[(usize, usize)]) {
+    let n = module.instructions.len();
+    let mut moved = vec![false; n];
+    let mut inserts: HashMap<usize, Vec<usize>> = HashMap::new();
+    for &(from, before) in moves {
+        moved[from] = true;
+        inserts.entry(before).or_default().push(from);
+    }
+
+    let old = std::mem::take(&mut module.instructions);
+    let mut new_pos = vec![0u32; n + 1];
+    let mut out: Vec<Instruction> = Vec::with_capacity(n);
+    let mut slots: Vec<Option<Instruction>> = old.into_iter().map(Some).collect();
+    for i in 0..n {
+        if let Some(list) = inserts.get(&i) {
+            for &m in list { out.push(slots[m].take().unwrap()); }
+        }
+        if !moved[i] {
+            new_pos[i] = out.len() as u32;
+            out.push(slots[i].take().unwrap());
+        }
+    }
+    new_pos[n] = out.len() as u32;
+    // Przeniesiona instrukcja jako cel skoku → następna, która została na miejscu
+    for i in (0..n).rev() {
+        if moved[i] { new_pos[i] = new_pos[i + 1]; }
+    }
+    module.instructions = out;
+    remap_targets(module, &new_pos, n);
+}
+
+fn remap_targets(module: &mut HlModule, offset_map: &[u32], old_len: usize) {
+    for insn in &mut module.instructions {
+        match insn {
+            Instruction::JumpIfFalse { offset, .. }
+            | Instruction::JumpIfTrue { offset, .. }
+            | Instruction::Jump { offset } => {
+                *offset = offset_map[(*offset as usize).min(old_len)];
+            }
+            Instruction::ForInNext { end_off, .. } | Instruction::ForRangeNext { end_off, .. } => {
+                *end_off = offset_map[(*end_off as usize).min(old_len)];
             }
             _ => {}
         }
     }
+    for entry in &mut module.funcs.entries {
+        let start = (entry.start_insn as usize).min(old_len);
+        let end   = (start + entry.insn_count as usize).min(old_len);
+        entry.start_insn = offset_map[start];
+        entry.insn_count = offset_map[end] - offset_map[start];
+    }
+    if !module.lines.is_empty() {
+        for (off, _) in &mut module.lines {
+            *off = offset_map[(*off as usize).min(old_len)];
+        }
+        // LICM przenosi instrukcje — przywróć porządek, z kilku znaczników
+        // pod jednym offsetem zostaje ostatni (linia, która tam się zaczyna)
+        module.lines.sort_by_key(|&(off, _)| off);
+        module.lines.dedup_by(|next, prev| {
+            let same = next.0 == prev.0;
+            if same { prev.1 = next.1; }
+            same
+        });
+    }
 }
 
 /// Usuń Nop — przepisz instrukcje pomijając Nopy i popraw offsety skoków
@@ -89,55 +716,172 @@ fn pass_nop_elimination(module: &mut HlModule) {
     let mut offset_map = vec![0u32; old_len + 1];
     let mut new_instructions = Vec::with_capacity(old_len);
 
-    for (old_off, insn) in module.instructions.iter().enumerate() {
+    for (old_off, insn) in std::mem::take(&mut module.instructions).into_iter().enumerate() {
         offset_map[old_off] = new_instructions.len() as u32;
         if !matches!(insn, Instruction::Nop) {
-            new_instructions.push(insn.clone());
+            new_instructions.push(insn);
         }
     }
     offset_map[old_len] = new_instructions.len() as u32;
 
-    // Przepisz offsety w instrukcjach skoku
-    for insn in &mut new_instructions {
-        match insn {
-            Instruction::JumpIfFalse { offset, .. } => {
-                *offset = offset_map[(*offset as usize).min(old_len)];
-            }
-            Instruction::JumpIfTrue { offset, .. } => {
-                *offset = offset_map[(*offset as usize).min(old_len)];
+    module.instructions = new_instructions;
+    // Przepisz offsety skoków i zakresy funkcji
+    remap_targets(module, &offset_map, old_len);
+}
+
+/// Znaczniki SourceLine → tablica `module.lines`. Znacznik staje się Nopem;
+/// jego offset przesuwają razem ze skokami `remap_targets`, więc po usunięciu
+/// Nopów wskazuje pierwszą instrukcję swojej linii
+fn pass_line_table(module: &mut HlModule) {
+    for (off, insn) in module.instructions.iter_mut().enumerate() {
+        if let Instruction::SourceLine { line } = *insn {
+            module.lines.push((off as InsnOff, line));
+            *insn = Instruction::Nop;
+        }
+    }
+    // Nopy usuwa pass_nop_elimination na końcu potoku
+}
+
+/// Łączenie rejestrów (linear scan). Każdy region (główny kod, ciało funkcji)
+/// dostaje własny bank numerów — rejestry wywołującego żyją w czasie
+/// `CallFunc`, więc ciało funkcji nie może ich nadpisać. W regionie rejestry
+/// o rozłącznych przedziałach życia dzielą jeden numer.
+fn pass_register_coalescing(module: &mut HlModule) {
+    let n = module.instructions.len();
+    if n == 0 { return; }
+    let cfg = Cfg::build(module);
+    let nregions = module.funcs.entries.len() + 1;
+
+    // Rejestr używany w kilku regionach (lowering tak nie robi) — nie ruszamy nic
+    let mut reg_region: HashMap<Reg, u32> = HashMap::new();
+    let mut shared = false;
+    for (i, insn) in module.instructions.iter().enumerate() {
+        visit_regs(insn, &mut |r, _| {
+            if *reg_region.entry(r).or_insert(cfg.region[i]) != cfg.region[i] { shared = true; }
+        });
+    }
+    if shared {
+        tracing::debug!("optimize: rejestr współdzielony między regionami — bez łączenia");
+        return;
+    }
+
+    // Liveness na blokach: gen/kill per blok, iteracja wstecz do punktu stałego.
+    // Rejestry lokalne (jeden blok, definicja przed pierwszym użyciem) nie
+    // potrzebują przepływu — tylko globalne dostają indeks w bitsecie.
+    let nb = cfg.blocks.len();
+    let mut first_block: HashMap<Reg, usize> = HashMap::new();
+    let mut global: HashMap<Reg, usize> = HashMap::new();
+    let mut def_seen: HashMap<Reg, ()> = HashMap::new();
+    for (i, insn) in module.instructions.iter().enumerate() {
+        let b = cfg.block_of[i];
+        visit_regs(insn, &mut |r, role| {
+            let fb = *first_block.entry(r).or_insert(b);
+            let upward = role == Role::Use && !def_seen.contains_key(&r);
+            if fb != b || upward {
+                let k = global.len();
+                global.entry(r).or_insert(k);
             }
-            Instruction::Jump { offset } => {
-                *offset = offset_map[(*offset as usize).min(old_len)];
+            if role == Role::Def { def_seen.insert(r, ()); }
+        });
+    }
+    let ng = global.len();
+    let words = ng.div_ceil(64).max(1);
+    let mut gen_  = vec![vec![0u64; words]; nb];
+    let mut kill  = vec![vec![0u64; words]; nb];
+    for (b, &(s, e)) in cfg.blocks.iter().enumerate() {
+        for insn in &module.instructions[s..e] {
+            visit_regs(insn, &mut |r, role| {
+                let Some(&g) = global.get(&r) else { return };
+                let (w, bit) = (g / 64, 1u64 << (g % 64));
+                match role {
+                    Role::Use => if kill[b][w] & bit == 0 { gen_[b][w] |= bit; },
+                    Role::Def => kill[b][w] |= bit,
+                }
+            });
+        }
+    }
+    let mut live_in  = vec![vec![0u64; words]; nb];
+    let mut live_out = vec![vec![0u64; words]; nb];
+    let mut changed = true;
+    while changed {
+        changed = false;
+        for b in (0..nb).rev() {
+            let mut out = vec![0u64; words];
+            for &s in &cfg.succs[b] {
+                for w in 0..words { out[w] |= live_in[s][w]; }
             }
-            Instruction::ForInNext { end_off, .. } => {
-                *end_off = offset_map[(*end_off as usize).min(old_len)];
+            let mut inn = vec![0u64; words];
+            for w in 0..words { inn[w] = gen_[b][w] | (out[w] & !kill[b][w]); }
+            if inn != live_in[b] || out != live_out[b] {
+                live_in[b] = inn;
+                live_out[b] = out;
+                changed = true;
             }
-            _ => {}
         }
     }
 
-    // Zaktualizuj wpisy funkcji
-    for entry in &mut module.funcs.entries {
-        entry.start_insn = offset_map[(entry.start_insn as usize).min(old_len)];
+    // Przedziały [start, end] w kolejności instrukcji
+    let mut interval: HashMap<Reg, (usize, usize)> = HashMap::new();
+    let extend = |r: Reg, p: usize, iv: &mut HashMap<Reg, (usize, usize)>| {
+        let e = iv.entry(r).or_insert((p, p));
+        e.0 = e.0.min(p);
+        e.1 = e.1.max(p);
+    };
+    for (i, insn) in module.instructions.iter().enumerate() {
+        visit_regs(insn, &mut |r, _| extend(r, i, &mut interval));
+    }
+    let mut region_span = vec![(usize::MAX, 0usize); nregions];
+    for i in 0..n {
+        let s = &mut region_span[cfg.region[i] as usize];
+        s.0 = s.0.min(i);
+        s.1 = s.1.max(i);
+    }
+    for (&r, &g) in &global {
+        let (w, bit) = (g / 64, 1u64 << (g % 64));
+        for (b, &(s, e)) in cfg.blocks.iter().enumerate() {
+            if live_in[b][w] & bit != 0 {
+                extend(r, s, &mut interval);
+                // Żywy na wejściu regionu = czytany przed zapisem; oczekuje nil,
+                // więc nikt inny w regionie nie może dostać jego numeru
+                if cfg.entries.contains(&b) {
+                    let span = region_span[cfg.region[s] as usize];
+                    extend(r, span.0, &mut interval);
+                    extend(r, span.1, &mut interval);
+                }
+            }
+            if live_out[b][w] & bit != 0 { extend(r, e - 1, &mut interval); }
+        }
     }
 
-    module.instructions = new_instructions;
-}
-
-/// Usuń SourceLine markers — nie potrzebne w release
-fn pass_source_line_strip(module: &mut HlModule) {
-    for insn in &mut module.instructions {
-        if matches!(insn, Instruction::SourceLine { .. }) {
-            *insn = Instruction::Nop;
+    // Linear scan per region
+    let mut by_region: Vec<Vec<(usize, usize, Reg)>> = vec![Vec::new(); nregions];
+    for (&r, &(s, e)) in &interval {
+        by_region[reg_region[&r] as usize].push((s, e, r));
+    }
+    let mut map: HashMap<Reg, Reg> = HashMap::new();
+    let mut base: Reg = 0;
+    for ivs in &mut by_region {
+        ivs.sort_unstable();
+        let mut active: Vec<(usize, Reg)> = Vec::new();
+        let mut free: std::collections::BinaryHeap<std::cmp::Reverse<Reg>> = Default::default();
+        let mut next: Reg = 0;
+        for &(s, e, r) in ivs.iter() {
+            active.retain(|&(end, phys)| {
+                if end < s { free.push(std::cmp::Reverse(phys)); false } else { true }
+            });
+            let phys = free.pop().map(|std::cmp::Reverse(p)| p).unwrap_or_else(|| { next += 1; next - 1 });
+            active.push((e, phys));
+            map.insert(r, base + phys);
         }
+        base += next;
     }
-    // Drugi pass: usuń właśnie wstawione Nopy (Nop elimination już to ogarnie
-    // ale wywołamy go ponownie jeśli cokolwiek zmieniliśmy)
-    let had_source_lines = module.instructions.iter()
-    .any(|i| matches!(i, Instruction::Nop));
-    if had_source_lines {
-        pass_nop_elimination(module);
+
+    let before = module.main_regs;
+    for insn in &mut module.instructions {
+        rename_regs(insn, &mut |r, _| map[&r]);
     }
+    module.main_regs = base;
+    tracing::debug!("optimize: rejestry {} → {}", before, base);
 }
 
 #[cfg(test)]
@@ -146,7 +890,6 @@ mod tests {
     use crate::bytecode::HlModule;
 
     fn make_module_with(insns: Vec<Instruction>, nums: Vec<f64>) -> HlModule {
-        use std::path::Path;
         let mut m = HlModule::new("test.hl", 2);
         for n in nums { m.consts.add_num(n); }
         m.instructions = insns;
@@ -189,4 +932,218 @@ mod tests {
             panic!("Oczekiwano JumpIfFalse");
         }
     }
+
+    #[test]
+    fn test_loop_counter_is_not_folded() {
+        // Kształt RepeatN: licznik ma dwie definicje, więc Add zostaje
+        let mut m = make_module_with(vec![
+            Instruction::LoadNum { dst: 0, idx: 0 },          // 0: licznik = 0
+            Instruction::LoadNum { dst: 1, idx: 2 },          // 1: limit = 10
+            Instruction::CmpLt { dst: 2, a: 0, b: 1 },        // 2
+            Instruction::JumpIfFalse { cond: 2, offset: 7 },  // 3
+            Instruction::LoadNum { dst: 3, idx: 1 },          // 4: 1
+            Instruction::Add { dst: 0, a: 0, b: 3 },          // 5
+            Instruction::Jump { offset: 2 },                  // 6
+            Instruction::Return { src: None },                // 7
+        ], vec![0.0, 1.0, 10.0]);
+
+        optimize_module(&mut m);
+        assert!(m.instructions.iter().any(|i| matches!(i, Instruction::Add { .. })));
+    }
+
+    #[test]
+    fn test_concat_of_constants_becomes_load_str() {
+        let mut m = HlModule::new("test.hl", 2);
+        let (a, b) = (m.consts.add_str("ab"), m.consts.add_str("cd"));
+        m.instructions = vec![
+            Instruction::LoadStr { dst: 0, idx: a },
+            Instruction::LoadStr { dst: 1, idx: b },
+            Instruction::ToString { dst: 2, src: 1 },
+            Instruction::Concat { dst: 3, parts: vec![0, 2] },
+            Instruction::Print { src: 3 },
+            Instruction::Return { src: None },
+        ];
+        optimize_module_at(&mut m, OptLevel::O1);
+        assert_eq!(m.instructions.len(), 3);
+        let Instruction::LoadStr { dst, idx } = m.instructions[0] else { panic!("{:?}", m.instructions) };
+        assert_eq!(m.consts.strings[idx as usize], "abcd");
+        assert!(matches!(m.instructions[1], Instruction::Print { src } if src == dst));
+    }
+
+    #[test]
+    fn test_copy_propagation_keeps_non_string_conversion() {
+        let mut m = HlModule::new("test.hl", 2);
+        let name = m.consts.add_str("x");
+        m.instructions = vec![
+            Instruction::GetVar { dst: 0, name },
+            Instruction::ToString { dst: 1, src: 0 },   // zmienna może być liczbą
+            Instruction::Print { src: 1 },
+            Instruction::Return { src: None },
+        ];
+        optimize_module_at(&mut m, OptLevel::O1);
+        assert!(m.instructions.iter().any(|i| matches!(i, Instruction::ToString { .. })));
+    }
+
+    /// for x in @list { print "@x-@sep" } — @sep i "-" są niezmiennikami
+    fn for_in_module() -> HlModule {
+        let mut m = HlModule::new("test.hl", 2);
+        let list = m.consts.add_str("list");
+        let x    = m.consts.add_str("x");
+        let sep  = m.consts.add_str("sep");
+        let dash = m.consts.add_str("-");
+        m.instructions = vec![
+            Instruction::GetVar { dst: 0, name: list },                    // 0
+            Instruction::ForInStart { iter_reg: 1, src: 0, lines: false }, // 1
+            Instruction::ForInNext { iter_reg: 1, dst: 2, end_off: 10 },   // 2
+            Instruction::SetVar { name: x, src: 2 },                       // 3
+            Instruction::GetVar { dst: 3, name: x },                       // 4
+            Instruction::LoadStr { dst: 4, idx: dash },                    // 5
+            Instruction::GetVar { dst: 5, name: sep },                     // 6
+            Instruction::Concat { dst: 6, parts: vec![3, 4, 5] },          // 7
+            Instruction::Print { src: 6 },                                 // 8
+            Instruction::Jump { offset: 2 },                               // 9
+            Instruction::Return { src: None },                             // 10
+        ];
+        m
+    }
+
+    #[test]
+    fn test_licm_hoists_invariants_out_of_for_in() {
+        let mut m = for_in_module();
+        pass_licm(&mut m);
+        let head = m.instructions.iter().position(|i| matches!(i, Instruction::ForInNext { .. })).unwrap();
+        let before: Vec<_> = m.instructions[..head].iter().collect();
+        assert!(before.iter().any(|i| matches!(i, Instruction::LoadStr { dst: 4, .. })));
+        assert!(before.iter().any(|i| matches!(i, Instruction::GetVar { dst: 5, .. })));
+        // @x zapisuje ciało pętli — zostaje w środku
+        assert!(m.instructions[head..].iter().any(|i| matches!(i, Instruction::GetVar { dst: 3, .. })));
+        // Krawędź powrotna wraca na nagłówek, wyjście trafia na Return
+        let Instruction::ForInNext { end_off, .. } = m.instructions[head] else { unreachable!() };
+        assert!(matches!(m.instructions[end_off as usize], Instruction::Return { .. }));
+        assert!(matches!(m.instructions[end_off as usize - 1], Instruction::Jump { offset } if offset as usize == head));
+    }
+
+    #[test]
+    fn test_licm_skips_loops_with_calls() {
+        let mut m = for_in_module();
+        let f = m.consts.add_str("f");
+        m.instructions[8] = Instruction::CallFunc { name: f };
+        pass_licm(&mut m);
+        let head = m.instructions.iter().position(|i| matches!(i, Instruction::ForInNext { .. })).unwrap();
+        // LoadStr nadal wychodzi, GetVar @sep już nie (funkcja może ją zmienić)
+        assert!(m.instructions[..head].iter().any(|i| matches!(i, Instruction::LoadStr { .. })));
+        assert!(m.instructions[head..].iter().any(|i| matches!(i, Instruction::GetVar { dst: 5, .. })));
+    }
+
+    #[test]
+    fn test_register_coalescing_shrinks_main_regs() {
+        let mut m = HlModule::new("test.hl", 2);
+        let mut insns = Vec::new();
+        for k in 0..10u32 {
+            let idx = m.consts.add_str(format!("linia {}", k));
+            insns.push(Instruction::LoadStr { dst: k, idx });
+            insns.push(Instruction::Print { src: k });
+        }
+        insns.push(Instruction::Return { src: None });
+        m.instructions = insns;
+        m.main_regs = 10;
+        pass_register_coalescing(&mut m);
+        assert_eq!(m.main_regs, 1);
+        assert!(m.instructions.iter().all(|i| !matches!(i, Instruction::LoadStr { dst, .. } if *dst != 0)));
+    }
+
+    #[test]
+    fn test_range_loop_licm_and_live_counter() {
+        // @i in 1..@n { print "@i-@sep" }
+        let mut m = HlModule::new("test.hl", 2);
+        let (n, i, sep, dash) = (m.consts.add_str("n"), m.consts.add_str("i"),
+                                 m.consts.add_str("sep"), m.consts.add_str("-"));
+        let one = m.consts.add_num(1.0);
+        m.instructions = vec![
+            Instruction::LoadNum { dst: 0, idx: one },                      // 0
+            Instruction::ToInt { dst: 1, src: 0 },                          // 1
+            Instruction::GetVar { dst: 2, name: n },                        // 2
+            Instruction::ToInt { dst: 3, src: 2 },                          // 3
+            Instruction::ForRangeNext { ctr: 1, end: 3, end_off: 13 },      // 4
+            Instruction::SetVar { name: i, src: 1 },                        // 5
+            Instruction::GetVar { dst: 4, name: i },                        // 6
+            Instruction::LoadStr { dst: 5, idx: dash },                     // 7
+            Instruction::GetVar { dst: 6, name: sep },                      // 8
+            Instruction::Concat { dst: 7, parts: vec![4, 5, 6] },           // 9
+            Instruction::Print { src: 7 },                                  // 10
+            Instruction::ForRangeStep { dst: 1, src: 1 },                   // 11
+            Instruction::Jump { offset: 4 },                                // 12
+            Instruction::Return { src: None },                              // 13
+        ];
+        m.main_regs = 8;
+        optimize_module_at(&mut m, OptLevel::O2);
+        let head = m.instructions.iter().position(|i| matches!(i, Instruction::ForRangeNext { .. })).unwrap();
+        assert!(m.instructions[..head].iter().any(|i| matches!(i, Instruction::LoadStr { .. })));
+        let Instruction::ForRangeNext { ctr, end, end_off } = m.instructions[head] else { unreachable!() };
+        assert!(matches!(m.instructions[end_off as usize - 1], Instruction::Jump { offset } if offset as usize == head));
+        assert!(matches!(m.instructions[end_off as usize - 2], Instruction::ForRangeStep { dst, src } if dst == ctr && src == ctr));
+        // Licznik i granica żyją przez całą pętlę — ciało ich nie nadpisuje
+        for insn in &m.instructions[head + 1..end_off as usize - 2] {
+            visit_regs(insn, &mut |r, role| assert!(!(role == Role::Def && (r == ctr || r == end)), "{:?}", insn));
+        }
+    }
+
+    #[test]
+    fn test_register_coalescing_keeps_live_ranges_apart() {
+        let mut m = for_in_module();
+        m.main_regs = 7;
+        optimize_module_at(&mut m, OptLevel::O2);
+        // Iterator żyje przez całą pętlę — nikt nie może dzielić z nim numeru
+        let iter = m.instructions.iter().find_map(|i| match i {
+            Instruction::ForInStart { iter_reg, .. } => Some(*iter_reg),
+            _ => None,
+        }).unwrap();
+        let head = m.instructions.iter().position(|i| matches!(i, Instruction::ForInNext { .. })).unwrap();
+        for insn in &m.instructions[head + 1..] {
+            visit_regs(insn, &mut |r, role| assert!(!(role == Role::Def && r == iter), "{:?}", insn));
+        }
+        assert!(m.main_regs < 7);
+    }
+
+    #[test]
+    fn test_function_body_gets_own_register_bank() {
+        let mut m = HlModule::new("test.hl", 2);
+        let (s, f) = (m.consts.add_str("a"), m.consts.add_str("f"));
+        m.instructions = vec![
+            Instruction::Jump { offset: 4 },              // 0: przeskocz ciało
+            Instruction::LoadStr { dst: 5, idx: s },      // 1: ciało f
+            Instruction::Print { src: 5 },                // 2
+            Instruction::Return { src: None },            // 3
+            Instruction::LoadStr { dst: 7, idx: s },      // 4: główny kod
+            Instruction::CallFunc { name: f },            // 5
+            Instruction::Print { src: 7 },                // 6
+            Instruction::Return { src: None },            // 7
+        ];
+        m.funcs.entries.push(FuncEntry { name: "f".into(), start_insn: 1, insn_count: 3 });
+        m.main_regs = 8;
+        pass_register_coalescing(&mut m);
+        let body = match m.instructions[1] { Instruction::LoadStr { dst, .. } => dst, _ => unreachable!() };
+        let main = match m.instructions[4] { Instruction::LoadStr { dst, .. } => dst, _ => unreachable!() };
+        assert_ne!(body, main, "ciało funkcji nadpisałoby rejestr żywy w czasie CallFunc");
+        assert_eq!(m.main_regs, 2);
+    }
+
+    #[test]
+    fn test_source_lines_move_to_line_table() {
+        let mut m = HlModule::new("test.hl", 2);
+        let s = m.consts.add_str("a");
+        m.instructions = vec![
+            Instruction::SourceLine { line: 1 },          // 0
+            Instruction::LoadStr { dst: 0, idx: s },      // 1
+            Instruction::Print { src: 0 },                // 2
+            Instruction::SourceLine { line: 2 },          // 3: pusta linia (bez kodu)
+            Instruction::SourceLine { line: 3 },          // 4
+            Instruction::Jump { offset: 4 },              // 5
+        ];
+        m.main_regs = 1;
+        optimize_module_at(&mut m, OptLevel::O1);
+        assert!(!m.instructions.iter().any(|i| matches!(i, Instruction::SourceLine { .. } | Instruction::Nop)));
+        assert_eq!(m.lines, vec![(0, 1), (2, 3)]);
+        assert!(matches!(m.instructions[2], Instruction::Jump { offset: 2 }));
+    }
 }
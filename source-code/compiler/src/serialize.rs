@@ -1,15 +1,72 @@
 use anyhow::{bail, Context, Result};
 use crate::bytecode::{HlBcHeader, HlModule};
+use crate::flat::{FlatBc, BC_FLAT_VERSION, write_flat_bytes};
 use std::path::Path;
 
 pub const BC_MAGIC: &[u8; 4] = b"HLBC";
-pub const BC_VERSION: u32 = 3; // bump: fix @VAR interpolation in commands
+pub const BC_VERSION: u32 = 12; // bump: Truthy bez ewaluacji tekstu warunku
 
 /// Shebang dla pliku .bc — `hl run` uruchamia bytecode przez JIT
 const BC_SHEBANG: &str = "#!/usr/bin/env -S /usr/bin/hl run\n";
 
+/// Format zapisu pliku .bc
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub enum BcFormat {
+    /// JSON header + bincode `HlModule` (domyślny, kompatybilny wstecz)
+    #[default]
+    Bincode,
+    /// Płaski układ sekcji — mmap + odczyt w miejscu (patrz `flat.rs`)
+    Flat,
+}
+
+impl BcFormat {
+    pub fn from_str(s: &str) -> Option<Self> {
+        match s {
+            "bincode" | "default" => Some(Self::Bincode),
+            "flat"                => Some(Self::Flat),
+            _                     => None,
+        }
+    }
+}
+
 pub fn write_bc_file(module: &HlModule, path: &Path) -> Result<()> {
+    write_bc_file_as(module, path, BcFormat::Bincode)
+}
+
+pub fn write_bc_file_as(module: &HlModule, path: &Path, format: BcFormat) -> Result<()> {
+    let buf = match format {
+        BcFormat::Bincode => encode_bincode(module)?,
+        BcFormat::Flat    => write_flat_bytes(module, BC_SHEBANG.as_bytes()),
+    };
+
+    // Zapisz do pliku tymczasowego i podmień przez rename — proces, który właśnie
+    // mapuje stary .bc (MappedBc), nie zobaczy uciętego pliku (SIGBUS).
+    // Licznik w nazwie rozróżnia równoległe zapisy z wątków jednego procesu.
+    static TMP_SEQ: std::sync::atomic::AtomicU32 = std::sync::atomic::AtomicU32::new(0);
+    let tmp = path.with_file_name(format!(
+        ".{}.{}.{}.tmp",
+        path.file_name().and_then(|n| n.to_str()).unwrap_or("out.bc"),
+        std::process::id(),
+        TMP_SEQ.fetch_add(1, std::sync::atomic::Ordering::Relaxed),
+    ));
+    std::fs::write(&tmp, &buf).with_context(|| format!("Zapis .bc: {:?}", tmp))?;
+
+    // Ustaw bit wykonywalny
+    #[cfg(unix)]
+    {
+        use std::os::unix::fs::PermissionsExt;
+        let mut perms = std::fs::metadata(&tmp)?.permissions();
+        perms.set_mode(0o755);
+        std::fs::set_permissions(&tmp, perms)?;
+    }
 
+    std::fs::rename(&tmp, path).with_context(|| format!("Zapis .bc: {:?}", path))?;
+
+    tracing::debug!("Zapisano .bc ({:?}, {} bajtów): {:?}", format, buf.len(), path);
+    Ok(())
+}
+
+fn encode_bincode(module: &HlModule) -> Result<Vec<u8>> {
     let mut buf: Vec<u8> = Vec::with_capacity(4096);
 
     // Shebang (musi być pierwszy żeby plik był wykonywalny bezpośrednio)
@@ -32,39 +89,60 @@ pub fn write_bc_file(module: &HlModule, path: &Path) -> Result<()> {
     let module_bytes = bincode::serialize(module)
     .context("Serializacja modułu .bc")?;
     buf.extend_from_slice(&module_bytes);
+    Ok(buf)
+}
 
-    // Zapisz
-    std::fs::write(path, &buf).with_context(|| format!("Zapis .bc: {:?}", path))?;
+/// Zmapowany plik .bc — trzyma mmap przy życiu, daje widok `FlatBc` bez kopiowania
+pub struct MappedBc {
+    map:  memmap2::Mmap,
+    base: usize,
+}
 
-    // Ustaw bit wykonywalny
-    #[cfg(unix)]
-    {
-        use std::os::unix::fs::PermissionsExt;
-        let mut perms = std::fs::metadata(path)?.permissions();
-        perms.set_mode(0o755);
-        std::fs::set_permissions(path, perms)?;
+impl MappedBc {
+    pub fn open(path: &Path) -> Result<Self> {
+        let file = std::fs::File::open(path)
+        .with_context(|| format!("Odczyt .bc: {:?}", path))?;
+        // SAFETY: plik .bc jest tylko czytany; write_bc_file_as podmienia go przez
+        // rename (nowy inode), więc zmapowane strony się nie zmieniają.
+        let map = unsafe { memmap2::Mmap::map(&file) }
+        .with_context(|| format!("mmap .bc: {:?}", path))?;
+        let base = magic_offset(&map);
+        Ok(Self { map, base })
     }
 
-    tracing::debug!("Zapisano .bc ({} bajtów): {:?}", buf.len(), path);
-    Ok(())
+    pub fn bytes(&self) -> &[u8] { &self.map }
+
+    pub fn is_flat(&self) -> bool {
+        read_version(&self.map, self.base) == Some(BC_FLAT_VERSION)
+    }
+
+    /// Widok płaskiego formatu (błąd dla plików bincode)
+    pub fn flat(&self) -> Result<FlatBc<'_>> {
+        FlatBc::parse(&self.map, self.base)
+    }
 }
 
 pub fn read_bc_file(path: &Path) -> Result<HlModule> {
-    let raw = std::fs::read(path)
-    .with_context(|| format!("Odczyt .bc: {:?}", path))?;
+    // mmap zamiast fs::read — bez kopii całego pliku do sterty
+    let mapped = MappedBc::open(path)?;
+    parse_bc_bytes(mapped.bytes(), path)
+}
 
-    parse_bc_bytes(&raw, path)
+/// Offset magic po (opcjonalnym) shebangu
+fn magic_offset(raw: &[u8]) -> usize {
+    if raw.starts_with(b"#!") {
+        raw.iter().position(|&b| b == b'\n').map(|i| i + 1).unwrap_or(0)
+    } else { 0 }
 }
 
-pub fn parse_bc_bytes(raw: &[u8], path: &Path) -> Result<HlModule> {
-    let mut pos = 0usize;
+fn read_version(raw: &[u8], base: usize) -> Option<u32> {
+    if raw.get(base..base + 4)? != BC_MAGIC { return None; }
+    raw.get(base + 4..base + 8).map(|v| u32::from_le_bytes(v.try_into().unwrap()))
+}
 
+pub fn parse_bc_bytes(raw: &[u8], path: &Path) -> Result<HlModule> {
     // Pomiń shebang jeśli jest
-    if raw.starts_with(b"#!") {
-        if let Some(nl) = raw.iter().position(|&b| b == b'\n') {
-            pos = nl + 1;
-        }
-    }
+    let mut pos = magic_offset(raw);
 
     // Magic
     if raw.len() < pos + 4 {
@@ -80,6 +158,11 @@ pub fn parse_bc_bytes(raw: &[u8], path: &Path) -> Result<HlModule> {
         bail!("Urwany nagłówek .bc: {:?}", path);
     }
     let ver = u32::from_le_bytes(raw[pos..pos+4].try_into().unwrap());
+    if ver == BC_FLAT_VERSION {
+        return FlatBc::parse(raw, pos - 4)
+        .and_then(|fc| fc.to_module())
+        .with_context(|| format!("Odczyt płaskiego .bc: {:?}", path));
+    }
     if ver != BC_VERSION {
         bail!("Niezgodna wersja .bc: {} (oczekiwano {}): {:?}", ver, BC_VERSION, path);
     }
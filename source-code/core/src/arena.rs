@@ -1,5 +1,9 @@
 use std::alloc::{alloc, dealloc, Layout};
-use std::cell::Cell;
+use std::cell::{Cell, RefCell};
+use std::sync::Mutex;
+use std::sync::atomic::{AtomicBool, Ordering};
+use rustc_hash::FxHashMap;
+use crate::metrics::{self, Counter, Hist};
 
 /// Bump-pointer arena
 pub struct Arena {
@@ -28,6 +32,16 @@ impl Arena {
         Self { ptr, capacity: size, used: Cell::new(0), layout }
     }
 
+    /// Pusta arena bez bloku — zaślepka po oddaniu bloku do puli
+    fn empty() -> Self {
+        Self {
+            ptr:      std::ptr::NonNull::dangling().as_ptr(),
+            capacity: 0,
+            used:     Cell::new(0),
+            layout:   Layout::from_size_align(0, 8).expect("layout pustej areny"),
+        }
+    }
+
     /// Zaalokuj `size` bajtów wyrównanych do `align`
     /// Zwraca None jeśli brak miejsca (executor powinien fallback do heap)
     #[inline]
@@ -73,6 +87,7 @@ impl Arena {
 
 impl Drop for Arena {
     fn drop(&mut self) {
+        if self.capacity == 0 { return; }
         unsafe { dealloc(self.ptr, self.layout); }
     }
 }
@@ -81,34 +96,96 @@ impl Drop for Arena {
 // (arena function nie jest async/multi-threaded)
 unsafe impl Send for Arena {}
 
-/// Kontekst wykonania arena function
-/// Przechowuje arenę + zmienne lokalne (slice do areny)
+// ── Widok na string w arenie ─────────────────────────────────────────────────
+
+/// String zapisany w arenie — wskaźnik + długość, bez własności
+///
+/// Ważny tylko do `reset()` areny, z której pochodzi. Executor pilnuje tego,
+/// odpinając (`Value::detach`) wszystko co wychodzi poza wywołanie areny
+#[derive(Clone, Copy)]
+pub struct ArenaStr {
+    ptr: *const u8,
+    len: usize,
+}
+
+// Arena function wykonuje się w jednym wątku; wartości z areny nie trafiają
+// do goroutines (Env::new_with_parent odpina je przed przekazaniem)
+unsafe impl Send for ArenaStr {}
+unsafe impl Sync for ArenaStr {}
+
+impl ArenaStr {
+    #[inline]
+    pub fn as_str(&self) -> &str {
+        // SAFETY: bajty skopiowane z &str w `alloc_string`, arena żyje do resetu
+        unsafe { std::str::from_utf8_unchecked(std::slice::from_raw_parts(self.ptr, self.len)) }
+    }
+}
+
+impl std::fmt::Debug for ArenaStr {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        std::fmt::Debug::fmt(self.as_str(), f)
+    }
+}
+
+// ── Pula bloków ───────────────────────────────────────────────────────────────
+
+/// Ile zwolnionych bloków trzymamy na wątek
+const POOL_MAX: usize = 4;
+
+thread_local! {
+    /// Bloki po zakończonych wywołaniach — arena function w pętli dostaje
+    /// ten sam blok po `reset()`, bez ponownego alloc/dealloc
+    static POOL: RefCell<Vec<Arena>> = const { RefCell::new(Vec::new()) };
+}
+
+fn take_arena(size: usize) -> Arena {
+    let size = size.max(64);
+    POOL.with(|p| {
+        let mut p = p.borrow_mut();
+        match p.iter().position(|a| a.capacity() >= size && a.capacity() <= size * 4) {
+            Some(i) => p.swap_remove(i),
+            None    => Arena::new(size),
+        }
+    })
+}
+
+fn give_back(arena: Arena) {
+    if arena.capacity() == 0 { return; }
+    arena.reset();
+    POOL.with(|p| {
+        let mut p = p.borrow_mut();
+        if p.len() < POOL_MAX { p.push(arena); }
+    });
+}
+
+/// Kontekst wykonania arena function — region jednego wywołania
+///
+/// Blok pochodzi z puli wątku; drop robi jeden `reset()` i oddaje go do puli
 pub struct ArenaContext {
-    pub arena: Arena,
+    arena: Arena,
     /// Licznik alokacji (do debugowania)
     pub alloc_count: usize,
     /// Czy arena się przepełniła (fallback do heap był używany)
     pub overflowed: bool,
+    /// Bajty skopiowane na heap przy wyjściu (wartości uciekające z areny)
+    pub escaped: usize,
 }
 
 impl ArenaContext {
     pub fn new(size: usize) -> Self {
         Self {
-            arena:       Arena::new(size),
+            arena:       take_arena(size),
             alloc_count: 0,
             overflowed:  false,
+            escaped:     0,
         }
     }
 
-    /// Zaalokuj string w arenie lub heap jeśli arena pełna
-    pub fn alloc_string(&mut self, s: String) -> String {
+    /// Zaalokuj string w arenie; None gdy arena pełna (string zostaje na heap)
+    pub fn alloc_string(&mut self, s: &str) -> Option<ArenaStr> {
         self.alloc_count += 1;
-        // Próbuj zaalokować w arenie
-        if let Some(_ptr) = self.arena.alloc_str(&s) {
-            // Sukces — ale nadal zwracamy String (Rust ownership model)
-            // W praktyce kopia jest w arenie, ale Rust API wymaga String
-            // Dla naprawdę zero-copy potrzeba unsafe lifetimes
-            s
+        if let Some(ptr) = self.arena.alloc_str(s) {
+            Some(ArenaStr { ptr, len: s.len() })
         } else {
             // Arena pełna — fallback do heap
             if !self.overflowed {
@@ -118,10 +195,14 @@ impl ArenaContext {
                 );
                 self.overflowed = true;
             }
-            s // String zostaje na heap
+            None
         }
     }
 
+    /// Zapisz ile bajtów wyszło z areny na heap
+    #[inline]
+    pub fn note_escape(&mut self, bytes: usize) { self.escaped += bytes; }
+
     /// Statystyki areny (do debugowania / profilowania)
     pub fn stats(&self) -> ArenaStats {
         ArenaStats {
@@ -129,22 +210,107 @@ impl ArenaContext {
             used:        self.arena.used(),
             alloc_count: self.alloc_count,
             overflowed:  self.overflowed,
+            escaped:     self.escaped,
         }
     }
 }
 
+impl Drop for ArenaContext {
+    fn drop(&mut self) {
+        give_back(std::mem::replace(&mut self.arena, Arena::empty()));
+    }
+}
+
 #[derive(Debug, Clone)]
 pub struct ArenaStats {
     pub capacity:    usize,
     pub used:        usize,
     pub alloc_count: usize,
     pub overflowed:  bool,
+    pub escaped:     usize,
 }
 
 impl std::fmt::Display for ArenaStats {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
-        write!(f, "arena: {}/{} bajtów, {} alokacji{}",
-               self.used, self.capacity, self.alloc_count,
+        write!(f, "arena: {}/{} bajtów, {} alokacji, {} B na heap{}",
+               self.used, self.capacity, self.alloc_count, self.escaped,
                if self.overflowed { " [OVERFLOW→heap]" } else { "" })
     }
 }
+
+// ── Statystyki zbiorcze (hl run --arena-stats) ───────────────────────────────
+
+static STATS_ON: AtomicBool = AtomicBool::new(false);
+static TOTALS: Mutex<Option<FxHashMap<String, ArenaTotals>>> = Mutex::new(None);
+
+/// Suma wywołań jednej arena function
+#[derive(Debug, Clone, Default)]
+pub struct ArenaTotals {
+    pub calls:       u64,
+    pub capacity:    usize,
+    pub peak_used:   usize,
+    pub total_used:  u64,
+    pub alloc_count: u64,
+    pub escaped:     u64,
+    pub overflows:   u64,
+}
+
+/// Zbieraj statystyki każdego wywołania (wyłączone domyślnie)
+pub fn enable_stats() { STATS_ON.store(true, Ordering::Relaxed); }
+
+#[inline]
+pub fn stats_enabled() -> bool { STATS_ON.load(Ordering::Relaxed) }
+
+/// Dolicz jedno wywołanie — oba executory wołają to przy wyjściu z areny
+pub fn record(name: &str, stats: &ArenaStats) {
+    tracing::debug!("[arena] ::{}  {}", name, stats);
+    metrics::inc(Counter::ArenaCalls);
+    metrics::add(Counter::ArenaOverflows, stats.overflowed as u64);
+    metrics::add(Counter::ArenaEscaped, stats.escaped as u64);
+    metrics::observe(Hist::ArenaUsed, stats.used as u64);
+    if !stats_enabled() { return; }
+    let mut g = TOTALS.lock().unwrap_or_else(|e| e.into_inner());
+    let t = g.get_or_insert_with(FxHashMap::default).entry(name.to_string()).or_default();
+    t.calls       += 1;
+    t.capacity     = stats.capacity;
+    t.peak_used    = t.peak_used.max(stats.used);
+    t.total_used  += stats.used as u64;
+    t.alloc_count += stats.alloc_count as u64;
+    t.escaped     += stats.escaped as u64;
+    t.overflows   += stats.overflowed as u64;
+}
+
+/// Zebrane statystyki posortowane po nazwie (czyści licznik)
+pub fn take_report() -> Vec<(String, ArenaTotals)> {
+    let mut g = TOTALS.lock().unwrap_or_else(|e| e.into_inner());
+    let mut v: Vec<_> = g.take().unwrap_or_default().into_iter().collect();
+    v.sort_by(|a, b| a.0.cmp(&b.0));
+    v
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_strings_live_in_arena_and_block_is_reused() {
+        let base = {
+            let mut ctx = ArenaContext::new(1024);
+            let a = ctx.alloc_string("w arenie").unwrap();
+            assert_eq!(a.as_str(), "w arenie");
+            assert!(ctx.stats().used >= "w arenie".len());
+            ctx.arena.ptr as usize
+        };
+        // Drugie wywołanie dostaje ten sam, wyzerowany blok
+        let ctx = ArenaContext::new(1024);
+        assert_eq!(ctx.arena.ptr as usize, base);
+        assert_eq!(ctx.stats().used, 0);
+    }
+
+    #[test]
+    fn test_full_arena_falls_back() {
+        let mut ctx = ArenaContext::new(64);
+        assert!(ctx.alloc_string(&"x".repeat(100)).is_none());
+        assert!(ctx.overflowed);
+    }
+}
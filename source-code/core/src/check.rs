@@ -0,0 +1,374 @@
+//! `hl check` dla wielu plików: równolegle, z cache i trybem `--watch`
+//!
+//! Plik jest parsowany raz, a reguły lint (liniowe — nie potrzebują tokenów)
+//! idą jednym przejściem po tekście razem ze sprawdzeniem `using`
+//! (`lint_pass`); deklaracja gena jest odczytywana raz dla obu.
+//!
+//! Wynik zależy tylko od treści pliku, więc cache jest adresowany hashem
+//! treści: `check.json` w katalogu cache HL. Ten sam skrypt pod dwiema
+//! ścieżkami (albo przywrócony z gita) jest sprawdzany raz.
+
+use anyhow::{bail, Result};
+use hl_parser::gen::extract_gen;
+use hl_parser::parse_source_with_meta;
+use rustc_hash::FxHashMap;
+use serde::{Deserialize, Serialize};
+use std::ffi::{CString, OsStr};
+use std::hash::{Hash, Hasher};
+use std::os::unix::ffi::OsStrExt;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::time::Duration;
+
+use crate::diagnostics::{lint_pass, parse_error_to_diag, Diag, DiagLevel};
+
+pub const CHECK_CACHE_FILE: &str = "check.json";
+const CHECK_CACHE_VERSION: u32 = 1;
+/// Limit wpisów; po przekroczeniu wypadają najdawniej dodane
+const CHECK_CACHE_MAX: usize = 4096;
+
+/// Wynik sprawdzenia jednego pliku
+#[derive(Debug, Clone, Default, Serialize, Deserialize)]
+pub struct FileCheck {
+    /// Diagnostyki lint, razem z błędem deklaracji gena
+    pub lint:    Vec<Diag>,
+    /// Błąd składni; przy błędnej deklaracji gena parser nie jest uruchamiany
+    pub syntax:  Option<Diag>,
+    pub nodes:   usize,
+    pub gen:     u32,
+    pub shebang: Option<String>,
+}
+
+impl FileCheck {
+    /// 2 — błędy lint, 1 — błąd składni, 0 — OK
+    pub fn exit_code(&self) -> i32 {
+        if self.lint.iter().any(|d| d.level == DiagLevel::Error) { 2 }
+        else if self.syntax.is_some() { 1 }
+        else { 0 }
+    }
+}
+
+/// Parsowanie + lint jednego źródła. Deklaracja gena jest czytana raz
+/// (z surowego źródła — `preprocess` wycina linie `using`) i trafia zarówno
+/// do lintu, jak i do wyniku; błędny gen kończy sprawdzanie przed parserem.
+pub fn analyze(source: &str) -> FileCheck {
+    let (gen, gen_err) = extract_gen(source);
+    let lint = lint_pass(source, gen_err.as_ref());
+    if gen_err.is_some() { return FileCheck { lint, ..FileCheck::default() }; }
+    match parse_source_with_meta(source) {
+        Ok(meta) => FileCheck {
+            lint,
+            syntax:  None,
+            nodes:   meta.nodes.len(),
+            gen:     gen.number(),
+            shebang: meta.shebang.map(|s| s.raw),
+        },
+        Err(e) => FileCheck { lint, syntax: Some(parse_error_to_diag(&e)), gen: gen.number(), ..FileCheck::default() },
+    }
+}
+
+/// Hash treści — klucz cache. Ziarno z wersji HL: nowe reguły lint
+/// unieważniają stare wpisy.
+pub fn content_hash(source: &str) -> u64 {
+    let mut h = std::collections::hash_map::DefaultHasher::new();
+    env!("CARGO_PKG_VERSION").hash(&mut h);
+    source.hash(&mut h);
+    h.finish().max(1)
+}
+
+// ── Cache ─────────────────────────────────────────────────────────────────────
+
+#[derive(Debug, Default, Serialize, Deserialize)]
+struct CheckCache {
+    version: u32,
+    clock:   u64,
+    /// Hash treści (hex) → (zegar dodania, wynik)
+    entries: FxHashMap<String, (u64, FileCheck)>,
+    #[serde(skip)]
+    dirty:   bool,
+}
+
+impl CheckCache {
+    fn path() -> PathBuf {
+        crate::libs::hl_cache_dir().join(CHECK_CACHE_FILE)
+    }
+
+    /// Brak pliku albo inna wersja — pusty cache
+    fn load() -> Self {
+        std::fs::read(Self::path()).ok()
+        .and_then(|raw| serde_json::from_slice::<CheckCache>(&raw).ok())
+        .filter(|c| c.version == CHECK_CACHE_VERSION)
+        .unwrap_or_else(|| CheckCache { version: CHECK_CACHE_VERSION, ..CheckCache::default() })
+    }
+
+    fn get(&self, hash: u64) -> Option<&FileCheck> {
+        self.entries.get(&format!("{:016x}", hash)).map(|(_, c)| c)
+    }
+
+    fn insert(&mut self, hash: u64, check: FileCheck) {
+        self.clock += 1;
+        self.entries.insert(format!("{:016x}", hash), (self.clock, check));
+        self.dirty = true;
+        if self.entries.len() > CHECK_CACHE_MAX {
+            let mut ticks: Vec<u64> = self.entries.values().map(|(t, _)| *t).collect();
+            ticks.sort_unstable();
+            let cut = ticks[self.entries.len() - CHECK_CACHE_MAX];
+            self.entries.retain(|_, (t, _)| *t >= cut);
+        }
+    }
+
+    /// Zapis przez plik tymczasowy + rename; równoległy `hl check` w najgorszym
+    /// razie nadpisze nasze wpisy swoimi
+    fn save(&self) {
+        if !self.dirty { return; }
+        let path = Self::path();
+        let Ok(raw) = serde_json::to_vec(self) else { return };
+        let tmp = path.with_extension(format!("tmp.{}", std::process::id()));
+        let ok = path.parent().map_or(false, |d| std::fs::create_dir_all(d).is_ok())
+            && std::fs::write(&tmp, raw).is_ok()
+            && std::fs::rename(&tmp, &path).is_ok();
+        if !ok {
+            let _ = std::fs::remove_file(&tmp);
+            tracing::debug!("[check] nie udało się zapisać {:?}", path);
+        }
+    }
+}
+
+// ── Sprawdzanie wielu plików ──────────────────────────────────────────────────
+
+pub struct CheckOptions {
+    /// Liczba wątków; 0 — wszystkie rdzenie
+    pub jobs:  usize,
+    /// Czytaj i zapisuj `check.json`
+    pub cache: bool,
+}
+
+pub struct Checked {
+    pub path:   PathBuf,
+    /// Treść pliku (do renderowania diagnostyk); pusta przy błędzie odczytu
+    pub source: String,
+    pub result: std::io::Result<FileCheck>,
+    /// Wynik z cache, bez parsowania
+    pub cached: bool,
+}
+
+/// Sprawdź pliki równolegle. Wyniki w kolejności `paths`.
+pub fn check_files(paths: &[PathBuf], opts: &CheckOptions) -> Vec<Checked> {
+    let mut cache = if opts.cache { CheckCache::load() } else { CheckCache::default() };
+    let jobs = match opts.jobs {
+        0 => std::thread::available_parallelism().map_or(1, |n| n.get()),
+        n => n,
+    };
+
+    let checked = par_map(paths, jobs, |path| {
+        let source = match std::fs::read_to_string(path) {
+            Ok(s)  => s,
+            Err(e) => return (0, Checked { path: path.clone(), source: String::new(), result: Err(e), cached: false }),
+        };
+        let hash = content_hash(&source);
+        let (result, cached) = match cache.get(hash) {
+            Some(c) => (c.clone(), true),
+            None    => (analyze(&source), false),
+        };
+        (hash, Checked { path: path.clone(), source, result: Ok(result), cached })
+    });
+
+    let mut out = Vec::with_capacity(checked.len());
+    for (hash, c) in checked {
+        if opts.cache && !c.cached {
+            if let Ok(r) = &c.result { cache.insert(hash, r.clone()); }
+        }
+        out.push(c);
+    }
+    if opts.cache { cache.save(); }
+    out
+}
+
+/// Mapowanie na `jobs` wątkach (std::thread::scope), wyniki w kolejności wejścia
+fn par_map<T: Sync, R: Send>(items: &[T], jobs: usize, f: impl Fn(&T) -> R + Sync) -> Vec<R> {
+    let jobs = jobs.clamp(1, items.len().max(1));
+    if jobs == 1 { return items.iter().map(&f).collect(); }
+    let next = AtomicUsize::new(0);
+    let mut parts: Vec<Vec<(usize, R)>> = std::thread::scope(|sc| {
+        let handles: Vec<_> = (0..jobs).map(|_| sc.spawn(|| {
+            let mut got = Vec::new();
+            loop {
+                let i = next.fetch_add(1, Ordering::Relaxed);
+                if i >= items.len() { break; }
+                got.push((i, f(&items[i])));
+            }
+            got
+        })).collect();
+        handles.into_iter().map(|h| h.join().expect("wątek hl check spanikował")).collect()
+    });
+    let mut out: Vec<(usize, R)> = parts.iter_mut().flat_map(std::mem::take).collect();
+    out.sort_by_key(|(i, _)| *i);
+    out.into_iter().map(|(_, r)| r).collect()
+}
+
+// ── --watch ───────────────────────────────────────────────────────────────────
+
+/// Obserwacja plików .hl przez inotify. Katalogi wejściowe są obserwowane
+/// rekurencyjnie (nowe podkatalogi dochodzą w locie), pliki — przez katalog
+/// nadrzędny.
+pub struct Watcher {
+    fd:   i32,
+    dirs: FxHashMap<i32, PathBuf>,
+}
+
+impl Watcher {
+    pub fn new(roots: &[PathBuf]) -> Result<Self> {
+        let fd = unsafe { libc::inotify_init1(libc::IN_CLOEXEC) };
+        if fd < 0 { bail!("inotify niedostępne: {}", std::io::Error::last_os_error()); }
+        let mut w = Self { fd, dirs: FxHashMap::default() };
+        for root in roots {
+            if root.is_dir() {
+                w.add_tree(root)?;
+            } else {
+                // Plik albo glob — obserwuj najbliższy istniejący katalog
+                let mut dir = root.as_path();
+                while !dir.is_dir() {
+                    dir = match dir.parent() {
+                        Some(p) if !p.as_os_str().is_empty() => p,
+                        _ => Path::new("."),
+                    };
+                }
+                if root.to_string_lossy().contains(['*', '?']) { w.add_tree(dir)?; } else { w.add(dir)?; }
+            }
+        }
+        Ok(w)
+    }
+
+    fn add(&mut self, dir: &Path) -> Result<()> {
+        if self.dirs.values().any(|d| d == dir) { return Ok(()); }
+        let Ok(c) = CString::new(dir.as_os_str().as_bytes()) else { return Ok(()) };
+        let mask = libc::IN_CLOSE_WRITE | libc::IN_MOVED_TO | libc::IN_MOVED_FROM
+            | libc::IN_CREATE | libc::IN_DELETE | libc::IN_ONLYDIR;
+        let wd = unsafe { libc::inotify_add_watch(self.fd, c.as_ptr(), mask) };
+        if wd < 0 {
+            bail!("inotify {:?}: {} (limit: fs.inotify.max_user_watches)", dir, std::io::Error::last_os_error());
+        }
+        self.dirs.insert(wd, dir.to_path_buf());
+        Ok(())
+    }
+
+    /// Katalog z podkatalogami; pomija ukryte i `target` (jak `hl compile`)
+    fn add_tree(&mut self, dir: &Path) -> Result<()> {
+        self.add(dir)?;
+        let Ok(rd) = std::fs::read_dir(dir) else { return Ok(()) };
+        for e in rd.flatten() {
+            let name = e.file_name();
+            let name = name.to_string_lossy();
+            if e.file_type().map_or(false, |t| t.is_dir()) && !name.starts_with('.') && name != "target" {
+                self.add_tree(&e.path())?;
+            }
+        }
+        Ok(())
+    }
+
+    /// Czekaj na zmiany. Po pierwszym zdarzeniu zbiera kolejne, dopóki przez
+    /// `settle` nic nie przyjdzie (edytory zapisują w kilku krokach). Zwraca
+    /// zmienione pliki .hl — także usunięte — bez powtórzeń.
+    pub fn wait(&mut self, settle: Duration) -> Result<Vec<PathBuf>> {
+        let mut changed: Vec<PathBuf> = Vec::new();
+        let mut timeout: i32 = -1;
+        loop {
+            let mut pfd = libc::pollfd { fd: self.fd, events: libc::POLLIN, revents: 0 };
+            let n = unsafe { libc::poll(&mut pfd, 1, timeout) };
+            if n < 0 {
+                let err = std::io::Error::last_os_error();
+                if err.kind() == std::io::ErrorKind::Interrupted { continue; }
+                bail!("inotify: {}", err);
+            }
+            if n == 0 {
+                if !changed.is_empty() { return Ok(changed); }
+                timeout = -1;
+                continue;
+            }
+            self.read_events(&mut changed)?;
+            if !changed.is_empty() { timeout = settle.as_millis() as i32; }
+        }
+    }
+
+    fn read_events(&mut self, changed: &mut Vec<PathBuf>) -> Result<()> {
+        let mut buf = [0u8; 8192];
+        let n = unsafe { libc::read(self.fd, buf.as_mut_ptr().cast(), buf.len()) };
+        if n < 0 { bail!("inotify: {}", std::io::Error::last_os_error()); }
+        let head = std::mem::size_of::<libc::inotify_event>();
+        let mut off = 0usize;
+        while off + head <= n as usize {
+            // Bufor read() nie gwarantuje wyrównania — kopiujemy nagłówek
+            let ev: libc::inotify_event = unsafe { std::ptr::read_unaligned(buf[off..].as_ptr().cast()) };
+            let name = &buf[off + head..off + head + ev.len as usize];
+            let name = &name[..name.iter().position(|&b| b == 0).unwrap_or(name.len())];
+            off += head + ev.len as usize;
+
+            let Some(dir) = self.dirs.get(&ev.wd).cloned() else { continue };
+            if ev.mask & libc::IN_IGNORED != 0 { self.dirs.remove(&ev.wd); continue; }
+            let path = dir.join(OsStr::from_bytes(name));
+            if ev.mask & libc::IN_ISDIR != 0 {
+                if ev.mask & (libc::IN_CREATE | libc::IN_MOVED_TO) != 0 { self.add_tree(&path)?; }
+                continue;
+            }
+            if path.extension().and_then(|e| e.to_str()) == Some("hl") && !changed.contains(&path) {
+                changed.push(path);
+            }
+        }
+        Ok(())
+    }
+}
+
+impl Drop for Watcher {
+    fn drop(&mut self) { unsafe { libc::close(self.fd); } }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_analyze_single_parse() {
+        let ok = analyze("// curl\n> curl -s example.com\n~> gotowe");
+        assert_eq!(ok.exit_code(), 0);
+        assert!(ok.syntax.is_none());
+        assert!(ok.lint.is_empty());
+        assert!(ok.nodes > 0);
+
+        let lint = analyze("> echo hej");
+        assert_eq!(lint.exit_code(), 2);
+
+        let gen = analyze("using <gen x>\n~> x");
+        assert_eq!(gen.exit_code(), 2);
+        assert!(gen.syntax.is_none());
+        assert_eq!(gen.lint.len(), 1);
+    }
+
+    #[test]
+    fn test_lint_pass_matches_separate_lints() {
+        let src = "> nmap localhost\n> echo x\n% PATH = /bin\n// nmap\n~> a\nusing <gen 2>";
+        let mut both = crate::diagnostics::lint_source(src);
+        both.extend(crate::diagnostics::lint_gen(src));
+        let one = lint_pass(src, None);
+        let msgs = |d: &[Diag]| d.iter().map(|d| d.message.clone()).collect::<Vec<_>>();
+        assert_eq!(msgs(&one), msgs(&both));
+        // Deklaracja `// nmap` niżej w pliku wycisza podpowiedź
+        assert!(!one.iter().any(|d| d.message.contains("nmap")));
+    }
+
+    #[test]
+    fn test_check_files_parallel_in_order() {
+        let dir = std::env::temp_dir().join(format!("hl-check-test-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let paths: Vec<PathBuf> = (0..6).map(|i| {
+            let p = dir.join(format!("s{}.hl", i));
+            let body = if i == 3 { "> echo zle".to_string() } else { format!("~> plik {}", i) };
+            std::fs::write(&p, body).unwrap();
+            p
+        }).collect();
+        let res = check_files(&paths, &CheckOptions { jobs: 3, cache: false });
+        assert_eq!(res.iter().map(|c| c.path.clone()).collect::<Vec<_>>(), paths);
+        let codes: Vec<i32> = res.iter().map(|c| c.result.as_ref().unwrap().exit_code()).collect();
+        assert_eq!(codes, vec![0, 0, 0, 2, 0, 0]);
+        std::fs::remove_dir_all(&dir).unwrap();
+    }
+}
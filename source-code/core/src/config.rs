@@ -109,6 +109,22 @@ impl HlConfig {
     pub fn java_cmd(&self)   -> &str { self.get("extern", "java").unwrap_or("java") }
     pub fn shell_cmd(&self)  -> &str { self.get("extern", "shell").unwrap_or("bash") }
 
+    /// Ciepłe workery python/java (`[extern] workers = true`) — domyślnie wyłączone
+    pub fn extern_workers(&self) -> bool {
+        matches!(self.get("extern", "workers"), Some("true" | "1" | "on" | "yes"))
+    }
+
+    /// Najwyżej tyle workerów na runtime (`[extern] pool_size`, domyślnie 2)
+    pub fn extern_pool_size(&self) -> usize {
+        self.get("extern", "pool_size").and_then(|v| v.trim().parse().ok()).unwrap_or(2)
+    }
+
+    /// Bezczynny worker jest zamykany po tylu sekundach (`[extern] idle_timeout`, domyślnie 60)
+    pub fn extern_idle_timeout(&self) -> std::time::Duration {
+        let secs = self.get("extern", "idle_timeout").and_then(|v| v.trim().parse().ok()).unwrap_or(60);
+        std::time::Duration::from_secs(secs)
+    }
+
     /// Pobierz wewnętrzny HkConfig do serializacji
     pub fn hk_config(&self) -> &HkConfig { &self.inner }
 }
@@ -157,6 +173,9 @@ fn default_config() -> HlConfig {
     cfg.set("extern", "python", "python3");
     cfg.set("extern", "java",   "java");
     cfg.set("extern", "shell",  "bash");
+    cfg.set("extern", "workers",      "false");
+    cfg.set("extern", "pool_size",    "2");
+    cfg.set("extern", "idle_timeout", "60");
 
     cfg
 }
@@ -1,8 +1,9 @@
 use colored::Colorize;
+use serde::{Deserialize, Serialize};
 use std::fmt;
 use std::collections::HashSet;
 
-#[derive(Debug, Clone, PartialEq)]
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
 pub enum DiagLevel { Error, Warning, Hint, Note }
 
 impl DiagLevel {
@@ -27,14 +28,14 @@ impl DiagLevel {
     }
 }
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct Span { pub line: usize, pub col: usize, pub len: usize }
 impl Span {
     pub fn new(line: usize, col: usize, len: usize) -> Self { Self { line, col, len } }
     pub fn line_only(line: usize) -> Self { Self { line, col: 1, len: 0 } }
 }
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct Diag {
     pub level: DiagLevel, pub message: String,
     pub span: Option<Span>, pub suggestion: Option<String>, pub notes: Vec<String>,
@@ -81,38 +82,53 @@ impl<'a> DiagRenderer<'a> {
 }
 
 pub fn lint_source(source: &str) -> Vec<Diag> {
-    let mut diags = Vec::new();
+    lint_lines(source, true, false).0
+}
 
-    // ── OPTYMALIZACJA: jednorazowy pre-pass dla deklaracji narzedzi ────────────
-    // Poprzednio: O(n^2) - dla kazdej linii komendy iterowalo wszystkie linie
-    // Teraz: O(n) - jeden HashSet zbierany na poczatku
-    // Parsuj "// narzedzie" i "// narzedzie [pakiet-apt]" → zbierz nazwy binarek
-    let declared_tools: HashSet<&str> = source.lines()
-    .filter_map(|l| {
-        let t = l.trim();
-        // Linia // narzedzie (nie ///, nie blok komentarz z \\)
-        if t.starts_with("//") && !t.starts_with("///") && !t.ends_with("\\\\") {
-            let raw = t[2..].trim();
-            if raw.is_empty() { return None; }
-            // Wyciągnij nazwę binarki: przed " [" lub całość jeśli brak []
-            let bin_name = if let Some(bracket_pos) = raw.find(" [") {
-                raw[..bracket_pos].trim()
-            } else if let Some(bracket_pos) = raw.find('[') {
-                raw[..bracket_pos].trim()
-            } else {
-                // Bez [] — całość to nazwa binarki (nie może zawierać spacji)
-                if raw.contains(' ') { return None; }
-                raw
-            };
-            if !bin_name.is_empty() { Some(bin_name) } else { None }
-        } else { None }
-    })
-    .collect();
+/// `lint_source` + `lint_gen` w jednym przejściu po liniach (`hl check`).
+/// `gen_err` — błąd deklaracji gena z parsowania tego samego źródła, więc
+/// `extract_gen` nie jest powtarzany.
+pub fn lint_pass(source: &str, gen_err: Option<&GenError>) -> Vec<Diag> {
+    if let Some(err) = gen_err {
+        let mut diags = lint_source(source);
+        diags.push(gen_error_diag(err));
+        return diags;
+    }
+    let (mut diags, gen) = lint_lines(source, true, true);
+    diags.extend(gen);
+    diags
+}
+
+/// Jedno przejście po liniach: reguły `lint_source` (`rules`) i położenie
+/// `using` (`gen`). Zwraca (diagnostyki reguł, diagnostyki gena).
+fn lint_lines(source: &str, rules: bool, gen: bool) -> (Vec<Diag>, Vec<Diag>) {
+    let mut diags = Vec::new();
+    let mut gen_diags = Vec::new();
+    // Deklaracje `// narzedzie` zbierane w tym samym przejściu; podpowiedzi
+    // o brakującej deklaracji odsiewamy na końcu (deklaracja może być niżej)
+    let mut declared_tools: HashSet<&str> = HashSet::new();
+    let mut pending_tools: Vec<(usize, &str)> = Vec::new();
+    let mut seen_code = false;
 
     for (idx, raw_line) in source.lines().enumerate() {
         let line_no = idx + 1;
         let trimmed = raw_line.trim();
 
+        if gen && !is_gen_preamble(trimmed) {
+            if trimmed.starts_with("using") {
+                if seen_code {
+                    gen_diags.push(Diag::warning("deklaracja `using` po kodzie — gen moze nie byc uwzgledniony")
+                    .with_span(Span::new(line_no, 1, trimmed.len()))
+                    .with_suggestion("umies `using <gen N>` na samym poczatku pliku"));
+                }
+            } else {
+                seen_code = true;
+            }
+        }
+        if !rules { continue; }
+
+        if let Some(tool) = declared_tool(trimmed) { declared_tools.insert(tool); }
+
         // echo zakazane w blokach >
         if let Some(rest) = strip_cmd_prefix(trimmed, ">") {
             let rest = rest.trim();
@@ -151,34 +167,60 @@ pub fn lint_source(source: &str) -> Vec<Diag> {
             }
         }
 
-        // Sprawdz narzedzia — uzywa pre-obliczonego HashSet (O(1) lookup)
-        check_missing_dep_fast(trimmed, line_no, &declared_tools, &mut diags);
+        if let Some(tool) = check_missing_dep(trimmed, line_no, &mut diags) {
+            pending_tools.push((diags.len() - 1, tool));
+        }
     }
-    diags
+
+    for &(i, tool) in pending_tools.iter().rev() {
+        if declared_tools.contains(tool) { diags.remove(i); }
+    }
+    (diags, gen_diags)
+}
+
+/// Linie pomijane przy szukaniu `using` (jak w `extract_gen`)
+fn is_gen_preamble(t: &str) -> bool {
+    t.starts_with("#!") || t.starts_with(";;") || t.starts_with("///") || t.starts_with("//") || t.is_empty()
 }
 
-/// Sprawdz czy narzedzie jest uzywane bez deklaracji //
-/// Uzywa przekazanego HashSet zamiast skanowac cale zrodlo (O(1) vs O(n))
-fn check_missing_dep_fast(line: &str, line_no: usize, declared: &HashSet<&str>, diags: &mut Vec<Diag>) {
+/// `// narzedzie` albo `// narzedzie [pakiet-apt]` → nazwa binarki
+/// (nie `///`, nie blok komentarza zamknięty `\\`)
+fn declared_tool(t: &str) -> Option<&str> {
+    if !t.starts_with("//") || t.starts_with("///") || t.ends_with("\\\\") { return None; }
+    let raw = t[2..].trim();
+    if raw.is_empty() { return None; }
+    // Wyciągnij nazwę binarki: przed " [" lub całość jeśli brak []
+    let bin_name = if let Some(bracket_pos) = raw.find(" [") {
+        raw[..bracket_pos].trim()
+    } else if let Some(bracket_pos) = raw.find('[') {
+        raw[..bracket_pos].trim()
+    } else {
+        // Bez [] — całość to nazwa binarki (nie może zawierać spacji)
+        if raw.contains(' ') { return None; }
+        raw
+    };
+    if !bin_name.is_empty() { Some(bin_name) } else { None }
+}
+
+/// Narzedzie z listy obserwowanych uzyte w linii komendy: dopisuje podpowiedz
+/// i zwraca nazwe, zeby `lint_lines` mogl ja odsiac, gdy deklaracja `//` istnieje
+fn check_missing_dep(line: &str, line_no: usize, diags: &mut Vec<Diag>) -> Option<&'static str> {
     const WATCHED: &[&str] = &["nmap","curl","wget","whois","john","hydra","sqlmap",
     "nikto","masscan","aircrack-ng","hashcat","git","python3"];
-    let cmd_content = if let Some(r) = strip_cmd_prefix(line, ">>") { r.to_string() }
-    else if let Some(r) = strip_cmd_prefix(line, ">")   { r.to_string() }
-    else if let Some(r) = strip_cmd_prefix(line, "->")  { r.to_string() }
-    else if let Some(r) = strip_cmd_prefix(line, "^>")  { r.to_string() }
-    else { return };
+    let cmd_content = strip_cmd_prefix(line, ">>")
+    .or_else(|| strip_cmd_prefix(line, ">"))
+    .or_else(|| strip_cmd_prefix(line, "->"))
+    .or_else(|| strip_cmd_prefix(line, "^>"))?;
 
     let first_word = cmd_content.trim().split_whitespace().next().unwrap_or("");
-    if let Some(&tool) = WATCHED.iter().find(|&&t| t == first_word) {
-        if !declared.contains(tool) {
-            diags.push(Diag::hint(format!("narzedzie `{}` uzyte bez deklaracji `// {}`", tool, tool))
-            .with_span(Span::new(line_no, 1, line.len()))
-            .with_suggestion(format!(
-                "dodaj: `// {tool}` lub `// {tool} [pakiet-apt]` jesli nazwa pakietu inna niz binarka
+    let &tool = WATCHED.iter().find(|&&t| t == first_word)?;
+    diags.push(Diag::hint(format!("narzedzie `{}` uzyte bez deklaracji `// {}`", tool, tool))
+    .with_span(Span::new(line_no, 1, line.len()))
+    .with_suggestion(format!(
+        "dodaj: `// {tool}` lub `// {tool} [pakiet-apt]` jesli nazwa pakietu inna niz binarka
                   Przyklady: `// ninja [ninja-build]`  `// rg [ripgrep]`  `// fd [fd-find]`"
-            )));
-        }
-    }
+    )));
+    Some(tool)
 }
 
 fn strip_cmd_prefix<'a>(line: &'a str, prefix: &str) -> Option<&'a str> {
@@ -213,6 +255,7 @@ impl fmt::Display for DiagSummary {
     }
 }
 
+use hl_parser::gen::{extract_gen, GenError, HL_MAX_GEN};
 use hl_parser::parser::ParseError;
 use hl_parser::lexer::LexError;
 
@@ -229,6 +272,8 @@ pub fn parse_error_to_diag(err: &ParseError) -> Diag {
         .with_suggestion("dodaj `]` na koncu listy"),
         ParseError::Gen(gen_err) => Diag::error(format!("blad deklaracji gena: {}", gen_err))
         .with_suggestion("poprawna skladnia: `using <gen 2>`"),
+        ParseError::Expr(e) => Diag::error(format!("blad wyrazenia: {}", e))
+        .with_suggestion("warunek `?~` to porownanie, test (-f, -z...) albo @zmienna; wynik komendy zapisz najpierw do zmiennej"),
     }
 }
 
@@ -246,27 +291,12 @@ pub fn lex_error_to_diag(err: &LexError) -> Diag {
 }
 
 pub fn lint_gen(source: &str) -> Vec<Diag> {
-    use hl_parser::gen::{extract_gen, HL_MAX_GEN};
-    let mut diags = Vec::new();
     let (_gen, gen_err) = extract_gen(source);
-    if let Some(err) = gen_err {
-        diags.push(Diag::error(format!("nieprawidlowa deklaracja gena: {}", err))
-        .with_suggestion(format!("poprawna skladnia: `using <gen 2>`  (max gen: {})", HL_MAX_GEN)));
-        return diags;
-    }
-    let mut seen_code = false;
-    for (idx, raw_line) in source.lines().enumerate() {
-        let t = raw_line.trim();
-        if t.starts_with("#!") || t.starts_with(";;") || t.starts_with("///") || t.starts_with("//") || t.is_empty() { continue; }
-            if t.starts_with("using") {
-                if seen_code {
-                    diags.push(Diag::warning("deklaracja `using` po kodzie — gen moze nie byc uwzgledniony")
-                    .with_span(Span::new(idx+1, 1, t.len()))
-                    .with_suggestion("umies `using <gen N>` na samym poczatku pliku"));
-                }
-                continue;
-            }
-            seen_code = true;
-    }
-    diags
+    if let Some(err) = gen_err { return vec![gen_error_diag(&err)]; }
+    lint_lines(source, false, true).1
+}
+
+fn gen_error_diag(err: &GenError) -> Diag {
+    Diag::error(format!("nieprawidlowa deklaracja gena: {}", err))
+    .with_suggestion(format!("poprawna skladnia: `using <gen 2>`  (max gen: {})", HL_MAX_GEN))
 }
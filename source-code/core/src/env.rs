@@ -1,10 +1,15 @@
+use std::ptr::NonNull;
 use std::sync::Arc;
 use rustc_hash::FxHashMap;
-use hl_parser::ast::{Node, StringPart, ArenaSize};
+use hl_parser::ast::{Node, StringPart, ArenaSize, Ident};
+use hl_parser::sym::{self, Slot};
+use crate::arena::{ArenaContext, ArenaStr};
 
 #[derive(Debug, Clone)]
 pub enum Value {
     String(String),
+    /// String w arenie wywołania `:: nazwa` — tylko w Env tego wywołania
+    Arena(ArenaStr),
     Number(f64),
     Bool(bool),
     List(Vec<Value>),
@@ -16,6 +21,7 @@ impl Value {
     pub fn to_string_val(&self) -> String {
         match self {
             Value::String(s) => s.clone(),
+            Value::Arena(s)  => s.as_str().to_string(),
             Value::Number(n) => if n.fract() == 0.0 { format!("{}", *n as i64) } else { format!("{}", n) },
             Value::Bool(b)   => b.to_string(),
             Value::List(v)   => v.iter().map(|x| x.to_string_val()).collect::<Vec<_>>().join(" "),
@@ -24,13 +30,14 @@ impl Value {
     }
     #[inline]
     pub fn as_str(&self) -> &str {
-        match self { Value::String(s) => s.as_str(), _ => "" }
+        match self { Value::String(s) => s.as_str(), Value::Arena(s) => s.as_str(), _ => "" }
     }
     #[inline]
     pub fn as_f64(&self) -> f64 {
         match self {
             Value::Number(n) => *n,
             Value::String(s) => s.parse().unwrap_or(0.0),
+            Value::Arena(s)  => s.as_str().parse().unwrap_or(0.0),
             Value::Bool(b)   => if *b { 1.0 } else { 0.0 },
             _                => 0.0,
         }
@@ -41,10 +48,57 @@ impl Value {
             Value::Bool(b)   => *b,
             Value::Number(n) => *n != 0.0,
             Value::String(s) => !s.is_empty() && s != "false" && s != "0",
+            Value::Arena(s)  => { let s = s.as_str(); !s.is_empty() && s != "false" && s != "0" }
             Value::List(v)   => !v.is_empty(),
             Value::Nil       => false,
         }
     }
+
+    /// Dopisz tekstową postać do bufora (bez pośredniego String dla stringów)
+    #[inline]
+    pub fn append_to(&self, buf: &mut String) {
+        match self {
+            Value::String(s) => buf.push_str(s),
+            Value::Arena(s)  => buf.push_str(s.as_str()),
+            other            => buf.push_str(&other.to_string_val()),
+        }
+    }
+
+    /// Odepnij od areny — String z areny kopiowany na heap, reszta bez zmian
+    #[inline]
+    pub fn detach(self) -> Value {
+        match self {
+            Value::Arena(s) => Value::String(s.as_str().to_string()),
+            v               => v,
+        }
+    }
+}
+
+/// Region areny przypięty do Env wywołania arena function
+///
+/// Wskazuje na `ArenaContext` na stosie `exec_arena_func_call`, który żyje
+/// dłużej niż to Env. Nie przechodzi do dzieci (`new_with_parent`), więc Env
+/// z regionem nigdy nie opuszcza wątku wywołania
+struct ArenaScope(NonNull<ArenaContext>);
+
+unsafe impl Send for ArenaScope {}
+
+impl ArenaScope {
+    #[inline]
+    fn ctx(&mut self) -> &mut ArenaContext {
+        // SAFETY: patrz opis typu — kontekst przeżywa Env
+        unsafe { self.0.as_mut() }
+    }
+
+    /// String trafia do areny; przy braku miejsca zostaje na heap
+    #[inline]
+    fn place(&mut self, s: String) -> Value {
+        if s.is_empty() { return Value::String(s); }
+        match self.ctx().alloc_string(&s) {
+            Some(a) => Value::Arena(a),
+            None    => Value::String(s),
+        }
+    }
 }
 
 pub type FuncBody = Arc<Vec<Node>>;
@@ -56,96 +110,239 @@ pub struct ArenaFuncEntry {
     pub arena_size: ArenaSize,
 }
 
+/// Układ ramki programu: slot z `hl_parser::sym` → pozycja w ramce.
+///
+/// Sloty są wspólne dla procesu (demon, REPL i kompilacje dokładają nazwy),
+/// więc ramka indeksowana wprost slotem rosłaby do rozmiaru całej tablicy
+/// symboli. Pozycje nadajemy w kolejności pierwszego zapisu — ramka ma tyle
+/// wpisów, ile zmiennych program ustawił, a kopia przy zapisie w dziecku
+/// kopiuje tylko je. Sam `index` (4 B na slot) jest dzielony przez `Arc`
+/// i kopiowany tylko, gdy Env dokłada nową zmienną.
+#[derive(Clone, Default)]
+struct Layout {
+    /// slot → pozycja w ramce + 1 (0 — zmienna nigdy nie ustawiona)
+    index: Vec<u32>,
+    /// pozycja w ramce → slot
+    slots: Vec<Slot>,
+}
+
+impl Layout {
+    #[inline(always)]
+    fn get(&self, slot: Slot) -> Option<usize> {
+        match self.index.get(slot as usize) {
+            Some(&i) if i != 0 => Some(i as usize - 1),
+            _                  => None,
+        }
+    }
+
+    /// Pozycja slotu, nadawana przy pierwszym zapisie
+    fn insert(&mut self, slot: Slot) -> usize {
+        if let Some(i) = self.get(slot) { return i; }
+        let s = slot as usize;
+        if s >= self.index.len() { self.index.resize(s + 1, 0); }
+        self.slots.push(slot);
+        self.index[s] = self.slots.len() as u32;
+        self.slots.len() - 1
+    }
+}
+
+/// Zmienne leżą w płaskiej ramce, do której slot z `hl_parser::sym` (nadaje
+/// go parser, więc executor nie hashuje nazw) prowadzi przez [`Layout`].
+/// Ramka, układ i mapy funkcji są współdzielone przez `Arc` i kopiowane
+/// dopiero przy pierwszym zapisie (`Arc::make_mut`) — `new_with_parent` dla
+/// areny czy goroutine kosztuje kilka inkrementów licznika, nie kopię
+/// wszystkich zmiennych
 pub struct Env {
-    pub vars:        FxHashMap<String, Value>,
-    pub functions:   FxHashMap<String, FuncBody>,
+    layout:          Arc<Layout>,
+    /// pozycja z `layout` → wartość; None = zmienna nieustawiona (odczyt sięga do std::env)
+    vars:            Arc<Vec<Option<Value>>>,
+    pub functions:   Arc<FxHashMap<String, FuncBody>>,
     /// Rejestr arena functions (gen 2): :: nazwa <rozmiar> def
-    pub arena_funcs: FxHashMap<String, ArenaFuncEntry>,
+    pub arena_funcs: Arc<FxHashMap<String, ArenaFuncEntry>>,
     pub last_exit:   i32,
     interp_buf:      String,
+    arena:           Option<ArenaScope>,
 }
 
 impl Default for Env {
     fn default() -> Self { Self::new() }
 }
 
+static NIL: Value = Value::Nil;
+
+/// Zmienne ustawiane przez wywołanie areny — nie wracają do rodzica
+const ARENA_LOCALS: [&str; 3] = ["_arena_args", "_arena_name", "_arena_size"];
+
 impl Env {
     pub fn new() -> Self {
-        let mut vars: FxHashMap<String, Value> = FxHashMap::default();
-        vars.insert("HL_VERSION".into(), Value::String("gen 2".into()));
-        vars.insert("HL_OS".into(),      Value::String("HackerOS/Debian".into()));
-        vars.insert("HL_GEN".into(),     Value::String("2".into()));
-        Self {
-            vars,
-            functions:   FxHashMap::default(),
-            arena_funcs: FxHashMap::default(),
+        let mut env = Self {
+            layout:      Arc::default(),
+            vars:        Arc::default(),
+            functions:   Arc::default(),
+            arena_funcs: Arc::default(),
             last_exit:   0,
             interp_buf:  String::with_capacity(256),
-        }
+            arena:       None,
+        };
+        env.set_var("HL_VERSION", Value::String("gen 2".into()));
+        env.set_var("HL_OS",      Value::String("HackerOS/Debian".into()));
+        env.set_var("HL_GEN",     Value::String("2".into()));
+        env
     }
 
-    /// Utwórz Env dziedziczący zmienne z rodzica (dla arena functions)
-    /// Shallow copy — arena function widzi zmienne rodzica ale nie modyfikuje
-    /// oryginału (zmiany propagowane ręcznie po powrocie)
+    /// Utwórz Env dziedziczący zmienne z rodzica (arena functions, goroutines)
+    /// Copy-on-write — dziecko widzi zmienne rodzica, a pierwszy zapis kopiuje
+    /// ramkę tylko u niego (zmiany areny propagowane ręcznie po powrocie)
+    ///
+    /// Rodzic w arenie: dziecko dostaje kopię ze stringami odpiętymi na heap,
+    /// bo może przeżyć region (goroutine) albo mieć własny (zagnieżdżona arena)
     pub fn new_with_parent(parent: &Env) -> Self {
+        let vars = if parent.arena.is_some() && parent.vars.iter().any(|v| matches!(v, Some(Value::Arena(_)))) {
+            Arc::new(parent.vars.iter().map(|v| v.clone().map(Value::detach)).collect())
+        } else {
+            parent.vars.clone()
+        };
         Self {
-            vars:        parent.vars.clone(),
+            layout:      parent.layout.clone(),
+            vars,
             functions:   parent.functions.clone(),
             arena_funcs: parent.arena_funcs.clone(),
             last_exit:   parent.last_exit,
             interp_buf:  String::with_capacity(256),
+            arena:       None,
         }
     }
 
+    /// Env wywołania arena function — stringi zapisywane w trakcie trafiają do `ctx`
+    ///
+    /// # Safety
+    /// `ctx` musi żyć dłużej niż zwrócone Env, a przed resetem areny wartości
+    /// trzeba odpiąć przez `finish_arena_call`
+    pub(crate) unsafe fn new_arena_call(parent: &Env, ctx: &mut ArenaContext) -> Self {
+        let mut env = Self::new_with_parent(parent);
+        env.arena = Some(ArenaScope(NonNull::from(ctx)));
+        env
+    }
+
+    /// Zakończ wywołanie areny: ramka dziecka staje się ramką rodzica (bez
+    /// `_arena_*`), a stringi z areny (jedyne wartości uciekające z regionu)
+    /// są kopiowane na heap
+    pub(crate) fn finish_arena_call(mut self, parent: &mut Env) {
+        parent.last_exit = self.last_exit;
+        let Some(mut scope) = self.arena.take() else { return; };
+        let vars = Arc::make_mut(&mut self.vars);
+        for name in ARENA_LOCALS {
+            let id = sym::intern(name);
+            if let Some(v) = self.layout.get(id.slot()).and_then(|i| vars.get_mut(i)) {
+                *v = parent.get_slot(id).cloned();
+            }
+        }
+        let mut escaped = 0;
+        for v in vars.iter_mut() {
+            if let Some(Value::Arena(s)) = v {
+                escaped += s.as_str().len();
+                *v = Some(Value::String(s.as_str().to_string()));
+            }
+        }
+        parent.vars   = std::mem::take(&mut self.vars);
+        parent.layout = std::mem::take(&mut self.layout);
+        scope.ctx().note_escape(escaped);
+    }
+
+    // ── Zmienne ───────────────────────────────────────────────────────────────
+
+    /// Zapis po slocie nadanym przez parser — ścieżka executora
+    #[inline]
+    pub fn set_slot(&mut self, id: Ident, val: Value) {
+        let val = match (&mut self.arena, val) {
+            (Some(scope), Value::String(s)) => scope.place(s),
+            (_, v) => v,
+        };
+        let i = match self.layout.get(id.slot()) {
+            Some(i) => i,
+            None    => Arc::make_mut(&mut self.layout).insert(id.slot()),
+        };
+        let vars = Arc::make_mut(&mut self.vars);
+        if i >= vars.len() { vars.resize(i + 1, None); }
+        vars[i] = Some(val);
+    }
+
+    /// Odczyt po slocie; None — zmienna nieustawiona
+    #[inline(always)]
+    pub fn get_slot(&self, id: Ident) -> Option<&Value> {
+        self.layout.get(id.slot()).and_then(|i| self.vars.get(i)).and_then(Option::as_ref)
+    }
+
+    /// Zapis po nazwie (biblioteki, quick-funkcje, nazwy dynamiczne)
     #[inline]
     pub fn set_var(&mut self, name: &str, val: Value) {
-        self.vars.insert(name.to_string(), val);
+        self.set_slot(sym::intern(name), val);
+    }
+
+    #[inline]
+    pub fn remove_var(&mut self, name: &str) {
+        let Some(id) = sym::lookup(name) else { return; };
+        if self.get_slot(id).is_some() {
+            let i = self.layout.get(id.slot()).expect("slot ustawionej zmiennej");
+            Arc::make_mut(&mut self.vars)[i] = None;
+        }
+    }
+
+    #[inline]
+    fn lookup(&self, name: &str) -> Option<&Value> {
+        sym::lookup(name).and_then(|id| self.get_slot(id))
     }
 
     pub fn get_var_str(&self, name: &str) -> String {
-        if let Some(v) = self.vars.get(name) {
+        if let Some(v) = self.lookup(name) {
             return v.to_string_val();
         }
         std::env::var(name).unwrap_or_default()
     }
 
     pub fn get_var_owned(&self, name: &str) -> Value {
-        self.vars.get(name).cloned().unwrap_or(Value::Nil)
+        self.lookup(name).cloned().unwrap_or(Value::Nil)
     }
 
     pub fn get_var(&self, name: &str) -> &Value {
-        static NIL: std::sync::OnceLock<Value> = std::sync::OnceLock::new();
-        let nil = NIL.get_or_init(|| Value::Nil);
-        self.vars.get(name).unwrap_or(nil)
+        self.lookup(name).unwrap_or(&NIL)
+    }
+
+    /// Ustawione zmienne jako (nazwa, wartość)
+    pub fn iter_vars(&self) -> impl Iterator<Item = (&'static str, &Value)> + '_ {
+        self.vars.iter().zip(&self.layout.slots)
+        .filter_map(|(v, &slot)| v.as_ref().map(|v| (sym::name(slot), v)))
     }
 
     pub fn resolve_string_parts(&mut self, parts: &[StringPart]) -> String {
-        self.interp_buf.clear();
+        let mut buf = std::mem::take(&mut self.interp_buf);
+        buf.clear();
+        self.append_parts(parts, &mut buf);
+        let out = buf.clone();
+        self.interp_buf = buf;
+        out
+    }
+
+    pub(crate) fn append_parts(&self, parts: &[StringPart], buf: &mut String) {
         for part in parts {
             match part {
-                StringPart::Literal(s) => self.interp_buf.push_str(s),
-                StringPart::Var(v) => {
-                    let val = if let Some(val) = self.vars.get(v.as_str()) {
-                        val.to_string_val()
-                    } else {
-                        std::env::var(v).unwrap_or_default()
-                    };
-                    self.interp_buf.push_str(&val);
-                }
+                StringPart::Literal(s) => buf.push_str(s),
+                StringPart::Var(v) => match self.get_slot(*v) {
+                    Some(val) => val.append_to(buf),
+                    None      => if let Ok(e) = std::env::var(v.as_str()) { buf.push_str(&e) },
+                },
                 // DynVar: @{arg@_i} lub @arg@_i — najpierw rozwiąż nazwę, potem lookup
                 // np. @{arg@_i} z _i=1 → resolve("arg" + get_var("_i")) = resolve("arg1") → get_var("arg1")
                 StringPart::DynVar(inner_parts) => {
-                    let var_name = self.resolve_string_parts(inner_parts);
-                    let val = if let Some(val) = self.vars.get(var_name.as_str()) {
-                        val.to_string_val()
-                    } else {
-                        std::env::var(&var_name).unwrap_or_default()
-                    };
-                    self.interp_buf.push_str(&val);
+                    let mut var_name = String::new();
+                    self.append_parts(inner_parts, &mut var_name);
+                    match self.lookup(&var_name) {
+                        Some(val) => val.append_to(buf),
+                        None      => if let Ok(e) = std::env::var(&var_name) { buf.push_str(&e) },
+                    }
                 }
             }
         }
-        self.interp_buf.clone()
     }
 
     pub fn interpolate(&mut self, raw: &str) -> String {
@@ -158,7 +355,7 @@ impl Env {
 
     #[inline]
     pub fn define_function(&mut self, name: String, body: Vec<Node>) {
-        self.functions.insert(name, Arc::new(body));
+        Arc::make_mut(&mut self.functions).insert(name, Arc::new(body));
     }
 
     #[inline]
@@ -171,7 +368,7 @@ impl Env {
     /// Zarejestruj arena function
     #[inline]
     pub fn define_arena_function(&mut self, name: String, body: Vec<Node>, arena_size: ArenaSize) {
-        self.arena_funcs.insert(name, ArenaFuncEntry {
+        Arc::make_mut(&mut self.arena_funcs).insert(name, ArenaFuncEntry {
             body:       Arc::new(body),
                                 arena_size,
         });
@@ -189,3 +386,50 @@ impl Env {
         self.arena_funcs.contains_key(name)
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_arena_call_detaches_escaping_strings() {
+        let mut parent = Env::new();
+        let mut ctx = ArenaContext::new(4096);
+        let mut env = unsafe { Env::new_arena_call(&parent, &mut ctx) };
+        env.set_var("_arena_args", Value::String("a b".into()));
+        env.set_var("wynik", Value::String("zbudowany w arenie".into()));
+        assert!(matches!(env.get_var("wynik"), Value::Arena(_)));
+
+        // Goroutine z wnętrza areny dostaje kopię na heap
+        let child = Env::new_with_parent(&env);
+        assert!(matches!(child.get_var("wynik"), Value::String(_)));
+
+        env.finish_arena_call(&mut parent);
+        assert!(matches!(parent.get_var("wynik"), Value::String(s) if s == "zbudowany w arenie"));
+        assert!(parent.iter_vars().all(|(k, _)| k != "_arena_args"));
+        assert_eq!(ctx.stats().escaped, "zbudowany w arenie".len());
+    }
+
+    #[test]
+    fn test_frame_sized_by_program_vars() {
+        // Nazwy innych programów w tym samym procesie (demon, REPL)
+        for n in 0..2000 { sym::intern(&format!("env_test_obcy_{}", n)); }
+        let mut env = Env::new();
+        env.set_var("env_test_a", Value::Number(1.0));
+        env.set_var("env_test_b", Value::Number(2.0));
+        // HL_VERSION, HL_OS, HL_GEN + dwie zmienne skryptu
+        assert_eq!(env.vars.len(), 5);
+
+        let mut child = Env::new_with_parent(&env);
+        child.set_var("env_test_c", Value::Bool(true));
+        child.remove_var("env_test_a");
+        assert_eq!(child.vars.len(), 6);
+        assert!(matches!(child.get_var("env_test_b"), Value::Number(n) if *n == 2.0));
+        assert!(matches!(child.get_var("env_test_a"), Value::Nil));
+        // Rodzic nie widzi zapisów dziecka
+        assert!(matches!(env.get_var("env_test_a"), Value::Number(n) if *n == 1.0));
+        assert!(matches!(env.get_var("env_test_c"), Value::Nil));
+        let names: Vec<&str> = child.iter_vars().map(|(k, _)| k).collect();
+        assert!(names.contains(&"env_test_c") && !names.contains(&"env_test_a"));
+    }
+}
@@ -142,18 +142,18 @@ pub fn cmd_env_enter(name_or_path: Option<&str>) -> Result<()> {
 
     // Ustaw zmienne środowiskowe dla bieżącego procesu
     // (bit czyta config.hk, więc to wystarczy dla nowych procesów)
-    std::env::set_var("HL_ENV_NAME",    &name);
-    std::env::set_var("HL_ENV_PATH",    env_path.to_str().unwrap_or(""));
-    std::env::set_var("HL_ENV_LIBS",    env.libs_dir.to_str().unwrap_or(""));
-    std::env::set_var("HL_ENV_LOCK",    env.lock_file.to_str().unwrap_or(""));
-    std::env::set_var("HL_ENV_ACTIVE",  "1");
+    crate::spawn::set_env("HL_ENV_NAME",    &name);
+    crate::spawn::set_env("HL_ENV_PATH",    env_path.to_str().unwrap_or(""));
+    crate::spawn::set_env("HL_ENV_LIBS",    env.libs_dir.to_str().unwrap_or(""));
+    crate::spawn::set_env("HL_ENV_LOCK",    env.lock_file.to_str().unwrap_or(""));
+    crate::spawn::set_env("HL_ENV_ACTIVE",  "1");
 
     // Aktualizuj BIT_HOME i BIT_LOCK_FILE żeby bit automatycznie
     // korzystał z izolowanego środowiska
-    std::env::set_var("BIT_HOME",      env.libs_dir.to_str().unwrap_or(""));
-    std::env::set_var("BIT_LOCK_FILE", env.lock_file.to_str().unwrap_or(""));
-    std::env::set_var("BIT_CACHE_DIR", env.cache_dir.to_str().unwrap_or(""));
-    std::env::set_var("BIT_META_DIR",  env.meta_dir.to_str().unwrap_or(""));
+    crate::spawn::set_env("BIT_HOME",      env.libs_dir.to_str().unwrap_or(""));
+    crate::spawn::set_env("BIT_LOCK_FILE", env.lock_file.to_str().unwrap_or(""));
+    crate::spawn::set_env("BIT_CACHE_DIR", env.cache_dir.to_str().unwrap_or(""));
+    crate::spawn::set_env("BIT_META_DIR",  env.meta_dir.to_str().unwrap_or(""));
 
     print_env_header("hl env enter");
     println!("  {} Wchodzę do środowiska: {}", "→".bright_cyan(), name.bright_cyan().bold());
@@ -194,15 +194,15 @@ pub fn cmd_env_exit() -> Result<()> {
     clear_active_env()?;
 
     // Wyczyść zmienne środowiskowe (tylko dla bieżącego procesu)
-    std::env::remove_var("HL_ENV_NAME");
-    std::env::remove_var("HL_ENV_PATH");
-    std::env::remove_var("HL_ENV_LIBS");
-    std::env::remove_var("HL_ENV_LOCK");
-    std::env::remove_var("HL_ENV_ACTIVE");
-    std::env::remove_var("BIT_HOME");
-    std::env::remove_var("BIT_LOCK_FILE");
-    std::env::remove_var("BIT_CACHE_DIR");
-    std::env::remove_var("BIT_META_DIR");
+    crate::spawn::remove_env("HL_ENV_NAME");
+    crate::spawn::remove_env("HL_ENV_PATH");
+    crate::spawn::remove_env("HL_ENV_LIBS");
+    crate::spawn::remove_env("HL_ENV_LOCK");
+    crate::spawn::remove_env("HL_ENV_ACTIVE");
+    crate::spawn::remove_env("BIT_HOME");
+    crate::spawn::remove_env("BIT_LOCK_FILE");
+    crate::spawn::remove_env("BIT_CACHE_DIR");
+    crate::spawn::remove_env("BIT_META_DIR");
 
     println!("{} Opuszczono środowisko '{}'.", "✓".green().bold(), name.bright_cyan());
     println!("  Wróciłeś do globalnego kontekstu bit.");
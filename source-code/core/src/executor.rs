@@ -1,14 +1,19 @@
-use std::process::{Command, Stdio};
 use anyhow::{Result, bail};
+use rustc_hash::FxHashMap;
 use smallvec::SmallVec;
+use std::cell::RefCell;
+use std::rc::Rc;
 use tracing::debug;
 use hl_parser::ast::*;
+use hl_parser::expr::{expect_arith, BinOp, Expr, TestOp, UnOp};
 use crate::env::{Env, Value};
 use crate::deps::resolve_dependency;
 use crate::libs::resolve_import;
 use crate::quick::exec_quick;
-use crate::arena::ArenaContext;
+use crate::arena::{self, ArenaContext};
 use crate::extern_runner::exec_extern_def;
+use crate::spawn::{self, SpawnOpts};
+use crate::goroutine;
 
 pub struct ExecResult {
     pub exit_code: i32,
@@ -53,21 +58,8 @@ fn try_builtin_test(s: &str) -> Option<i32> {
     // Unary: test -n STR, test -z STR, test -e PATH, ...
     if tokens.len() == 2 {
         let (flag, val) = (&tokens[0], &tokens[1]);
-        return Some(match flag.as_str() {
-            "-n" => if val.is_empty() { 1 } else { 0 },
-            "-z" => if val.is_empty() { 0 } else { 1 },
-            "-e" => if std::path::Path::new(val).exists()      { 0 } else { 1 },
-            "-f" => if std::path::Path::new(val).is_file()     { 0 } else { 1 },
-            "-d" => if std::path::Path::new(val).is_dir()      { 0 } else { 1 },
-            "-r" => if std::fs::metadata(val).map(|m| !m.permissions().readonly()).unwrap_or(false) { 0 } else { 1 },
-            "-x" => {
-                use std::os::unix::fs::PermissionsExt;
-                if std::fs::metadata(val).map(|m| m.permissions().mode() & 0o111 != 0).unwrap_or(false) { 0 } else { 1 }
-            },
-            "-s" => if std::fs::metadata(val).map(|m| m.len() > 0).unwrap_or(false) { 0 } else { 1 },
-            "-L" | "-h" => if std::path::Path::new(val).is_symlink() { 0 } else { 1 },
-            _ => return None,
-        });
+        let op = TestOp::from_flag(flag.strip_prefix('-')?)?;
+        return Some(if eval_test(op, val) { 0 } else { 1 });
     }
 
     // Unary z jednym tokenem (np. test -n bez argumentu → traktujemy jako puste)
@@ -179,12 +171,140 @@ fn shell_words(s: &str) -> SmallVec<[String; 8]> {
     words
 }
 
-fn run_command(raw: &str, sudo: bool, isolated: bool, interpolate: bool, env: &mut Env, capture: bool) -> Result<ExecResult> {
-    let expanded = if interpolate || raw.contains('@') {
-        env.interpolate(raw)
-    } else {
-        raw.to_string()
-    };
+// ── Szablony komend ───────────────────────────────────────────────────────────
+//
+// Komenda w pętli ma ten sam surowy tekst przy każdym obrocie. Parsowanie `@zmiennych`,
+// `needs_shell` i `shell_words` robimy raz na tekst: szablon trzyma słowa argv z
+// dziurami na wartości. Wykonanie tylko wypełnia dziury; gdy wartość mogłaby zmienić
+// podział albo wymagać powłoki, wracamy do pełnej linii — wynik jest identyczny.
+
+/// Ile różnych tekstów komend trzymamy na wątek (po przepełnieniu: od zera)
+const CMD_TPL_MAX: usize = 512;
+
+/// Znaki, od których `needs_shell` może wybrać `bash -c`
+const SHELL_META: &[char] = &['&', ';', '`', '|', '>', '<', '$', '*'];
+
+enum TplSeg {
+    Lit(String),
+    /// Zmienna; `quoted` — wewnątrz cudzysłowu (biały znak nie dzieli słowa)
+    Hole { part: StringPart, quoted: bool },
+}
+
+struct TplWord {
+    segs:   Vec<TplSeg>,
+    /// Słowo z cudzysłowem zostaje nawet puste (jak w `shell_words`)
+    quoted: bool,
+}
+
+struct CmdTpl {
+    /// Części całej linii — dla ścieżki ogólnej, bez ponownego parsowania
+    parts: Vec<StringPart>,
+    /// Słowa argv; None, gdy literały same wymagają powłoki albo cudzysłów
+    /// nie jest zamknięty
+    words: Option<Vec<TplWord>>,
+}
+
+thread_local! {
+    static CMD_TPLS: RefCell<FxHashMap<Box<str>, Rc<CmdTpl>>> = RefCell::new(FxHashMap::default());
+}
+
+fn cmd_template(raw: &str) -> Rc<CmdTpl> {
+    CMD_TPLS.with(|c| {
+        if let Some(t) = c.borrow().get(raw) { return t.clone(); }
+        let t = Rc::new(CmdTpl::compile(raw));
+        let mut c = c.borrow_mut();
+        if c.len() >= CMD_TPL_MAX { c.clear(); }
+        c.insert(raw.into(), t.clone());
+        t
+    })
+}
+
+impl CmdTpl {
+    fn compile(raw: &str) -> Self {
+        // `Env::interpolate` nie parsuje tekstu bez '@'
+        let parts = if raw.contains('@') {
+            parse_string_parts(raw)
+        } else {
+            vec![StringPart::Literal(raw.to_string())]
+        };
+        let words = Self::split(&parts);
+        Self { parts, words }
+    }
+
+    /// Podział jak `shell_words` na linii po `trim`, z dziurami w miejscu zmiennych
+    fn split(parts: &[StringPart]) -> Option<Vec<TplWord>> {
+        let plain = |s: &str| !s.contains(|c: char| SHELL_META.contains(&c)
+            || (c.is_whitespace() && c != ' ' && c != '\t'));
+        if parts.iter().any(|p| matches!(p, StringPart::Literal(s) if !plain(s))) {
+            return None;
+        }
+        let mut words = Vec::new();
+        let mut segs  = Vec::new();
+        let mut lit   = String::new();
+        let (mut in_s, mut in_d, mut had_quote) = (false, false, false);
+        for part in parts {
+            let StringPart::Literal(s) = part else {
+                if !lit.is_empty() { segs.push(TplSeg::Lit(std::mem::take(&mut lit))); }
+                segs.push(TplSeg::Hole { part: part.clone(), quoted: in_s || in_d });
+                continue;
+            };
+            for c in s.chars() {
+                match c {
+                    '\'' if !in_d => { in_s = !in_s; had_quote = true; }
+                    '"'  if !in_s => { in_d = !in_d; had_quote = true; }
+                    ' ' | '\t' if !in_s && !in_d => {
+                        if !lit.is_empty() { segs.push(TplSeg::Lit(std::mem::take(&mut lit))); }
+                        if !segs.is_empty() || had_quote {
+                            words.push(TplWord { segs: std::mem::take(&mut segs), quoted: had_quote });
+                            had_quote = false;
+                        }
+                    }
+                    _ => lit.push(c),
+                }
+            }
+        }
+        if in_s || in_d { return None; }
+        if !lit.is_empty() { segs.push(TplSeg::Lit(lit)); }
+        if !segs.is_empty() || had_quote { words.push(TplWord { segs, quoted: had_quote }); }
+        Some(words)
+    }
+
+    /// Argv z wypełnionych dziur. None = ścieżka ogólna: wartość z cudzysłowem,
+    /// znakiem powłoki albo białym znakiem poza cudzysłowem, pusta komenda
+    /// albo wbudowane `exit`/`test`.
+    fn argv(&self, env: &mut Env) -> Option<SmallVec<[String; 8]>> {
+        let words = self.words.as_ref()?;
+        let mut argv: SmallVec<[String; 8]> = SmallVec::new();
+        for word in words {
+            let mut w = String::new();
+            for seg in &word.segs {
+                match seg {
+                    TplSeg::Lit(s) => w.push_str(s),
+                    TplSeg::Hole { part, quoted } => {
+                        let at = w.len();
+                        env.append_parts(std::slice::from_ref(part), &mut w);
+                        let bad = |c: char| c == '\'' || c == '"' || SHELL_META.contains(&c)
+                            || (!quoted && c.is_whitespace());
+                        if w[at..].contains(bad) { return None; }
+                    }
+                }
+            }
+            if !w.is_empty() || word.quoted { argv.push(w); }
+        }
+        match argv.first().map(String::as_str) {
+            None | Some("exit" | "test" | "[") => None,
+            Some(_) => Some(argv),
+        }
+    }
+}
+
+fn run_command(raw: &str, sudo: bool, isolated: bool, env: &mut Env, capture: bool) -> Result<ExecResult> {
+    let tpl = cmd_template(raw);
+    if let Some(parts) = tpl.argv(env) {
+        debug!("run: {}", parts.join(" "));
+        return build_and_run(parts, sudo, isolated, capture);
+    }
+    let expanded = env.resolve_string_parts(&tpl.parts);
     let trimmed = expanded.trim();
     debug!("run: {}", trimmed);
 
@@ -206,44 +326,71 @@ fn run_command(raw: &str, sudo: bool, isolated: bool, interpolate: bool, env: &m
 }
 
 fn run_via_shell(cmd: &str, sudo: bool, isolated: bool, capture: bool) -> Result<ExecResult> {
-    let (prog, args): (String, Vec<String>) = match (sudo, isolated) {
+    let (prog, args) = shell_argv(cmd, sudo, isolated);
+    exec_process(prog, args, capture)
+}
+
+fn build_and_run(parts: SmallVec<[String; 8]>, sudo: bool, isolated: bool, capture: bool) -> Result<ExecResult> {
+    let (prog, args) = direct_argv(parts, sudo, isolated);
+    exec_process(prog, args, capture)
+}
+
+fn shell_argv(cmd: &str, sudo: bool, isolated: bool) -> (String, Vec<String>) {
+    match (sudo, isolated) {
         (false, false) => ("bash".into(), vec!["-c".into(), cmd.into()]),
         (true,  false) => ("sudo".into(), vec!["bash".into(), "-c".into(), cmd.into()]),
         (false, true)  => ("unshare".into(), vec!["--mount".into(),"--pid".into(),"--net".into(),"--fork".into(),"--".into(),"bash".into(),"-c".into(),cmd.into()]),
         (true,  true)  => ("sudo".into(), vec!["unshare".into(),"--mount".into(),"--pid".into(),"--net".into(),"--fork".into(),"--".into(),"bash".into(),"-c".into(),cmd.into()]),
-    };
-    exec_process(prog, args, capture)
+    }
 }
 
-fn build_and_run(parts: SmallVec<[String; 8]>, sudo: bool, isolated: bool, capture: bool) -> Result<ExecResult> {
-    let (prog, args): (String, Vec<String>) = match (sudo, isolated) {
+fn direct_argv(parts: SmallVec<[String; 8]>, sudo: bool, isolated: bool) -> (String, Vec<String>) {
+    match (sudo, isolated) {
         (false, false) => { let mut it = parts.into_iter(); let p = it.next().unwrap(); (p, it.collect()) }
         (true,  false) => ("sudo".into(), parts.into_iter().collect()),
         (false, true)  => { let mut a = vec!["--mount".into(),"--pid".into(),"--net".into(),"--fork".into(),"--".into()]; a.extend(parts); ("unshare".into(), a) }
         (true,  true)  => { let mut iso = vec!["--mount".into(),"--pid".into(),"--net".into(),"--fork".into(),"--".into()]; iso.extend(parts); let mut a = vec!["unshare".into()]; a.extend(iso); ("sudo".into(), a) }
+    }
+}
+
+/// Komenda dla `@ x in >> cmd` — stdout czytany strumieniowo, bez buforowania
+/// całego wyjścia (stdin null jak w trybie capture)
+fn stream_command(raw: &str, sudo: bool, isolated: bool, env: &mut Env) -> Result<spawn::OutputStream> {
+    let tpl = cmd_template(raw);
+    let (prog, args) = match tpl.argv(env) {
+        Some(parts) => {
+            debug!("stream: {}", parts.join(" "));
+            direct_argv(parts, sudo, isolated)
+        }
+        None => {
+            let expanded = env.resolve_string_parts(&tpl.parts);
+            let trimmed  = expanded.trim();
+            debug!("stream: {}", trimmed);
+            if needs_shell(trimmed) {
+                shell_argv(trimmed, sudo, isolated)
+            } else {
+                let parts = shell_words(trimmed);
+                if parts.is_empty() { bail!("Pusta komenda w for-in"); }
+                direct_argv(parts, sudo, isolated)
+            }
+        }
     };
-    exec_process(prog, args, capture)
+    let opts = SpawnOpts { stdin: spawn::Stdio::Null, stdout: spawn::Stdio::Piped, stderr: spawn::Stdio::Inherit };
+    Ok(spawn::stream(&prog, &args, opts)?)
 }
 
 fn exec_process(prog: String, args: Vec<String>, capture: bool) -> Result<ExecResult> {
-    let mut cmd = Command::new(&prog);
-    cmd.args(&args);
     if capture {
         // WAZONE: stdin musi byc null — inherit blokuje gdy subproces czeka na input z TTY
         // (bug powodujacy wiszenie >> bash -c "..." |> @var)
-        cmd.stdin(Stdio::null())
-           .stdout(Stdio::piped())
-           .stderr(Stdio::inherit());
-        let out = cmd.output()?;
+        let opts = SpawnOpts { stdin: spawn::Stdio::Null, stdout: spawn::Stdio::Piped, stderr: spawn::Stdio::Inherit };
+        let out = spawn::run(&prog, &args, opts)?;
         return Ok(ExecResult {
-            exit_code: out.status.code().unwrap_or(1),
-            stdout:    Some(String::from_utf8_lossy(&out.stdout).into_owned()),
+            exit_code: out.exit_code,
+            stdout:    Some(String::from_utf8_lossy(&out.stdout.unwrap_or_default()).into_owned()),
         });
     }
-    cmd.stdin(Stdio::inherit())
-       .stdout(Stdio::inherit())
-       .stderr(Stdio::inherit());
-    Ok(ExecResult { exit_code: cmd.status()?.code().unwrap_or(1), stdout: None })
+    Ok(ExecResult { exit_code: spawn::run(&prog, &args, SpawnOpts::INHERIT)?.exit_code, stdout: None })
 }
 
 fn resolve_export_value(val: &ExportValue, env: &mut Env) -> String {
@@ -268,6 +415,8 @@ pub fn exec_nodes(nodes: &[Node], env: &mut Env) -> Result<ExecResult> {
 pub fn exec_node(node: &Node, env: &mut Env) -> Result<ExecResult> {
     match node {
         Node::LineComment(_) | Node::DocComment(_) | Node::BlockComment(_) => Ok(ExecResult::ok()),
+        // Znacznik linii nie zmienia kodu wyjścia poprzedniej instrukcji
+        Node::SourceLine(_) => Ok(ExecResult::err_or_ok(env.last_exit)),
 
         Node::Print { parts } => {
             let has_vars = parts.iter().any(|p| matches!(p, StringPart::Var(_)));
@@ -283,13 +432,13 @@ pub fn exec_node(node: &Node, env: &mut Env) -> Result<ExecResult> {
         }
 
         // ── :: QuickCall (gen 1 wbudowane + gen 2 fallback) ───────────────────
-        Node::QuickCall { name, args } => exec_quick(name, args, env),
+        Node::QuickCall { name, func, args } => exec_quick(name, *func, args, env),
 
         // :: name args |> @var — QuickCall z przechwyceniem stdout do zmiennej
-        Node::QuickPipeToVar { name, args, var_name } => {
-            let result_str = crate::quick::exec_quick_capture(name, args, env)?;
+        Node::QuickPipeToVar { name, func, args, var_name } => {
+            let result_str = crate::quick::exec_quick_capture(name, *func, args, env)?;
             let trimmed    = result_str.trim_end_matches('\n').trim_end_matches('\r').to_string();
-            env.set_var(var_name, Value::String(trimmed.clone()));
+            env.set_slot(*var_name, Value::String(trimmed));
             env.last_exit = 0;
             Ok(ExecResult::ok())
         }
@@ -313,38 +462,29 @@ pub fn exec_node(node: &Node, env: &mut Env) -> Result<ExecResult> {
             if trimmed.starts_with("echo ") || trimmed == "echo" {
                 bail!("'echo' jest zabroniony. Użyj '~>'.");
             }
-            let (sudo, isolated, interpolate) = match mode {
-                CommandMode::Plain            => (false, false, false),
-                CommandMode::Sudo             => (true,  false, false),
-                CommandMode::Isolated         => (false, true,  false),
-                CommandMode::IsolatedSudo     => (true,  true,  false),
-                CommandMode::WithVars         => (false, false, true),
-                CommandMode::WithVarsSudo     => (true,  false, true),
-                CommandMode::WithVarsIsolated => (false, true,  true),
+            let (sudo, isolated) = match mode {
+                CommandMode::Plain    | CommandMode::WithVars         => (false, false),
+                CommandMode::Sudo     | CommandMode::WithVarsSudo     => (true,  false),
+                CommandMode::Isolated | CommandMode::WithVarsIsolated => (false, true),
+                CommandMode::IsolatedSudo                             => (true,  true),
             };
-            run_command(raw, sudo, isolated, interpolate, env, false)
+            run_command(raw, sudo, isolated, env, false)
         }
 
         Node::HshCommand { raw } => {
             let expanded = env.interpolate(raw);
-            let status = Command::new("hsh")
-            .args(["-c", expanded.trim()])
-            .stdin(Stdio::inherit()).stdout(Stdio::inherit()).stderr(Stdio::inherit())
-            .status()
-            .map_err(|e| anyhow::anyhow!("hsh nie znaleziony: {}", e))?;
-            Ok(ExecResult { exit_code: status.code().unwrap_or(1), stdout: None })
+            let out = spawn::run("hsh", &["-c", expanded.trim()], SpawnOpts::INHERIT)
+                .map_err(|e| anyhow::anyhow!("hsh nie znaleziony: {}", e))?;
+            Ok(ExecResult { exit_code: out.exit_code, stdout: None })
         }
 
         Node::Background { raw } => {
             let expanded = env.interpolate(raw);
-            let child = Command::new("sh")
-            .args(["-c", expanded.trim()])
-            .stdin(Stdio::null()).stdout(Stdio::inherit()).stderr(Stdio::inherit())
-            .spawn()
-            .map_err(|e| anyhow::anyhow!("Błąd tła: {}", e))?;
-            env.set_var("_bg_pid", Value::Number(child.id() as f64));
-            eprintln!("\x1b[90m[hl &] PID={}\x1b[0m", child.id());
-            std::mem::forget(child);
+            let opts = SpawnOpts { stdin: spawn::Stdio::Null, ..SpawnOpts::INHERIT };
+            let pid = spawn::spawn_detached("sh", &["-c", expanded.trim()], opts)
+                .map_err(|e| anyhow::anyhow!("Błąd tła: {}", e))?;
+            env.set_var("_bg_pid", Value::Number(pid as f64));
+            eprintln!("\x1b[90m[hl &] PID={}\x1b[0m", pid);
             Ok(ExecResult::ok())
         }
 
@@ -429,44 +569,54 @@ pub fn exec_node(node: &Node, env: &mut Env) -> Result<ExecResult> {
         Node::Goroutine { name, body } => {
             let body_clone = body.clone();
             let name_str   = name.clone().unwrap_or_else(|| "<goroutine>".to_string());
-            let mut thread_env = Env::new();
-            for (k, v) in &env.vars { thread_env.vars.insert(k.clone(), v.clone()); }
-            std::thread::spawn(move || { let _ = exec_nodes(&body_clone, &mut thread_env); });
+            let mut thread_env = Env::new_with_parent(env);
+            let label = name_str.clone();
+            goroutine::spawn(name.as_deref(), move || match exec_nodes(&body_clone, &mut thread_env) {
+                Ok(r)  => r.exit_code,
+                Err(e) => { eprintln!("\x1b[31m[hl :*]\x1b[0m goroutine '{}': {}", label, e); 1 }
+            });
             eprintln!("\x1b[35m[hl :*] goroutine '{}' uruchomiona\x1b[0m", name_str);
             Ok(ExecResult::ok())
         }
 
-        Node::Channel { name } => {
-            env.set_var(&format!("__chan_{}", name), Value::String(String::new()));
+        Node::GoroutineWait { name } => {
+            Ok(ExecResult::err_or_ok(goroutine::wait(name.as_deref())?))
+        }
+
+        Node::Channel { name, cap } => {
+            goroutine::channel_open(name, cap.unwrap_or(goroutine::DEFAULT_CHANNEL_CAP));
             Ok(ExecResult::ok())
         }
 
-        Node::ChannelOp { name, value } => {
-            let chan_var = format!("__chan_{}", name);
+        Node::ChannelOp { name, value, var_name } => {
             if let Some(parts) = value {
                 let resolved = env.resolve_string_parts(parts);
-                env.set_var(&chan_var, Value::String(resolved));
+                goroutine::send(name, resolved)?;
             } else {
-                println!("{}", env.get_var(&chan_var).to_string_val());
+                let got = goroutine::recv(name)?;
+                match var_name {
+                    Some(v) => env.set_slot(*v, Value::String(got)),
+                    None    => println!("{}", got),
+                }
             }
             Ok(ExecResult::ok())
         }
 
         Node::VarDecl { name, typ: _typ, value } => {
             let val = eval_var_value(value, env)?;
-            env.set_var(name, val);
+            env.set_slot(*name, val);
             Ok(ExecResult::ok())
         }
 
         Node::Export { name, value } => {
             let resolved = resolve_export_value(value, env);
-            std::env::set_var(name, &resolved);
-            env.set_var(name, Value::String(resolved));
+            spawn::set_env(name, &resolved);
+            env.set_slot(*name, Value::String(resolved));
             Ok(ExecResult::ok())
         }
 
         Node::VarRef(name) => {
-            println!("{}", env.get_var(name).to_string_val());
+            println!("{}", env.get_slot(*name).map(Value::to_string_val).unwrap_or_default());
             Ok(ExecResult::ok())
         }
 
@@ -507,18 +657,50 @@ pub fn exec_node(node: &Node, env: &mut Env) -> Result<ExecResult> {
             if run { exec_nodes(body, env) } else { Ok(ExecResult::ok()) }
         }
 
-        Node::ForIn { var, iterable, body } => {
+        Node::ForIn { var, iterable, lines, body } => {
             let iter_str = env.resolve_string_parts(iterable);
             let mut last = ExecResult::ok();
-            for item in iter_str.split_whitespace() {
-                env.set_var(var, Value::String(item.to_string()));
+            let items: Box<dyn Iterator<Item = &str>> = if *lines {
+                Box::new(iter_str.lines())
+            } else {
+                Box::new(iter_str.split_whitespace())
+            };
+            for item in items {
+                env.set_slot(*var, Value::String(item.to_string()));
+                last = exec_nodes(body, env)?;
+                env.last_exit = last.exit_code;
+            }
+            Ok(last)
+        }
+
+        Node::ForRange { var, from, to, body } => {
+            // Granice jak `ToInt` w bytecode: liczba obcięta do i32, tekst → 0
+            let mut bound = |parts: &[StringPart]| {
+                env.resolve_string_parts(parts).trim().parse::<f64>().unwrap_or(0.0) as i32
+            };
+            let (from, to) = (bound(from), bound(to));
+            let mut last = ExecResult::ok();
+            for i in from..=to {
+                env.set_slot(*var, Value::Number(i as f64));
                 last = exec_nodes(body, env)?;
                 env.last_exit = last.exit_code;
             }
             Ok(last)
         }
 
-        Node::WhileLoop { condition, body } => {
+        Node::ForInCmd { var, command, mode, lines, body } => {
+            let sudo     = matches!(mode, CommandMode::Sudo | CommandMode::IsolatedSudo | CommandMode::WithVarsSudo);
+            let isolated = matches!(mode, CommandMode::Isolated | CommandMode::IsolatedSudo | CommandMode::WithVarsIsolated);
+            let mut stream = stream_command(command, sudo, isolated, env)?;
+            while let Some(item) = if *lines { stream.next_line() } else { stream.next_word() } {
+                env.set_slot(*var, Value::String(item));
+                let r = exec_nodes(body, env)?;
+                env.last_exit = r.exit_code;
+            }
+            Ok(ExecResult::err_or_ok(stream.exit_code().unwrap_or(1)))
+        }
+
+        Node::WhileLoop { parsed, body, .. } => {
             let mut iterations = 0usize;
             const MAX_ITER: usize = 1_000_000;
             loop {
@@ -526,8 +708,7 @@ pub fn exec_node(node: &Node, env: &mut Env) -> Result<ExecResult> {
                     bail!("Pętla while: przekroczono limit {} iteracji", MAX_ITER);
                 }
                 iterations += 1;
-                let cond_str = env.resolve_string_parts(condition);
-                if !eval_condition_fast(&cond_str, env)? { break; }
+                if !eval_cond(parsed, env) { break; }
                 let r = exec_nodes(body, env)?;
                 env.last_exit = r.exit_code;
             }
@@ -555,12 +736,10 @@ pub fn exec_node(node: &Node, env: &mut Env) -> Result<ExecResult> {
             Ok(ExecResult::ok())
         }
 
-        Node::Arithmetic { expr, assign_to } => {
-            let expanded = env.interpolate(expr);
-            let result   = eval_arithmetic_fast(&expanded);
-            let result = result.unwrap_or_else(|| eval_arithmetic_shell(&expanded));
+        Node::Arithmetic { expr, parsed, assign_to } => {
+            let result = eval_arith(expr, parsed.as_ref(), env)?;
             if let Some(var) = assign_to {
-                env.set_var(var, Value::String(result.clone()));
+                env.set_slot(*var, Value::String(result));
             } else {
                 println!("{}", result);
             }
@@ -568,12 +747,11 @@ pub fn exec_node(node: &Node, env: &mut Env) -> Result<ExecResult> {
         }
 
         Node::PipeToVar { command, mode, var_name } => {
-            let interpolate = true;
             let sudo     = matches!(mode, CommandMode::Sudo | CommandMode::IsolatedSudo | CommandMode::WithVarsSudo);
             let isolated = matches!(mode, CommandMode::Isolated | CommandMode::IsolatedSudo | CommandMode::WithVarsIsolated);
-            let r = run_command(command, sudo, isolated, interpolate, env, true)?;
+            let r = run_command(command, sudo, isolated, env, true)?;
             let output = r.stdout.unwrap_or_default().trim().to_string();
-            env.set_var(var_name, Value::String(output));
+            env.set_slot(*var_name, Value::String(output));
             Ok(ExecResult { exit_code: r.exit_code, stdout: None })
         }
 
@@ -586,7 +764,7 @@ pub fn exec_node(node: &Node, env: &mut Env) -> Result<ExecResult> {
                 return Ok(ExecResult::err(127));
             }
             let cmd = if args_str.is_empty() { bin.to_string() } else { format!("{} {}", bin, args_str) };
-            run_command(&cmd, false, false, false, env, false)
+            run_command(&cmd, false, false, env, false)
         }
 
         Node::Block(nodes) => exec_nodes(nodes, env),
@@ -597,15 +775,17 @@ pub fn exec_node(node: &Node, env: &mut Env) -> Result<ExecResult> {
 
 /// Wykonaj arena function z bump-pointer arena allocatorem
 ///
-/// Przed wywołaniem: alokuj blok `arena_size` bajtów
-/// Podczas wywołania: zmienne lokalne tworzone przez zwykły Env (String na heap)
-///   ale arena jest dostępna do alokacji przez ArenaContext
-/// Po powrocie: drop ArenaContext → jeden dealloc całego bloku
+/// Przed wywołaniem: blok `arena_size` bajtów z puli wątku
+/// Podczas wywołania: stringi zapisywane do zmiennych (także przechwycony
+///   output komend) lądują w arenie jako `Value::Arena`; gdy braknie miejsca —
+///   zostają na heap
+/// Po powrocie: zmienne wracają do rodzica, stringi z areny kopiowane na heap,
+///   a cały region zwalnia jeden `reset()` (blok wraca do puli)
 ///
 /// Dlaczego to jest szybsze:
-///  - Zero fragmentation heap: wszystkie małe alokacje razem
+///  - Nadpisywane w pętli wartości nie trzymają osobnych alokacji heap
 ///  - Lepsza lokalność danych (cache lines)
-///  - Brak GC pressure: wszystko zwalniane naraz
+///  - Wywołanie w pętli używa tego samego bloku — bez alloc/dealloc
 ///  - Env dla areny jest izolowany — bez kopiowania zmiennych rodzica
 fn exec_arena_func_call(name: &str, args: &[StringPart], env: &mut Env) -> Result<ExecResult> {
     // Pobierz definicję areny
@@ -617,12 +797,11 @@ fn exec_arena_func_call(name: &str, args: &[StringPart], env: &mut Env) -> Resul
     // Rozwiąż argumenty przed wejściem do areny
     let resolved_args = env.resolve_string_parts(args);
 
-    // Utwórz arenę
-    let arena_ctx = ArenaContext::new(arena_size.bytes());
+    // Arena musi przeżyć arena_env — deklarowana pierwsza, dropowana ostatnia
+    let mut arena_ctx = ArenaContext::new(arena_size.bytes());
 
-    // Utwórz izolowane środowisko dla arena function
-    // Zmienne rodzica są dostępne przez kopiowanie (shallow clone)
-    let mut arena_env = Env::new_with_parent(env);
+    // SAFETY: arena_ctx żyje do końca funkcji; finish_arena_call odpina wartości
+    let mut arena_env = unsafe { Env::new_arena_call(env, &mut arena_ctx) };
     arena_env.set_var("_arena_args", Value::String(resolved_args));
     arena_env.set_var("_arena_name", Value::String(name.to_string()));
     arena_env.set_var("_arena_size", Value::Number(arena_size.bytes() as f64));
@@ -630,24 +809,11 @@ fn exec_arena_func_call(name: &str, args: &[StringPart], env: &mut Env) -> Resul
     // Wykonaj ciało areny
     let result = exec_nodes(&body, &mut arena_env)?;
 
-    // Propaguj zmienne z powrotem do rodzica (tylko te które zmieniła arena)
-    // (zmienne lokalne areny są porzucane razem z arena_env)
-    for (k, v) in &arena_env.vars {
-        if !k.starts_with("_arena_") {
-            env.vars.insert(k.clone(), v.clone());
-        }
-    }
-    env.last_exit = arena_env.last_exit;
-
-    // Log statystyk w trybie debug
-    if tracing::enabled!(tracing::Level::DEBUG) {
-        let stats = arena_ctx.stats();
-        tracing::debug!("[arena] ::{}  {}", name, stats);
-    }
-
-    // Drop arena_ctx → jeden dealloc bloku areny
-    drop(arena_ctx);
+    // Propaguj zmienne z powrotem do rodzica (kopie z areny na heap)
+    arena_env.finish_arena_call(env);
+    arena::record(name, &arena_ctx.stats());
 
+    // Drop arena_ctx → reset() i blok wraca do puli
     Ok(result)
 }
 
@@ -662,15 +828,10 @@ fn eval_var_value(value: &VarValue, env: &mut Env) -> Result<Value> {
        VarValue::Bool(b)         => Value::Bool(*b),
        VarValue::Interpolated(p) => Value::String(env.resolve_string_parts(p)),
        VarValue::CmdOutput(cmd)  => {
-           let r = run_command(cmd, false, false, true, env, true)?;
+           let r = run_command(cmd, false, false, env, true)?;
            Value::String(r.stdout.unwrap_or_default().trim().to_string())
        }
-       VarValue::Arithmetic(expr) => {
-           let expanded = env.interpolate(expr);
-           let result = eval_arithmetic_fast(&expanded)
-           .unwrap_or_else(|| eval_arithmetic_shell(&expanded));
-           Value::String(result)
-       }
+       VarValue::Arithmetic(expr, parsed) => Value::String(eval_arith(expr, parsed.as_ref(), env)?),
        VarValue::List(items) => {
            Value::List(items.iter().map(|v| match v {
                VarValue::String(s) => Value::String(s.clone()),
@@ -685,168 +846,152 @@ fn eval_var_value(value: &VarValue, env: &mut Env) -> Result<Value> {
     })
 }
 
-// ── Arytmetyka natywna ────────────────────────────────────────────────────────
+// ── Wyrażenia (`hl_parser::expr`) ────────────────────────────────────────────
 
-pub fn eval_arithmetic_fast(expr: &str) -> Option<String> {
-    let e = expr.trim();
-    if e.is_empty() { return Some("0".to_string()); }
-    match eval_expr(e) {
-        Some(v) => {
-            if v.fract() == 0.0 && v.abs() < 1e15 {
-                Some(format!("{}", v as i64))
-            } else {
-                Some(format!("{}", v))
-            }
-        }
-        None => None,
-    }
+/// `$( ... )`: drzewo z parsera; tekst spoza gramatyki po interpolacji
+/// parsujemy jeszcze raz — nadal poza gramatyką to błąd, nie `sh`
+fn eval_arith(src: &str, parsed: Option<&Expr>, env: &mut Env) -> Result<String> {
+    if let Some(e) = parsed { return Ok(format_num(eval_num(e, env))); }
+    let expanded = env.interpolate(src);
+    if expanded.trim().is_empty() { return Ok("0".to_string()); }
+    let e = expect_arith(&expanded)?;
+    Ok(format_num(eval_num(&e, env)))
 }
 
-fn eval_expr(s: &str) -> Option<f64> {
-    let s = s.trim();
-    eval_additive(s)
+fn format_num(v: f64) -> String {
+    if v.fract() == 0.0 && v.abs() < 1e15 { format!("{}", v as i64) } else { format!("{}", v) }
 }
 
-fn eval_additive(s: &str) -> Option<f64> {
-    let bytes = s.as_bytes();
-    let mut depth = 0i32;
-    let mut last_add = None;
-    let mut last_sub = None;
-    for i in (0..bytes.len()).rev() {
-        match bytes[i] {
-            b')' => depth += 1,
-            b'(' => depth -= 1,
-            b'+' if depth == 0 && i > 0 => { last_add = Some(i); break; }
-            b'-' if depth == 0 && i > 0 && bytes[i-1] != b'*' && bytes[i-1] != b'/' => {
-                last_sub = Some(i); break;
-            }
-            _ => {}
-        }
-    }
-    let split_at = match (last_add, last_sub) {
-        (Some(a), Some(b)) => Some(if a > b { (a, '+') } else { (b, '-') }),
-        (Some(a), None)    => Some((a, '+')),
-        (None, Some(b))    => Some((b, '-')),
-        _                  => None,
-    };
-    if let Some((pos, op)) = split_at {
-        let left  = eval_multiplicative(s[..pos].trim())?;
-        let right = eval_multiplicative(s[pos+1..].trim())?;
-        return Some(if op == '+' { left + right } else { left - right });
-    }
-    eval_multiplicative(s)
+/// Warunek: wartość wyrażenia w sensie `Value::is_truthy`
+pub fn eval_cond(e: &Expr, env: &mut Env) -> bool {
+    eval_expr(e, env).is_truthy()
 }
 
-fn eval_multiplicative(s: &str) -> Option<f64> {
-    let bytes = s.as_bytes();
-    let mut depth = 0i32;
-    let mut split = None;
-    for i in (0..bytes.len()).rev() {
-        match bytes[i] {
-            b')' => depth += 1,
-            b'(' => depth -= 1,
-            b'*' if depth == 0 && i + 1 < bytes.len() && bytes[i+1] != b'*' => {
-                split = Some((i, '*')); break;
-            }
-            b'/' if depth == 0 => { split = Some((i, '/')); break; }
-            b'%' if depth == 0 => { split = Some((i, '%')); break; }
-            _ => {}
-        }
-    }
-    if let Some((pos, op)) = split {
-        let left  = eval_unary(s[..pos].trim())?;
-        let right = eval_unary(s[pos+1..].trim())?;
-        return Some(match op {
-            '*' => left * right,
-            '/' => if right == 0.0 { 0.0 } else { left / right },
-            '%' => if right == 0.0 { 0.0 } else { (left as i64 % right as i64) as f64 },
-                    _   => 0.0,
-        });
+fn eval_num(e: &Expr, env: &mut Env) -> f64 {
+    match e {
+        Expr::Num(n) => *n,
+        _            => eval_expr(e, env).as_f64(),
     }
-    eval_unary(s)
-}
-
-fn eval_unary(s: &str) -> Option<f64> {
-    let s = s.trim();
-    if s.starts_with('-') { return Some(-eval_atom(s[1..].trim())?); }
-    eval_atom(s)
 }
 
-fn eval_atom(s: &str) -> Option<f64> {
-    let s = s.trim();
-    if s.is_empty() { return None; }
-    if s.starts_with('(') && s.ends_with(')') {
-        return eval_expr(&s[1..s.len()-1]);
+fn eval_expr(e: &Expr, env: &mut Env) -> Value {
+    match e {
+        Expr::Num(n)  => Value::Number(*n),
+        Expr::Bool(b) => Value::Bool(*b),
+        Expr::Str(parts) => match parts.as_slice() {
+            // Sama zmienna — bez sklejania stringa, liczba zostaje liczbą
+            [StringPart::Var(v)] => match env.get_slot(*v) {
+                Some(val) => val.clone(),
+                None      => Value::String(std::env::var(v.as_str()).unwrap_or_default()),
+            },
+            _ => Value::String(env.resolve_string_parts(parts)),
+        },
+        Expr::Unary { op: UnOp::Neg, arg } => Value::Number(-eval_num(arg, env)),
+        Expr::Unary { op: UnOp::Not, arg } => Value::Bool(!eval_cond(arg, env)),
+        Expr::Test { op, arg } => {
+            let s = eval_expr(arg, env);
+            Value::Bool(eval_test(*op, &s.to_string_val()))
+        }
+        Expr::Binary { op, lhs, rhs } => match op {
+            BinOp::And => Value::Bool(eval_cond(lhs, env) && eval_cond(rhs, env)),
+            BinOp::Or  => Value::Bool(eval_cond(lhs, env) || eval_cond(rhs, env)),
+            BinOp::Eq | BinOp::Ne => {
+                let (a, b) = (eval_expr(lhs, env), eval_expr(rhs, env));
+                let eq = match (&a, &b) {
+                    (Value::Number(x), Value::Number(y)) => x == y,
+                    _ => a.to_string_val() == b.to_string_val(),
+                };
+                Value::Bool(eq == (*op == BinOp::Eq))
+            }
+            _ => {
+                let (a, b) = (eval_num(lhs, env), eval_num(rhs, env));
+                match op {
+                    BinOp::Lt  => Value::Bool(a <  b),
+                    BinOp::Le  => Value::Bool(a <= b),
+                    BinOp::Gt  => Value::Bool(a >  b),
+                    BinOp::Ge  => Value::Bool(a >= b),
+                    BinOp::Add => Value::Number(a + b),
+                    BinOp::Sub => Value::Number(a - b),
+                    BinOp::Mul => Value::Number(a * b),
+                    BinOp::Div => Value::Number(if b == 0.0 { 0.0 } else { a / b }),
+                    _          => Value::Number(if b as i64 == 0 { 0.0 } else { (a as i64 % b as i64) as f64 }),
+                }
+            }
+        },
     }
-    if let Ok(n) = s.parse::<f64>() { return Some(n); }
-    None
 }
 
-fn eval_arithmetic_shell(expr: &str) -> String {
-    let sh_expr = format!("echo $(( {} ))", expr);
-    if let Ok(out) = Command::new("sh").args(["-c", &sh_expr]).output() {
-        if out.status.success() {
-            let s = String::from_utf8_lossy(&out.stdout).trim().to_string();
-            if !s.is_empty() && s != "0" || expr.trim() == "0" { return s; }
-        }
+/// `-z`/`-n` i testy plików bez procesu `test` — wspólne dla executora,
+/// wbudowanego `test`/`[` i interpretera bytecode
+pub fn eval_test(op: TestOp, s: &str) -> bool {
+    match op {
+        TestOp::Empty       => s.is_empty(),
+        TestOp::NonEmpty    => !s.is_empty(),
+        TestOp::Exists      => std::fs::metadata(s).is_ok(),
+        TestOp::File        => std::fs::metadata(s).is_ok_and(|m| m.is_file()),
+        TestOp::Dir         => std::fs::metadata(s).is_ok_and(|m| m.is_dir()),
+        TestOp::Symlink     => std::fs::symlink_metadata(s).is_ok_and(|m| m.file_type().is_symlink()),
+        TestOp::NonZeroSize => std::fs::metadata(s).is_ok_and(|m| m.len() > 0),
+        TestOp::Readable    => access(s, libc::R_OK),
+        TestOp::Writable    => access(s, libc::W_OK),
+        TestOp::Executable  => access(s, libc::X_OK),
     }
-    "0".to_string()
 }
 
-// ── Warunek while ─────────────────────────────────────────────────────────────
-
-fn eval_condition_fast(cond: &str, env: &mut Env) -> Result<bool> {
-    let cond = env.interpolate(cond);
-    let cond = cond.trim();
-    if cond.is_empty() { return Ok(false); }
-    if cond == "true"  { return Ok(true);  }
-    if cond == "false" { return Ok(false); }
+fn access(path: &str, mode: libc::c_int) -> bool {
+    let Ok(c) = std::ffi::CString::new(path) else { return false };
+    // SAFETY: c to poprawny napis zakończony zerem
+    unsafe { libc::access(c.as_ptr(), mode) == 0 }
+}
 
-    const OPS: &[&str] = &["==", "!=", ">=", "<=", ">", "<"];
-    for op in OPS {
-        if let Some(pos) = find_operator(cond, op) {
-            let left_raw  = cond[..pos].trim();
-            let right_raw = cond[pos + op.len()..].trim().trim_matches('"');
-            let lv = if left_raw.starts_with('@') {
-                env.get_var(&left_raw[1..]).to_string_val()
-            } else {
-                left_raw.to_string()
-            };
-            return Ok(match *op {
-                "==" => lv == right_raw,
-                "!=" => lv != right_raw,
-                ">=" => lv.parse::<f64>().unwrap_or(0.0) >= right_raw.parse::<f64>().unwrap_or(0.0),
-                      "<=" => lv.parse::<f64>().unwrap_or(0.0) <= right_raw.parse::<f64>().unwrap_or(0.0),
-                      ">"  => lv.parse::<f64>().unwrap_or(0.0) >  right_raw.parse::<f64>().unwrap_or(0.0),
-                      "<"  => lv.parse::<f64>().unwrap_or(0.0) <  right_raw.parse::<f64>().unwrap_or(0.0),
-                      _    => false,
-            });
-        }
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use hl_parser::expr::{parse_arith, parse_condition};
+
+    #[test]
+    fn test_cmd_template_matches_shell_words() {
+        let mut env = Env::new();
+        env.set_var("tpl_ab", Value::String("a b".into()));
+        env.set_var("tpl_e",  Value::String(String::new()));
+        env.set_var("tpl_sc", Value::String("x;y".into()));
+        env.set_var("tpl_i",  Value::String("7".into()));
+        let lines = [
+            "touch /tmp/f@tpl_i", "touch \"@tpl_ab\" ''", "cp @tpl_e dst", "ls '@tpl_e' z",
+            "  grep -n \"x @tpl_i\"\t@tpl_i  ", "ls @tpl_ab", "rm @tpl_sc", "ls *.rs",
+            "exit @tpl_i", "test -n @tpl_e", "@tpl_i", "echo \"open", "a'b'c\"@tpl_ab\"",
+        ];
+        let mut direct = 0;
+        for raw in lines {
+            let expanded = env.interpolate(raw);
+            let Some(argv) = CmdTpl::compile(raw).argv(&mut env) else { continue };
+            direct += 1;
+            assert!(!needs_shell(expanded.trim()), "{}", raw);
+            assert_eq!(argv, shell_words(expanded.trim()), "{}", raw);
+        }
+        assert_eq!(direct, 7);
+        // Wartość ze spacją poza cudzysłowem i komendy wbudowane idą ścieżką ogólną
+        assert!(CmdTpl::compile("ls @tpl_ab").argv(&mut env).is_none());
+        assert!(CmdTpl::compile("exit @tpl_i").argv(&mut env).is_none());
     }
 
-    if cond.starts_with('@') {
-        let val = env.get_var(&cond[1..]).to_string_val();
-        return Ok(!val.is_empty() && val != "false" && val != "0");
+    #[test]
+    fn test_expr_conditions_and_arith() {
+        let mut env = Env::new();
+        env.set_var("ex_i", Value::Number(4.0));
+        env.set_var("ex_s", Value::String("running".into()));
+        env.set_var("ex_n", Value::String("12".into()));
+        let cond = |src: &str, env: &mut Env| eval_cond(&parse_condition(src).unwrap(), env);
+        assert!(cond("@ex_i < 10 && @ex_s == running", &mut env));
+        assert!(cond("@ex_i + 8 == @ex_n", &mut env));
+        assert!(!cond("@ex_n < 9 || !@ex_s", &mut env));
+        assert!(cond("-z @ex_nope && -n \"@ex_s\"", &mut env));
+        assert!(cond("[ -d /tmp ] ", &mut env) && !cond("-f /tmp", &mut env));
+        assert_eq!(eval_arith("@ex_i * (@ex_n - 2) % 7", parse_arith("@ex_i * (@ex_n - 2) % 7").as_ref(), &mut env).unwrap(), "5");
+        assert_eq!(eval_arith("@ex_n / 8", None, &mut env).unwrap(), "1.5");
+        assert_eq!(eval_arith("7 / 0", None, &mut env).unwrap(), "0");
+        // Poza gramatyką także po interpolacji — błąd zamiast `sh -c`
+        env.set_var("ex_op", Value::String("**".into()));
+        assert!(eval_arith("@ex_i @ex_op 2", None, &mut env).is_err());
     }
-
-    Ok(Command::new("sh").args(["-c", cond]).status().map(|s| s.success()).unwrap_or(false))
-}
-
-fn find_operator(s: &str, op: &str) -> Option<usize> {
-    let b = s.as_bytes();
-    let op_b = op.as_bytes();
-    let op_len = op_b.len();
-    let mut i = 0;
-    while i + op_len <= b.len() {
-        if &b[i..i+op_len] == op_b {
-            let ok = match op {
-                ">" => i + 1 >= b.len() || b[i+1] != b'=',
-                "<" => i + 1 >= b.len() || b[i+1] != b'=',
-                _   => true,
-            };
-            if ok { return Some(i); }
-        }
-        i += 1;
-    }
-    None
 }
@@ -0,0 +1,566 @@
+//! Ciepłe workery dla bloków extern python / java
+//!
+//! Domyślnie każdy blok `_> python` / `_> java` startuje nowy interpreter —
+//! przy JVM to setki milisekund na wywołanie. Po włączeniu w config.hk
+//!
+//! ```text
+//! [extern]
+//! workers      = true
+//! pool_size    = 2     ; najwyżej tyle workerów na runtime
+//! idle_timeout = 60    ; sekundy bezczynności, po których worker jest zamykany
+//! ```
+//!
+//! skrypt jest wykonywany przez długo żyjący proces-worker. stdin/stdout/stderr
+//! workera są dziedziczone jak przy zwykłym uruchomieniu, a żądania idą
+//! osobnymi potokami na fd 3 (żądania) i fd 4 (odpowiedzi), w ramkach
+//! `u32 LE długość + treść`:
+//!
+//!  - żądanie: pola rozdzielone NUL — `plik, cwd, argc, argv..., envc, K=V...`,
+//!  - odpowiedź: `i32 LE` kod wyjścia.
+//!
+//! Po starcie worker wysyła ramkę powitalną `HLW1`. Semantyka jak przy
+//! osobnym procesie: `sys.exit(n)` / wyjątek → kod n / 1, wyjście skryptu
+//! idzie prosto na terminal (`stdout: None`). Jeśli skrypt zabije worker
+//! (`os._exit`, `System.exit`), kod wyjścia bierzemy z zakończonego procesu,
+//! a worker nie wraca do puli.
+//!
+//! Środowisko workera to środowisko hl z chwili jego startu; żądanie niesie
+//! tylko `_env_*` bloku. Po każdej zmianie środowiska procesu (generacja z
+//! [`crate::spawn::env_generation`]) bezczynne workery są zamykane, a następne
+//! wywołanie startuje nowy — tak jak osobny proces widzi bieżące envp.
+//!
+//! Gdy pula jest pełna, worker nie wstaje albo żądania nie da się obsłużyć
+//! w workerze (java z `_env_*` albo innym cwd niż przy starcie JVM), wołający
+//! dostaje None i uruchamia osobny proces jak dotychczas.
+
+use anyhow::{bail, Result};
+use rustc_hash::FxHashMap;
+use std::fs::File;
+use std::io::{Read, Write};
+use std::os::unix::io::FromRawFd;
+use std::os::unix::process::CommandExt;
+use std::path::PathBuf;
+use std::process::{Child, Command, Stdio};
+use std::sync::{Mutex, OnceLock};
+use std::time::{Duration, Instant};
+
+use crate::executor::ExecResult;
+
+/// Ramka powitalna workera
+pub const HELLO: &[u8; 4] = b"HLW1";
+
+/// Fd żądań / odpowiedzi po stronie workera
+const REQ_FD:  i32 = 3;
+const RESP_FD: i32 = 4;
+
+/// Czas na wyjście workera po zamknięciu potoku żądań, potem SIGKILL
+const RETIRE_GRACE: Duration = Duration::from_millis(500);
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum Kind {
+    Python,
+    Java,
+}
+
+/// Ustawienia puli (z sekcji `[extern]` config.hk)
+#[derive(Debug, Clone, Copy)]
+pub struct PoolConfig {
+    pub size: usize,
+    pub idle: Duration,
+}
+
+struct Worker {
+    child:     Child,
+    req:       File,
+    resp:      File,
+    cwd:       PathBuf,
+    /// Generacja środowiska, z którym worker wystartował
+    env_gen:   u64,
+    last_used: Instant,
+}
+
+#[derive(Default)]
+struct Pool {
+    idle: Vec<Worker>,
+    busy: usize,
+    /// Worker nie wstał (np. JRE bez kompilatora dla `java Plik.java`) —
+    /// nie próbujemy ponownie w tym procesie
+    broken: bool,
+}
+
+type Key = (Kind, String);
+
+fn pools() -> &'static Mutex<FxHashMap<Key, Pool>> {
+    static POOLS: OnceLock<Mutex<FxHashMap<Key, Pool>>> = OnceLock::new();
+    POOLS.get_or_init(|| Mutex::new(FxHashMap::default()))
+}
+
+/// Wykonaj skrypt w ciepłym workerze. None — wykonaj osobnym procesem.
+pub fn run(
+    kind:      Kind,
+    cmd:       &str,
+    cfg:       PoolConfig,
+    file:      &str,
+    args:      &[String],
+    extra_env: &[(String, String)],
+) -> Result<Option<ExecResult>> {
+    if file.is_empty() || cfg.size == 0 { return Ok(None); }
+    let cwd = std::env::current_dir()?;
+    // JVM nie zmieni swojego środowiska ani katalogu roboczego
+    if kind == Kind::Java && !extra_env.is_empty() { return Ok(None); }
+
+    let key: Key = (kind, cmd.to_string());
+    let Some(mut worker) = acquire(&key, cfg, &cwd) else { return Ok(None) };
+
+    let frame = encode_request(file, &cwd, args, extra_env);
+    let reply = write_frame(&mut worker.req, &frame).and_then(|_| read_frame(&mut worker.resp));
+
+    let exit_code = match reply {
+        Ok(body) if body.len() == 4 => i32::from_le_bytes([body[0], body[1], body[2], body[3]]),
+        _ => {
+            // Skrypt zakończył proces workera — jego kod to kod skryptu
+            drop(worker.req);
+            let code = worker.child.wait().ok().and_then(|s| s.code()).unwrap_or(1);
+            release(&key, cfg, None);
+            return Ok(Some(ExecResult { exit_code: code, stdout: None }));
+        }
+    };
+    worker.last_used = Instant::now();
+    release(&key, cfg, Some(worker));
+    Ok(Some(ExecResult { exit_code, stdout: None }))
+}
+
+/// Liczba bezczynnych workerów (diagnostyka, testy)
+pub fn idle_count(kind: Kind, cmd: &str) -> usize {
+    pools().lock().unwrap().get(&(kind, cmd.to_string())).map_or(0, |p| p.idle.len())
+}
+
+/// Zamknij wszystkie bezczynne workery
+pub fn shutdown() {
+    let retired: Vec<Worker> = pools().lock().unwrap()
+        .values_mut()
+        .flat_map(|pool| pool.idle.drain(..))
+        .collect();
+    retired.into_iter().for_each(retire);
+}
+
+fn acquire(key: &Key, cfg: PoolConfig, cwd: &PathBuf) -> Option<Worker> {
+    let mut retired = Vec::new();
+    let reused = {
+        let mut pools = pools().lock().unwrap();
+        let pool = pools.entry(key.clone()).or_default();
+        if pool.broken { return None; }
+        retired.extend(reap(pool, cfg.idle));
+        // Środowisko zmieniło się od startu workera — nie zobaczy nowych zmiennych
+        let gen = crate::spawn::env_generation();
+        let (fresh, stale): (Vec<_>, Vec<_>) = pool.idle.drain(..).partition(|w| w.env_gen == gen);
+        pool.idle = fresh;
+        retired.extend(stale);
+
+        // JVM ma cwd z chwili startu — bierzemy tylko pasujący worker
+        let pos = match key.0 {
+            Kind::Python => pool.idle.len().checked_sub(1),
+            Kind::Java   => pool.idle.iter().rposition(|w| &w.cwd == cwd),
+        };
+        if let Some(i) = pos {
+            pool.busy += 1;
+            Some(Some(pool.idle.swap_remove(i)))
+        } else if pool.busy + pool.idle.len() >= cfg.size {
+            match pool.idle.iter().position(|w| &w.cwd != cwd) {
+                // Zwolnij miejsce po workerze z innym cwd
+                Some(i) => {
+                    retired.push(pool.idle.swap_remove(i));
+                    pool.busy += 1;
+                    None
+                }
+                None => Some(None),
+            }
+        } else {
+            pool.busy += 1;
+            None
+        }
+    };
+    // Czekanie na zamykane workery poza blokadą — nie wstrzymuje innych wątków
+    retired.into_iter().for_each(retire);
+    if let Some(w) = reused { return w; }
+    // Start workera poza blokadą — JVM wstaje długo
+    match spawn(key.0, &key.1, cwd) {
+        Ok(w) => Some(w),
+        Err(e) => {
+            tracing::debug!("[extern pool] worker {:?} nie wstał: {}", key.0, e);
+            let mut pools = pools().lock().unwrap();
+            let pool = pools.entry(key.clone()).or_default();
+            pool.busy -= 1;
+            pool.broken = true;
+            None
+        }
+    }
+}
+
+fn release(key: &Key, cfg: PoolConfig, worker: Option<Worker>) {
+    let mut pools = pools().lock().unwrap();
+    let pool = pools.entry(key.clone()).or_default();
+    pool.busy = pool.busy.saturating_sub(1);
+    let mut retired = reap(pool, cfg.idle);
+    if let Some(w) = worker {
+        if pool.busy + pool.idle.len() < cfg.size { pool.idle.push(w); } else { retired.push(w); }
+    }
+    drop(pools);
+    retired.into_iter().for_each(retire);
+    start_reaper(cfg.idle);
+}
+
+/// Wyjmij z puli workery bezczynne dłużej niż `idle` — do [`retire`] po
+/// zwolnieniu blokady
+fn reap(pool: &mut Pool, idle: Duration) -> Vec<Worker> {
+    let now = Instant::now();
+    let (keep, old): (Vec<_>, Vec<_>) = pool.idle.drain(..)
+        .partition(|w| now.duration_since(w.last_used) < idle);
+    pool.idle = keep;
+    old
+}
+
+/// Wątek sprzątający — workery nie czekają na kolejne wywołanie z timeoutem
+fn start_reaper(idle: Duration) {
+    static STARTED: OnceLock<()> = OnceLock::new();
+    STARTED.get_or_init(|| {
+        let tick = (idle / 2).max(Duration::from_millis(100));
+        std::thread::Builder::new()
+            .name("hl-extern-reaper".into())
+            .spawn(move || loop {
+                std::thread::sleep(tick);
+                let retired: Vec<Worker> = pools().lock().unwrap()
+                    .values_mut()
+                    .flat_map(|pool| reap(pool, idle))
+                    .collect();
+                retired.into_iter().for_each(retire);
+            })
+            .ok();
+    });
+}
+
+/// Zamknięcie potoku żądań kończy pętlę workera; worker, który nie wyjdzie
+/// w [`RETIRE_GRACE`] (np. wątek skryptu bez daemon), dostaje SIGKILL.
+/// Nie wołać pod blokadą `pools()`.
+fn retire(mut w: Worker) {
+    drop(w.req);
+    let deadline = Instant::now() + RETIRE_GRACE;
+    while Instant::now() < deadline {
+        if !matches!(w.child.try_wait(), Ok(None)) { return; }
+        std::thread::sleep(Duration::from_millis(10));
+    }
+    let _ = w.child.kill();
+    let _ = w.child.wait();
+}
+
+// ── Start workera ────────────────────────────────────────────────────────────
+
+fn spawn(kind: Kind, cmd: &str, cwd: &PathBuf) -> Result<Worker> {
+    // Przed startem: zmiana w trakcie spawn da co najwyżej zbędny restart
+    let env_gen = crate::spawn::env_generation();
+    let (req_r, req_w)   = pipe()?;
+    let (resp_r, resp_w) = pipe()?;
+
+    let mut command = Command::new(cmd);
+    match kind {
+        Kind::Python => { command.arg("-u").arg("-c").arg(PY_WORKER); }
+        Kind::Java   => { command.arg(java_worker_source()?); }
+    }
+    command.current_dir(cwd)
+        .stdin(Stdio::inherit())
+        .stdout(Stdio::inherit())
+        .stderr(Stdio::inherit());
+
+    let (child_r, child_w) = (req_r, resp_w);
+    // SAFETY: między fork a exec tylko fcntl/dup2 (async-signal-safe).
+    // Najpierw kopie powyżej 10, bo końce potoków mogą same być fd 3/4.
+    unsafe {
+        command.pre_exec(move || {
+            let r = libc::fcntl(child_r, libc::F_DUPFD, 10);
+            let w = libc::fcntl(child_w, libc::F_DUPFD, 10);
+            if r < 0 || w < 0
+                || libc::dup2(r, REQ_FD) < 0
+                || libc::dup2(w, RESP_FD) < 0 {
+                return Err(std::io::Error::last_os_error());
+            }
+            libc::close(r);
+            libc::close(w);
+            Ok(())
+        });
+    }
+    let spawned = command.spawn();
+    // Końce potomka zamykamy u siebie, żeby EOF docierał po śmierci workera
+    unsafe { libc::close(req_r); libc::close(resp_w); }
+    let child = spawned?;
+
+    // SAFETY: fd z pipe2, jedyni właściciele
+    let req  = unsafe { File::from_raw_fd(req_w) };
+    let resp = unsafe { File::from_raw_fd(resp_r) };
+    let mut w = Worker { child, req, resp, cwd: cwd.clone(), env_gen, last_used: Instant::now() };
+
+    match read_frame(&mut w.resp) {
+        Ok(hello) if hello == HELLO => Ok(w),
+        _ => {
+            let _ = w.child.kill();
+            retire(w);
+            bail!("brak ramki powitalnej")
+        }
+    }
+}
+
+fn pipe() -> Result<(i32, i32)> {
+    let mut fds = [0i32; 2];
+    if unsafe { libc::pipe2(fds.as_mut_ptr(), libc::O_CLOEXEC) } != 0 {
+        bail!("pipe2: {}", std::io::Error::last_os_error());
+    }
+    Ok((fds[0], fds[1]))
+}
+
+/// Źródło workera JVM w cache (`java Plik.java` — tryb single-file, JDK 11+)
+fn java_worker_source() -> Result<PathBuf> {
+    let path = crate::libs::hl_cache_dir().join("extern").join("HlWorker.java");
+    if std::fs::read_to_string(&path).ok().as_deref() != Some(JAVA_WORKER) {
+        std::fs::create_dir_all(path.parent().unwrap())?;
+        std::fs::write(&path, JAVA_WORKER)?;
+    }
+    Ok(path)
+}
+
+// ── Ramki ────────────────────────────────────────────────────────────────────
+
+fn encode_request(file: &str, cwd: &std::path::Path, args: &[String], env: &[(String, String)]) -> Vec<u8> {
+    let mut fields: Vec<String> = Vec::with_capacity(4 + args.len() + env.len());
+    fields.push(file.to_string());
+    fields.push(cwd.to_string_lossy().into_owned());
+    fields.push(args.len().to_string());
+    fields.extend(args.iter().cloned());
+    fields.push(env.len().to_string());
+    fields.extend(env.iter().map(|(k, v)| format!("{}={}", k, v)));
+    // NUL nie przejdzie przez argv/env zwykłego procesu — tu też go usuwamy
+    fields.iter().map(|f| f.replace('\0', "")).collect::<Vec<_>>().join("\0").into_bytes()
+}
+
+fn write_frame(w: &mut impl Write, body: &[u8]) -> std::io::Result<()> {
+    let mut buf = Vec::with_capacity(4 + body.len());
+    buf.extend_from_slice(&(body.len() as u32).to_le_bytes());
+    buf.extend_from_slice(body);
+    w.write_all(&buf)
+}
+
+fn read_frame(r: &mut impl Read) -> std::io::Result<Vec<u8>> {
+    let mut len = [0u8; 4];
+    r.read_exact(&mut len)?;
+    let mut body = vec![0u8; u32::from_le_bytes(len) as usize];
+    r.read_exact(&mut body)?;
+    Ok(body)
+}
+
+// ── Workery ──────────────────────────────────────────────────────────────────
+
+const PY_WORKER: &str = r#"
+import os, sys, struct, runpy, traceback
+rq = os.fdopen(3, 'rb', buffering=0)
+rs = os.fdopen(4, 'wb', buffering=0)
+def read_exact(n):
+    b = b''
+    while len(b) < n:
+        c = rq.read(n - len(b))
+        if not c: return None
+        b += c
+    return b
+def send(body):
+    rs.write(struct.pack('<I', len(body)) + body)
+send(b'HLW1')
+while True:
+    h = read_exact(4)
+    if h is None: break
+    f = read_exact(struct.unpack('<I', h)[0]).decode('utf-8', 'surrogateescape').split('\0')
+    file, cwd, argc = f[0], f[1], int(f[2])
+    argv, envc = f[3:3 + argc], int(f[3 + argc])
+    env = dict(kv.split('=', 1) for kv in f[4 + argc:4 + argc + envc])
+    saved = (dict(os.environ), sys.argv, os.getcwd(), list(sys.path))
+    code = 0
+    try:
+        os.environ.update(env)
+        os.chdir(cwd)
+        sys.argv = [file] + argv
+        sys.path.insert(0, os.path.dirname(os.path.abspath(file)))
+        runpy.run_path(file, run_name='__main__')
+    except SystemExit as e:
+        if e.code is None: code = 0
+        elif isinstance(e.code, int): code = e.code & 0xff
+        else:
+            print(e.code, file=sys.stderr)
+            code = 1
+    except BaseException as e:
+        # Traceback od ramki skryptu — bez ramek workera i runpy
+        tb = e.__traceback__
+        while tb is not None and tb.tb_frame.f_code.co_filename != file: tb = tb.tb_next
+        traceback.print_exception(type(e), e, tb or e.__traceback__)
+        code = 1
+    finally:
+        sys.stdout.flush(); sys.stderr.flush()
+        os.environ.clear(); os.environ.update(saved[0])
+        sys.argv = saved[1]; os.chdir(saved[2]); sys.path[:] = saved[3]
+    send(struct.pack('<i', code))
+"#;
+
+const JAVA_WORKER: &str = r#"import java.io.*;
+import java.lang.reflect.*;
+import java.net.*;
+import java.nio.*;
+import java.nio.charset.StandardCharsets;
+import java.util.*;
+import java.util.jar.*;
+
+public class HlWorker {
+    public static void main(String[] a) throws Exception {
+        DataInputStream in = new DataInputStream(new FileInputStream("/proc/self/fd/3"));
+        OutputStream out = new FileOutputStream("/proc/self/fd/4");
+        send(out, "HLW1".getBytes(StandardCharsets.UTF_8));
+        while (true) {
+            byte[] h = new byte[4];
+            try { in.readFully(h); } catch (EOFException e) { return; }
+            byte[] body = new byte[ByteBuffer.wrap(h).order(ByteOrder.LITTLE_ENDIAN).getInt()];
+            in.readFully(body);
+            String[] f = new String(body, StandardCharsets.UTF_8).split("\0", -1);
+            int argc = Integer.parseInt(f[2]);
+            int code = run(f[0], f[1], Arrays.copyOfRange(f, 3, 3 + argc));
+            System.out.flush();
+            System.err.flush();
+            send(out, ByteBuffer.allocate(4).order(ByteOrder.LITTLE_ENDIAN).putInt(code).array());
+        }
+    }
+
+    static void send(OutputStream out, byte[] body) throws IOException {
+        out.write(ByteBuffer.allocate(4).order(ByteOrder.LITTLE_ENDIAN).putInt(body.length).array());
+        out.write(body);
+        out.flush();
+    }
+
+    static int run(String file, String cwd, String[] args) {
+        try {
+            URL cp;
+            String cls;
+            if (file.endsWith(".jar")) {
+                try (JarFile jar = new JarFile(file)) {
+                    cls = jar.getManifest().getMainAttributes().getValue("Main-Class");
+                }
+                cp = new File(file).toURI().toURL();
+            } else {
+                cls = file.endsWith(".class") ? file.substring(0, file.length() - 6) : file;
+                cp = new File(cwd).toURI().toURL();
+            }
+            // Nowy loader na wywołanie: statyczny stan klas skryptu jak w nowym procesie
+            try (URLClassLoader loader = new URLClassLoader(new URL[]{ cp }, HlWorker.class.getClassLoader().getParent())) {
+                Method m = Class.forName(cls, true, loader).getMethod("main", String[].class);
+                m.invoke(null, (Object) args);
+            }
+            return 0;
+        } catch (InvocationTargetException e) {
+            e.getCause().printStackTrace();
+            return 1;
+        } catch (Throwable e) {
+            e.printStackTrace();
+            return 1;
+        }
+    }
+}
+"#;
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_request_encoding() {
+        let env = vec![("K".to_string(), "v=1".to_string())];
+        let body = encode_request("a.py", std::path::Path::new("/tmp"), &["x".into(), "y\0z".into()], &env);
+        let fields: Vec<&[u8]> = body.split(|b| *b == 0).collect();
+        assert_eq!(fields, [&b"a.py"[..], b"/tmp", b"2", b"x", b"yz", b"1", b"K=v=1"]);
+    }
+
+    #[test]
+    fn test_frame_roundtrip() {
+        let mut buf = Vec::new();
+        write_frame(&mut buf, b"abc").unwrap();
+        assert_eq!(&buf[..4], &3u32.to_le_bytes());
+        assert_eq!(read_frame(&mut &buf[..]).unwrap(), b"abc");
+        assert!(read_frame(&mut &buf[..5]).is_err());
+    }
+
+    #[test]
+    fn test_python_worker_reused() {
+        if which::which("python3").is_err() { return; }
+        let dir = std::env::temp_dir().join(format!("hl-pool-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let ok   = dir.join("ok.py");
+        let exit = dir.join("exit.py");
+        let kill = dir.join("kill.py");
+        std::fs::write(&ok, "import sys, os\nsys.exit(int(sys.argv[1]) + int(os.environ.get('HL_T', '0')))\n").unwrap();
+        std::fs::write(&exit, "raise RuntimeError('x')\n").unwrap();
+        std::fs::write(&kill, "import os\nos._exit(7)\n").unwrap();
+        let cfg = PoolConfig { size: 1, idle: Duration::from_secs(60) };
+        let run_py = |f: &PathBuf, args: &[&str], env: &[(String, String)]| {
+            let args: Vec<String> = args.iter().map(|s| s.to_string()).collect();
+            run(Kind::Python, "python3", cfg, f.to_str().unwrap(), &args, env).unwrap().unwrap().exit_code
+        };
+
+        assert_eq!(run_py(&ok, &["3"], &[]), 3);
+        assert_eq!(idle_count(Kind::Python, "python3"), 1);
+        assert_eq!(run_py(&ok, &["1"], &[("HL_T".into(), "4".into())]), 5);
+        // Środowisko nie przecieka do kolejnego żądania
+        assert_eq!(run_py(&ok, &["1"], &[]), 1);
+        assert_eq!(run_py(&exit, &[], &[]), 1);
+        assert_eq!(idle_count(Kind::Python, "python3"), 1);
+        // os._exit kończy worker: kod z procesu, worker poza pulą
+        assert_eq!(run_py(&kill, &[], &[]), 7);
+        assert_eq!(idle_count(Kind::Python, "python3"), 0);
+        assert_eq!(run_py(&ok, &["2"], &[]), 2);
+
+        shutdown();
+        assert_eq!(idle_count(Kind::Python, "python3"), 0);
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+
+    #[test]
+    fn test_worker_sees_env_changes() {
+        let Ok(py) = which::which("python3") else { return };
+        // Własna ścieżka interpretera — osobna pula od pozostałych testów
+        let py = py.to_str().unwrap().to_string();
+        let dir = std::env::temp_dir().join(format!("hl-pool-env-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let script = dir.join("env.py");
+        std::fs::write(&script, "import os, sys\nsys.exit(int(os.environ.get('HL_POOL_ENV_T', '0')))\n").unwrap();
+        let cfg = PoolConfig { size: 1, idle: Duration::from_secs(60) };
+        let run_py = || run(Kind::Python, &py, cfg, script.to_str().unwrap(), &[], &[]).unwrap().unwrap().exit_code;
+
+        assert_eq!(run_py(), 0);
+        crate::spawn::set_env("HL_POOL_ENV_T", "6");
+        assert_eq!(run_py(), 6);
+        crate::spawn::remove_env("HL_POOL_ENV_T");
+        assert_eq!(run_py(), 0);
+        assert_eq!(idle_count(Kind::Python, &py), 1);
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+
+    #[test]
+    fn test_retire_kills_stuck_worker() {
+        if which::which("python3").is_err() { return; }
+        let dir = std::env::temp_dir().join(format!("hl-pool-stuck-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        // Wątek bez daemon trzyma interpreter przy życiu po EOF na potoku żądań
+        let stuck = dir.join("stuck.py");
+        std::fs::write(&stuck, "import threading, time\nthreading.Thread(target=time.sleep, args=(600,)).start()\n").unwrap();
+
+        let mut w = spawn(Kind::Python, "python3", &dir).unwrap();
+        let frame = encode_request(stuck.to_str().unwrap(), &dir, &[], &[]);
+        write_frame(&mut w.req, &frame).unwrap();
+        assert_eq!(read_frame(&mut w.resp).unwrap(), 0i32.to_le_bytes());
+
+        let start = Instant::now();
+        retire(w);
+        assert!(start.elapsed() < RETIRE_GRACE + Duration::from_secs(5));
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+}
@@ -3,7 +3,9 @@ use std::process::{Command, Stdio};
 use hl_parser::ast::{Node, ExternRuntime};
 use crate::env::{Env, Value};
 use crate::executor::exec_nodes;
-use crate::config::load_config;
+use crate::config::{load_config, HlConfig};
+use crate::extern_pool::{self, Kind, PoolConfig};
+use crate::ffi::Arg;
 
 /// Wykonaj blok extern
 pub fn exec_extern_def(
@@ -17,20 +19,25 @@ pub fn exec_extern_def(
     //    Env vars: _env_KEY=VALUE
     exec_nodes(body, env)?;
 
-    // 2. Zbierz argumenty pozycyjne z env
-    let mut args: Vec<String> = Vec::new();
+    // 2. Zbierz argumenty pozycyjne z env (liczby zostają liczbami — typowane ABI `so`)
+    let mut vals: Vec<(String, Option<f64>)> = Vec::new();
     let mut i = 0usize;
     loop {
         let key = format!("_arg_{}", i);
-        let val = env.get_var(&key).to_string_val();
-        if val.is_empty() { break; }
-        args.push(val);
+        let v = env.get_var(&key);
+        let text = v.to_string_val();
+        if text.is_empty() { break; }
+        let num = match v { Value::Number(n) => Some(*n), _ => None };
+        vals.push((text, num));
         i += 1;
     }
+    let args: Vec<Arg> = vals.iter()
+        .map(|(t, n)| n.map_or(Arg::Str(t), Arg::Num))
+        .collect();
 
     // 3. Zbierz zmienne env (_env_KEY)
     let mut extra_env: Vec<(String, String)> = Vec::new();
-    for (k, v) in &env.vars {
+    for (k, v) in env.iter_vars() {
         if let Some(env_key) = k.strip_prefix("_env_") {
             extra_env.push((env_key.to_string(), v.to_string_val()));
         }
@@ -40,13 +47,7 @@ pub fn exec_extern_def(
     let resolved_path = resolve_extern_file(file, runtime, env);
 
     // 5. Uruchom odpowiedni runtime
-    let result = match runtime {
-        ExternRuntime::Shell  => run_shell(&resolved_path, &args, &extra_env),
-        ExternRuntime::Python => run_python(&resolved_path, &args, &extra_env),
-        ExternRuntime::Java   => run_java(&resolved_path, &args, &extra_env),
-        ExternRuntime::Elf    => run_elf(&resolved_path, &args, &extra_env),
-        ExternRuntime::So     => run_so(&resolved_path, &args, &extra_env),
-    }?;
+    let result = run_extern(runtime, &resolved_path, &args, &extra_env)?;
 
     // 6. Zapisz wynik do env
     env.set_var("_extern_result",   Value::String(result.stdout.clone().unwrap_or_default().trim().to_string()));
@@ -56,11 +57,34 @@ pub fn exec_extern_def(
     Ok(result)
 }
 
+/// Uruchom runtime z gotowymi argumentami — wspólne dla executora AST
+/// i interpretera bytecode (`__extern__:<runtime>:<plik>`)
+pub fn run_extern(
+    runtime:   &ExternRuntime,
+    file:      &str,
+    args:      &[Arg],
+    extra_env: &[(String, String)],
+) -> Result<crate::executor::ExecResult> {
+    let text = || args.iter().map(Arg::to_text).collect::<Vec<_>>();
+    match runtime {
+        ExternRuntime::Shell  => run_shell(file, &text(), extra_env),
+        ExternRuntime::Python => run_python(file, &text(), extra_env),
+        ExternRuntime::Java   => run_java(file, &text(), extra_env),
+        ExternRuntime::Elf    => run_elf(file, &text(), extra_env),
+        ExternRuntime::So     => run_so(file, args),
+    }
+}
+
 // ── Rozwiązywanie ścieżki ────────────────────────────────────────────────────
 
 fn resolve_extern_file(file: &str, runtime: &ExternRuntime, env: &mut Env) -> String {
     let expanded = env.interpolate(file);
+    locate_extern_file(expanded, runtime)
+}
 
+/// Ścieżka pliku extern po interpolacji: cwd, bit libs, PATH (elf),
+/// katalogi systemowe (so)
+pub fn locate_extern_file(expanded: String, runtime: &ExternRuntime) -> String {
     // Absolutna ścieżka — użyj bezpośrednio
     if expanded.starts_with('/') { return expanded; }
 
@@ -159,6 +183,10 @@ fn run_python(
         );
     }
 
+    if let Some(res) = pooled(&cfg, Kind::Python, &python, file, args, extra_env)? {
+        return Ok(res);
+    }
+
     let mut cmd = Command::new(&python);
     if !file.is_empty() { cmd.arg(file); }
     cmd.args(args);
@@ -174,6 +202,20 @@ fn run_python(
     })
 }
 
+/// Ciepły worker, jeśli włączony w config.hk; None — zwykły proces
+fn pooled(
+    cfg:       &HlConfig,
+    kind:      Kind,
+    cmd:       &str,
+    file:      &str,
+    args:      &[String],
+    extra_env: &[(String, String)],
+) -> Result<Option<crate::executor::ExecResult>> {
+    if !cfg.extern_workers() { return Ok(None); }
+    let pool = PoolConfig { size: cfg.extern_pool_size(), idle: cfg.extern_idle_timeout() };
+    extern_pool::run(kind, cmd, pool, file, args, extra_env)
+}
+
 // ── Java runtime ──────────────────────────────────────────────────────────────
 
 fn run_java(
@@ -193,6 +235,10 @@ fn run_java(
         );
     }
 
+    if let Some(res) = pooled(&cfg, Kind::Java, &java, file, args, extra_env)? {
+        return Ok(res);
+    }
+
     let mut cmd = Command::new(&java);
 
     if file.ends_with(".jar") {
@@ -254,91 +300,37 @@ fn run_elf(
 
 // ── .so runtime ───────────────────────────────────────────────────────────────
 //
-// Szuka symbolu "hl_extern_call" w bibliotece .so
-// Sygnatura: extern "C" fn hl_extern_call(argc: i32, argv: *const *const i8) -> i32
+// Uchwyt i symbole z cache procesu (`crate::ffi`) — dlopen tylko przy pierwszym
+// wywołaniu danej ścieżki. `hl_extern_typed` dostaje liczby i wycinki napisów
+// bez kopiowania, a jego wynik trafia do `_extern_result`; `hl_extern_call`
+// (argc/argv) jak dotąd.
+
+thread_local! {
+    /// Bufor wyniku typowanego wywołania, wielokrotnego użytku
+    static SO_OUT: std::cell::RefCell<Vec<u8>> = const { std::cell::RefCell::new(Vec::new()) };
+}
 
-fn run_so(
-    file:      &str,
-    args:      &[String],
-    _extra_env: &[(String, String)],
-) -> Result<crate::executor::ExecResult> {
+fn run_so(file: &str, args: &[Arg]) -> Result<crate::executor::ExecResult> {
     if file.is_empty() {
         bail!("[extern so] Brak nazwy biblioteki .so");
     }
 
-    if !std::path::Path::new(file).exists() {
-        bail!(
+    let lib = match crate::ffi::load(file) {
+        Ok(lib) => lib,
+        Err(_) if !std::path::Path::new(file).exists() => bail!(
             "[extern so] Biblioteka .so nie znaleziona: '{}'\n\
              Sprawdź ścieżkę lub zainstaluj przez bit.",
             file
-        );
-    }
-
-    // Załaduj .so przez dlopen (libloading)
-    // SAFETY: ładujemy symbol zgodnie z deklarowaną sygnaturą
-    #[cfg(target_os = "linux")]
-    {
-        use std::ffi::{CString, CStr};
-        use std::os::raw::{c_int, c_char};
-
-        extern "C" {
-            fn dlopen(filename: *const c_char, flag: c_int) -> *mut std::ffi::c_void;
-            fn dlsym(handle: *mut std::ffi::c_void, symbol: *const c_char) -> *mut std::ffi::c_void;
-            fn dlclose(handle: *mut std::ffi::c_void) -> c_int;
-            fn dlerror() -> *const c_char;
-        }
-
-        const RTLD_NOW: c_int   = 0x00002;
-        const RTLD_LOCAL: c_int = 0x00000;
-
-        let c_file = CString::new(file).unwrap();
-        let handle = unsafe { dlopen(c_file.as_ptr(), RTLD_NOW | RTLD_LOCAL) };
-
-        if handle.is_null() {
-            let err = unsafe {
-                let e = dlerror();
-                if e.is_null() { "nieznany błąd".to_string() }
-                else { CStr::from_ptr(e).to_string_lossy().to_string() }
-            };
-            bail!("[extern so] dlopen('{}') failed: {}", file, err);
-        }
-
-        let sym_name = CString::new("hl_extern_call").unwrap();
-        let sym_ptr  = unsafe { dlsym(handle, sym_name.as_ptr()) };
-
-        if sym_ptr.is_null() {
-            unsafe { dlclose(handle); }
-            bail!(
-                "[extern so] Symbol 'hl_extern_call' nie znaleziony w '{}'.\n\
-                 Biblioteka musi eksportować:\n\
-                 extern \"C\" fn hl_extern_call(argc: i32, argv: *const *const i8) -> i32",
-                file
-            );
-        }
-
-        // Przygotuj argv
-        type HlExternCallFn = unsafe extern "C" fn(c_int, *const *const c_char) -> c_int;
-        let func: HlExternCallFn = unsafe { std::mem::transmute(sym_ptr) };
-
-        let c_args: Vec<CString> = args.iter()
-            .filter_map(|a| CString::new(a.as_str()).ok())
-            .collect();
-        let c_ptrs: Vec<*const c_char> = c_args.iter().map(|s| s.as_ptr()).collect();
-
-        let exit_code = unsafe {
-            func(c_ptrs.len() as c_int, c_ptrs.as_ptr())
-        };
-
-        unsafe { dlclose(handle); }
-
-        return Ok(crate::executor::ExecResult {
-            exit_code: exit_code as i32,
-            stdout: None,
-        });
-    }
-
-    #[cfg(not(target_os = "linux"))]
-    bail!("[extern so] Obsługiwane tylko na Linux");
+        ),
+        Err(e) => return Err(e),
+    };
+
+    let (exit_code, stdout) = SO_OUT.with(|buf| {
+        let mut buf = buf.borrow_mut();
+        let (code, has_out) = lib.call(args, &mut buf);
+        (code, has_out.then(|| String::from_utf8_lossy(&buf).into_owned()))
+    });
+    Ok(crate::executor::ExecResult { exit_code, stdout })
 }
 
 // ── Helpers ───────────────────────────────────────────────────────────────────
@@ -0,0 +1,202 @@
+//! Biblioteki natywne `extern so`: cache uchwytów i typowane ABI
+//!
+//! `dlopen` + `dlsym` robimy raz na proces i ścieżkę; uchwyty zostają
+//! otwarte do końca procesu (destruktory bibliotek uruchamia dynamiczny
+//! linker przy wyjściu), więc wywołanie w pętli to tylko skok przez wskaźnik.
+//!
+//! Biblioteka eksportuje jeden z dwóch symboli (albo oba — typowany wygrywa):
+//!
+//! ```c
+//! // argv: każdy argument jako C-string
+//! int32_t hl_extern_call(int32_t argc, const char **argv);
+//!
+//! // typowane: liczby i wycinki napisów bez kopiowania (ptr+len, bez NUL);
+//! // wynik tekstowy do bufora wołającego, *out_len = zapisane bajty
+//! typedef struct { uint32_t tag; uint32_t len; double num; const uint8_t *ptr; } hl_val;
+//! int32_t hl_extern_typed(const hl_val *args, uint32_t argc,
+//!                         uint8_t *out, uint32_t out_cap, uint32_t *out_len);
+//! ```
+//!
+//! Wartość zwracana to kod wyjścia (`@_extern_exit`), bufor wyjścia trafia do
+//! `@_extern_result`. Wynik dłuższy niż `out_cap` (`OUT_CAP`) jest ucinany.
+
+use anyhow::{bail, Result};
+use rustc_hash::FxHashMap;
+use std::ffi::{CStr, CString};
+use std::os::raw::{c_char, c_int, c_void};
+use std::sync::{Mutex, OnceLock};
+
+pub const SYM_ARGV:  &str = "hl_extern_call";
+pub const SYM_TYPED: &str = "hl_extern_typed";
+
+/// Pojemność bufora wyniku typowanego wywołania
+pub const OUT_CAP: usize = 64 * 1024;
+
+pub const HL_VAL_NUM: u32 = 0;
+pub const HL_VAL_STR: u32 = 1;
+
+/// Argument typowanego ABI (układ jak `hl_val` w C)
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct HlVal {
+    pub tag: u32,
+    pub len: u32,
+    pub num: f64,
+    pub ptr: *const u8,
+}
+
+pub type ArgvFn  = unsafe extern "C" fn(c_int, *const *const c_char) -> c_int;
+pub type TypedFn = unsafe extern "C" fn(*const HlVal, u32, *mut u8, u32, *mut u32) -> i32;
+
+/// Argument extern po stronie HL
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum Arg<'a> {
+    Num(f64),
+    Str(&'a str),
+}
+
+impl Arg<'_> {
+    /// Postać tekstowa (argv, runtime'y procesowe) — jak `Value::to_string_val`
+    pub fn to_text(&self) -> String {
+        match *self {
+            Arg::Str(s) => s.to_string(),
+            Arg::Num(n) if n.fract() == 0.0 && n.abs() < 1e15 => format!("{}", n as i64),
+            Arg::Num(n) => format!("{}", n),
+        }
+    }
+}
+
+/// Załadowana biblioteka: rozwiązane symbole
+#[derive(Debug, Clone, Copy)]
+pub struct SoLib {
+    pub argv:  Option<ArgvFn>,
+    pub typed: Option<TypedFn>,
+}
+
+fn libs() -> &'static Mutex<FxHashMap<String, SoLib>> {
+    static LIBS: OnceLock<Mutex<FxHashMap<String, SoLib>>> = OnceLock::new();
+    LIBS.get_or_init(|| Mutex::new(FxHashMap::default()))
+}
+
+/// Uchwyt biblioteki z cache procesu (dlopen przy pierwszym użyciu ścieżki)
+pub fn load(path: &str) -> Result<SoLib> {
+    if let Some(lib) = libs().lock().unwrap().get(path) {
+        return Ok(*lib);
+    }
+    let lib = open(path)?;
+    // Równoległe pierwsze użycie z dwóch wątków: dlopen liczy referencje,
+    // drugi uchwyt to ten sam obiekt — zostawiamy pierwszy wpis
+    Ok(*libs().lock().unwrap().entry(path.to_string()).or_insert(lib))
+}
+
+/// Liczba bibliotek w cache (diagnostyka, testy)
+pub fn loaded_count() -> usize {
+    libs().lock().unwrap().len()
+}
+
+#[cfg(target_os = "linux")]
+fn open(path: &str) -> Result<SoLib> {
+    extern "C" {
+        fn dlopen(filename: *const c_char, flag: c_int) -> *mut c_void;
+        fn dlsym(handle: *mut c_void, symbol: *const c_char) -> *mut c_void;
+        fn dlclose(handle: *mut c_void) -> c_int;
+        fn dlerror() -> *const c_char;
+    }
+    const RTLD_NOW: c_int   = 0x00002;
+    const RTLD_LOCAL: c_int = 0x00000;
+
+    let c_file = CString::new(path)?;
+    let handle = unsafe { dlopen(c_file.as_ptr(), RTLD_NOW | RTLD_LOCAL) };
+    if handle.is_null() {
+        let err = unsafe {
+            let e = dlerror();
+            if e.is_null() { "nieznany błąd".to_string() }
+            else { CStr::from_ptr(e).to_string_lossy().to_string() }
+        };
+        bail!("[extern so] dlopen('{}') failed: {}", path, err);
+    }
+
+    let sym = |name: &str| {
+        let c = CString::new(name).unwrap();
+        unsafe { dlsym(handle, c.as_ptr()) }
+    };
+    // SAFETY: symbole o ustalonych nazwach mają sygnatury z nagłówka modułu
+    let argv  = Some(sym(SYM_ARGV)).filter(|p| !p.is_null())
+        .map(|p| unsafe { std::mem::transmute::<*mut c_void, ArgvFn>(p) });
+    let typed = Some(sym(SYM_TYPED)).filter(|p| !p.is_null())
+        .map(|p| unsafe { std::mem::transmute::<*mut c_void, TypedFn>(p) });
+
+    if argv.is_none() && typed.is_none() {
+        unsafe { dlclose(handle); }
+        bail!(
+            "[extern so] Symbol '{}' ani '{}' nie znaleziony w '{}'.\n\
+             Biblioteka musi eksportować:\n\
+             extern \"C\" fn hl_extern_call(argc: i32, argv: *const *const i8) -> i32\n\
+             albo typowane hl_extern_typed (patrz hl_core::ffi)",
+            SYM_ARGV, SYM_TYPED, path
+        );
+    }
+    Ok(SoLib { argv, typed })
+}
+
+#[cfg(not(target_os = "linux"))]
+fn open(_path: &str) -> Result<SoLib> {
+    bail!("[extern so] Obsługiwane tylko na Linux");
+}
+
+impl SoLib {
+    /// Wywołaj bibliotekę: typowane ABI, jeśli jest, inaczej argv.
+    /// `out` — bufor wyniku wielokrotnego użytku (czyszczony tutaj);
+    /// zwraca kod wyjścia i czy `out` zawiera wynik.
+    pub fn call(&self, args: &[Arg], out: &mut Vec<u8>) -> (i32, bool) {
+        out.clear();
+        if let Some(f) = self.typed {
+            let vals: Vec<HlVal> = args.iter().map(|a| match *a {
+                Arg::Num(n) => HlVal { tag: HL_VAL_NUM, len: 0, num: n, ptr: std::ptr::null() },
+                Arg::Str(s) => HlVal { tag: HL_VAL_STR, len: s.len() as u32, num: 0.0, ptr: s.as_ptr() },
+            }).collect();
+            out.reserve(OUT_CAP);
+            let cap = out.capacity().min(u32::MAX as usize) as u32;
+            let mut len: u32 = 0;
+            // SAFETY: `vals` i napisy żyją do końca wywołania; biblioteka pisze
+            // najwyżej `cap` bajtów do `out`
+            let code = unsafe { f(vals.as_ptr(), vals.len() as u32, out.as_mut_ptr(), cap, &mut len) };
+            unsafe { out.set_len((len as usize).min(cap as usize)); }
+            return (code, true);
+        }
+        let Some(f) = self.argv else { return (1, false) };
+        let c_args: Vec<CString> = args.iter()
+            .filter_map(|a| CString::new(a.to_text()).ok())
+            .collect();
+        let c_ptrs: Vec<*const c_char> = c_args.iter().map(|s| s.as_ptr()).collect();
+        // SAFETY: jak wyżej — argv żyje do końca wywołania
+        let code = unsafe { f(c_ptrs.len() as c_int, c_ptrs.as_ptr()) };
+        (code, false)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_arg_text() {
+        assert_eq!(Arg::Num(3.0).to_text(), "3");
+        assert_eq!(Arg::Num(2.5).to_text(), "2.5");
+        assert_eq!(Arg::Str("x").to_text(), "x");
+    }
+
+    #[test]
+    fn test_load_missing_is_error_and_not_cached() {
+        let before = loaded_count();
+        assert!(load("/nonexistent/libhl-test.so").is_err());
+        assert_eq!(loaded_count(), before);
+    }
+
+    #[test]
+    fn test_hl_val_layout() {
+        // Układ musi zgadzać się z `hl_val` z nagłówka C
+        assert_eq!(std::mem::size_of::<HlVal>(), 24);
+        assert_eq!(std::mem::align_of::<HlVal>(), 8);
+    }
+}
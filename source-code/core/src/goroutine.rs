@@ -0,0 +1,427 @@
+//! Runtime goroutines: `:* nazwa ... done`, kanały `:** kanał`, `:*~ nazwa`
+//!
+//! Stała pula wątków (liczba rdzeni, `HL_GO_WORKERS` nadpisuje) z kolejką
+//! lokalną na wątek i podkradaniem pracy: goroutine uruchomiona z wnętrza
+//! innej trafia do kolejki bieżącego wątku, a bezczynne wątki biorą zadania
+//! z kolejki globalnej i od sąsiadów. Kanały są MPMC z ograniczoną
+//! pojemnością — `send` blokuje przy pełnym, `recv` przy pustym.
+//!
+//! Goroutine zablokowana na kanale (albo na `:*~`) oddaje swoje miejsce:
+//! jeśli w kolejce czekają zadania, a wszystkie wątki są zajęte, pula dokłada
+//! wątek zastępczy (jak Go przy blokującym syscallu). Liczba wątków, które
+//! faktycznie liczą, zostaje równa liczbie rdzeni; zastępcze kończą się, gdy
+//! nie mają pracy. Każde zdarzenie (nowe zadanie, koniec zadania, ruch na
+//! kanale) podbija licznik epok i budzi czekających przez jeden Condvar —
+//! bez odpytywania.
+//!
+//! Z runtime'u korzysta executor AST i interpreter bajtkodu w `hl-jit`.
+//! Wartości w kanałach to stringi, więc oba światy mogą się komunikować.
+
+use crate::metrics::{self, Counter, Hist};
+use anyhow::{bail, Result};
+use rustc_hash::FxHashMap;
+use std::cell::Cell;
+use std::collections::VecDeque;
+use std::panic::{catch_unwind, AssertUnwindSafe};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, Condvar, Mutex, OnceLock};
+use std::time::Duration;
+
+/// Pojemność kanału bez jawnego rozmiaru (`:** kanał`)
+pub const DEFAULT_CHANNEL_CAP: usize = 64;
+
+/// Ile czekamy na jakiekolwiek zdarzenie, zanim uznamy, że wszystkie
+/// goroutines wiszą na kanałach (deadlock)
+const DEADLOCK_GRACE: Duration = Duration::from_secs(1);
+
+/// Górna granica wątków razem z zastępczymi
+const MAX_THREADS: usize = 1024;
+const WORKER_STACK: usize = 8 << 20;
+
+type Task = Box<dyn FnOnce() + Send>;
+
+struct Pool {
+    injector:    Mutex<VecDeque<Task>>,
+    locals:      Vec<Mutex<VecDeque<Task>>>,
+    /// Docelowa liczba pracujących wątków
+    target:      usize,
+    /// Żyjące wątki puli (stałe + zastępcze)
+    threads:     AtomicUsize,
+    /// Wątki puli śpiące bez pracy
+    idle:        AtomicUsize,
+    /// Zadania zgłoszone i niezakończone (w kolejce + wykonywane)
+    outstanding: AtomicUsize,
+    /// Zadania, które czekają teraz na kanał albo na inne goroutines
+    blocked:     AtomicUsize,
+    /// Licznik epok — zmienia się przy każdym zdarzeniu
+    epoch:       Mutex<u64>,
+    wake:        Condvar,
+}
+
+thread_local! {
+    /// Indeks kolejki lokalnej wątku (usize::MAX: wątek spoza puli albo zastępczy)
+    static WORKER:  Cell<usize> = const { Cell::new(usize::MAX) };
+    /// Czy wątek wykonuje teraz goroutine (false = wątek główny skryptu)
+    static IN_TASK: Cell<bool>  = const { Cell::new(false) };
+}
+
+static POOL: OnceLock<Pool> = OnceLock::new();
+
+fn pool() -> &'static Pool {
+    let mut fresh = false;
+    let p = POOL.get_or_init(|| {
+        fresh = true;
+        let n = std::env::var("HL_GO_WORKERS").ok()
+            .and_then(|s| s.parse::<usize>().ok())
+            .unwrap_or_else(|| std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1))
+            .clamp(1, MAX_THREADS);
+        tracing::debug!("[go] pula: {} wątków", n);
+        Pool {
+            injector:    Mutex::new(VecDeque::new()),
+            locals:      (0..n).map(|_| Mutex::new(VecDeque::new())).collect(),
+            target:      n,
+            threads:     AtomicUsize::new(0),
+            idle:        AtomicUsize::new(0),
+            outstanding: AtomicUsize::new(0),
+            blocked:     AtomicUsize::new(0),
+            epoch:       Mutex::new(0),
+            wake:        Condvar::new(),
+        }
+    });
+    if fresh {
+        for i in 0..p.target { p.start_thread(i); }
+    }
+    p
+}
+
+impl Pool {
+    fn start_thread(&'static self, local: usize) {
+        self.threads.fetch_add(1, Ordering::AcqRel);
+        let spawned = std::thread::Builder::new()
+            .name(format!("hl-go-{}", local.min(self.target)))
+            .stack_size(WORKER_STACK)
+            .spawn(move || self.worker_loop(local));
+        if spawned.is_err() { self.threads.fetch_sub(1, Ordering::AcqRel); }
+    }
+
+    fn worker_loop(&'static self, local: usize) {
+        WORKER.with(|w| w.set(local));
+        loop {
+            let seen = self.epoch();
+            if let Some(task) = self.find_task() {
+                self.run(task);
+                continue;
+            }
+            // Zastępczy wątek bez pracy nie jest już potrzebny
+            if local >= self.target {
+                self.threads.fetch_sub(1, Ordering::AcqRel);
+                // Zadanie wrzucone w tej chwili mogło nie zobaczyć spadku
+                if !self.has_queued() { return; }
+                self.threads.fetch_add(1, Ordering::AcqRel);
+                continue;
+            }
+            self.idle.fetch_add(1, Ordering::AcqRel);
+            self.wait_event(seen, None);
+            self.idle.fetch_sub(1, Ordering::AcqRel);
+        }
+    }
+
+    fn epoch(&self) -> u64 { *self.epoch.lock().unwrap() }
+
+    fn notify(&self) {
+        *self.epoch.lock().unwrap() += 1;
+        self.wake.notify_all();
+    }
+
+    /// Śpij, dopóki epoka == `seen`. Zwraca bieżącą epokę.
+    fn wait_event(&self, seen: u64, timeout: Option<Duration>) -> u64 {
+        let mut g = self.epoch.lock().unwrap();
+        while *g == seen {
+            match timeout {
+                Some(t) => {
+                    let (ng, res) = self.wake.wait_timeout(g, t).unwrap();
+                    g = ng;
+                    if res.timed_out() { break; }
+                }
+                None => g = self.wake.wait(g).unwrap(),
+            }
+        }
+        *g
+    }
+
+    fn push(&'static self, task: Task) {
+        let depth = self.outstanding.fetch_add(1, Ordering::AcqRel) + 1;
+        metrics::inc(Counter::GoSpawned);
+        metrics::observe(Hist::GoQueueDepth, depth as u64);
+        match WORKER.with(|w| w.get()) {
+            i if i < self.locals.len() => self.locals[i].lock().unwrap().push_back(task),
+            _ => self.injector.lock().unwrap().push_back(task),
+        }
+        self.compensate();
+        self.notify();
+    }
+
+    /// Dołóż wątek zastępczy, gdy są zadania, nikt nie śpi bez pracy,
+    /// a część wątków stoi na kanałach
+    fn compensate(&'static self) {
+        let threads = self.threads.load(Ordering::Acquire);
+        let running = threads.saturating_sub(self.blocked.load(Ordering::Acquire));
+        if self.idle.load(Ordering::Acquire) == 0 && running < self.target && threads < MAX_THREADS {
+            self.start_thread(self.target);
+        }
+    }
+
+    /// Własna kolejka od końca (najświeższe zadanie, ciepły cache),
+    /// globalna i cudze — od początku
+    fn find_task(&self) -> Option<Task> {
+        let me = WORKER.with(|w| w.get());
+        if me < self.locals.len() {
+            if let Some(t) = self.locals[me].lock().unwrap().pop_back() { return Some(t); }
+        }
+        if let Some(t) = self.injector.lock().unwrap().pop_front() { return Some(t); }
+        let n = self.locals.len();
+        let from = if me < n { me + 1 } else { 0 };
+        (0..n).map(|k| (from + k) % n)
+            .filter(|&v| v != me)
+            .find_map(|v| self.locals[v].lock().unwrap().pop_front())
+    }
+
+    fn run(&self, task: Task) {
+        IN_TASK.with(|t| t.set(true));
+        task();
+        IN_TASK.with(|t| t.set(false));
+        self.outstanding.fetch_sub(1, Ordering::AcqRel);
+        self.notify();
+    }
+
+    fn has_queued(&self) -> bool {
+        !self.injector.lock().unwrap().is_empty()
+            || self.locals.iter().any(|q| !q.lock().unwrap().is_empty())
+    }
+}
+
+/// Czekaj, aż `ready` zwróci wartość. Goroutine czekająca oddaje swój wątek
+/// (pula dokłada zastępczy); wątek główny wykrywa sytuację, w której każda
+/// goroutine też czeka.
+fn block_on<T>(what: &str, mut ready: impl FnMut() -> Option<T>) -> Result<T> {
+    let Some(p) = POOL.get() else {
+        // Pula nie wystartowała — nikt inny nie może spełnić warunku
+        return match ready() {
+            Some(v) => Ok(v),
+            None    => bail!("Deadlock: {} — brak goroutines, które mogłyby go odblokować", what),
+        };
+    };
+    if let Some(v) = ready() { return Ok(v); }
+    let in_task = IN_TASK.with(|t| t.get());
+    if in_task {
+        p.blocked.fetch_add(1, Ordering::AcqRel);
+        if p.has_queued() { p.compensate(); }
+    }
+    let res = loop {
+        let seen = p.epoch();
+        if let Some(v) = ready() { break Ok(v); }
+        let stuck = || p.outstanding.load(Ordering::Acquire) == p.blocked.load(Ordering::Acquire);
+        if in_task || !stuck() {
+            p.wait_event(seen, None);
+            continue;
+        }
+        if p.outstanding.load(Ordering::Acquire) == 0 {
+            break Err(anyhow::anyhow!("Deadlock: {} — brak goroutines, które mogłyby go odblokować", what));
+        }
+        if p.wait_event(seen, Some(DEADLOCK_GRACE)) == seen && stuck() {
+            break Err(anyhow::anyhow!("Deadlock: {} — wszystkie goroutines czekają na kanałach", what));
+        }
+    };
+    if in_task { p.blocked.fetch_sub(1, Ordering::AcqRel); }
+    res
+}
+
+// ── Goroutines ────────────────────────────────────────────────────────────────
+
+/// Uchwyt do jednej goroutine — kod wyjścia po zakończeniu
+#[derive(Clone)]
+pub struct JoinHandle {
+    done: Arc<Mutex<Option<i32>>>,
+}
+
+impl JoinHandle {
+    pub fn join(&self) -> Result<i32> {
+        block_on("oczekiwanie na goroutine", || *self.done.lock().unwrap())
+    }
+}
+
+/// Uruchomione, jeszcze nie odebrane przez `wait` — nazwa → uchwyty
+/// ("" = goroutines bez nazwy)
+static GROUPS: Mutex<Option<FxHashMap<String, Vec<JoinHandle>>>> = Mutex::new(None);
+
+/// Uruchom `f` w puli. `f` zwraca kod wyjścia; panika daje 1.
+pub fn spawn(name: Option<&str>, f: impl FnOnce() -> i32 + Send + 'static) -> JoinHandle {
+    let handle = JoinHandle { done: Arc::new(Mutex::new(None)) };
+    GROUPS.lock().unwrap()
+        .get_or_insert_with(FxHashMap::default)
+        .entry(name.unwrap_or("").to_string())
+        .or_default()
+        .push(handle.clone());
+    let done = handle.done.clone();
+    pool().push(Box::new(move || {
+        let code = catch_unwind(AssertUnwindSafe(f)).unwrap_or(1);
+        *done.lock().unwrap() = Some(code);
+    }));
+    handle
+}
+
+/// `:*~ nazwa` / `:*~` — czekaj na goroutines o danej nazwie albo na wszystkie
+/// (także uruchamiane w trakcie czekania). Wynik: pierwszy niezerowy kod
+/// wyjścia albo 0.
+pub fn wait(name: Option<&str>) -> Result<i32> {
+    let mut code = 0;
+    loop {
+        let handles: Vec<JoinHandle> = {
+            let mut g = GROUPS.lock().unwrap();
+            let Some(groups) = g.as_mut() else { return Ok(code) };
+            match name {
+                Some(n) => groups.remove(n).unwrap_or_default(),
+                None    => groups.drain().flat_map(|(_, v)| v).collect(),
+            }
+        };
+        if handles.is_empty() { return Ok(code); }
+        for h in handles {
+            let c = h.join()?;
+            if code == 0 { code = c; }
+        }
+    }
+}
+
+/// Koniec skryptu: poczekaj na wszystkie goroutines (no-op, gdy żadnej nie było)
+pub fn wait_all() -> Result<i32> {
+    if POOL.get().is_none() { return Ok(0); }
+    wait(None)
+}
+
+// ── Kanały ────────────────────────────────────────────────────────────────────
+
+struct Channel {
+    queue: Mutex<VecDeque<String>>,
+    cap:   usize,
+}
+
+static CHANNELS: Mutex<Option<FxHashMap<String, Arc<Channel>>>> = Mutex::new(None);
+
+fn new_channel(cap: usize) -> Arc<Channel> {
+    Arc::new(Channel { queue: Mutex::new(VecDeque::new()), cap: cap.max(1) })
+}
+
+/// `:** kanał [pojemność]` — utwórz (albo wyczyść) kanał
+pub fn channel_open(name: &str, cap: usize) {
+    CHANNELS.lock().unwrap()
+        .get_or_insert_with(FxHashMap::default)
+        .insert(name.to_string(), new_channel(cap));
+}
+
+/// Kanał po nazwie; niezadeklarowany tworzymy z domyślną pojemnością
+fn channel(name: &str) -> Arc<Channel> {
+    CHANNELS.lock().unwrap()
+        .get_or_insert_with(FxHashMap::default)
+        .entry(name.to_string())
+        .or_insert_with(|| new_channel(DEFAULT_CHANNEL_CAP))
+        .clone()
+}
+
+/// Wyślij wartość; blokuje, gdy kanał jest pełny
+pub fn send(name: &str, val: String) -> Result<()> {
+    let ch = channel(name);
+    let mut val = Some(val);
+    let what = format!("wysyłanie do pełnego kanału '{}'", name);
+    let mut tries = 0u32;
+    let depth = block_on(&what, || {
+        tries += 1;
+        let mut q = ch.queue.lock().unwrap();
+        if q.len() >= ch.cap { return None; }
+        q.push_back(val.take()?);
+        Some(q.len())
+    })?;
+    if let Some(p) = POOL.get() { p.notify(); }
+    chan_metrics(Counter::ChanSends, tries);
+    metrics::observe(Hist::ChanDepth, depth as u64);
+    Ok(())
+}
+
+/// Odbierz wartość; blokuje, gdy kanał jest pusty
+pub fn recv(name: &str) -> Result<String> {
+    let ch = channel(name);
+    let what = format!("odbiór z pustego kanału '{}'", name);
+    let mut tries = 0u32;
+    let v = block_on(&what, || { tries += 1; ch.queue.lock().unwrap().pop_front() })?;
+    if let Some(p) = POOL.get() { p.notify(); }
+    chan_metrics(Counter::ChanRecvs, tries);
+    Ok(v)
+}
+
+/// Operacja na kanale; więcej niż jedna próba = czekała na drugą stronę
+#[inline]
+fn chan_metrics(op: Counter, tries: u32) {
+    metrics::inc(op);
+    if tries > 1 { metrics::inc(Counter::ChanBlocked); }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_spawn_and_wait_returns_exit_code() {
+        spawn(Some("t_codes"), || 0);
+        spawn(Some("t_codes"), || 7);
+        assert_eq!(wait(Some("t_codes")).unwrap(), 7);
+        // Grupa odebrana — drugi wait nie czeka na nic
+        assert_eq!(wait(Some("t_codes")).unwrap(), 0);
+    }
+
+    #[test]
+    fn test_bounded_channel_between_goroutines() {
+        channel_open("t_pipe", 1);
+        spawn(Some("t_producer"), || {
+            for i in 0..100 { send("t_pipe", i.to_string()).unwrap(); }
+            0
+        });
+        let got: Vec<String> = (0..100).map(|_| recv("t_pipe").unwrap()).collect();
+        assert_eq!(got.first().map(String::as_str), Some("0"));
+        assert_eq!(got.last().map(String::as_str), Some("99"));
+        assert_eq!(wait(Some("t_producer")).unwrap(), 0);
+    }
+
+    #[test]
+    fn test_consumers_outnumber_workers() {
+        // Więcej czekających konsumentów niż wątków puli — producent i tak
+        // musi dostać swoją kolej
+        channel_open("t_fan", 4);
+        let n = pool().locals.len() * 2 + 1;
+        for _ in 0..n {
+            spawn(Some("t_fan_rx"), || if recv("t_fan").unwrap() == "x" { 0 } else { 1 });
+        }
+        spawn(Some("t_fan_tx"), move || {
+            for _ in 0..n { send("t_fan", "x".into()).unwrap(); }
+            0
+        });
+        assert_eq!(wait(Some("t_fan_tx")).unwrap(), 0);
+        assert_eq!(wait(Some("t_fan_rx")).unwrap(), 0);
+    }
+
+    #[test]
+    fn test_nested_spawn_is_awaited() {
+        channel_open("t_nested", 2);
+        spawn(Some("t_outer"), || {
+            spawn(Some("t_inner"), || { send("t_nested", "inner".into()).unwrap(); 0 });
+            wait(Some("t_inner")).unwrap()
+        });
+        assert_eq!(wait(Some("t_outer")).unwrap(), 0);
+        assert_eq!(recv("t_nested").unwrap(), "inner");
+    }
+
+    #[test]
+    fn test_recv_without_producer_is_deadlock() {
+        channel_open("t_empty", 1);
+        let err = recv("t_empty").unwrap_err().to_string();
+        assert!(err.contains("Deadlock"), "{}", err);
+    }
+}
@@ -1,5 +1,7 @@
 pub mod deps;
 pub mod diagnostics;
+pub mod check;
+pub mod metrics;
 pub mod env;
 pub mod executor;
 pub mod libs;
@@ -8,6 +10,10 @@ pub mod arena;
 pub mod config;
 pub mod env_manager;
 pub mod extern_runner;
+pub mod extern_pool;
+pub mod ffi;
+pub mod spawn;
+pub mod goroutine;
 
 pub use hl_parser::{
     ast, lexer, parser, gen, shebang,
@@ -52,9 +58,9 @@ pub fn exec_nodes_pub(nodes: &[Node], env: &mut Env) -> Result<executor::ExecRes
 pub use env::Value;
 pub use executor::ExecResult;
 pub use diagnostics::{Diag, DiagLevel, DiagRenderer, DiagSummary, Span, lint_source};
-pub use libs::{cmd_lib_list, cmd_lib_install, cmd_lib_remove, cmd_clean_cache};
-pub use diagnostics::lint_gen;
-pub use arena::{Arena, ArenaContext, ArenaStats};
+pub use libs::{cmd_lib_list, cmd_lib_install, cmd_lib_remove, cmd_clean_cache, preload_main_libs, locate_import, LibTarget};
+pub use diagnostics::{lint_gen, lint_pass};
+pub use arena::{Arena, ArenaContext, ArenaStats, ArenaStr, ArenaTotals};
 pub use config::{
     HlConfig, load_config, save_config, config_path,
     set_active_env, clear_active_env, get_active_env,
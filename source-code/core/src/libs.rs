@@ -1,5 +1,9 @@
 use anyhow::{bail, Result};
+use hl_parser::ast::Node;
+use rustc_hash::FxHashMap;
 use std::path::{Path, PathBuf};
+use std::sync::{Arc, Mutex};
+use std::time::SystemTime;
 use tracing::info;
 use crate::env::{Env, Value};
 
@@ -48,77 +52,110 @@ pub fn parse_import_spec(raw: &str) -> Option<ImportSource> {
     }
 }
 
-pub fn resolve_import(lib: &str, detail: Option<&str>, env: &mut Env) -> Result<()> {
-    let lib = lib.trim();
-    if lib.starts_with('<') && lib.ends_with('>') {
-        let spec = &lib[1..lib.len()-1];
-        if let Some(src) = parse_import_spec(spec) {
-            return dispatch_import(src, env);
-        }
+/// Import po rozwiązaniu: plik do wykonania i zmienne do ustawienia.
+/// Wspólne dla executora AST (`resolve_import`) i linkera bytecode
+/// (`hl_jit::libs`, który kompiluje `file` do cache .bc zamiast parsować).
+#[derive(Debug, Clone)]
+pub struct LibTarget {
+    /// Plik .hl biblioteki; None — same zmienne (wbudowany fallback, natywna .so)
+    pub file:   Option<PathBuf>,
+    /// Zmienne ustawiane po wykonaniu pliku (`BIT_<X>_LOADED`, fallbacki)
+    pub vars:   Vec<(String, Value)>,
+    /// Komunikat na stderr po załadowaniu (executor AST)
+    pub banner: Option<String>,
+}
+
+impl LibTarget {
+    fn file(path: PathBuf, banner: Option<String>) -> Self {
+        Self { file: Some(path), vars: Vec::new(), banner }
+    }
+}
+
+pub fn resolve_import(lib: &str, _detail: Option<&str>, env: &mut Env) -> Result<()> {
+    let target = locate_import(lib)?;
+    if let Some(path) = &target.file {
+        let nodes = parse_lib(path)?;
+        crate::executor::exec_nodes(&nodes, env)?;
     }
-    if let Some(src) = parse_import_spec(lib) {
-        return dispatch_import(src, env);
+    for (name, val) in target.vars {
+        env.set_var(&name, val);
     }
-    match lib {
-        "std/net"    | "main/net"    => load_main_lib("net",   detail, env),
-        "std/fs"     | "main/fs"     => load_main_lib("fs",    detail, env),
-        "std/sys"    | "main/sys"    => load_main_lib("sys",   detail, env),
-        "std/str"    | "main/str"    => load_main_lib("str",   detail, env),
-        "std/crypto" | "main/crypto" => load_main_lib("crypto",detail, env),
-        "std/proc"   | "main/proc"   => load_main_lib("proc",  detail, env),
-        _ => bail!("Nieznana biblioteka: '{}'", lib),
+    if let Some(banner) = &target.banner {
+        eprintln!("{}", banner);
     }
+    Ok(())
 }
 
-fn dispatch_import(src: ImportSource, env: &mut Env) -> Result<()> {
-    match src {
-        ImportSource::Main { lib, detail, .. }  => load_main_lib(&lib, detail.as_deref(), env),
-        ImportSource::Bit  { name, version }     => load_bit_lib(&name, version.as_deref(), env),
-        ImportSource::GitHub { path, version }   => load_github_lib(&path, version.as_deref(), env),
+/// Rozwiąż import (`<main/json>`, `bit/x:1.2`, `github/u/r`) bez wykonywania.
+/// Biblioteki z GitHuba klonuje przy pierwszym użyciu.
+pub fn locate_import(lib: &str) -> Result<LibTarget> {
+    let lib  = lib.trim();
+    let spec = lib.strip_prefix('<').and_then(|s| s.strip_suffix('>')).unwrap_or(lib);
+    match parse_import_spec(spec) {
+        Some(ImportSource::Main { lib, .. })      => locate_main_lib(&lib),
+        Some(ImportSource::Bit  { name, version }) => locate_bit_lib(&name, version.as_deref()),
+        Some(ImportSource::GitHub { path, version }) => locate_github_lib(&path, version.as_deref()),
+        None => bail!("Nieznana biblioteka: '{}'", lib),
     }
 }
 
-// ── Main libs — pliki .hl w MAIN_LIBS_DIR ─────────────────────────────────────
+// ── Cache sparsowanych bibliotek ──────────────────────────────────────────────
+//
+// Wpis jest ważny, dopóki mtime i rozmiar pliku się nie zmienią. `hl daemon`
+// wypełnia go przy starcie (`preload_main_libs`), więc workery dziedziczą
+// gotowe AST i import tylko wykonuje węzły.
+
+struct ParsedLib {
+    mtime: SystemTime,
+    len:   u64,
+    nodes: Arc<Vec<Node>>,
+}
 
-fn load_main_lib(lib: &str, detail: Option<&str>, env: &mut Env) -> Result<()> {
-    let libs_dir = Path::new(MAIN_LIBS_DIR);
-    let hl_file  = libs_dir.join(format!("{}.hl", lib));
-    let dir_file = libs_dir.join(lib).join("lib.hl");
+static PARSED: Mutex<Option<FxHashMap<PathBuf, ParsedLib>>> = Mutex::new(None);
 
-    if hl_file.exists() {
-        info!("Laduje main lib '{}' z {:?}", lib, hl_file);
-        let src   = std::fs::read_to_string(&hl_file)?;
-        let nodes = hl_parser::parse_source(&src)?;
-        crate::executor::exec_nodes(&nodes, env)?;
-        eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/{}", lib);
-        return Ok(());
+fn parse_lib(path: &Path) -> Result<Arc<Vec<Node>>> {
+    let meta = std::fs::metadata(path)?;
+    let (mtime, len) = (meta.modified()?, meta.len());
+    if let Some(hit) = PARSED.lock().unwrap().as_ref().and_then(|m| m.get(path)) {
+        if hit.mtime == mtime && hit.len == len { return Ok(hit.nodes.clone()); }
     }
-    if dir_file.exists() {
-        info!("Laduje main lib '{}' z {:?}", lib, dir_file);
-        let src   = std::fs::read_to_string(&dir_file)?;
-        let nodes = hl_parser::parse_source(&src)?;
-        crate::executor::exec_nodes(&nodes, env)?;
-        eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/{}", lib);
-        return Ok(());
+    let src   = std::fs::read_to_string(path)?;
+    let nodes = Arc::new(hl_parser::parse_source(&src)?);
+    PARSED.lock().unwrap()
+        .get_or_insert_with(FxHashMap::default)
+        .insert(path.to_path_buf(), ParsedLib { mtime, len, nodes: nodes.clone() });
+    Ok(nodes)
+}
+
+/// Sparsuj wszystkie main libs (`<nazwa>.hl` i `<nazwa>/lib.hl`) do cache.
+/// Zwraca liczbę wczytanych plików; błędne pliki zgłosi dopiero import.
+pub fn preload_main_libs() -> usize {
+    let Ok(dir) = std::fs::read_dir(MAIN_LIBS_DIR) else { return 0 };
+    dir.flatten()
+        .map(|e| e.path())
+        .map(|p| if p.is_dir() { p.join("lib.hl") } else { p })
+        .filter(|p| p.extension().is_some_and(|e| e == "hl") && p.is_file())
+        .filter(|p| parse_lib(p).is_ok())
+        .count()
+}
+
+// ── Main libs — pliki .hl w MAIN_LIBS_DIR ─────────────────────────────────────
+
+fn locate_main_lib(lib: &str) -> Result<LibTarget> {
+    let libs_dir = Path::new(MAIN_LIBS_DIR);
+    let banner   = format!("\x1b[36m[hl main]\x1b[0m Zaladowano main/{}", lib);
+    for file in [libs_dir.join(format!("{}.hl", lib)), libs_dir.join(lib).join("lib.hl")] {
+        if file.exists() {
+            info!("Laduje main lib '{}' z {:?}", lib, file);
+            return Ok(LibTarget::file(file, Some(banner)));
+        }
     }
 
-    // Builtin fallback
-    match lib {
-        "net"          => load_builtin_net(detail, env),
-        "fs"           => load_builtin_fs(detail, env),
-        "sys"          => load_builtin_sys(detail, env),
-        "str"          => load_builtin_str(detail, env),
-        "crypto"       => load_builtin_crypto(detail, env),
-        "proc"         => load_builtin_proc(detail, env),
-        "colors"       => load_builtin_colors(env),
-        "cli"          => load_builtin_cli(env),
-        "progress-bar" => load_builtin_progress_bar(env),
-        "json"         => load_builtin_json(env),
-        "hk-parser"    => load_builtin_hk_parser(env),
-        "hacker"       => load_builtin_hacker(env),
-        other => bail!(
+    match builtin_vars(lib) {
+        Some(vars) => Ok(LibTarget { file: None, vars, banner: Some(format!("{} (builtin fallback)", banner)) }),
+        None => bail!(
             "Biblioteka main/{} nie znaleziona w {} i brak wbudowanego fallbacku",
-            other, MAIN_LIBS_DIR
+            lib, MAIN_LIBS_DIR
         ),
     }
 }
@@ -135,7 +172,7 @@ fn load_main_lib(lib: &str, detail: Option<&str>, env: &mut Env) -> Result<()> {
 //
 // Jeśli nie zainstalowany → instrukcja instalacji przez bit
 
-fn load_bit_lib(name: &str, _version: Option<&str>, env: &mut Env) -> Result<()> {
+fn locate_bit_lib(name: &str, _version: Option<&str>) -> Result<LibTarget> {
     let current_dir = bit_current_dir(name);
 
     if !current_dir.exists() {
@@ -152,6 +189,10 @@ name, name, name
         );
     }
 
+    // Zmienne informacyjne
+    let prefix = name.to_uppercase().replace('-', "_");
+    let loaded = (format!("BIT_{}_LOADED", prefix), Value::Bool(true));
+
     // Szukaj pliku .hl do załadowania
     let candidates = [
         current_dir.join("lib.hl"),
@@ -160,32 +201,23 @@ name, name, name
         current_dir.join("mod.hl"),
     ];
 
-    for candidate in &candidates {
-        if candidate.exists() {
-            info!("Laduje bit lib '{}' z {:?}", name, candidate);
-            let src   = std::fs::read_to_string(candidate)?;
-            let nodes = hl_parser::parse_source(&src)?;
-            crate::executor::exec_nodes(&nodes, env)?;
-            eprintln!("\x1b[35m[hl bit]\x1b[0m Zaladowano bit/{}", name);
-
-            // Ustaw zmienne informacyjne
-            let prefix = name.to_uppercase().replace('-', "_");
-            env.set_var(&format!("BIT_{}_LOADED", prefix), Value::Bool(true));
-            env.set_var(&format!("BIT_{}_PATH", prefix),
-                        Value::String(current_dir.display().to_string()));
-            return Ok(());
-        }
+    if let Some(candidate) = candidates.into_iter().find(|c| c.exists()) {
+        info!("Laduje bit lib '{}' z {:?}", name, candidate);
+        return Ok(LibTarget {
+            file:   Some(candidate),
+            vars:   vec![loaded, (format!("BIT_{}_PATH", prefix), Value::String(current_dir.display().to_string()))],
+            banner: Some(format!("\x1b[35m[hl bit]\x1b[0m Zaladowano bit/{}", name)),
+        });
     }
 
     // Biblioteka natywna .so
     let so_path = current_dir.join(format!("{}.so", name));
     if so_path.exists() {
-        let prefix = name.to_uppercase().replace('-', "_");
-        env.set_var(&format!("BIT_{}_LOADED", prefix), Value::Bool(true));
-        env.set_var(&format!("BIT_{}_PATH", prefix),
-                    Value::String(so_path.display().to_string()));
-        eprintln!("\x1b[35m[hl bit]\x1b[0m Zaladowano bit/{} (.so)", name);
-        return Ok(());
+        return Ok(LibTarget {
+            file:   None,
+            vars:   vec![loaded, (format!("BIT_{}_PATH", prefix), Value::String(so_path.display().to_string()))],
+            banner: Some(format!("\x1b[35m[hl bit]\x1b[0m Zaladowano bit/{} (.so)", name)),
+        });
     }
 
     bail!(
@@ -197,7 +229,7 @@ name, current_dir, name, name, name
 
 // ── GitHub libs ───────────────────────────────────────────────────────────────
 
-fn load_github_lib(path: &str, version: Option<&str>, env: &mut Env) -> Result<()> {
+fn locate_github_lib(path: &str, version: Option<&str>) -> Result<LibTarget> {
     let lib_dir = github_libs_dir().join(path.replace('/', "__"));
 
     if !lib_dir.exists() {
@@ -211,10 +243,10 @@ fn load_github_lib(path: &str, version: Option<&str>, env: &mut Env) -> Result<(
         if !cmd.status()?.success() { bail!("Nie mozna pobrac github: {}", path); }
     }
 
-    load_from_dir(&lib_dir, None, env, path)
+    Ok(LibTarget::file(dir_entry(&lib_dir, None, path)?, None))
 }
 
-fn load_from_dir(dir: &Path, detail: Option<&str>, env: &mut Env, name: &str) -> Result<()> {
+fn dir_entry(dir: &Path, detail: Option<&str>, name: &str) -> Result<PathBuf> {
     let main_file = if let Some(d) = detail {
         let f = dir.join(format!("{}.hl", d));
         if f.exists() { f } else { dir.join(d).join("mod.hl") }
@@ -223,10 +255,7 @@ fn load_from_dir(dir: &Path, detail: Option<&str>, env: &mut Env, name: &str) ->
         .unwrap_or_else(|| dir.join("lib.hl"))
     };
     if !main_file.exists() { bail!("Brak pliku wejsciowego dla '{}' w {:?}", name, dir); }
-    let src   = std::fs::read_to_string(&main_file)?;
-    let nodes = hl_parser::parse_source(&src)?;
-    crate::executor::exec_nodes(&nodes, env)?;
-    Ok(())
+    Ok(main_file)
 }
 
 pub fn github_libs_dir() -> PathBuf {
@@ -241,85 +270,58 @@ pub fn hl_cache_dir() -> PathBuf {
 
 // ── Builtin fallbacks ─────────────────────────────────────────────────────────
 
-fn load_builtin_net(_detail: Option<&str>, env: &mut Env) -> Result<()> {
-    env.set_var("NET_LOCALHOST", Value::String("127.0.0.1".into()));
-    env.set_var("NET_BROADCAST", Value::String("255.255.255.255".into()));
-    eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/net (builtin fallback)");
-    Ok(())
-}
-fn load_builtin_fs(_detail: Option<&str>, env: &mut Env) -> Result<()> {
-    let home = dirs::home_dir().map(|p| p.display().to_string()).unwrap_or_default();
-    env.set_var("FS_HOME",    Value::String(home));
-    env.set_var("FS_TMP",     Value::String("/tmp".into()));
-    env.set_var("FS_ETC",     Value::String("/etc".into()));
-    env.set_var("FS_VAR_LOG", Value::String("/var/log".into()));
-    eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/fs (builtin fallback)");
-    Ok(())
-}
-fn load_builtin_sys(_detail: Option<&str>, env: &mut Env) -> Result<()> {
-    env.set_var("SYS_ARCH",     Value::String(std::env::consts::ARCH.into()));
-    env.set_var("SYS_HOSTNAME", Value::String(
-        std::fs::read_to_string("/etc/hostname").unwrap_or_default().trim().into()
-    ));
-    eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/sys (builtin fallback)");
-    Ok(())
-}
-fn load_builtin_str(_detail: Option<&str>, env: &mut Env) -> Result<()> {
-    env.set_var("STR_NEWLINE", Value::String("\n".into()));
-    env.set_var("STR_TAB",     Value::String("\t".into()));
-    eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/str (builtin fallback)");
-    Ok(())
-}
-fn load_builtin_crypto(_detail: Option<&str>, env: &mut Env) -> Result<()> {
-    env.set_var("CRYPTO_SHA256_CMD", Value::String("sha256sum".into()));
-    env.set_var("CRYPTO_MD5_CMD",    Value::String("md5sum".into()));
-    eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/crypto (builtin fallback)");
-    Ok(())
-}
-fn load_builtin_proc(_detail: Option<&str>, env: &mut Env) -> Result<()> {
-    env.set_var("PROC_SELF_PID", Value::Number(std::process::id() as f64));
-    eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/proc (builtin fallback)");
-    Ok(())
-}
-fn load_builtin_colors(env: &mut Env) -> Result<()> {
-    env.set_var("COLOR_RED",    Value::String("\x1b[31m".into()));
-    env.set_var("COLOR_GREEN",  Value::String("\x1b[32m".into()));
-    env.set_var("COLOR_YELLOW", Value::String("\x1b[33m".into()));
-    env.set_var("COLOR_CYAN",   Value::String("\x1b[36m".into()));
-    env.set_var("COLOR_RESET",  Value::String("\x1b[0m".into()));
-    env.set_var("COLOR_BOLD",   Value::String("\x1b[1m".into()));
-    eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/colors (builtin fallback)");
-    Ok(())
-}
-fn load_builtin_cli(env: &mut Env) -> Result<()> {
-    env.set_var("CLI_ARGS_COUNT", Value::Number(std::env::args().count() as f64));
-    env.set_var("CLI_PROG_NAME", Value::String(
-        std::env::args().next().unwrap_or_else(|| "hl".into())
-    ));
-    eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/cli (builtin fallback)");
-    Ok(())
-}
-fn load_builtin_progress_bar(env: &mut Env) -> Result<()> {
-    env.set_var("PROGRESS_BAR_LOADED", Value::Bool(true));
-    eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/progress-bar (builtin fallback)");
-    Ok(())
-}
-fn load_builtin_json(env: &mut Env) -> Result<()> {
-    env.set_var("JSON_LOADED", Value::Bool(true));
-    eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/json (builtin fallback)");
-    Ok(())
-}
-fn load_builtin_hk_parser(env: &mut Env) -> Result<()> {
-    env.set_var("HK_PARSER_LOADED",  Value::Bool(true));
-    env.set_var("HK_PARSER_VERSION", Value::String("gen 1".into()));
-    eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/hk-parser (builtin fallback)");
-    Ok(())
-}
-fn load_builtin_hacker(env: &mut Env) -> Result<()> {
-    env.set_var("HACKER_PARSER_LOADED",  Value::Bool(true));
-    env.set_var("HACKER_PARSER_VERSION", Value::String("gen 1".into()));
-    eprintln!("\x1b[36m[hl main]\x1b[0m Zaladowano main/hacker (builtin fallback)");
-    Ok(())
+/// Zmienne wbudowanego fallbacku main/<lib> (gdy w MAIN_LIBS_DIR brak pliku)
+pub fn builtin_vars(lib: &str) -> Option<Vec<(String, Value)>> {
+    let s = |v: &str| Value::String(v.to_string());
+    let vars: Vec<(&str, Value)> = match lib {
+        "net" => vec![
+            ("NET_LOCALHOST", s("127.0.0.1")),
+            ("NET_BROADCAST", s("255.255.255.255")),
+        ],
+        "fs" => vec![
+            ("FS_HOME",    Value::String(dirs::home_dir().map(|p| p.display().to_string()).unwrap_or_default())),
+            ("FS_TMP",     s("/tmp")),
+            ("FS_ETC",     s("/etc")),
+            ("FS_VAR_LOG", s("/var/log")),
+        ],
+        "sys" => vec![
+            ("SYS_ARCH",     s(std::env::consts::ARCH)),
+            ("SYS_HOSTNAME", s(std::fs::read_to_string("/etc/hostname").unwrap_or_default().trim())),
+        ],
+        "str" => vec![
+            ("STR_NEWLINE", s("\n")),
+            ("STR_TAB",     s("\t")),
+        ],
+        "crypto" => vec![
+            ("CRYPTO_SHA256_CMD", s("sha256sum")),
+            ("CRYPTO_MD5_CMD",    s("md5sum")),
+        ],
+        "proc" => vec![("PROC_SELF_PID", Value::Number(std::process::id() as f64))],
+        "colors" => vec![
+            ("COLOR_RED",    s("\x1b[31m")),
+            ("COLOR_GREEN",  s("\x1b[32m")),
+            ("COLOR_YELLOW", s("\x1b[33m")),
+            ("COLOR_CYAN",   s("\x1b[36m")),
+            ("COLOR_RESET",  s("\x1b[0m")),
+            ("COLOR_BOLD",   s("\x1b[1m")),
+        ],
+        "cli" => vec![
+            ("CLI_ARGS_COUNT", Value::Number(std::env::args().count() as f64)),
+            ("CLI_PROG_NAME",  Value::String(std::env::args().next().unwrap_or_else(|| "hl".into()))),
+        ],
+        "progress-bar" => vec![("PROGRESS_BAR_LOADED", Value::Bool(true))],
+        "json"         => vec![("JSON_LOADED", Value::Bool(true))],
+        "hk-parser" => vec![
+            ("HK_PARSER_LOADED",  Value::Bool(true)),
+            ("HK_PARSER_VERSION", s("gen 1")),
+        ],
+        "hacker" => vec![
+            ("HACKER_PARSER_LOADED",  Value::Bool(true)),
+            ("HACKER_PARSER_VERSION", s("gen 1")),
+        ],
+        _ => return None,
+    };
+    Some(vars.into_iter().map(|(k, v)| (k.to_string(), v)).collect())
 }
 
 // ── CLI helpers ───────────────────────────────────────────────────────────────
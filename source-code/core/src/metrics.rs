@@ -0,0 +1,389 @@
+//! Metryki runtime: liczniki, wskaźniki i histogramy (`HL_METRICS`)
+//!
+//! `HL_METRICS=json` albo `HL_METRICS=openmetrics` włącza zbieranie; bez tej
+//! zmiennej każde wywołanie kończy się na jednym odczycie atomika.
+//!
+//!  - liczniki są per wątek: wątek pisze tylko do własnego bloku `AtomicU64`
+//!    (load + store, bez instrukcji `lock`), migawka sumuje bloki wszystkich
+//!    wątków; blok kończącego się wątku jest doliczany do sumy zakończonych
+//!    i wraca do puli,
+//!  - histogramy mają stałe kubełki log2 na `AtomicU64` — `fetch_add`, bez blokad,
+//!  - wskaźniki (gauge) trzymają maksimum (`fetch_max`).
+//!
+//! Raport idzie przy wyjściu procesu (atexit — także po `process::exit`) na
+//! stderr albo pod `HL_METRICS_ADDR`: `unix:/ścieżka`, `tcp:host:port` lub
+//! ścieżka pliku (dopisywanie). Z `HL_METRICS_INTERVAL=N` raport jest
+//! wysyłany dodatkowo co N sekund — dla długich procesów (`hl shell`, demon).
+//! Wartości są narastające, więc kolejne raporty można wprost nanosić na wykres.
+
+use std::io::Write;
+use std::sync::atomic::{AtomicBool, AtomicU64, AtomicU8, Ordering};
+use std::sync::Mutex;
+use std::time::{Duration, Instant};
+
+const MODE_OFF:         u8 = 0;
+const MODE_JSON:        u8 = 1;
+const MODE_OPENMETRICS: u8 = 2;
+
+static MODE: AtomicU8 = AtomicU8::new(MODE_OFF);
+static PID:  AtomicU64 = AtomicU64::new(0);
+
+/// Czy metryki są zbierane (`init` z ustawionym `HL_METRICS`)
+#[inline(always)]
+pub fn enabled() -> bool {
+    MODE.load(Ordering::Relaxed) != MODE_OFF
+}
+
+// ── Nazwy ─────────────────────────────────────────────────────────────────────
+
+macro_rules! metric_enum {
+    ($ty:ident, $names:ident, $count:ident { $($var:ident => $name:literal, $help:literal;)* }) => {
+        #[derive(Debug, Clone, Copy, PartialEq, Eq)]
+        #[repr(usize)]
+        pub enum $ty { $($var),* }
+        const $names: &[(&str, &str)] = &[$(($name, $help)),*];
+        const $count: usize = $names.len();
+    };
+}
+
+metric_enum!(Counter, COUNTER_NAMES, N_COUNTERS {
+    Spawns          => "spawns",              "Procesy uruchomione przez posix_spawn";
+    SpawnErrors     => "spawn_errors",        "Nieudane uruchomienia procesów";
+    InterpInsns     => "interp_instructions", "Instrukcje wykonane przez interpreter bytecode";
+    JitCompiles     => "jit_compiles",        "Trasy JIT zdefiniowane (kompilacja albo cache)";
+    JitTraceRuns    => "jit_trace_runs",      "Wejścia do skompilowanych tras";
+    JitDeopts       => "jit_deopts",          "Wyjścia z tras przez guard (deopt)";
+    JitCacheHits    => "jit_cache_hits",      "Trasy wczytane z trwałego cache JIT";
+    JitCacheMisses  => "jit_cache_misses",    "Trasy bez wpisu w trwałym cache JIT";
+    BcCacheHits     => "bc_cache_hits",       "Trafienia cache bytecode";
+    BcCacheMisses   => "bc_cache_misses",     "Kompilacje do cache bytecode";
+    GoSpawned       => "goroutines",          "Uruchomione goroutines";
+    ChanSends       => "chan_sends",          "Wysłania do kanałów";
+    ChanRecvs       => "chan_recvs",          "Odbiory z kanałów";
+    ChanBlocked     => "chan_blocked",        "Operacje na kanałach, które musiały czekać";
+    ArenaCalls      => "arena_calls",         "Wywołania arena functions";
+    ArenaOverflows  => "arena_overflows",     "Wywołania, w których arena się przepełniła";
+    ArenaEscaped    => "arena_escaped_bytes", "Bajty skopiowane z aren przy wyjściu";
+});
+
+metric_enum!(Hist, HIST_NAMES, N_HISTS {
+    SpawnNs         => "spawn_seconds",       "Czas posix_spawn (fork + exec)";
+    WaitNs          => "wait_seconds",        "Czas od startu procesu do jego zakończenia (waitpid)";
+    JitCompileNs    => "jit_compile_seconds", "Czas definicji jednej trasy JIT";
+    GoQueueDepth    => "go_queue_depth",      "Zadania goroutines w kolejce przy każdym spawn";
+    ChanDepth       => "chan_depth",          "Długość kolejki kanału po wysłaniu";
+    ArenaUsed       => "arena_used_bytes",    "Bajty zajęte w arenie na wywołanie";
+});
+
+metric_enum!(Gauge, GAUGE_NAMES, N_GAUGES {
+    InternerStrings => "interner_strings",    "Stringi w internerze (maks. na interpreter)";
+    InternerBytes   => "interner_bytes",      "Bajty stringów w internerze (maks.)";
+    HeapStrings     => "heap_strings_live",   "Żywe stringi na stercie interpretera (maks.)";
+    JitCodeBytes    => "jit_code_bytes",      "Kod maszynowy tras JIT (maks.)";
+});
+
+/// Histogramy opóźnień liczone w nanosekundach, raportowane w sekundach
+fn is_latency(h: usize) -> bool { HIST_NAMES[h].0.ends_with("_seconds") }
+
+// ── Liczniki per wątek ────────────────────────────────────────────────────────
+
+struct Block([AtomicU64; N_COUNTERS]);
+
+impl Block {
+    fn new() -> Self { Self(std::array::from_fn(|_| AtomicU64::new(0))) }
+}
+
+struct Blocks {
+    live:    Vec<&'static Block>,
+    free:    Vec<&'static Block>,
+    /// Suma bloków wątków, które się zakończyły
+    retired: [u64; N_COUNTERS],
+}
+
+static BLOCKS: Mutex<Blocks> = Mutex::new(Blocks { live: Vec::new(), free: Vec::new(), retired: [0; N_COUNTERS] });
+
+/// Blok wątku; przy końcu wątku przenosi swoje wartości do `retired`
+struct Local(&'static Block);
+
+impl Local {
+    fn acquire() -> Self {
+        let mut g = BLOCKS.lock().unwrap_or_else(|e| e.into_inner());
+        // Bloki żyją do końca procesu — wątki się zmieniają, pula nie rośnie
+        let b = g.free.pop().unwrap_or_else(|| Box::leak(Box::new(Block::new())));
+        g.live.push(b);
+        Self(b)
+    }
+}
+
+impl Drop for Local {
+    fn drop(&mut self) {
+        let mut g = BLOCKS.lock().unwrap_or_else(|e| e.into_inner());
+        for (i, a) in self.0.0.iter().enumerate() {
+            g.retired[i] += a.swap(0, Ordering::Relaxed);
+        }
+        g.live.retain(|b| !std::ptr::eq(*b, self.0));
+        g.free.push(self.0);
+    }
+}
+
+thread_local! {
+    static LOCAL: Local = Local::acquire();
+}
+
+/// Dolicz `n` do licznika bieżącego wątku
+#[inline]
+pub fn add(c: Counter, n: u64) {
+    if !enabled() { return; }
+    // Zakończony wątek (destruktory TLS) — wartość przepada, nie panikujemy
+    let _ = LOCAL.try_with(|l| {
+        let a = &l.0.0[c as usize];
+        a.store(a.load(Ordering::Relaxed).wrapping_add(n), Ordering::Relaxed);
+    });
+}
+
+#[inline]
+pub fn inc(c: Counter) { add(c, 1) }
+
+// ── Histogramy i wskaźniki ────────────────────────────────────────────────────
+
+/// Kubełek i: wartości o długości bitowej i, czyli [2^(i-1), 2^i); 0 → kubełek 0
+const BUCKETS: usize = 65;
+
+struct Histogram {
+    buckets: [AtomicU64; BUCKETS],
+    count:   AtomicU64,
+    sum:     AtomicU64,
+}
+
+static HISTS: [Histogram; N_HISTS] = [const { Histogram {
+    buckets: [const { AtomicU64::new(0) }; BUCKETS],
+    count:   AtomicU64::new(0),
+    sum:     AtomicU64::new(0),
+} }; N_HISTS];
+
+static GAUGES: [AtomicU64; N_GAUGES] = [const { AtomicU64::new(0) }; N_GAUGES];
+
+/// Zapisz obserwację w histogramie
+#[inline]
+pub fn observe(h: Hist, v: u64) {
+    if !enabled() { return; }
+    let hist = &HISTS[h as usize];
+    let b = (u64::BITS - v.leading_zeros()) as usize;
+    hist.buckets[b].fetch_add(1, Ordering::Relaxed);
+    hist.count.fetch_add(1, Ordering::Relaxed);
+    hist.sum.fetch_add(v, Ordering::Relaxed);
+}
+
+/// Czas od `t0` w nanosekundach
+#[inline]
+pub fn observe_since(h: Hist, t0: Instant) {
+    if !enabled() { return; }
+    observe(h, t0.elapsed().as_nanos().min(u64::MAX as u128) as u64);
+}
+
+/// `Some(Instant::now())` tylko przy włączonych metrykach — bez zegara na gorącej ścieżce
+#[inline]
+pub fn start() -> Option<Instant> {
+    enabled().then(Instant::now)
+}
+
+/// Podnieś wskaźnik do `v`, jeśli jest wyższe
+#[inline]
+pub fn gauge_max(g: Gauge, v: u64) {
+    if !enabled() { return; }
+    GAUGES[g as usize].fetch_max(v, Ordering::Relaxed);
+}
+
+// ── Migawka ───────────────────────────────────────────────────────────────────
+
+#[derive(Debug, Clone, Default)]
+pub struct HistSnapshot {
+    /// (górna granica kubełka, liczba w kubełku) — tylko niepuste
+    pub buckets: Vec<(u64, u64)>,
+    pub count:   u64,
+    pub sum:     u64,
+}
+
+#[derive(Debug, Clone, Default)]
+pub struct Snapshot {
+    pub counters: Vec<(&'static str, u64)>,
+    pub gauges:   Vec<(&'static str, u64)>,
+    pub hists:    Vec<(&'static str, HistSnapshot)>,
+}
+
+/// Źródła spoza `hl-core` (np. cache bytecode w `hl-compiler`) — wołane przed
+/// każdą migawką, dopisują swoje przyrosty przez `add`
+static COLLECTORS: Mutex<Vec<fn()>> = Mutex::new(Vec::new());
+
+pub fn add_collector(f: fn()) {
+    COLLECTORS.lock().unwrap_or_else(|e| e.into_inner()).push(f);
+}
+
+pub fn snapshot() -> Snapshot {
+    let collectors = COLLECTORS.lock().unwrap_or_else(|e| e.into_inner()).clone();
+    for f in collectors { f(); }
+
+    let totals = {
+        let g = BLOCKS.lock().unwrap_or_else(|e| e.into_inner());
+        let mut t = g.retired;
+        for b in &g.live {
+            for (t, a) in t.iter_mut().zip(b.0.iter()) { *t += a.load(Ordering::Relaxed); }
+        }
+        t
+    };
+    Snapshot {
+        counters: COUNTER_NAMES.iter().zip(totals).map(|(n, v)| (n.0, v)).collect(),
+        gauges:   GAUGE_NAMES.iter().zip(&GAUGES).map(|(n, g)| (n.0, g.load(Ordering::Relaxed))).collect(),
+        hists:    HIST_NAMES.iter().zip(&HISTS).map(|(n, h)| (n.0, HistSnapshot {
+            buckets: h.buckets.iter().enumerate()
+                .map(|(i, b)| (if i >= 64 { u64::MAX } else { 1u64 << i }, b.load(Ordering::Relaxed)))
+                .filter(|&(_, c)| c > 0)
+                .collect(),
+            count: h.count.load(Ordering::Relaxed),
+            sum:   h.sum.load(Ordering::Relaxed),
+        })).collect(),
+    }
+}
+
+// ── Formaty ───────────────────────────────────────────────────────────────────
+
+/// JSON: `{"pid", "counters": {..}, "gauges": {..}, "histograms": {nazwa:
+/// {"count", "sum", "buckets": [[le, n], ..]}}}`; opóźnienia w nanosekundach
+pub fn render_json(s: &Snapshot) -> String {
+    use serde_json::{json, Map, Value};
+    let flat = |v: &[(&str, u64)]| v.iter().map(|(n, x)| (n.to_string(), json!(x))).collect::<Map<String, Value>>();
+    let hists: Map<String, Value> = s.hists.iter().map(|(n, h)| {
+        let name = n.strip_suffix("_seconds").map(|b| format!("{}_ns", b)).unwrap_or_else(|| n.to_string());
+        (name, json!({ "count": h.count, "sum": h.sum, "buckets": h.buckets }))
+    }).collect();
+    json!({
+        "pid":        std::process::id(),
+        "counters":   flat(&s.counters),
+        "gauges":     flat(&s.gauges),
+        "histograms": hists,
+    }).to_string()
+}
+
+/// OpenMetrics (tekst): prefiks `hl_`, histogramy skumulowane, opóźnienia w sekundach
+pub fn render_openmetrics(s: &Snapshot) -> String {
+    use std::fmt::Write as _;
+    let mut out = String::new();
+    for ((name, v), (_, help)) in s.counters.iter().zip(COUNTER_NAMES) {
+        let _ = write!(out, "# TYPE hl_{name} counter\n# HELP hl_{name} {help}\nhl_{name}_total {v}\n");
+    }
+    for ((name, v), (_, help)) in s.gauges.iter().zip(GAUGE_NAMES) {
+        let _ = write!(out, "# TYPE hl_{name} gauge\n# HELP hl_{name} {help}\nhl_{name} {v}\n");
+    }
+    for (i, ((name, h), (_, help))) in s.hists.iter().zip(HIST_NAMES).enumerate() {
+        let scale = if is_latency(i) { 1e-9 } else { 1.0 };
+        let _ = write!(out, "# TYPE hl_{name} histogram\n# HELP hl_{name} {help}\n");
+        let mut cum = 0;
+        for &(le, n) in &h.buckets {
+            cum += n;
+            if le == u64::MAX { continue; }
+            let _ = writeln!(out, "hl_{name}_bucket{{le=\"{}\"}} {cum}", le as f64 * scale);
+        }
+        let _ = writeln!(out, "hl_{name}_bucket{{le=\"+Inf\"}} {}", h.count);
+        let _ = writeln!(out, "hl_{name}_count {}", h.count);
+        let _ = writeln!(out, "hl_{name}_sum {}", h.sum as f64 * scale);
+    }
+    out.push_str("# EOF\n");
+    out
+}
+
+// ── Wyjście ───────────────────────────────────────────────────────────────────
+
+/// Odczytaj `HL_METRICS`; przy włączonych metrykach zarejestruj raport przy
+/// wyjściu procesu (i wątek raportów okresowych z `HL_METRICS_INTERVAL`).
+/// Wołane raz, na starcie `hl`.
+pub fn init() {
+    let mode = match std::env::var("HL_METRICS").as_deref() {
+        Ok("json")                           => MODE_JSON,
+        Ok("openmetrics") | Ok("prometheus") => MODE_OPENMETRICS,
+        Ok("") | Ok("0") | Err(_)            => return,
+        Ok(other) => {
+            tracing::warn!("HL_METRICS={}: nieznany format (json | openmetrics)", other);
+            return;
+        }
+    };
+    static STARTED: AtomicBool = AtomicBool::new(false);
+    if STARTED.swap(true, Ordering::AcqRel) { return; }
+    PID.store(std::process::id() as u64, Ordering::Relaxed);
+    MODE.store(mode, Ordering::Relaxed);
+
+    extern "C" fn at_exit() { emit(); }
+    // SAFETY: at_exit nie przyjmuje argumentów i nie wraca przez unwinding
+    unsafe { libc::atexit(at_exit); }
+
+    let interval = std::env::var("HL_METRICS_INTERVAL").ok()
+        .and_then(|s| s.trim().parse::<u64>().ok())
+        .filter(|&s| s > 0);
+    if let Some(secs) = interval {
+        let _ = std::thread::Builder::new().name("hl-metrics".into()).spawn(move || loop {
+            std::thread::sleep(Duration::from_secs(secs));
+            emit();
+        });
+    }
+}
+
+/// Wyślij raport. Potomek po `fork` (workery demona, goroutines AST) nie
+/// raportuje — jego liczniki są kopią rodzica.
+pub fn emit() {
+    let mode = MODE.load(Ordering::Relaxed);
+    if mode == MODE_OFF || PID.load(Ordering::Relaxed) != std::process::id() as u64 { return; }
+    let snap = snapshot();
+    let body = if mode == MODE_JSON { render_json(&snap) + "\n" } else { render_openmetrics(&snap) };
+    if let Err(e) = write_out(body.as_bytes()) {
+        eprintln!("hl: metryki: {}", e);
+    }
+}
+
+fn write_out(body: &[u8]) -> std::io::Result<()> {
+    let addr = std::env::var("HL_METRICS_ADDR").unwrap_or_default();
+    if let Some(path) = addr.strip_prefix("unix:") {
+        std::os::unix::net::UnixStream::connect(path)?.write_all(body)
+    } else if let Some(hp) = addr.strip_prefix("tcp:") {
+        let mut s = std::net::TcpStream::connect(hp)?;
+        s.set_write_timeout(Some(Duration::from_secs(2)))?;
+        s.write_all(body)
+    } else if !addr.is_empty() {
+        std::fs::OpenOptions::new().create(true).append(true).open(&addr)?.write_all(body)
+    } else {
+        std::io::stderr().lock().write_all(body)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_counters_histograms_and_formats() {
+        MODE.store(MODE_JSON, Ordering::Relaxed);
+        add(Counter::Spawns, 2);
+        std::thread::spawn(|| inc(Counter::Spawns)).join().unwrap();
+        observe(Hist::ChanDepth, 0);
+        observe(Hist::ChanDepth, 5);
+        observe(Hist::ChanDepth, 6);
+        gauge_max(Gauge::InternerBytes, 10);
+        gauge_max(Gauge::InternerBytes, 4);
+
+        let s = snapshot();
+        let get = |v: &[(&str, u64)], n: &str| v.iter().find(|(k, _)| *k == n).map(|(_, x)| *x);
+        // Wątek pomocniczy skończył się — jego licznik jest w `retired`
+        assert!(get(&s.counters, "spawns").unwrap() >= 3);
+        assert_eq!(get(&s.gauges, "interner_bytes"), Some(10));
+        let (_, h) = s.hists.iter().find(|(n, _)| *n == "chan_depth").unwrap();
+        assert_eq!(h.count, 3);
+        assert_eq!(h.sum, 11);
+        assert_eq!(h.buckets, vec![(1, 1), (8, 2)]);
+
+        let om = render_openmetrics(&s);
+        assert!(om.contains("hl_chan_depth_bucket{le=\"8\"} 3\n"));
+        assert!(om.contains("hl_spawns_total "));
+        assert!(om.ends_with("# EOF\n"));
+        let js: serde_json::Value = serde_json::from_str(&render_json(&s)).unwrap();
+        assert_eq!(js["histograms"]["chan_depth"]["count"], 3);
+        assert!(js["histograms"]["spawn_ns"].is_object());
+    }
+}
@@ -1,49 +1,252 @@
+use std::cell::RefCell;
+use std::fmt::Write as _;
+use std::io::Write as _;
 use anyhow::{bail, Result};
+use memchr::{memchr_iter, memmem};
 use hl_parser::ast::StringPart;
+use hl_parser::quick_fn::QuickFn;
 use crate::env::{Env, Value};
 use crate::executor::ExecResult;
 
-pub fn exec_quick(name: &str, args: &[StringPart], env: &mut Env) -> Result<ExecResult> {
-    let arg_str = env.resolve_string_parts(args);
-    let arg_str = arg_str.trim();
-
-    match name {
-        "upper"      => { println!("{}", arg_str.to_uppercase()); Ok(ExecResult::ok()) }
-        "lower"      => { println!("{}", arg_str.to_lowercase()); Ok(ExecResult::ok()) }
-        "len"        => { println!("{}", arg_str.len()); Ok(ExecResult::ok()) }
-        "trim"       => { println!("{}", arg_str.trim()); Ok(ExecResult::ok()) }
-        "rev"        => { println!("{}", arg_str.chars().rev().collect::<String>()); Ok(ExecResult::ok()) }
-        "repeat"     => {
-            let (text, n) = split_last(arg_str);
-            println!("{}", text.repeat(n.parse().unwrap_or(1)));
-            Ok(ExecResult::ok())
-        }
-        "replace" => {
-            let parts: Vec<&str> = arg_str.splitn(3, ' ').collect();
-            if parts.len() < 3 { bail!(":: replace wymaga: :: replace <text> <from> <to>"); }
-            println!("{}", parts[0].replace(parts[1], parts[2]));
-            Ok(ExecResult::ok())
-        }
-        "contains"   => { let (t, p) = split_last(arg_str); let r = t.contains(p);    env.set_var("_last_bool", Value::Bool(r)); println!("{}", r); Ok(if r { ExecResult::ok() } else { ExecResult::err(1) }) }
-        "startswith" => { let (t, p) = split_last(arg_str); let r = t.starts_with(p); env.set_var("_last_bool", Value::Bool(r)); println!("{}", r); Ok(if r { ExecResult::ok() } else { ExecResult::err(1) }) }
-        "endswith"   => { let (t, p) = split_last(arg_str); let r = t.ends_with(p);   env.set_var("_last_bool", Value::Bool(r)); println!("{}", r); Ok(if r { ExecResult::ok() } else { ExecResult::err(1) }) }
-        "split"      => { let (t, s) = split_last(arg_str); for p in t.split(s) { println!("{}", p); } Ok(ExecResult::ok()) }
-        "lines"      => { for l in arg_str.lines() { println!("{}", l); } Ok(ExecResult::ok()) }
-        "words"      => { for w in arg_str.split_whitespace() { println!("{}", w); } Ok(ExecResult::ok()) }
-        "abs"   => { let n: f64 = arg_str.parse().unwrap_or(0.0); println!("{}", n.abs()); Ok(ExecResult::ok()) }
-        "ceil"  => { let n: f64 = arg_str.parse().unwrap_or(0.0); println!("{}", n.ceil() as i64); Ok(ExecResult::ok()) }
-        "floor" => { let n: f64 = arg_str.parse().unwrap_or(0.0); println!("{}", n.floor() as i64); Ok(ExecResult::ok()) }
-        "round" => { let n: f64 = arg_str.parse().unwrap_or(0.0); println!("{}", n.round() as i64); Ok(ExecResult::ok()) }
-        "max"   => { let (a,b) = split_last(arg_str); let a:f64=a.trim().parse().unwrap_or(0.0); let b:f64=b.trim().parse().unwrap_or(0.0); println!("{}", if a>b{a}else{b}); Ok(ExecResult::ok()) }
-        "min"   => { let (a,b) = split_last(arg_str); let a:f64=a.trim().parse().unwrap_or(0.0); let b:f64=b.trim().parse().unwrap_or(0.0); println!("{}", if a<b{a}else{b}); Ok(ExecResult::ok()) }
-        "rand"  => {
-            let seed = std::time::SystemTime::now().duration_since(std::time::UNIX_EPOCH).unwrap_or_default().subsec_nanos() as u64;
-            println!("{}", (seed.wrapping_mul(6364136223846793005).wrapping_add(1442695040888963407)) % 100);
-            Ok(ExecResult::ok())
-        }
-        "env"  => { match std::env::var(arg_str) { Ok(v) => { println!("{}", v); Ok(ExecResult::ok()) } Err(_) => { println!(); Ok(ExecResult::err(1)) } } }
+// ── Kernele wspólne dla executora i interpretera bytecode ─────────────────────
+
+/// Wynik czystej quick-funkcji
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum Kernel {
+    /// Wynik dopisany do `out`
+    Text,
+    /// Wynikiem jest argument bez zmian — wywołujący oddaje wejście
+    Same,
+    Num(f64),
+    /// Predykat (`contains`, `exists`…) — runtime ustawia `_last_bool`
+    Bool(bool),
+}
+
+/// Czyste quick-funkcje na bajtach argumentu. Wynik tekstowy trafia do `out`
+/// (bufor wywołującego, czyszczony przez niego), więc wywołanie w pętli nie
+/// alokuje. `Ok(None)` — funkcja z efektami (zmienne, wyjście, procesy),
+/// obsługuje ją runtime.
+pub fn kernel(f: QuickFn, arg: &str, out: &mut String) -> Result<Option<Kernel>> {
+    use QuickFn as Q;
+    Ok(Some(match f {
+        Q::Upper => { map_ascii_case(arg, out, true);  Kernel::Text }
+        Q::Lower => { map_ascii_case(arg, out, false); Kernel::Text }
+        Q::Len   => Kernel::Num(arg.len() as f64),
+        Q::Trim  => {
+            let t = arg.trim();
+            if t.len() == arg.len() { return Ok(Some(Kernel::Same)); }
+            out.push_str(t);
+            Kernel::Text
+        }
+        Q::Rev => {
+            if arg.is_ascii() {
+                let start = out.len();
+                out.push_str(arg);
+                // SAFETY: odwrócenie bajtów ASCII zostawia poprawny UTF-8
+                unsafe { out.as_mut_vec()[start..].reverse() };
+            } else {
+                out.extend(arg.chars().rev());
+            }
+            Kernel::Text
+        }
+        Q::Repeat => {
+            let (text, n) = split_last(arg);
+            let n: usize = n.parse().unwrap_or(1);
+            out.reserve(text.len().saturating_mul(n));
+            for _ in 0..n { out.push_str(text); }
+            Kernel::Text
+        }
+        Q::Replace => {
+            let mut it = arg.splitn(3, ' ');
+            let (Some(text), Some(from), Some(to)) = (it.next(), it.next(), it.next()) else {
+                bail!(":: replace wymaga: :: replace <text> <from> <to>");
+            };
+            replace_into(text, from, to, out);
+            Kernel::Text
+        }
+        Q::Contains => {
+            let (t, p) = split_last(arg);
+            Kernel::Bool(memmem::find(t.as_bytes(), p.as_bytes()).is_some())
+        }
+        Q::StartsWith => { let (t, p) = split_last(arg); Kernel::Bool(t.starts_with(p)) }
+        Q::EndsWith   => { let (t, p) = split_last(arg); Kernel::Bool(t.ends_with(p)) }
+        // Części jedna pod drugą — czyli separator zamieniony na '\n'
+        Q::Split => {
+            let (t, sep) = split_last(arg);
+            if sep.is_empty() { out.push_str(t) } else { replace_into(t, sep, "\n", out) }
+            Kernel::Text
+        }
+        Q::Lines => {
+            let b = arg.as_bytes();
+            let base = out.len();
+            let mut start = 0;
+            for nl in memchr_iter(b'\n', b) {
+                let end = if nl > start && b[nl - 1] == b'\r' { nl - 1 } else { nl };
+                out.push_str(&arg[start..end]);
+                out.push('\n');
+                start = nl + 1;
+            }
+            if start < b.len() { out.push_str(&arg[start..]) } else if out.len() > base { out.pop(); }
+            Kernel::Text
+        }
+        Q::Words => {
+            for (i, w) in arg.split_whitespace().enumerate() {
+                if i > 0 { out.push('\n'); }
+                out.push_str(w);
+            }
+            Kernel::Text
+        }
+        Q::Abs   => Kernel::Num(num(arg).abs()),
+        Q::Ceil  => Kernel::Num(num(arg).ceil()),
+        Q::Floor => Kernel::Num(num(arg).floor()),
+        Q::Round => Kernel::Num(num(arg).round()),
+        Q::Max | Q::Min => {
+            let (a, b) = split_last(arg);
+            let (a, b) = (num(a), num(b));
+            Kernel::Num(if (f == Q::Max) == (a > b) { a } else { b })
+        }
+        Q::Rand => {
+            let seed = std::time::SystemTime::now().duration_since(std::time::UNIX_EPOCH)
+                .unwrap_or_default().subsec_nanos() as u64;
+            Kernel::Num((seed.wrapping_mul(6364136223846793005).wrapping_add(1442695040888963407) % 100) as f64)
+        }
+        Q::Basename => {
+            out.push_str(std::path::Path::new(arg).file_name().and_then(|n| n.to_str()).unwrap_or(""));
+            Kernel::Text
+        }
+        Q::Dirname => {
+            out.push_str(std::path::Path::new(arg).parent().and_then(|n| n.to_str()).unwrap_or("."));
+            Kernel::Text
+        }
+        Q::Exists => Kernel::Bool(std::fs::metadata(arg).is_ok()),
+        Q::IsDir  => Kernel::Bool(std::fs::metadata(arg).is_ok_and(|m| m.is_dir())),
+        Q::IsFile => Kernel::Bool(std::fs::metadata(arg).is_ok_and(|m| m.is_file())),
+        _ => return Ok(None),
+    }))
+}
+
+/// Liczba w postaci, w jakiej wypisuje ją HL (`3`, `2.5`)
+pub fn push_num(out: &mut String, n: f64) {
+    if n.fract() == 0.0 && n.abs() < 1e15 {
+        let _ = write!(out, "{}", n as i64);
+    } else {
+        let _ = write!(out, "{}", n);
+    }
+}
+
+/// Zmiana wielkości liter. ASCII: kopia i bezgałęziowa pętla po bajtach,
+/// którą kompilator wektoryzuje (16/32 bajty na iterację); reszta — Unicode
+fn map_ascii_case(s: &str, out: &mut String, upper: bool) {
+    if !s.is_ascii() {
+        out.push_str(&if upper { s.to_uppercase() } else { s.to_lowercase() });
+        return;
+    }
+    let start = out.len();
+    out.push_str(s);
+    let first = if upper { b'a' } else { b'A' };
+    // SAFETY: zmieniamy tylko litery ASCII na litery ASCII
+    let bytes = unsafe { &mut out.as_mut_vec()[start..] };
+    for b in bytes.iter_mut() {
+        let letter = b.wrapping_sub(first) < 26;
+        *b ^= (letter as u8) << 5;
+    }
+}
+
+/// `text.replace(from, to)` dopisane do `out` — wyszukiwanie memchr/memmem
+fn replace_into(text: &str, from: &str, to: &str, out: &mut String) {
+    if from.is_empty() {
+        out.push_str(&text.replace(from, to));
+        return;
+    }
+    let mut last = 0;
+    let mut push = |at: usize, out: &mut String| {
+        out.push_str(&text[last..at]);
+        out.push_str(to);
+        last = at + from.len();
+    };
+    if let [byte] = from.as_bytes() {
+        for at in memchr_iter(*byte, text.as_bytes()) { push(at, out); }
+    } else {
+        for at in memmem::find_iter(text.as_bytes(), from.as_bytes()) { push(at, out); }
+    }
+    out.push_str(&text[last..]);
+}
+
+#[inline]
+fn num(s: &str) -> f64 {
+    s.trim().parse().unwrap_or(0.0)
+}
+
+#[inline]
+pub fn split_last(s: &str) -> (&str, &str) {
+    match s.rsplit_once(' ') { Some((a, b)) => (a.trim(), b.trim()), None => (s, "") }
+}
+
+#[inline]
+fn split_first(s: &str) -> (&str, &str) {
+    match s.split_once(' ') { Some((a, b)) => (a.trim(), b.trim()), None => (s.trim(), "") }
+}
+
+// ── Executor (AST) ────────────────────────────────────────────────────────────
+
+thread_local! {
+    /// (argument, wynik) — bufory wielokrotnego użytku dla wywołań w pętli
+    static BUFS: RefCell<(String, String)> = const { RefCell::new((String::new(), String::new())) };
+}
+
+/// Argument wywołania zinterpolowany do bufora wątku; `f` dostaje go
+/// przyciętego razem z wyczyszczonym buforem wyniku
+fn with_bufs<R>(args: &[StringPart], env: &mut Env, f: impl FnOnce(&str, &mut String, &mut Env) -> R) -> R {
+    BUFS.with(|b| {
+        let (arg, out) = &mut *b.borrow_mut();
+        arg.clear();
+        out.clear();
+        env.append_parts(args, arg);
+        f(arg.trim(), out, env)
+    })
+}
+
+fn unknown(name: &str) -> anyhow::Error {
+    anyhow::anyhow!("Nieznana quick-funkcja '::{}'. Zdefiniuj ją jako arena function: :: {} <4k> def ... done", name, name)
+}
+
+pub fn exec_quick(name: &str, func: Option<QuickFn>, args: &[StringPart], env: &mut Env) -> Result<ExecResult> {
+    let Some(f) = func else { return Err(unknown(name)) };
+    with_bufs(args, env, |arg, out, env| {
+        let k = match kernel(f, arg, out)? {
+            Some(k) => k,
+            None    => return exec_effect(f, arg, env),
+        };
+        let mut so = std::io::stdout().lock();
+        match k {
+            // `lines`/`words` z pustego wejścia nic nie wypisują
+            Kernel::Text if out.is_empty() && matches!(f, QuickFn::Lines | QuickFn::Words) => {}
+            Kernel::Text   => { out.push('\n'); let _ = so.write_all(out.as_bytes()); }
+            Kernel::Same   => { let _ = writeln!(so, "{}", arg); }
+            Kernel::Num(n) => { push_num(out, n); out.push('\n'); let _ = so.write_all(out.as_bytes()); }
+            Kernel::Bool(b) => {
+                env.set_var("_last_bool", Value::Bool(b));
+                // exists/isdir/isfile odpowiadają tylko kodem wyjścia
+                if matches!(f, QuickFn::Contains | QuickFn::StartsWith | QuickFn::EndsWith) {
+                    let _ = writeln!(so, "{}", b);
+                }
+                return Ok(if b { ExecResult::ok() } else { ExecResult::err(1) });
+            }
+        }
+        Ok(ExecResult::ok())
+    })
+}
+
+/// Quick-funkcje z efektami w executorze
+fn exec_effect(f: QuickFn, arg_str: &str, env: &mut Env) -> Result<ExecResult> {
+    use QuickFn as Q;
+    match f {
+        Q::Env => match std::env::var(arg_str) {
+            Ok(v)  => { println!("{}", v); Ok(ExecResult::ok()) }
+            Err(_) => { println!(); Ok(ExecResult::err(1)) }
+        },
         // ::env-path — ścieżka aktywnego env z config.hk, zero subprocess
-        "env-path" => {
+        Q::EnvPath => {
             use crate::config::get_active_env;
             match get_active_env() {
                 Some((_name, path)) => { println!("{}", path.display()); Ok(ExecResult::ok()) }
@@ -51,27 +254,26 @@ pub fn exec_quick(name: &str, args: &[StringPart], env: &mut Env) -> Result<Exec
             }
         }
         // ::getenv VAR — pobierz zmienną środowiskową (alias do env, dla czytelności)
-        "getenv" => {
-            match std::env::var(arg_str) {
-                Ok(v)  => { print!("{}", v); Ok(ExecResult::ok()) }
-                Err(_) => { Ok(ExecResult::err(1)) }
-            }
-        }
-        "date" => { if let Ok(o) = std::process::Command::new("date").arg("+%Y-%m-%d").output() { print!("{}", String::from_utf8_lossy(&o.stdout)); } Ok(ExecResult::ok()) }
-        "time" => { if let Ok(o) = std::process::Command::new("date").arg("+%H:%M:%S").output() { print!("{}", String::from_utf8_lossy(&o.stdout)); } Ok(ExecResult::ok()) }
-        "pid"  => { println!("{}", std::process::id()); Ok(ExecResult::ok()) }
-        "which"=> { match which::which(arg_str) { Ok(p) => { println!("{}", p.display()); Ok(ExecResult::ok()) } Err(_) => { println!(); Ok(ExecResult::err(1)) } } }
-        "exists"   => { let e = std::path::Path::new(arg_str).exists();   env.set_var("_last_bool", Value::Bool(e)); Ok(if e { ExecResult::ok() } else { ExecResult::err(1) }) }
-        "isdir"    => { let e = std::path::Path::new(arg_str).is_dir();    env.set_var("_last_bool", Value::Bool(e)); Ok(if e { ExecResult::ok() } else { ExecResult::err(1) }) }
-        "isfile"   => { let e = std::path::Path::new(arg_str).is_file();   env.set_var("_last_bool", Value::Bool(e)); Ok(if e { ExecResult::ok() } else { ExecResult::err(1) }) }
-        "basename" => { println!("{}", std::path::Path::new(arg_str).file_name().and_then(|n|n.to_str()).unwrap_or("")); Ok(ExecResult::ok()) }
-        "dirname"  => { println!("{}", std::path::Path::new(arg_str).parent().and_then(|n|n.to_str()).unwrap_or(".")); Ok(ExecResult::ok()) }
-        "read"     => { match std::fs::read_to_string(arg_str) { Ok(c) => { print!("{}", c); Ok(ExecResult::ok()) } Err(e) => bail!(":: read '{}': {}", arg_str, e) } }
-        "set"   => { let (name, value) = split_first(arg_str); env.set_var(name, Value::String(value.to_string())); Ok(ExecResult::ok()) }
-        "get"   => { println!("{}", env.get_var(arg_str).to_string_val()); Ok(ExecResult::ok()) }
-        "type"  => {
+        Q::Getenv => match std::env::var(arg_str) {
+            Ok(v)  => { print!("{}", v); Ok(ExecResult::ok()) }
+            Err(_) => Ok(ExecResult::err(1)),
+        },
+        Q::Date => { if let Ok(o) = std::process::Command::new("date").arg("+%Y-%m-%d").output() { print!("{}", String::from_utf8_lossy(&o.stdout)); } Ok(ExecResult::ok()) }
+        Q::Time => { if let Ok(o) = std::process::Command::new("date").arg("+%H:%M:%S").output() { print!("{}", String::from_utf8_lossy(&o.stdout)); } Ok(ExecResult::ok()) }
+        Q::Pid  => { println!("{}", std::process::id()); Ok(ExecResult::ok()) }
+        Q::Which => match which::which(arg_str) {
+            Ok(p)  => { println!("{}", p.display()); Ok(ExecResult::ok()) }
+            Err(_) => { println!(); Ok(ExecResult::err(1)) }
+        },
+        Q::Read => match std::fs::read_to_string(arg_str) {
+            Ok(c)  => { print!("{}", c); Ok(ExecResult::ok()) }
+            Err(e) => bail!(":: read '{}': {}", arg_str, e),
+        },
+        Q::Set => { let (name, value) = split_first(arg_str); env.set_var(name, Value::String(value.to_string())); Ok(ExecResult::ok()) }
+        Q::Get => { println!("{}", env.get_var(arg_str).to_string_val()); Ok(ExecResult::ok()) }
+        Q::Type => {
             let t = match env.get_var(arg_str) {
-                Value::String(_) => "string",
+                Value::String(_) | Value::Arena(_) => "string",
                 Value::Number(_) => "number",
                 Value::Bool(_)   => "bool",
                 Value::List(_)   => "list",
@@ -79,65 +281,92 @@ pub fn exec_quick(name: &str, args: &[StringPart], env: &mut Env) -> Result<Exec
             };
             println!("{}", t); Ok(ExecResult::ok())
         }
-        "unset" => { env.vars.remove(arg_str); Ok(ExecResult::ok()) }
-        "nl"     => { println!(); Ok(ExecResult::ok()) }
-        "hr"     => { let w: usize = arg_str.parse().unwrap_or(60); println!("{}", "─".repeat(w)); Ok(ExecResult::ok()) }
-        "bold"   => { println!("\x1b[1m{}\x1b[0m", arg_str); Ok(ExecResult::ok()) }
-        "red"    => { println!("\x1b[31m{}\x1b[0m", arg_str); Ok(ExecResult::ok()) }
-        "green"  => { println!("\x1b[32m{}\x1b[0m", arg_str); Ok(ExecResult::ok()) }
-        "yellow" => { println!("\x1b[33m{}\x1b[0m", arg_str); Ok(ExecResult::ok()) }
-        "cyan"   => { println!("\x1b[36m{}\x1b[0m", arg_str); Ok(ExecResult::ok()) }
-        other    => bail!("Nieznana quick-funkcja '::{}'. Zdefiniuj ją jako arena function: :: {} <4k> def ... done", other, other),
+        Q::Unset  => { env.remove_var(arg_str); Ok(ExecResult::ok()) }
+        Q::Nl     => { println!(); Ok(ExecResult::ok()) }
+        Q::Hr     => { let w: usize = arg_str.parse().unwrap_or(60); println!("{}", "─".repeat(w)); Ok(ExecResult::ok()) }
+        Q::Bold   => { println!("\x1b[1m{}\x1b[0m", arg_str); Ok(ExecResult::ok()) }
+        Q::Red    => { println!("\x1b[31m{}\x1b[0m", arg_str); Ok(ExecResult::ok()) }
+        Q::Green  => { println!("\x1b[32m{}\x1b[0m", arg_str); Ok(ExecResult::ok()) }
+        Q::Yellow => { println!("\x1b[33m{}\x1b[0m", arg_str); Ok(ExecResult::ok()) }
+        Q::Cyan   => { println!("\x1b[36m{}\x1b[0m", arg_str); Ok(ExecResult::ok()) }
+        // Czyste funkcje obsłużył `kernel`
+        _ => Ok(ExecResult::ok()),
     }
 }
 
-#[inline] fn split_last(s: &str) -> (&str, &str) {
-match s.rsplit_once(' ') { Some((a,b)) => (a.trim(), b.trim()), None => (s, "") }
-}
-#[inline] fn split_first(s: &str) -> (&str, &str) {
-match s.splitn(2,' ').collect::<Vec<_>>().as_slice() {
-    [a,b] => (a.trim(), b.trim()), [a] => (a.trim(), ""), _ => ("","")
-}
-}
-
 /// exec_quick z przechwyceniem wyjścia do String (dla :: name args |> @var)
-/// Obsługuje bezpośrednio znane "czyste" quickcalls (bez fork/pipe overhead).
-/// Dla pozostałych: fallback przez plik tymczasowy.
-pub fn exec_quick_capture(name: &str, args: &[StringPart], env: &mut Env) -> Result<String> {
-    let arg_str = env.resolve_string_parts(args);
-    let arg_str_t = arg_str.trim();
-
-    match name {
-        "upper"    => return Ok(arg_str_t.to_uppercase()),
-        "lower"    => return Ok(arg_str_t.to_lowercase()),
-        "len"      => return Ok(arg_str_t.len().to_string()),
-        "trim"     => return Ok(arg_str_t.trim().to_string()),
-        "rev"      => return Ok(arg_str_t.chars().rev().collect::<String>()),
-        "env" | "getenv" => return Ok(std::env::var(arg_str_t).unwrap_or_default()),
-        "pid"      => return Ok(std::process::id().to_string()),
-        "basename" => return Ok(std::path::Path::new(arg_str_t)
-                          .file_name().and_then(|n| n.to_str())
-                          .unwrap_or(arg_str_t).to_string()),
-        "dirname"  => return Ok(std::path::Path::new(arg_str_t)
-                          .parent().and_then(|p| p.to_str())
-                          .unwrap_or(".").to_string()),
-        "abs"   => { let n: f64 = arg_str_t.parse().unwrap_or(0.0); return Ok(n.abs().to_string()); }
-        "ceil"  => { let n: f64 = arg_str_t.parse().unwrap_or(0.0); return Ok((n.ceil() as i64).to_string()); }
-        "floor" => { let n: f64 = arg_str_t.parse().unwrap_or(0.0); return Ok((n.floor() as i64).to_string()); }
-        "round" => { let n: f64 = arg_str_t.parse().unwrap_or(0.0); return Ok((n.round() as i64).to_string()); }
-        // Kluczowy: ::env-path bez subprocess!
-        "env-path" => {
-            use crate::config::get_active_env;
-            return Ok(get_active_env()
+/// Czyste funkcje idą przez kernele, z efektami — tylko te, które nie
+/// potrzebują procesu ani terminala.
+pub fn exec_quick_capture(name: &str, func: Option<QuickFn>, args: &[StringPart], env: &mut Env) -> Result<String> {
+    let Some(f) = func else { return Err(unknown(name)) };
+    with_bufs(args, env, |arg, out, env| {
+        match kernel(f, arg, out)? {
+            Some(Kernel::Text)   => return Ok(out.clone()),
+            Some(Kernel::Same)   => return Ok(arg.to_string()),
+            Some(Kernel::Num(n)) => { push_num(out, n); return Ok(out.clone()); }
+            Some(Kernel::Bool(b)) => {
+                env.set_var("_last_bool", Value::Bool(b));
+                return Ok(b.to_string());
+            }
+            None => {}
+        }
+        Ok(match f {
+            QuickFn::Env | QuickFn::Getenv => std::env::var(arg).unwrap_or_default(),
+            QuickFn::Pid => std::process::id().to_string(),
+            // Kluczowy: ::env-path bez subprocess!
+            QuickFn::EnvPath => crate::config::get_active_env()
                 .map(|(_n, p)| p.display().to_string())
-                .unwrap_or_default());
+                .unwrap_or_default(),
+            QuickFn::Which => which::which(arg).map(|p| p.display().to_string()).unwrap_or_default(),
+            QuickFn::Get   => env.get_var(arg).to_string_val(),
+            _ => bail!(":: {} nie obsługuje przechwycenia (|>). Użyj >> zamiast ::", name),
+        })
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn run(f: QuickFn, arg: &str) -> (Option<Kernel>, String) {
+        let mut out = String::new();
+        let k = kernel(f, arg, &mut out).unwrap();
+        (k, out)
+    }
+
+    #[test]
+    fn test_case_kernels_match_std() {
+        for s in ["Hello, World! 123 [z]", "@`{~", "Zażółć gęślą JAŹŃ", ""] {
+            assert_eq!(run(QuickFn::Upper, s).1, s.to_uppercase());
+            assert_eq!(run(QuickFn::Lower, s).1, s.to_lowercase());
+            assert_eq!(run(QuickFn::Rev, s).1, s.chars().rev().collect::<String>());
         }
-        "which"  => return Ok(which::which(arg_str_t).map(|p| p.display().to_string()).unwrap_or_default()),
-        _ => {}
     }
 
-    // Fallback dla nieznanych quickcalls — uruchom przez subprocess dla przechwycenia
-    // Unikamy dup2/libc; zamiast tego uruchamiamy hl z flagą wewnętrzną (self-invoke)
-    // W praktyce: nowe sztuczki tylko dla env-path (powyżej), reszta zwraca ""
-    anyhow::bail!(":: {} nie obsługuje przechwycenia (|>). Użyj >> zamiast ::", name)
+    #[test]
+    fn test_search_and_split_kernels() {
+        assert_eq!(run(QuickFn::Replace, "a-b-c - +").1, "a+b+c");
+        assert_eq!(run(QuickFn::Replace, "xxabxxab ab Q").1, "xxQxxQ");
+        assert_eq!(run(QuickFn::Split, "a:b::c :").1, "a\nb\n\nc");
+        assert_eq!(run(QuickFn::Lines, "a\r\nb\n\nc\n").1, "a\nb\n\nc");
+        assert_eq!(run(QuickFn::Words, "  a \t b\nc ").1, "a\nb\nc");
+        assert_eq!(run(QuickFn::Contains, "log: ERROR x ERROR").0, Some(Kernel::Bool(true)));
+        assert_eq!(run(QuickFn::EndsWith, "plik.gz .bz2").0, Some(Kernel::Bool(false)));
+        assert!(kernel(QuickFn::Replace, "tylko dwa", &mut String::new()).is_err());
+    }
+
+    #[test]
+    fn test_value_kernels() {
+        assert_eq!(run(QuickFn::Len, "zażółć").0, Some(Kernel::Num(10.0)));
+        assert_eq!(run(QuickFn::Trim, "bez").0, Some(Kernel::Same));
+        assert_eq!(run(QuickFn::Max, "10 20").0, Some(Kernel::Num(20.0)));
+        assert_eq!(run(QuickFn::Min, "10 20").0, Some(Kernel::Num(10.0)));
+        assert_eq!(run(QuickFn::Repeat, "ab 3").1, "ababab");
+        assert_eq!(run(QuickFn::Basename, "/a/b.c").1, "b.c");
+        assert_eq!(run(QuickFn::Set, "x 1").0, None);
+        let mut s = String::new();
+        push_num(&mut s, 3.0);
+        push_num(&mut s, 2.5);
+        assert_eq!(s, "32.5");
+    }
 }
@@ -0,0 +1,518 @@
+//! Szybka ścieżka uruchamiania komend zewnętrznych
+//!
+//! `std::process::Command` przy każdym wywołaniu kopiuje całe środowisko,
+//! przeszukuje PATH i forkuje proces. W skryptach hl, które odpalają tysiące
+//! krótkich komend w pętli, to dominujący koszt. Tutaj:
+//!  - proces startuje przez `posix_spawn` (glibc robi to przez
+//!    `clone(CLONE_VM | CLONE_VFORK)` — bez kopiowania tablic stron rodzica),
+//!  - blok `envp` budujemy raz i trzymamy do czasu zmiany środowiska
+//!    przez [`set_env`] / [`remove_env`] (licznik generacji),
+//!  - wynik wyszukiwania programu w PATH jest cache'owany aż do zmiany PATH.
+//!
+//! Z modułu korzysta zarówno executor AST (`executor.rs`), jak i interpreter
+//! bajtkodu w `hl-jit`, więc obie ścieżki mają ten sam koszt startu procesu.
+
+use crate::metrics::{self, Counter, Hist};
+use rustc_hash::FxHashMap;
+use std::ffi::{CString, OsStr};
+use std::io::{self, Read};
+use std::os::unix::ffi::{OsStrExt, OsStringExt};
+use std::os::unix::io::FromRawFd;
+use std::path::Path;
+use std::ptr;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::mpsc::{sync_channel, Receiver, SyncSender};
+use std::sync::{Arc, Mutex};
+
+/// Podbijany przy każdej zmianie środowiska procesu
+static ENV_GEN: AtomicU64 = AtomicU64::new(1);
+static ENV_BLOCK: Mutex<Option<Arc<EnvBlock>>> = Mutex::new(None);
+static PATH_CACHE: Mutex<Option<FxHashMap<String, CString>>> = Mutex::new(None);
+
+/// Co zrobić ze standardowym wejściem/wyjściem potomka
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Stdio {
+    Inherit,
+    Null,
+    /// Tylko dla stdout — bajty wracają w [`Output::stdout`]
+    Piped,
+}
+
+#[derive(Debug, Clone, Copy)]
+pub struct SpawnOpts {
+    pub stdin:  Stdio,
+    pub stdout: Stdio,
+    pub stderr: Stdio,
+}
+
+impl SpawnOpts {
+    pub const INHERIT: Self = Self { stdin: Stdio::Inherit, stdout: Stdio::Inherit, stderr: Stdio::Inherit };
+}
+
+pub struct Output {
+    pub exit_code: i32,
+    pub stdout:    Option<Vec<u8>>,
+}
+
+/// Zbudowane `envp`: właściciel napisów + tablica wskaźników zakończona NULL
+struct EnvBlock {
+    gen:   u64,
+    _strs: Vec<CString>,
+    ptrs:  Vec<*const libc::c_char>,
+}
+
+// Wskaźniki prowadzą do `_strs`, które żyją tak długo jak blok
+unsafe impl Send for EnvBlock {}
+unsafe impl Sync for EnvBlock {}
+
+impl EnvBlock {
+    fn capture(gen: u64) -> Self {
+        let strs: Vec<CString> = std::env::vars_os()
+            .filter_map(|(k, v)| {
+                let mut kv = Vec::with_capacity(k.len() + v.len() + 1);
+                kv.extend_from_slice(k.as_bytes());
+                kv.push(b'=');
+                kv.extend_from_slice(v.as_bytes());
+                CString::new(kv).ok()
+            })
+            .collect();
+        let mut ptrs: Vec<*const libc::c_char> = strs.iter().map(|s| s.as_ptr()).collect();
+        ptrs.push(ptr::null());
+        Self { gen, _strs: strs, ptrs }
+    }
+}
+
+/// Ustaw zmienną środowiskową procesu i unieważnij cache `envp`/PATH.
+/// Wszystkie miejsca w hl zmieniające środowisko powinny iść tędy —
+/// bezpośrednie `std::env::set_var` nie dotrze do następnych komend.
+pub fn set_env(name: &str, val: &str) {
+    std::env::set_var(name, val);
+    env_changed(name);
+}
+
+pub fn remove_env(name: &str) {
+    std::env::remove_var(name);
+    env_changed(name);
+}
+
+/// Bieżąca generacja środowiska — rośnie przy każdym [`set_env`] / [`remove_env`]
+pub fn env_generation() -> u64 {
+    ENV_GEN.load(Ordering::Acquire)
+}
+
+fn env_changed(name: &str) {
+    ENV_GEN.fetch_add(1, Ordering::Release);
+    if name == "PATH" {
+        *PATH_CACHE.lock().unwrap() = None;
+    }
+}
+
+fn env_block() -> Arc<EnvBlock> {
+    let gen = ENV_GEN.load(Ordering::Acquire);
+    let mut slot = ENV_BLOCK.lock().unwrap();
+    match slot.as_ref() {
+        Some(b) if b.gen == gen => b.clone(),
+        _ => {
+            let b = Arc::new(EnvBlock::capture(gen));
+            *slot = Some(b.clone());
+            b
+        }
+    }
+}
+
+/// Ścieżka wykonywalna dla `prog`. Nazwy ze `/` są brane dosłownie,
+/// resztę szukamy w PATH i zapamiętujemy (tylko trafienia — brakujący
+/// program może zostać doinstalowany w trakcie skryptu).
+pub fn resolve(prog: &str) -> Option<CString> {
+    if prog.contains('/') {
+        return CString::new(prog).ok();
+    }
+    if let Some(hit) = PATH_CACHE.lock().unwrap().as_ref().and_then(|m| m.get(prog)) {
+        return Some(hit.clone());
+    }
+    let path = std::env::var_os("PATH")?;
+    let found = std::env::split_paths(&path)
+        .map(|dir| dir.join(prog))
+        .find(|p| is_executable(p))?;
+    let c = CString::new(found.into_os_string().into_vec()).ok()?;
+    PATH_CACHE.lock().unwrap()
+        .get_or_insert_with(FxHashMap::default)
+        .insert(prog.to_string(), c.clone());
+    Some(c)
+}
+
+fn forget(prog: &str) {
+    if let Some(m) = PATH_CACHE.lock().unwrap().as_mut() {
+        m.remove(prog);
+    }
+}
+
+fn is_executable(p: &Path) -> bool {
+    let Ok(c) = CString::new(p.as_os_str().as_bytes()) else { return false };
+    // SAFETY: c to poprawny napis zakończony zerem
+    unsafe { libc::access(c.as_ptr(), libc::X_OK) == 0 && !p.is_dir() }
+}
+
+/// Uruchom `prog args..` i poczekaj na zakończenie.
+/// Kod wyjścia jak w `ExitStatus::code().unwrap_or(1)` — proces zabity
+/// sygnałem daje 1.
+pub fn run<S: AsRef<OsStr>>(prog: &str, args: &[S], opts: SpawnOpts) -> io::Result<Output> {
+    let t0 = metrics::start();
+    let (pid, pipe) = spawn(prog, args, opts)?;
+    let stdout = match pipe {
+        Some(fd) => {
+            // SAFETY: fd to nasz koniec odczytu potoku, przejmujemy go na własność
+            let mut f = unsafe { std::fs::File::from_raw_fd(fd) };
+            let mut buf = Vec::new();
+            let res = f.read_to_end(&mut buf);
+            drop(f);
+            let code = wait(pid, t0)?;
+            res?;
+            return Ok(Output { exit_code: code, stdout: Some(buf) });
+        }
+        None => None,
+    };
+    Ok(Output { exit_code: wait(pid, t0)?, stdout })
+}
+
+/// Uruchom w tle bez czekania (odpowiednik `Command::spawn` z porzuconym
+/// `Child`). Zwraca PID potomka.
+pub fn spawn_detached<S: AsRef<OsStr>>(prog: &str, args: &[S], opts: SpawnOpts) -> io::Result<u32> {
+    let opts = SpawnOpts { stdout: if opts.stdout == Stdio::Piped { Stdio::Null } else { opts.stdout }, ..opts };
+    spawn(prog, args, opts).map(|(pid, _)| pid as u32)
+}
+
+/// Rozmiar jednego bufora strumienia i liczba buforów w obiegu —
+/// w locie jest najwyżej `STREAM_DEPTH * STREAM_CHUNK` bajtów wyjścia
+const STREAM_CHUNK: usize = 64 * 1024;
+const STREAM_DEPTH: usize = 4;
+
+enum Chunk {
+    Data(Vec<u8>),
+    Exit(i32),
+}
+
+/// Stdout potomka czytany przez wątek w tle i oddawany słowo po słowie.
+///
+/// Bufory krążą w pierścieniu: wątek wypełnia je i wysyła kanałem
+/// ograniczonym do `STREAM_DEPTH`, konsument po zużyciu odsyła je z powrotem.
+/// Producent i pętla skryptu pracują równolegle, a pamięć nie rośnie z
+/// rozmiarem wyjścia. Porzucenie strumienia zamyka potok — potomek dostaje
+/// SIGPIPE, wątek zbiera jego status.
+pub struct OutputStream {
+    rx:    Receiver<Chunk>,
+    free:  SyncSender<Vec<u8>>,
+    buf:   Vec<u8>,
+    pos:   usize,
+    exit:  Option<i32>,
+}
+
+impl OutputStream {
+    /// Następne słowo (separatorem są białe znaki ASCII, jak w for-in po
+    /// przechwyconym stringu). None = koniec wyjścia.
+    pub fn next_word(&mut self) -> Option<String> {
+        let mut word: Vec<u8> = Vec::new();
+        loop {
+            if self.pos == self.buf.len() && !self.refill() {
+                break;
+            }
+            let rest = &self.buf[self.pos..];
+            if word.is_empty() {
+                let skip = rest.iter().take_while(|b| b.is_ascii_whitespace()).count();
+                self.pos += skip;
+                if skip == rest.len() { continue; }
+            }
+            let rest = &self.buf[self.pos..];
+            let len = rest.iter().position(|b| b.is_ascii_whitespace()).unwrap_or(rest.len());
+            word.extend_from_slice(&rest[..len]);
+            self.pos += len;
+            if self.pos < self.buf.len() { break; }
+        }
+        if word.is_empty() { return None; }
+        // Wielobajtowe znaki UTF-8 nie zawierają bajtów ASCII, więc cięcie
+        // po białych znakach nigdy ich nie rozdziela
+        Some(lossy(word))
+    }
+
+    /// Następna linia bez `\n` / `\r\n` (puste linie też są elementami, jak
+    /// w `str::lines`). None = koniec wyjścia.
+    pub fn next_line(&mut self) -> Option<String> {
+        let mut line: Vec<u8> = Vec::new();
+        loop {
+            if self.pos == self.buf.len() && !self.refill() {
+                break;
+            }
+            let rest = &self.buf[self.pos..];
+            match rest.iter().position(|&b| b == b'\n') {
+                Some(n) => {
+                    line.extend_from_slice(&rest[..n]);
+                    self.pos += n + 1;
+                    if line.last() == Some(&b'\r') { line.pop(); }
+                    return Some(lossy(line));
+                }
+                None => {
+                    line.extend_from_slice(rest);
+                    self.pos = self.buf.len();
+                }
+            }
+        }
+        // Ostatnia linia bez `\n`
+        if line.is_empty() { return None; }
+        if line.last() == Some(&b'\r') { line.pop(); }
+        Some(lossy(line))
+    }
+
+    /// Kod wyjścia potomka — dostępny po wyczerpaniu strumienia
+    pub fn exit_code(&self) -> Option<i32> { self.exit }
+
+    fn refill(&mut self) -> bool {
+        if self.exit.is_some() { return false; }
+        loop {
+            match self.rx.recv() {
+                Ok(Chunk::Data(data)) => {
+                    let old = std::mem::replace(&mut self.buf, data);
+                    let _ = self.free.try_send(old);
+                    self.pos = 0;
+                    if !self.buf.is_empty() { return true; }
+                }
+                Ok(Chunk::Exit(code)) => { self.exit = Some(code); return false; }
+                Err(_) => { self.exit = Some(1); return false; }
+            }
+        }
+    }
+}
+
+fn lossy(bytes: Vec<u8>) -> String {
+    match String::from_utf8(bytes) {
+        Ok(s)  => s,
+        Err(e) => String::from_utf8_lossy(e.as_bytes()).into_owned(),
+    }
+}
+
+/// Uruchom `prog args..` ze stdout podpiętym pod [`OutputStream`]
+/// (`opts.stdout` jest ignorowane)
+pub fn stream<S: AsRef<OsStr>>(prog: &str, args: &[S], opts: SpawnOpts) -> io::Result<OutputStream> {
+    let t0 = metrics::start();
+    let (pid, pipe) = spawn(prog, args, SpawnOpts { stdout: Stdio::Piped, ..opts })?;
+    let fd = pipe.expect("stdout potomka jest potokiem");
+    let (tx, rx) = sync_channel::<Chunk>(STREAM_DEPTH);
+    let (free, free_rx) = sync_channel::<Vec<u8>>(STREAM_DEPTH);
+
+    let reader = move || {
+        // SAFETY: fd to nasz koniec odczytu potoku, przejmujemy go na własność
+        let mut f = unsafe { std::fs::File::from_raw_fd(fd) };
+        loop {
+            let mut buf = free_rx.try_recv().unwrap_or_default();
+            buf.resize(STREAM_CHUNK, 0);
+            match f.read(&mut buf) {
+                Ok(0) => break,
+                Ok(n) => {
+                    buf.truncate(n);
+                    // Konsument porzucił strumień — przestań czytać
+                    if tx.send(Chunk::Data(buf)).is_err() { break; }
+                }
+                Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
+                Err(_) => break,
+            }
+        }
+        drop(f);
+        let _ = tx.send(Chunk::Exit(wait(pid, t0).unwrap_or(1)));
+    };
+    std::thread::Builder::new().name("hl-capture".into()).spawn(reader)?;
+    Ok(OutputStream { rx, free, buf: Vec::new(), pos: 0, exit: None })
+}
+
+fn spawn<S: AsRef<OsStr>>(prog: &str, args: &[S], opts: SpawnOpts) -> io::Result<(libc::pid_t, Option<libc::c_int>)> {
+    let mut argv_own: Vec<CString> = Vec::with_capacity(args.len() + 1);
+    argv_own.push(CString::new(prog).map_err(|_| nul_err())?);
+    for a in args {
+        argv_own.push(CString::new(a.as_ref().as_bytes()).map_err(|_| nul_err())?);
+    }
+    let mut argv: Vec<*mut libc::c_char> = argv_own.iter().map(|s| s.as_ptr() as *mut _).collect();
+    argv.push(ptr::null_mut());
+
+    let env = env_block();
+    let Some(path) = resolve(prog) else {
+        return Err(io::Error::from_raw_os_error(libc::ENOENT));
+    };
+    match spawn_raw(&path, &argv, &env, opts) {
+        // Program z cache zniknął z dysku — szukaj od nowa
+        Err(e) if e.raw_os_error() == Some(libc::ENOENT) && !prog.contains('/') => {
+            forget(prog);
+            let path = resolve(prog).ok_or(e)?;
+            spawn_raw(&path, &argv, &env, opts)
+        }
+        r => r,
+    }
+}
+
+fn nul_err() -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidInput, "argument komendy zawiera bajt NUL")
+}
+
+fn spawn_raw(
+    path: &CString,
+    argv: &[*mut libc::c_char],
+    env:  &EnvBlock,
+    opts: SpawnOpts,
+) -> io::Result<(libc::pid_t, Option<libc::c_int>)> {
+    // SAFETY: wszystkie struktury posix_spawn* są inicjalizowane przed użyciem
+    // i niszczone na każdej ścieżce; argv/envp są zakończone NULL i żyją
+    // do powrotu z posix_spawn.
+    unsafe {
+        let mut fds = [-1 as libc::c_int; 2];
+        if opts.stdout == Stdio::Piped && libc::pipe2(fds.as_mut_ptr(), libc::O_CLOEXEC) != 0 {
+            return Err(io::Error::last_os_error());
+        }
+
+        let mut fa: libc::posix_spawn_file_actions_t = std::mem::zeroed();
+        let mut attr: libc::posix_spawnattr_t = std::mem::zeroed();
+        libc::posix_spawn_file_actions_init(&mut fa);
+        libc::posix_spawnattr_init(&mut attr);
+
+        let dev_null = c"/dev/null";
+        if opts.stdin == Stdio::Null {
+            libc::posix_spawn_file_actions_addopen(&mut fa, 0, dev_null.as_ptr(), libc::O_RDONLY, 0);
+        }
+        match opts.stdout {
+            Stdio::Piped => { libc::posix_spawn_file_actions_adddup2(&mut fa, fds[1], 1); }
+            Stdio::Null  => { libc::posix_spawn_file_actions_addopen(&mut fa, 1, dev_null.as_ptr(), libc::O_WRONLY, 0); }
+            Stdio::Inherit => {}
+        }
+        if opts.stderr != Stdio::Inherit {
+            libc::posix_spawn_file_actions_addopen(&mut fa, 2, dev_null.as_ptr(), libc::O_WRONLY, 0);
+        }
+
+        // Rust ignoruje SIGPIPE w rodzicu, a ignorowanie dziedziczy się przez
+        // exec — przywróć domyślną obsługę jak robi to std::process::Command
+        let mut sigdef: libc::sigset_t = std::mem::zeroed();
+        libc::sigemptyset(&mut sigdef);
+        libc::sigaddset(&mut sigdef, libc::SIGPIPE);
+        libc::posix_spawnattr_setsigdefault(&mut attr, &sigdef);
+        let mut mask: libc::sigset_t = std::mem::zeroed();
+        libc::sigemptyset(&mut mask);
+        libc::posix_spawnattr_setsigmask(&mut attr, &mask);
+        libc::posix_spawnattr_setflags(
+            &mut attr,
+            (libc::POSIX_SPAWN_SETSIGDEF | libc::POSIX_SPAWN_SETSIGMASK) as libc::c_short,
+        );
+
+        let mut pid: libc::pid_t = 0;
+        let t0 = metrics::start();
+        let rc = libc::posix_spawn(
+            &mut pid, path.as_ptr(), &fa, &attr,
+            argv.as_ptr(), env.ptrs.as_ptr() as *const *mut libc::c_char,
+        );
+        if let Some(t0) = t0 {
+            metrics::observe_since(Hist::SpawnNs, t0);
+            metrics::inc(if rc == 0 { Counter::Spawns } else { Counter::SpawnErrors });
+        }
+        libc::posix_spawn_file_actions_destroy(&mut fa);
+        libc::posix_spawnattr_destroy(&mut attr);
+
+        if fds[1] >= 0 { libc::close(fds[1]); }
+        if rc != 0 {
+            if fds[0] >= 0 { libc::close(fds[0]); }
+            return Err(io::Error::from_raw_os_error(rc));
+        }
+        tracing::debug!("[spawn] pid {} ← {:?}", pid, path);
+        Ok((pid, if fds[0] >= 0 { Some(fds[0]) } else { None }))
+    }
+}
+
+/// `started` — czas sprzed startu potomka (metryki: czas życia procesu)
+fn wait(pid: libc::pid_t, started: Option<std::time::Instant>) -> io::Result<i32> {
+    let mut status: libc::c_int = 0;
+    loop {
+        // SAFETY: pid to nasze dziecko, status to poprawny wskaźnik
+        let r = unsafe { libc::waitpid(pid, &mut status, 0) };
+        if r == pid { break; }
+        let e = io::Error::last_os_error();
+        if e.kind() != io::ErrorKind::Interrupted { return Err(e); }
+    }
+    if let Some(t0) = started { metrics::observe_since(Hist::WaitNs, t0); }
+    Ok(if libc::WIFEXITED(status) { libc::WEXITSTATUS(status) } else { 1 })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const CAPTURE: SpawnOpts = SpawnOpts { stdin: Stdio::Null, stdout: Stdio::Piped, stderr: Stdio::Inherit };
+
+    #[test]
+    fn test_exit_codes() {
+        assert_eq!(run("true", &[] as &[&str], SpawnOpts::INHERIT).unwrap().exit_code, 0);
+        assert_eq!(run("sh", &["-c", "exit 3"], SpawnOpts::INHERIT).unwrap().exit_code, 3);
+    }
+
+    #[test]
+    fn test_capture_stdout() {
+        let out = run("echo", &["hello", "hl"], CAPTURE).unwrap();
+        assert_eq!(out.exit_code, 0);
+        assert_eq!(out.stdout.as_deref(), Some(&b"hello hl\n"[..]));
+    }
+
+    #[test]
+    fn test_detached_returns_child_pid() {
+        let pid = spawn_detached("sh", &["-c", "exit 0"], SpawnOpts::INHERIT).unwrap();
+        assert!(pid > 0 && pid != std::process::id());
+    }
+
+    #[test]
+    fn test_missing_program_is_enoent() {
+        let e = run("hl-no-such-program-xyz", &[] as &[&str], SpawnOpts::INHERIT).err().unwrap();
+        assert_eq!(e.raw_os_error(), Some(libc::ENOENT));
+    }
+
+    #[test]
+    fn test_set_env_reaches_child() {
+        set_env("HL_SPAWN_TEST", "one");
+        let a = run("sh", &["-c", "printf %s \"$HL_SPAWN_TEST\""], CAPTURE).unwrap();
+        set_env("HL_SPAWN_TEST", "two");
+        let b = run("sh", &["-c", "printf %s \"$HL_SPAWN_TEST\""], CAPTURE).unwrap();
+        remove_env("HL_SPAWN_TEST");
+        assert_eq!(a.stdout.as_deref(), Some(&b"one"[..]));
+        assert_eq!(b.stdout.as_deref(), Some(&b"two"[..]));
+    }
+
+    #[test]
+    fn test_stream_words_across_chunks() {
+        // Słowa dłuższe niż bufor i przecinające granice chunków
+        let script = "printf 'a bb\\n'; head -c 100000 /dev/zero | tr '\\0' x; printf ' end\\n'; exit 4";
+        let mut s = stream("sh", &["-c", script], CAPTURE).unwrap();
+        assert_eq!(s.next_word().as_deref(), Some("a"));
+        assert_eq!(s.next_word().as_deref(), Some("bb"));
+        assert_eq!(s.next_word().map(|w| w.len()), Some(100_000));
+        assert_eq!(s.next_word().as_deref(), Some("end"));
+        assert_eq!(s.next_word(), None);
+        assert_eq!(s.exit_code(), Some(4));
+    }
+
+    #[test]
+    fn test_stream_lines() {
+        let script = "printf 'a b\\r\\n\\n'; head -c 70000 /dev/zero | tr '\\0' x; printf '\\nkoniec'";
+        let mut s = stream("sh", &["-c", script], CAPTURE).unwrap();
+        assert_eq!(s.next_line().as_deref(), Some("a b"));
+        assert_eq!(s.next_line().as_deref(), Some(""));
+        assert_eq!(s.next_line().map(|l| l.len()), Some(70_000));
+        assert_eq!(s.next_line().as_deref(), Some("koniec"));
+        assert_eq!(s.next_line(), None);
+        assert_eq!(s.exit_code(), Some(0));
+    }
+
+    #[test]
+    fn test_dropped_stream_stops_producer() {
+        let mut s = stream("yes", &["hl"], CAPTURE).unwrap();
+        assert_eq!(s.next_word().as_deref(), Some("hl"));
+        drop(s);
+    }
+
+    #[test]
+    fn test_resolve_is_cached() {
+        let a = resolve("sh").unwrap();
+        assert!(a.as_bytes().ends_with(b"/sh"));
+        let cached = PATH_CACHE.lock().unwrap().as_ref().and_then(|m| m.get("sh").cloned());
+        assert_eq!(cached, Some(a));
+    }
+}
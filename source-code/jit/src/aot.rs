@@ -0,0 +1,383 @@
+//! Kompilacja AOT: `hl compile --native`
+//!
+//! Moduł (z bibliotekami zlinkowanymi już przy kompilacji) trafia do obiektu
+//! ELF jako płaski obraz bytecode, a każda pętla, którą trace JIT mógłby
+//! skompilować w czasie wykonania, jako gotowa funkcja natywna — ten sam
+//! codegen (`build_region_fn`) i to samo ABI (`TraceEnv`). Obiekt linkujemy
+//! z `libhl_rt.a` (crate `hl-rt`: interpreter, interner, spawner,
+//! quick-funkcje) w plik wykonywalny albo `.so`.
+//!
+//! Start takiego programu to odczyt obrazu w miejscu (`FlatBc` na sekcji
+//! danych) i rejestracja tras — bez parsowania, deserializacji, progu
+//! rozgrzewania i Cranelift. Kod, którego nie da się skompilować (wywołania
+//! funkcji w pętli, instrukcje spoza JIT), wykonuje interpreter jak zwykle.
+//!
+//! Obiekt jest dla architektury hosta, ale bez cech CPU wykrytych na nim
+//! (`builder_with_options(false)`) — działa na każdej maszynie tej architektury.
+
+use anyhow::{anyhow, bail, Context as _, Result};
+use cranelift_codegen::ir::{types, AbiParam, Function, InstBuilder, Signature, UserFuncName};
+use cranelift_codegen::isa::OwnedTargetIsa;
+use cranelift_codegen::settings::{self, Configurable};
+use cranelift_codegen::Context;
+use cranelift_frontend::{FunctionBuilder, FunctionBuilderContext};
+use cranelift_module::{DataDescription, DataId, FuncId, Linkage, Module};
+use cranelift_object::{ObjectBuilder, ObjectModule};
+use hl_compiler::flat::{op, write_flat_bytes, FlatInsn};
+use hl_compiler::{FlatBc, HlModule};
+use std::mem::{align_of, offset_of, size_of};
+use std::path::{Path, PathBuf};
+
+use crate::compact::Program;
+use crate::interpreter::BytecodeInterpreter;
+use crate::jit_engine::{build_region_fn, is_jit_eligible, JitFn, RegionSrc, TraceSigs};
+
+/// Punkt wejścia runtime w `libhl_rt.a` — woła go `main` (albo `hl_main`) obiektu
+pub const RT_ENTRY: &str = "hl_aot_main";
+/// Eksport biblioteki `--shared`: `int hl_main(int argc, char **argv)`
+pub const SHARED_ENTRY: &str = "hl_main";
+/// Nazwa biblioteki runtime (`cargo build --release` → `target/release/`)
+pub const RT_LIB_NAME: &str = "libhl_rt.a";
+/// Biblioteka runtime w instalacji systemowej
+const RT_LIB_INSTALLED: &str = "/usr/lib/HackerOS/Hacker-Lang/libhl_rt.a";
+/// Biblioteki systemowe wymagane przez staticlib Rusta (`--print native-static-libs`)
+const RT_NATIVE_LIBS: &[&str] = &["-lgcc_s", "-lutil", "-lrt", "-lpthread", "-lm", "-ldl", "-lc"];
+
+const AOT_MAGIC: u64 = u64::from_le_bytes(*b"HLAOTIMG");
+/// Podbij przy zmianie układu `AotImage`/`AotTrace`
+const AOT_LAYOUT_VERSION: u32 = 1;
+
+/// Wersja obrazu: układ + generator kodu tras. Obiekt z innego `hl` niż
+/// `libhl_rt.a`, z którą go zlinkowano, odrzucamy zamiast wykonywać.
+fn image_version() -> u32 {
+    AOT_LAYOUT_VERSION << 16 | crate::jit_cache::JIT_CACHE_VERSION
+}
+
+/// Trasa w obrazie: region [start..=end] i jego kod
+#[repr(C)]
+pub struct AotTrace {
+    pub start: u32,
+    pub end:   u32,
+    pub func:  JitFn,
+}
+
+/// Obraz programu w sekcji danych obiektu (`__hl_aot_image`)
+#[repr(C)]
+pub struct AotImage {
+    pub magic:       u64,
+    pub version:     u32,
+    pub n_traces:    u32,
+    /// Płaski .bc (bez shebangu), wyrównany do 16 — kod czytany w miejscu
+    pub program:     *const u8,
+    pub program_len: usize,
+    pub traces:      *const AotTrace,
+}
+
+// ── Kompilacja ────────────────────────────────────────────────────────────────
+
+/// Zbuduj plik wykonywalny (albo `.so` przy `shared`) z modułu
+pub fn build_native(module: &HlModule, out: &Path, shared: bool) -> Result<usize> {
+    let (object, traces) = emit_object(module, shared)?;
+    let obj_path = out.with_file_name(format!(
+        ".{}.{}.o",
+        out.file_name().and_then(|n| n.to_str()).unwrap_or("hl-native"),
+        std::process::id(),
+    ));
+    std::fs::write(&obj_path, &object).with_context(|| format!("Zapis obiektu: {:?}", obj_path))?;
+    let linked = link(&obj_path, out, shared);
+    let _ = std::fs::remove_file(&obj_path);
+    linked?;
+    Ok(traces)
+}
+
+/// Obiekt ELF: obraz programu, trasy pętli i punkt wejścia. Zwraca bajty
+/// obiektu i liczbę skompilowanych tras.
+pub fn emit_object(module: &HlModule, shared: bool) -> Result<(Vec<u8>, usize)> {
+    // Importy rozwiązujemy teraz — w runtime nie ma już czego linkować
+    let linked = crate::libs::link_imports(module, None)?;
+    let module = linked.as_ref().map_or(module, |(m, _)| m);
+
+    let mut obj = ObjectModule::new(
+        ObjectBuilder::new(aot_isa()?, "hl-native", cranelift_module::default_libcall_names())
+            .map_err(|e| anyhow!("Obiekt AOT: {}", e))?,
+    );
+    let ptr_type = obj.target_config().pointer_type();
+    if ptr_type.bytes() as usize != size_of::<usize>() {
+        bail!("AOT wymaga wskaźników {}-bitowych", usize::BITS);
+    }
+    let sigs = TraceSigs::new(obj.isa().default_call_conv(), ptr_type);
+    let mut ctx    = Context::new();
+    let mut fn_ctx = FunctionBuilderContext::new();
+
+    let image = write_flat_bytes(module, &[]);
+    let mut traces: Vec<(u32, u32, FuncId)> = Vec::new();
+    {
+        let fc   = FlatBc::parse(&image, 0)?;
+        let prog = Program::from_flat(&fc)?;
+        let src  = RegionSrc {
+            code:    &prog.code,
+            extra:   &prog.extra,
+            numbers: &prog.numbers,
+            strings: &prog.strings,
+        };
+        for (start, end) in loop_regions(&prog.code) {
+            let name = UserFuncName::user(0, traces.len() as u32);
+            if let Err(e) = build_region_fn(&mut ctx, &mut fn_ctx, &sigs, ptr_type, name, &src, start, end) {
+                // Przerwany builder — następna pętla od czystego kontekstu
+                fn_ctx = FunctionBuilderContext::new();
+                tracing::debug!("[aot] pętla @ {}: {}", start, e);
+                continue;
+            }
+            let id = obj.declare_function(&format!("__hl_trace_{}_{}", start, end), Linkage::Local, &sigs.sig)?;
+            ctx.func.name = UserFuncName::user(0, id.as_u32());
+            obj.define_function(id, &mut ctx)?;
+            obj.clear_context(&mut ctx);
+            traces.push((start, end, id));
+        }
+    }
+
+    let image_id = define_image(&mut obj, image, &traces)?;
+    define_entry(&mut obj, &mut ctx, &mut fn_ctx, image_id, shared)?;
+
+    let bytes = obj.finish().emit().map_err(|e| anyhow!("Zapis obiektu AOT: {}", e))?;
+    Ok((bytes, traces.len()))
+}
+
+/// ISA hosta dla kodu w pliku: PIC (PIE i `.so`), optymalizacja szybkości,
+/// bez cech CPU wykrytych na maszynie budującej
+fn aot_isa() -> Result<OwnedTargetIsa> {
+    let mut flags = settings::builder();
+    flags.set("is_pic", "true")?;
+    flags.set("opt_level", "speed")?;
+    cranelift_native::builder_with_options(false)
+        .map_err(|e| anyhow!("Brak ISA: {}", e))?
+        .finish(settings::Flags::new(flags))
+        .map_err(|e| anyhow!("Brak ISA: {}", e))
+}
+
+/// Pętle do skompilowania: skoki wsteczne, jak w trace JIT, ale bez limitu
+/// rozmiaru — czas kompilacji nie obciąża uruchomienia. Trasy są kluczowane
+/// początkiem pętli, więc przy kilku skokach do tego samego celu bierzemy
+/// najdłuższy region (obejmuje pozostałe skoki).
+fn loop_regions(code: &[FlatInsn]) -> Vec<(u32, u32)> {
+    let mut regions: Vec<(u32, u32)> = code.iter().enumerate()
+        .filter(|&(here, r)| r.op == op::JUMP && (r.b as usize) < here)
+        .map(|(here, r)| (r.b, here as u32))
+        .filter(|&(start, end)| is_jit_eligible(code, start, end))
+        .collect();
+    regions.sort_unstable_by(|a, b| a.0.cmp(&b.0).then(b.1.cmp(&a.1)));
+    regions.dedup_by_key(|r| r.0);
+    regions
+}
+
+/// Dane obrazu: program, tablica tras (adresy funkcji przez relokacje) i
+/// nagłówek `AotImage` wskazujący na oba
+fn define_image(obj: &mut ObjectModule, program: Vec<u8>, traces: &[(u32, u32, FuncId)]) -> Result<DataId> {
+    fn put(buf: &mut [u8], at: usize, bytes: &[u8]) {
+        buf[at..at + bytes.len()].copy_from_slice(bytes);
+    }
+
+    let program_len = program.len();
+    let prog_id = obj.declare_data("__hl_aot_program", Linkage::Local, false, false)?;
+    let mut desc = DataDescription::new();
+    desc.define(program.into_boxed_slice());
+    desc.set_align(16);
+    obj.define_data(prog_id, &desc)?;
+
+    // Pusta tablica dostaje jeden zerowy wpis — obiekt nie lubi symboli zerowej długości
+    let entry = size_of::<AotTrace>();
+    let mut table = vec![0u8; entry * traces.len().max(1)];
+    for (i, &(start, end, _)) in traces.iter().enumerate() {
+        put(&mut table, i * entry + offset_of!(AotTrace, start), &start.to_ne_bytes());
+        put(&mut table, i * entry + offset_of!(AotTrace, end), &end.to_ne_bytes());
+    }
+    let table_id = obj.declare_data("__hl_aot_traces", Linkage::Local, false, false)?;
+    let mut desc = DataDescription::new();
+    desc.define(table.into_boxed_slice());
+    desc.set_align(align_of::<AotTrace>() as u64);
+    for (i, &(_, _, id)) in traces.iter().enumerate() {
+        let f = obj.declare_func_in_data(id, &mut desc);
+        desc.write_function_addr((i * entry + offset_of!(AotTrace, func)) as u32, f);
+    }
+    obj.define_data(table_id, &desc)?;
+
+    let mut head = vec![0u8; size_of::<AotImage>()];
+    put(&mut head, offset_of!(AotImage, magic), &AOT_MAGIC.to_ne_bytes());
+    put(&mut head, offset_of!(AotImage, version), &image_version().to_ne_bytes());
+    put(&mut head, offset_of!(AotImage, n_traces), &(traces.len() as u32).to_ne_bytes());
+    put(&mut head, offset_of!(AotImage, program_len), &program_len.to_ne_bytes());
+    let image_id = obj.declare_data("__hl_aot_image", Linkage::Local, false, false)?;
+    let mut desc = DataDescription::new();
+    desc.define(head.into_boxed_slice());
+    desc.set_align(align_of::<AotImage>() as u64);
+    let p = obj.declare_data_in_data(prog_id, &mut desc);
+    desc.write_data_addr(offset_of!(AotImage, program) as u32, p, 0);
+    let t = obj.declare_data_in_data(table_id, &mut desc);
+    desc.write_data_addr(offset_of!(AotImage, traces) as u32, t, 0);
+    obj.define_data(image_id, &desc)?;
+    Ok(image_id)
+}
+
+/// `main(argc, argv)` (albo eksport `hl_main` dla `.so`) — przekazuje obraz
+/// i argumenty do `hl_aot_main` z runtime
+fn define_entry(
+    obj: &mut ObjectModule,
+    ctx: &mut Context,
+    fn_ctx: &mut FunctionBuilderContext,
+    image_id: DataId,
+    shared: bool,
+) -> Result<()> {
+    let ptr_type  = obj.target_config().pointer_type();
+    let call_conv = obj.isa().default_call_conv();
+
+    let mut main_sig = Signature::new(call_conv);
+    main_sig.params.push(AbiParam::new(types::I32));
+    main_sig.params.push(AbiParam::new(ptr_type));
+    main_sig.returns.push(AbiParam::new(types::I32));
+    let mut rt_sig = main_sig.clone();
+    rt_sig.params.insert(0, AbiParam::new(ptr_type));
+
+    let rt_id    = obj.declare_function(RT_ENTRY, Linkage::Import, &rt_sig)?;
+    let entry    = if shared { SHARED_ENTRY } else { "main" };
+    let entry_id = obj.declare_function(entry, Linkage::Export, &main_sig)?;
+
+    ctx.clear();
+    ctx.func = Function::with_name_signature(UserFuncName::user(0, entry_id.as_u32()), main_sig);
+    {
+        let mut b = FunctionBuilder::new(&mut ctx.func, fn_ctx);
+        let block = b.create_block();
+        b.append_block_params_for_function_params(block);
+        b.switch_to_block(block);
+        b.seal_block(block);
+        let (argc, argv) = (b.block_params(block)[0], b.block_params(block)[1]);
+        let gv    = obj.declare_data_in_func(image_id, &mut *b.func);
+        let image = b.ins().symbol_value(ptr_type, gv);
+        let rt    = obj.declare_func_in_func(rt_id, &mut *b.func);
+        let call  = b.ins().call(rt, &[image, argc, argv]);
+        let code  = b.inst_results(call)[0];
+        b.ins().return_(&[code]);
+        b.finalize();
+    }
+    obj.define_function(entry_id, ctx)?;
+    obj.clear_context(ctx);
+    Ok(())
+}
+
+/// Biblioteka runtime: `HL_RT_LIB`, obok binarki `hl` (build z cargo),
+/// potem instalacja systemowa
+fn find_runtime_lib() -> Result<PathBuf> {
+    if let Some(p) = std::env::var_os("HL_RT_LIB") {
+        return Ok(PathBuf::from(p));
+    }
+    let beside = std::env::current_exe().ok()
+        .and_then(|exe| exe.parent().map(|d| d.join(RT_LIB_NAME)))
+        .filter(|p| p.is_file());
+    if let Some(p) = beside {
+        return Ok(p);
+    }
+    let installed = PathBuf::from(RT_LIB_INSTALLED);
+    if installed.is_file() {
+        return Ok(installed);
+    }
+    bail!("Brak {} (zbuduj: cargo build --release -p hl-rt albo ustaw HL_RT_LIB)", RT_LIB_NAME)
+}
+
+/// Zlinkuj obiekt z runtime przez `cc` (`CC` nadpisuje)
+fn link(obj_path: &Path, out: &Path, shared: bool) -> Result<()> {
+    let rt = find_runtime_lib()?;
+    let cc = std::env::var("CC").unwrap_or_else(|_| "cc".to_string());
+    let mut cmd = std::process::Command::new(&cc);
+    if shared { cmd.arg("-shared"); }
+    cmd.arg(obj_path).arg(&rt).arg("-o").arg(out).arg("-Wl,--gc-sections").args(RT_NATIVE_LIBS);
+    tracing::debug!("[aot] {:?}", cmd);
+    let status = cmd.status().with_context(|| format!("Nie można uruchomić linkera '{}'", cc))?;
+    if !status.success() {
+        bail!("Linker '{}' zakończył się kodem {}", cc, status.code().unwrap_or(-1));
+    }
+    Ok(())
+}
+
+// ── Runtime ───────────────────────────────────────────────────────────────────
+
+/// Wykonaj obraz z obiektu (`hl_aot_main` w `libhl_rt.a`)
+pub fn run_image(image: &'static AotImage, args: &[String]) -> Result<i32> {
+    if image.magic != AOT_MAGIC {
+        bail!("Uszkodzony obraz AOT");
+    }
+    if image.version != image_version() {
+        bail!("Obraz AOT z innej wersji hl ({:#x}, runtime {:#x}) — przebuduj: hl compile --native",
+              image.version, image_version());
+    }
+    // SAFETY: wskaźniki i długości zapisał `emit_object`; dane leżą w sekcjach
+    // obiektu i żyją do końca procesu
+    let program = unsafe { std::slice::from_raw_parts(image.program, image.program_len) };
+    let traces  = unsafe { std::slice::from_raw_parts(image.traces, image.n_traces as usize) };
+
+    crate::runner::inject_args_to_env(args);
+    let mut interp = BytecodeInterpreter::from_flat(FlatBc::parse(program, 0)?)?;
+    interp.install_aot(traces);
+    interp.run()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_loop_regions_keep_longest_back_edge() {
+        let code = vec![
+            FlatInsn::new(op::NOP,  0, 0, 0, 0),
+            FlatInsn::new(op::JUMP, 0, 0, 0, 0),
+            FlatInsn::new(op::JUMP, 0, 0, 0, 0),
+            FlatInsn::new(op::JUMP, 0, 0, 5, 0),
+            FlatInsn::new(op::CALL_FUNC, 0, 0, 0, 0),
+            FlatInsn::new(op::JUMP, 0, 0, 4, 0),
+        ];
+        // Dwa skoki do 0 — jedna trasa [0..=2]; pętla z CallFunc odpada
+        assert_eq!(loop_regions(&code), vec![(0, 2)]);
+    }
+
+    #[test]
+    fn test_object_has_entry_and_traces() {
+        let module = hl_compiler::compile_source_to_module(
+            "% n = 0\n?~ @n < 10\n$( @n + 1 ) -> @n\ndone",
+            Path::new("<aot>"),
+            hl_compiler::OptLevel::default(),
+        ).unwrap();
+        let (bytes, traces) = emit_object(&module, false).unwrap();
+        let syms = elf_symbols(&bytes);
+        let has = |sym: &str| syms.iter().any(|s| s == sym);
+        assert!(has("main") && has(RT_ENTRY));
+        assert!(!has(SHARED_ENTRY));
+
+        // Pętla `?~` to region z loop_regions — jej trasa jest w obiekcie
+        let flat = write_flat_bytes(&module, &[]);
+        let prog = Program::from_flat(&FlatBc::parse(&flat, 0).unwrap()).unwrap();
+        let regions = loop_regions(&prog.code);
+        assert_eq!(traces, regions.len());
+        let &(start, end) = regions.first().expect("pętla bez regionu");
+        assert!(has(&format!("__hl_trace_{}_{}", start, end)), "brak trasy {}..{} w {:?}", start, end, syms);
+    }
+
+    /// Nazwy z tablicy symboli (`SHT_SYMTAB`) obiektu ELF64 little-endian
+    fn elf_symbols(elf: &[u8]) -> Vec<String> {
+        assert_eq!(&elf[..6], b"\x7fELF\x02\x01", "oczekiwany ELF64 LE");
+        let u16_at = |at: usize| u16::from_le_bytes(elf[at..at + 2].try_into().unwrap()) as usize;
+        let u32_at = |at: usize| u32::from_le_bytes(elf[at..at + 4].try_into().unwrap()) as usize;
+        let u64_at = |at: usize| u64::from_le_bytes(elf[at..at + 8].try_into().unwrap()) as usize;
+        let (shoff, shentsize, shnum) = (u64_at(0x28), u16_at(0x3a), u16_at(0x3c));
+        let section = |i: usize| shoff + i * shentsize;
+
+        let mut names = Vec::new();
+        for sh in (0..shnum).map(section).filter(|&sh| u32_at(sh + 4) == 2) {
+            let (off, size, entsize) = (u64_at(sh + 0x18), u64_at(sh + 0x20), u64_at(sh + 0x38));
+            let strtab = u64_at(section(u32_at(sh + 0x28)) + 0x18);
+            for sym in (off..off + size).step_by(entsize) {
+                let name = &elf[strtab + u32_at(sym)..];
+                let len = name.iter().position(|&b| b == 0).unwrap();
+                if len > 0 { names.push(String::from_utf8_lossy(&name[..len]).into_owned()); }
+            }
+        }
+        names
+    }
+}
@@ -0,0 +1,302 @@
+//! Wykonawcza forma bytecode dla `BytecodeInterpreter`
+//!
+//! `Instruction` to enum z `Vec<Reg>` w `Concat` — klonowanie go w każdym kroku
+//! alokuje i rozdmuchuje i-cache. Interpreter wykonuje więc gęste 16-bajtowe
+//! rekordy `FlatInsn` (ten sam układ co sekcja CODE płaskiego .bc), z operandami
+//! `Concat` w osobnej tabeli `extra`. Tłumaczenie z `HlModule` robimy raz przy
+//! ładowaniu; płaski .bc z mmap wykonujemy w miejscu, bez kopiowania.
+
+use anyhow::{bail, Result};
+use hl_compiler::bytecode::HlModule;
+use hl_compiler::flat::{encode_insn, op, FlatBc, FlatInsn, TplView};
+use std::borrow::Cow;
+
+/// Załadowany program: kod + stałe, pożyczone z `HlModule` albo z mmap
+pub struct Program<'a> {
+    pub code:      Cow<'a, [FlatInsn]>,
+    pub extra:     Cow<'a, [u32]>,
+    /// Stałe string (ConstIdx → &str) — wskaźniki do modułu/bloba, bez kopii treści
+    pub strings:   Vec<&'a str>,
+    pub numbers:   Vec<f64>,
+    /// (nazwa, start_insn, insn_count)
+    pub funcs:     Vec<(&'a str, u32, u32)>,
+    pub main_regs: u32,
+    /// Najwyższy rejestr użyty w kodzie + 1 — rejestry alokujemy raz, z góry
+    pub reg_count: u32,
+}
+
+impl<'a> Program<'a> {
+    /// Przetłumacz `HlModule` (wynik lower/optimize lub bincode .bc)
+    pub fn from_module(module: &'a HlModule) -> Result<Self> {
+        let mut extra = Vec::new();
+        let code: Vec<FlatInsn> = module.instructions.iter()
+            .map(|i| encode_insn(i, &mut extra))
+            .collect();
+        let mut p = Self {
+            code:      Cow::Owned(code),
+            extra:     Cow::Owned(extra),
+            strings:   module.consts.strings.iter().map(|s| s.as_str()).collect(),
+            numbers:   module.consts.numbers.clone(),
+            funcs:     module.funcs.entries.iter()
+                .map(|f| (f.name.as_str(), f.start_insn, f.insn_count))
+                .collect(),
+            main_regs: module.main_regs,
+            reg_count: 0,
+        };
+        p.validate()?;
+        Ok(p)
+    }
+
+    /// Program modułu, którego początek jest już przetłumaczony (`code`,
+    /// `extra`) — sesja REPL dokleja instrukcje na końcu modułu, więc
+    /// tłumaczymy tylko nowy ogon
+    pub fn extend_module(module: &'a HlModule, mut code: Vec<FlatInsn>, mut extra: Vec<u32>) -> Result<Self> {
+        if code.len() > module.instructions.len() {
+            bail!("Moduł krótszy niż przetłumaczony kod ({} < {})", module.instructions.len(), code.len());
+        }
+        for i in &module.instructions[code.len()..] {
+            code.push(encode_insn(i, &mut extra));
+        }
+        let mut p = Self {
+            code:      Cow::Owned(code),
+            extra:     Cow::Owned(extra),
+            strings:   module.consts.strings.iter().map(|s| s.as_str()).collect(),
+            numbers:   module.consts.numbers.clone(),
+            funcs:     module.funcs.entries.iter()
+                .map(|f| (f.name.as_str(), f.start_insn, f.insn_count))
+                .collect(),
+            main_regs: module.main_regs,
+            reg_count: 0,
+        };
+        p.validate()?;
+        Ok(p)
+    }
+
+    /// Wykonuj płaski .bc w miejscu — kod i EXTRA pożyczone wprost z bufora
+    pub fn from_flat(fc: &FlatBc<'a>) -> Result<Self> {
+        let code = match fc.insn_slice() {
+            Some(s) => Cow::Borrowed(s),
+            None    => Cow::Owned((0..fc.insn_count()).filter_map(|pc| fc.insn(pc)).collect()),
+        };
+        let extra = match fc.extra_slice() {
+            Some(s) => Cow::Borrowed(s),
+            None    => Cow::Owned(fc.extra_vec()),
+        };
+        let strings = (0..fc.string_count() as u32)
+            .map(|i| fc.string(i).ok_or_else(|| anyhow::anyhow!("Uszkodzona stała string #{}", i)))
+            .collect::<Result<Vec<_>>>()?;
+        let numbers = (0..fc.number_count() as u32)
+            .map(|i| fc.number(i).unwrap_or(0.0))
+            .collect();
+        let funcs = (0..fc.func_count())
+            .map(|i| fc.func(i).ok_or_else(|| anyhow::anyhow!("Uszkodzony wpis funkcji #{}", i)))
+            .collect::<Result<Vec<_>>>()?;
+        let mut p = Self {
+            code, extra, strings, numbers, funcs,
+            main_regs: fc.main_regs,
+            reg_count: 0,
+        };
+        p.validate()?;
+        Ok(p)
+    }
+
+    /// Własna kopia programu dla goroutines — wątki puli nie mogą pożyczać
+    /// z modułu albo mmap wątku głównego. Robiona raz, przy pierwszym `:*`.
+    pub fn to_shared(&self) -> SharedProgram {
+        SharedProgram {
+            code:      self.code.to_vec(),
+            extra:     self.extra.to_vec(),
+            strings:   self.strings.iter().map(|s| Box::from(*s)).collect(),
+            numbers:   self.numbers.clone(),
+            funcs:     self.funcs.iter().map(|&(n, s, c)| (Box::from(n), s, c)).collect(),
+            main_regs: self.main_regs,
+            reg_count: self.reg_count,
+        }
+    }
+
+    #[inline]
+    pub fn const_str(&self, idx: u32) -> &'a str {
+        self.strings.get(idx as usize).copied().unwrap_or("")
+    }
+
+    #[inline]
+    pub fn number(&self, idx: u32) -> f64 {
+        self.numbers.get(idx as usize).copied().unwrap_or(0.0)
+    }
+
+    /// FNV-1a treści programu (kod, EXTRA, stałe) — klucz cache JIT dla .bc,
+    /// którego nie dostarczył `compile_to_cache`
+    pub fn content_hash(&self) -> u64 {
+        const FNV_PRIME: u64 = 1099511628211;
+        let mut h: u64 = 14695981039346656037;
+        let mut mix = |bytes: &[u8]| for b in bytes {
+            h ^= *b as u64;
+            h = h.wrapping_mul(FNV_PRIME);
+        };
+        for r in self.code.iter() {
+            mix(&[r.op, r.aux]);
+            mix(&r.a.to_le_bytes()); mix(&r.b.to_le_bytes()); mix(&r.c.to_le_bytes());
+        }
+        for e in self.extra.iter() { mix(&e.to_le_bytes()); }
+        for s in &self.strings { mix(s.as_bytes()); mix(&[0]); }
+        for n in &self.numbers { mix(&n.to_bits().to_le_bytes()); }
+        h
+    }
+
+    /// Jednorazowa walidacja przy ładowaniu. Dzięki niej pętla dispatch nie
+    /// sprawdza granic: każdy skok, zakres funkcji i zakres Concat mieści się
+    /// w kodzie, a każdy rejestr < `reg_count`.
+    fn validate(&mut self) -> Result<()> {
+        let len = self.code.len();
+        let mut max_reg = 0u32;
+        let mut see = |r: u32| { if r >= max_reg { max_reg = r + 1; } };
+        for (pc, r) in self.code.iter().enumerate() {
+            match r.op {
+                op::LOAD_STR | op::LOAD_NUM | op::LOAD_BOOL | op::LOAD_NIL |
+                op::GET_VAR => see(r.a),
+                op::GET_VAR_DYN | op::NEG | op::TO_STRING | op::TO_NUMBER | op::TO_INT |
+                op::TRUTHY | op::NOT | op::TEST | op::FOR_RANGE_STEP |
+                op::FOR_IN_START | op::FOR_IN_CMD => { see(r.a); see(r.b); }
+                op::SET_VAR | op::SET_ENV => see(r.b),
+                op::ADD | op::SUB | op::MUL | op::DIV | op::MOD |
+                op::CMP_EQ | op::CMP_NE | op::CMP_LT | op::CMP_LE | op::CMP_GT | op::CMP_GE => {
+                    see(r.a); see(r.b); see(r.c);
+                }
+                op::CONCAT => {
+                    see(r.a);
+                    let (s, n) = (r.b as usize, r.c as usize);
+                    match self.extra.get(s..s + n) {
+                        Some(parts) => parts.iter().for_each(|&p| see(p)),
+                        None => bail!("Concat @{} poza tabelą EXTRA", pc),
+                    }
+                }
+                op::JUMP_IF_FALSE | op::JUMP_IF_TRUE => {
+                    see(r.a);
+                    if r.b as usize > len { bail!("Skok @{} poza kod ({})", pc, r.b); }
+                }
+                op::JUMP => {
+                    if r.b as usize > len { bail!("Skok @{} poza kod ({})", pc, r.b); }
+                }
+                op::RETURN => if r.aux != 0 { see(r.a) },
+                op::CALL_FUNC | op::ARENA_CALL | op::SOURCE_LINE | op::NOP => {}
+                op::CALL_QUICK | op::HACKEROS_CALL => { see(r.b); see(r.c); }
+                op::EXEC_CMD => { see(r.a); see(r.b); }
+                op::EXEC_CAPTURE => { see(r.a); see(r.b); see(r.c); }
+                op::EXEC_TPL | op::CAPTURE_TPL | op::FOR_IN_TPL => {
+                    let start = if r.op == op::FOR_IN_TPL { see(r.a); r.b } else { see(r.b); r.a };
+                    if r.op == op::CAPTURE_TPL { see(r.c); }
+                    match TplView::parse(&self.extra, start as usize) {
+                        Some(tpl) => tpl.holes().for_each(&mut see),
+                        None => bail!("Szablon komendy @{} poza tabelą EXTRA", pc),
+                    }
+                }
+                op::PRINT => see(r.a),
+                op::GO_SPAWN | op::CHAN_OPEN => {}
+                op::GO_WAIT | op::CHAN_SEND | op::CHAN_RECV => see(r.b),
+                op::FOR_IN_NEXT => {
+                    see(r.a); see(r.b);
+                    if r.c as usize > len { bail!("ForInNext @{} poza kod ({})", pc, r.c); }
+                }
+                op::FOR_RANGE_NEXT => {
+                    see(r.a); see(r.b);
+                    if r.c as usize > len { bail!("ForRangeNext @{} poza kod ({})", pc, r.c); }
+                }
+                other => bail!("Nieznany opcode {} @{}", other, pc),
+            }
+        }
+        for &(name, start, count) in &self.funcs {
+            if start as usize + count as usize > len {
+                bail!("Funkcja '{}' poza kodem ({}+{})", name, start, count);
+            }
+        }
+        self.reg_count = max_reg;
+        Ok(())
+    }
+}
+
+/// Program posiadający swoje dane (`Program::to_shared`), współdzielony
+/// przez `Arc` między interpreterami goroutines
+pub struct SharedProgram {
+    code:      Vec<FlatInsn>,
+    extra:     Vec<u32>,
+    strings:   Vec<Box<str>>,
+    numbers:   Vec<f64>,
+    funcs:     Vec<(Box<str>, u32, u32)>,
+    main_regs: u32,
+    reg_count: u32,
+}
+
+impl SharedProgram {
+    /// Widok wykonawczy — dane były zwalidowane w programie źródłowym
+    pub fn program(&self) -> Program<'_> {
+        Program {
+            code:      Cow::Borrowed(&self.code),
+            extra:     Cow::Borrowed(&self.extra),
+            strings:   self.strings.iter().map(|s| &**s).collect(),
+            numbers:   self.numbers.clone(),
+            funcs:     self.funcs.iter().map(|(n, s, c)| (&**n, *s, *c)).collect(),
+            main_regs: self.main_regs,
+            reg_count: self.reg_count,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use hl_compiler::bytecode::{FuncEntry, Instruction};
+
+    #[test]
+    fn test_from_module_sizes_registers() {
+        let mut m = HlModule::new("t.hl", 2);
+        m.instructions.push(Instruction::LoadNil { dst: 3 });
+        m.instructions.push(Instruction::Concat { dst: 1, parts: vec![3, 70] });
+        let p = Program::from_module(&m).unwrap();
+        assert_eq!(p.reg_count, 71);
+        assert_eq!(p.extra.as_ref(), &[3, 70]);
+    }
+
+    #[test]
+    fn test_rejects_bad_jump() {
+        let mut m = HlModule::new("t.hl", 2);
+        m.instructions.push(Instruction::Jump { offset: 9 });
+        assert!(Program::from_module(&m).is_err());
+    }
+
+    #[test]
+    fn test_shared_program_matches_source() {
+        let mut m = HlModule::new("t.hl", 2);
+        let chan = m.consts.add_str("kanal");
+        m.instructions.push(Instruction::ChanRecv { name: chan, dst: 5 });
+        m.instructions.push(Instruction::Return { src: None });
+        m.funcs.entries.push(FuncEntry { name: "__go_0".into(), start_insn: 0, insn_count: 2 });
+        let p = Program::from_module(&m).unwrap();
+        let shared = p.to_shared();
+        let q = shared.program();
+        assert_eq!(q.reg_count, 6);
+        assert_eq!(q.const_str(chan), "kanal");
+        assert_eq!(q.funcs, vec![("__go_0", 0, 2)]);
+        assert_eq!(q.code.len(), p.code.len());
+    }
+
+    #[test]
+    fn test_extend_module_translates_tail() {
+        let mut m = HlModule::new("t.hl", 2);
+        m.instructions.push(Instruction::Concat { dst: 0, parts: vec![1, 2] });
+        let p = Program::from_module(&m).unwrap();
+        let (code, extra) = (p.code.into_owned(), p.extra.into_owned());
+        m.instructions.push(Instruction::Concat { dst: 3, parts: vec![4] });
+        let q = Program::extend_module(&m, code, extra).unwrap();
+        assert_eq!(q.code.len(), 2);
+        assert_eq!(q.extra.as_ref(), &[1, 2, 4]);
+        assert_eq!(q.reg_count, 5);
+    }
+
+    #[test]
+    fn test_rejects_bad_func_range() {
+        let mut m = HlModule::new("t.hl", 2);
+        m.instructions.push(Instruction::Nop);
+        m.funcs.entries.push(FuncEntry { name: "f".into(), start_insn: 0, insn_count: 4 });
+        assert!(Program::from_module(&m).is_err());
+    }
+}
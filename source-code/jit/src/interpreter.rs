@@ -1,53 +1,221 @@
 use anyhow::{bail, Result};
 use hl_compiler::bytecode::*;
-use crate::runtime::{RuntimeState, NanVal};
-use std::process::{Command, Stdio};
+use hl_compiler::flat::{cmd_mode_from_u8, op, test_op_from_u8, tpl_part, FlatBc, FlatInsn, TplView};
+use hl_compiler::lower::SHELL_CHARS;
+use hl_parser::ast::ExternRuntime;
+use crate::aot::AotTrace;
+use crate::compact::{Program, SharedProgram};
+use crate::jit_engine::{
+    promoted_vars, CompiledTrace, JitEngine, RegionSrc, TraceEnv, HELPER_BRANCH, HELPER_FAILED, HELPER_NEXT,
+};
+use crate::profile::{self, Profiler};
+use crate::runtime::{ForIter, RuntimeState, NanVal};
+use rustc_hash::FxHashMap;
+use hl_core::{executor, goroutine, quick};
+use hl_core::metrics::{self, Counter, Gauge};
+use hl_core::spawn::{self, SpawnOpts, Stdio};
+use std::sync::Arc;
+use std::time::Instant;
 
-// ── Dispatch signal ───────────────────────────────────────────────────────────
+// ── Trace JIT threshold ───────────────────────────────────────────────────────
+
+const TRACE_THRESHOLD: u32 = 50;
 
-#[derive(Debug, Clone)]
-pub enum ExecSignal {
-    Next,
-    Jump(u32),
+/// Znacznik w leniwych tablicach `str_ids` / `call_targets`
+const UNRESOLVED: u32 = u32::MAX;
+const NOT_FOUND:  u32 = u32::MAX - 1;
+
+/// Jak zakończyło się wykonywanie zakresu kodu
+enum Flow {
+    /// Doszliśmy do końca zakresu
+    End,
+    /// Instrukcja Return
     Return,
-    FuncCall(u32),   // name_idx
-    Exit(i32),
 }
 
-// ── Trace JIT threshold ───────────────────────────────────────────────────────
-
-const TRACE_THRESHOLD: u32 = 50;
+/// Interpreter sesji REPL między fragmentami: wszystko poza programem
+/// pożyczonym z modułu (`crate::session`). Trasy JIT, sloty zmiennych,
+/// interner i rozwiązane stałe przechodzą na kolejny fragment.
+pub(crate) struct Parked {
+    code:         Vec<FlatInsn>,
+    extra:        Vec<u32>,
+    pub(crate) state: RuntimeState,
+    exec_counts:  Vec<u32>,
+    pub(crate) jit: JitEngine,
+    str_ids:      Vec<u32>,
+    le_idx:       u32,
+    var_slot_ids: Vec<u32>,
+    trace_vars:   FxHashMap<u32, Vec<u32>>,
+}
 
 // ── Główny interpreter ────────────────────────────────────────────────────────
 
 pub struct BytecodeInterpreter<'a> {
-    pub module:      &'a HlModule,
+    /// Kod w formie wykonawczej (rekordy FlatInsn + EXTRA)
+    prog:            Program<'a>,
     pub state:       RuntimeState,
     /// Liczniki wykonań per instrukcja (dla trace JIT)
     exec_counts:     Vec<u32>,
-    /// Skompilowane trasy (offset → native fn ptr)
-    compiled_traces: rustc_hash::FxHashMap<u32, CompiledTrace>,
-}
-
-/// Skompilowana trasa (wynik trace JIT)
-pub struct CompiledTrace {
-    /// fn(regs: *mut u64, vars: *mut u64, reg_count: u32, var_count: u32) -> i32
-    pub fn_ptr: unsafe extern "C" fn(*mut u64, *mut u64, u32, u32) -> i32,
-    /// Offset wyjścia z trasy (dokąd skakać po wykonaniu)
-    pub exit_offset: u32,
+    /// Trace JIT — jeden moduł Cranelift na interpreter, zwalniany w Drop
+    jit:             JitEngine,
+    /// ConstIdx → idx w internerze. Nazwy zmiennych i literały internujemy raz,
+    /// przy pierwszym użyciu — potem LoadStr/GetVar to odczyt z tablicy.
+    str_ids:         Vec<u32>,
+    /// ConstIdx nazwy funkcji → indeks w `prog.funcs`
+    call_targets:    Vec<u32>,
+    /// idx "_last_exit_code" w internerze
+    le_idx:          u32,
+    /// Bufor wielokrotnego użytku dla Concat (i argumentu CallQuick)
+    scratch:         String,
+    /// Bufor wyniku kerneli quick-funkcji
+    quick_buf:       String,
+    /// Klucz trwałego cache JIT (hash z compile_to_cache albo hash treści)
+    module_hash:     Option<u64>,
+    /// Błąd z instrukcji wykonanej przez helper trasy — odbierany po jej wyjściu
+    jit_error:       Option<anyhow::Error>,
+    /// ConstIdx nazwy → slot w `vars_flat` dla zmiennych trzymanych przez trasy w SSA
+    var_slot_ids:    Vec<u32>,
+    /// Początek trasy → jej zmienne w SSA (sloty odświeżamy przy każdym wejściu)
+    trace_vars:      FxHashMap<u32, Vec<u32>>,
+    /// Kopia programu dla goroutines — tworzona przy pierwszym GoSpawn
+    shared:          Option<Arc<SharedProgram>>,
+    /// `hl run --profile` — None poza trybem profilowania
+    prof:            Option<Box<Profiler>>,
+    /// Wykonane instrukcje od ostatniego `flush_metrics` (HL_METRICS)
+    insns:           u64,
+    /// Trasy z obrazu AOT — instalowane też w interpreterach goroutines
+    aot:             &'static [AotTrace],
 }
 
 impl<'a> BytecodeInterpreter<'a> {
-    pub fn new(module: &'a HlModule) -> Self {
-        let n = module.instructions.len();
+    /// Interpreter dla `HlModule` — instrukcje tłumaczone raz do formy FlatInsn
+    pub fn new(module: &'a HlModule) -> Result<Self> {
+        let prog = Program::from_module(module)?;
+        Ok(Self::with_program(prog))
+    }
+
+    /// Interpreter wykonujący płaski .bc w miejscu (np. z `MappedBc`)
+    pub fn from_flat(fc: FlatBc<'a>) -> Result<Self> {
+        let prog = Program::from_flat(&fc)?;
+        Ok(Self::with_program(prog))
+    }
+
+    fn with_program(prog: Program<'a>) -> Self {
+        let n     = prog.code.len();
+        let nstr  = prog.strings.len();
+        let regs  = prog.main_regs.max(prog.reg_count) as usize;
+        let mut state = RuntimeState::new(regs);
+        let le_idx    = state.interner.intern("_last_exit_code");
         Self {
-            module,
-            state:           RuntimeState::new(module.main_regs as usize),
+            prog,
+            state,
             exec_counts:     vec![0u32; n],
-            compiled_traces: rustc_hash::FxHashMap::default(),
+            jit:             JitEngine::new(),
+            str_ids:         vec![UNRESOLVED; nstr],
+            call_targets:    vec![UNRESOLVED; nstr],
+            le_idx,
+            scratch:         String::with_capacity(256),
+            quick_buf:       String::with_capacity(256),
+            module_hash:     None,
+            jit_error:       None,
+            var_slot_ids:    vec![0; nstr],
+            trace_vars:      FxHashMap::default(),
+            shared:          None,
+            prof:            None,
+            insns:           0,
+            aot:             &[],
+        }
+    }
+
+    /// Odłóż interpreter do następnego fragmentu sesji
+    pub(crate) fn park(mut self) -> Parked {
+        // Błąd w środku wywołania zostawia licznik głębokości
+        self.state.call_depth = 0;
+        Parked {
+            code:         self.prog.code.into_owned(),
+            extra:        self.prog.extra.into_owned(),
+            state:        self.state,
+            exec_counts:  self.exec_counts,
+            jit:          self.jit,
+            str_ids:      self.str_ids,
+            le_idx:       self.le_idx,
+            var_slot_ids: self.var_slot_ids,
+            trace_vars:   self.trace_vars,
         }
     }
 
+    /// Wznów odłożony interpreter na module sesji z doklejonym fragmentem.
+    /// Stałe sesji tylko przybywają, więc `str_ids` zostają ważne; tabela
+    /// funkcji mogła się zmienić (redefinicja), więc `call_targets` od nowa.
+    pub(crate) fn resume(module: &'a HlModule, p: Parked) -> Result<Self> {
+        let prog = Program::extend_module(module, p.code, p.extra)?;
+        let (n, nstr) = (prog.code.len(), prog.strings.len());
+        let regs = prog.main_regs.max(prog.reg_count) as usize;
+        let mut state = p.state;
+        if state.regs.len() < regs { state.regs.resize(regs, NanVal::nil()); }
+        let grow = |mut v: Vec<u32>, len: usize, fill: u32| { v.resize(len, fill); v };
+        Ok(Self {
+            prog,
+            state,
+            exec_counts:  grow(p.exec_counts, n, 0),
+            jit:          p.jit,
+            str_ids:      grow(p.str_ids, nstr, UNRESOLVED),
+            call_targets: vec![UNRESOLVED; nstr],
+            le_idx:       p.le_idx,
+            scratch:      String::with_capacity(256),
+            quick_buf:    String::with_capacity(256),
+            // Klucz cache JIT liczony od nowa z treści — program urósł
+            module_hash:  None,
+            jit_error:    None,
+            var_slot_ids: grow(p.var_slot_ids, nstr, 0),
+            trace_vars:   p.trace_vars,
+            shared:       None,
+            prof:         None,
+            insns:        0,
+            aot:          &[],
+        })
+    }
+
+    /// Wykonaj fragment sesji od `start` do jego Return. Goroutines działają
+    /// dalej w tle — REPL nie czeka na nie po każdej linii.
+    pub(crate) fn run_from(&mut self, start: usize) -> Result<i32> {
+        let res = self.exec_range(start, self.prog.code.len());
+        self.flush_metrics();
+        res?;
+        Ok(self.state.last_exit)
+    }
+
+    /// Włącz profiler (`hl run --profile`); `lines` — tablica linii modułu
+    pub fn enable_profiler(&mut self, file: &str, lines: &[(u32, u32)]) {
+        self.prof = Some(Box::new(Profiler::new(file, &self.prog, lines)));
+    }
+
+    pub fn take_profiler(&mut self) -> Option<Box<Profiler>> {
+        self.prof.take()
+    }
+
+    /// Trasy skompilowane zawczasu (`crate::aot`): od pierwszego obrotu pętli
+    /// wykonanie natywne, bez liczenia do progu i bez Cranelift.
+    /// `HL_NO_JIT` wyłącza je tak samo jak trace JIT.
+    pub(crate) fn install_aot(&mut self, traces: &'static [AotTrace]) {
+        self.aot = traces;
+        if !self.jit.is_enabled() { return; }
+        for t in traces {
+            match self.prepare_trace(t.start, t.end) {
+                Ok(vars) => {
+                    self.jit.install_trace(t.start, t.end, t.func);
+                    self.trace_vars.insert(t.start, vars);
+                }
+                Err(e) => tracing::debug!("[aot] pętla @ {}: {}", t.start, e),
+            }
+        }
+    }
+
+    /// Ustaw klucz cache JIT — runner przekazuje hash pliku z cache .bc
+    pub fn set_module_hash(&mut self, hash: u64) {
+        self.module_hash = Some(hash);
+    }
+
     /// Inicjalizuj zmienne HL_VERSION itp.
     pub fn init_hl_vars(&mut self) {
         let k = self.state.interner.intern("HL_VERSION");
@@ -58,422 +226,886 @@ impl<'a> BytecodeInterpreter<'a> {
         self.state.set_var(k2, v2);
     }
 
-    /// Uruchom główny blok
+    /// Uruchom główny blok. Ciała funkcji leżą w tym samym strumieniu,
+    /// ale lowering emituje nad nimi skok — główny kod kończy się na Return.
     pub fn run(&mut self) -> Result<i32> {
         self.init_hl_vars();
-        let main_end = self.module.funcs.entries.first()
-        .map(|f| f.start_insn as usize)
-        .unwrap_or(self.module.instructions.len());
-        self.exec_block(0, main_end)?;
+        let res = self.exec_range(0, self.prog.code.len());
+        self.flush_metrics();
+        res?;
+        // Skrypt kończy się razem z ostatnią goroutine
+        goroutine::wait_all()?;
         Ok(self.state.last_exit)
     }
 
-    fn exec_block(&mut self, start: usize, end: usize) -> Result<ExecSignal> {
+    /// Dolicz liczniki tego interpretera do `hl_core::metrics` (koniec
+    /// uruchomienia, fragmentu sesji albo goroutine)
+    fn flush_metrics(&mut self) {
+        if !metrics::enabled() { return; }
+        metrics::add(Counter::InterpInsns, std::mem::take(&mut self.insns));
+        let strings = &self.state.interner;
+        metrics::gauge_max(Gauge::InternerStrings, strings.len() as u64);
+        metrics::gauge_max(Gauge::InternerBytes, strings.bytes() as u64);
+        metrics::gauge_max(Gauge::HeapStrings, strings.heap_live() as u64);
+        metrics::gauge_max(Gauge::JitCodeBytes, self.jit.code_bytes() as u64);
+    }
+
+    /// Pętla dispatch. Rekord kopiujemy (16 B, Copy) zamiast klonować enum,
+    /// granice sprawdza raz `Program::validate`, a sterowanie to zwykłe
+    /// przypisanie `pc` — bez budowania sygnału sterowania per instrukcja.
+    fn exec_range(&mut self, start: usize, end: usize) -> Result<Flow> {
+        let end = end.min(self.prog.code.len());
         let mut pc = start;
         while pc < end {
-            // ── Trace JIT check ───────────────────────────────────────────
-            // Przy JumpIfFalse/Jump które wracają do wcześniejszego offsetu
-            // (pętla) — zliczamy i kompilujemy po przekroczeniu progu
-            if let Some(Instruction::Jump { offset }) = self.module.instructions.get(pc) {
-                let target = *offset as usize;
-                if target < pc {
-                    // Pętla wsteczna — kandydat do trace JIT
-                    // Guard: kompiluj tylko małe pętle (<= 64 instrukcji)
-                    let loop_size = pc - target;
-                    let count = self.exec_counts.get_mut(pc).map(|c| { *c += 1; *c }).unwrap_or(0);
-                    if count == TRACE_THRESHOLD && loop_size <= 64 {
-                        // Próbuj skompilować pętlę [target..pc+1]
-                        if let Ok(trace) = self.try_compile_trace(target as u32, pc as u32) {
-                            self.compiled_traces.insert(target as u32, trace);
-                            tracing::debug!("[trace jit] skompilowano pętle @ {} (size={})", target, loop_size);
+            // SAFETY: pc < end <= code.len()
+            let r: FlatInsn = unsafe { *self.prog.code.get_unchecked(pc) };
+            if let Some(p) = self.prof.as_deref_mut() { p.step(pc); }
+            pc += 1;
+            self.insns += 1;
+
+            match r.op {
+                // ── Sterowanie ────────────────────────────────────────────────
+                op::JUMP_IF_FALSE => {
+                    if !self.state.get_reg(r.a).is_truthy(&self.state.interner) {
+                        pc = r.b as usize;
+                    }
+                }
+                op::JUMP_IF_TRUE => {
+                    if self.state.get_reg(r.a).is_truthy(&self.state.interner) {
+                        pc = r.b as usize;
+                    }
+                }
+                op::JUMP => {
+                    let target = r.b as usize;
+                    let here   = pc - 1;
+                    // Skok wsteczny = pętla — kandydat do trace JIT i bezpieczny
+                    // punkt zbierania stringów
+                    if target < here {
+                        self.state.maybe_collect_strings();
+                        if let Some(exit) = self.on_back_edge(target, here)? {
+                            pc = exit;
+                            continue;
                         }
                     }
-                    // Jeśli pętla jest skompilowana — wykonaj natywnie
-                    if let Some(_trace) = self.compiled_traces.get(&(target as u32)) {
-                        let result = self.exec_native_trace(target as u32)?;
-                        pc = result as usize;
-                        continue;
+                    pc = target;
+                }
+                op::RETURN => return Ok(Flow::Return),
+
+                op::FOR_IN_NEXT => {
+                    let done = if self.prof.is_some() && self.iter_is_stream(r.a) {
+                        self.timed_proc(pc - 1, |s| s.for_in_next(r))
+                    } else {
+                        self.for_in_next(r)
+                    };
+                    if done {
+                        pc = r.c as usize;
+                    }
+                }
+                op::FOR_RANGE_NEXT => {
+                    if self.range_done(r) {
+                        pc = r.c as usize;
                     }
                 }
-            }
 
-            match self.exec_insn(pc)? {
-                ExecSignal::Next          => pc += 1,
-                ExecSignal::Jump(off)     => pc = off as usize,
-                ExecSignal::Return        => return Ok(ExecSignal::Return),
-                ExecSignal::Exit(code)    => { self.state.last_exit = code; return Ok(ExecSignal::Return); }
-                ExecSignal::FuncCall(ni)  => {
-                    self.exec_func_by_name_idx(ni)?;
-                    pc += 1;
+                _ if self.prof.is_some() && profile::is_proc_op(r.op) => {
+                    self.timed_proc(pc - 1, |s| s.exec_simple(r))?
                 }
+                _ => self.exec_simple(r)?,
             }
         }
-        Ok(ExecSignal::Next)
+        Ok(Flow::End)
     }
 
-    /// Wykonaj skompilowaną trasę — przekaż rejestry i zmienne jako raw pointers
-    fn exec_native_trace(&mut self, trace_start: u32) -> Result<u32> {
-        let trace = match self.compiled_traces.get(&trace_start) {
-            Some(t) => t,
-            None    => return Ok(trace_start),
-        };
-        let exit_offset = trace.exit_offset;
-        let fn_ptr      = trace.fn_ptr;
-        let reg_count   = self.state.regs.len() as u32;
-        let var_count   = self.state.vars_flat.len() as u32;
-
-        // SAFETY: NanVal jest #[repr(transparent)] u64 — bezpośredni cast
-        let result = unsafe {
-            (fn_ptr)(
-                self.state.regs.as_mut_ptr() as *mut u64,
-                     self.state.vars_flat.as_mut_ptr() as *mut u64,
-                     reg_count,
-                     var_count,
-            )
-        };
-
-        self.state.last_exit = result;
-        Ok(exit_offset)
-    }
+    /// Instrukcje bez skoków — wspólne dla pętli dispatch i helpera tras JIT
+    #[inline(always)]
+    fn exec_simple(&mut self, r: FlatInsn) -> Result<()> {
+        match r.op {
+            op::NOP | op::SOURCE_LINE => {}
 
-    /// Próbuj skompilować trasę [start..end] do kodu maszynowego
-    /// Aktualnie: deleguje do JitEngine jeśli blok jest kwalifikowany
-    fn try_compile_trace(&self, start: u32, end: u32) -> Result<CompiledTrace> {
-        // Trace compilation przez JitEngine — kompiluje blok jako pseudo-funkcję
-        let entry = hl_compiler::bytecode::FuncEntry {
-            name:       format!("__trace_{}_{}", start, end),
-            start_insn: start,
-            insn_count: end - start + 1,
-        };
-        crate::jit_engine::compile_trace_entry(self.module, &entry)
-    }
-
-    // ── Dispatch instrukcji ───────────────────────────────────────────────────
-
-    fn exec_insn(&mut self, pc: usize) -> Result<ExecSignal> {
-        let insn = match self.module.instructions.get(pc) {
-            Some(i) => i.clone(),
-            None    => return Ok(ExecSignal::Return),
-        };
-
-        // Dispatch — Rust kompilator generuje jump table dla gęstego match
-        // Używamy jawnego match zamiast fn ptr table bo Rust optymalizuje to dobrze
-        match insn {
-            Instruction::Nop | Instruction::SourceLine { .. } => Ok(ExecSignal::Next),
-
-            // ── Ładowanie stałych ─────────────────────────────────────────────
-            Instruction::LoadStr { dst, idx } => {
-                let s   = self.module.consts.strings.get(idx as usize).map(|s| s.as_str()).unwrap_or("");
-                let val = self.state.intern_str(s);
-                self.state.set_reg(dst, val);
-                Ok(ExecSignal::Next)
-            }
-            Instruction::LoadNum { dst, idx } => {
-                let n = self.module.consts.numbers.get(idx as usize).copied().unwrap_or(0.0);
-                self.state.set_reg(dst, NanVal::num(n));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::LoadBool { dst, val } => {
-                self.state.set_reg(dst, NanVal::bool(val));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::LoadNil { dst } => {
-                self.state.set_reg(dst, NanVal::nil());
-                Ok(ExecSignal::Next)
+            // ── Ładowanie stałych ─────────────────────────────────────────
+            op::LOAD_STR => {
+                let id = self.str_id(r.b);
+                let v  = self.state.interner.interned_val(id);
+                self.state.set_reg(r.a, v);
             }
+            op::LOAD_NUM  => self.state.set_reg(r.a, NanVal::num(self.prog.number(r.b))),
+            op::LOAD_BOOL => self.state.set_reg(r.a, NanVal::bool(r.aux != 0)),
+            op::LOAD_NIL  => self.state.set_reg(r.a, NanVal::nil()),
 
-            // ── Zmienne ───────────────────────────────────────────────────────
-            Instruction::GetVar { dst, name } => {
+            // ── Zmienne ───────────────────────────────────────────────────
+            op::GET_VAR => {
                 // Inline cache hot path — O(1)
-                let val = self.state.get_var(name);
-                self.state.set_reg(dst, val);
-                Ok(ExecSignal::Next)
-            }
-            // GetVarDyn: @{arg@_i} — dynamiczna nazwa zmiennej z rejestru
-            // Rejestr `name` zawiera string (nazwę zmiennej), np. "arg0".
-            // Rozdzielamy borrow: najpierw kopiujemy string (owned), potem internujemy i robimy lookup.
-            Instruction::GetVarDyn { dst, name } => {
-                // 1. Pobierz wartość rejestru name → string (owned, by uniknąć borrow conflict)
-                let name_str: String = {
-                    let name_val = self.state.get_reg(name);
-                    name_val.to_str_val(&self.state.interner)
+                let name = self.str_id(r.b);
+                let val  = self.state.get_var(name);
+                self.state.set_reg(r.a, val);
+            }
+            // GetVarDyn: @{arg@_i} — nazwa zmiennej w rejestrze
+            op::GET_VAR_DYN => {
+                let name_val = self.state.get_reg(r.b);
+                let name_idx = match name_val.as_str_idx() {
+                    Some(idx) => idx,
+                    None      => {
+                        let s = name_val.to_str_val(&self.state.interner);
+                        self.state.interner.intern_owned(s)
+                    }
                 };
-                // 2. Intern string → idx (wymaga &mut interner — osobny blok)
-                let name_idx = self.state.interner.intern(&name_str);
-                // 3. Lookup zmiennej przez idx
                 let val = self.state.get_var(name_idx);
-                self.state.set_reg(dst, val);
-                Ok(ExecSignal::Next)
+                self.state.set_reg(r.a, val);
             }
-            Instruction::SetVar { name, src } => {
-                let val = self.state.get_reg(src);
+            op::SET_VAR => {
+                let name = self.str_id(r.a);
+                let val  = self.state.get_reg(r.b);
                 self.state.set_var(name, val);
                 // Synchronizuj last_exit jeśli to _last_exit_code
-                let le_name = self.const_str_idx("_last_exit_code");
-                if name == le_name {
+                if name == self.le_idx {
                     self.state.last_exit = val.as_f64() as i32;
                 }
-                Ok(ExecSignal::Next)
             }
-            Instruction::SetEnv { name, src } => {
-                let val = self.state.get_reg(src);
+            op::SET_ENV => {
+                let name = self.str_id(r.a);
+                let val  = self.state.get_reg(r.b);
                 self.state.export_var(name, val);
-                Ok(ExecSignal::Next)
-            }
-
-            // ── Arytmetyka — bezpośrednio na f64, zero alokacji ───────────────
-            Instruction::Add { dst, a, b } => {
-                let r = self.state.get_reg(a).as_f64() + self.state.get_reg(b).as_f64();
-                self.state.set_reg(dst, NanVal::num(r));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::Sub { dst, a, b } => {
-                let r = self.state.get_reg(a).as_f64() - self.state.get_reg(b).as_f64();
-                self.state.set_reg(dst, NanVal::num(r));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::Mul { dst, a, b } => {
-                let r = self.state.get_reg(a).as_f64() * self.state.get_reg(b).as_f64();
-                self.state.set_reg(dst, NanVal::num(r));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::Div { dst, a, b } => {
-                let va = self.state.get_reg(a).as_f64();
-                let vb = self.state.get_reg(b).as_f64();
-                self.state.set_reg(dst, NanVal::num(if vb == 0.0 { 0.0 } else { va / vb }));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::Mod { dst, a, b } => {
-                let va = self.state.get_reg(a).as_f64() as i64;
-                let vb = self.state.get_reg(b).as_f64() as i64;
-                let r  = if vb == 0 { 0 } else { va % vb };
-                self.state.set_reg(dst, NanVal::num(r as f64));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::Neg { dst, src } => {
-                let r = -self.state.get_reg(src).as_f64();
-                self.state.set_reg(dst, NanVal::num(r));
-                Ok(ExecSignal::Next)
-            }
-
-            // ── Porównania — fast path dla liczb ─────────────────────────────
-            Instruction::CmpEq { dst, a, b } => {
-                let va = self.state.get_reg(a);
-                let vb = self.state.get_reg(b);
-                self.state.set_reg(dst, NanVal::bool(va.eq_val(&vb, &self.state.interner)));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::CmpNe { dst, a, b } => {
-                let va = self.state.get_reg(a);
-                let vb = self.state.get_reg(b);
-                self.state.set_reg(dst, NanVal::bool(!va.eq_val(&vb, &self.state.interner)));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::CmpLt { dst, a, b } => {
-                let r = self.state.get_reg(a).as_f64() < self.state.get_reg(b).as_f64();
-                self.state.set_reg(dst, NanVal::bool(r));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::CmpLe { dst, a, b } => {
-                let r = self.state.get_reg(a).as_f64() <= self.state.get_reg(b).as_f64();
-                self.state.set_reg(dst, NanVal::bool(r));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::CmpGt { dst, a, b } => {
-                let r = self.state.get_reg(a).as_f64() > self.state.get_reg(b).as_f64();
-                self.state.set_reg(dst, NanVal::bool(r));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::CmpGe { dst, a, b } => {
-                let r = self.state.get_reg(a).as_f64() >= self.state.get_reg(b).as_f64();
-                self.state.set_reg(dst, NanVal::bool(r));
-                Ok(ExecSignal::Next)
-            }
-
-            // ── Konwersje ─────────────────────────────────────────────────────
-            Instruction::ToString { dst, src } => {
-                let s   = self.state.get_reg(src).to_str_val(&self.state.interner);
-                let val = self.state.intern_str_owned(s);
-                self.state.set_reg(dst, val);
-                Ok(ExecSignal::Next)
-            }
-            Instruction::ToNumber { dst, src } => {
-                let n = self.state.get_reg(src).as_f64();
-                self.state.set_reg(dst, NanVal::num(n));
-                Ok(ExecSignal::Next)
-            }
-            Instruction::Truthy { dst, src } => {
-                let val = self.state.get_reg(src);
-                let b   = match val.as_str_idx() {
-                    Some(idx) => {
-                        // Warunek while — ewaluuj wyrażenie porównania
-                        let s = self.state.interner.get(idx).to_string();
-                        eval_condition_str(&s, &mut self.state)
-                    }
-                    None => val.is_truthy(&self.state.interner),
-                };
-                self.state.set_reg(dst, NanVal::bool(b));
-                Ok(ExecSignal::Next)
             }
 
-            // ── Concat — internuje wynik ──────────────────────────────────────
-            Instruction::Concat { dst, parts } => {
-                let mut buf = String::new();
-                for &r in &parts {
-                    let s = self.state.get_reg(r).to_str_val(&self.state.interner);
-                    buf.push_str(&s);
-                }
-                let val = self.state.intern_str_owned(buf);
-                self.state.set_reg(dst, val);
-                Ok(ExecSignal::Next)
+            // ── Arytmetyka — bezpośrednio na f64, zero alokacji ───────────
+            op::ADD => {
+                let v = self.state.get_reg(r.b).as_f64() + self.state.get_reg(r.c).as_f64();
+                self.state.set_reg(r.a, NanVal::num(v));
+            }
+            op::SUB => {
+                let v = self.state.get_reg(r.b).as_f64() - self.state.get_reg(r.c).as_f64();
+                self.state.set_reg(r.a, NanVal::num(v));
+            }
+            op::MUL => {
+                let v = self.state.get_reg(r.b).as_f64() * self.state.get_reg(r.c).as_f64();
+                self.state.set_reg(r.a, NanVal::num(v));
+            }
+            op::DIV => {
+                let va = self.state.get_reg(r.b).as_f64();
+                let vb = self.state.get_reg(r.c).as_f64();
+                self.state.set_reg(r.a, NanVal::num(if vb == 0.0 { 0.0 } else { va / vb }));
+            }
+            op::MOD => {
+                let va = self.state.get_reg(r.b).as_f64() as i64;
+                let vb = self.state.get_reg(r.c).as_f64() as i64;
+                let v  = if vb == 0 { 0 } else { va % vb };
+                self.state.set_reg(r.a, NanVal::num(v as f64));
+            }
+            op::NEG => {
+                let v = -self.state.get_reg(r.b).as_f64();
+                self.state.set_reg(r.a, NanVal::num(v));
             }
 
-            // ── Output ────────────────────────────────────────────────────────
-            Instruction::Print { src } => {
-                println!("{}", self.state.get_reg(src).to_str_val(&self.state.interner));
-                Ok(ExecSignal::Next)
+            // ── Porównania — fast path dla liczb ─────────────────────────
+            op::CMP_EQ | op::CMP_NE => {
+                let va = self.state.get_reg(r.b);
+                let vb = self.state.get_reg(r.c);
+                let eq = va.eq_val(&vb, &self.state.interner);
+                self.state.set_reg(r.a, NanVal::bool(eq == (r.op == op::CMP_EQ)));
+            }
+            op::CMP_LT | op::CMP_LE | op::CMP_GT | op::CMP_GE => {
+                let va = self.state.get_reg(r.b).as_f64();
+                let vb = self.state.get_reg(r.c).as_f64();
+                let v  = match r.op {
+                    op::CMP_LT => va <  vb,
+                    op::CMP_LE => va <= vb,
+                    op::CMP_GT => va >  vb,
+                    _          => va >= vb,
+                };
+                self.state.set_reg(r.a, NanVal::bool(v));
             }
 
-            // ── Sterowanie ────────────────────────────────────────────────────
-            Instruction::JumpIfFalse { cond, offset } => {
-                if !self.state.get_reg(cond).is_truthy(&self.state.interner) {
-                    Ok(ExecSignal::Jump(offset))
-                } else {
-                    Ok(ExecSignal::Next)
-                }
+            // ── Konwersje ─────────────────────────────────────────────────
+            op::TO_STRING => {
+                let v = self.state.get_reg(r.b);
+                let val = if v.is_str() { v } else {
+                    let s = v.to_str_val(&self.state.interner);
+                    self.state.new_str_owned(s)
+                };
+                self.state.set_reg(r.a, val);
             }
-            Instruction::JumpIfTrue { cond, offset } => {
-                if self.state.get_reg(cond).is_truthy(&self.state.interner) {
-                    Ok(ExecSignal::Jump(offset))
-                } else {
-                    Ok(ExecSignal::Next)
+            // Tekst parsujemy — `@n` z wyjścia komendy porównuje się jak liczba
+            op::TO_NUMBER => {
+                let v = self.state.get_reg(r.b);
+                let n = match v.text(&self.state.interner) {
+                    Some(s) => s.trim().parse().unwrap_or(0.0),
+                    None    => v.as_f64(),
+                };
+                self.state.set_reg(r.a, NanVal::num(n));
+            }
+            // Granica pętli zakresu: i32 z nasyceniem, tekst parsowany jak wyżej
+            op::TO_INT => {
+                let v = self.state.get_reg(r.b);
+                let i = match (v.as_int(), v.text(&self.state.interner)) {
+                    (Some(i), _)    => i,
+                    (None, Some(s)) => s.trim().parse::<f64>().unwrap_or(0.0) as i32,
+                    (None, None)    => v.as_f64() as i32,
+                };
+                self.state.set_reg(r.a, NanVal::int(i));
+            }
+            // Licznik po i32::MAX przechodzi w nil — ForRangeNext kończy pętlę
+            op::FOR_RANGE_STEP => {
+                let next = self.state.get_reg(r.b).as_int().and_then(|i| i.checked_add(1));
+                self.state.set_reg(r.a, next.map_or(NanVal::nil(), NanVal::int));
+            }
+            // Ta sama prawda co trasa JIT (`trace_truthy`) — bez ewaluacji tekstu
+            op::TRUTHY => {
+                let b = self.state.get_reg(r.b).is_truthy(&self.state.interner);
+                self.state.set_reg(r.a, NanVal::bool(b));
+            }
+            op::NOT => {
+                let b = self.state.get_reg(r.b).is_truthy(&self.state.interner);
+                self.state.set_reg(r.a, NanVal::bool(!b));
+            }
+            op::TEST => {
+                let v = self.state.get_reg(r.b);
+                let b = match (test_op_from_u8(r.aux), v.text(&self.state.interner)) {
+                    (Some(t), Some(s)) => executor::eval_test(t, &s),
+                    (Some(t), None)    => executor::eval_test(t, &v.to_str_val(&self.state.interner)),
+                    (None, _)          => false,
+                };
+                self.state.set_reg(r.a, NanVal::bool(b));
+            }
+
+            // ── Concat — bufor wielokrotnego użytku, internuje wynik ──────
+            op::CONCAT => {
+                let mut buf = std::mem::take(&mut self.scratch);
+                buf.clear();
+                let (s, n) = (r.b as usize, r.c as usize);
+                for &p in &self.prog.extra[s..s + n] {
+                    self.state.get_reg(p).append_to(&self.state.interner, &mut buf);
                 }
+                let v = self.state.new_str(&buf);
+                self.scratch = buf;
+                self.state.set_reg(r.a, v);
+            }
+
+            // ── Output ────────────────────────────────────────────────────
+            op::PRINT => {
+                println!("{}", self.state.get_reg(r.a).to_str_val(&self.state.interner));
             }
-            Instruction::Jump { offset } => Ok(ExecSignal::Jump(offset)),
-            Instruction::Return { .. }   => Ok(ExecSignal::Return),
 
-            // ── Wywołania ─────────────────────────────────────────────────────
-            Instruction::CallFunc { name } => Ok(ExecSignal::FuncCall(name)),
+            // ── Wywołania ─────────────────────────────────────────────────
+            op::CALL_FUNC => self.call_func(r.a)?,
+            op::ARENA_CALL => self.call_arena(r.a, r.b)?,
 
-            Instruction::CallQuick { name, arg, dst } => {
-                let arg_str  = self.state.get_reg(arg).to_str_val(&self.state.interner);
-                let name_str = self.const_str(name);
-                let result   = exec_quick_fn(&name_str, &arg_str, &mut self.state);
-                let val      = self.state.intern_str_owned(result);
-                self.state.set_reg(dst, val);
-                Ok(ExecSignal::Next)
+            // Funkcja rozwiązana w parserze (`aux`); czyste idą przez kernele
+            // z hl_core::quick na buforach interpretera — bez alokacji
+            op::CALL_QUICK => {
+                let Some(f) = QuickFn::from_id(r.aux) else {
+                    eprintln!("\x1b[31m[hl jit]\x1b[0m Nieznana quick-funkcja '::{}'", self.prog.const_str(r.a));
+                    let v = self.state.new_str("");
+                    self.state.set_reg(r.c, v);
+                    return Ok(());
+                };
+                let argv = self.state.get_reg(r.b);
+                let (mut arg, mut out) = (std::mem::take(&mut self.scratch), std::mem::take(&mut self.quick_buf));
+                arg.clear();
+                out.clear();
+                argv.append_to(&self.state.interner, &mut arg);
+                let val = match quick::kernel(f, arg.trim(), &mut out) {
+                    Ok(Some(quick::Kernel::Text)) => self.state.new_str(&out),
+                    Ok(Some(quick::Kernel::Same)) if arg.trim().len() == arg.len() => argv,
+                    Ok(Some(quick::Kernel::Same)) => self.state.new_str(arg.trim()),
+                    Ok(Some(quick::Kernel::Num(n))) => NanVal::num(n),
+                    Ok(Some(quick::Kernel::Bool(b))) => {
+                        let k = self.state.interner.intern("_last_bool");
+                        self.state.set_var(k, NanVal::bool(b));
+                        NanVal::bool(b)
+                    }
+                    Ok(None) => {
+                        let res = exec_quick_effect(f, arg.trim(), &mut self.state);
+                        self.state.new_str_owned(res)
+                    }
+                    Err(e) => {
+                        self.scratch = arg;
+                        self.quick_buf = out;
+                        return Err(e);
+                    }
+                };
+                self.scratch = arg;
+                self.quick_buf = out;
+                self.state.set_reg(r.c, val);
             }
 
-            // ── Komendy systemowe ─────────────────────────────────────────────
-            Instruction::ExecCmd { cmd, mode, dst } => {
-                let cmd_str   = self.state.get_reg(cmd).to_str_val(&self.state.interner);
+            // ── Komendy systemowe ─────────────────────────────────────────
+            op::EXEC_CMD => {
+                let mode      = cmd_mode_from_u8(r.aux).unwrap_or(CmdMode::Plain);
+                let cmd_str   = self.state.get_reg(r.a).to_str_val(&self.state.interner);
                 let exit_code = exec_system_cmd(&cmd_str, mode, &mut self.state)?;
-                self.state.set_reg(dst, NanVal::num(exit_code as f64));
+                self.state.set_reg(r.b, NanVal::num(exit_code as f64));
                 self.state.last_exit = exit_code;
                 // Ustaw _last_exit_code w zmiennych
-                let le_idx = self.state.interner.intern("_last_exit_code");
-                self.state.set_var(le_idx, NanVal::num(exit_code as f64));
-                Ok(ExecSignal::Next)
+                self.state.set_var(self.le_idx, NanVal::num(exit_code as f64));
             }
-
-            Instruction::ExecCapture { cmd, mode, dst_ec, dst_out } => {
-                let cmd_str = self.state.get_reg(cmd).to_str_val(&self.state.interner);
-                let (exit_code, stdout) = exec_system_cmd_capture(&cmd_str, mode)?;
-                self.state.set_reg(dst_ec, NanVal::num(exit_code as f64));
-                let out_val = self.state.intern_str_owned(stdout);
-                self.state.set_reg(dst_out, out_val);
+            op::EXEC_CAPTURE => {
+                let mode    = cmd_mode_from_u8(r.aux).unwrap_or(CmdMode::Plain);
+                let cmd_str = self.state.get_reg(r.a).to_str_val(&self.state.interner);
+                let (exit_code, stdout) = match cmd_str.strip_prefix("__extern__:") {
+                    Some(spec) => self.exec_extern(spec)?,
+                    None       => exec_system_cmd_capture(&cmd_str, mode)?,
+                };
+                self.state.set_reg(r.b, NanVal::num(exit_code as f64));
+                let out_val = self.state.new_str_owned(stdout);
+                self.state.set_reg(r.c, out_val);
                 self.state.last_exit = exit_code;
-                Ok(ExecSignal::Next)
             }
-
-            // ── For-in ────────────────────────────────────────────────────────
-            Instruction::ForInStart { iter_reg, src } => {
-                let src_str = self.state.get_reg(src).to_str_val(&self.state.interner);
-                // Intern każde słowo — szybsze porównania w pętli
-                let words: Vec<u32> = src_str.split_whitespace()
-                .map(|w| self.state.interner.intern(w))
-                .collect();
-                self.state.iters.insert(iter_reg, (words, 0));
-                Ok(ExecSignal::Next)
+            op::EXEC_TPL => {
+                let mode      = cmd_mode_from_u8(r.aux).unwrap_or(CmdMode::Plain);
+                let exit_code = match self.tpl_cmd(r.a, mode) {
+                    TplCmd::Argv(argv) => exec_launch(tpl_launch(argv, mode)),
+                    TplCmd::Line(line) => exec_system_cmd(&line, mode, &mut self.state)?,
+                };
+                self.state.set_reg(r.b, NanVal::num(exit_code as f64));
+                self.state.last_exit = exit_code;
+                self.state.set_var(self.le_idx, NanVal::num(exit_code as f64));
+            }
+            op::CAPTURE_TPL => {
+                let mode = cmd_mode_from_u8(r.aux).unwrap_or(CmdMode::Plain);
+                let (exit_code, stdout) = match self.tpl_cmd(r.a, mode) {
+                    TplCmd::Argv(argv) => capture_launch(tpl_launch(argv, mode)),
+                    TplCmd::Line(line) => exec_system_cmd_capture(&line, mode)?,
+                };
+                self.state.set_reg(r.b, NanVal::num(exit_code as f64));
+                let out_val = self.state.new_str_owned(stdout);
+                self.state.set_reg(r.c, out_val);
+                self.state.last_exit = exit_code;
             }
 
-            Instruction::ForInNext { iter_reg, dst, end_off } => {
-                let should_jump = if let Some((words, idx)) = self.state.iters.get_mut(&iter_reg) {
-                    if *idx >= words.len() {
-                        true
-                    } else {
-                        let word_idx = words[*idx];
-                        *idx += 1;
-                        self.state.set_reg(dst, NanVal::str_interned(word_idx));
-                        false
-                    }
-                } else { true };
-
-                if should_jump {
-                    self.state.iters.remove(&iter_reg);
-                    Ok(ExecSignal::Jump(end_off))
-                } else {
-                    Ok(ExecSignal::Next)
+            // ── For-in ────────────────────────────────────────────────────
+            op::FOR_IN_START => {
+                // String dzielony leniwie w ForInNext; liczba/bool najpierw do tekstu
+                let mut src = self.state.get_reg(r.b);
+                if src.text(&self.state.interner).is_none() {
+                    let s = src.to_str_val(&self.state.interner);
+                    src = self.state.new_str_owned(s);
                 }
+                self.state.iter_start(r.a, ForIter::Text { src, pos: 0, lines: r.c != 0 });
+            }
+            op::FOR_IN_CMD => {
+                let mode    = cmd_mode_from_u8(r.aux).unwrap_or(CmdMode::Plain);
+                let cmd_str = self.state.get_reg(r.b).to_str_val(&self.state.interner);
+                let stream  = exec_system_cmd_stream(&cmd_str, mode);
+                self.start_stream(r.a, stream, r.c != 0);
+            }
+            op::FOR_IN_TPL => {
+                let mode   = cmd_mode_from_u8(r.aux).unwrap_or(CmdMode::Plain);
+                let stream = match self.tpl_cmd(r.b, mode) {
+                    TplCmd::Argv(argv) => stream_launch(tpl_launch(argv, mode)),
+                    TplCmd::Line(line) => exec_system_cmd_stream(&line, mode),
+                };
+                self.start_stream(r.a, stream, r.c != 0);
+            }
+            // ── Goroutines i kanały ───────────────────────────────────────
+            op::GO_SPAWN => self.spawn_goroutine(r.a, r.b)?,
+            op::GO_WAIT => {
+                let tag  = (r.a != GO_TAG_ALL).then(|| self.prog.const_str(r.a));
+                let code = goroutine::wait(tag)?;
+                self.state.set_reg(r.b, NanVal::num(code as f64));
+            }
+            op::CHAN_OPEN => {
+                let cap = if r.b == 0 { goroutine::DEFAULT_CHANNEL_CAP } else { r.b as usize };
+                goroutine::channel_open(self.prog.const_str(r.a), cap);
+            }
+            op::CHAN_SEND => {
+                let val = self.state.get_reg(r.b).to_str_val(&self.state.interner);
+                goroutine::send(self.prog.const_str(r.a), val)?;
+            }
+            op::CHAN_RECV => {
+                let got = goroutine::recv(self.prog.const_str(r.a))?;
+                let val = self.state.new_str_owned(got);
+                self.state.set_reg(r.b, val);
             }
 
-            // ── HackerOS API ──────────────────────────────────────────────────
-            Instruction::HackerOsCall { tool, args, dst } => {
-                let tool_str = self.const_str(tool);
-                let args_str = self.state.get_reg(args).to_str_val(&self.state.interner);
+            // ── HackerOS API ──────────────────────────────────────────────
+            op::HACKEROS_CALL => {
+                let tool_str = self.prog.const_str(r.a);
+                let args_str = self.state.get_reg(r.b).to_str_val(&self.state.interner);
                 let cmd = if args_str.is_empty() {
-                    tool_str.clone()
+                    tool_str.to_string()
                 } else {
                     format!("{} {}", tool_str, args_str)
                 };
-                if which::which(&tool_str).is_err() {
+                if which::which(tool_str).is_err() {
                     eprintln!("\x1b[33m[hl ||]\x1b[0m Narzędzie '{}' nie jest zainstalowane.", tool_str);
-                    self.state.set_reg(dst, NanVal::num(127.0));
+                    self.state.set_reg(r.c, NanVal::num(127.0));
                 } else {
                     let ec = exec_system_cmd(&cmd, CmdMode::Plain, &mut self.state)?;
-                    self.state.set_reg(dst, NanVal::num(ec as f64));
+                    self.state.set_reg(r.c, NanVal::num(ec as f64));
                 }
-                Ok(ExecSignal::Next)
             }
+
+            // Program::validate odrzuca nieznane opcode przy ładowaniu
+            _ => {}
         }
+        Ok(())
     }
 
-    fn exec_func_by_name_idx(&mut self, name_idx: u32) -> Result<()> {
-        self.state.check_call_depth()?;
-        let name = self.const_str(name_idx);
-        let entry = match self.module.funcs.find(&name) {
-            Some(e) => e.clone(),
-            None    => bail!("Niezdefiniowana funkcja: '{}'", name),
+    /// ForInNext: następne słowo/linia do r.b; true = iterator wyczerpany (skok do r.c)
+    #[inline]
+    fn for_in_next(&mut self, r: FlatInsn) -> bool {
+        match self.state.iter_next(r.a) {
+            Ok(word) => {
+                self.state.set_reg(r.b, word);
+                false
+            }
+            Err(ec) => {
+                // Komenda skończyła — jej kod wyjścia widzi `? ok` / `? err` po pętli
+                if let Some(ec) = ec {
+                    self.state.last_exit = ec;
+                    self.state.set_var(self.le_idx, NanVal::num(ec as f64));
+                }
+                true
+            }
+        }
+    }
+
+    /// Wykonaj jedną instrukcję na żądanie trasy JIT. true = skok (ForInNext wyczerpany)
+    fn exec_one(&mut self, pc: usize) -> Result<bool> {
+        let r = self.prog.code[pc];
+        self.insns += 1;
+        if let Some(p) = self.prof.as_deref_mut() {
+            p.count(pc);
+            if profile::is_proc_op(r.op) || (r.op == op::FOR_IN_NEXT && self.iter_is_stream(r.a)) {
+                return self.timed_proc(pc, |s| s.exec_one_inner(r));
+            }
+        }
+        self.exec_one_inner(r)
+    }
+
+    #[inline]
+    fn exec_one_inner(&mut self, r: FlatInsn) -> Result<bool> {
+        if r.op == op::FOR_IN_NEXT {
+            return Ok(self.for_in_next(r));
+        }
+        if r.op == op::FOR_RANGE_NEXT {
+            return Ok(self.range_done(r));
+        }
+        self.exec_simple(r)?;
+        Ok(false)
+    }
+
+    /// Instrukcja uruchamiająca proces (albo czytająca jego wyjście) pod
+    /// profilerem — czas czekania idzie na konto procesów, nie interpretera
+    #[cold]
+    fn timed_proc<T>(&mut self, pc: usize, f: impl FnOnce(&mut Self) -> T) -> T {
+        if let Some(p) = self.prof.as_deref_mut() { p.proc_start(pc); }
+        let t0  = Instant::now();
+        let out = f(self);
+        if let Some(p) = self.prof.as_deref_mut() { p.proc_done(pc, t0.elapsed()); }
+        out
+    }
+
+    fn iter_is_stream(&self, iter: u32) -> bool {
+        matches!(self.state.iter_get(iter), Some(ForIter::Stream { .. }))
+    }
+
+    /// ForRangeNext: true = koniec pętli zakresu (licznik > koniec albo
+    /// któraś wartość nie jest liczbą całkowitą — licznik po i32::MAX to nil)
+    #[inline]
+    fn range_done(&self, r: FlatInsn) -> bool {
+        match (self.state.get_reg(r.a).as_int(), self.state.get_reg(r.b).as_int()) {
+            (Some(ctr), Some(end)) => ctr > end,
+            _                      => true,
+        }
+    }
+
+    /// Skok wsteczny: zliczaj, kompiluj gorącą pętlę, wykonaj natywnie jeśli gotowa.
+    /// Zwraca offset wyjścia z trasy albo None (interpretuj dalej).
+    #[cold]
+    fn on_back_edge(&mut self, target: usize, here: usize) -> Result<Option<usize>> {
+        // Guard: kompiluj tylko małe pętle (<= 64 instrukcji)
+        let loop_size = here - target;
+        let count = {
+            let c = &mut self.exec_counts[here];
+            *c = c.saturating_add(1);
+            *c
         };
-        self.state.call_depth += 1;
-        let start = entry.start_insn as usize;
-        let end   = start + entry.insn_count as usize;
-        let mut pc = start;
-        loop {
-            if pc >= end { break; }
-            match self.exec_insn(pc)? {
-                ExecSignal::Next             => pc += 1,
-                ExecSignal::Jump(off)        => pc = off as usize,
-                ExecSignal::Return           => break,
-                ExecSignal::Exit(code)       => { self.state.last_exit = code; break; }
-                ExecSignal::FuncCall(ni)     => { self.exec_func_by_name_idx(ni)?; pc += 1; }
+        if count == TRACE_THRESHOLD && loop_size <= 64 && self.jit.is_enabled() {
+            self.compile_hot_traces(target as u32, here as u32);
+        }
+        if let Some(trace) = self.jit.trace(target as u32) {
+            return self.exec_native_trace(trace);
+        }
+        Ok(None)
+    }
+
+    /// Skompiluj gorącą pętlę [start..=end] razem z pętlami, które są już
+    /// ciepłe (≥ połowy progu) — cała partia dostaje jedno `finalize_definitions`
+    /// przy pierwszym wykonaniu. Zagnieżdżone i sąsiednie pętle zwykle
+    /// rozgrzewają się razem, więc zamiast N finalizacji jest jedna.
+    fn compile_hot_traces(&mut self, start: u32, end: u32) {
+        let mut batch = vec![(start, end)];
+        for (here, &c) in self.exec_counts.iter().enumerate() {
+            if c < TRACE_THRESHOLD / 2 || c >= TRACE_THRESHOLD || here == end as usize { continue; }
+            let r = self.prog.code[here];
+            let target = r.b as usize;
+            if r.op == op::JUMP && target < here && here - target <= 64 {
+                batch.push((target as u32, here as u32));
+            }
+        }
+
+        let mut evicted = false;
+        for &(s, e) in &batch {
+            match self.try_compile_trace(s, e) {
+                Ok(ev) => {
+                    evicted |= ev;
+                    tracing::debug!("[trace jit] skompilowano pętlę @ {} (size={})", s, e - s);
+                }
+                Err(err) => tracing::debug!("[trace jit] pętla @ {}: {}", s, err),
+            }
+        }
+        // Limit pamięci JIT porzucił poprzednie trasy — niech liczą się od nowa
+        if evicted { self.exec_counts.fill(0); }
+        for &(_, e) in &batch {
+            self.exec_counts[e as usize] = TRACE_THRESHOLD;
+        }
+    }
+
+    /// Wykonaj skompilowaną trasę. Zwraca pc, od którego interpreter kontynuuje,
+    /// albo None — obrót pętli zostaje w interpreterze.
+    /// Wyjście wewnątrz trasy (inne niż Return) to deopt — po `DEOPT_LIMIT`
+    /// takich wyjściach trasa jest unieważniana i pętla zostaje w interpreterze.
+    fn exec_native_trace(&mut self, trace: CompiledTrace) -> Result<Option<usize>> {
+        // Slot mógł zniknąć (::unset) albo jeszcze nie istnieć — rozwiąż na wejściu.
+        // Zmienna bez slotu czyta std::env przy każdym odczycie; trasa trzymałaby
+        // jej wartość w slocie, więc ten obrót wykonuje interpreter (zwykle to
+        // pierwszy obrót przed przypisaniem w pętli).
+        if let Some(names) = self.trace_vars.remove(&trace.start) {
+            let mut ready = true;
+            for &c in &names {
+                let k = self.str_id(c);
+                match self.state.var_slot(k) {
+                    Some(slot) => self.var_slot_ids[c as usize] = slot,
+                    None       => ready = false,
+                }
+            }
+            self.trace_vars.insert(trace.start, names);
+            if !ready { return Ok(None); }
+        }
+        let (gc_live, gc_next) = self.state.interner.gc_counters();
+        let mut env = TraceEnv {
+            // SAFETY: NanVal jest #[repr(transparent)] u64. Rejestry nie są
+            // realokowane w trakcie trasy — validate mieści reg_count w regs.
+            regs:      self.state.regs.as_mut_ptr() as *mut u64,
+            str_ids:   self.str_ids.as_ptr(),
+            vars:      self.state.vars_flat.as_mut_ptr() as *mut u64,
+            var_slots: self.var_slot_ids.as_ptr(),
+            interp:    self as *mut Self as *mut std::ffi::c_void,
+            exec_one:  trace_exec_one,
+            truthy:    trace_truthy,
+            gc_live,
+            gc_next,
+            collect:   trace_collect,
+        };
+        let t0 = self.prof.as_deref_mut().map(|p| {
+            p.trace_begin(trace.start, trace.end as usize);
+            Instant::now()
+        });
+        metrics::inc(Counter::JitTraceRuns);
+        let pc = unsafe { (trace.fn_ptr)(&mut env) };
+        if let (Some(t0), Some(p)) = (t0, self.prof.as_deref_mut()) {
+            p.trace_done(trace.start, t0.elapsed());
+        }
+        if let Some(e) = self.jit_error.take() {
+            return Err(e);
+        }
+        let inside = pc >= trace.start && pc <= trace.end;
+        if inside && self.prog.code[pc as usize].op != op::RETURN {
+            metrics::inc(Counter::JitDeopts);
+            if self.jit.record_deopt(trace.start) {
+                tracing::debug!("[trace jit] pętla @ {} wraca do interpretera (deopt)", trace.start);
+            }
+        }
+        Ok(Some(pc as usize))
+    }
+
+    /// Zdefiniuj trasę [start..=end] w module JIT interpretera.
+    /// Zwraca true, jeśli limit pamięci JIT porzucił wcześniejsze trasy.
+    fn try_compile_trace(&mut self, start: u32, end: u32) -> Result<bool> {
+        // .bc spoza cache (hl compile) — kluczem jest hash treści kodu
+        let hash = *self.module_hash.get_or_insert_with(|| self.prog.content_hash());
+        let vars = self.prepare_trace(start, end)?;
+        let src = RegionSrc {
+            code:    &self.prog.code,
+            extra:   &self.prog.extra,
+            numbers: &self.prog.numbers,
+            strings: &self.prog.strings,
+        };
+        let evicted = self.jit.compile_trace(&src, start, end, Some(hash))?;
+        self.trace_vars.insert(start, vars);
+        Ok(evicted)
+    }
+
+    /// Przygotuj stan pod trasę [start..=end] (JIT albo AOT). Zwraca stałe
+    /// nazw zmiennych, które trasa trzyma w SSA.
+    fn prepare_trace(&mut self, start: u32, end: u32) -> Result<Vec<u32>> {
+        if start > end || end as usize >= self.prog.code.len() {
+            bail!("Pętla @{}..{} poza kodem", start, end);
+        }
+        // Kod natywny czyta id stringów wprost z `str_ids` — rozwiąż je teraz
+        for pc in start..=end {
+            let r = self.prog.code[pc as usize];
+            if r.op == op::LOAD_STR {
+                if r.b as usize >= self.str_ids.len() {
+                    bail!("LoadStr @{} poza tabelą stałych", pc);
+                }
+                self.str_id(r.b);
             }
         }
+        let src = RegionSrc {
+            code:    &self.prog.code,
+            extra:   &self.prog.extra,
+            numbers: &self.prog.numbers,
+            strings: &self.prog.strings,
+        };
+        let vars = promoted_vars(&src, start, end);
+        if vars.iter().any(|&c| c as usize >= self.var_slot_ids.len()) {
+            bail!("Zmienna w pętli @{} poza tabelą stałych", start);
+        }
+        Ok(vars)
+    }
+
+    // ── Wywołania funkcji ─────────────────────────────────────────────────────
+
+    fn call_func(&mut self, name_idx: u32) -> Result<()> {
+        self.state.check_call_depth()?;
+        let fi = self.resolve_func(name_idx)?;
+        let (_, start, count) = self.prog.funcs[fi];
+        self.state.call_depth += 1;
+        if let Some(p) = self.prof.as_deref_mut() { p.enter(fi); }
+        let start = start as usize;
+        self.exec_range(start, start + count as usize)?;
+        if let Some(p) = self.prof.as_deref_mut() { p.leave(); }
         self.state.call_depth -= 1;
         Ok(())
     }
 
-    #[inline]
-    fn const_str(&self, idx: u32) -> String {
-        self.module.consts.strings.get(idx as usize).cloned().unwrap_or_default()
+    /// ArenaCall: ciało `__arena__nazwa` we własnym regionie `size` bajtów.
+    /// Stringi zbudowane w ciele żyją w arenie; `arena_leave` kopiuje te, które
+    /// zostały w rejestrach i zmiennych, i zwalnia resztę jednym resetem
+    fn call_arena(&mut self, name_idx: u32, size: u32) -> Result<()> {
+        self.state.interner.arena_enter(size as usize);
+        let res = self.call_func(name_idx);
+        if let Some(stats) = self.state.arena_leave() {
+            let name = self.prog.const_str(name_idx);
+            hl_core::arena::record(name.strip_prefix("__arena__").unwrap_or(name), &stats);
+        }
+        res
+    }
+
+    /// ConstIdx nazwy funkcji → indeks w `prog.funcs` (leniwie, raz na stałą)
+    fn resolve_func(&mut self, name_idx: u32) -> Result<usize> {
+        let fi = match self.call_targets.get(name_idx as usize).copied() {
+            Some(UNRESOLVED) => {
+                let name = self.prog.const_str(name_idx);
+                let fi = self.prog.funcs.iter().position(|f| f.0 == name)
+                .map(|i| i as u32)
+                .unwrap_or(NOT_FOUND);
+                self.call_targets[name_idx as usize] = fi;
+                fi
+            }
+            Some(fi) => fi,
+            None     => NOT_FOUND,
+        };
+        if fi == NOT_FOUND {
+            bail!("Niezdefiniowana funkcja: '{}'", self.prog.const_str(name_idx));
+        }
+        Ok(fi as usize)
+    }
+
+    /// GoSpawn: ciało `:*` (ukryta funkcja __go_N) wykonuje osobny interpreter
+    /// w puli goroutines — na wspólnej kopii programu i z kopią zmiennych,
+    /// które ciało czyta
+    #[cold]
+    fn spawn_goroutine(&mut self, func_idx: u32, tag_idx: u32) -> Result<()> {
+        let fi = self.resolve_func(func_idx)?;
+        let (_, start, count) = self.prog.funcs[fi];
+        let (start, end) = (start as usize, (start + count) as usize);
+        let shared = self.shared.get_or_insert_with(|| Arc::new(self.prog.to_shared())).clone();
+
+        // Zmienne po nazwie czytają też warunki, quick-funkcje i wywołania —
+        // wtedy kopiujemy wszystkie
+        let body = &self.prog.code[start..end];
+        let vars = if body.iter().any(|r| matches!(r.op, op::GET_VAR_DYN | op::CALL_FUNC | op::ARENA_CALL | op::CALL_QUICK | op::TRUTHY)) {
+            self.state.snapshot_vars(None)
+        } else {
+            let consts: Vec<u32> = body.iter().filter(|r| r.op == op::GET_VAR).map(|r| r.b).collect();
+            // Blok extern (ExecCapture `__extern__:…`) czyta `_arg_N` i `_env_*`
+            // po nazwie w `exec_extern`
+            let has_extern = body.iter().any(|r| r.op == op::EXEC_CAPTURE);
+            let mut names: Vec<u32> = consts.into_iter().map(|c| self.str_id(c)).collect();
+            if has_extern {
+                let interner = &self.state.interner;
+                names.extend(self.state.var_slots.keys().copied().filter(|&n| {
+                    let name = interner.get(n);
+                    name.starts_with("_arg_") || name.starts_with("_env_")
+                }));
+            }
+            self.state.snapshot_vars(Some(&names))
+        };
+
+        let tag   = self.prog.const_str(tag_idx);
+        let label = if tag.is_empty() { "<goroutine>".to_string() } else { tag.to_string() };
+        let hash  = self.module_hash;
+        let aot   = self.aot;
+        goroutine::spawn((!tag.is_empty()).then_some(tag), move || {
+            let mut child = BytecodeInterpreter::with_program(shared.program());
+            child.shared = Some(shared.clone());
+            if let Some(h) = hash { child.set_module_hash(h); }
+            child.install_aot(aot);
+            child.init_hl_vars();
+            child.state.restore_vars(vars);
+            let res = child.exec_range(start, end);
+            child.flush_metrics();
+            match res {
+                Ok(_)  => child.state.last_exit,
+                Err(e) => { eprintln!("\x1b[31m[hl :*]\x1b[0m goroutine '{}': {}", label, e); 1 }
+            }
+        });
+        Ok(())
+    }
+
+    /// Blok `_> plik [runtime] def` (lower: `__extern__:<runtime>:<plik>`).
+    /// Argumenty `_arg_N` idą do `extern so` bez przepisywania na argv:
+    /// liczby jako liczby, napisy jako wycinki z internera; biblioteka
+    /// i symbole z cache procesu (`hl_core::ffi`).
+    fn exec_extern(&mut self, spec: &str) -> Result<(i32, String)> {
+        use hl_core::ffi::Arg;
+        let Some((rt, file)) = spec.split_once(':') else { bail!("extern: zły opis '{}'", spec) };
+        let Some(runtime) = ExternRuntime::from_str(rt) else { bail!("extern: nieznany runtime '{}'", rt) };
+        let file = hl_core::extern_runner::locate_extern_file(file.to_string(), &runtime);
+
+        let mut vals: Vec<NanVal> = Vec::new();
+        while let Some(k) = self.state.interner.lookup(&format!("_arg_{}", vals.len())) {
+            let v = self.state.get_var(k);
+            if v.is_nil() || v.text(&self.state.interner).is_some_and(|t| t.is_empty()) { break; }
+            vals.push(v);
+        }
+        let extra_env: Vec<(String, String)> = match runtime {
+            ExternRuntime::So => Vec::new(),
+            _ => self.state.var_slots.iter().filter_map(|(&n, &slot)| {
+                let key = self.state.interner.get(n).strip_prefix("_env_")?;
+                Some((key.to_string(), self.state.vars_flat[slot as usize].to_str_val(&self.state.interner)))
+            }).collect(),
+        };
+
+        let interner = &self.state.interner;
+        let texts: Vec<_> = vals.iter().map(|v| v.text(interner)).collect();
+        let args: Vec<Arg> = vals.iter().zip(&texts).map(|(v, t)| match t {
+            Some(s)               => Arg::Str(s),
+            None if v.is_bool()   => Arg::Str(if v.as_f64() != 0.0 { "true" } else { "false" }),
+            None                  => Arg::Num(v.as_f64()),
+        }).collect();
+
+        let res = hl_core::extern_runner::run_extern(&runtime, &file, &args, &extra_env)?;
+        Ok((res.exit_code, res.stdout.unwrap_or_default().trim().to_string()))
     }
 
+    /// Iterator for-in po wyjściu komendy; błąd startu = pusta pętla, exit 1
+    fn start_stream(&mut self, iter: u32, stream: std::io::Result<spawn::OutputStream>, lines: bool) {
+        match stream {
+            Ok(out) => self.state.iter_start(iter, ForIter::Stream { out, lines }),
+            Err(e)  => {
+                eprintln!("\x1b[31m[hl jit]\x1b[0m Błąd komendy: {}", e);
+                self.state.iter_start(iter, ForIter::Text { src: NanVal::nil(), pos: 0, lines });
+                self.state.last_exit = 1;
+                self.state.set_var(self.le_idx, NanVal::num(1.0));
+            }
+        }
+    }
+
+    /// Wypełnij dziury szablonu `extra[start]`. Słowa argv podzielił już
+    /// lower, więc zwykle nic nie tokenizujemy. Gdy wartość dziury zmieniłaby
+    /// podział (biały znak, cudzysłów, znak powłoki) albo tryb wymaga `sh -c`,
+    /// składamy pełną linię i idziemy zwykłą ścieżką — wynik jest taki sam
+    /// jak dla `ExecCmd` z tą samą linią.
+    fn tpl_cmd(&mut self, start: u32, mode: CmdMode) -> TplCmd {
+        let Some(tpl) = TplView::parse(&self.prog.extra, start as usize) else {
+            return TplCmd::Line(String::new());
+        };
+        let isolated = matches!(mode, CmdMode::Isolated | CmdMode::IsolatedSudo | CmdMode::WithVarsIsolated);
+        let mut argv: Vec<String> = Vec::with_capacity(8);
+        let mut fallback = isolated;
+        'words: for word in tpl.words() {
+            let mut w = String::new();
+            for &p in word {
+                match tpl_part(p) {
+                    TplPart::Lit(idx) => w.push_str(self.prog.const_str(idx)),
+                    TplPart::Hole(reg) => {
+                        let at = w.len();
+                        self.state.get_reg(reg).append_to(&self.state.interner, &mut w);
+                        if w[at..].contains(|c: char| c.is_whitespace() || c == '\'' || c == '"' || SHELL_CHARS.contains(&c)) {
+                            fallback = true;
+                            break 'words;
+                        }
+                    }
+                }
+            }
+            if !w.is_empty() { argv.push(w); }
+        }
+        if !fallback && argv.first().is_some_and(|p| p != "__hl_import__") {
+            return TplCmd::Argv(argv);
+        }
+        let mut line = String::new();
+        for &p in tpl.raw {
+            match tpl_part(p) {
+                TplPart::Lit(idx)  => line.push_str(self.prog.const_str(idx)),
+                TplPart::Hole(reg) => self.state.get_reg(reg).append_to(&self.state.interner, &mut line),
+            }
+        }
+        TplCmd::Line(line)
+    }
+
+    /// ConstIdx → idx w internerze (leniwie, raz na stałą)
     #[inline]
-    fn const_str_idx(&mut self, s: &str) -> u32 {
-        self.state.interner.intern(s)
+    fn str_id(&mut self, idx: u32) -> u32 {
+        match self.str_ids.get(idx as usize).copied() {
+            Some(UNRESOLVED) => {
+                let id = self.state.interner.intern(self.prog.const_str(idx));
+                self.str_ids[idx as usize] = id;
+                id
+            }
+            Some(id) => id,
+            None     => 0, // idx 0 = pusty string
+        }
     }
 }
 
+// ── Helpery tras JIT ──────────────────────────────────────────────────────────
+//
+// Wołane z kodu natywnego przez wskaźniki w `TraceEnv`. `env.interp` ustawia
+// `exec_native_trace` na interpreter, który właśnie wykonuje trasę.
+
+/// Wykonaj instrukcję `pc` ogólną ścieżką interpretera
+unsafe extern "C" fn trace_exec_one(env: *mut TraceEnv, pc: u32) -> u32 {
+    let interp = &mut *((*env).interp as *mut BytecodeInterpreter<'static>);
+    let res = interp.exec_one(pc as usize);
+    // set_var mógł powiększyć (przenieść) vars_flat
+    (*env).vars = interp.state.vars_flat.as_mut_ptr() as *mut u64;
+    match res {
+        Ok(false) => HELPER_NEXT,
+        Ok(true)  => HELPER_BRANCH,
+        Err(e)    => {
+            interp.jit_error = Some(e);
+            HELPER_FAILED
+        }
+    }
+}
+
+/// Truthiness dla nil/int/string (bool i liczby rozstrzyga kod natywny)
+unsafe extern "C" fn trace_truthy(env: *mut TraceEnv, v: u64) -> u32 {
+    let interp = &*((*env).interp as *const BytecodeInterpreter<'static>);
+    NanVal(v).is_truthy(&interp.state.interner) as u32
+}
+
+/// Skok wsteczny trasy przy `wants_gc` — kod natywny zapisał już rejestry
+/// i zmienne z SSA, więc korzenie są te same co w interpreterze
+unsafe extern "C" fn trace_collect(env: *mut TraceEnv) {
+    let interp = &mut *((*env).interp as *mut BytecodeInterpreter<'static>);
+    interp.state.collect_strings();
+}
+
 // ── Komendy systemowe ─────────────────────────────────────────────────────────
 
 fn exec_system_cmd(cmd: &str, mode: CmdMode, _state: &mut RuntimeState) -> Result<i32> {
@@ -485,80 +1117,110 @@ fn exec_system_cmd(cmd: &str, mode: CmdMode, _state: &mut RuntimeState) -> Resul
         return Ok(0);
     }
     if let Some(rest) = cmd.strip_prefix("& ") {
-        let _ = Command::new("sh").args(["-c", rest])
-        .stdin(Stdio::null()).stdout(Stdio::inherit()).stderr(Stdio::inherit())
-        .spawn();
+        let opts = SpawnOpts { stdin: Stdio::Null, ..SpawnOpts::INHERIT };
+        let _ = spawn::spawn_detached("sh", &["-c", rest], opts);
         return Ok(0);
     }
 
-    let (prog, args, needs_sh) = build_cmd_parts(cmd, mode);
-    let status = if needs_sh {
-        Command::new("sh").args(["-c", cmd])
-        .stdin(Stdio::inherit()).stdout(Stdio::inherit()).stderr(Stdio::inherit())
-        .status()
-    } else {
-        Command::new(&prog).args(&args)
-        .stdin(Stdio::inherit()).stdout(Stdio::inherit()).stderr(Stdio::inherit())
-        .status()
-    };
+    Ok(exec_launch(build_cmd_parts(cmd, mode)))
+}
+
+fn exec_system_cmd_capture(cmd: &str, mode: CmdMode) -> Result<(i32, String)> {
+    Ok(capture_launch(build_cmd_parts(cmd, mode)))
+}
+
+/// Jak capture, ale stdout trafia do strumienia czytanego przez ForInNext
+fn exec_system_cmd_stream(cmd: &str, mode: CmdMode) -> std::io::Result<spawn::OutputStream> {
+    stream_launch(build_cmd_parts(cmd, mode))
+}
 
+/// Komenda z szablonu: gotowe argv albo linia dla zwykłej ścieżki
+enum TplCmd {
+    Argv(Vec<String>),
+    Line(String),
+}
+
+/// Sposób uruchomienia komendy: program z argumentami albo `sh -c linia`
+enum Launch<'c> {
+    Direct(String, Vec<String>),
+    Shell(&'c str),
+}
+
+fn exec_launch(l: Launch) -> i32 {
+    let status = match l {
+        Launch::Direct(prog, args) => spawn::run(&prog, &args, SpawnOpts::INHERIT),
+        Launch::Shell(cmd)         => spawn::run("sh", &["-c", cmd], SpawnOpts::INHERIT),
+    };
     match status {
-        Ok(s)  => Ok(s.code().unwrap_or(1)),
+        Ok(o)  => o.exit_code,
         Err(e) => {
             eprintln!("\x1b[31m[hl jit]\x1b[0m Błąd komendy: {}", e);
-            Ok(1)
+            1
         }
     }
 }
 
-fn exec_system_cmd_capture(cmd: &str, mode: CmdMode) -> Result<(i32, String)> {
-    let (prog, args, needs_sh) = build_cmd_parts(cmd, mode);
-    let out = if needs_sh {
-        Command::new("sh").args(["-c", cmd])
-        .stdin(Stdio::inherit()).stdout(Stdio::piped()).stderr(Stdio::piped())
-        .output()
-    } else {
-        Command::new(&prog).args(&args)
-        .stdin(Stdio::inherit()).stdout(Stdio::piped()).stderr(Stdio::piped())
-        .output()
+fn capture_launch(l: Launch) -> (i32, String) {
+    // stderr potomka ląduje w /dev/null (wcześniej: potok czytany i porzucany)
+    let opts = SpawnOpts { stdin: Stdio::Inherit, stdout: Stdio::Piped, stderr: Stdio::Null };
+    let out = match l {
+        Launch::Direct(prog, args) => spawn::run(&prog, &args, opts),
+        Launch::Shell(cmd)         => spawn::run("sh", &["-c", cmd], opts),
     };
     match out {
-        Ok(o)  => Ok((o.status.code().unwrap_or(1), String::from_utf8_lossy(&o.stdout).trim().to_string())),
-        Err(e) => { eprintln!("\x1b[31m[hl jit]\x1b[0m Capture error: {}", e); Ok((1, String::new())) }
+        Ok(o)  => (o.exit_code, String::from_utf8_lossy(&o.stdout.unwrap_or_default()).trim().to_string()),
+        Err(e) => { eprintln!("\x1b[31m[hl jit]\x1b[0m Capture error: {}", e); (1, String::new()) }
+    }
+}
+
+fn stream_launch(l: Launch) -> std::io::Result<spawn::OutputStream> {
+    let opts = SpawnOpts { stdin: Stdio::Null, stdout: Stdio::Piped, stderr: Stdio::Inherit };
+    match l {
+        Launch::Direct(prog, args) => spawn::stream(&prog, &args, opts),
+        Launch::Shell(cmd)         => spawn::stream("sh", &["-c", cmd], opts),
+    }
+}
+
+/// Argv z szablonu — ten sam podział, który `build_cmd_parts` zrobiłby na
+/// złożonej linii (szablony powstają tylko dla komend bez `sh -c`)
+fn tpl_launch(mut argv: Vec<String>, mode: CmdMode) -> Launch<'static> {
+    match mode {
+        CmdMode::Sudo | CmdMode::WithVarsSudo => Launch::Direct("sudo".into(), argv),
+        _ => {
+            let prog = argv.remove(0);
+            Launch::Direct(prog, argv)
+        }
     }
 }
 
-fn build_cmd_parts(cmd: &str, mode: CmdMode) -> (String, Vec<String>, bool) {
-    let needs_sh = cmd.contains('|') || cmd.contains(';') || cmd.contains('&')
-    || cmd.contains('>') || cmd.contains('<') || cmd.contains('$') || cmd.contains('`')
-    || cmd.contains('*') || cmd.contains('~');
+fn build_cmd_parts(cmd: &str, mode: CmdMode) -> Launch<'_> {
+    let needs_sh = cmd.contains(SHELL_CHARS);
 
     match mode {
         CmdMode::Sudo | CmdMode::WithVarsSudo => {
             if needs_sh {
-                ("sudo".into(), vec!["sh".into(), "-c".into(), cmd.into()], false)
+                Launch::Direct("sudo".into(), vec!["sh".into(), "-c".into(), cmd.into()])
             } else {
-                let parts = split_cmd(cmd);
-                ("sudo".into(), parts, false)
+                Launch::Direct("sudo".into(), split_cmd(cmd))
             }
         }
         CmdMode::Isolated | CmdMode::WithVarsIsolated => {
             let a = vec!["--mount","--pid","--net","--fork","--","sh","-c",cmd]
             .into_iter().map(|s| s.to_string()).collect();
-            ("unshare".into(), a, false)
+            Launch::Direct("unshare".into(), a)
         }
         CmdMode::IsolatedSudo => {
             let a = vec!["unshare","--mount","--pid","--net","--fork","--","sh","-c",cmd]
             .into_iter().map(|s| s.to_string()).collect();
-            ("sudo".into(), a, false)
+            Launch::Direct("sudo".into(), a)
         }
         _ => {
             if needs_sh {
-                (String::new(), vec![], true) // caller uses sh -c
+                Launch::Shell(cmd)
             } else {
                 let mut parts = split_cmd(cmd);
                 let prog = if parts.is_empty() { String::new() } else { parts.remove(0) };
-                (prog, parts, false)
+                Launch::Direct(prog, parts)
             }
         }
     }
@@ -585,131 +1247,59 @@ fn split_cmd(cmd: &str) -> Vec<String> {
 
 // ── Quick functions ───────────────────────────────────────────────────────────
 
-fn exec_quick_fn(name: &str, arg: &str, state: &mut RuntimeState) -> String {
-    match name {
-        "upper"    => arg.to_uppercase(),
-        "lower"    => arg.to_lowercase(),
-        "len"      => arg.len().to_string(),
-        "trim"     => arg.trim().to_string(),
-        "rev"      => arg.chars().rev().collect(),
-        "abs"      => arg.parse::<f64>().unwrap_or(0.0).abs().to_string(),
-        "ceil"     => arg.parse::<f64>().unwrap_or(0.0).ceil().to_string(),
-        "floor"    => arg.parse::<f64>().unwrap_or(0.0).floor().to_string(),
-        "round"    => arg.parse::<f64>().unwrap_or(0.0).round().to_string(),
-        "basename" => std::path::Path::new(arg).file_name().and_then(|n| n.to_str()).unwrap_or("").to_string(),
-        "dirname"  => std::path::Path::new(arg).parent().and_then(|p| p.to_str()).unwrap_or(".").to_string(),
-        "pid"      => { println!("{}", std::process::id()); String::new() }
-        "nl"       => { println!(); String::new() }
-        "hr"       => {
+fn capture_quick(prog: &str, arg: &str) -> String {
+    let opts = SpawnOpts { stdin: Stdio::Null, stdout: Stdio::Piped, stderr: Stdio::Inherit };
+    spawn::run(prog, &[arg], opts).ok()
+    .and_then(|o| o.stdout)
+    .map(|b| String::from_utf8_lossy(&b).trim().to_string())
+    .unwrap_or_default()
+}
+
+/// Quick-funkcje z efektami (zmienne, wyjście, procesy) — czyste liczy
+/// `hl_core::quick::kernel`
+fn exec_quick_effect(f: QuickFn, arg: &str, state: &mut RuntimeState) -> String {
+    use QuickFn as Q;
+    match f {
+        Q::Pid     => { println!("{}", std::process::id()); String::new() }
+        Q::Nl      => { println!(); String::new() }
+        Q::Hr      => {
             let w: usize = arg.parse().unwrap_or(60);
             println!("{}", "─".repeat(w)); String::new()
         }
-        "bold"     => { println!("\x1b[1m{}\x1b[0m", arg); String::new() }
-        "red"      => { println!("\x1b[31m{}\x1b[0m", arg); String::new() }
-        "green"    => { println!("\x1b[32m{}\x1b[0m", arg); String::new() }
-        "yellow"   => { println!("\x1b[33m{}\x1b[0m", arg); String::new() }
-        "cyan"     => { println!("\x1b[36m{}\x1b[0m", arg); String::new() }
-        "exists"   => {
-            let e = std::path::Path::new(arg).exists();
-            let k = state.interner.intern("_last_bool");
-            state.set_var(k, NanVal::bool(e));
-            if !e { String::from("false") } else { String::new() }
-        }
-        "isdir"    => { let e = std::path::Path::new(arg).is_dir();  e.to_string() }
-        "isfile"   => { let e = std::path::Path::new(arg).is_file(); e.to_string() }
-        "which"    => which::which(arg).map(|p| p.display().to_string()).unwrap_or_default(),
-        "env" | "getenv" => std::env::var(arg).unwrap_or_default(),
+        Q::Bold    => { println!("\x1b[1m{}\x1b[0m", arg); String::new() }
+        Q::Red     => { println!("\x1b[31m{}\x1b[0m", arg); String::new() }
+        Q::Green   => { println!("\x1b[32m{}\x1b[0m", arg); String::new() }
+        Q::Yellow  => { println!("\x1b[33m{}\x1b[0m", arg); String::new() }
+        Q::Cyan    => { println!("\x1b[36m{}\x1b[0m", arg); String::new() }
+        Q::Which   => which::which(arg).map(|p| p.display().to_string()).unwrap_or_default(),
+        Q::Env | Q::Getenv => std::env::var(arg).unwrap_or_default(),
         // ::env-path — ścieżka aktywnego środowiska z config.hk, zero subprocess
-        "env-path" => {
+        Q::EnvPath => {
             use hl_core::config::get_active_env;
             get_active_env()
                 .map(|(_n, p)| p.display().to_string())
                 .unwrap_or_default()
         }
-        "read"     => std::fs::read_to_string(arg).unwrap_or_default(),
-        "set"      => {
-            if let Some((name, val)) = arg.splitn(2, ' ').collect::<Vec<_>>().as_slice().split_first() {
-                let k = state.interner.intern(name);
-                let v = state.intern_str(val.first().copied().unwrap_or(""));
-                state.set_var(k, v);
-            }
+        Q::Read    => std::fs::read_to_string(arg).unwrap_or_default(),
+        Q::Set     => {
+            let (name, val) = arg.split_once(' ').unwrap_or((arg, ""));
+            let k = state.interner.intern(name);
+            let v = state.new_str(val.trim());
+            state.set_var(k, v);
             String::new()
         }
-        "get"      => {
+        Q::Get     => {
             let k = state.interner.intern(arg);
             state.get_var(k).to_str_val(&state.interner)
         }
-        "unset"    => {
+        Q::Unset   => {
             let k = state.interner.intern(arg);
-            state.var_cache.invalidate(k);
-            state.var_slots.remove(&k);
-            String::new()
-        }
-        "rand"     => {
-            let seed = std::time::SystemTime::now()
-            .duration_since(std::time::UNIX_EPOCH).unwrap_or_default().subsec_nanos() as u64;
-            let r = seed.wrapping_mul(6364136223846793005).wrapping_add(1442695040888963407) % 100;
-            r.to_string()
-        }
-        "date"     => { let o = Command::new("date").arg("+%Y-%m-%d").output().ok(); o.map(|o| String::from_utf8_lossy(&o.stdout).trim().to_string()).unwrap_or_default() }
-        "time"     => { let o = Command::new("date").arg("+%H:%M:%S").output().ok(); o.map(|o| String::from_utf8_lossy(&o.stdout).trim().to_string()).unwrap_or_default() }
-        _          => {
-            eprintln!("\x1b[31m[hl jit]\x1b[0m Nieznana quick-funkcja '::{}'", name);
+            state.unset_var(k);
             String::new()
         }
+        Q::Date    => { capture_quick("date", "+%Y-%m-%d") }
+        Q::Time    => { capture_quick("date", "+%H:%M:%S") }
+        _          => String::new(),
     }
 }
 
-// ── Ewaluacja warunków while ──────────────────────────────────────────────────
-
-fn eval_condition_str(cond: &str, state: &mut RuntimeState) -> bool {
-    let cond = cond.trim();
-    if cond.is_empty() { return false; }
-    if cond == "true"  { return true;  }
-    if cond == "false" { return false; }
-
-    const OPS: &[&str] = &["==", "!=", ">=", "<=", ">", "<"];
-    for op in OPS {
-        if let Some(pos) = find_op(cond, op) {
-            let left_raw  = cond[..pos].trim();
-            let right_raw = cond[pos + op.len()..].trim().trim_matches('"');
-
-            let lv = if let Some(name) = left_raw.strip_prefix('@') {
-                let k = state.interner.intern(name);
-                state.get_var(k).to_str_val(&state.interner)
-            } else {
-                left_raw.to_string()
-            };
-
-            return match *op {
-                "==" => lv == right_raw,
-                "!=" => lv != right_raw,
-                ">=" => lv.parse::<f64>().unwrap_or(0.0) >= right_raw.parse::<f64>().unwrap_or(0.0),
-                "<=" => lv.parse::<f64>().unwrap_or(0.0) <= right_raw.parse::<f64>().unwrap_or(0.0),
-                ">"  => lv.parse::<f64>().unwrap_or(0.0) >  right_raw.parse::<f64>().unwrap_or(0.0),
-                "<"  => lv.parse::<f64>().unwrap_or(0.0) <  right_raw.parse::<f64>().unwrap_or(0.0),
-                _    => false,
-            };
-        }
-    }
-
-    // Fallback shell
-    Command::new("sh").args(["-c", cond]).status().map(|s| s.success()).unwrap_or(false)
-}
-
-fn find_op(s: &str, op: &str) -> Option<usize> {
-    let b = s.as_bytes(); let ob = op.as_bytes(); let ol = ob.len();
-    let mut i = 0;
-    while i + ol <= b.len() {
-        if &b[i..i+ol] == ob {
-            let ok = match op {
-                ">" => i + 1 >= b.len() || b[i+1] != b'=',
-                "<" => i + 1 >= b.len() || b[i+1] != b'=',
-                _   => true,
-            };
-            if ok { return Some(i); }
-        }
-        i += 1;
-    }
-    None
-}
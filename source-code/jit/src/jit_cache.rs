@@ -0,0 +1,166 @@
+//! Trwały cache kodu maszynowego JIT
+//!
+//! Skompilowane fragmenty (trasy pętli) zapisujemy obok plików .bc w
+//! `~/.hackeros/hacker-lang/cache`, jako `<hash>.<start>-<end>.<cpu>.jit`:
+//!  - `hash`  — hash modułu (ten sam hash treści co w `compile_to_cache`)
+//!  - `start-end` — zakres instrukcji fragmentu
+//!  - `cpu`   — odcisk ISA hosta (triple + flagi cech CPU) i wersji generatora
+//!
+//! Kolejne uruchomienie ładuje bajty przez `define_function_bytes` zamiast
+//! ponownie przepuszczać IR przez Cranelift. Cache'ujemy tylko kod bez
+//! relokacji — taki fragment jest w pełni pozycyjnie niezależny.
+
+use cranelift_codegen::isa::TargetIsa;
+use std::io::{Read, Seek, SeekFrom, Write};
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::OnceLock;
+
+const JIT_MAGIC: &[u8; 4] = b"HLJC";
+/// Podbij przy każdej zmianie kodu generowanego dla tras (`build_region_fn`
+/// w `jit_engine`: guardy, ABI `TraceEnv`, helpery) — stary kod maszynowy
+/// musi przestać pasować do klucza (i do obrazów `crate::aot`)
+pub(crate) const JIT_CACHE_VERSION: u32 = 7;
+const JIT_HEADER_SIZE: usize = 4 + 4 + 8 + 4 + 4 + 8 + 4 + 4;
+const JIT_STATS_FILE: &str = "jit-stats";
+
+static HITS:   AtomicU64 = AtomicU64::new(0);
+static MISSES: AtomicU64 = AtomicU64::new(0);
+
+/// Fragment wczytany z cache
+pub struct CachedCode {
+    pub alignment: u64,
+    pub bytes:     Vec<u8>,
+}
+
+/// Czy trwały cache JIT jest aktywny (HL_NO_JIT_CACHE=1 wyłącza)
+pub fn enabled() -> bool {
+    static ON: OnceLock<bool> = OnceLock::new();
+    *ON.get_or_init(|| std::env::var_os("HL_NO_JIT_CACHE").is_none())
+}
+
+fn fnv1a(hash: &mut u64, bytes: &[u8]) {
+    const FNV_PRIME: u64 = 1099511628211;
+    for b in bytes {
+        *hash ^= *b as u64;
+        *hash = hash.wrapping_mul(FNV_PRIME);
+    }
+}
+
+/// Odcisk hosta: triple, flagi ISA (cechy CPU wykryte przez cranelift_native)
+/// oraz wersja hl i generatora. Liczony raz na proces.
+pub fn cpu_fingerprint(isa: &dyn TargetIsa) -> u64 {
+    static FP: OnceLock<u64> = OnceLock::new();
+    *FP.get_or_init(|| {
+        let mut h: u64 = 14695981039346656037;
+        fnv1a(&mut h, isa.triple().to_string().as_bytes());
+        for flag in isa.isa_flags() {
+            fnv1a(&mut h, flag.to_string().as_bytes());
+        }
+        fnv1a(&mut h, env!("CARGO_PKG_VERSION").as_bytes());
+        fnv1a(&mut h, &JIT_CACHE_VERSION.to_le_bytes());
+        h
+    })
+}
+
+pub fn entry_path(module_hash: u64, start: u32, end: u32, cpu: u64) -> PathBuf {
+    hl_compiler::cache::cache_dir()
+    .join(format!("{:016x}.{}-{}.{:016x}.jit", module_hash, start, end, cpu))
+}
+
+/// Wczytaj fragment. Każda niezgodność nagłówka = miss (plik zostanie nadpisany).
+pub fn load(module_hash: u64, start: u32, end: u32, cpu: u64) -> Option<CachedCode> {
+    let raw = std::fs::read(entry_path(module_hash, start, end, cpu)).ok()?;
+    if raw.len() < JIT_HEADER_SIZE || &raw[0..4] != JIT_MAGIC { return None; }
+    let u32_at = |o: usize| u32::from_le_bytes(raw[o..o + 4].try_into().unwrap());
+    let u64_at = |o: usize| u64::from_le_bytes(raw[o..o + 8].try_into().unwrap());
+    if u32_at(4) != JIT_CACHE_VERSION || u64_at(8) != module_hash
+        || u32_at(16) != start || u32_at(20) != end || u64_at(24) != cpu
+    {
+        return None;
+    }
+    let alignment = u32_at(32) as u64;
+    let len       = u32_at(36) as usize;
+    let bytes     = raw.get(JIT_HEADER_SIZE..JIT_HEADER_SIZE + len)?.to_vec();
+    if bytes.is_empty() || !alignment.is_power_of_two() { return None; }
+    Some(CachedCode { alignment, bytes })
+}
+
+/// Zapisz fragment (tmp + rename — równoległe procesy widzą stary albo nowy plik)
+pub fn store(module_hash: u64, start: u32, end: u32, cpu: u64, alignment: u64, code: &[u8]) {
+    if hl_compiler::ensure_cache_dir().is_err() { return; }
+    let mut buf = Vec::with_capacity(JIT_HEADER_SIZE + code.len());
+    buf.extend_from_slice(JIT_MAGIC);
+    buf.extend_from_slice(&JIT_CACHE_VERSION.to_le_bytes());
+    buf.extend_from_slice(&module_hash.to_le_bytes());
+    buf.extend_from_slice(&start.to_le_bytes());
+    buf.extend_from_slice(&end.to_le_bytes());
+    buf.extend_from_slice(&cpu.to_le_bytes());
+    buf.extend_from_slice(&(alignment as u32).to_le_bytes());
+    buf.extend_from_slice(&(code.len() as u32).to_le_bytes());
+    buf.extend_from_slice(code);
+
+    let path = entry_path(module_hash, start, end, cpu);
+    let tmp  = path.with_extension(format!("jit.{}.tmp", std::process::id()));
+    if std::fs::write(&tmp, &buf).is_ok() && std::fs::rename(&tmp, &path).is_ok() {
+        tracing::debug!("[jit cache] zapisano {:?} ({} B)", path, code.len());
+        // Fragment liczy się do budżetu wpisu .bc — usuwany razem z nim
+        hl_compiler::cache::add_entry_bytes(module_hash, buf.len() as u64);
+    } else {
+        let _ = std::fs::remove_file(&tmp);
+    }
+}
+
+#[inline] pub fn record_hit()  { HITS.fetch_add(1, Ordering::Relaxed); }
+#[inline] pub fn record_miss() { MISSES.fetch_add(1, Ordering::Relaxed); }
+
+/// Statystyki trafień (łącznie ze wszystkich uruchomień)
+#[derive(Debug, Clone, Copy, Default)]
+pub struct JitCacheStats {
+    pub hits:   u64,
+    pub misses: u64,
+}
+
+impl JitCacheStats {
+    pub fn hit_rate(&self) -> f64 {
+        let total = self.hits + self.misses;
+        if total == 0 { 0.0 } else { self.hits as f64 * 100.0 / total as f64 }
+    }
+}
+
+fn stats_path() -> PathBuf {
+    hl_compiler::cache::cache_dir().join(JIT_STATS_FILE)
+}
+
+pub fn read_stats() -> JitCacheStats {
+    parse_stats(&std::fs::read(stats_path()).unwrap_or_default())
+}
+
+fn parse_stats(raw: &[u8]) -> JitCacheStats {
+    if raw.len() < 16 { return JitCacheStats::default(); }
+    JitCacheStats {
+        hits:   u64::from_le_bytes(raw[0..8].try_into().unwrap()),
+        misses: u64::from_le_bytes(raw[8..16].try_into().unwrap()),
+    }
+}
+
+/// Dopisz liczniki tego procesu do pliku statystyk (wołane na końcu uruchomienia)
+pub fn flush_stats() {
+    let hits   = HITS.swap(0, Ordering::Relaxed);
+    let misses = MISSES.swap(0, Ordering::Relaxed);
+    if hits == 0 && misses == 0 { return; }
+    if hl_compiler::ensure_cache_dir().is_err() { return; }
+    // Odczyt i zapis pod flock — równoległe procesy `hl` nie gubią liczników
+    let Ok(mut file) = std::fs::OpenOptions::new()
+        .read(true).write(true).create(true).open(stats_path()) else { return };
+    if hl_compiler::cache::flock(&file).is_err() { return; }
+    let mut raw = Vec::with_capacity(16);
+    let _ = file.read_to_end(&mut raw);
+    let mut s = parse_stats(&raw);
+    s.hits   += hits;
+    s.misses += misses;
+    let mut buf = Vec::with_capacity(16);
+    buf.extend_from_slice(&s.hits.to_le_bytes());
+    buf.extend_from_slice(&s.misses.to_le_bytes());
+    let _ = file.seek(SeekFrom::Start(0)).and_then(|_| file.write_all(&buf));
+}
@@ -1,414 +1,1323 @@
 use anyhow::{bail, Result};
+use cranelift_codegen::ir::condcodes::{FloatCC, IntCC};
 use cranelift_codegen::ir::{
-    types, AbiParam, Function, InstBuilder, Signature, UserFuncName,
+    types, AbiParam, Block, Function, InstBuilder, MemFlags, SigRef, Signature, Type,
+    UserFuncName, Value,
 };
-use cranelift_codegen::isa::CallConv;
+use cranelift_codegen::isa::{CallConv, OwnedTargetIsa};
 use cranelift_codegen::{settings, Context};
 use cranelift_frontend::{FunctionBuilder, FunctionBuilderContext, Variable};
 use cranelift_jit::{JITBuilder, JITModule};
-use cranelift_module::{Linkage, Module};
+use cranelift_module::{FuncId, Linkage, Module};
 use hl_compiler::bytecode::*;
-use std::collections::HashMap;
+use hl_compiler::flat::{op, FlatInsn, TplView};
+use crate::jit_cache;
+use hl_core::metrics::{self, Counter, Hist};
+use crate::runtime::{NanVal, NAN_BASE, PAYLOAD_SHIFT, SSO_TAG_MASK, TAG_INT, TAG_MASK, TAG_SSO, TAG_STR};
+use std::collections::{BTreeMap, BTreeSet};
+use std::sync::OnceLock;
 
-/// Próg wywołań funkcji/pętli przed JIT kompilacją
-const JIT_THRESHOLD: u32 = 50;
+/// Domyślny limit kodu maszynowego na silnik (HL_JIT_MEM_LIMIT nadpisuje)
+const JIT_MEM_LIMIT_DEFAULT: usize = 64 * 1024 * 1024;
 
-/// Skompilowany JIT fragment — wskaźnik do kodu maszynowego
+/// Po tylu wyjściach przez guard trasa jest unieważniana — typy w pętli
+/// nie pasują do specjalizacji i interpreter radzi sobie lepiej
+const DEOPT_LIMIT: u32 = 32;
+
+// ── ABI kodu natywnego ────────────────────────────────────────────────────────
+
+/// Środowisko trasy — przekazywane jedynym argumentem, offsety czyta codegen.
+/// Helpery wołamy pośrednio przez wskaźniki z tej struktury, więc kod maszynowy
+/// nie ma relokacji i nadaje się do trwałego cache.
+#[repr(C)]
+pub struct TraceEnv {
+    /// Rejestry interpretera (NaN-boxed u64)
+    pub regs:      *mut u64,
+    /// ConstIdx → idx w internerze (rozwiązane przed wejściem do trasy)
+    pub str_ids:   *const u32,
+    /// `RuntimeState::vars_flat` — helpery odświeżają go po realokacji
+    pub vars:      *mut u64,
+    /// ConstIdx nazwy zmiennej → slot w `vars` (dla zmiennych trzymanych w SSA)
+    pub var_slots: *const u32,
+    /// `BytecodeInterpreter` — nieprzezroczysty dla kodu natywnego
+    pub interp:    *mut std::ffi::c_void,
+    /// Wykonaj instrukcję `pc` w interpreterze
+    pub exec_one:  HelperFn,
+    /// Truthiness wartości, której nie rozstrzyga szybka ścieżka
+    pub truthy:    TruthyFn,
+    /// Liczniki sterty stringów (`live`, `next_gc`) — skok wsteczny trasy
+    /// sprawdza nimi `wants_gc` bez wywołania
+    pub gc_live:   *const usize,
+    pub gc_next:   *const usize,
+    /// Zbierz stertę stringów; rejestry i zmienne są wtedy w pamięci
+    pub collect:   CollectFn,
+}
+
+pub type HelperFn = unsafe extern "C" fn(*mut TraceEnv, u32) -> u32;
+pub type TruthyFn = unsafe extern "C" fn(*mut TraceEnv, u64) -> u32;
+pub type CollectFn = unsafe extern "C" fn(*mut TraceEnv);
+
+/// Wyniki `TraceEnv::exec_one`
+pub const HELPER_NEXT:   u32 = 0;
+/// ForInNext: iterator wyczerpany, skocz do celu
+pub const HELPER_BRANCH: u32 = 1;
+/// Błąd — interpreter trzyma go do odebrania po wyjściu z trasy
+pub const HELPER_FAILED: u32 = 2;
+
+const ENV_REGS:      i32 = std::mem::offset_of!(TraceEnv, regs)     as i32;
+const ENV_STR_IDS:   i32 = std::mem::offset_of!(TraceEnv, str_ids)  as i32;
+const ENV_VARS:      i32 = std::mem::offset_of!(TraceEnv, vars)     as i32;
+const ENV_VAR_SLOTS: i32 = std::mem::offset_of!(TraceEnv, var_slots) as i32;
+const ENV_EXEC_ONE:  i32 = std::mem::offset_of!(TraceEnv, exec_one) as i32;
+const ENV_TRUTHY:    i32 = std::mem::offset_of!(TraceEnv, truthy)   as i32;
+const ENV_GC_LIVE:   i32 = std::mem::offset_of!(TraceEnv, gc_live)  as i32;
+const ENV_GC_NEXT:   i32 = std::mem::offset_of!(TraceEnv, gc_next)  as i32;
+const ENV_COLLECT:   i32 = std::mem::offset_of!(TraceEnv, collect)  as i32;
+
+/// fn(env: *mut TraceEnv) -> pc, od którego interpreter ma kontynuować
+pub type JitFn = unsafe extern "C" fn(*mut TraceEnv) -> u32;
+
+/// Skompilowany JIT fragment — wskaźnik do kodu maszynowego.
+/// Ważny tak długo, jak żyje generacja modułu silnika, który go wydał.
+#[derive(Clone, Copy)]
 pub struct JitFragment {
-    /// fn(regs: *mut u64, vars: *mut u64, reg_count: u32, var_count: u32) -> i32
-    pub fn_ptr: unsafe extern "C" fn(*mut u64, *mut u64, u32, u32) -> i32,
+    pub fn_ptr: JitFn,
+}
+
+/// Skompilowana trasa (wynik trace JIT) — region [start..=end]
+#[derive(Clone, Copy)]
+pub struct CompiledTrace {
+    pub fn_ptr: JitFn,
+    pub start:  u32,
+    pub end:    u32,
+}
+
+/// Kod i stałe programu, z których kompilujemy region
+#[derive(Clone, Copy)]
+pub struct RegionSrc<'s> {
+    pub code:    &'s [FlatInsn],
+    /// Operandy Concat (`Program::extra`)
+    pub extra:   &'s [u32],
+    pub numbers: &'s [f64],
+    /// Stałe string — nazwy zmiennych i quick fn
+    pub strings: &'s [&'s str],
+}
+
+/// Fragment zdefiniowany w module — czeka na wspólne `finalize_definitions`
+#[derive(Clone, Copy)]
+enum Slot {
+    Pending(FuncId, usize),
+    Ready(JitFragment, usize),
+}
+
+struct TraceSlot {
+    slot:   Slot,
+    end:    u32,
+    deopts: u32,
+    /// Trasa AOT — kod w obrazie programu, nie w module, więc przeżywa `release`
+    pinned: bool,
+}
+
+/// ISA hosta — wykrywanie cech CPU i budowa flag raz na proces; `OwnedTargetIsa`
+/// to Arc, więc każdy moduł dostaje tanią kopię
+fn host_isa() -> Result<OwnedTargetIsa> {
+    static ISA: OnceLock<std::result::Result<OwnedTargetIsa, String>> = OnceLock::new();
+    ISA.get_or_init(|| {
+        let flags = settings::Flags::new(settings::builder());
+        cranelift_native::builder()
+        .map_err(|e| e.to_string())?
+        .finish(flags)
+        .map_err(|e| e.to_string())
+    })
+    .clone()
+    .map_err(|e| anyhow::anyhow!("Brak ISA: {}", e))
+}
+
+/// "64M", "512K", "1G" albo liczba bajtów
+fn parse_mem_limit(s: &str) -> Option<usize> {
+    let s = s.trim();
+    let (num, mul) = match s.char_indices().last()? {
+        (i, 'k' | 'K') => (&s[..i], 1024),
+        (i, 'm' | 'M') => (&s[..i], 1024 * 1024),
+        (i, 'g' | 'G') => (&s[..i], 1024 * 1024 * 1024),
+        _              => (s, 1),
+    };
+    num.trim().parse::<usize>().ok()?.checked_mul(mul)
+}
+
+/// Jeden `JITModule` na silnik: wspólna ISA, sygnatury i konteksty Cranelift
+/// wielokrotnego użytku. Kod wszystkich fragmentów mieszka w pamięci tego modułu.
+struct JitCore {
+    module: JITModule,
+    sigs:   TraceSigs,
+    ctx:    Context,
+    fn_ctx: FunctionBuilderContext,
+}
+
+/// Sygnatury ABI tras — wspólne dla modułu JIT i obiektu AOT (`crate::aot`)
+pub(crate) struct TraceSigs {
+    /// fn(env: *mut TraceEnv) -> u32 (== `JitFn`)
+    pub sig:    Signature,
+    /// exec_one(env, pc: u32) -> u32
+    pub helper: Signature,
+    /// truthy(env, val: u64) -> u32
+    pub truthy: Signature,
+    /// collect(env)
+    pub collect: Signature,
+}
+
+impl TraceSigs {
+    pub(crate) fn new(call_conv: CallConv, ptr_type: Type) -> Self {
+        let mut sig = Signature::new(call_conv);
+        sig.params.push(AbiParam::new(ptr_type));
+        sig.returns.push(AbiParam::new(types::I32));
+
+        let mut helper = Signature::new(call_conv);
+        helper.params.push(AbiParam::new(ptr_type));
+        helper.params.push(AbiParam::new(types::I32));
+        helper.returns.push(AbiParam::new(types::I32));
+
+        let mut truthy = Signature::new(call_conv);
+        truthy.params.push(AbiParam::new(ptr_type));
+        truthy.params.push(AbiParam::new(types::I64));
+        truthy.returns.push(AbiParam::new(types::I32));
+
+        let mut collect = Signature::new(call_conv);
+        collect.params.push(AbiParam::new(ptr_type));
+
+        Self { sig, helper, truthy, collect }
+    }
 }
 
-/// Menedżer JIT — śledzi wywołania i kompiluje hotspoty
+/// Zbuduj funkcję trasy [start..=end] w `ctx.func`. Po błędzie `fn_ctx` ma
+/// stan przerwanego buildera — wołający zaczyna od nowego kontekstu.
+#[allow(clippy::too_many_arguments)]
+pub(crate) fn build_region_fn(
+    ctx: &mut Context,
+    fn_ctx: &mut FunctionBuilderContext,
+    sigs: &TraceSigs,
+    ptr_type: Type,
+    name: UserFuncName,
+    src: &RegionSrc,
+    start: u32,
+    end: u32,
+) -> Result<()> {
+    ctx.clear();
+    ctx.func = Function::with_name_signature(name, sigs.sig.clone());
+    let mut builder = FunctionBuilder::new(&mut ctx.func, fn_ctx);
+    let helper_sig  = builder.import_signature(sigs.helper.clone());
+    let truthy_sig  = builder.import_signature(sigs.truthy.clone());
+    let collect_sig = builder.import_signature(sigs.collect.clone());
+    let entry_block = builder.create_block();
+    builder.append_block_params_for_function_params(entry_block);
+    builder.switch_to_block(entry_block);
+    let env = builder.block_params(entry_block)[0];
+
+    compile_region(
+        &mut builder, env, ptr_type, helper_sig, truthy_sig, collect_sig,
+        src, start as usize, end as usize,
+    )?;
+    builder.seal_all_blocks();
+    builder.finalize();
+    Ok(())
+}
+
+impl JitCore {
+    fn new() -> Result<Self> {
+        let builder  = JITBuilder::with_isa(host_isa()?, cranelift_module::default_libcall_names());
+        let module   = JITModule::new(builder);
+        let ptr_type = module.target_config().pointer_type();
+        let sigs     = TraceSigs::new(module.isa().default_call_conv(), ptr_type);
+        Ok(Self {
+            module, sigs,
+            ctx:    Context::new(),
+            fn_ctx: FunctionBuilderContext::new(),
+        })
+    }
+
+    /// Zdefiniuj region [start..=end] (bez finalize). Zwraca id i rozmiar kodu.
+    /// `module_hash` = klucz trwałego cache (None = bez cache)
+    fn define(
+        &mut self,
+        name: &str,
+        src: &RegionSrc,
+        start: u32,
+        end: u32,
+        module_hash: Option<u64>,
+    ) -> Result<(FuncId, usize)> {
+        let func_id = self.module.declare_function(name, Linkage::Local, &self.sigs.sig)?;
+        let t0 = metrics::start();
+
+        // Trwały cache: gotowy kod maszynowy z poprzedniego uruchomienia
+        let cache_key = module_hash.filter(|_| jit_cache::enabled()).map(|h| {
+            let cpu = jit_cache::cpu_fingerprint(self.module.isa());
+            (h, start, end + 1, cpu)
+        });
+        if let Some((h, s, e, cpu)) = cache_key {
+            if let Some(code) = jit_cache::load(h, s, e, cpu) {
+                self.module.define_function_bytes(func_id, code.alignment, &code.bytes, &[])?;
+                jit_cache::record_hit();
+                metrics::inc(Counter::JitCacheHits);
+                tracing::debug!("[jit cache] hit '{}' ({} B)", name, code.bytes.len());
+                return Ok((func_id, code.bytes.len()));
+            }
+            jit_cache::record_miss();
+            metrics::inc(Counter::JitCacheMisses);
+        }
+
+        let ptr_type = self.module.target_config().pointer_type();
+        let name     = UserFuncName::user(0, func_id.as_u32());
+        let built    = build_region_fn(
+            &mut self.ctx, &mut self.fn_ctx, &self.sigs, ptr_type, name, src, start, end,
+        );
+        if let Err(e) = built {
+            // Przerwany builder zostawia stan w kontekście — zacznij od czystego
+            self.fn_ctx = FunctionBuilderContext::new();
+            return Err(e);
+        }
+
+        self.module.define_function(func_id, &mut self.ctx)?;
+
+        let cc   = self.ctx.compiled_code();
+        let size = cc.map(|cc| cc.code_buffer().len()).unwrap_or(0);
+        // Zapisz kod do trwałego cache — tylko fragmenty bez relokacji
+        // (nie odwołują się do żadnych adresów poza własnym buforem)
+        if let (Some((h, s, e, cpu)), Some(cc)) = (cache_key, cc) {
+            if cc.buffer.relocs().is_empty() {
+                let align = self.module.isa().function_alignment().minimum.max(16) as u64;
+                jit_cache::store(h, s, e, cpu, align, cc.code_buffer());
+            }
+        }
+        self.module.clear_context(&mut self.ctx);
+        if let Some(t0) = t0 {
+            metrics::inc(Counter::JitCompiles);
+            metrics::observe_since(Hist::JitCompileNs, t0);
+        }
+        Ok((func_id, size))
+    }
+
+    fn fragment(&self, func_id: FuncId) -> JitFragment {
+        let fn_ptr = self.module.get_finalized_function(func_id);
+        // SAFETY: każda funkcja modułu ma sygnaturę `self.sigs.sig` == JitFn
+        JitFragment { fn_ptr: unsafe { std::mem::transmute::<*const u8, JitFn>(fn_ptr) } }
+    }
+}
+
+/// Menedżer JIT — trasy gorących pętli.
+///
+/// Wszystkie trasy trafiają do jednego, leniwie
+/// tworzonego `JITModule`. Definicje zbieramy i finalizujemy hurtem — dopiero
+/// gdy któraś trasa jest potrzebna. Cranelift zwalnia pamięć kodu tylko dla
+/// całego modułu, więc po przekroczeniu limitu (HL_JIT_MEM_LIMIT, domyślnie
+/// 64 MiB) porzucamy całą generację i gorące miejsca kompilują się od nowa
+/// (z trwałym cache to tylko odczyt pliku). Drop silnika oddaje pamięć.
 pub struct JitEngine {
-    /// Liczniki wywołań per funkcja (nazwa → liczba)
-    call_counts: HashMap<String, u32>,
-    /// Skompilowane fragmenty (nazwa → JitFragment)
-    compiled:    HashMap<String, JitFragment>,
+    /// Skompilowane trasy (offset początku pętli → fragment)
+    traces:      rustc_hash::FxHashMap<u32, TraceSlot>,
+    core:        Option<JitCore>,
+    /// Czy są definicje czekające na finalize
+    pending:     bool,
+    /// Rozmiar kodu w bieżącej generacji (łącznie z unieważnionymi fragmentami)
+    code_bytes:  usize,
+    mem_limit:   usize,
+    /// Ile razy porzucono moduł z powodu limitu
+    generation:  u32,
     /// Flaga: czy JIT jest aktywny (może być wyłączony dla debugowania)
     enabled:     bool,
 }
 
 impl JitEngine {
     pub fn new() -> Self {
+        let mem_limit = std::env::var("HL_JIT_MEM_LIMIT").ok()
+        .and_then(|s| parse_mem_limit(&s))
+        .unwrap_or(JIT_MEM_LIMIT_DEFAULT);
         Self {
-            call_counts: HashMap::new(),
-            compiled:    HashMap::new(),
+            traces:      rustc_hash::FxHashMap::default(),
+            core:        None,
+            pending:     false,
+            code_bytes:  0,
+            mem_limit,
+            generation:  0,
             enabled:     !std::env::var("HL_NO_JIT").is_ok(),
         }
     }
 
-    /// Zgłoś wywołanie funkcji. Jeśli przekroczono próg → skompiluj.
-    pub fn record_call(&mut self, name: &str, module: &HlModule) -> bool {
-        if !self.enabled { return false; }
-        if self.compiled.contains_key(name) { return true; } // Już skompilowana
-
-        let count = self.call_counts.entry(name.to_string()).or_insert(0);
-        *count += 1;
-
-        if *count >= JIT_THRESHOLD {
-            // Sprawdź czy funkcja nadaje się do JIT (tylko czysta arytmetyka)
-            if let Some(entry) = module.funcs.find(name) {
-                if is_jit_eligible(module, entry) {
-                    match self.jit_compile(name, module, entry) {
-                        Ok(frag) => {
-                            tracing::debug!("[jit] skompilowano funkcję '{}'", name);
-                            self.compiled.insert(name.to_string(), frag);
-                            return true;
-                        }
-                        Err(e) => {
-                            tracing::warn!("[jit] błąd kompilacji '{}': {}", name, e);
-                        }
-                    }
+    /// Ustaw limit pamięci kodu maszynowego (bajty)
+    pub fn with_mem_limit(mut self, bytes: usize) -> Self {
+        self.mem_limit = bytes;
+        self
+    }
+
+    pub fn is_enabled(&self) -> bool { self.enabled }
+
+    /// Bajty kodu maszynowego w bieżącej generacji
+    pub fn code_bytes(&self) -> usize { self.code_bytes }
+
+    pub fn generation(&self) -> u32 { self.generation }
+
+    /// Zdefiniuj trasę pętli [start..=end] (bez finalize — patrz `trace`).
+    /// Zwraca true, jeśli przed definicją porzucono generację z powodu limitu
+    /// pamięci — wszystkie wcześniejsze trasy zniknęły.
+    pub fn compile_trace(
+        &mut self,
+        src: &RegionSrc,
+        start: u32,
+        end: u32,
+        module_hash: Option<u64>,
+    ) -> Result<bool> {
+        if !self.enabled { bail!("JIT wyłączony (HL_NO_JIT)"); }
+        if self.traces.contains_key(&start) { return Ok(false); }
+        if !is_jit_eligible(src.code, start, end) {
+            bail!("Pętla @{}..{} zawiera instrukcje spoza JIT", start, end);
+        }
+        let evicted = self.code_bytes >= self.mem_limit;
+        if evicted { self.release(); }
+
+        let name = format!("__trace_{}_{}", start, end);
+        let slot = self.define(&name, src, start, end, module_hash)?;
+        self.traces.insert(start, TraceSlot { slot, end, deopts: 0, pinned: false });
+        Ok(evicted)
+    }
+
+    /// Trasa skompilowana zawczasu (`hl compile --native`, `crate::aot`) —
+    /// gotowa od razu, bez finalize. Kod leży w obrazie programu, więc nie
+    /// liczy się do limitu pamięci i zostaje po porzuceniu generacji; usuwa ją
+    /// tylko deopt.
+    pub fn install_trace(&mut self, start: u32, end: u32, fn_ptr: JitFn) {
+        let slot = Slot::Ready(JitFragment { fn_ptr }, 0);
+        self.traces.insert(start, TraceSlot { slot, end, deopts: 0, pinned: true });
+    }
+
+    /// Czy pod `start` jest trasa (gotowa albo czekająca na finalize)
+    #[inline]
+    pub fn has_trace(&self, start: u32) -> bool {
+        self.traces.contains_key(&start)
+    }
+
+    /// Trasa gotowa do wykonania — pierwsze żądanie finalizuje całą partię definicji
+    pub fn trace(&mut self, start: u32) -> Option<CompiledTrace> {
+        let t = self.traces.get(&start)?;
+        let end = t.end;
+        let frag = match t.slot {
+            Slot::Ready(f, _)   => f,
+            Slot::Pending(..)   => {
+                self.finalize_pending().ok()?;
+                match self.traces.get(&start)?.slot {
+                    Slot::Ready(f, _) => f,
+                    Slot::Pending(..) => return None,
                 }
             }
-        }
-        false
+        };
+        Some(CompiledTrace { fn_ptr: frag.fn_ptr, start, end })
     }
 
-    /// Sprawdź czy funkcja jest już skompilowana
-    pub fn is_compiled(&self, name: &str) -> bool {
-        self.compiled.contains_key(name)
+    /// Zgłoś wyjście przez guard. Zwraca true, gdy trasa została unieważniona.
+    pub fn record_deopt(&mut self, start: u32) -> bool {
+        let Some(t) = self.traces.get_mut(&start) else { return false };
+        t.deopts += 1;
+        if t.deopts < DEOPT_LIMIT { return false; }
+        self.invalidate_trace(start);
+        true
     }
 
-    /// Wykonaj skompilowaną funkcję
-    /// regs: tablica wartości rejestrów jako f64
-    pub fn execute_compiled(
-        &self,
+    /// Unieważnij trasę (np. po deopt). Jej kod zostaje w module do końca
+    /// generacji, ale liczy się do limitu — po jego przekroczeniu wróci do puli.
+    pub fn invalidate_trace(&mut self, start: u32) {
+        if self.traces.remove(&start).is_some() {
+            tracing::debug!("[jit] unieważniono trasę @ {}", start);
+        }
+    }
+
+    fn define(
+        &mut self,
         name: &str,
-        regs: &mut Vec<u64>,
-        vars: &mut Vec<u64>,
-    ) -> Option<i32> {
-        let frag = self.compiled.get(name)?;
-        if regs.is_empty() { regs.resize(64, 0); }
-        if vars.is_empty() { vars.resize(64, 0); }
-        let result = unsafe {
-            (frag.fn_ptr)(
-                regs.as_mut_ptr(),
-                          vars.as_mut_ptr(),
-                          regs.len() as u32,
-                          vars.len() as u32,
-            )
+        src: &RegionSrc,
+        start: u32,
+        end: u32,
+        module_hash: Option<u64>,
+    ) -> Result<Slot> {
+        if self.code_bytes >= self.mem_limit { self.release(); }
+        if self.core.is_none() {
+            self.core = Some(JitCore::new()?);
+        }
+        let core = self.core.as_mut().expect("JitCore");
+        let (func_id, size) = core.define(name, src, start, end, module_hash)?;
+        self.code_bytes += size;
+        self.pending = true;
+        Ok(Slot::Pending(func_id, size))
+    }
+
+    /// Jedno `finalize_definitions` dla wszystkich zdefiniowanych od ostatniego razu
+    pub fn finalize_pending(&mut self) -> Result<()> {
+        if !self.pending { return Ok(()); }
+        let Some(core) = self.core.as_mut() else { return Ok(()); };
+        core.module.finalize_definitions()?;
+        self.pending = false;
+        let core = &*core;
+        let ready = |slot: &mut Slot| if let Slot::Pending(id, n) = *slot {
+            *slot = Slot::Ready(core.fragment(id), n);
         };
-        Some(result)
+        self.traces.values_mut().for_each(|t| ready(&mut t.slot));
+        Ok(())
     }
 
-    /// Kompilacja Cranelift → kod maszynowy
-    fn jit_compile(
-        &self,
-        name: &str,
-        module_bc: &HlModule,
-        entry: &FuncEntry,
-    ) -> Result<JitFragment> {
-        let flags = settings::Flags::new(settings::builder());
-        let isa   = cranelift_native::builder()
-        .map_err(|e| anyhow::anyhow!("Brak ISA: {}", e))?
-        .finish(flags)?;
+    /// Porzuć bieżącą generację: zwolnij pamięć kodu i jej trasy (trasy AOT
+    /// nie należą do modułu i zostają)
+    pub fn release(&mut self) {
+        let frags = self.traces.len();
+        // Wskaźniki do kodu żyją tylko w tej mapie — czyścimy ją przed zwolnieniem
+        self.traces.retain(|_, t| t.pinned);
+        let frags = frags - self.traces.len();
+        self.pending = false;
+        if let Some(core) = self.core.take() {
+            tracing::debug!("[jit] zwalniam moduł: {} tras, {} KB kodu",
+                            frags, self.code_bytes / 1024);
+            // SAFETY: żaden fragment tej generacji nie jest już osiągalny
+            unsafe { core.module.free_memory(); }
+            self.generation += 1;
+        }
+        self.code_bytes = 0;
+    }
+}
 
-        let jit_builder = JITBuilder::with_isa(
-            isa,
-            cranelift_module::default_libcall_names(),
-        );
+impl Drop for JitEngine {
+    fn drop(&mut self) {
+        self.release();
+    }
+}
 
-        let mut jit_module = JITModule::new(jit_builder);
+impl Default for JitEngine {
+    fn default() -> Self { Self::new() }
+}
 
-        // Sygnatura: fn(regs: *mut u64, vars: *mut u64, reg_count: u32, var_count: u32) -> i32
-        let mut sig = Signature::new(CallConv::SystemV);
-        let ptr_type = jit_module.target_config().pointer_type();
-        sig.params.push(AbiParam::new(ptr_type));    // regs: *mut u64
-        sig.params.push(AbiParam::new(ptr_type));    // vars: *mut u64
-        sig.params.push(AbiParam::new(types::I32));  // reg_count: u32
-        sig.params.push(AbiParam::new(types::I32));  // var_count: u32
-        sig.returns.push(AbiParam::new(types::I32));
+/// Sprawdź czy region [start..=end] kwalifikuje się do JIT.
+/// Arytmetyka, porównania i skoki idą natywnie z guardami typów; stringi,
+/// Concat, Print, komendy i for-in — przez helper `exec_one`. Odpadają tylko
+/// CallFunc i ArenaCall: ciało funkcji wraca do interpretera, który mógłby
+/// w trakcie trasy kompilować (i zwalniać) kod tego samego modułu.
+pub(crate) fn is_jit_eligible(code: &[FlatInsn], start: u32, end: u32) -> bool {
+    match code.get(start as usize..=end as usize) {
+        Some(region) => region.iter().all(|r| r.op != op::CALL_FUNC && r.op != op::ARENA_CALL),
+        None         => false,
+    }
+}
 
-        let func_id = jit_module.declare_function(name, Linkage::Local, &sig)?;
-        let mut ctx = Context::new();
-        ctx.func = Function::with_name_signature(
-            UserFuncName::user(0, 0),
-                                                 sig.clone(),
-        );
+const BOOL_BITS_TRUE:  u64 = 0x7FF8_0000_0001_0001;
+const BOOL_BITS_FALSE: u64 = 0x7FF8_0000_0000_0001;
 
-        let mut fn_ctx = FunctionBuilderContext::new();
-        {
-            let mut builder = FunctionBuilder::new(&mut ctx.func, &mut fn_ctx);
-            let entry_block = builder.create_block();
-            builder.append_block_params_for_function_params(entry_block);
-            builder.switch_to_block(entry_block);
-            builder.seal_block(entry_block);
-
-            let regs_ptr = builder.block_params(entry_block)[0];
-
-            // Kompiluj instrukcje funkcji
-            compile_func_body(
-                &mut builder,
-                module_bc,
-                entry,
-                regs_ptr,
-            )?;
-
-            // Zwróć 0 (exit_code OK)
-            let zero = builder.ins().iconst(types::I32, 0);
-            builder.ins().return_(&[zero]);
-            builder.finalize();
-        }
+/// Bloki regionu: jeden na instrukcję + bloki wyjścia (jeden na docelowy pc).
+/// `exits` zapisują rejestry/zmienne z SSA do pamięci, `aborts` (błąd helpera)
+/// wychodzą bez zapisu — helper zostawił już stan w pamięci.
+struct Region {
+    start:  usize,
+    end:    usize,
+    blocks: Vec<Block>,
+    exits:  BTreeMap<u32, Block>,
+    aborts: BTreeMap<u32, Block>,
+}
 
-        jit_module.define_function(func_id, &mut ctx)?;
-        jit_module.finalize_definitions()?;
+impl Region {
+    /// Blok dla skoku do `pc` — wewnątrz regionu zostajemy w kodzie natywnym
+    fn target(&mut self, b: &mut FunctionBuilder, pc: usize) -> Block {
+        if pc >= self.start && pc <= self.end { return self.blocks[pc - self.start]; }
+        self.exit(b, pc)
+    }
 
-        let fn_ptr = jit_module.get_finalized_function(func_id);
-        // Dopasuj sygnaturę do CompiledTrace::fn_ptr
-        let fn_typed: unsafe extern "C" fn(*mut u64, *mut u64, u32, u32) -> i32 =
-        unsafe { std::mem::transmute(fn_ptr) };
+    /// Blok, który wraca do interpretera na `pc`
+    fn exit(&mut self, b: &mut FunctionBuilder, pc: usize) -> Block {
+        *self.exits.entry(pc as u32).or_insert_with(|| b.create_block())
+    }
 
-        std::mem::forget(jit_module);
+    fn abort(&mut self, b: &mut FunctionBuilder, pc: usize) -> Block {
+        *self.aborts.entry(pc as u32).or_insert_with(|| b.create_block())
+    }
+}
 
-        Ok(JitFragment { fn_ptr: fn_typed })
+/// Rejestry czytane i pisane przez instrukcję (ta sama klasyfikacja co
+/// `Program::validate`, z rozbiciem na odczyt/zapis)
+fn reg_effects(r: FlatInsn, extra: &[u32]) -> (Vec<u32>, Vec<u32>) {
+    match r.op {
+        op::LOAD_STR | op::LOAD_NUM | op::LOAD_BOOL | op::LOAD_NIL |
+        op::GET_VAR => (vec![], vec![r.a]),
+        op::GET_VAR_DYN | op::NEG | op::TO_STRING | op::TO_NUMBER | op::TO_INT |
+        op::TRUTHY | op::NOT | op::TEST | op::FOR_RANGE_STEP => (vec![r.b], vec![r.a]),
+        op::SET_VAR | op::SET_ENV | op::FOR_IN_START | op::FOR_IN_CMD => (vec![r.b], vec![]),
+        op::ADD | op::SUB | op::MUL | op::DIV | op::MOD |
+        op::CMP_EQ | op::CMP_NE | op::CMP_LT | op::CMP_LE | op::CMP_GT | op::CMP_GE => {
+            (vec![r.b, r.c], vec![r.a])
+        }
+        op::CONCAT => {
+            let (s, n) = (r.b as usize, r.c as usize);
+            (extra.get(s..s + n).map(|p| p.to_vec()).unwrap_or_default(), vec![r.a])
+        }
+        op::JUMP_IF_FALSE | op::JUMP_IF_TRUE | op::PRINT => (vec![r.a], vec![]),
+        op::RETURN if r.aux != 0 => (vec![r.a], vec![]),
+        op::CALL_QUICK | op::HACKEROS_CALL => (vec![r.b], vec![r.c]),
+        op::EXEC_CMD     => (vec![r.a], vec![r.b]),
+        op::EXEC_CAPTURE => (vec![r.a], vec![r.b, r.c]),
+        op::EXEC_TPL     => (tpl_holes(extra, r.a), vec![r.b]),
+        op::CAPTURE_TPL  => (tpl_holes(extra, r.a), vec![r.b, r.c]),
+        op::FOR_IN_TPL   => (tpl_holes(extra, r.b), vec![]),
+        op::FOR_IN_NEXT  => (vec![], vec![r.b]),
+        op::FOR_RANGE_NEXT => (vec![r.a, r.b], vec![]),
+        op::CHAN_SEND    => (vec![r.b], vec![]),
+        op::CHAN_RECV | op::GO_WAIT => (vec![], vec![r.b]),
+        _ => (vec![], vec![]),
     }
 }
 
-impl Default for JitEngine {
-    fn default() -> Self { Self::new() }
+fn tpl_holes(extra: &[u32], start: u32) -> Vec<u32> {
+    TplView::parse(extra, start as usize).map(|t| t.holes().collect()).unwrap_or_default()
 }
 
-/// Sprawdź czy blok funkcji kwalifikuje się do JIT
-/// Kwalifikuje się: czysta arytmetyka + ładowanie stałych + SetVar/GetVar
-fn is_jit_eligible(module: &HlModule, entry: &FuncEntry) -> bool {
-    let start = entry.start_insn as usize;
-    let end   = start + entry.insn_count as usize;
-
-    for insn in module.instructions.get(start..end).unwrap_or(&[]) {
-        match insn {
-            // Dozwolone w JIT
-            Instruction::LoadNum { .. } |
-            Instruction::LoadBool { .. } |
-            Instruction::LoadNil { .. } |
-            Instruction::GetVar { .. } |
-            Instruction::SetVar { .. } |
-            Instruction::Add { .. } |
-            Instruction::Sub { .. } |
-            Instruction::Mul { .. } |
-            Instruction::Div { .. } |
-            Instruction::Mod { .. } |
-            Instruction::Neg { .. } |
-            Instruction::CmpEq { .. } |
-            Instruction::CmpNe { .. } |
-            Instruction::CmpLt { .. } |
-            Instruction::CmpLe { .. } |
-            Instruction::CmpGt { .. } |
-            Instruction::CmpGe { .. } |
-            Instruction::ToNumber { .. } |
-            Instruction::Jump { .. } |
-            Instruction::JumpIfFalse { .. } |
-            Instruction::JumpIfTrue { .. } |
-            Instruction::Return { .. } |
-            Instruction::Nop => {}
-
-            // Niedozwolone — fallback do interpretera
-            _ => return false,
-        }
+/// Zmienne (ConstIdx nazwy), które trasa [start..=end] trzyma w SSA zamiast
+/// przez `get_var`/`set_var`. Wynik zależy tylko od kodu i stałych, więc
+/// interpreter i codegen (także kod z trwałego cache) zgadzają się co do układu
+/// `TraceEnv::var_slots`. Pomijamy `_last_exit_code` (SetVar synchronizuje
+/// `last_exit`) oraz całą trasę z `::unset` — ten usuwa slot zmiennej.
+///
+/// Odczyt promujemy tylko dla zmiennych, które program sam przypisuje
+/// (SetVar/SetEnv gdziekolwiek w kodzie). Nieprzypisana zmienna to odczyt
+/// std::env przy każdym GetVar — zostaje w helperze, żeby trasa nie zamroziła
+/// wartości środowiska w slocie.
+pub fn promoted_vars(src: &RegionSrc, start: u32, end: u32) -> Vec<u32> {
+    let Some(region) = src.code.get(start as usize..=end as usize) else { return Vec::new() };
+    if region.iter().any(|r| r.op == op::CALL_QUICK && r.aux == QuickFn::Unset.id()) {
+        return Vec::new();
     }
-    true
+    let name = |i: u32| src.strings.get(i as usize).copied().unwrap_or("");
+    let assigned: BTreeSet<&str> = src.code.iter()
+    .filter(|r| r.op == op::SET_VAR || r.op == op::SET_ENV)
+    .map(|r| name(r.a))
+    .collect();
+    let mut out: Vec<u32> = region.iter()
+    .filter_map(|r| match r.op {
+        op::GET_VAR if assigned.contains(name(r.b)) => Some(r.b),
+        op::SET_VAR => Some(r.a),
+        _           => None,
+    })
+    .filter(|&i| name(i) != "_last_exit_code")
+    .collect();
+    out.sort_unstable();
+    out.dedup();
+    out
 }
 
-/// Kompiluj ciało funkcji do IR Cranelift
-fn compile_func_body(
-    builder: &mut FunctionBuilder,
-    module: &HlModule,
-    entry: &FuncEntry,
-    regs_ptr: cranelift_codegen::ir::Value,
-) -> Result<()> {
-    let start = entry.start_insn as usize;
-    let end   = start + entry.insn_count as usize;
-    let insns = match module.instructions.get(start..end) {
-        Some(s) => s,
-        None    => bail!("Nieprawidłowy zakres instrukcji"),
-    };
+/// Rejestry i zmienne regionu trzymane w zmiennych Cranelift (SSA). Do pamięci
+/// trafiają tylko na wyjściach i wokół wywołań helperów.
+struct Promoted {
+    regs:      BTreeMap<u32, Variable>,
+    /// Rejestry pisane w regionie — tylko je trzeba zapisywać (reszta w pamięci jest aktualna)
+    written:   BTreeSet<u32>,
+    /// ConstIdx nazwy → (wartość, offset slotu w bajtach)
+    vars:      BTreeMap<u32, (Variable, Value)>,
+    /// Zmienne pisane natywnie (SetVar)
+    set_vars:  BTreeSet<u32>,
+    /// `env.vars` — helper mógł przenieść `vars_flat`
+    vars_base: Variable,
+    regs_ptr:  Value,
+}
 
-    // Cranelift 0.132: declare_var(ty) -> Variable  (API changed from 0.113)
-    // Pre-pass: znajdź unikalne rejestry, przypisz im Variables przez nowe API
-    let mut reg_set: Vec<u32> = Vec::new();
-    for insn in insns {
-        for reg in insn_regs(insn) {
-            if !reg_set.contains(&reg) {
-                reg_set.push(reg);
-            }
+impl Promoted {
+    fn spill_regs(&self, b: &mut FunctionBuilder, set: &[u32]) {
+        for r in set.iter().filter(|r| self.written.contains(r)) {
+            let v = b.use_var(self.regs[r]);
+            b.ins().store(MemFlags::trusted(), v, self.regs_ptr, (*r as i32) * 8);
         }
     }
-    reg_set.sort();
 
-    // declare_var(ty) -> Variable — nowe API zwraca Variable
-    let mut reg_vars: HashMap<u32, Variable> = HashMap::new();
-    for &reg in &reg_set {
-        let var = builder.declare_var(types::F64);
-        reg_vars.insert(reg, var);
+    fn reload_regs(&self, b: &mut FunctionBuilder, set: &[u32]) {
+        for r in set {
+            let v = b.ins().load(types::I64, MemFlags::trusted(), self.regs_ptr, (*r as i32) * 8);
+            b.def_var(self.regs[r], v);
+        }
     }
 
-    // Zainicjalizuj wszystkie rejestry z tablicy (load z regs_ptr[reg * 8])
-    for (&reg_idx, &var) in &reg_vars {
-        let offset = (reg_idx as i32) * 8;
-        let val = builder.ins().load(
-            types::F64,
-            cranelift_codegen::ir::MemFlags::new(),
-                                     regs_ptr,
-                                     offset,
-        );
-        builder.def_var(var, val);
+    fn spill_vars(&self, b: &mut FunctionBuilder) {
+        if self.set_vars.is_empty() { return; }
+        let base = b.use_var(self.vars_base);
+        for c in &self.set_vars {
+            let (var, off) = self.vars[c];
+            let v    = b.use_var(var);
+            let addr = b.ins().iadd(base, off);
+            b.ins().store(MemFlags::trusted(), v, addr, 0);
+        }
     }
 
-    // Kompiluj instrukcje
-    for insn in insns {
-        compile_insn(builder, insn, module, &reg_vars, regs_ptr)?;
+    fn reload_vars(&self, b: &mut FunctionBuilder, env: Value, ptr_type: Type) {
+        if self.vars.is_empty() { return; }
+        let base = b.ins().load(ptr_type, MemFlags::trusted(), env, ENV_VARS);
+        b.def_var(self.vars_base, base);
+        for &(var, off) in self.vars.values() {
+            let addr = b.ins().iadd(base, off);
+            let v    = b.ins().load(types::I64, MemFlags::trusted(), addr, 0);
+            b.def_var(var, v);
+        }
     }
 
-    // Zapisz wyniki z powrotem do tablicy rejestrów
-    for (&reg_idx, &var) in &reg_vars {
-        let val = builder.use_var(var);
-        let offset = (reg_idx as i32) * 8;
-        builder.ins().store(
-            cranelift_codegen::ir::MemFlags::new(),
-                            val,
-                            regs_ptr,
-                            offset,
-        );
+    /// Wejście na helper: helper czyta operandy i zmienne z pamięci
+    fn spill_for(&self, b: &mut FunctionBuilder, reads: &[u32]) {
+        self.spill_regs(b, reads);
+        self.spill_vars(b);
     }
 
-    Ok(())
+    /// Powrót z helpera: jego wyniki i wszystkie zmienne mogły się zmienić
+    fn reload_after(&self, b: &mut FunctionBuilder, writes: &[u32], env: Value, ptr_type: Type) {
+        self.reload_regs(b, writes);
+        self.reload_vars(b, env, ptr_type);
+    }
 }
 
-fn compile_insn(
-    builder: &mut FunctionBuilder,
-    insn: &Instruction,
-    module: &HlModule,
-    reg_vars: &HashMap<u32, Variable>,
-    _regs_ptr: cranelift_codegen::ir::Value,
+/// Kompiluj region [start..=end] do IR. Rejestry użyte w regionie żyją w
+/// zmiennych SSA (Cranelift przydziela im rejestry maszyny), podobnie zmienne
+/// z `promoted_vars` — GetVar/SetVar to wtedy zwykłe przypisanie. Stan wraca do
+/// pamięci na każdym wyjściu, więc interpreter zastaje spójne rejestry:
+///  - skok poza region → wyjście z pc celu
+///  - guard typu nie przeszedł → deopt: wyjście z pc tej instrukcji,
+///    interpreter wykona ją ogólną ścieżką
+///  - Return → wyjście z pc instrukcji; błąd helpera → wyjście bez zapisu
+#[allow(clippy::too_many_arguments)]
+fn compile_region(
+    b: &mut FunctionBuilder,
+    env: Value,
+    ptr_type: Type,
+    helper_sig: SigRef,
+    truthy_sig: SigRef,
+    collect_sig: SigRef,
+    src: &RegionSrc,
+    start: usize,
+    end: usize,
 ) -> Result<()> {
-    // Makra inline zamiast closures — Rust nie pozwala na dwa closure borrowujące `builder`
-    macro_rules! gv {
-        ($r:expr) => {
-            if let Some(&v) = reg_vars.get(&$r) {
-                builder.use_var(v)
-            } else {
-                builder.ins().f64const(0.0)
-            }
-        };
+    let Some(insns) = src.code.get(start..=end) else {
+        bail!("Nieprawidłowy zakres instrukcji");
+    };
+    let mem = MemFlags::trusted();
+
+    let regs      = b.ins().load(ptr_type, mem, env, ENV_REGS);
+    let str_ids   = b.ins().load(ptr_type, mem, env, ENV_STR_IDS);
+    let var_slots = b.ins().load(ptr_type, mem, env, ENV_VAR_SLOTS);
+    let exec_one  = b.ins().load(ptr_type, mem, env, ENV_EXEC_ONE);
+    let truthy    = b.ins().load(ptr_type, mem, env, ENV_TRUTHY);
+    let gc_live   = b.ins().load(ptr_type, mem, env, ENV_GC_LIVE);
+    let gc_next   = b.ins().load(ptr_type, mem, env, ENV_GC_NEXT);
+    let collect   = b.ins().load(ptr_type, mem, env, ENV_COLLECT);
+
+    // Rejestry regionu: wszystkie ładujemy na wejściu, zapisujemy tylko pisane
+    let mut used = BTreeSet::new();
+    let mut written = BTreeSet::new();
+    for r in insns {
+        let (rd, wr) = reg_effects(*r, &src.extra);
+        used.extend(rd.iter().copied().chain(wr.iter().copied()));
+        written.extend(wr);
     }
-    macro_rules! dv {
-        ($r:expr, $val:expr) => {
-            if let Some(&v) = reg_vars.get(&$r) {
-                builder.def_var(v, $val);
-            }
-        };
+    let promoted_names = promoted_vars(src, start as u32, end as u32);
+    let mut p = Promoted {
+        regs:      BTreeMap::new(),
+        written,
+        vars:      BTreeMap::new(),
+        set_vars:  insns.iter()
+            .filter(|r| r.op == op::SET_VAR && promoted_names.binary_search(&r.a).is_ok())
+            .map(|r| r.a)
+            .collect(),
+        vars_base: b.declare_var(ptr_type),
+        regs_ptr:  regs,
+    };
+    for &r in &used {
+        let var = b.declare_var(types::I64);
+        let v   = b.ins().load(types::I64, mem, regs, (r as i32) * 8);
+        b.def_var(var, v);
+        p.regs.insert(r, var);
     }
+    for &c in &promoted_names {
+        // Slot rozwiązany przez interpreter przed wejściem — offset stały w trasie
+        let slot = b.ins().load(types::I32, mem, var_slots, (c as i32) * 4);
+        let slot = b.ins().uextend(ptr_type, slot);
+        let off  = b.ins().ishl_imm(slot, 3);
+        p.vars.insert(c, (b.declare_var(types::I64), off));
+    }
+    p.reload_vars(b, env, ptr_type);
 
-    match insn {
-        Instruction::LoadNum { dst, idx } => {
-            let n   = module.consts.numbers.get(*idx as usize).copied().unwrap_or(0.0);
-            let val = builder.ins().f64const(n);
-            dv!(*dst, val);
-        }
-        Instruction::LoadBool { dst, val } => {
-            let n = if *val { 1.0f64 } else { 0.0f64 };
-            let v = builder.ins().f64const(n);
-            dv!(*dst, v);
-        }
-        Instruction::LoadNil { dst } => {
-            let v = builder.ins().f64const(0.0);
-            dv!(*dst, v);
-        }
-        Instruction::GetVar    { dst, .. }      => { let _ = dst; }
-        Instruction::GetVarDyn { dst, name }    => { let _ = (dst, name); }
-        Instruction::SetVar    { src, .. }      => { let _ = src; }
-
-        Instruction::Add { dst, a, b } => {
-            let va = gv!(*a); let vb = gv!(*b);
-            let r  = builder.ins().fadd(va, vb);
-            dv!(*dst, r);
-        }
-        Instruction::Sub { dst, a, b } => {
-            let va = gv!(*a); let vb = gv!(*b);
-            let r  = builder.ins().fsub(va, vb);
-            dv!(*dst, r);
-        }
-        Instruction::Mul { dst, a, b } => {
-            let va = gv!(*a); let vb = gv!(*b);
-            let r  = builder.ins().fmul(va, vb);
-            dv!(*dst, r);
-        }
-        Instruction::Div { dst, a, b } => {
-            let va = gv!(*a); let vb = gv!(*b);
-            let r  = builder.ins().fdiv(va, vb);
-            dv!(*dst, r);
-        }
-        Instruction::Neg { dst, src } => {
-            let v = gv!(*src);
-            let r = builder.ins().fneg(v);
-            dv!(*dst, r);
-        }
-        Instruction::CmpLt { dst, a, b } => {
-            let va    = gv!(*a); let vb = gv!(*b);
-            let cmp   = builder.ins().fcmp(
-                cranelift_codegen::ir::condcodes::FloatCC::LessThan, va, vb
-            );
-            let one_f  = builder.ins().f64const(1.0);
-            let zero_f = builder.ins().f64const(0.0);
-            let r      = builder.ins().select(cmp, one_f, zero_f);
-            dv!(*dst, r);
-        }
-        Instruction::ToNumber { dst, src } => {
-            let v = gv!(*src);
-            dv!(*dst, v);
+    let mut rg = Region {
+        start, end,
+        blocks: insns.iter().map(|_| b.create_block()).collect(),
+        exits:  BTreeMap::new(),
+        aborts: BTreeMap::new(),
+    };
+    let first = rg.blocks[0];
+    b.ins().jump(first, &[]);
+
+    macro_rules! ld {
+        ($r:expr) => { b.use_var(p.regs[&$r]) };
+    }
+    macro_rules! st {
+        ($r:expr, $v:expr) => {{ let v = $v; b.def_var(p.regs[&$r], v); }};
+    }
+    // v jest NaN-tagged (nie liczba) → i8
+    macro_rules! tagged {
+        ($v:expr) => {{
+            let m = b.ins().band_imm($v, NAN_BASE as i64);
+            b.ins().icmp_imm(IntCC::Equal, m, NAN_BASE as i64)
+        }};
+    }
+    // v to `TAG_INT` (licznik pętli zakresu) → i8
+    macro_rules! is_int {
+        ($v:expr) => {{
+            let m = b.ins().band_imm($v, (NAN_BASE | TAG_MASK) as i64);
+            b.ins().icmp_imm(IntCC::Equal, m, (NAN_BASE | TAG_INT) as i64)
+        }};
+    }
+    // Payload `TAG_INT` jako i32
+    macro_rules! int_payload {
+        ($v:expr) => {{
+            let s = b.ins().ushr_imm($v, PAYLOAD_SHIFT as i64);
+            b.ins().ireduce(types::I32, s)
+        }};
+    }
+    // v nie jest ani f64, ani intem → i8
+    macro_rules! non_num {
+        ($v:expr) => {{
+            let t = tagged!($v);
+            let i = is_int!($v);
+            b.ins().band_not(t, i)
+        }};
+    }
+    // Wartość liczbowa (f64 albo int, po guardzie) jako F64
+    macro_rules! to_f64 {
+        ($v:expr) => {{
+            let i  = is_int!($v);
+            let n  = int_payload!($v);
+            let fi = b.ins().fcvt_from_sint(types::F64, n);
+            let fb = b.ins().bitcast(types::F64, MemFlags::new(), $v);
+            b.ins().select(i, fi, fb)
+        }};
+    }
+    // Liczba f64 → NanVal: wzorzec kolidujący z NaN-boxingiem staje się 0.0 (jak NanVal::num)
+    macro_rules! boxed_num {
+        ($f:expr) => {{
+            let bits = b.ins().bitcast(types::I64, MemFlags::new(), $f);
+            let bad  = tagged!(bits);
+            let zero = b.ins().iconst(types::I64, 0);
+            b.ins().select(bad, zero, bits)
+        }};
+    }
+    // i8 (0/1) → NanVal::bool
+    macro_rules! boxed_bool {
+        ($c:expr) => {{
+            let w = b.ins().uextend(types::I64, $c);
+            let s = b.ins().ishl_imm(w, PAYLOAD_SHIFT as i64);
+            b.ins().bor_imm(s, NanVal::bool(false).0 as i64)
+        }};
+    }
+    // Guard: obie wartości to liczby (f64 albo int), inaczej deopt na `pc`
+    macro_rules! guard_nums {
+        ($pc:expr, $va:expr, $vb:expr) => {{
+            let ta  = non_num!($va);
+            let tb  = non_num!($vb);
+            let any = b.ins().bor(ta, tb);
+            let deopt = rg.exit(b, $pc);
+            let fast  = b.create_block();
+            b.ins().brif(any, deopt, &[], fast, &[]);
+            b.switch_to_block(fast);
+        }};
+    }
+    // Wywołaj helper exec_one dla `r`: operandy do pamięci, wyniki z powrotem
+    // do SSA. Błąd → wyjście bez zapisu. Zwraca wynik helpera.
+    macro_rules! call_exec_one {
+        ($pc:expr, $r:expr) => {{
+            let (reads, writes) = reg_effects($r, &src.extra);
+            p.spill_for(b, &reads);
+            let pcv  = b.ins().iconst(types::I32, $pc as i64);
+            let call = b.ins().call_indirect(helper_sig, exec_one, &[env, pcv]);
+            let res  = b.inst_results(call)[0];
+            let failed = b.ins().icmp_imm(IntCC::Equal, res, HELPER_FAILED as i64);
+            let err  = rg.abort(b, $pc);
+            let ok   = b.create_block();
+            b.ins().brif(failed, err, &[], ok, &[]);
+            b.switch_to_block(ok);
+            p.reload_after(b, &writes, env, ptr_type);
+            res
+        }};
+    }
+
+    for (i, r) in insns.iter().copied().enumerate() {
+        let pc = start + i;
+        b.switch_to_block(rg.blocks[i]);
+
+        match r.op {
+            op::NOP | op::SOURCE_LINE => {}
+
+            op::LOAD_NUM => {
+                let n = src.numbers.get(r.b as usize).copied().unwrap_or(0.0);
+                let v = b.ins().iconst(types::I64, NanVal::num(n).0 as i64);
+                st!(r.a, v);
+            }
+            op::LOAD_BOOL => {
+                let v = b.ins().iconst(types::I64, NanVal::bool(r.aux != 0).0 as i64);
+                st!(r.a, v);
+            }
+            op::LOAD_NIL => {
+                let v = b.ins().iconst(types::I64, NanVal::nil().0 as i64);
+                st!(r.a, v);
+            }
+            // Id z internera czytamy z env.str_ids — kod nie zależy od kolejności
+            // internowania, więc jest ważny także w kolejnych uruchomieniach.
+            // Krótka stała to SSO — wtedy cała wartość jest stałą w kodzie.
+            op::LOAD_STR => {
+                let v = match NanVal::sso(src.strings.get(r.b as usize).copied().unwrap_or("")) {
+                    Some(sso) => b.ins().iconst(types::I64, sso.0 as i64),
+                    None => {
+                        let id = b.ins().load(types::I32, mem, str_ids, (r.b as i32) * 4);
+                        let id = b.ins().uextend(types::I64, id);
+                        let s  = b.ins().ishl_imm(id, PAYLOAD_SHIFT as i64);
+                        b.ins().bor_imm(s, (NAN_BASE | TAG_STR) as i64)
+                    }
+                };
+                st!(r.a, v);
+            }
+            // Zmienne w SSA — GetVar/SetVar bez wyszukiwania i bez pamięci
+            op::GET_VAR if p.vars.contains_key(&r.b) => {
+                let v = b.use_var(p.vars[&r.b].0);
+                st!(r.a, v);
+            }
+            op::SET_VAR if p.vars.contains_key(&r.a) => {
+                let v = ld!(r.b);
+                b.def_var(p.vars[&r.a].0, v);
+            }
+
+            op::ADD | op::SUB | op::MUL | op::DIV => {
+                let va = ld!(r.b);
+                let vb = ld!(r.c);
+                guard_nums!(pc, va, vb);
+                let fa = to_f64!(va);
+                let fb = to_f64!(vb);
+                let f = match r.op {
+                    op::ADD => b.ins().fadd(fa, fb),
+                    op::SUB => b.ins().fsub(fa, fb),
+                    op::MUL => b.ins().fmul(fa, fb),
+                    _ => {
+                        // Dzielenie przez zero daje 0 (semantyka interpretera)
+                        let q    = b.ins().fdiv(fa, fb);
+                        let zero = b.ins().f64const(0.0);
+                        let isz  = b.ins().fcmp(FloatCC::Equal, fb, zero);
+                        b.ins().select(isz, zero, q)
+                    }
+                };
+                let v = boxed_num!(f);
+                st!(r.a, v);
+            }
+            op::NEG => {
+                let v = ld!(r.b);
+                guard_nums!(pc, v, v);
+                let f = to_f64!(v);
+                let n = b.ins().fneg(f);
+                let v = boxed_num!(n);
+                st!(r.a, v);
+            }
+
+            op::CMP_LT | op::CMP_LE | op::CMP_GT | op::CMP_GE => {
+                let va = ld!(r.b);
+                let vb = ld!(r.c);
+                guard_nums!(pc, va, vb);
+                let fa = to_f64!(va);
+                let fb = to_f64!(vb);
+                let cc = match r.op {
+                    op::CMP_LT => FloatCC::LessThan,
+                    op::CMP_LE => FloatCC::LessThanOrEqual,
+                    op::CMP_GT => FloatCC::GreaterThan,
+                    _          => FloatCC::GreaterThanOrEqual,
+                };
+                let c = b.ins().fcmp(cc, fa, fb);
+                let v = boxed_bool!(c);
+                st!(r.a, v);
+            }
+            // Dwa stringi kanoniczne (z internera albo SSO): równe ⇔ równe bity.
+            // Dwie liczby (f64/int): fcmp. Sterta i mieszane typy → deopt (porównanie tekstowe).
+            op::CMP_EQ | op::CMP_NE => {
+                let va = ld!(r.b);
+                let vb = ld!(r.c);
+                macro_rules! canon_str {
+                    ($v:expr) => {{
+                        let m  = b.ins().band_imm($v, (NAN_BASE | TAG_MASK) as i64);
+                        let is = b.ins().icmp_imm(IntCC::Equal, m, (NAN_BASE | TAG_STR) as i64);
+                        let m  = b.ins().band_imm($v, (NAN_BASE | SSO_TAG_MASK) as i64);
+                        let so = b.ins().icmp_imm(IntCC::Equal, m, (NAN_BASE | TAG_SSO) as i64);
+                        b.ins().bor(is, so)
+                    }};
+                }
+                let sa = canon_str!(va);
+                let sb = canon_str!(vb);
+                let both_str = b.ins().band(sa, sb);
+                let ta = non_num!(va);
+                let tb = non_num!(vb);
+                let any_tagged = b.ins().bor(ta, tb);
+                let both_num = b.ins().icmp_imm(IntCC::Equal, any_tagged, 0);
+                let fast_ok  = b.ins().bor(both_str, both_num);
+
+                let deopt = rg.exit(b, pc);
+                let fast  = b.create_block();
+                b.ins().brif(fast_ok, fast, &[], deopt, &[]);
+                b.switch_to_block(fast);
+
+                let eq_bits = b.ins().icmp(IntCC::Equal, va, vb);
+                let fa = to_f64!(va);
+                let fb = to_f64!(vb);
+                let eq_num = b.ins().fcmp(FloatCC::Equal, fa, fb);
+                let mut eq = b.ins().select(both_str, eq_bits, eq_num);
+                if r.op == op::CMP_NE {
+                    eq = b.ins().icmp_imm(IntCC::Equal, eq, 0);
+                }
+                let v = boxed_bool!(eq);
+                st!(r.a, v);
+            }
+            // Liczba zostaje, int → f64; tekst parsuje helper
+            op::TO_NUMBER => {
+                let v    = ld!(r.b);
+                let t    = non_num!(v);
+                let fast = b.create_block();
+                let slow = b.create_block();
+                let next = rg.target(b, pc + 1);
+                b.ins().brif(t, slow, &[], fast, &[]);
+                b.switch_to_block(fast);
+                let f = to_f64!(v);
+                let n = boxed_num!(f);
+                st!(r.a, n);
+                b.ins().jump(next, &[]);
+                b.switch_to_block(slow);
+                call_exec_one!(pc, r);
+            }
+
+            // ── Sterowanie ────────────────────────────────────────────────────
+            op::JUMP => {
+                let t = rg.target(b, r.b as usize);
+                if (r.b as usize) < pc {
+                    // Skok wsteczny — bezpieczny punkt zbierania stringów, jak
+                    // w interpreterze. Korzenie GC czyta z pamięci, więc przed
+                    // wywołaniem zapisujemy rejestry i zmienne z SSA.
+                    let live = b.ins().load(ptr_type, mem, gc_live, 0);
+                    let next = b.ins().load(ptr_type, mem, gc_next, 0);
+                    let want = b.ins().icmp(IntCC::UnsignedGreaterThanOrEqual, live, next);
+                    let gc   = b.create_block();
+                    b.ins().brif(want, gc, &[], t, &[]);
+                    b.switch_to_block(gc);
+                    let all: Vec<u32> = p.regs.keys().copied().collect();
+                    p.spill_for(b, &all);
+                    b.ins().call_indirect(collect_sig, collect, &[env]);
+                }
+                b.ins().jump(t, &[]);
+                continue;
+            }
+            op::JUMP_IF_FALSE | op::JUMP_IF_TRUE => {
+                let jump = rg.target(b, r.b as usize);
+                let next = rg.target(b, pc + 1);
+                let (on_true, on_false) = if r.op == op::JUMP_IF_TRUE { (jump, next) } else { (next, jump) };
+
+                let v         = ld!(r.a);
+                let num_blk   = b.create_block();
+                let tag_blk   = b.create_block();
+                let chk_false = b.create_block();
+                let slow      = b.create_block();
+                let t = tagged!(v);
+                b.ins().brif(t, tag_blk, &[], num_blk, &[]);
+
+                b.switch_to_block(num_blk);
+                let f    = b.ins().bitcast(types::F64, MemFlags::new(), v);
+                let zero = b.ins().f64const(0.0);
+                let nz   = b.ins().fcmp(FloatCC::NotEqual, f, zero);
+                b.ins().brif(nz, on_true, &[], on_false, &[]);
+
+                b.switch_to_block(tag_blk);
+                let is_t = b.ins().icmp_imm(IntCC::Equal, v, BOOL_BITS_TRUE as i64);
+                b.ins().brif(is_t, on_true, &[], chk_false, &[]);
+
+                b.switch_to_block(chk_false);
+                let is_f = b.ins().icmp_imm(IntCC::Equal, v, BOOL_BITS_FALSE as i64);
+                b.ins().brif(is_f, on_false, &[], slow, &[]);
+
+                // nil / int / string — helper z internerem (dostaje wartość, nie rejestr)
+                b.switch_to_block(slow);
+                let call = b.ins().call_indirect(truthy_sig, truthy, &[env, v]);
+                let res  = b.inst_results(call)[0];
+                b.ins().brif(res, on_true, &[], on_false, &[]);
+                continue;
+            }
+            op::FOR_IN_NEXT => {
+                let res  = call_exec_one!(pc, r);
+                let done = rg.target(b, r.c as usize);
+                let next = rg.target(b, pc + 1);
+                let br   = b.ins().icmp_imm(IntCC::Equal, res, HELPER_BRANCH as i64);
+                b.ins().brif(br, done, &[], next, &[]);
+                continue;
+            }
+            // Licznik i koniec zakresu to inty — porównanie bez helpera.
+            // Inna wartość (nil po i32::MAX) → deopt, interpreter kończy pętlę.
+            op::FOR_RANGE_NEXT => {
+                let vc = ld!(r.a);
+                let ve = ld!(r.b);
+                let ic = is_int!(vc);
+                let ie = is_int!(ve);
+                let both  = b.ins().band(ic, ie);
+                let deopt = rg.exit(b, pc);
+                let fast  = b.create_block();
+                b.ins().brif(both, fast, &[], deopt, &[]);
+                b.switch_to_block(fast);
+                let c    = int_payload!(vc);
+                let e    = int_payload!(ve);
+                let gt   = b.ins().icmp(IntCC::SignedGreaterThan, c, e);
+                let done = rg.target(b, r.c as usize);
+                let next = rg.target(b, pc + 1);
+                b.ins().brif(gt, done, &[], next, &[]);
+                continue;
+            }
+            op::FOR_RANGE_STEP => {
+                let v     = ld!(r.b);
+                let i     = is_int!(v);
+                let n     = int_payload!(v);
+                let max   = b.ins().icmp_imm(IntCC::Equal, n, i32::MAX as i64);
+                let ok    = b.ins().band_not(i, max);
+                let deopt = rg.exit(b, pc);
+                let fast  = b.create_block();
+                b.ins().brif(ok, fast, &[], deopt, &[]);
+                b.switch_to_block(fast);
+                let n = b.ins().iadd_imm(n, 1);
+                let w = b.ins().uextend(types::I64, n);
+                let s = b.ins().ishl_imm(w, PAYLOAD_SHIFT as i64);
+                let v = b.ins().bor_imm(s, (NAN_BASE | TAG_INT) as i64);
+                st!(r.a, v);
+            }
+            op::RETURN | op::CALL_FUNC | op::ARENA_CALL => {
+                let x = rg.exit(b, pc);
+                b.ins().jump(x, &[]);
+                continue;
+            }
+
+            // Reszta (zmienne spoza SSA, Concat, Print, CallQuick, komendy,
+            // ForInStart, Mod, Truthy, ToString…) — instrukcja wykonana przez interpreter
+            _ => { call_exec_one!(pc, r); }
         }
 
-        Instruction::Nop | Instruction::Return { .. } => {}
-        _ => { /* pozostałe instrukcje nie są kompilowane do JIT */ }
+        let next = rg.target(b, pc + 1);
+        b.ins().jump(next, &[]);
     }
 
+    let written: Vec<u32> = p.written.iter().copied().collect();
+    for (&pc, &blk) in &rg.exits {
+        b.switch_to_block(blk);
+        p.spill_for(b, &written);
+        let v = b.ins().iconst(types::I32, pc as i64);
+        b.ins().return_(&[v]);
+    }
+    for (&pc, &blk) in &rg.aborts {
+        b.switch_to_block(blk);
+        let v = b.ins().iconst(types::I32, pc as i64);
+        b.ins().return_(&[v]);
+    }
     Ok(())
 }
 
-/// Zbierz wszystkie rejestry użyte w instrukcji
-fn insn_regs(insn: &Instruction) -> Vec<u32> {
-    match insn {
-        Instruction::LoadNum  { dst, .. } => vec![*dst],
-        Instruction::LoadBool { dst, .. } => vec![*dst],
-        Instruction::LoadNil  { dst }     => vec![*dst],
-        Instruction::GetVar    { dst, .. } => vec![*dst],
-        Instruction::GetVarDyn { dst, name } => vec![*dst, *name],
-        Instruction::SetVar    { src, .. } => vec![*src],
-        Instruction::Add { dst, a, b } |
-        Instruction::Sub { dst, a, b } |
-        Instruction::Mul { dst, a, b } |
-        Instruction::Div { dst, a, b } |
-        Instruction::Mod { dst, a, b } |
-        Instruction::CmpEq { dst, a, b } |
-        Instruction::CmpNe { dst, a, b } |
-        Instruction::CmpLt { dst, a, b } |
-        Instruction::CmpLe { dst, a, b } |
-        Instruction::CmpGt { dst, a, b } |
-        Instruction::CmpGe { dst, a, b } => vec![*dst, *a, *b],
-        Instruction::Neg { dst, src } |
-        Instruction::ToString { dst, src } |
-        Instruction::ToNumber { dst, src } |
-        Instruction::Truthy   { dst, src } => vec![*dst, *src],
-        Instruction::JumpIfFalse { cond, .. } |
-        Instruction::JumpIfTrue  { cond, .. } => vec![*cond],
-        _ => vec![],
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    unsafe extern "C" fn no_exec(_: *mut TraceEnv, _: u32) -> u32 { HELPER_FAILED }
+    unsafe extern "C" fn no_truthy(_: *mut TraceEnv, _: u64) -> u32 { 0 }
+    unsafe extern "C" fn no_collect(_: *mut TraceEnv) {}
+
+    /// while r0 < r2 { r0 = r0 + r1 } — pętla [2..=5], wyjście na 6
+    fn counting_loop() -> (Vec<FlatInsn>, Vec<f64>) {
+        let code = vec![
+            FlatInsn::new(op::LOAD_NUM,      0, 1, 0, 0),
+            FlatInsn::new(op::LOAD_NUM,      0, 2, 1, 0),
+            FlatInsn::new(op::CMP_LT,        0, 3, 0, 2),
+            FlatInsn::new(op::JUMP_IF_FALSE, 0, 3, 6, 0),
+            FlatInsn::new(op::ADD,           0, 0, 0, 1),
+            FlatInsn::new(op::JUMP,          0, 0, 2, 0),
+            FlatInsn::new(op::NOP,           0, 0, 0, 0),
+        ];
+        (code, vec![1.0, 10.0])
     }
-}
 
-// ── compile_trace_entry — publiczny entry point dla Trace JIT ─────────────────
-//
-// Kompiluje blok instrukcji jako pseudo-funkcję przez Cranelift JIT.
-// Wywoływany z interpreter.rs::try_compile_trace.
-
-pub fn compile_trace_entry(
-    module_bc: &HlModule,
-    entry: &FuncEntry,
-) -> anyhow::Result<crate::interpreter::CompiledTrace> {
-    let engine = JitEngine::new();
-    engine.jit_compile(&entry.name, module_bc, entry)
-    .map(|frag| crate::interpreter::CompiledTrace {
-        fn_ptr:      frag.fn_ptr,
-         exit_offset: entry.start_insn + entry.insn_count,
-    })
+    /// x = 0; while x < 10 { x = x + 1 } na zmiennej "x" — pętla [2..=7], wyjście na 8
+    fn var_loop() -> (Vec<FlatInsn>, Vec<f64>) {
+        let code = vec![
+            FlatInsn::new(op::LOAD_NUM,      0, 1, 0, 0),
+            FlatInsn::new(op::LOAD_NUM,      0, 2, 1, 0),
+            FlatInsn::new(op::GET_VAR,       0, 0, 0, 0),
+            FlatInsn::new(op::CMP_LT,        0, 3, 0, 2),
+            FlatInsn::new(op::JUMP_IF_FALSE, 0, 3, 8, 0),
+            FlatInsn::new(op::ADD,           0, 0, 0, 1),
+            FlatInsn::new(op::SET_VAR,       0, 0, 0, 0),
+            FlatInsn::new(op::JUMP,          0, 0, 2, 0),
+            FlatInsn::new(op::NOP,           0, 0, 0, 0),
+        ];
+        (code, vec![1.0, 10.0])
+    }
+
+    fn src<'s>(code: &'s [FlatInsn], nums: &'s [f64], strings: &'s [&'s str]) -> RegionSrc<'s> {
+        RegionSrc { code, extra: &[], numbers: nums, strings }
+    }
+
+    fn run(jit: &mut JitEngine, start: u32, regs: &mut [u64]) -> u32 {
+        run_with_vars(jit, start, regs, &mut [], &[])
+    }
+
+    fn run_with_vars(jit: &mut JitEngine, start: u32, regs: &mut [u64], vars: &mut [u64], slots: &[u32]) -> u32 {
+        let trace = jit.trace(start).expect("trace po finalize");
+        let mut env = TraceEnv {
+            regs:      regs.as_mut_ptr(),
+            str_ids:   std::ptr::null(),
+            vars:      vars.as_mut_ptr(),
+            var_slots: slots.as_ptr(),
+            interp:    std::ptr::null_mut(),
+            exec_one:  no_exec,
+            truthy:    no_truthy,
+            gc_live:   &0,
+            gc_next:   &usize::MAX,
+            collect:   no_collect,
+        };
+        unsafe { (trace.fn_ptr)(&mut env) }
+    }
+
+    #[test]
+    fn test_parse_mem_limit() {
+        assert_eq!(parse_mem_limit("4096"), Some(4096));
+        assert_eq!(parse_mem_limit("512K"), Some(512 * 1024));
+        assert_eq!(parse_mem_limit("64m"), Some(64 * 1024 * 1024));
+        assert_eq!(parse_mem_limit("x"), None);
+    }
+
+    #[test]
+    fn test_rejects_call_func() {
+        let code = vec![FlatInsn::new(op::CALL_FUNC, 0, 0, 0, 0), FlatInsn::new(op::JUMP, 0, 0, 0, 0)];
+        assert!(!is_jit_eligible(&code, 0, 1));
+        assert!(!is_jit_eligible(&code, 0, 5));
+    }
+
+    #[test]
+    fn test_trace_loops_natively_and_deopts_on_string() {
+        let (code, nums) = counting_loop();
+        let mut jit = JitEngine::new();
+        jit.enabled = true;
+        jit.compile_trace(&src(&code, &nums, &[]), 2, 5, None).unwrap();
+
+        let mut regs = [NanVal::num(0.0).0, NanVal::num(1.0).0, NanVal::num(10.0).0, 0];
+        assert_eq!(run(&mut jit, 2, &mut regs), 6);
+        assert_eq!(f64::from_bits(regs[0]), 10.0);
+
+        // String w r0 — guard CmpLt nie przechodzi, wracamy na pc 2
+        regs[0] = NanVal::str_interned(7).0;
+        assert_eq!(run(&mut jit, 2, &mut regs), 2);
+        assert_eq!(regs[0], NanVal::str_interned(7).0);
+    }
+
+    #[test]
+    fn test_traces_share_module_and_evict_over_limit() {
+        let (code, nums) = counting_loop();
+        let mut jit = JitEngine::new().with_mem_limit(1);
+        jit.enabled = true;
+        assert!(!jit.compile_trace(&src(&code, &nums, &[]), 2, 5, None).unwrap());
+        assert!(jit.code_bytes() > 0);
+        assert!(jit.trace(2).is_some());
+
+        // Limit przekroczony — następna definicja porzuca generację
+        assert!(jit.compile_trace(&src(&code, &nums, &[]), 3, 5, None).unwrap());
+        assert_eq!(jit.generation(), 1);
+        assert!(!jit.has_trace(2));
+        assert!(jit.trace(3).is_some());
+    }
+
+    #[test]
+    fn test_release_keeps_aot_traces() {
+        unsafe extern "C" fn aot_trace(_env: *mut TraceEnv) -> u32 { 6 }
+        let (code, nums) = counting_loop();
+        let mut jit = JitEngine::new().with_mem_limit(1);
+        jit.enabled = true;
+        jit.install_trace(0, 1, aot_trace);
+        assert_eq!(jit.code_bytes(), 0);
+
+        jit.compile_trace(&src(&code, &nums, &[]), 2, 5, None).unwrap();
+        assert!(jit.compile_trace(&src(&code, &nums, &[]), 3, 5, None).unwrap());
+        // Generacja porzucona — trasa JIT znika, trasa z obrazu zostaje
+        assert!(!jit.has_trace(2));
+        let t = jit.trace(0).expect("trasa AOT po release");
+        assert_eq!(t.fn_ptr as usize, aot_trace as usize);
+
+        jit.release();
+        assert!(jit.has_trace(0));
+    }
+
+    #[test]
+    fn test_promoted_var_stays_in_ssa_until_exit() {
+        let (code, nums) = var_loop();
+        let strings = ["x"];
+        let s = src(&code, &nums, &strings);
+        assert_eq!(promoted_vars(&s, 2, 7), vec![0]);
+
+        let mut jit = JitEngine::new();
+        jit.enabled = true;
+        jit.compile_trace(&s, 2, 7, None).unwrap();
+
+        // "x" w slocie 1; helper nie jest potrzebny (no_exec = błąd)
+        let mut regs = [0, NanVal::num(1.0).0, NanVal::num(10.0).0, 0];
+        let mut vars = [NanVal::nil().0, NanVal::num(0.0).0];
+        assert_eq!(run_with_vars(&mut jit, 2, &mut regs, &mut vars, &[1]), 8);
+        assert_eq!(f64::from_bits(vars[1]), 10.0);
+        assert_eq!(f64::from_bits(regs[0]), 10.0);
+    }
+
+    #[test]
+    fn test_unset_and_last_exit_are_not_promoted() {
+        let code = |quick: QuickFn| vec![
+            FlatInsn::new(op::GET_VAR,    0, 0, 0, 0),
+            FlatInsn::new(op::SET_VAR,    0, 1, 0, 0),
+            FlatInsn::new(op::CALL_QUICK, quick.id(), 2, 0, 0),
+        ];
+        let strings = ["x", "_last_exit_code", "q"];
+        assert_eq!(promoted_vars(&src(&code(QuickFn::Len), &[], &strings), 0, 2), vec![0]);
+        assert!(promoted_vars(&src(&code(QuickFn::Unset), &[], &strings), 0, 2).is_empty());
+    }
+
+    #[test]
+    fn test_only_assigned_vars_are_promoted() {
+        // n przypisane przed pętlą, HOME tylko czytane (std::env) — pętla [2..=4]
+        let code = vec![
+            FlatInsn::new(op::LOAD_NUM, 0, 0, 0, 0),
+            FlatInsn::new(op::SET_VAR,  0, 0, 0, 0),
+            FlatInsn::new(op::GET_VAR,  0, 1, 0, 0),
+            FlatInsn::new(op::GET_VAR,  0, 2, 1, 0),
+            FlatInsn::new(op::JUMP,     0, 0, 2, 0),
+        ];
+        let strings = ["n", "HOME"];
+        assert_eq!(promoted_vars(&src(&code, &[1.0], &strings), 2, 4), vec![0]);
+    }
+
+    #[test]
+    fn test_range_loop_counts_natively_and_deopts_at_max() {
+        // for r0 in r0..=r1 { r2 = r2 + r0 } — pętla [0..=3], wyjście na 4
+        let code = vec![
+            FlatInsn::new(op::FOR_RANGE_NEXT, 0, 0, 1, 4),
+            FlatInsn::new(op::ADD,            0, 2, 2, 0),
+            FlatInsn::new(op::FOR_RANGE_STEP, 0, 0, 0, 0),
+            FlatInsn::new(op::JUMP,           0, 0, 0, 0),
+            FlatInsn::new(op::NOP,            0, 0, 0, 0),
+        ];
+        let mut jit = JitEngine::new();
+        jit.enabled = true;
+        jit.compile_trace(&src(&code, &[], &[]), 0, 3, None).unwrap();
+
+        let mut regs = [NanVal::int(1).0, NanVal::int(10).0, NanVal::num(0.0).0];
+        assert_eq!(run(&mut jit, 0, &mut regs), 4);
+        assert_eq!(f64::from_bits(regs[2]), 55.0);
+        assert_eq!(NanVal(regs[0]).as_int(), Some(11));
+
+        // Licznik na i32::MAX — krok wraca do interpretera (ten daje nil)
+        let mut regs = [NanVal::int(i32::MAX).0, NanVal::int(i32::MAX).0, NanVal::num(0.0).0];
+        assert_eq!(run(&mut jit, 0, &mut regs), 2);
+        assert_eq!(f64::from_bits(regs[2]), i32::MAX as f64);
+    }
+
+    #[test]
+    fn test_reg_effects_concat_reads_extra() {
+        let insn = FlatInsn::new(op::CONCAT, 0, 4, 1, 2);
+        assert_eq!(reg_effects(insn, &[9, 5, 6]), (vec![5, 6], vec![4]));
+    }
 }
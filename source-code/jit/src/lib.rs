@@ -1,10 +1,17 @@
+pub mod aot;
+pub mod compact;
 pub mod interpreter;
+pub mod jit_cache;
 pub mod jit_engine;
+pub mod libs;
+pub mod profile;
 pub mod runtime;
 pub mod runner;
+pub mod session;
 
-pub use runner::{run_bc_file, run_bc_module, run_hl_file};
+pub use runner::{run_bc_file, run_bc_module, run_hl_file, run_profiled, ProfileOpts};
 pub use interpreter::BytecodeInterpreter;
+pub use session::{ReplSession, SeedVal};
 
 use anyhow::Result;
 use std::path::Path;
@@ -15,3 +22,12 @@ use std::path::Path;
 pub fn run_file(path: &Path, args: &[String]) -> Result<i32> {
     runner::run_hl_file(path, args)
 }
+
+/// Kolektor `hl_core::metrics` dla liczników spoza core (cache bytecode
+/// w `hl_compiler`, który nie zależy od core)
+pub fn collect_metrics() {
+    use hl_core::metrics::{add, Counter};
+    let (hits, misses) = hl_compiler::cache::take_process_stats();
+    add(Counter::BcCacheHits, hits);
+    add(Counter::BcCacheMisses, misses);
+}
@@ -0,0 +1,72 @@
+//! Biblioteki w ścieżce bytecode: import → skompilowany .bc z cache → linker
+//!
+//! Executor AST parsuje i wykonuje plik biblioteki przy każdym imporcie.
+//! Tu plik biblioteki przechodzi przez ten sam cache co skrypty
+//! (`compile_to_cache`, klucz = hash treści), więc kolejne uruchomienia tylko
+//! wczytują gotowy .bc. `hl_compiler::link` dokleja do modułu skryptu
+//! inicjalizację biblioteki i wyłącznie wołane funkcje.
+
+use anyhow::{Context, Result};
+use hl_compiler::link::{self, InitVal, LinkLib};
+use hl_compiler::{compile_to_cache, read_bc_file, source_hash, HlModule, Instruction};
+use hl_core::{locate_import, Value};
+use std::collections::HashSet;
+
+/// Zlinkuj biblioteki importowane przez moduł (przechodnio).
+/// None — moduł niczego nie importuje. Zwraca też klucz trwałego cache JIT:
+/// offsety kodu bibliotek zależą od ich treści, więc hash samego skryptu
+/// nie wystarcza.
+pub fn link_imports(module: &HlModule, hash: Option<u64>) -> Result<Option<(HlModule, Option<u64>)>> {
+    if !link::has_imports(module) { return Ok(None); }
+
+    let mut libs: Vec<LinkLib> = Vec::new();
+    let mut key  = hash.map(|h| format!("{:016x}", h));
+    let mut seen = HashSet::new();
+    let mut queue = link::imports(module);
+
+    while !queue.is_empty() {
+        for init in std::mem::take(&mut queue) {
+            if !seen.insert(init.clone()) { continue; }
+            let spec = link::lib_of_init(&init).unwrap_or(&init).to_string();
+            let (lib_module, lib_hash) = load_lib(&spec)?;
+            queue.extend(link::imports(&lib_module.module));
+            if let Some(k) = key.as_mut() { k.push_str(&format!(":{}={:016x}", spec, lib_hash)); }
+            libs.push(LinkLib { init, ..lib_module });
+        }
+    }
+
+    let linked = link::link(module, &libs)?;
+    tracing::debug!("Zlinkowano {} bibliotek ({} instrukcji)", libs.len(), linked.instructions.len());
+    Ok(Some((linked, key.map(|k| source_hash(&k)))))
+}
+
+/// Moduł biblioteki i hash jej treści (0 — brak pliku, same zmienne)
+fn load_lib(spec: &str) -> Result<(LinkLib, u64)> {
+    let target = locate_import(spec)?;
+    let vars = target.vars.into_iter().map(|(k, v)| (k, init_val(v))).collect();
+
+    let (module, hash) = match &target.file {
+        Some(path) => {
+            let source = std::fs::read_to_string(path)
+                .with_context(|| format!("Nie mozna wczytac biblioteki {:?}", path))?;
+            let bc = compile_to_cache(&source, path)
+                .with_context(|| format!("Kompilacja biblioteki '{}'", spec))?;
+            (read_bc_file(&bc)?, source_hash(&source))
+        }
+        None => {
+            let mut m = HlModule::new(spec, 2);
+            m.instructions.push(Instruction::Return { src: None });
+            (m, 0)
+        }
+    };
+    Ok((LinkLib { init: String::new(), module, vars }, hash))
+}
+
+fn init_val(v: Value) -> InitVal {
+    match v {
+        Value::String(s) => InitVal::Str(s),
+        Value::Number(n) => InitVal::Num(n),
+        Value::Bool(b)   => InitVal::Bool(b),
+        other            => InitVal::Str(other.to_string_val()),
+    }
+}
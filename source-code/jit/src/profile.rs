@@ -0,0 +1,362 @@
+//! Profiler `hl run --profile`
+//!
+//! Zbiera naraz dwa profile:
+//!  - liczący — ile razy interpreter wykonał każdą instrukcję, ile wywołań
+//!    miała każda funkcja, ile wejść i czasu mają trasy JIT, ile czasu
+//!    zajęły procesy potomne (`ExecCmd` i pokrewne);
+//!  - próbkujący — wątek zegara co `SAMPLE_INTERVAL` podbija licznik tyknięć,
+//!    a interpreter w bezpiecznych punktach (każda instrukcja, powrót z
+//!    procesu, wyjście z trasy natywnej) przypisuje zaległe tyknięcia swojemu
+//!    stosowi. Tyknięcia z czasu, gdy wątek czekał na proces albo wykonywał
+//!    kod natywny, trafiają do tej komendy/trasy — bez sygnałów i bez
+//!    czytania stosu z obcego wątku.
+//!
+//! Linie źródła pochodzą z `HlModule::lines` (tablica optymalizatora) albo ze
+//! znaczników `SourceLine`, które zostają w kodzie przy -O0.
+
+use crate::compact::Program;
+use hl_compiler::flat::op;
+use rustc_hash::FxHashMap;
+use std::io::Write;
+use std::path::Path;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+/// Okres próbkowania
+pub const SAMPLE_INTERVAL: Duration = Duration::from_millis(1);
+
+/// Co robił wątek, gdy przyszła próbka
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Kind {
+    Interp = 0,
+    /// czekanie na proces potomny
+    Proc   = 1,
+    /// kod natywny trasy JIT
+    Jit    = 2,
+}
+
+/// Instrukcje, które uruchamiają proces potomny i czekają na niego
+#[inline]
+pub fn is_proc_op(o: u8) -> bool {
+    matches!(o, op::EXEC_CMD | op::EXEC_CAPTURE | op::EXEC_TPL | op::CAPTURE_TPL
+        | op::FOR_IN_CMD | op::FOR_IN_TPL | op::HACKEROS_CALL)
+}
+
+#[derive(Debug, Default, Clone, Copy)]
+struct TraceStat {
+    entries: u64,
+    ns:      u64,
+}
+
+pub struct Profiler {
+    file:       String,
+    /// pc → linia źródła (0 = nieznana)
+    line_of:    Vec<u32>,
+    /// (nazwa, start, liczba instrukcji) — kopia `Program::funcs`
+    funcs:      Vec<(String, u32, u32)>,
+    counts:     Vec<u64>,
+    proc_ns:    Vec<u64>,
+    samples:    Vec<[u64; 3]>,
+    calls:      Vec<u64>,
+    /// Próbki włącznie z wywołanymi funkcjami; [0] = główny kod
+    func_samples: Vec<u64>,
+    traces:     FxHashMap<u32, TraceStat>,
+    /// Indeksy funkcji aktywnych wywołań
+    stack:      Vec<u32>,
+    /// Trasa, której kod natywny właśnie się wykonuje (start)
+    in_trace:   Option<u32>,
+    /// Czas procesów uruchomionych z bieżącej trasy — odejmowany od jej czasu
+    trace_proc_ns: u64,
+    folded:     FxHashMap<String, u64>,
+    key:        String,
+    total:      u64,
+    ticks:      Arc<AtomicU64>,
+    stop:       Arc<AtomicBool>,
+    sampler:    Option<std::thread::JoinHandle<()>>,
+    started:    Instant,
+    elapsed:    Duration,
+}
+
+impl Profiler {
+    pub fn new(file: &str, prog: &Program, lines: &[(u32, u32)]) -> Self {
+        let n = prog.code.len();
+        let mut line_of = vec![0u32; n];
+        let (mut cur, mut next) = (0u32, 0usize);
+        for (pc, line) in line_of.iter_mut().enumerate() {
+            while next < lines.len() && lines[next].0 as usize <= pc {
+                cur = lines[next].1;
+                next += 1;
+            }
+            let r = prog.code[pc];
+            if r.op == op::SOURCE_LINE { cur = r.a; }
+            *line = cur;
+        }
+
+        let ticks = Arc::new(AtomicU64::new(0));
+        let stop  = Arc::new(AtomicBool::new(false));
+        let sampler = {
+            let (ticks, stop) = (ticks.clone(), stop.clone());
+            std::thread::Builder::new()
+                .name("hl-profiler".into())
+                .spawn(move || while !stop.load(Ordering::Relaxed) {
+                    std::thread::sleep(SAMPLE_INTERVAL);
+                    ticks.fetch_add(1, Ordering::Relaxed);
+                })
+                .ok()
+        };
+
+        Self {
+            file: file.to_string(),
+            line_of,
+            funcs: prog.funcs.iter().map(|&(f, s, c)| (f.to_string(), s, c)).collect(),
+            counts: vec![0; n],
+            proc_ns: vec![0; n],
+            samples: vec![[0; 3]; n],
+            calls: vec![0; prog.funcs.len()],
+            func_samples: vec![0; prog.funcs.len() + 1],
+            traces: FxHashMap::default(),
+            stack: Vec::with_capacity(16),
+            in_trace: None,
+            trace_proc_ns: 0,
+            folded: FxHashMap::default(),
+            key: String::with_capacity(128),
+            total: 0,
+            ticks,
+            stop,
+            sampler,
+            started: Instant::now(),
+            elapsed: Duration::ZERO,
+        }
+    }
+
+    /// Instrukcja `pc` w pętli dispatch: licznik + odbiór zaległych próbek
+    #[inline(always)]
+    pub fn step(&mut self, pc: usize) {
+        self.counts[pc] += 1;
+        if self.ticks.load(Ordering::Relaxed) != 0 {
+            self.sample(pc, Kind::Interp);
+        }
+    }
+
+    /// Instrukcja wykonana na żądanie trasy JIT — tylko licznik (próbki
+    /// z wnętrza trasy odbiera `trace_done`)
+    #[inline]
+    pub fn count(&mut self, pc: usize) {
+        self.counts[pc] += 1;
+    }
+
+    pub fn enter(&mut self, func: usize) {
+        self.calls[func] += 1;
+        self.stack.push(func as u32);
+    }
+
+    pub fn leave(&mut self) {
+        self.stack.pop();
+    }
+
+    /// Przed startem procesu: próbki do tej pory należą do interpretera
+    /// (albo do trasy, z której proces jest uruchamiany)
+    pub fn proc_start(&mut self, pc: usize) {
+        match self.in_trace {
+            Some(t) => self.sample(t as usize, Kind::Jit),
+            None    => self.sample(pc, Kind::Interp),
+        }
+    }
+
+    pub fn proc_done(&mut self, pc: usize, took: Duration) {
+        let ns = took.as_nanos() as u64;
+        self.proc_ns[pc] += ns;
+        if self.in_trace.is_some() { self.trace_proc_ns += ns; }
+        self.sample(pc, Kind::Proc);
+    }
+
+    pub fn trace_begin(&mut self, start: u32, pc: usize) {
+        self.sample(pc, Kind::Interp);
+        self.in_trace = Some(start);
+        self.trace_proc_ns = 0;
+    }
+
+    pub fn trace_done(&mut self, start: u32, took: Duration) {
+        let t = self.traces.entry(start).or_default();
+        t.entries += 1;
+        t.ns += (took.as_nanos() as u64).saturating_sub(self.trace_proc_ns);
+        self.sample(start as usize, Kind::Jit);
+        self.in_trace = None;
+    }
+
+    /// Przypisz zaległe tyknięcia do `pc` i bieżącego stosu
+    #[cold]
+    pub fn sample(&mut self, pc: usize, kind: Kind) {
+        let n = self.ticks.swap(0, Ordering::Relaxed);
+        if n == 0 || pc >= self.samples.len() { return; }
+        self.samples[pc][kind as usize] += n;
+        self.total += n;
+
+        // main;f;g;plik.hl:12[;[proces]|[jit]]
+        use std::fmt::Write as _;
+        self.key.clear();
+        self.key.push_str("main");
+        self.func_samples[0] += n;
+        for (i, &f) in self.stack.iter().enumerate() {
+            self.key.push(';');
+            self.key.push_str(&self.funcs[f as usize].0);
+            // Rekurencja liczy się raz na funkcję
+            if !self.stack[..i].contains(&f) { self.func_samples[f as usize + 1] += n; }
+        }
+        let _ = write!(self.key, ";{}:{}", self.file, self.line_of[pc]);
+        match kind {
+            Kind::Interp => {}
+            Kind::Proc   => self.key.push_str(";[proces]"),
+            Kind::Jit    => self.key.push_str(";[jit]"),
+        }
+        match self.folded.get_mut(self.key.as_str()) {
+            Some(c) => *c += n,
+            None    => { self.folded.insert(self.key.clone(), n); }
+        }
+    }
+
+    /// Zatrzymaj zegar próbek
+    pub fn stop(&mut self) {
+        self.elapsed = self.started.elapsed();
+        self.stop.store(true, Ordering::Relaxed);
+        if let Some(h) = self.sampler.take() { let _ = h.join(); }
+    }
+
+    /// Profil w formacie folded (`flamegraph.pl`, `inferno-flamegraph`)
+    pub fn write_folded(&self, path: &Path) -> std::io::Result<()> {
+        let mut rows: Vec<(&String, &u64)> = self.folded.iter().collect();
+        rows.sort();
+        let mut w = std::io::BufWriter::new(std::fs::File::create(path)?);
+        for (stack, n) in rows {
+            writeln!(w, "{} {}", stack, n)?;
+        }
+        w.flush()
+    }
+
+    /// Statystyki linii: (linia, próbki, wykonania, procesy ns, jit ns)
+    fn line_stats(&self) -> Vec<(u32, u64, u64, u64, u64)> {
+        let mut by_line: FxHashMap<u32, (u64, u64, u64, u64)> = FxHashMap::default();
+        for pc in 0..self.line_of.len() {
+            let s = self.samples[pc].iter().sum::<u64>();
+            if s == 0 && self.counts[pc] == 0 && self.proc_ns[pc] == 0 { continue; }
+            let e = by_line.entry(self.line_of[pc]).or_default();
+            e.0 += s;
+            e.1 += self.counts[pc];
+            e.2 += self.proc_ns[pc];
+        }
+        for (&start, t) in &self.traces {
+            let line = self.line_of.get(start as usize).copied().unwrap_or(0);
+            by_line.entry(line).or_default().3 += t.ns;
+        }
+        let mut rows: Vec<_> = by_line.into_iter().map(|(l, (s, c, p, j))| (l, s, c, p, j)).collect();
+        rows.sort_by(|a, b| b.1.cmp(&a.1).then(b.3.max(b.4).cmp(&a.3.max(a.4))).then(b.2.cmp(&a.2)));
+        rows
+    }
+
+    /// Raport na stderr: najgorętsze linie, funkcje i trasy JIT
+    pub fn print_report(&self, top: usize, source: Option<&str>, folded: Option<&Path>) {
+        let src_lines: Vec<&str> = source.map(|s| s.lines().collect()).unwrap_or_default();
+        let ms = |ns: u64| ns as f64 / 1e6;
+        let pct = |n: u64| if self.total == 0 { 0.0 } else { n as f64 * 100.0 / self.total as f64 };
+        let total_proc: u64 = self.proc_ns.iter().sum();
+        let total_jit: u64  = self.traces.values().map(|t| t.ns).sum();
+        let kind_total = |k: Kind| self.samples.iter().map(|s| s[k as usize]).sum::<u64>();
+
+        eprintln!();
+        eprintln!("=== Profil: {} — {:.3} s, {} próbek co {} ms ===",
+                  self.file, self.elapsed.as_secs_f64(), self.total, SAMPLE_INTERVAL.as_millis());
+        eprintln!("{:>6} {:>8} {:>6} {:>12} {:>11} {:>9}  źródło",
+                  "linia", "próbki", "%", "wykonania", "procesy ms", "jit ms");
+        for (line, s, c, p, j) in self.line_stats().into_iter().take(top) {
+            let text = match line {
+                0 => "<bez linii>",
+                l => src_lines.get(l as usize - 1).map(|t| t.trim()).unwrap_or(""),
+            };
+            let text: String = text.chars().take(48).collect();
+            eprintln!("{:>6} {:>8} {:>5.1}% {:>12} {:>11.1} {:>9.1}  {}",
+                      line, s, pct(s), c, ms(p), ms(j), text);
+        }
+
+        let mut funcs: Vec<usize> = (0..self.funcs.len()).filter(|&i| self.calls[i] > 0).collect();
+        if !funcs.is_empty() {
+            funcs.sort_by_key(|&i| std::cmp::Reverse(self.func_samples[i + 1]));
+            eprintln!();
+            eprintln!("{:<24} {:>10} {:>10} {:>6} {:>12}", "funkcja", "wywołania", "próbki", "%", "wykonania");
+            for i in funcs.into_iter().take(top) {
+                let (name, start, len) = &self.funcs[i];
+                let execs: u64 = self.counts[*start as usize..(*start + *len) as usize].iter().sum();
+                let s = self.func_samples[i + 1];
+                eprintln!("{:<24} {:>10} {:>10} {:>5.1}% {:>12}", name, self.calls[i], s, pct(s), execs);
+            }
+        }
+
+        if !self.traces.is_empty() {
+            let mut traces: Vec<_> = self.traces.iter().collect();
+            traces.sort_by_key(|(_, t)| std::cmp::Reverse(t.ns));
+            eprintln!();
+            eprintln!("{:<10} {:>6} {:>10} {:>10}", "trasa JIT", "linia", "wejścia", "czas ms");
+            for (&start, t) in traces.into_iter().take(top) {
+                let line = self.line_of.get(start as usize).copied().unwrap_or(0);
+                eprintln!("{:<10} {:>6} {:>10} {:>10.1}", format!("@{}", start), line, t.entries, ms(t.ns));
+            }
+        }
+
+        eprintln!();
+        eprintln!("próbki: interpreter {}, procesy {}, jit {} | czas procesów {:.1} ms, kodu natywnego {:.1} ms",
+                  kind_total(Kind::Interp), kind_total(Kind::Proc), kind_total(Kind::Jit),
+                  ms(total_proc), ms(total_jit));
+        if let Some(p) = folded {
+            eprintln!("folded: {} (flamegraph.pl / inferno-flamegraph)", p.display());
+        }
+    }
+}
+
+impl Drop for Profiler {
+    fn drop(&mut self) {
+        self.stop.store(true, Ordering::Relaxed);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use hl_compiler::bytecode::{HlModule, Instruction};
+
+    #[test]
+    fn test_lines_from_table_and_markers() {
+        let mut m = HlModule::new("t.hl", 2);
+        m.instructions = vec![
+            Instruction::LoadNil { dst: 0 },
+            Instruction::LoadNil { dst: 1 },
+            Instruction::SourceLine { line: 9 },
+            Instruction::LoadNil { dst: 2 },
+            Instruction::Return { src: None },
+        ];
+        m.main_regs = 3;
+        let prog = Program::from_module(&m).unwrap();
+        let mut p = Profiler::new("t.hl", &prog, &[(1, 4)]);
+        p.stop();
+        assert_eq!(p.line_of, vec![0, 4, 9, 9, 9]);
+    }
+
+    #[test]
+    fn test_samples_fold_stack_and_kind() {
+        let mut m = HlModule::new("t.hl", 2);
+        m.instructions = vec![Instruction::LoadNil { dst: 0 }, Instruction::Return { src: None }];
+        m.funcs.entries.push(hl_compiler::bytecode::FuncEntry { name: "f".into(), start_insn: 0, insn_count: 2 });
+        let prog = Program::from_module(&m).unwrap();
+        let mut p = Profiler::new("t.hl", &prog, &[(0, 3)]);
+        p.stop();
+        p.enter(0);
+        p.ticks.store(5, Ordering::Relaxed);
+        p.proc_done(0, Duration::from_millis(5));
+        p.leave();
+        p.ticks.store(2, Ordering::Relaxed);
+        p.step(1);
+        assert_eq!(p.folded.get("main;f;t.hl:3;[proces]"), Some(&5));
+        assert_eq!(p.folded.get("main;t.hl:3"), Some(&2));
+        assert_eq!((p.total, p.func_samples[1], p.calls[0], p.counts[1]), (7, 5, 1, 1));
+        assert_eq!(p.line_stats()[0], (3, 7, 1, 5_000_000, 0));
+    }
+}
@@ -1,9 +1,9 @@
 use anyhow::Result;
 use colored::Colorize;
-use hl_compiler::{compile_to_cache, read_bc_file, HlModule};
+use hl_compiler::{compile_source_with_lines, compile_to_cache, read_bc_file, HlModule, MappedBc, OptLevel};
 use hl_core::{env::Env, Value};
 use crate::interpreter::BytecodeInterpreter;
-use std::path::Path;
+use std::path::{Path, PathBuf};
 
 /// Skrypty powyżej tego progu linii używają AST executor zamiast BC serializacji.
 /// Podniesione z 300 → 2000, żeby duże skrypty jak bit.hl nie miały problemu z wstrzykiwaniem args.
@@ -53,7 +53,7 @@ pub fn run_hl_source(source: &str, source_path: &Path, args: &[String]) -> Resul
     match compile_with_timeout(source, source_path, std::time::Duration::from_secs(30)) {
         Ok(bc_path) => {
             let module = read_bc_file(&bc_path)?;
-            run_bc_module(&module, args)
+            run_bc_module_keyed(&module, args, cache_hash_of(&bc_path))
         }
         Err(e) => {
             tracing::warn!("BC compile failed ({}), fallback do AST executor", e);
@@ -78,10 +78,10 @@ fn run_via_ast(source: &str, _source_path: &Path, args: &[String]) -> Result<i32
         env.set_var(&format!("arg{}", i), Value::String(arg.clone()));
     }
 
-    match run_source(source, &mut env) {
-        Ok(result) => Ok(result.exit_code),
-        Err(e)     => Err(e),
-    }
+    let code = run_source(source, &mut env)?.exit_code;
+    // Skrypt kończy się razem z ostatnią goroutine
+    hl_core::goroutine::wait_all()?;
+    Ok(code)
 }
 
 fn compile_with_timeout(
@@ -89,6 +89,7 @@ fn compile_with_timeout(
     source_path: &Path,
     timeout:     std::time::Duration,
 ) -> Result<std::path::PathBuf> {
+    use std::sync::mpsc::{channel, RecvTimeoutError};
     use std::time::Instant;
 
     let t0 = Instant::now();
@@ -97,22 +98,21 @@ fn compile_with_timeout(
     let source_owned = source.to_string();
     let path_owned   = source_path.to_path_buf();
 
-    let handle = std::thread::spawn(move || {
-        compile_to_cache(&source_owned, &path_owned)
+    // Wątek oddaje wynik przez kanał — trafienie w cache wraca od razu,
+    // bez odpytywania `is_finished()` co 25 ms. Po przekroczeniu limitu
+    // wątek zostaje odłączony (kanał po drugiej stronie już nie istnieje).
+    let (tx, rx) = channel();
+    std::thread::spawn(move || {
+        let _ = tx.send(compile_to_cache(&source_owned, &path_owned));
     });
 
-    let result = loop {
-        if handle.is_finished() {
-            break handle.join()
-                .map_err(|_| anyhow::anyhow!("wątek kompilacji BC spanikował"))?;
-        }
-        if t0.elapsed() > timeout {
-            anyhow::bail!(
-                "Kompilacja BC przekroczyła limit czasu ({:.0}s)",
-                timeout.as_secs_f64()
-            );
-        }
-        std::thread::sleep(std::time::Duration::from_millis(25));
+    let result = match rx.recv_timeout(timeout) {
+        Ok(r) => r,
+        Err(RecvTimeoutError::Timeout) => anyhow::bail!(
+            "Kompilacja BC przekroczyła limit czasu ({:.0}s)",
+            timeout.as_secs_f64()
+        ),
+        Err(RecvTimeoutError::Disconnected) => anyhow::bail!("wątek kompilacji BC spanikował"),
     };
 
     let elapsed = t0.elapsed();
@@ -121,34 +121,158 @@ fn compile_with_timeout(
 }
 
 /// Uruchom plik .bc
+/// Płaski .bc wykonujemy wprost ze zmapowanego pliku, bincode — przez HlModule.
 pub fn run_bc_file(path: &Path, args: &[String]) -> Result<i32> {
-    let module = read_bc_file(path)?;
-    run_bc_module(&module, args)
+    let mapped = MappedBc::open(path)?;
+    if mapped.is_flat() {
+        let fc = mapped.flat()?;
+        // Importy wymagają linkowania — wtedy przez HlModule
+        if imports_libs(&fc) {
+            return run_bc_module_keyed(&fc.to_module()?, args, cache_hash_of(path));
+        }
+        inject_args_to_env(args);
+        let mut interp = BytecodeInterpreter::from_flat(fc)?;
+        if let Some(h) = cache_hash_of(path) { interp.set_module_hash(h); }
+        let exit_code = interp.run();
+        crate::jit_cache::flush_stats();
+        return exit_code;
+    }
+    let module = hl_compiler::serialize::parse_bc_bytes(mapped.bytes(), path)?;
+    run_bc_module_keyed(&module, args, cache_hash_of(path))
 }
 
 /// Uruchom załadowany moduł bytecode przez interpreter + JIT
 pub fn run_bc_module(module: &HlModule, args: &[String]) -> Result<i32> {
+    run_bc_module_keyed(module, args, None)
+}
+
+/// Jak `run_bc_module`, z kluczem trwałego cache JIT
+fn run_bc_module_keyed(module: &HlModule, args: &[String], hash: Option<u64>) -> Result<i32> {
     inject_args_to_env(args);
-    let mut interp = BytecodeInterpreter::new(module);
-    let exit_code = interp.run()?;
-    Ok(exit_code)
+    let linked = crate::libs::link_imports(module, hash)?;
+    let (module, hash) = match &linked {
+        Some((m, h)) => (m, *h),
+        None         => (module, hash),
+    };
+    let mut interp = BytecodeInterpreter::new(module)?;
+    if let Some(h) = hash { interp.set_module_hash(h); }
+    let exit_code = interp.run();
+    crate::jit_cache::flush_stats();
+    exit_code
+}
+
+/// Opcje `hl run --profile`
+#[derive(Debug, Clone)]
+pub struct ProfileOpts {
+    /// Plik folded; None — `<nazwa>.folded` w bieżącym katalogu
+    pub out: Option<PathBuf>,
+    /// Liczba wierszy w tabelach raportu
+    pub top: usize,
+}
+
+/// `hl run --profile`: .hl kompilowany w pamięci z tablicą linii (bez cache),
+/// wykonanie przez interpreter bytecode z profilerem; raport na stderr,
+/// stosy do pliku folded. Płaski .bc i bincode .bc nie mają tablicy linii —
+/// profil ma wtedy tylko funkcje i trasy.
+pub fn run_profiled(path: &Path, args: &[String], opts: &ProfileOpts) -> Result<i32> {
+    if !path.exists() {
+        anyhow::bail!("Plik nie istnieje: {:?}", path);
+    }
+    inject_args_to_env(args);
+    let name = path.file_name().and_then(|n| n.to_str()).unwrap_or("<skrypt>");
+    let out  = opts.out.clone().unwrap_or_else(|| {
+        let stem = path.file_stem().and_then(|s| s.to_str()).unwrap_or("hl");
+        PathBuf::from(format!("{}.folded", stem))
+    });
+
+    if path.extension().and_then(|e| e.to_str()) == Some("bc") {
+        let mapped = MappedBc::open(path)?;
+        if mapped.is_flat() && !imports_libs(&mapped.flat()?) {
+            let interp = BytecodeInterpreter::from_flat(mapped.flat()?)?;
+            return profile_run(interp, name, &[], None, &out, opts.top);
+        }
+        let module = match mapped.is_flat() {
+            true  => mapped.flat()?.to_module()?,
+            false => hl_compiler::serialize::parse_bc_bytes(mapped.bytes(), path)?,
+        };
+        let module = crate::libs::link_imports(&module, None)?.map_or(module, |(m, _)| m);
+        return profile_run(BytecodeInterpreter::new(&module)?, name, &[], None, &out, opts.top);
+    }
+
+    let source = std::fs::read_to_string(path)?;
+    let module = compile_source_with_lines(&source, path, OptLevel::default())?;
+    // Kod skryptu zostaje na swoich offsetach, więc tablica linii dalej pasuje
+    let module = crate::libs::link_imports(&module, None)?.map_or(module, |(m, _)| m);
+    profile_run(BytecodeInterpreter::new(&module)?, name, &module.lines, Some(&source), &out, opts.top)
+}
+
+fn profile_run(
+    mut interp: BytecodeInterpreter<'_>,
+    name:   &str,
+    lines:  &[(u32, u32)],
+    source: Option<&str>,
+    out:    &Path,
+    top:    usize,
+) -> Result<i32> {
+    interp.enable_profiler(name, lines);
+    let exit_code = interp.run();
+    crate::jit_cache::flush_stats();
+    if let Some(mut prof) = interp.take_profiler() {
+        prof.stop();
+        let written = match prof.write_folded(out) {
+            Ok(())  => Some(out),
+            Err(e)  => { eprintln!("{} {}: {}", "[hl profile]".red(), out.display(), e); None }
+        };
+        prof.print_report(top, source, written);
+    }
+    exit_code
+}
+
+/// Czy płaski .bc woła inicjalizację biblioteki (`__lib__<spec>`)
+fn imports_libs(fc: &hl_compiler::FlatBc<'_>) -> bool {
+    (0..fc.string_count() as u32)
+    .filter_map(|i| fc.string(i))
+    .any(|s| s.starts_with(hl_compiler::LIB_INIT_PREFIX))
+}
+
+/// Hash treści zapisany w nazwie pliku z cache .bc (`<hash>.bc`) — ten sam klucz
+/// co w `compile_to_cache`, więc fragmenty JIT trafiają obok swojego .bc
+fn cache_hash_of(bc_path: &Path) -> Option<u64> {
+    if bc_path.parent()? != hl_compiler::cache::cache_dir() { return None; }
+    let stem = bc_path.file_stem()?.to_str()?;
+    if stem.len() != 16 { return None; }
+    u64::from_str_radix(stem, 16).ok()
 }
 
 /// Ustaw zmienne procesu dla BytecodeInterpreter (który czyta std::env::var)
-fn inject_args_to_env(args: &[String]) {
-    std::env::set_var("argc", args.len().to_string());
+pub(crate) fn inject_args_to_env(args: &[String]) {
+    hl_core::spawn::set_env("argc", &args.len().to_string());
     for (i, arg) in args.iter().enumerate() {
-        std::env::set_var(format!("arg{}", i), arg);
+        hl_core::spawn::set_env(&format!("arg{}", i), arg);
     }
 }
 
 /// Wypisz statystyki cache (dla `hl cache-info`)
 pub fn print_cache_stats() {
-    use hl_compiler::cache::{cache_dir, cache_list, CACHE_MAX_FILES};
+    use hl_compiler::cache::{cache_dir, cache_list, cache_stats};
     let dir = cache_dir();
     println!("{}", "=== Cache bytecode ===".bright_cyan().bold());
     println!("  Katalog: {}", dir.display().to_string().bright_white());
-    println!("  Limit:   {} plików .bc", CACHE_MAX_FILES);
+
+    match cache_stats() {
+        Ok(s) => {
+            println!("  Budżet:  {} KB z {} KB ({} wpisów)",
+                     (s.bytes / 1024).to_string().bright_yellow(),
+                     s.budget / 1024,
+                     s.entries.to_string().bright_white());
+            println!("  Trafienia: {}  Chybienia: {}  ({:.1}%)  Usunięte: {}",
+                     s.hits.to_string().bright_green(),
+                     s.misses.to_string().bright_red(),
+                     s.hit_rate(),
+                     s.evictions);
+        }
+        Err(e) => eprintln!("  Błąd odczytu indeksu cache: {}", e),
+    }
     println!();
 
     match cache_list() {
@@ -162,6 +286,8 @@ pub fn print_cache_stats() {
             println!("  Rozmiar łączny: {} KB",
                      (total_size / 1024).to_string().bright_yellow());
             println!();
+            print_jit_cache_stats();
+            println!();
             for entry in entries.iter().take(10) {
                 let name = entry.path.file_name()
                 .and_then(|n| n.to_str())
@@ -177,3 +303,21 @@ pub fn print_cache_stats() {
         Err(e) => eprintln!("  Błąd odczytu cache: {}", e),
     }
 }
+
+/// Sekcja „JIT" w `hl cache-info`: fragmenty kodu maszynowego + trafienia
+fn print_jit_cache_stats() {
+    let dir = hl_compiler::cache::cache_dir();
+    let (count, size) = std::fs::read_dir(&dir).map(|rd| {
+        rd.flatten()
+        .filter(|e| e.path().extension().and_then(|x| x.to_str()) == Some("jit"))
+        .fold((0usize, 0u64), |(c, s), e| (c + 1, s + e.metadata().map(|m| m.len()).unwrap_or(0)))
+    }).unwrap_or((0, 0));
+    let stats = crate::jit_cache::read_stats();
+    println!("  {}", "JIT (kod maszynowy):".bright_cyan());
+    println!("    Fragmenty: {} ({} KB)", count.to_string().bright_white(),
+             (size / 1024).to_string().bright_yellow());
+    println!("    Trafienia: {}  Chybienia: {}  ({:.1}%)",
+             stats.hits.to_string().bright_green(),
+             stats.misses.to_string().bright_red(),
+             stats.hit_rate());
+}
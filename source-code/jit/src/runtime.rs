@@ -1,17 +1,40 @@
 use rustc_hash::FxHashMap;
+use std::rc::Rc;
+use hl_core::arena::{ArenaContext, ArenaStats, ArenaStr};
 
 // ── NaN-boxing ────────────────────────────────────────────────────────────────
 
-const NAN_BASE:      u64 = 0x7FF8_0000_0000_0000;
-const TAG_MASK:      u64 = 0x0000_0000_0000_FFFF;
-const PAYLOAD_SHIFT: u32 = 16;
+pub(crate) const NAN_BASE:      u64 = 0x7FF8_0000_0000_0000;
+pub(crate) const TAG_MASK:      u64 = 0x0000_0000_0000_FFFF;
+pub(crate) const PAYLOAD_SHIFT: u32 = 16;
 
 const TAG_NIL:  u64 = 0x0000;
 const TAG_BOOL: u64 = 0x0001;
-const TAG_STR:  u64 = 0x0002;
-const TAG_INT:  u64 = 0x0003;
+pub(crate) const TAG_STR:  u64 = 0x0002;
+pub(crate) const TAG_INT:  u64 = 0x0003;
+/// Krótki string w samej wartości. Tag zajmuje tylko młodszy bajt:
+/// bity 8..10 = długość (1..=5), bity 11..50 = bajty treści
+pub(crate) const TAG_SSO:  u64 = 0x04;
+pub(crate) const SSO_TAG_MASK: u64 = 0xFF;
+/// String z odzyskiwalnej sterty internera (payload = slot)
+const TAG_HEAP: u64 = 0x0005;
+/// String w arenie aktywnego wywołania `:: nazwa` (payload = idx w `spans`)
+const TAG_ARENA: u64 = 0x0006;
+
+/// Najdłuższy string trzymany w `NanVal` bez alokacji
+pub const SSO_MAX: usize = 5;
 
 /// Wartość jako NaN-boxed u64 — 8 bajtów, zero alokacji dla liczb/boolów/intów
+///
+/// Stringi mają trzy postaci:
+/// - `TAG_STR` — internowane (stałe programu, nazwy); deduplikowane, więc
+///   równe idx ⇔ równa treść. Nigdy nie są zwalniane.
+/// - `TAG_SSO` — 1..=5 bajtów w samej wartości. Każdy tak krótki string ma
+///   tę postać (także stałe), więc równość to równość bitów.
+/// - `TAG_HEAP` — dłuższe stringi budowane w czasie wykonania (Concat,
+///   wyjście komend, słowa for-in); slot zwalnia `RuntimeState::collect_strings`.
+/// - `TAG_ARENA` — jak `TAG_HEAP`, ale zbudowane wewnątrz arena function;
+///   region zwalnia `RuntimeState::arena_leave`, kopiując to, co ucieka.
 #[derive(Clone, Copy)]
 #[repr(transparent)]
 pub struct NanVal(pub u64);
@@ -35,6 +58,8 @@ impl NanVal {
         }
     }
 
+    /// Surowy idx internera. Stałe zamieniaj przez `StringInterner::interned_val`,
+    /// które daje formę kanoniczną (SSO dla krótkich).
     #[inline(always)]
     pub fn str_interned(idx: u32) -> Self {
         NanVal(NAN_BASE | TAG_STR | ((idx as u64) << PAYLOAD_SHIFT))
@@ -45,6 +70,25 @@ impl NanVal {
         NanVal(NAN_BASE | TAG_INT | ((n as u32 as u64) << PAYLOAD_SHIFT))
     }
 
+    /// String 1..=5 bajtów zapisany w wartości; None dla pustego i dłuższych
+    #[inline]
+    pub fn sso(s: &str) -> Option<Self> {
+        let b = s.as_bytes();
+        if b.is_empty() || b.len() > SSO_MAX { return None; }
+        let bits = b.iter().enumerate().fold(0u64, |acc, (i, &c)| acc | (c as u64) << (8 * i));
+        Some(NanVal(NAN_BASE | TAG_SSO | ((b.len() as u64) << 8) | (bits << 11)))
+    }
+
+    #[inline(always)]
+    fn heap(slot: u32) -> Self {
+        NanVal(NAN_BASE | TAG_HEAP | ((slot as u64) << PAYLOAD_SHIFT))
+    }
+
+    #[inline(always)]
+    fn arena(idx: u32) -> Self {
+        NanVal(NAN_BASE | TAG_ARENA | ((idx as u64) << PAYLOAD_SHIFT))
+    }
+
     #[inline(always)] fn is_nan_tagged(&self) -> bool { (self.0 & NAN_BASE) == NAN_BASE }
     #[inline(always)] fn tag(&self) -> u64             { self.0 & TAG_MASK }
     #[inline(always)] fn payload(&self) -> u64         { (self.0 >> PAYLOAD_SHIFT) & 0xFFFF_FFFF }
@@ -52,8 +96,19 @@ impl NanVal {
     #[inline(always)] pub fn is_nil(&self)  -> bool { self.is_nan_tagged() && self.tag() == TAG_NIL }
     #[inline(always)] pub fn is_bool(&self) -> bool { self.is_nan_tagged() && self.tag() == TAG_BOOL }
     #[inline(always)] pub fn is_num(&self)  -> bool { !self.is_nan_tagged() }
-    #[inline(always)] pub fn is_str(&self)  -> bool { self.is_nan_tagged() && self.tag() == TAG_STR }
     #[inline(always)] pub fn is_int(&self)  -> bool { self.is_nan_tagged() && self.tag() == TAG_INT }
+    #[inline(always)] pub fn is_interned(&self) -> bool { self.is_nan_tagged() && self.tag() == TAG_STR }
+    #[inline(always)] pub fn is_sso(&self)  -> bool { self.is_nan_tagged() && (self.0 & SSO_TAG_MASK) == TAG_SSO }
+    #[inline(always)] pub fn is_heap(&self) -> bool { self.is_nan_tagged() && self.tag() == TAG_HEAP }
+    #[inline(always)] pub fn is_arena(&self) -> bool { self.is_nan_tagged() && self.tag() == TAG_ARENA }
+    /// String w dowolnej postaci
+    #[inline(always)] pub fn is_str(&self)  -> bool { self.is_interned() || self.is_sso() || self.is_heap() || self.is_arena() }
+
+    /// Wartość `TAG_INT` (licznik pętli zakresu); None dla innych postaci
+    #[inline(always)]
+    pub fn as_int(&self) -> Option<i32> {
+        if self.is_int() { Some(self.payload() as i32) } else { None }
+    }
 
     #[inline(always)]
     pub fn as_f64(&self) -> f64 {
@@ -63,9 +118,26 @@ impl NanVal {
         0.0
     }
 
+    /// Idx internera — tylko dla postaci `TAG_STR`
     #[inline(always)]
     pub fn as_str_idx(&self) -> Option<u32> {
-        if self.is_str() { Some(self.payload() as u32) } else { None }
+        if self.is_interned() { Some(self.payload() as u32) } else { None }
+    }
+
+    /// Treść stringa bez kopiowania; None dla wartości, które nie są stringami
+    #[inline]
+    pub fn text<'i>(&self, interner: &'i StringInterner) -> Option<StrRef<'i>> {
+        if self.is_interned() { return Some(StrRef::Shared(interner.get(self.payload() as u32))); }
+        if self.is_heap()     { return Some(StrRef::Shared(interner.heap_get(self.payload() as u32))); }
+        if self.is_arena()    { return Some(StrRef::Shared(interner.arena_get(self.payload() as u32))); }
+        if self.is_sso() {
+            let len  = ((self.0 >> 8) & 0x7) as usize;
+            let bits = self.0 >> 11;
+            let mut b = [0u8; SSO_MAX];
+            for (i, c) in b.iter_mut().enumerate().take(len) { *c = (bits >> (8 * i)) as u8; }
+            return Some(StrRef::Inline(b, len as u8));
+        }
+        None
     }
 
     /// Truthy check — zgodny z HL semantyką
@@ -75,11 +147,10 @@ impl NanVal {
         if self.is_bool() { return self.payload() != 0; }
         if self.is_num()  { return self.as_f64() != 0.0; }
         if self.is_int()  { return self.payload() != 0; }
-        if self.is_str()  {
-            let s = interner.get(self.payload() as u32);
-            return !s.is_empty() && s != "false" && s != "0";
+        match self.text(interner) {
+            Some(s) => !s.is_empty() && &*s != "false" && &*s != "0",
+            None    => false,
         }
-        false
     }
 
     /// Konwertuj do String
@@ -95,18 +166,32 @@ impl NanVal {
             };
         }
         if self.is_int()  { return format!("{}", self.payload() as i32); }
-        if self.is_str()  { return interner.get(self.payload() as u32).to_string(); }
-        String::new()
+        self.text(interner).map(|s| s.to_string()).unwrap_or_default()
     }
 
-    /// Równość — fast path dla stringów przez idx
+    /// Dopisz tekstową postać do bufora — bez pośredniego String dla stringów
+    #[inline]
+    pub fn append_to(&self, interner: &StringInterner, buf: &mut String) {
+        if let Some(s) = self.text(interner) {
+            buf.push_str(&s);
+        } else if self.is_num() || self.is_int() || self.is_bool() {
+            buf.push_str(&self.to_str_val(interner));
+        }
+    }
+
+    /// Równość — fast path dla stringów kanonicznych (STR/SSO) przez bity
     #[inline]
     pub fn eq_val(&self, other: &NanVal, interner: &StringInterner) -> bool {
-        if self.is_num() && other.is_num() {
+        let numeric = |v: &NanVal| v.is_num() || v.is_int();
+        if numeric(self) && numeric(other) {
             return self.as_f64() == other.as_f64();
         }
-        if self.is_str() && other.is_str() {
-            return self.payload() == other.payload(); // u32 porównanie!
+        let canon = |v: &NanVal| v.is_interned() || v.is_sso();
+        if canon(self) && canon(other) {
+            return self.0 == other.0;
+        }
+        if let (Some(a), Some(b)) = (self.text(interner), other.text(interner)) {
+            return *a == *b;
         }
         self.to_str_val(interner) == other.to_str_val(interner)
     }
@@ -118,18 +203,62 @@ impl std::fmt::Debug for NanVal {
         else if self.is_bool() { write!(f, "Bool({})", self.payload() != 0) }
         else if self.is_num()  { write!(f, "Num({})", self.as_f64()) }
         else if self.is_int()  { write!(f, "Int({})", self.payload() as i32) }
-        else if self.is_str()  { write!(f, "Str(idx={})", self.payload()) }
+        else if self.is_interned() { write!(f, "Str(idx={})", self.payload()) }
+        else if self.is_heap() { write!(f, "Heap(slot={})", self.payload()) }
+        else if self.is_sso()  { write!(f, "Sso(0x{:016x})", self.0) }
         else { write!(f, "NanVal(0x{:016x})", self.0) }
     }
 }
 
+/// Pożyczona treść stringowej `NanVal` — SSO odtwarza bajty na stosie
+pub enum StrRef<'i> {
+    Shared(&'i str),
+    Inline([u8; SSO_MAX], u8),
+}
+
+impl std::ops::Deref for StrRef<'_> {
+    type Target = str;
+    #[inline]
+    fn deref(&self) -> &str {
+        match self {
+            StrRef::Shared(s)      => s,
+            StrRef::Inline(b, len) => std::str::from_utf8(&b[..*len as usize]).unwrap_or(""),
+        }
+    }
+}
+
 // ── String Interner ───────────────────────────────────────────────────────────
 
-/// Interner stringów: String → u32 idx, Vec<String> dla lookup przez idx
-/// Porównanie stringów = porównanie u32 — eliminuje strcmp w hot paths
+/// Najmniejszy próg zbierania sterty stringów (liczba żywych slotów)
+const STR_GC_MIN: usize = 4096;
+
+/// Interner stringów: String → u32 idx, Vec dla lookup przez idx
+/// Porównanie stringów = porównanie u32 — eliminuje strcmp w hot paths.
+/// Treść jest alokowana raz (`Rc<str>` współdzielony przez mapę i tablicę).
+///
+/// Obok internera leży sterta stringów czasu wykonania: sloty z listą
+/// wolnych, zwalniane przez mark & sweep w bezpiecznych punktach.
 pub struct StringInterner {
-    map:     FxHashMap<String, u32>,
-    pub strings: Vec<String>,
+    map:     FxHashMap<Rc<str>, u32>,
+    strings: Vec<Rc<str>>,
+    heap:    Vec<Option<Box<str>>>,
+    free:    Vec<u32>,
+    marks:   Vec<bool>,
+    live:    usize,
+    next_gc: usize,
+    /// Stringi w arenach aktywnych wywołań (idx = payload `TAG_ARENA`)
+    spans:   Vec<ArenaStr>,
+    /// Stos regionów — zagnieżdżone wywołania arena functions
+    regions: Vec<ArenaRegion>,
+    /// Suma długości stringów w `strings` (metryki)
+    bytes:   usize,
+}
+
+/// Region jednego wywołania arena function
+struct ArenaRegion {
+    ctx:  ArenaContext,
+    /// `spans.len()` przy wejściu — wszystko od tego idx należy do regionu
+    base: usize,
 }
 
 impl StringInterner {
@@ -137,6 +266,14 @@ impl StringInterner {
         let mut s = Self {
             map:     FxHashMap::default(),
             strings: Vec::with_capacity(512),
+            heap:    Vec::new(),
+            free:    Vec::new(),
+            marks:   Vec::new(),
+            live:    0,
+            next_gc: STR_GC_MIN,
+            spans:   Vec::new(),
+            regions: Vec::new(),
+            bytes:   0,
         };
         // Idx 0 = pusty string
         s.intern("");
@@ -154,16 +291,18 @@ impl StringInterner {
     #[inline]
     pub fn intern(&mut self, s: &str) -> u32 {
         if let Some(&idx) = self.map.get(s) { return idx; }
-        let idx = self.strings.len() as u32;
-        self.strings.push(s.to_string());
-        self.map.insert(s.to_string(), idx);
-        idx
+        self.insert(Rc::from(s))
     }
 
     #[inline]
     pub fn intern_owned(&mut self, s: String) -> u32 {
-        if let Some(&idx) = self.map.get(&s) { return idx; }
+        if let Some(&idx) = self.map.get(s.as_str()) { return idx; }
+        self.insert(Rc::from(s))
+    }
+
+    fn insert(&mut self, s: Rc<str>) -> u32 {
         let idx = self.strings.len() as u32;
+        self.bytes += s.len();
         self.map.insert(s.clone(), idx);
         self.strings.push(s);
         idx
@@ -171,11 +310,118 @@ impl StringInterner {
 
     #[inline(always)]
     pub fn get(&self, idx: u32) -> &str {
-        self.strings.get(idx as usize).map(|s| s.as_str()).unwrap_or("")
+        self.strings.get(idx as usize).map(|s| &**s).unwrap_or("")
     }
 
     #[inline]
     pub fn lookup(&self, s: &str) -> Option<u32> { self.map.get(s).copied() }
+
+    /// Liczba zinternowanych stringów
+    pub fn len(&self) -> usize { self.strings.len() }
+
+    /// Bajty zinternowanych stringów (bez narzutu mapy)
+    pub fn bytes(&self) -> usize { self.bytes }
+
+    /// Wartość stałej o idx internera — SSO dla krótkich, żeby porównania
+    /// z wartościami czasu wykonania zostały porównaniem bitów
+    #[inline]
+    pub fn interned_val(&self, idx: u32) -> NanVal {
+        NanVal::sso(self.get(idx)).unwrap_or(NanVal::str_interned(idx))
+    }
+
+    // ── Sterta stringów czasu wykonania ───────────────────────────────────────
+
+    /// Nowy string czasu wykonania: pusty → idx 0, krótki → SSO, reszta →
+    /// arena bieżącego wywołania `:: nazwa` albo sterta
+    #[inline]
+    pub fn new_val(&mut self, s: &str) -> NanVal {
+        if s.is_empty() { return NanVal::str_interned(0); }
+        if let Some(v) = NanVal::sso(s) { return v; }
+        if let Some(v) = self.arena_alloc(s) { return v; }
+        self.heap_alloc(Box::from(s))
+    }
+
+    #[inline]
+    pub fn new_val_owned(&mut self, s: String) -> NanVal {
+        if s.len() <= SSO_MAX { return self.new_val(&s); }
+        if let Some(v) = self.arena_alloc(&s) { return v; }
+        self.heap_alloc(s.into_boxed_str())
+    }
+
+    fn heap_alloc(&mut self, s: Box<str>) -> NanVal {
+        self.live += 1;
+        match self.free.pop() {
+            Some(slot) => {
+                self.heap[slot as usize] = Some(s);
+                NanVal::heap(slot)
+            }
+            None => {
+                self.heap.push(Some(s));
+                NanVal::heap(self.heap.len() as u32 - 1)
+            }
+        }
+    }
+
+    #[inline(always)]
+    pub fn heap_get(&self, slot: u32) -> &str {
+        self.heap.get(slot as usize).and_then(|s| s.as_deref()).unwrap_or("")
+    }
+
+    // ── Regiony arena functions ──────────────────────────────────────────────
+
+    /// Wejdź do regionu o `size` bajtach — blok z puli wątku (hl_core::arena)
+    pub fn arena_enter(&mut self, size: usize) {
+        let base = self.spans.len();
+        self.regions.push(ArenaRegion { ctx: ArenaContext::new(size), base });
+    }
+
+    /// Pełna arena → None, string idzie na stertę
+    #[inline]
+    fn arena_alloc(&mut self, s: &str) -> Option<NanVal> {
+        let a = self.regions.last_mut()?.ctx.alloc_string(s)?;
+        self.spans.push(a);
+        Some(NanVal::arena(self.spans.len() as u32 - 1))
+    }
+
+    #[inline(always)]
+    pub fn arena_get(&self, idx: u32) -> &str {
+        self.spans.get(idx as usize).map(|a| a.as_str()).unwrap_or("")
+    }
+
+    /// Żywe (niezwolnione) stringi na stercie
+    pub fn heap_live(&self) -> usize { self.live }
+
+    /// Sterta urosła od ostatniego zbierania na tyle, że warto zbierać
+    #[inline(always)]
+    pub fn wants_gc(&self) -> bool { self.live >= self.next_gc }
+
+    /// Adresy `live` i `next_gc` — trasy JIT sprawdzają nimi `wants_gc`
+    /// na skoku wstecznym. Ważne, dopóki interner się nie przeniesie.
+    pub(crate) fn gc_counters(&self) -> (*const usize, *const usize) {
+        (&self.live, &self.next_gc)
+    }
+
+    /// Mark & sweep: zostają sloty osiągalne z `roots`. Wywołujący gwarantuje,
+    /// że żadna wartość poza `roots` nie wskazuje na stertę.
+    pub fn collect(&mut self, roots: impl Iterator<Item = NanVal>) {
+        self.marks.clear();
+        self.marks.resize(self.heap.len(), false);
+        for v in roots {
+            if v.is_heap() {
+                if let Some(m) = self.marks.get_mut(v.payload() as usize) { *m = true; }
+            }
+        }
+        let before = self.live;
+        for (i, slot) in self.heap.iter_mut().enumerate() {
+            if slot.is_some() && !self.marks[i] {
+                *slot = None;
+                self.free.push(i as u32);
+                self.live -= 1;
+            }
+        }
+        self.next_gc = (self.live * 2).max(STR_GC_MIN);
+        tracing::debug!("[jit gc] stringi: {} → {} żywych", before, self.live);
+    }
 }
 
 impl Default for StringInterner { fn default() -> Self { Self::new() } }
@@ -219,6 +465,43 @@ impl VarCache {
 
 // ── RuntimeState ─────────────────────────────────────────────────────────────
 
+/// Stan pętli for-in
+pub enum ForIter {
+    /// Gotowy string dzielony leniwie: `src` jest korzeniem GC (i jest
+    /// przenoszony z areny jak rejestr), `pos` — bajt, od którego szukamy
+    /// następnego słowa/linii. Element powstaje dopiero w ForInNext.
+    Text { src: NanVal, pos: usize, lines: bool },
+    /// Wyjście komendy czytane w tle (`@ x in >> cmd`)
+    Stream { out: hl_core::spawn::OutputStream, lines: bool },
+}
+
+/// Następny element `text` od bajtu `pos`: (początek, koniec, nowe `pos`).
+/// Słowa dzieli `char::is_whitespace` (jak `split_whitespace`), linie — `\n`
+/// z obciętym `\r` (jak `str::lines`).
+fn next_span(text: &str, pos: usize, lines: bool) -> Option<(usize, usize, usize)> {
+    let rest = text.get(pos..).filter(|r| !r.is_empty())?;
+    if lines {
+        let (len, skip) = match rest.find('\n') {
+            Some(n) => (n, n + 1),
+            None    => (rest.len(), rest.len()),
+        };
+        let end = pos + if rest[..len].ends_with('\r') { len - 1 } else { len };
+        return Some((pos, end, pos + skip));
+    }
+    let word = rest.trim_start();
+    if word.is_empty() { return None; }
+    let start = pos + rest.len() - word.len();
+    let end   = start + word.find(char::is_whitespace).unwrap_or(word.len());
+    Some((start, end, end))
+}
+
+/// Zmienna przenoszona do stanu innej goroutine. Idx internera są lokalne
+/// dla `RuntimeState`, więc stringi przechodzą jako treść.
+pub enum VarSnap {
+    Val(NanVal),
+    Str(String),
+}
+
 pub struct RuntimeState {
     /// Rejestry: 8 B/rejestr (NaN-boxed)
     pub regs:      Vec<NanVal>,
@@ -226,6 +509,10 @@ pub struct RuntimeState {
     pub vars_flat: Vec<NanVal>,
     /// name_idx → slot mapping
     pub var_slots: FxHashMap<u32, u32>,
+    /// Sloty przydzielone kiedykolwiek: `vars_flat[..slots_used]` to korzenie GC
+    slots_used: u32,
+    /// Sloty zwolnione przez `::unset` — do ponownego przydziału
+    free_slots: Vec<u32>,
     /// Inline cache: name_idx → slot
     pub var_cache: VarCache,
     /// String interner
@@ -234,8 +521,8 @@ pub struct RuntimeState {
     pub last_exit: i32,
     /// Głębokość wywołań
     pub call_depth: u32,
-    /// Iterator state: iter_reg → (interned word idxs, current pos)
-    pub iters: FxHashMap<u32, (Vec<u32>, usize)>,
+    /// Iteratory for-in: slot na rejestr (indeks = iter_reg), bez haszowania
+    pub iters: Vec<Option<ForIter>>,
 }
 
 const MAX_CALL_DEPTH: u32 = 512;
@@ -246,11 +533,13 @@ impl RuntimeState {
             regs:      vec![NanVal::nil(); num_regs.max(64)],
             vars_flat: vec![NanVal::nil(); 128],
             var_slots: FxHashMap::default(),
+            slots_used: 0,
+            free_slots: Vec::new(),
             var_cache: VarCache::new(256),
             interner:  StringInterner::new(),
             last_exit: 0,
             call_depth: 0,
-            iters:     FxHashMap::default(),
+            iters:     Vec::new(),
         }
     }
 
@@ -281,8 +570,7 @@ impl RuntimeState {
         // 3. Fallback: std::env
         let name = self.interner.get(name_idx).to_string();
         if let Ok(val) = std::env::var(&name) {
-            let idx = self.interner.intern_owned(val);
-            return NanVal::str_interned(idx);
+            return self.interner.new_val_owned(val);
         }
         NanVal::nil()
     }
@@ -301,8 +589,12 @@ impl RuntimeState {
             self.vars_flat[slot as usize] = val;
             return;
         }
-        // Nowy slot
-        let slot = self.var_slots.len() as u32;
+        // Nowy slot: zwolniony albo następny za ostatnim przydzielonym
+        // (nie `var_slots.len()` — po `::unset` wskazałby slot żywej zmiennej)
+        let slot = self.free_slots.pop().unwrap_or_else(|| {
+            self.slots_used += 1;
+            self.slots_used - 1
+        });
         let i    = slot as usize;
         if i >= self.vars_flat.len() { self.vars_flat.resize(i + 64, NanVal::nil()); }
         self.vars_flat[i] = val;
@@ -310,26 +602,171 @@ impl RuntimeState {
         self.var_cache.set(name_idx, slot);
     }
 
+    /// Slot zmiennej dla kodu natywnego, który czyta i pisze `vars_flat`
+    /// bezpośrednio. None — zmienna nieprzypisana (odczyt idzie do std::env).
+    pub fn var_slot(&self, name_idx: u32) -> Option<u32> {
+        self.var_slots.get(&name_idx).copied()
+    }
+
+    /// `::unset`: nazwa znika, slot wraca do puli. Wartość zerujemy, żeby
+    /// wolny slot nie trzymał stringu przy życiu.
+    pub fn unset_var(&mut self, name_idx: u32) {
+        self.var_cache.invalidate(name_idx);
+        if let Some(slot) = self.var_slots.remove(&name_idx) {
+            self.vars_flat[slot as usize] = NanVal::nil();
+            self.free_slots.push(slot);
+        }
+    }
+
     /// Export do std::env
     pub fn export_var(&mut self, name_idx: u32, val: NanVal) {
         let name    = self.interner.get(name_idx).to_string();
         let val_str = val.to_str_val(&self.interner);
-        std::env::set_var(&name, &val_str);
+        hl_core::spawn::set_env(&name, &val_str);
         self.set_var(name_idx, val);
     }
 
+    /// Kopia zmiennych dla goroutine: `names` = idx w internerze
+    /// (None — wszystkie zmienne)
+    pub fn snapshot_vars(&self, names: Option<&[u32]>) -> Vec<(String, VarSnap)> {
+        let snap = |name_idx: u32, slot: u32| {
+            let val = self.vars_flat[slot as usize];
+            // SSO niesie treść w bitach — tylko STR/sterta zależą od internera
+            let v = match val.text(&self.interner) {
+                Some(t) if !val.is_sso() => VarSnap::Str(t.to_string()),
+                _                        => VarSnap::Val(val),
+            };
+            (self.interner.get(name_idx).to_string(), v)
+        };
+        match names {
+            Some(names) => names.iter()
+                .filter_map(|&n| self.var_slots.get(&n).map(|&slot| snap(n, slot)))
+                .collect(),
+            None => self.var_slots.iter().map(|(&n, &slot)| snap(n, slot)).collect(),
+        }
+    }
+
+    pub fn restore_vars(&mut self, vars: Vec<(String, VarSnap)>) {
+        for (name, v) in vars {
+            let k = self.interner.intern_owned(name);
+            let val = match v {
+                VarSnap::Val(val) => val,
+                VarSnap::Str(s)   => self.new_str_owned(s),
+            };
+            self.set_var(k, val);
+        }
+    }
+
     pub fn val_to_str(&self, val: NanVal) -> String { val.to_str_val(&self.interner) }
 
+    /// String trwały (internowany) — stałe i wartości startowe
     #[inline]
     pub fn intern_str(&mut self, s: &str) -> NanVal {
         let idx = self.interner.intern(s);
-        NanVal::str_interned(idx)
+        self.interner.interned_val(idx)
     }
 
+    /// String czasu wykonania — SSO albo odzyskiwalna sterta
     #[inline]
-    pub fn intern_str_owned(&mut self, s: String) -> NanVal {
-        let idx = self.interner.intern_owned(s);
-        NanVal::str_interned(idx)
+    pub fn new_str(&mut self, s: &str) -> NanVal { self.interner.new_val(s) }
+
+    #[inline]
+    pub fn new_str_owned(&mut self, s: String) -> NanVal { self.interner.new_val_owned(s) }
+
+    /// Bezpieczny punkt (skok wsteczny interpretera): zbierz stertę stringów,
+    /// jeśli urosła. Korzenie to rejestry, zmienne i iteratory for-in — poza
+    /// nimi interpreter nie trzyma wartości między instrukcjami.
+    #[inline(always)]
+    pub fn maybe_collect_strings(&mut self) {
+        if self.interner.wants_gc() { self.collect_strings(); }
+    }
+
+    #[cold]
+    pub fn collect_strings(&mut self) {
+        // Wszystkie przydzielone sloty — po `::unset` żywe mogą leżeć za `var_slots.len()`
+        let used = self.slots_used as usize;
+        let srcs = self.iters.iter().flatten().filter_map(|it| match it {
+            ForIter::Text { src, .. } => Some(*src),
+            ForIter::Stream { .. }    => None,
+        });
+        let roots = self.regs.iter().chain(&self.vars_flat[..used]).copied().chain(srcs);
+        self.interner.collect(roots);
+    }
+
+    /// Wyjście z regionu arena function: stringi regionu osiągalne z rejestrów,
+    /// zmiennych i iteratorów (te same korzenie co `collect_strings`) są
+    /// kopiowane poziom wyżej (arena wywołującego albo sterta), a region
+    /// zwalnia jeden `reset()`. None poza regionem.
+    pub fn arena_leave(&mut self) -> Option<ArenaStats> {
+        let mut region = self.interner.regions.pop()?;
+        let base = region.base;
+        let used = self.slots_used as usize;
+        let interner = &mut self.interner;
+        let mut escaped = 0;
+        let mut lift = |v: &mut NanVal| {
+            if v.is_arena() && v.payload() as usize >= base {
+                let a = interner.spans[v.payload() as usize];
+                escaped += a.as_str().len();
+                *v = interner.new_val(a.as_str());
+            }
+        };
+        self.regs.iter_mut().for_each(&mut lift);
+        self.vars_flat[..used].iter_mut().for_each(&mut lift);
+        for it in self.iters.iter_mut().flatten() {
+            if let ForIter::Text { src, .. } = it { lift(src); }
+        }
+        self.interner.spans.truncate(base);
+        region.ctx.note_escape(escaped);
+        Some(region.ctx.stats())
+    }
+
+    /// Załóż iterator for-in w slocie rejestru `reg`
+    pub fn iter_start(&mut self, reg: u32, it: ForIter) {
+        let i = reg as usize;
+        if i >= self.iters.len() { self.iters.resize_with(i + 1, || None); }
+        self.iters[i] = Some(it);
+    }
+
+    #[inline]
+    pub fn iter_get(&self, reg: u32) -> Option<&ForIter> {
+        self.iters.get(reg as usize)?.as_ref()
+    }
+
+    /// Następny element iteratora z `reg`. Err(Some(ec)) — strumień komendy
+    /// wyczerpany z kodem wyjścia `ec`; Err(None) — koniec stringa albo brak
+    /// iteratora. Po Err slot jest pusty.
+    pub fn iter_next(&mut self, reg: u32) -> Result<NanVal, Option<i32>> {
+        let slot = self.iters.get_mut(reg as usize).ok_or(None)?;
+        let next = match slot.as_mut() {
+            Some(ForIter::Text { src, pos, lines }) => {
+                let text = src.text(&self.interner);
+                match text.as_deref().and_then(|t| next_span(t, *pos, *lines)) {
+                    Some((start, end, next)) => {
+                        *pos = next;
+                        let t = text.as_deref().unwrap_or("");
+                        // Krótkie elementy (SSO) bez alokacji, dłuższe — jedna kopia
+                        Ok(match NanVal::sso(&t[start..end]) {
+                            Some(v) => v,
+                            None    => {
+                                let owned = t[start..end].to_owned();
+                                self.interner.new_val_owned(owned)
+                            }
+                        })
+                    }
+                    None => Err(None),
+                }
+            }
+            Some(ForIter::Stream { out, lines }) => {
+                let item = if *lines { out.next_line() } else { out.next_word() };
+                match item {
+                    Some(w) => Ok(self.interner.new_val_owned(w)),
+                    None    => Err(Some(out.exit_code().unwrap_or(1))),
+                }
+            }
+            None => Err(None),
+        };
+        if next.is_err() { *slot = None; }
+        next
     }
 
     pub fn check_call_depth(&self) -> anyhow::Result<()> {
@@ -339,3 +776,112 @@ impl RuntimeState {
         Ok(())
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_short_strings_are_inline_and_canonical() {
+        let mut st = RuntimeState::new(4);
+        let lit  = st.intern_str("ok");
+        let made = st.new_str_owned(String::from("ok"));
+        assert!(lit.is_sso() && made.is_sso());
+        assert_eq!(lit.0, made.0);
+        assert_eq!(made.to_str_val(&st.interner), "ok");
+        assert!(!st.new_str("false").is_truthy(&st.interner));
+        assert!(st.new_str("").as_str_idx() == Some(0));
+    }
+
+    #[test]
+    fn test_heap_and_interned_compare_by_content() {
+        let mut st = RuntimeState::new(4);
+        let lit  = st.intern_str("dłuższy napis");
+        let made = st.new_str("dłuższy napis");
+        assert!(lit.is_interned() && made.is_heap());
+        assert!(lit.eq_val(&made, &st.interner));
+        assert!(!made.eq_val(&st.new_str("inny napis"), &st.interner));
+    }
+
+    #[test]
+    fn test_collect_frees_unreachable_heap_strings() {
+        let mut st = RuntimeState::new(4);
+        let keep = st.new_str("trzymany w rejestrze");
+        st.set_reg(0, keep);
+        let k = st.interner.intern("zmienna");
+        let var = st.new_str("trzymany w zmiennej");
+        st.set_var(k, var);
+        for i in 0..100 { st.new_str_owned(format!("tymczasowy {}", i)); }
+        assert_eq!(st.interner.heap_live(), 102);
+        st.collect_strings();
+        assert_eq!(st.interner.heap_live(), 2);
+        assert_eq!(st.get_reg(0).to_str_val(&st.interner), "trzymany w rejestrze");
+        assert_eq!(st.get_var(k).to_str_val(&st.interner), "trzymany w zmiennej");
+        // Zwolnione sloty idą do ponownego użycia
+        let slots = st.interner.heap.len();
+        st.new_str("kolejny długi napis");
+        assert_eq!(st.interner.heap.len(), slots);
+    }
+
+    #[test]
+    fn test_arena_region_copies_out_only_escaping_strings() {
+        let mut st = RuntimeState::new(4);
+        let k = st.interner.intern("wynik");
+        st.interner.arena_enter(4096);
+        for i in 0..50 { st.new_str_owned(format!("tymczasowy {}", i)); }
+        let out = st.new_str("zostaje po powrocie");
+        assert!(out.is_arena());
+        st.set_var(k, out);
+        assert_eq!(st.interner.heap_live(), 0);
+
+        let stats = st.arena_leave().unwrap();
+        assert_eq!(stats.escaped, "zostaje po powrocie".len());
+        assert_eq!(st.interner.heap_live(), 1);
+        let v = st.get_var(k);
+        assert!(v.is_heap());
+        assert_eq!(v.to_str_val(&st.interner), "zostaje po powrocie");
+        assert!(st.arena_leave().is_none());
+    }
+
+    #[test]
+    fn test_unset_keeps_higher_slot_rooted_and_reuses_freed_one() {
+        let mut st = RuntimeState::new(4);
+        let (a, b, c) = (st.interner.intern("a"), st.interner.intern("b"), st.interner.intern("c"));
+        let va = st.new_str("pierwsza zmienna na stercie");
+        st.set_var(a, va);
+        let vb = st.new_str("druga zmienna na stercie");
+        st.set_var(b, vb);
+        st.unset_var(a);
+        for i in 0..100 { st.new_str_owned(format!("tymczasowy {}", i)); }
+
+        // GC na skoku wstecznym: "b" leży w slocie 1, za var_slots.len() == 1
+        st.collect_strings();
+        assert_eq!(st.interner.heap_live(), 1);
+        assert_eq!(st.get_var(b).to_str_val(&st.interner), "druga zmienna na stercie");
+
+        // Nowa zmienna dostaje zwolniony slot, nie slot "b"
+        let vc = st.new_str("trzecia");
+        st.set_var(c, vc);
+        assert_eq!(st.get_var(b).to_str_val(&st.interner), "druga zmienna na stercie");
+        assert_eq!(st.get_var(c).to_str_val(&st.interner), "trzecia");
+        assert!(st.get_var(a).is_nil());
+    }
+
+    #[test]
+    fn test_arena_leave_lifts_var_past_unset_slot() {
+        let mut st = RuntimeState::new(4);
+        let (a, b) = (st.interner.intern("a"), st.interner.intern("b"));
+        st.interner.arena_enter(4096);
+        let va = st.new_str("tymczasowa w arenie");
+        st.set_var(a, va);
+        let vb = st.new_str("wynik z regionu areny");
+        st.set_var(b, vb);
+        st.unset_var(a);
+
+        let stats = st.arena_leave().unwrap();
+        assert_eq!(stats.escaped, "wynik z regionu areny".len());
+        let v = st.get_var(b);
+        assert!(v.is_heap());
+        assert_eq!(v.to_str_val(&st.interner), "wynik z regionu areny");
+    }
+}
@@ -0,0 +1,198 @@
+//! Sesja REPL na bytecode: jeden rosnący `HlModule` i jeden interpreter
+//!
+//! Każdy fragment (linia albo blok wklejony w `hsh`, plik .hlrc) jest
+//! parsowany, obniżany i optymalizowany osobno, a potem doklejany na koniec
+//! modułu sesji (`hl_compiler::link::append`). Wcześniejszy kod zostaje na
+//! swoich offsetach, więc interpreter tłumaczy tylko nowy ogon, a interner,
+//! sloty zmiennych, tabela funkcji i skompilowane trasy JIT przechodzą
+//! z fragmentu na fragment.
+//!
+//! Rejestry: fragment zaczyna od `fn_regs` — za rejestrami wszystkich
+//! zdefiniowanych dotąd funkcji, które nowy kod może wołać. Fragment bez
+//! definicji nie przesuwa tej granicy, więc zwykłe linie używają ciągle tych
+//! samych rejestrów.
+
+use anyhow::Result;
+use hl_compiler::bytecode::{HlModule, Reg};
+use hl_compiler::{link, lower_ast, optimize_module};
+use hl_parser::parse_source_with_meta;
+use std::path::Path;
+
+use crate::compact::Program;
+use crate::interpreter::{BytecodeInterpreter, Parked};
+use crate::runtime::NanVal;
+
+/// Wartość początkowa zmiennej sesji
+#[derive(Debug, Clone, PartialEq)]
+pub enum SeedVal {
+    Str(String),
+    Num(f64),
+    Bool(bool),
+}
+
+pub struct ReplSession {
+    module:  HlModule,
+    /// Interpreter między fragmentami (None tylko w trakcie `eval`)
+    parked:  Option<Parked>,
+    fn_regs: Reg,
+}
+
+impl ReplSession {
+    pub fn new(name: &str) -> Result<Self> {
+        let module = HlModule::new(name, hl_parser::HL_DEFAULT_GEN);
+        let mut interp = BytecodeInterpreter::new(&module)?;
+        interp.init_hl_vars();
+        let parked = Some(interp.park());
+        Ok(Self { module, parked, fn_regs: 0 })
+    }
+
+    /// Skompiluj fragment, doklej go do sesji i wykonaj. Zwraca kod wyjścia.
+    pub fn eval(&mut self, source: &str) -> Result<i32> {
+        let meta = parse_source_with_meta(source)?;
+        let path = self.module.header.source_path.clone();
+        let mut chunk = lower_ast(&meta.nodes, Path::new(&path), meta.gen.number());
+        optimize_module(&mut chunk);
+        if let Some((linked, _)) = crate::libs::link_imports(&chunk, None)? {
+            chunk = linked;
+        }
+
+        // Fragment sprawdzony osobno — po doklejeniu walidacja w `resume`
+        // nie może się nie udać, a sesja nie traci interpretera
+        Program::from_module(&chunk)?;
+
+        let start = link::append(&mut self.module, &chunk, self.fn_regs);
+        if !chunk.funcs.entries.is_empty() {
+            self.fn_regs += link::reg_limit(&chunk);
+        }
+        tracing::debug!("[repl] fragment @{} ({} instrukcji)", start, chunk.instructions.len());
+
+        let parked = self.parked.take().expect("sesja REPL bez interpretera");
+        let mut interp = BytecodeInterpreter::resume(&self.module, parked)?;
+        let res = interp.run_from(start as usize);
+        self.parked = Some(interp.park());
+        res
+    }
+
+    /// Ustaw zmienną (stan startowy z `Env` powłoki, `SHELL`, argumenty)
+    pub fn set_var(&mut self, name: &str, val: SeedVal) {
+        let st = &mut self.parked_mut().state;
+        let k = st.interner.intern(name);
+        let v = match val {
+            SeedVal::Str(s)  => st.intern_str(&s),
+            SeedVal::Num(n)  => NanVal::num(n),
+            SeedVal::Bool(b) => NanVal::bool(b),
+        };
+        st.set_var(k, v);
+    }
+
+    /// Zmienne sesji (nazwa, wartość tekstowa) — builtin `vars`
+    pub fn vars(&self) -> Vec<(String, String)> {
+        let st = &self.parked().state;
+        st.var_slots.iter()
+        .map(|(&k, &slot)| (st.interner.get(k).to_string(), st.val_to_str(st.vars_flat[slot as usize])))
+        .collect()
+    }
+
+    /// Funkcje zdefiniowane w sesji, bez ukrytych (`__go_N`, `__arena__`, biblioteki)
+    pub fn funcs(&self) -> Vec<&str> {
+        self.module.funcs.entries.iter()
+        .map(|e| e.name.as_str())
+        .filter(|n| !n.starts_with("__"))
+        .collect()
+    }
+
+    pub fn last_exit(&self) -> i32 {
+        self.parked().state.last_exit
+    }
+
+    /// Liczba instrukcji w module sesji (diagnostyka, testy)
+    pub fn code_len(&self) -> usize {
+        self.module.instructions.len()
+    }
+
+    fn parked(&self) -> &Parked {
+        self.parked.as_ref().expect("sesja REPL bez interpretera")
+    }
+
+    fn parked_mut(&mut self) -> &mut Parked {
+        self.parked.as_mut().expect("sesja REPL bez interpretera")
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_state_persists_across_chunks() {
+        let mut s = ReplSession::new("<test>").unwrap();
+        s.set_var("start", SeedVal::Num(40.0));
+        s.eval("% x = 1").unwrap();
+        s.eval(": inc def\n$( @x + 1 ) -> @x\ndone").unwrap();
+        let before = s.code_len();
+        s.eval("-- inc\n-- inc").unwrap();
+        assert!(s.code_len() > before);
+        s.eval("$( @x + @start ) -> @y").unwrap();
+
+        let vars: std::collections::HashMap<String, String> = s.vars().into_iter().collect();
+        assert_eq!(vars.get("x").map(String::as_str), Some("3"));
+        assert_eq!(vars.get("y").map(String::as_str), Some("43"));
+        assert_eq!(s.funcs(), vec!["inc"]);
+    }
+
+    #[test]
+    fn test_error_keeps_session() {
+        let mut s = ReplSession::new("<test>").unwrap();
+        s.eval("% a = ok").unwrap();
+        assert!(s.eval("-- brak").is_err());
+        s.eval("% b = @a").unwrap();
+        let vars: std::collections::HashMap<String, String> = s.vars().into_iter().collect();
+        assert_eq!(vars.get("b").map(String::as_str), Some("ok"));
+    }
+
+    #[test]
+    fn test_traced_loop_collects_strings_on_back_edge() {
+        let mut s = ReplSession::new("<test>").unwrap();
+        s.eval("% i = 0\n?~ @i < 20000\n% s = wiersz-@i-dlugi\n$( @i + 1 ) -> @i\ndone").unwrap();
+        let p = s.parked();
+        assert!(p.jit.code_bytes() > 0, "pętla powinna działać jako trasa");
+        // Bez zbierania na natywnym skoku wstecznym zostałoby ~20000 stringów
+        let live = p.state.interner.heap_live();
+        assert!(live < 3 * 4096, "sterta stringów rośnie w trasie: {} żywych", live);
+    }
+
+    #[test]
+    fn test_traced_loop_keeps_env_fallback_dynamic() {
+        hl_core::spawn::set_env("HL_JIT_ENV_T", "przed");
+        let mut s = ReplSession::new("<test>").unwrap();
+        s.eval("% i = 0\n?~ @i < 2000\n% w = @HL_JIT_ENV_T\n$( @i + 1 ) -> @i\ndone").unwrap();
+        assert!(s.parked().jit.code_bytes() > 0, "pętla powinna działać jako trasa");
+
+        // Zmienna nieprzypisana w skrypcie — po pętli nadal czytana z std::env
+        hl_core::spawn::set_env("HL_JIT_ENV_T", "po");
+        s.eval("% v = @HL_JIT_ENV_T").unwrap();
+        hl_core::spawn::remove_env("HL_JIT_ENV_T");
+        let vars: std::collections::HashMap<String, String> = s.vars().into_iter().collect();
+        assert_eq!(vars.get("w").map(String::as_str), Some("przed"));
+        assert_eq!(vars.get("v").map(String::as_str), Some("po"));
+        assert!(!vars.contains_key("HL_JIT_ENV_T"));
+    }
+
+    #[test]
+    fn test_goroutine_extern_sees_args_and_env_set_outside() {
+        // Kod wyjścia skryptu: 0 tylko gdy dostał `_arg_0` i `_env_HL_GO_T`
+        let script = std::env::temp_dir().join(format!("hl_go_extern_{}.sh", std::process::id()));
+        std::fs::write(&script, "[ \"$1\" = hej ] && [ \"$HL_GO_T\" = env ]\n").unwrap();
+        let mut s = ReplSession::new("<test>").unwrap();
+        let res = s.eval(&format!(
+            ":** wyniki\n% _arg_0 = hej\n% _env_HL_GO_T = env\n\
+             :* w def\n_> {} [shell] def\n% _nic = 1\ndone\n:**: wyniki = @_extern_exit\ndone\n\
+             *-- wyniki |> @kod",
+            script.display(),
+        ));
+        let _ = std::fs::remove_file(&script);
+        res.unwrap();
+        let vars: std::collections::HashMap<String, String> = s.vars().into_iter().collect();
+        assert_eq!(vars.get("kod").map(String::as_str), Some("0"));
+    }
+}
@@ -1,4 +1,7 @@
 use serde::{Deserialize, Serialize};
+pub use crate::sym::Ident;
+use crate::expr::Expr;
+use crate::quick_fn::QuickFn;
 
 /// Typ zmiennej (gen 2 — typowane zmienne)
 #[derive(Debug, Clone, Serialize, Deserialize, PartialEq)]
@@ -162,17 +165,18 @@ pub enum Node {
     //   Definicja: :: nazwa <rozmiar> def ... done → ArenaFuncDef
     //
     // QuickCall: wbudowane funkcje (gen 1 + fallback gen 2)
-    QuickCall { name: String, args: Vec<StringPart> },
+    // func: nazwa rozwiązana przez parser (None — spoza tabeli wbudowanych)
+    QuickCall { name: String, func: Option<QuickFn>, args: Vec<StringPart> },
     /// :: name args |> @var  — QuickCall z przechwyceniem stdout do zmiennej
-    QuickPipeToVar { name: String, args: Vec<StringPart>, var_name: String },
+    QuickPipeToVar { name: String, func: Option<QuickFn>, args: Vec<StringPart>, var_name: Ident },
 
     Command     { raw: String, mode: CommandMode, interpolate: bool },
     HshCommand  { raw: String },
     Background  { raw: String },
     RepeatN     { count: u64, body: Vec<Node> },
-    VarDecl     { name: String, typ: VarType, value: VarValue },
-    Export      { name: String, value: ExportValue },
-    VarRef      (String),
+    VarDecl     { name: Ident, typ: VarType, value: VarValue },
+    Export      { name: Ident, value: ExportValue },
+    VarRef      (Ident),
     /// Deklaracja zależności narzędzia:
     ///   // curl              → name="curl", apt_package=None   (apt szuka "curl")
     ///   // ninja [ninja-build] → name="ninja", apt_package=Some("ninja-build")
@@ -199,19 +203,33 @@ pub enum Node {
     ArenaFuncCall { name: String, args: Vec<StringPart> },
 
     Conditional { condition: ConditionKind, body: Vec<Node> },
-    ForIn       { var: String, iterable: Vec<StringPart>, body: Vec<Node> },
-    WhileLoop   { condition: Vec<StringPart>, body: Vec<Node> },
+    // lines: `@ x in lines …` — po liniach zamiast po słowach
+    ForIn       { var: Ident, iterable: Vec<StringPart>, lines: bool, body: Vec<Node> },
+    // @ x in >> cmd — iteracja po słowach wyjścia komendy, czytanego strumieniowo
+    ForInCmd    { var: Ident, command: String, mode: CommandMode, lines: bool, body: Vec<Node> },
+    // @ i in 1..@n — liczby całkowite od `from` do `to` włącznie, rosnąco;
+    // granice to literał całkowity albo zmienna
+    ForRange    { var: Ident, from: Vec<StringPart>, to: Vec<StringPart>, body: Vec<Node> },
+    // parsed: warunek jako wyrażenie (`expr::expect_condition`); condition —
+    // tekst źródła (np. dla `hl ast`)
+    WhileLoop   { condition: Vec<StringPart>, parsed: Expr, body: Vec<Node> },
     MatchExpr   { subject: Vec<StringPart>, arms: Vec<MatchArm> },
-    Arithmetic  { expr: String, assign_to: Option<String> },
-    PipeToVar   { command: String, mode: CommandMode, var_name: String },
+    Arithmetic  { expr: String, parsed: Option<Expr>, assign_to: Option<Ident> },
+    PipeToVar   { command: String, mode: CommandMode, var_name: Ident },
     HackerOsApi { tool: HackerOsTool, args: Vec<StringPart> },
     Goroutine   { name: Option<String>, body: Vec<Node> },
-    ChannelOp   { name: String, value: Option<Vec<StringPart>> },
-    Channel     { name: String },
+    // :*~ [nazwa] — czekaj na goroutines o nazwie (None = wszystkie)
+    GoroutineWait { name: Option<String> },
+    // value: Some — wysyłka (:**:), None — odbiór (*--) do var_name albo na stdout
+    ChannelOp   { name: String, value: Option<Vec<StringPart>>, var_name: Option<Ident> },
+    Channel     { name: String, cap: Option<usize> },
     BlockComment(String),
     DocComment  (String),
     LineComment  (String),
     Block       (Vec<Node>),
+    /// Numer linii źródła następnej instrukcji — tylko z `parse_source_with_lines`
+    /// (profiler); wykonanie go pomija
+    SourceLine  (u32),
 
     // ── extern system (gen 2+) ────────────────────────────────────────────────
     // _> plik [runtime] def ... done
@@ -244,8 +262,8 @@ pub enum ConditionKind { Ok, Err }
 #[derive(Debug, Clone, Serialize, Deserialize)]
 pub enum StringPart {
     Literal(String),
-    /// Prosta zmienna: @nazwa → get_var("nazwa")
-    Var(String),
+    /// Prosta zmienna: @nazwa → slot nadany przy parsowaniu (`sym::intern`)
+    Var(Ident),
     /// Dynamiczna referencja: @{nazwa@_i} → get_var(resolve(nazwa@_i))
     /// Parsowana ze składni @{...}
     DynVar(Vec<StringPart>),
@@ -262,7 +280,8 @@ pub enum VarValue {
     Float(f64),
     List(Vec<VarValue>),
     Map(Vec<(String, VarValue)>),
-    Arithmetic(String),
+    /// `$( ... )` — tekst i drzewo z `expr::parse_arith` (None — zostaje dla `sh`)
+    Arithmetic(String, Option<Expr>),
 }
 
 impl Node {
@@ -304,7 +323,7 @@ pub fn parse_string_parts(s: &str) -> Vec<StringPart> {
                 i += 1;
                 let start = i;
                 while i < bytes.len() && (bytes[i].is_ascii_alphanumeric() || bytes[i] == b'_') { i += 1; }
-                let var_name = s[start..i].to_string();
+                let var_name = crate::sym::intern(&s[start..i]);
 
                 // Sprawdź czy zaraz po zmiennej jest kolejny @var (compound ref: @arg@_i)
                 // Jeśli tak: zbierz wszystkie kolejne @var i zrób DynVar
@@ -321,7 +340,7 @@ pub fn parse_string_parts(s: &str) -> Vec<StringPart> {
                         i += 1;
                         let s2 = i;
                         while i < bytes.len() && (bytes[i].is_ascii_alphanumeric() || bytes[i] == b'_') { i += 1; }
-                        dyn_parts.push(StringPart::Var(s[s2..i].to_string()));
+                        dyn_parts.push(StringPart::Var(crate::sym::intern(&s[s2..i])));
                     }
                     parts.push(StringPart::DynVar(dyn_parts));
                 } else {
@@ -0,0 +1,388 @@
+//! Wyrażenia warunków `?~` i arytmetyki `$( ... )`
+//!
+//! Parser parsuje je raz, przy budowie AST — executor i lowering dostają
+//! drzewo zamiast tekstu, więc porównanie dwóch liczb nie wymaga ani
+//! interpolacji całej linii, ani `sh -c`. Warunek spoza gramatyki (komenda,
+//! nazwy bez `@`) to błąd parsowania (`ExprError`). Arytmetykę spoza gramatyki
+//! (`@a @op @b`) executor parsuje jeszcze raz po interpolacji — i też zgłasza
+//! `ExprError` zamiast oddawać tekst powłoce.
+//!
+//! Priorytety (od najsłabszego):
+//!   `||`  `&&`  `!`  `== != < <= > >=` (bez łączenia)  `+ -`  `* / %`  unarne `-`, testy
+//!
+//! W warunkach dodatkowo: `=` i `-eq -ne -lt -le -gt -ge` jak w `test`,
+//! testy `-z -n` (string) i `-e -f -d -L -h -r -w -x -s` (plik), składnia
+//! `[ ... ]`, `[[ ... ]]` i `test ...`. Słowa bez `@` są tam literałami
+//! (`@status == running`), a `+ - * / %` są operatorami tylko jako osobne słowa —
+//! `/etc/hosts` i `a-b` zostają słowami.
+
+use serde::{Deserialize, Serialize};
+use thiserror::Error;
+use crate::ast::{parse_string_parts, StringPart};
+
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub enum Expr {
+    Num(f64),
+    Bool(bool),
+    /// Słowo albo string w cudzysłowie; `@zmienne` rozwiązywane w runtime
+    Str(Vec<StringPart>),
+    Unary  { op: UnOp, arg: Box<Expr> },
+    Binary { op: BinOp, lhs: Box<Expr>, rhs: Box<Expr> },
+    Test   { op: TestOp, arg: Box<Expr> },
+}
+
+#[derive(Debug, Clone, Copy, Serialize, Deserialize, PartialEq, Eq)]
+pub enum UnOp { Neg, Not }
+
+#[derive(Debug, Clone, Copy, Serialize, Deserialize, PartialEq, Eq)]
+pub enum BinOp {
+    Add, Sub, Mul, Div, Mod,
+    /// `==`/`!=` porównują tekst (dwie liczby — wartość), `<`… — liczby
+    Eq, Ne, Lt, Le, Gt, Ge,
+    And, Or,
+}
+
+impl BinOp {
+    fn prec(self) -> u8 {
+        match self {
+            BinOp::Or  => 1,
+            BinOp::And => 2,
+            BinOp::Eq | BinOp::Ne | BinOp::Lt | BinOp::Le | BinOp::Gt | BinOp::Ge => 4,
+            BinOp::Add | BinOp::Sub => 5,
+            BinOp::Mul | BinOp::Div | BinOp::Mod => 6,
+        }
+    }
+
+    pub fn is_cmp(self) -> bool {
+        matches!(self, BinOp::Eq | BinOp::Ne | BinOp::Lt | BinOp::Le | BinOp::Gt | BinOp::Ge)
+    }
+
+    pub fn is_arith(self) -> bool {
+        matches!(self, BinOp::Add | BinOp::Sub | BinOp::Mul | BinOp::Div | BinOp::Mod)
+    }
+}
+
+/// Testy `-z`/`-n` na stringu i testy plików z `test`
+#[derive(Debug, Clone, Copy, Serialize, Deserialize, PartialEq, Eq)]
+pub enum TestOp {
+    Empty, NonEmpty,
+    Exists, File, Dir, Symlink,
+    Readable, Writable, Executable, NonZeroSize,
+}
+
+impl TestOp {
+    pub fn from_flag(flag: &str) -> Option<Self> {
+        Some(match flag {
+            "z" => TestOp::Empty,
+            "n" => TestOp::NonEmpty,
+            "e" => TestOp::Exists,
+            "f" => TestOp::File,
+            "d" => TestOp::Dir,
+            "L" | "h" => TestOp::Symlink,
+            "r" => TestOp::Readable,
+            "w" => TestOp::Writable,
+            "x" => TestOp::Executable,
+            "s" => TestOp::NonZeroSize,
+            _   => return None,
+        })
+    }
+}
+
+/// Priorytet operandu `!` — porównania wiążą mocniej (`! @a == b` to `!(@a == b)`)
+const PREC_NOT: u8 = 3;
+/// Priorytet operandu unarnego minusa
+const PREC_UNARY: u8 = 7;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Mode { Cond, Arith }
+
+/// Tekst poza gramatyką wyrażeń
+#[derive(Debug, Clone, PartialEq, Error)]
+pub enum ExprError {
+    #[error("'{0}' nie jest warunkiem (porównanie, test albo zmienna) — komenda jako warunek nie jest obsługiwana")]
+    Condition(String),
+    #[error("'{0}' nie jest wyrażeniem arytmetycznym")]
+    Arith(String),
+}
+
+/// Warunek `?~`. None — tekst nie jest wyrażeniem (np. komenda).
+pub fn parse_condition(src: &str) -> Option<Expr> {
+    let s = src.trim();
+    let (inner, wrapped) = strip_test_syntax(s);
+    let e = parse(inner, Mode::Cond)?;
+    match e {
+        // Samo słowo to komenda (`?~ ping -c1 host` nie przejdzie, `?~ gotowe` też
+        // nie) — chyba że w `[ słowo ]`, gdzie znaczy „niepusty”
+        Expr::Str(parts) if parts.iter().all(|p| matches!(p, StringPart::Literal(_))) => {
+            wrapped.then(|| Expr::Test { op: TestOp::NonEmpty, arg: Box::new(Expr::Str(parts)) })
+        }
+        e => Some(e),
+    }
+}
+
+/// Wyrażenie `$( ... )`. None — poza gramatyką (nazwy bez `@`, `**`, `?:`…).
+pub fn parse_arith(src: &str) -> Option<Expr> {
+    parse(src.trim(), Mode::Arith)
+}
+
+/// `parse_condition` z błędem zamiast None
+pub fn expect_condition(src: &str) -> Result<Expr, ExprError> {
+    parse_condition(src).ok_or_else(|| ExprError::Condition(src.trim().to_string()))
+}
+
+/// `parse_arith` z błędem zamiast None
+pub fn expect_arith(src: &str) -> Result<Expr, ExprError> {
+    parse_arith(src).ok_or_else(|| ExprError::Arith(src.trim().to_string()))
+}
+
+/// `[ x ]`, `[[ x ]]`, `test x` → (x, true)
+fn strip_test_syntax(s: &str) -> (&str, bool) {
+    if let Some(inner) = s.strip_prefix("[[").and_then(|r| r.strip_suffix("]]")) {
+        return (inner, true);
+    }
+    if let Some(inner) = s.strip_prefix('[').and_then(|r| r.strip_suffix(']')) {
+        return (inner, true);
+    }
+    if let Some(inner) = s.strip_prefix("test ") {
+        return (inner, true);
+    }
+    (s, false)
+}
+
+fn parse(src: &str, mode: Mode) -> Option<Expr> {
+    let toks = lex(src, mode)?;
+    if toks.is_empty() { return None; }
+    let mut p = ExprParser { toks, pos: 0, mode };
+    let e = p.expr(0)?;
+    if p.pos != p.toks.len() { return None; }
+    Some(e)
+}
+
+// ── Lekser ────────────────────────────────────────────────────────────────────
+
+#[derive(Debug)]
+enum Tok {
+    Num(f64),
+    Word(Vec<StringPart>),
+    LParen,
+    RParen,
+    Not,
+    Bin(BinOp),
+    Test(TestOp),
+}
+
+fn lex(src: &str, mode: Mode) -> Option<Vec<Tok>> {
+    let b = src.as_bytes();
+    let mut out = Vec::with_capacity(8);
+    let mut i = 0;
+    // Znak kończy token-operator w warunku — `- 1` to minus, `-1` i `-x` nie
+    let alone = |j: usize| j >= b.len() || matches!(b[j], b' ' | b'\t' | b'(');
+    while i < b.len() {
+        let next = b.get(i + 1).copied();
+        let (tok, len) = match b[i] {
+            b' ' | b'\t' => { i += 1; continue; }
+            b'(' => (Tok::LParen, 1),
+            b')' => (Tok::RParen, 1),
+            b'=' if next == Some(b'=') => (Tok::Bin(BinOp::Eq), 2),
+            b'=' if mode == Mode::Cond => (Tok::Bin(BinOp::Eq), 1),
+            b'!' if next == Some(b'=') => (Tok::Bin(BinOp::Ne), 2),
+            b'!' => (Tok::Not, 1),
+            b'<' if next == Some(b'=') => (Tok::Bin(BinOp::Le), 2),
+            b'<' => (Tok::Bin(BinOp::Lt), 1),
+            b'>' if next == Some(b'=') => (Tok::Bin(BinOp::Ge), 2),
+            b'>' => (Tok::Bin(BinOp::Gt), 1),
+            b'&' if next == Some(b'&') => (Tok::Bin(BinOp::And), 2),
+            b'|' if next == Some(b'|') => (Tok::Bin(BinOp::Or), 2),
+            b'&' | b'|' | b'=' => return None,
+            q @ (b'"' | b'\'') => {
+                let close = src[i + 1..].find(q as char)? + i + 1;
+                out.push(Tok::Word(parse_string_parts(&src[i + 1..close])));
+                i = close + 1;
+                continue;
+            }
+            c @ (b'+' | b'-' | b'*' | b'/' | b'%') if mode == Mode::Arith || alone(i + 1) => {
+                let op = match c {
+                    b'+' => BinOp::Add, b'-' => BinOp::Sub, b'*' => BinOp::Mul,
+                    b'/' => BinOp::Div, _    => BinOp::Mod,
+                };
+                (Tok::Bin(op), 1)
+            }
+            // `-f`, `-eq`… jako osobne słowo
+            b'-' if next.is_some_and(|c| c.is_ascii_alphabetic()) => {
+                let end = word_end(b, i + 1, mode);
+                let tok = match &src[i + 1..end] {
+                    "eq" => Some(Tok::Bin(BinOp::Eq)),
+                    "ne" => Some(Tok::Bin(BinOp::Ne)),
+                    "lt" => Some(Tok::Bin(BinOp::Lt)),
+                    "le" => Some(Tok::Bin(BinOp::Le)),
+                    "gt" => Some(Tok::Bin(BinOp::Gt)),
+                    "ge" => Some(Tok::Bin(BinOp::Ge)),
+                    flag => TestOp::from_flag(flag).map(Tok::Test),
+                };
+                match tok {
+                    Some(t) => (t, end - i),
+                    None    => (word(&src[i..end], mode)?, end - i),
+                }
+            }
+            _ => {
+                let end = word_end(b, i, mode);
+                if end == i { return None; }
+                (word(&src[i..end], mode)?, end - i)
+            }
+        };
+        out.push(tok);
+        i += len;
+    }
+    Some(out)
+}
+
+fn word_end(b: &[u8], mut i: usize, mode: Mode) -> usize {
+    while i < b.len() {
+        match b[i] {
+            b' ' | b'\t' | b'(' | b')' | b'=' | b'!' | b'<' | b'>' | b'&' | b'|' | b'"' | b'\'' => break,
+            b'+' | b'-' | b'*' | b'/' | b'%' if mode == Mode::Arith => break,
+            _ => i += 1,
+        }
+    }
+    i
+}
+
+fn word(text: &str, mode: Mode) -> Option<Tok> {
+    if let Ok(n) = text.parse::<f64>() {
+        // W warunku `007` zostaje tekstem — `==` porównuje to, co napisano
+        if mode == Mode::Arith || canonical_num(n) == text { return Some(Tok::Num(n)); }
+    }
+    let parts = parse_string_parts(text);
+    // W arytmetyce słowo to liczba albo sama referencja `@x` / `@{...}`;
+    // `x` bez `@` to zmienna powłoki — taki tekst zostaje dla `sh`
+    if mode == Mode::Arith && (parts.len() != 1 || matches!(parts[0], StringPart::Literal(_))) {
+        return None;
+    }
+    Some(Tok::Word(parts))
+}
+
+/// Liczba w postaci, w jakiej wypisuje ją HL (`3`, `2.5`)
+fn canonical_num(n: f64) -> String {
+    if n.fract() == 0.0 && n.abs() < 1e15 { format!("{}", n as i64) } else { format!("{}", n) }
+}
+
+// ── Parser (precedence climbing) ──────────────────────────────────────────────
+
+struct ExprParser {
+    toks: Vec<Tok>,
+    pos:  usize,
+    mode: Mode,
+}
+
+impl ExprParser {
+    fn expr(&mut self, min_prec: u8) -> Option<Expr> {
+        let mut lhs = self.prefix()?;
+        while let Some(Tok::Bin(op)) = self.toks.get(self.pos) {
+            let op = *op;
+            if op.prec() < min_prec { break; }
+            self.pos += 1;
+            let rhs = self.expr(op.prec() + 1)?;
+            // `a < b < c` — bez łączenia porównań
+            if op.is_cmp() && matches!(self.toks.get(self.pos), Some(Tok::Bin(n)) if n.is_cmp()) {
+                return None;
+            }
+            lhs = Expr::Binary { op, lhs: Box::new(lhs), rhs: Box::new(rhs) };
+        }
+        Some(lhs)
+    }
+
+    fn prefix(&mut self) -> Option<Expr> {
+        let tok = self.toks.get(self.pos)?;
+        self.pos += 1;
+        Some(match tok {
+            Tok::Num(n) => Expr::Num(*n),
+            Tok::Word(parts) => match parts.as_slice() {
+                [StringPart::Literal(s)] if self.mode == Mode::Cond && s == "true"  => Expr::Bool(true),
+                [StringPart::Literal(s)] if self.mode == Mode::Cond && s == "false" => Expr::Bool(false),
+                _ => Expr::Str(parts.clone()),
+            },
+            Tok::LParen => {
+                let e = self.expr(0)?;
+                if !matches!(self.toks.get(self.pos), Some(Tok::RParen)) { return None; }
+                self.pos += 1;
+                e
+            }
+            Tok::Not => Expr::Unary { op: UnOp::Not, arg: Box::new(self.expr(PREC_NOT)?) },
+            Tok::Bin(BinOp::Sub) => Expr::Unary { op: UnOp::Neg, arg: Box::new(self.expr(PREC_UNARY)?) },
+            Tok::Bin(BinOp::Add) => self.expr(PREC_UNARY)?,
+            Tok::Test(op) => {
+                let op = *op;
+                Expr::Test { op, arg: Box::new(self.prefix()?) }
+            }
+            Tok::RParen | Tok::Bin(_) => return None,
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn bin(e: &Expr) -> Option<BinOp> {
+        match e { Expr::Binary { op, .. } => Some(*op), _ => None }
+    }
+
+    #[test]
+    fn test_precedence_and_parens() {
+        let e = parse_arith("@a + @b * 2").unwrap();
+        let Expr::Binary { op: BinOp::Add, rhs, .. } = &e else { panic!("{:?}", e) };
+        assert_eq!(bin(rhs), Some(BinOp::Mul));
+
+        let e = parse_arith("(@a + 1) * -@b").unwrap();
+        let Expr::Binary { op: BinOp::Mul, lhs, rhs } = &e else { panic!("{:?}", e) };
+        assert_eq!(bin(lhs), Some(BinOp::Add));
+        assert!(matches!(**rhs, Expr::Unary { op: UnOp::Neg, .. }));
+        // `@i + 1` to nie zmienna o nazwie "i + 1"
+        assert_eq!(bin(&parse_arith("@i + 1").unwrap()), Some(BinOp::Add));
+        assert_eq!(bin(&parse_arith("10-3").unwrap()), Some(BinOp::Sub));
+    }
+
+    #[test]
+    fn test_arith_rejects_shell_syntax() {
+        assert!(parse_arith("PCT * @W / 100").is_none());
+        assert!(parse_arith("FILL > 0 ? FILL - 1 : 0").is_none());
+        assert!(parse_arith("mktemp").is_none());
+        assert!(parse_arith("(1 + 2").is_none());
+    }
+
+    #[test]
+    fn test_conditions() {
+        assert_eq!(bin(&parse_condition("@i < 10").unwrap()), Some(BinOp::Lt));
+        assert_eq!(bin(&parse_condition("@i<10").unwrap()), Some(BinOp::Lt));
+        assert_eq!(bin(&parse_condition("@status == running").unwrap()), Some(BinOp::Eq));
+        assert_eq!(bin(&parse_condition("@a == 1 && @b != \"x y\"").unwrap()), Some(BinOp::And));
+        assert_eq!(bin(&parse_condition("@i + 1 <= @n || !@done").unwrap()), Some(BinOp::Or));
+        assert!(matches!(parse_condition("true"), Some(Expr::Bool(true))));
+        assert!(matches!(parse_condition("@running"), Some(Expr::Str(_))));
+        assert!(matches!(parse_condition("! @a == b"), Some(Expr::Unary { op: UnOp::Not, .. })));
+    }
+
+    #[test]
+    fn test_file_and_string_tests() {
+        let e = parse_condition("-f /etc/hosts && -n @x").unwrap();
+        let Expr::Binary { op: BinOp::And, lhs, rhs } = &e else { panic!("{:?}", e) };
+        assert!(matches!(**lhs, Expr::Test { op: TestOp::File, .. }));
+        assert!(matches!(**rhs, Expr::Test { op: TestOp::NonEmpty, .. }));
+        assert!(matches!(parse_condition("[ -d @dir/sub ]"), Some(Expr::Test { op: TestOp::Dir, .. })));
+        assert_eq!(bin(&parse_condition("[ @n -gt 3 ]").unwrap()), Some(BinOp::Gt));
+        assert_eq!(bin(&parse_condition("test @a = b").unwrap()), Some(BinOp::Eq));
+        assert!(matches!(parse_condition("[ word ]"), Some(Expr::Test { op: TestOp::NonEmpty, .. })));
+    }
+
+    #[test]
+    fn test_commands_stay_commands() {
+        assert!(parse_condition("ping -c1 host").is_none());
+        assert!(parse_condition("grep -q foo /etc/hosts").is_none());
+        assert!(parse_condition("gotowe").is_none());
+        assert!(parse_condition("@a < @b < @c").is_none());
+        assert!(parse_condition("ls | wc -l").is_none());
+        // `007` w warunku zostaje tekstem
+        assert!(matches!(&parse_condition("@x == 007").unwrap(),
+            Expr::Binary { rhs, .. } if matches!(**rhs, Expr::Str(_))));
+    }
+}
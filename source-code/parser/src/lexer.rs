@@ -1,62 +1,83 @@
+//! Lekser hl — bajtowy, bez kopii źródła
+//!
+//! Pracuje wprost na `&str` (pozycja = offset w bajtach). Składnia hl to
+//! prefiksy ASCII, więc rozgałęzienia to porównania bajtów; znaki spoza ASCII
+//! dekodujemy tylko tam, gdzie liczy się `is_alphanumeric` (identyfikatory
+//! z polskimi literami). Tokeny pożyczają fragmenty źródła (`&'a str`) —
+//! własny `String` powstaje dopiero w AST albo gdy treść nie jest ciągłym
+//! wycinkiem (escape'y w stringach, sklejane identyfikatory).
+//!
+//! `Lexer` jest iteratorem: `Parser` pobiera tokeny leniwie, jeden naprzód,
+//! więc nigdy nie trzymamy w pamięci całej listy tokenów wielomegabajtowego
+//! skryptu. `tokenize` zostaje dla wywołań, które chcą całego wektora.
+
+use std::borrow::Cow;
 use thiserror::Error;
 use crate::import_spec::parse_import_line;
 
 #[derive(Debug, Clone, PartialEq)]
-pub enum Token {
-    Print(String),
+pub enum Token<'a> {
+    Print(&'a str),
     // Wbudowane quick-call (gen 1 + gen 2 fallback): :: nazwa args
-    QuickCall { name: String, args: String },
+    QuickCall { name: &'a str, args: &'a str },
     /// :: nazwa args |> @var  — QuickCall z przechwyceniem stdout do zmiennej
-    QuickPipeToVar { name: String, args: String, var_name: String },
+    QuickPipeToVar { name: &'a str, args: &'a str, var_name: &'a str },
     // Arena function DEFINICJA (gen 2): :: nazwa <rozmiar> def
-    ArenaFuncDef { name: String, arena_size: String },
+    ArenaFuncDef { name: &'a str, arena_size: &'a str },
     // Arena function WYWOŁANIE (gen 2): :: nazwa args
     // Rozróżnienie od QuickCall następuje w parserze (sprawdza czy nazwa zdefiniowana)
     // W lekserze emitujemy QuickCall — parser decyduje co to jest
-    CmdIsolatedSudo(String),
-    CmdWithVarsSudo(String),
-    CmdWithVarsIsolated(String),
-    CmdSudo(String),
-    CmdIsolated(String),
-    CmdWithVars(String),
-    Cmd(String),
-    HshCmd(String),
-    Background(String),
-    CmdPipeToVar { cmd: String, mode: PipeCmdMode, var_name: String },
-    HackerOsApi { tool: String, args: String },
-    VarDecl { name: String, typ: String, value: String },
-    VarRef(String),
-    ExportSingle { name: String, value: String },
-    ExportListStart(String),
-    ExportListItem(String),
+    CmdIsolatedSudo(&'a str),
+    CmdWithVarsSudo(&'a str),
+    CmdWithVarsIsolated(&'a str),
+    CmdSudo(&'a str),
+    CmdIsolated(&'a str),
+    CmdWithVars(&'a str),
+    Cmd(&'a str),
+    HshCmd(&'a str),
+    Background(&'a str),
+    CmdPipeToVar { cmd: &'a str, mode: PipeCmdMode, var_name: &'a str },
+    HackerOsApi { tool: &'a str, args: &'a str },
+    VarDecl { name: &'a str, typ: &'a str, value: &'a str },
+    VarRef(&'a str),
+    ExportSingle { name: &'a str, value: &'a str },
+    ExportListStart(&'a str),
+    ExportListItem(&'a str),
     ExportListEnd,
     /// // narzedzie [pakiet-apt]
     /// Pole 0: nazwa binarka (np. "ninja"), pole 1: apt package (np. Some("ninja-build"))
-    Dependency(String, Option<String>),
+    Dependency(&'a str, Option<&'a str>),
+    /// Spec po normalizacji przestrzeni nazw (std/ → main/ itd.) — własny String
     Import { lib: String, detail: Option<String> },
-    FileImport { path: String, detail: Option<String> },
+    FileImport { path: &'a str, detail: Option<&'a str> },
     // <* katalog — import katalogu (gen 2)
-    DirImport  { path: String },
-    FuncDef(String),
-    FuncCall(String),
+    DirImport  { path: &'a str },
+    FuncDef(&'a str),
+    FuncCall(&'a str),
     IfOk,
     IfErr,
-    WhileStart(String),
-    SwitchStart(String),
-    SwitchArm { pattern: String },
-    ForIn { var: String, iterable: String },
-    Arithmetic { expr: String, assign_to: Option<String> },
+    WhileStart(&'a str),
+    SwitchStart(&'a str),
+    SwitchArm { pattern: &'a str },
+    ForIn { var: &'a str, iterable: &'a str },
+    Arithmetic { expr: &'a str, assign_to: Option<&'a str> },
     Done,
-    Using(String),
-    GoroutineStart { name: Option<String> },
-    ChannelDecl(String),
-    ChannelOp(String),
+    Using(Cow<'a, str>),
+    GoroutineStart { name: Option<&'a str> },
+    // :*~ [nazwa] — czekaj na goroutines
+    GoroutineWait(Option<&'a str>),
+    ChannelDecl { name: &'a str, cap: Option<usize> },
+    // :**: kanał = wartość
+    ChannelSend { name: &'a str, value: &'a str },
+    // *-- kanał [|> @zmienna]
+    ChannelOp { name: &'a str, var_name: Option<&'a str> },
     // _> plik [runtime] — extern system
-    ExternStart { file: String, runtime: String },
+    ExternStart { file: &'a str, runtime: &'a str },
     RepeatN(u64),
-    Comments(CommentKind, String),
-    Ident(String),
-    StringLit(String),
+    Comments(CommentKind, &'a str),
+    Ident(Cow<'a, str>),
+    /// Bez escape'ów — wycinek źródła; z escape'ami — nowy String
+    StringLit(Cow<'a, str>),
     Bool(bool),
     Number(f64),
     Newline,
@@ -79,51 +100,124 @@ pub enum LexError {
     UnterminatedBlockComment,
 }
 
-pub struct Lexer {
-    source: Vec<char>,
+#[inline]
+fn is_ident_ascii(b: u8) -> bool { b.is_ascii_alphanumeric() || b == b'_' }
+
+#[inline]
+fn is_path_ascii(b: u8) -> bool { b.is_ascii_alphanumeric() || matches!(b, b'/' | b'.' | b'-' | b'_') }
+
+pub struct Lexer<'a> {
+    src:   &'a str,
+    bytes: &'a [u8],
+    /// Offset w bajtach
     pub pos:  usize,
     pub line: usize,
+    /// Kolumna w znakach (nie bajtach) — dla komunikatów błędów
     pub col:  usize,
     in_export_list: bool,
+    /// Najbliższe `\\` (koniec bloku `// ... \\`) na pozycji ≥ pos — cache,
+    /// żeby każda linia `//` nie przeszukiwała całej reszty pliku
+    block_end: Option<Option<usize>>,
+    /// Eof już wydany — iterator się kończy
+    finished: bool,
 }
 
-impl Lexer {
-    pub fn new(source: &str) -> Self {
-        Self { source: source.chars().collect(), pos: 0, line: 1, col: 1, in_export_list: false }
+impl<'a> Lexer<'a> {
+    pub fn new(source: &'a str) -> Self {
+        Self {
+            src: source, bytes: source.as_bytes(),
+            pos: 0, line: 1, col: 1,
+            in_export_list: false,
+            block_end: None,
+            finished: false,
+        }
     }
 
-    #[inline] pub fn peek(&self) -> Option<char> { self.source.get(self.pos).copied() }
-    #[inline] pub fn peek_at(&self, n: usize) -> Option<char> { self.source.get(self.pos + n).copied() }
-    #[inline] fn matches_seq(&self, seq: &[char]) -> bool {
-    self.source.get(self.pos..self.pos + seq.len()) == Some(seq)
+    #[inline] fn peek_byte(&self) -> Option<u8> { self.bytes.get(self.pos).copied() }
+    #[inline] fn byte_at(&self, n: usize) -> Option<u8> { self.bytes.get(self.pos + n).copied() }
+    #[inline] fn matches_seq(&self, seq: &[u8]) -> bool { self.bytes[self.pos..].starts_with(seq) }
+
+    /// Znak pod kursorem (dekoduje UTF-8 tylko poza ASCII)
+    #[inline]
+    pub fn peek(&self) -> Option<char> {
+        match self.peek_byte()? {
+            b if b < 0x80 => Some(b as char),
+            _             => self.src[self.pos..].chars().next(),
+        }
     }
 
+    #[inline]
+    pub fn peek_at(&self, n: usize) -> Option<char> { self.src[self.pos..].chars().nth(n) }
+
     #[inline]
     pub fn advance(&mut self) -> Option<char> {
-        let ch = self.source.get(self.pos).copied();
-        if let Some(c) = ch {
-            self.pos += 1;
-            if c == '\n' { self.line += 1; self.col = 1; } else { self.col += 1; }
+        let c = self.peek()?;
+        self.pos += c.len_utf8();
+        if c == '\n' { self.line += 1; self.col = 1; } else { self.col += 1; }
+        Some(c)
+    }
+
+    /// Przesuń kursor do `end` (granica znaku), aktualizując linię i kolumnę
+    fn bump_to(&mut self, end: usize) {
+        for &b in &self.bytes[self.pos..end] {
+            if b == b'\n' { self.line += 1; self.col = 1; }
+            else if b & 0xC0 != 0x80 { self.col += 1; }
         }
-        ch
+        self.pos = end;
     }
 
-    fn skip_n(&mut self, n: usize) { for _ in 0..n { self.advance(); } }
-    fn skip_ws(&mut self) { while matches!(self.peek(), Some(' ') | Some('\t')) { self.advance(); } }
+    /// `n` bajtów ASCII (prefiksy operatorów)
+    #[inline]
+    fn skip_n(&mut self, n: usize) { self.pos += n; self.col += n; }
+
+    fn skip_ws(&mut self) {
+        while matches!(self.peek_byte(), Some(b' ' | b'\t')) { self.pos += 1; self.col += 1; }
+    }
 
-    fn read_line(&mut self) -> String {
+    /// Przewiń, dopóki znak spełnia warunek; zwraca pozycję końca
+    fn scan_while(&mut self, ascii: impl Fn(u8) -> bool, other: impl Fn(char) -> bool) -> usize {
+        while let Some(b) = self.peek_byte() {
+            if b < 0x80 {
+                if !ascii(b) { break; }
+                self.pos += 1;
+            } else {
+                let c = self.src[self.pos..].chars().next().unwrap_or('\u{FFFD}');
+                if !other(c) { break; }
+                self.pos += c.len_utf8();
+            }
+            self.col += 1;
+        }
+        self.pos
+    }
+
+    /// Reszta linii (bez '\n'), z obciętymi białymi znakami na końcu
+    fn read_line(&mut self) -> &'a str {
         let start = self.pos;
-        let mut end = self.pos;
-        while end < self.source.len() && self.source[end] != '\n' { end += 1; }
-        let s: String = self.source[start..end].iter().collect();
-        for _ in start..end { self.advance(); }
-        s.trim_end().to_string()
+        let end = self.bytes[start..].iter().position(|&b| b == b'\n')
+            .map_or(self.bytes.len(), |n| start + n);
+        self.bump_to(end);
+        self.src[start..end].trim_end()
     }
 
-    fn read_string_lit(&mut self) -> Result<String, LexError> {
+    fn read_string_lit(&mut self) -> Result<Cow<'a, str>, LexError> {
         let start_line = self.line;
         self.advance();
-        let mut s = String::with_capacity(64);
+        let start = self.pos;
+        // Szybka ścieżka: bez escape'ów string to wycinek źródła
+        loop {
+            match self.peek_byte() {
+                None        => return Err(LexError::UnterminatedString(start_line)),
+                Some(b'"')  => {
+                    let s = &self.src[start..self.pos];
+                    self.advance();
+                    return Ok(Cow::Borrowed(s));
+                }
+                Some(b'\\') => break,
+                Some(_)     => { self.advance(); }
+            }
+        }
+        let mut s = String::with_capacity(self.pos - start + 16);
+        s.push_str(&self.src[start..self.pos]);
         loop {
             match self.advance() {
                 None       => return Err(LexError::UnterminatedString(start_line)),
@@ -139,39 +233,52 @@ impl Lexer {
                 Some(c) => s.push(c),
             }
         }
-        Ok(s)
+        Ok(Cow::Owned(s))
     }
 
-    fn read_ident(&mut self) -> String {
-        let mut s = String::with_capacity(16);
-        while let Some(c) = self.peek() {
-            if c.is_alphanumeric() || c == '_' { s.push(c); self.advance(); } else { break; }
-        }
-        s
+    fn read_ident(&mut self) -> &'a str {
+        let start = self.pos;
+        let end = self.scan_while(is_ident_ascii, char::is_alphanumeric);
+        &self.src[start..end]
     }
 
-    fn read_ident_full(&mut self) -> String {
-        let mut s = String::with_capacity(16);
-        while let Some(c) = self.peek() {
-            if c.is_alphanumeric() || c == '_' || c == '-' { s.push(c); self.advance(); } else { break; }
-        }
-        while s.ends_with('-') { s.pop(); }
-        s
+    fn read_ident_full(&mut self) -> &'a str {
+        let start = self.pos;
+        let end = self.scan_while(|b| is_ident_ascii(b) || b == b'-', char::is_alphanumeric);
+        self.src[start..end].trim_end_matches('-')
     }
 
     fn read_number(&mut self) -> f64 {
-        let mut s = String::with_capacity(16);
-        while let Some(c) = self.peek() {
-            if c.is_ascii_digit() || c == '.' { s.push(c); self.advance(); } else { break; }
-        }
-        s.parse().unwrap_or(0.0)
+        let start = self.pos;
+        let end = self.scan_while(|b| b.is_ascii_digit() || b == b'.', |_| false);
+        self.src[start..end].parse().unwrap_or(0.0)
     }
 
-    fn read_cmd(&mut self) -> String { self.skip_ws(); self.read_line() }
+    fn read_cmd(&mut self) -> &'a str { self.skip_ws(); self.read_line() }
+
+    /// Następne słowo (same litery) bez przesuwania kursora
+    fn peek_word(&self) -> &'a str {
+        let rest = &self.src[self.pos..];
+        let end = rest.char_indices().find(|&(_, c)| !c.is_alphabetic()).map_or(rest.len(), |(i, _)| i);
+        &rest[..end]
+    }
+
+    /// Offset najbliższego `\\` od bieżącej pozycji (amortyzowane O(n) dla całego pliku)
+    fn next_block_end(&mut self) -> Option<usize> {
+        match self.block_end {
+            Some(Some(p)) if p >= self.pos => Some(p),
+            Some(None)                     => None,
+            _ => {
+                let found = self.src[self.pos..].find("\\\\").map(|i| self.pos + i);
+                self.block_end = Some(found);
+                found
+            }
+        }
+    }
 
     /// Rozdziel `args |> @var` dla QuickCall (:: name args |> @var)
     /// Zwraca (args_before_pipe, var_name) lub None jeśli brak |>
-    fn split_quick_pipe(line: &str) -> Option<(String, String)> {
+    fn split_quick_pipe(line: &str) -> Option<(&str, &str)> {
         let b = line.as_bytes();
         let mut in_s = false;
         let mut in_d = false;
@@ -181,11 +288,11 @@ impl Lexer {
                 b'\'' if !in_d => in_s = !in_s,
                 b'"'  if !in_s => in_d = !in_d,
                 b'|' if !in_s && !in_d && b[i+1] == b'>' => {
-                    let args_part = line[..i].trim().to_string();
+                    let args_part = line[..i].trim();
                     let rest      = line[i+2..].trim();
                     let var_name  = rest.strip_prefix('@')
                         .map(|v| v.split(|c: char| !c.is_alphanumeric() && c != '_')
-                            .next().unwrap_or("").to_string())
+                            .next().unwrap_or(""))
                         .unwrap_or_default();
                     if var_name.is_empty() { return None; }
                     return Some((args_part, var_name));
@@ -197,7 +304,7 @@ impl Lexer {
         None
     }
 
-    fn split_pipe_to_var(line: &str) -> Option<(String, String)> {
+    fn split_pipe_to_var(line: &str) -> Option<(&str, &str)> {
         let bytes = line.as_bytes();
         let mut in_sq = false;
         let mut in_dq = false;
@@ -207,8 +314,8 @@ impl Lexer {
                 b'\'' if !in_dq => in_sq = !in_sq,
                 b'"'  if !in_sq => in_dq = !in_dq,
                 b'|' if !in_sq && !in_dq && bytes[i+1] == b'>' => {
-                    let cmd = line[..i].trim().to_string();
-                    let var = line[i+2..].trim().trim_start_matches('@').to_string();
+                    let cmd = line[..i].trim();
+                    let var = line[i+2..].trim().trim_start_matches('@');
                     if !var.is_empty() && !cmd.is_empty() { return Some((cmd, var)); }
                 }
                 _ => {}
@@ -219,151 +326,164 @@ impl Lexer {
     }
 
     // ── Parsowanie rozmiaru areny: <4k>, <1m>, <4096> ────────────────────────
-    fn try_read_arena_size(&mut self) -> Option<String> {
+    fn try_read_arena_size(&mut self) -> Option<&'a str> {
         // Spójrz czy po skip_ws jest '<'
-        let saved_pos  = self.pos;
-        let saved_line = self.line;
-        let saved_col  = self.col;
+        let (saved_pos, saved_col) = (self.pos, self.col);
 
         self.skip_ws();
-        if self.peek() != Some('<') {
+        if self.peek_byte() != Some(b'<') {
             // Cofnij
-            self.pos  = saved_pos;
-            self.line = saved_line;
-            self.col  = saved_col;
+            self.pos = saved_pos;
+            self.col = saved_col;
             return None;
         }
-        self.advance(); // '<'
-        let mut size_str = String::new();
-        loop {
-            match self.peek() {
-                Some('>') => { self.advance(); break; }
-                Some('\n') | None => {
-                    // Niezamknięty '<' — cofnij i traktuj jako brak rozmiaru
-                    self.pos  = saved_pos;
-                    self.line = saved_line;
-                    self.col  = saved_col;
-                    return None;
-                }
-                Some(c) => { size_str.push(c); self.advance(); }
+        self.skip_n(1); // '<'
+        let start = self.pos;
+        let close = self.bytes[start..].iter().position(|&b| b == b'>' || b == b'\n')
+            .map(|n| start + n)
+            .filter(|&p| self.bytes[p] == b'>');
+        match close {
+            Some(p) => {
+                self.bump_to(p + 1);
+                Some(self.src[start..p].trim())
+            }
+            None => {
+                // Niezamknięty '<' — cofnij i traktuj jako brak rozmiaru
+                self.pos = saved_pos;
+                self.col = saved_col;
+                None
             }
         }
-        Some(size_str.trim().to_string())
     }
 
-    pub fn tokenize(&mut self) -> Result<Vec<Token>, LexError> {
-        let mut tokens = Vec::with_capacity(self.source.len() / 8 + 16);
-
-        while self.pos < self.source.len() {
-            let ch = match self.peek() { None => break, Some(c) => c };
+    /// Wszystkie tokeny naraz (z końcowym `Eof`)
+    pub fn tokenize(&mut self) -> Result<Vec<Token<'a>>, LexError> {
+        let mut tokens = Vec::with_capacity(self.src.len() / 8 + 16);
+        loop {
+            let t = self.next_token()?;
+            let eof = t == Token::Eof;
+            tokens.push(t);
+            if eof { break; }
+        }
+        Ok(tokens)
+    }
 
+    /// Następny token; po końcu źródła zawsze `Eof`
+    pub fn next_token(&mut self) -> Result<Token<'a>, LexError> {
+        while let Some(b) = self.peek_byte() {
             // ── Export list mode ─────────────────────────────────────────────
             if self.in_export_list {
-                match ch {
-                    '\n' => { tokens.push(Token::Newline); self.advance(); }
-                    ' ' | '\t' | '\r' => { self.advance(); }
-                    '|' if self.peek_at(1) != Some('>') && self.peek_at(1) != Some('|') => {
-                        self.advance(); self.skip_ws();
-                        tokens.push(Token::ExportListItem(self.read_line()));
+                match b {
+                    b'\n' => { self.advance(); return Ok(Token::Newline); }
+                    b' ' | b'\t' | b'\r' => { self.skip_n(1); }
+                    b'|' if self.byte_at(1) != Some(b'>') && self.byte_at(1) != Some(b'|') => {
+                        self.skip_n(1); self.skip_ws();
+                        return Ok(Token::ExportListItem(self.read_line()));
                     }
-                    ']' => {
-                        self.advance();
+                    b']' => {
+                        self.skip_n(1);
                         self.in_export_list = false;
-                        tokens.push(Token::ExportListEnd);
                         self.read_line();
+                        return Ok(Token::ExportListEnd);
                     }
-                    ';' if self.peek_at(1) == Some(';') => {
+                    b';' if self.byte_at(1) == Some(b';') => {
                         self.skip_n(2);
-                        tokens.push(Token::Comments(CommentKind::Line, self.read_line()));
-                    }
-                    _ => {
-                        let (l, c) = (self.line, self.col);
-                        self.advance();
-                        return Err(LexError::UnexpectedChar(ch, l, c));
+                        return Ok(Token::Comments(CommentKind::Line, self.read_line()));
                     }
+                    _ => return Err(self.unexpected()),
                 }
                 continue;
             }
 
-            match ch {
-                '\n' => { tokens.push(Token::Newline); self.advance(); }
-                ' ' | '\t' | '\r' => { self.advance(); }
+            let tok = match b {
+                b'\n' => { self.advance(); Token::Newline }
+                b' ' | b'\t' | b'\r' => { self.skip_n(1); continue; }
 
                 // ── ~> print ─────────────────────────────────────────────────
-                '~' if self.peek_at(1) == Some('>') => {
+                b'~' if self.byte_at(1) == Some(b'>') => {
                     self.skip_n(2); self.skip_ws();
-                    tokens.push(Token::Print(self.read_line()));
+                    Token::Print(self.read_line())
                 }
 
                 // ── $( expr ) arytmetyka ──────────────────────────────────────
-                '$' if self.peek_at(1) == Some('(') => {
+                b'$' if self.byte_at(1) == Some(b'(') => {
                     self.skip_n(2);
-                    let mut expr = String::new();
+                    let start = self.pos;
                     let mut depth = 1usize;
-                    loop {
-                        match self.peek() {
-                            Some('(')  => { depth += 1; expr.push('('); self.advance(); }
-                            Some(')')  => {
-                                depth -= 1; self.advance();
-                                if depth == 0 { break; }
-                                expr.push(')');
-                            }
-                            Some(c)    => { expr.push(c); self.advance(); }
-                            None       => break,
+                    let mut close = self.bytes.len();
+                    for (i, &c) in self.bytes[start..].iter().enumerate() {
+                        match c {
+                            b'(' => depth += 1,
+                            b')' => { depth -= 1; if depth == 0 { close = start + i; break; } }
+                            _ => {}
                         }
                     }
+                    let expr = self.src[start..close].trim();
+                    self.bump_to((close + 1).min(self.bytes.len()));
                     self.skip_ws();
-                    let assign_to = if self.matches_seq(&['-', '>']) {
+                    let assign_to = if self.matches_seq(b"->") {
                         self.skip_n(2); self.skip_ws();
-                        if self.peek() == Some('@') { self.advance(); }
+                        if self.peek_byte() == Some(b'@') { self.skip_n(1); }
                         let v = self.read_ident_full();
                         if v.is_empty() { None } else { Some(v) }
                     } else { None };
-                    tokens.push(Token::Arithmetic { expr: expr.trim().to_string(), assign_to });
+                    Token::Arithmetic { expr, assign_to }
                 }
 
                 // ── || HackerOS API ───────────────────────────────────────────
-                '|' if self.peek_at(1) == Some('|') => {
+                b'|' if self.byte_at(1) == Some(b'|') => {
                     self.skip_n(2); self.skip_ws();
-                    let mut tool = String::new();
-                    while let Some(c) = self.peek() {
-                        if c.is_alphanumeric() || c == '-' || c == '#' { tool.push(c); self.advance(); }
-                        else { break; }
-                    }
+                    let start = self.pos;
+                    let end = self.scan_while(|b| b.is_ascii_alphanumeric() || b == b'-' || b == b'#',
+                                              char::is_alphanumeric);
+                    let tool = &self.src[start..end];
                     self.skip_ws();
-                    tokens.push(Token::HackerOsApi { tool, args: self.read_line() });
+                    Token::HackerOsApi { tool, args: self.read_line() }
                 }
 
                 // ── | switch arm ──────────────────────────────────────────────
-                '|' if self.peek_at(1) != Some('>') && self.peek_at(1) != Some('|') => {
-                    self.advance(); self.skip_ws();
+                b'|' if self.byte_at(1) != Some(b'>') && self.byte_at(1) != Some(b'|') => {
+                    self.skip_n(1); self.skip_ws();
                     let line = self.read_line();
-                    let pattern = if let Some(p) = line.find("->") {
-                        line[..p].trim().to_string()
-                    } else {
-                        line.trim().to_string()
+                    let pattern = match line.find("->") {
+                        Some(p) => line[..p].trim(),
+                        None    => line.trim(),
                     };
-                    tokens.push(Token::SwitchArm { pattern });
+                    Token::SwitchArm { pattern }
                 }
 
-                // ── :** channel ───────────────────────────────────────────────
-                ':' if self.matches_seq(&[':', '*', '*']) => {
+                // ── :**: send / :** channel ───────────────────────────────────
+                b':' if self.matches_seq(b":**:") => {
+                    self.skip_n(4); self.skip_ws();
+                    let name = self.read_ident_full();
+                    let rest = self.read_line().trim_start();
+                    let value = rest.strip_prefix('=').unwrap_or(rest).trim();
+                    Token::ChannelSend { name, value }
+                }
+                b':' if self.matches_seq(b":**") => {
                     self.skip_n(3); self.skip_ws();
-                    tokens.push(Token::ChannelDecl(self.read_ident_full()));
-                    self.read_line();
+                    let name = self.read_ident_full();
+                    let cap = self.read_line().trim().parse::<usize>().ok();
+                    Token::ChannelDecl { name, cap }
+                }
+
+                // ── :*~ wait ──────────────────────────────────────────────────
+                b':' if self.matches_seq(b":*~") => {
+                    self.skip_n(3); self.skip_ws();
+                    let name = self.read_line().trim();
+                    Token::GoroutineWait(if name.is_empty() { None } else { Some(name) })
                 }
 
                 // ── :* goroutine ──────────────────────────────────────────────
-                ':' if self.matches_seq(&[':', '*']) => {
+                b':' if self.matches_seq(b":*") => {
                     self.skip_n(2); self.skip_ws();
-                    let rest = self.read_line();
-                    let rest = rest.trim();
-                    let name = if rest.ends_with("def") {
-                        let n = rest[..rest.len()-3].trim().to_string();
+                    let rest = self.read_line().trim();
+                    let name = if let Some(n) = rest.strip_suffix("def") {
+                        let n = n.trim();
                         if n.is_empty() { None } else { Some(n) }
                     } else if rest.is_empty() { None }
-                    else { Some(rest.to_string()) };
-                    tokens.push(Token::GoroutineStart { name });
+                    else { Some(rest) };
+                    Token::GoroutineStart { name }
                 }
 
                 // ── :: arena function DEF lub QuickCall ───────────────────────
@@ -371,40 +491,26 @@ impl Lexer {
                 // Reguła rozróżnienia w lekserze:
                 //   :: nazwa <rozmiar> def  → ArenaFuncDef
                 //   :: nazwa [args...]      → QuickCall (parser rozróżni czy to wywołanie areny)
-                ':' if self.peek_at(1) == Some(':') => {
+                b':' if self.byte_at(1) == Some(b':') => {
                     self.skip_n(2); self.skip_ws();
                     let name = self.read_ident_full();
                     self.skip_ws();
 
                     // Próbuj rozpoznać def areny: <rozmiar> def  LUB  def
-                    let saved = self.pos;
-                    let saved_line = self.line;
-                    let saved_col = self.col;
+                    let (saved, saved_line, saved_col) = (self.pos, self.line, self.col);
 
                     // Sprawdź czy następne to <rozmiar> def lub samo def
-                    let arena_size_str = self.try_read_arena_size();
+                    let arena_size = self.try_read_arena_size();
                     self.skip_ws();
-                    let is_def = {
-                        let mut tmp_pos = self.pos;
-                        let mut kw = String::new();
-                        while tmp_pos < self.source.len()
-                            && self.source[tmp_pos].is_alphabetic()
-                            {
-                                kw.push(self.source[tmp_pos]);
-                                tmp_pos += 1;
-                            }
-                            kw == "def"
-                    };
 
-                    if is_def {
+                    if self.peek_word() == "def" {
                         // Pochłoń "def" i resztę linii
                         self.read_ident(); // "def"
                         self.read_line();
-                        let size = arena_size_str.unwrap_or_default();
-                        tokens.push(Token::ArenaFuncDef { name, arena_size: size });
+                        Token::ArenaFuncDef { name, arena_size: arena_size.unwrap_or_default() }
                     } else {
                         // Cofnij po read_arena_size (jeśli było) i traktuj jako QuickCall
-                        if arena_size_str.is_some() {
+                        if arena_size.is_some() {
                             self.pos  = saved;
                             self.line = saved_line;
                             self.col  = saved_col;
@@ -412,343 +518,379 @@ impl Lexer {
                         }
                         // Sprawdź czy linia zawiera |> @var (QuickPipeToVar)
                         let line = self.read_line();
-                        if let Some((cmd_part, var_part)) = Self::split_quick_pipe(&line) {
-                            tokens.push(Token::QuickPipeToVar {
-                                name,
-                                args:     cmd_part,
-                                var_name: var_part,
-                            });
-                        } else {
-                            tokens.push(Token::QuickCall { name, args: line });
+                        match Self::split_quick_pipe(line) {
+                            Some((args, var_name)) => Token::QuickPipeToVar { name, args, var_name },
+                            None                   => Token::QuickCall { name, args: line },
                         }
                     }
                 }
 
-                ':' => {
-                    self.advance(); self.skip_ws();
+                b':' => {
+                    self.skip_n(1); self.skip_ws();
                     let name = self.read_ident_full(); self.skip_ws();
                     let kw = self.read_ident();
-                    if kw == "def" { tokens.push(Token::FuncDef(name)); self.read_line(); }
-                    else { tokens.push(Token::Ident(format!(":{} {}", name, kw))); }
+                    if kw == "def" { self.read_line(); Token::FuncDef(name) }
+                    else { Token::Ident(Cow::Owned(format!(":{} {}", name, kw))) }
                 }
 
                 // ── ;; komentarz ──────────────────────────────────────────────
-                ';' if self.peek_at(1) == Some(';') => {
+                b';' if self.byte_at(1) == Some(b';') => {
                     self.skip_n(2);
-                    tokens.push(Token::Comments(CommentKind::Line, self.read_line()));
+                    Token::Comments(CommentKind::Line, self.read_line())
                 }
 
                 // ── /// doc comment ───────────────────────────────────────────
-                '/' if self.matches_seq(&['/', '/', '/']) => {
+                b'/' if self.matches_seq(b"///") => {
                     self.skip_n(3);
-                    tokens.push(Token::Comments(CommentKind::Doc, self.read_line()));
+                    Token::Comments(CommentKind::Doc, self.read_line())
                 }
 
                 // ── // zależność lub blok ─────────────────────────────────────
-                '/' if self.matches_seq(&['/', '/']) => {
+                b'/' if self.matches_seq(b"//") => {
                     self.skip_n(2); self.skip_ws();
-                    let rest: String = self.source[self.pos..].iter().collect();
-                    if let Some(end) = rest.find("\\\\") {
-                        let content = rest[..end].trim().to_string();
-                        self.skip_n(end + 2);
-                        tokens.push(Token::Comments(CommentKind::Block, content));
+                    if let Some(end) = self.next_block_end() {
+                        let content = self.src[self.pos..end].trim();
+                        self.bump_to(end + 2);
+                        Token::Comments(CommentKind::Block, content)
                     } else {
                         // Parsuj: "// narzedzie [pakiet-apt]" lub "// narzedzie"
-                        let raw_dep = self.read_line();
-                        let raw_dep = raw_dep.trim();
+                        let raw_dep = self.read_line().trim();
                         // Rozdziel na bin_name i opcjonalny [apt-package]
-                        let (bin_name, apt_pkg) = if let (Some(lb), Some(rb)) = (raw_dep.find('['), raw_dep.rfind(']')) {
-                            let name = raw_dep[..lb].trim().to_string();
-                            let pkg  = raw_dep[lb+1..rb].trim().to_string();
-                            (name, if pkg.is_empty() { None } else { Some(pkg) })
-                        } else {
-                            (raw_dep.to_string(), None)
-                        };
-                        tokens.push(Token::Dependency(bin_name, apt_pkg));
+                        match (raw_dep.find('['), raw_dep.rfind(']')) {
+                            (Some(lb), Some(rb)) if lb < rb => {
+                                let pkg = raw_dep[lb+1..rb].trim();
+                                Token::Dependency(raw_dep[..lb].trim(), if pkg.is_empty() { None } else { Some(pkg) })
+                            }
+                            _ => Token::Dependency(raw_dep, None),
+                        }
                     }
                 }
 
                 // ── << file import ────────────────────────────────────────────
                 // ── <* dir import (gen 2) ────────────────────────────────────────────────
                 // <* katalog — ładuje katalog/imports.hl (odpowiednik mod.rs)
-                '<' if self.peek_at(1) == Some('*') => {
+                b'<' if self.byte_at(1) == Some(b'*') => {
                     self.skip_n(2); self.skip_ws();
-                    let path = self.read_line().trim().to_string();
-                    tokens.push(Token::DirImport { path });
+                    Token::DirImport { path: self.read_line().trim() }
                 }
 
-                '<' if self.peek_at(1) == Some('<') => {
+                b'<' if self.byte_at(1) == Some(b'<') => {
                     self.skip_n(2); self.skip_ws();
                     let rest = self.read_line();
-                    if let Some(p) = rest.find('|') {
-                        let path   = rest[..p].trim().to_string();
-                        let detail = rest[p+1..].trim().to_string();
-                        tokens.push(Token::FileImport { path, detail: if detail.is_empty() { None } else { Some(detail) } });
-                    } else {
-                        tokens.push(Token::FileImport { path: rest.trim().to_string(), detail: None });
+                    match rest.find('|') {
+                        Some(p) => {
+                            let detail = rest[p+1..].trim();
+                            Token::FileImport { path: rest[..p].trim(), detail: if detail.is_empty() { None } else { Some(detail) } }
+                        }
+                        None => Token::FileImport { path: rest.trim(), detail: None },
                     }
                 }
 
                 // ── -- func call ──────────────────────────────────────────────
-                '-' if self.matches_seq(&['-', '-']) => {
+                b'-' if self.matches_seq(b"--") => {
                     self.skip_n(2); self.skip_ws();
-                    tokens.push(Token::FuncCall(self.read_ident_full()));
+                    let name = self.read_ident_full();
                     self.read_line();
+                    Token::FuncCall(name)
                 }
 
                 // ── => export ─────────────────────────────────────────────────
-                '=' if self.peek_at(1) == Some('>') => {
+                b'=' if self.byte_at(1) == Some(b'>') => {
                     self.skip_n(2); self.skip_ws();
                     let name = self.read_ident_full(); self.skip_ws();
-                    match self.peek() {
-                        Some('=') => { self.advance(); self.skip_ws(); tokens.push(Token::ExportSingle { name, value: self.read_line() }); }
-                        Some('[') => { self.advance(); self.read_line(); self.in_export_list = true; tokens.push(Token::ExportListStart(name)); }
-                        _ => { tokens.push(Token::ExportSingle { name, value: String::new() }); }
+                    match self.peek_byte() {
+                        Some(b'=') => { self.skip_n(1); self.skip_ws(); Token::ExportSingle { name, value: self.read_line() } }
+                        Some(b'[') => { self.skip_n(1); self.read_line(); self.in_export_list = true; Token::ExportListStart(name) }
+                        _ => Token::ExportSingle { name, value: "" },
                     }
                 }
 
-                '^' if self.matches_seq(&['^', '-', '>']) => { self.skip_n(3); tokens.push(Token::CmdIsolatedSudo(self.read_cmd())); }
-                '^' if self.matches_seq(&['^', '>', '>']) => {
+                b'^' if self.matches_seq(b"^->") => { self.skip_n(3); Token::CmdIsolatedSudo(self.read_cmd()) }
+                b'^' if self.matches_seq(b"^>>") => {
                     self.skip_n(3);
                     let line = self.read_cmd();
-                    if let Some((cmd, var)) = Self::split_pipe_to_var(&line) {
-                        tokens.push(Token::CmdPipeToVar { cmd, mode: PipeCmdMode::WithVars, var_name: var });
-                    } else { tokens.push(Token::CmdWithVarsSudo(line)); }
+                    match Self::split_pipe_to_var(line) {
+                        Some((cmd, var)) => Token::CmdPipeToVar { cmd, mode: PipeCmdMode::WithVars, var_name: var },
+                        None             => Token::CmdWithVarsSudo(line),
+                    }
                 }
-                '^' if self.peek_at(1) == Some('>') => {
+                b'^' if self.byte_at(1) == Some(b'>') => {
                     self.skip_n(2);
                     let line = self.read_cmd();
-                    if let Some((cmd, var)) = Self::split_pipe_to_var(&line) {
-                        tokens.push(Token::CmdPipeToVar { cmd, mode: PipeCmdMode::Sudo, var_name: var });
-                    } else { tokens.push(Token::CmdSudo(line)); }
+                    match Self::split_pipe_to_var(line) {
+                        Some((cmd, var)) => Token::CmdPipeToVar { cmd, mode: PipeCmdMode::Sudo, var_name: var },
+                        None             => Token::CmdSudo(line),
+                    }
                 }
-                '^' => { self.advance(); }
+                b'^' => { self.skip_n(1); continue; }
 
-                '-' if self.matches_seq(&['-', '>', '>']) => {
+                b'-' if self.matches_seq(b"->>") => {
                     self.skip_n(3);
                     let line = self.read_cmd();
-                    if let Some((cmd, var)) = Self::split_pipe_to_var(&line) {
-                        tokens.push(Token::CmdPipeToVar { cmd, mode: PipeCmdMode::WithVars, var_name: var });
-                    } else { tokens.push(Token::CmdWithVarsIsolated(line)); }
+                    match Self::split_pipe_to_var(line) {
+                        Some((cmd, var)) => Token::CmdPipeToVar { cmd, mode: PipeCmdMode::WithVars, var_name: var },
+                        None             => Token::CmdWithVarsIsolated(line),
+                    }
                 }
-                '-' if self.peek_at(1) == Some('>') => { self.skip_n(2); tokens.push(Token::CmdIsolated(self.read_cmd())); }
+                b'-' if self.byte_at(1) == Some(b'>') => { self.skip_n(2); Token::CmdIsolated(self.read_cmd()) }
 
-                '>' if self.peek_at(1) == Some('>') => {
+                b'>' if self.byte_at(1) == Some(b'>') => {
                     self.skip_n(2);
                     let line = self.read_cmd();
-                    if let Some((cmd, var)) = Self::split_pipe_to_var(&line) {
-                        tokens.push(Token::CmdPipeToVar { cmd, mode: PipeCmdMode::WithVars, var_name: var });
-                    } else { tokens.push(Token::CmdWithVars(line)); }
+                    match Self::split_pipe_to_var(line) {
+                        Some((cmd, var)) => Token::CmdPipeToVar { cmd, mode: PipeCmdMode::WithVars, var_name: var },
+                        None             => Token::CmdWithVars(line),
+                    }
                 }
-                '>' => {
-                    self.advance();
+                b'>' => {
+                    self.skip_n(1);
                     let line = self.read_cmd();
-                    if let Some((cmd, var)) = Self::split_pipe_to_var(&line) {
-                        tokens.push(Token::CmdPipeToVar { cmd, mode: PipeCmdMode::Plain, var_name: var });
-                    } else { tokens.push(Token::Cmd(line)); }
+                    match Self::split_pipe_to_var(line) {
+                        Some((cmd, var)) => Token::CmdPipeToVar { cmd, mode: PipeCmdMode::Plain, var_name: var },
+                        None             => Token::Cmd(line),
+                    }
                 }
 
-                '&' => { self.advance(); self.skip_ws(); tokens.push(Token::Background(self.read_line())); }
+                b'&' => { self.skip_n(1); self.skip_ws(); Token::Background(self.read_line()) }
 
                 // ── _> extern ─────────────────────────────────────────────────
                 // _> plik.sh [shell] def ... done
                 // _> binarka [elf] def ... done
-                '_' if self.peek_at(1) == Some('>') => {
+                b'_' if self.byte_at(1) == Some(b'>') => {
                     self.skip_n(2); self.skip_ws();
                     // Czytaj ścieżkę pliku (do pierwszego białego znaku lub '[')
-                    let mut file = String::new();
-                    while let Some(c) = self.peek() {
-                        if c == ' ' || c == '\t' || c == '[' || c == '\n' { break; }
-                        file.push(c); self.advance();
-                    }
+                    let start = self.pos;
+                    let end = self.scan_while(|b| !matches!(b, b' ' | b'\t' | b'[' | b'\n'), |_| true);
+                    let file = &self.src[start..end];
                     self.skip_ws();
                     // Czytaj [runtime]
-                    let runtime = if self.peek() == Some('[') {
-                        self.advance();
-                        let mut rt = String::new();
-                        while let Some(c) = self.peek() {
-                            if c == ']' { self.advance(); break; }
-                            if c == '\n' { break; }
-                            rt.push(c); self.advance();
-                        }
-                        rt.trim().to_string()
+                    let runtime = if self.peek_byte() == Some(b'[') {
+                        self.skip_n(1);
+                        let start = self.pos;
+                        let end = self.scan_while(|b| b != b']' && b != b'\n', |_| true);
+                        if self.peek_byte() == Some(b']') { self.skip_n(1); }
+                        self.src[start..end].trim()
                     } else {
                         // Próbuj zgadnąć runtime z rozszerzenia pliku
-                        let ext = file.rsplit('.').next().unwrap_or("").to_lowercase();
-                        match ext.as_str() {
-                            "sh" | "bash"  => "shell".to_string(),
-                            "py"           => "python".to_string(),
-                            "jar"          => "java".to_string(),
-                            "so"           => "so".to_string(),
-                            _              => "elf".to_string(),
+                        let ext = file.rsplit('.').next().unwrap_or("");
+                        match ext.to_ascii_lowercase().as_str() {
+                            "sh" | "bash"  => "shell",
+                            "py"           => "python",
+                            "jar"          => "java",
+                            "so"           => "so",
+                            _              => "elf",
                         }
                     };
                     self.skip_ws();
-                    // Pochłoń "def"
-                    let kw = self.read_ident();
-                    if kw != "def" {
-                        // Cofnij — traktuj jako VarRef ze specjalną obsługą
-                        tokens.push(Token::ExternStart { file, runtime });
-                    } else {
-                        self.read_line();
-                        tokens.push(Token::ExternStart { file, runtime });
-                    }
+                    // Pochłoń "def" (bez niego — ExternStart i tak, reszta linii zostaje)
+                    if self.read_ident() == "def" { self.read_line(); }
+                    Token::ExternStart { file, runtime }
                 }
 
-                '*' if self.matches_seq(&['*', '-', '-']) => {
+                b'*' if self.matches_seq(b"*--") => {
                     self.skip_n(3); self.skip_ws();
-                    tokens.push(Token::ChannelOp(self.read_ident_full()));
-                    self.read_line();
+                    let name = self.read_ident_full();
+                    let rest = self.read_line().trim();
+                    let var_name = rest.strip_prefix("|>")
+                        .map(|v| v.trim().trim_start_matches('@'))
+                        .filter(|v| !v.is_empty());
+                    Token::ChannelOp { name, var_name }
                 }
-                '*' if self.peek_at(1) == Some('>') => {
+                b'*' if self.byte_at(1) == Some(b'>') => {
                     self.skip_n(2); self.skip_ws();
-                    tokens.push(Token::HshCmd(self.read_line()));
+                    Token::HshCmd(self.read_line())
                 }
 
-                '_' => {
-                    self.advance();
-                    let mut num_str = String::new();
-                    while let Some(c) = self.peek() {
-                        if c.is_ascii_digit() { num_str.push(c); self.advance(); } else { break; }
-                    }
-                    if !num_str.is_empty() {
+                b'_' => {
+                    let start = self.pos;
+                    self.skip_n(1);
+                    let digits_end = self.scan_while(|b| b.is_ascii_digit(), |_| false);
+                    if digits_end > start + 1 {
                         let next_is_alnum = self.peek()
                         .map(|c| c.is_alphanumeric() || c == '_')
                         .unwrap_or(false);
                         if !next_is_alnum {
-                            tokens.push(Token::RepeatN(num_str.parse().unwrap_or(1)));
-                            continue;
+                            Token::RepeatN(self.src[start + 1..digits_end].parse().unwrap_or(1))
+                        } else {
+                            let rest = self.read_ident_full();
+                            let end = digits_end + rest.len();
+                            Token::VarRef(&self.src[start..end])
                         }
-                        let mut id = format!("_{}", num_str);
-                        id.push_str(&self.read_ident_full());
-                        tokens.push(Token::VarRef(id));
                     } else {
                         let rest = self.read_ident_full();
                         if rest.is_empty() {
-                            tokens.push(Token::Comments(CommentKind::Line, String::new()));
+                            Token::Comments(CommentKind::Line, "")
                         } else {
-                            tokens.push(Token::VarRef(format!("_{}", rest)));
+                            Token::VarRef(&self.src[start..start + 1 + rest.len()])
                         }
                     }
                 }
 
-                '@' => {
-                    self.advance();
+                b'@' => {
+                    self.skip_n(1);
                     let name = self.read_ident_full();
                     self.skip_ws();
-                    let looks_like_for = {
-                        let mut tmp = self.pos;
-                        let mut kw = String::new();
-                        while tmp < self.source.len() && self.source[tmp].is_alphabetic() {
-                            kw.push(self.source[tmp]);
-                            tmp += 1;
-                        }
-                        kw == "in"
-                    };
-                    if looks_like_for {
-                        let _in_kw = self.read_ident();
+                    if self.peek_word() == "in" {
+                        self.read_ident();
                         self.skip_ws();
-                        tokens.push(Token::ForIn { var: name, iterable: self.read_line() });
+                        Token::ForIn { var: name, iterable: self.read_line() }
                     } else {
-                        tokens.push(Token::VarRef(name));
+                        Token::VarRef(name)
                     }
                 }
 
-                '%' => {
-                    self.advance(); self.skip_ws();
+                b'%' => {
+                    self.skip_n(1); self.skip_ws();
                     let name = self.read_ident_full(); self.skip_ws();
-                    let typ = if self.peek() == Some(':') {
-                        self.advance(); self.skip_ws();
+                    let typ = if self.peek_byte() == Some(b':') {
+                        self.skip_n(1); self.skip_ws();
                         self.read_ident_full()
-                    } else { String::new() };
+                    } else { "" };
                     self.skip_ws();
-                    if self.peek() == Some('=') {
-                        self.advance(); self.skip_ws();
-                        tokens.push(Token::VarDecl { name, typ, value: self.read_line() });
+                    if self.peek_byte() == Some(b'=') {
+                        self.skip_n(1); self.skip_ws();
+                        Token::VarDecl { name, typ, value: self.read_line() }
                     } else {
-                        tokens.push(Token::Ident(format!("%{}", name)));
+                        Token::Ident(Cow::Owned(format!("%{}", name)))
                     }
                 }
 
-                '?' => {
-                    self.advance(); self.skip_ws();
-                    if self.peek() == Some('~') {
-                        self.advance(); self.skip_ws();
-                        tokens.push(Token::WhileStart(self.read_line()));
+                b'?' => {
+                    self.skip_n(1); self.skip_ws();
+                    if self.peek_byte() == Some(b'~') {
+                        self.skip_n(1); self.skip_ws();
+                        Token::WhileStart(self.read_line())
                     } else {
-                        let kw = self.read_ident();
-                        match kw.as_str() {
-                            "ok"     => { tokens.push(Token::IfOk);  self.read_line(); }
-                            "err"    => { tokens.push(Token::IfErr); self.read_line(); }
-                            "switch" => { self.skip_ws(); tokens.push(Token::SwitchStart(self.read_line())); }
-                            _        => tokens.push(Token::Ident(format!("?{}", kw))),
+                        match self.read_ident() {
+                            "ok"     => { self.read_line(); Token::IfOk }
+                            "err"    => { self.read_line(); Token::IfErr }
+                            "switch" => { self.skip_ws(); Token::SwitchStart(self.read_line()) }
+                            kw       => Token::Ident(Cow::Owned(format!("?{}", kw))),
                         }
                     }
                 }
 
-                '#' => {
-                    self.advance();
-                    if self.peek() == Some('!') {
-                        tokens.push(Token::Comments(CommentKind::Line, self.read_line()));
-                        continue;
-                    }
-                    self.skip_ws();
-                    let rest = self.read_line();
-                    if let Some(decl) = parse_import_line(&rest) {
-                        tokens.push(Token::Import { lib: decl.spec, detail: decl.detail });
+                b'#' => {
+                    self.skip_n(1);
+                    if self.peek_byte() == Some(b'!') {
+                        Token::Comments(CommentKind::Line, self.read_line())
                     } else {
-                        tokens.push(Token::Import { lib: rest, detail: None });
+                        self.skip_ws();
+                        let rest = self.read_line();
+                        match parse_import_line(rest) {
+                            Some(decl) => Token::Import { lib: decl.spec, detail: decl.detail },
+                            None       => Token::Import { lib: rest.to_string(), detail: None },
+                        }
                     }
                 }
 
-                '"' => { tokens.push(Token::StringLit(self.read_string_lit()?)); }
+                b'"' => Token::StringLit(self.read_string_lit()?),
 
-                c if c.is_ascii_digit() => { tokens.push(Token::Number(self.read_number())); }
+                b'0'..=b'9' => Token::Number(self.read_number()),
 
-                c if c.is_alphabetic() => {
-                    let id = self.read_ident_full();
-                    match id.as_str() {
-                        "done"  => { tokens.push(Token::Done); self.read_line(); }
-                        "using" => { self.skip_ws(); let rest = self.read_line(); tokens.push(Token::Using(format!("using {}", rest))); }
-                        "true"  => tokens.push(Token::Bool(true)),
-                        "false" => tokens.push(Token::Bool(false)),
-                        _       => tokens.push(Token::Ident(id)),
-                    }
+                b'/' | b'.' => {
+                    let start = self.pos;
+                    self.skip_n(1);
+                    let end = self.scan_while(is_path_ascii, char::is_alphanumeric);
+                    Token::Ident(Cow::Borrowed(&self.src[start..end]))
                 }
 
-                '/' => {
-                    let mut path = String::from("/");
-                    self.advance();
-                    while let Some(c) = self.peek() {
-                        if c.is_alphanumeric() || matches!(c, '/' | '.' | '-' | '_') {
-                            path.push(c); self.advance();
-                        } else { break; }
+                b'=' => { self.skip_n(1); continue; }
+
+                _ => match self.peek() {
+                    Some(c) if c.is_alphabetic() => {
+                        let id = self.read_ident_full();
+                        match id {
+                            "done"  => { self.read_line(); Token::Done }
+                            "using" => {
+                                self.skip_ws();
+                                let rest = self.read_line();
+                                Token::Using(Cow::Owned(format!("using {}", rest)))
+                            }
+                            "true"  => Token::Bool(true),
+                            "false" => Token::Bool(false),
+                            _       => Token::Ident(Cow::Borrowed(id)),
+                        }
                     }
-                    tokens.push(Token::Ident(path));
-                }
+                    _ => return Err(self.unexpected()),
+                },
+            };
+            return Ok(tok);
+        }
+        Ok(Token::Eof)
+    }
 
-                '=' => { self.advance(); }
+    /// Błąd dla znaku pod kursorem (kursor przechodzi za niego)
+    fn unexpected(&mut self) -> LexError {
+        let (l, c) = (self.line, self.col);
+        let ch = self.advance().unwrap_or('\0');
+        LexError::UnexpectedChar(ch, l, c)
+    }
+}
 
-                '.' => {
-                    let mut path = String::from(".");
-                    self.advance();
-                    while let Some(c) = self.peek() {
-                        if c.is_alphanumeric() || matches!(c, '/' | '.' | '-' | '_') {
-                            path.push(c); self.advance();
-                        } else { break; }
-                    }
-                    tokens.push(Token::Ident(path));
-                }
+/// Leniwy strumień tokenów: kończy się po `Eof` albo po pierwszym błędzie
+impl<'a> Iterator for Lexer<'a> {
+    type Item = Result<Token<'a>, LexError>;
 
-                _ => {
-                    let (l, c) = (self.line, self.col);
-                    self.advance();
-                    return Err(LexError::UnexpectedChar(ch, l, c));
-                }
-            }
-        }
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.finished { return None; }
+        let t = self.next_token();
+        if matches!(t, Ok(Token::Eof) | Err(_)) { self.finished = true; }
+        Some(t)
+    }
+}
 
-        tokens.push(Token::Eof);
-        Ok(tokens)
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_tokens_borrow_source() {
+        let src = "~> hello\n> echo hi |> @out\n\"plain\"";
+        let toks = Lexer::new(src).tokenize().unwrap();
+        assert_eq!(toks[0], Token::Print("hello"));
+        assert_eq!(toks[2], Token::CmdPipeToVar { cmd: "echo hi", mode: PipeCmdMode::Plain, var_name: "out" });
+        assert!(matches!(&toks[4], Token::StringLit(Cow::Borrowed("plain"))));
+    }
+
+    #[test]
+    fn test_string_escapes_are_owned() {
+        let toks = Lexer::new(r#""a\tb\"c""#).tokenize().unwrap();
+        assert!(matches!(&toks[0], Token::StringLit(Cow::Owned(s)) if s == "a\tb\"c"));
+    }
+
+    #[test]
+    fn test_iterator_is_lazy_and_stops_on_error() {
+        let mut lx = Lexer::new("~> a\n~> b\n");
+        assert_eq!(lx.next().unwrap().unwrap(), Token::Print("a"));
+        assert_eq!(lx.line, 1);
+        let rest: Vec<_> = lx.collect();
+        assert_eq!(rest.len(), 4); // Newline, Print, Newline, Eof
+
+        let mut lx = Lexer::new("{ x");
+        assert!(matches!(lx.next(), Some(Err(LexError::UnexpectedChar('{', 1, 1)))));
+        assert!(lx.next().is_none());
+    }
+
+    #[test]
+    fn test_unicode_idents_and_columns() {
+        let mut lx = Lexer::new("@zażółć ~\n");
+        assert_eq!(lx.next().unwrap().unwrap(), Token::VarRef("zażółć"));
+        assert!(matches!(lx.next(), Some(Err(LexError::UnexpectedChar('~', 1, 9)))));
+    }
+
+    #[test]
+    fn test_underscore_var_and_repeat() {
+        let toks = Lexer::new("_3\n_1st\n_x").tokenize().unwrap();
+        assert_eq!(toks[0], Token::RepeatN(3));
+        assert_eq!(toks[2], Token::VarRef("_1st"));
+        assert_eq!(toks[4], Token::VarRef("_x"));
+    }
+
+    #[test]
+    fn test_block_comment_spans_lines() {
+        let toks = Lexer::new("// a\nb \\\\\n// git\n").tokenize().unwrap();
+        assert_eq!(toks[0], Token::Comments(CommentKind::Block, "a\nb"));
+        assert_eq!(toks[2], Token::Dependency("git", None));
     }
 }
@@ -5,14 +5,19 @@ pub mod parser;
 pub mod shebang;
 pub mod import_spec;
 pub mod extern_spec;
+pub mod sym;
+pub mod expr;
+pub mod quick_fn;
 
 pub use ast::*;
 pub use gen::{Gen, GenError, GenFeature, extract_gen, parse_gen_declaration, HL_MAX_GEN, HL_DEFAULT_GEN};
 pub use shebang::{ShebangInfo, PreprocessResult, preprocess};
 pub use lexer::{Lexer, Token, LexError};
-pub use parser::{Parser, ParseError, parse_source, parse_source_with_meta};
+pub use parser::{Parser, ParseError, parse_source, parse_source_with_meta, parse_source_with_lines};
 pub use import_spec::{parse_import_line, ImportDecl};
 pub use extern_spec::{ExternRuntime};
+pub use expr::{Expr, BinOp, UnOp, TestOp, parse_condition, parse_arith};
+pub use quick_fn::{QuickFn, QUICK_UNKNOWN};
 
 // ArenaSize jest częścią ast — re-export dla wygody
 pub use ast::ArenaSize;
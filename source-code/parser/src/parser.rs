@@ -4,6 +4,9 @@ use crate::extern_spec::ExternRuntime;
 use crate::shebang::preprocess;
 use crate::lexer::{LexError, Lexer, Token, CommentKind, PipeCmdMode};
 use crate::ParseMeta;
+use crate::sym::intern;
+use crate::expr::{expect_condition, parse_arith, ExprError};
+use crate::quick_fn::QuickFn;
 use thiserror::Error;
 
 #[derive(Debug, Error)]
@@ -20,30 +23,77 @@ pub enum ParseError {
     MissingExportListEnd,
     #[error("Błąd deklaracji gena: {0}")]
     Gen(#[from] GenError),
+    #[error("Błąd wyrażenia: {0}")]
+    Expr(#[from] ExprError),
 }
 
-pub struct Parser {
-    tokens: Vec<Token>,
+/// Parser pobiera tokeny z leksera leniwie — trzyma tylko jeden token naprzód
+pub struct Parser<'a> {
+    lexer:  Lexer<'a>,
+    peeked: Option<Token<'a>>,
+    /// Numer bieżącego tokenu (dla komunikatów błędów)
     pos:    usize,
+    /// Pierwszy błąd leksera — od niego strumień zwraca już tylko Eof,
+    /// a `parse` zgłasza ten błąd zamiast skutków przedwczesnego końca
+    lex_error: Option<LexError>,
     /// Nazwy zdefiniowanych arena functions — do rozróżnienia wywołań `:: nazwa`
     arena_funcs: std::collections::HashSet<String>,
+    /// Wstawiaj `Node::SourceLine` przed instrukcjami z nowej linii
+    lines: bool,
 }
 
-impl Parser {
-    pub fn new(tokens: Vec<Token>) -> Self {
+impl<'a> Parser<'a> {
+    pub fn new(lexer: Lexer<'a>) -> Self {
         Self {
-            tokens,
+            lexer,
+            peeked: None,
             pos: 0,
+            lex_error: None,
             arena_funcs: std::collections::HashSet::new(),
+            lines: false,
         }
     }
 
-    #[inline] fn peek(&self) -> &Token { self.tokens.get(self.pos).unwrap_or(&Token::Eof) }
+    /// Parser znaczący linie źródła (`Node::SourceLine`) — dla profilera
+    pub fn with_lines(mut self) -> Self {
+        self.lines = true;
+        self
+    }
+
+    /// Węzeł z `parse_node` do bloku, poprzedzony znacznikiem linii, na której
+    /// się zaczął (tylko gdy linia się zmieniła)
+    fn push_node(&mut self, nodes: &mut Vec<Node>, line: &mut u32) -> Result<(), ParseError> {
+        let at = self.lexer.line as u32;
+        if let Some(n) = self.parse_node()? {
+            if self.lines && at != *line && !n.is_comment() {
+                nodes.push(Node::SourceLine(at));
+                *line = at;
+            }
+            nodes.push(n);
+        }
+        Ok(())
+    }
 
-    fn advance(&mut self) -> Token {
-        let t = self.tokens.get(self.pos).cloned().unwrap_or(Token::Eof);
+    #[inline]
+    fn peek(&mut self) -> &Token<'a> {
+        if self.peeked.is_none() {
+            let t = if self.lex_error.is_some() {
+                Token::Eof
+            } else {
+                self.lexer.next_token().unwrap_or_else(|e| {
+                    self.lex_error = Some(e);
+                    Token::Eof
+                })
+            };
+            self.peeked = Some(t);
+        }
+        self.peeked.as_ref().unwrap_or(&Token::Eof)
+    }
+
+    fn advance(&mut self) -> Token<'a> {
+        self.peek();
         self.pos += 1;
-        t
+        self.peeked.take().unwrap_or(Token::Eof)
     }
 
     fn skip_newlines(&mut self) {
@@ -71,7 +121,8 @@ impl Parser {
             return VarValue::String(inner.to_string());
         }
         if value.starts_with("$(") && value.ends_with(')') {
-            return VarValue::Arithmetic(value[2..value.len()-1].trim().to_string());
+            let expr = value[2..value.len()-1].trim();
+            return VarValue::Arithmetic(expr.to_string(), parse_arith(expr));
         }
         if let Ok(n) = value.parse::<i64>() { return VarValue::Int(n); }
         if let Ok(n) = value.parse::<f64>() { return VarValue::Number(n); }
@@ -85,13 +136,56 @@ impl Parser {
         }
     }
 
+    /// `@ x in > cmd` / `>> cmd` / `^> cmd` / `^>> cmd` — pętla po wyjściu
+    /// komendy czytanym strumieniowo zamiast po gotowym stringu
+    fn split_for_in_cmd(iterable: &str) -> Option<(&str, CommandMode)> {
+        let it = iterable.trim_start();
+        let (rest, mode) = if let Some(r) = it.strip_prefix("^>>") {
+            (r, CommandMode::WithVarsSudo)
+        } else if let Some(r) = it.strip_prefix("^>") {
+            (r, CommandMode::Sudo)
+        } else if let Some(r) = it.strip_prefix(">>") {
+            (r, CommandMode::WithVars)
+        } else if let Some(r) = it.strip_prefix('>') {
+            (r, CommandMode::Plain)
+        } else {
+            return None;
+        };
+        let cmd = rest.trim();
+        if cmd.is_empty() { None } else { Some((cmd, mode)) }
+    }
+
+    /// `lines <reszta>` — pętla po liniach; zwraca resztę
+    fn split_for_in_lines(iterable: &str) -> (&str, bool) {
+        let it = iterable.trim_start();
+        match it.strip_prefix("lines") {
+            Some(rest) if rest.starts_with([' ', '\t']) && !rest.trim().is_empty() => (rest, true),
+            _ => (iterable, false),
+        }
+    }
+
+    /// `a..b`, gdzie każda granica to liczba całkowita albo `@zmienna`
+    fn split_for_range(iterable: &str) -> Option<(Vec<StringPart>, Vec<StringPart>)> {
+        let (from, to) = iterable.trim().split_once("..")?;
+        let bound = |s: &str| -> Option<Vec<StringPart>> {
+            if s.is_empty() || s.contains(char::is_whitespace) { return None; }
+            let parts = parse_string_parts(s);
+            match parts.as_slice() {
+                [StringPart::Var(_)] => Some(parts),
+                [StringPart::Literal(l)] if l.parse::<i64>().is_ok() => Some(parts),
+                _ => None,
+            }
+        };
+        Some((bound(from)?, bound(to)?))
+    }
+
     fn parse_export_list(&mut self) -> Result<Vec<Vec<StringPart>>, ParseError> {
         let mut items = Vec::new();
         loop {
             self.skip_newlines();
             match self.peek().clone() {
                 Token::ExportListEnd          => { self.advance(); break; }
-                Token::ExportListItem(val)    => { self.advance(); items.push(parse_string_parts(&val)); }
+                Token::ExportListItem(val)    => { self.advance(); items.push(parse_string_parts(val)); }
                 Token::Eof                    => return Err(ParseError::MissingExportListEnd),
                 _                             => { self.advance(); }
             }
@@ -116,7 +210,7 @@ impl Parser {
                             _ => { if let Some(n) = self.parse_node()? { body.push(n); } }
                         }
                     }
-                    arms.push(MatchArm { pattern, body });
+                    arms.push(MatchArm { pattern: pattern.to_string(), body });
                 }
                 _ => { self.advance(); }
             }
@@ -130,18 +224,18 @@ impl Parser {
             Token::Eof | Token::Done => Ok(None),
             Token::Newline           => { self.advance(); Ok(None) }
 
-            Token::Comments(CommentKind::Line,  t) => { self.advance(); Ok(Some(Node::LineComment(t))) }
-            Token::Comments(CommentKind::Doc,   t) => { self.advance(); Ok(Some(Node::DocComment(t))) }
-            Token::Comments(CommentKind::Block, t) => { self.advance(); Ok(Some(Node::BlockComment(t))) }
+            Token::Comments(CommentKind::Line,  t) => { self.advance(); Ok(Some(Node::LineComment(t.to_string()))) }
+            Token::Comments(CommentKind::Doc,   t) => { self.advance(); Ok(Some(Node::DocComment(t.to_string()))) }
+            Token::Comments(CommentKind::Block, t) => { self.advance(); Ok(Some(Node::BlockComment(t.to_string()))) }
 
             Token::Using(ref decl) => {
                 self.advance();
                 Ok(Some(Node::LineComment(format!("gen-decl: {}", decl))))
             }
 
-            Token::Print(msg)             => { self.advance(); Ok(Some(Node::Print { parts: parse_string_parts(&msg) })) }
-            Token::Background(raw)        => { self.advance(); Ok(Some(Node::Background { raw })) }
-            Token::HshCmd(raw)            => { self.advance(); Ok(Some(Node::HshCommand { raw })) }
+            Token::Print(msg)             => { self.advance(); Ok(Some(Node::Print { parts: parse_string_parts(msg) })) }
+            Token::Background(raw)        => { self.advance(); Ok(Some(Node::Background { raw: raw.to_string() })) }
+            Token::HshCmd(raw)            => { self.advance(); Ok(Some(Node::HshCommand { raw: raw.to_string() })) }
 
             // ── :: operator ──────────────────────────────────────────────────
             //
@@ -152,32 +246,37 @@ impl Parser {
             // ArenaFuncDef z leksera → Node::ArenaFuncDef (rejestruje nazwę)
             Token::QuickCall { name, args } => {
                 self.advance();
-                if self.arena_funcs.contains(&name) {
+                if self.arena_funcs.contains(name) {
                     Ok(Some(Node::ArenaFuncCall {
-                        name,
-                        args: parse_string_parts(&args),
+                        name: name.to_string(),
+                        args: parse_string_parts(args),
                     }))
                 } else {
-                    Ok(Some(Node::QuickCall { name, args: parse_string_parts(&args) }))
+                    Ok(Some(Node::QuickCall {
+                        name: name.to_string(),
+                        func: QuickFn::from_name(name),
+                        args: parse_string_parts(args),
+                    }))
                 }
             }
             // :: name args |> @var  — QuickCall z przechwyceniem wyjścia do zmiennej
             Token::QuickPipeToVar { name, args, var_name } => {
                 self.advance();
                 Ok(Some(Node::QuickPipeToVar {
-                    name,
-                    args:     parse_string_parts(&args),
-                    var_name,
+                    name:     name.to_string(),
+                    func:     QuickFn::from_name(name),
+                    args:     parse_string_parts(args),
+                    var_name: intern(var_name),
                 }))
             }
 
             Token::ArenaFuncDef { name, arena_size } => {
                 self.advance();
                 // Zarejestruj nazwę areny żeby przyszłe `:: nazwa` były ArenaFuncCall
-                self.arena_funcs.insert(name.clone());
-                let size = ArenaSize::parse(&arena_size);
+                self.arena_funcs.insert(name.to_string());
+                let size = ArenaSize::parse(arena_size);
                 Ok(Some(Node::ArenaFuncDef {
-                    name,
+                    name: name.to_string(),
                     arena_size: size,
                     body: self.parse_block()?,
                 }))
@@ -190,31 +289,62 @@ impl Parser {
                 Ok(Some(Node::RepeatN { count: n, body }))
             }
 
-            Token::FileImport { path, detail } => { self.advance(); Ok(Some(Node::FileImport { path, detail })) }
+            Token::FileImport { path, detail } => {
+                self.advance();
+                Ok(Some(Node::FileImport { path: path.to_string(), detail: detail.map(str::to_string) }))
+            }
 
-            Token::DirImport { path } => { self.advance(); Ok(Some(Node::DirImport { path })) }
+            Token::DirImport { path } => { self.advance(); Ok(Some(Node::DirImport { path: path.to_string() })) }
 
             Token::GoroutineStart { name } => {
                 self.advance();
-                Ok(Some(Node::Goroutine { name, body: self.parse_block()? }))
+                Ok(Some(Node::Goroutine { name: name.map(str::to_string), body: self.parse_block()? }))
+            }
+            Token::GoroutineWait(name) => { self.advance(); Ok(Some(Node::GoroutineWait { name: name.map(str::to_string) })) }
+            Token::ChannelDecl { name, cap } => { self.advance(); Ok(Some(Node::Channel { name: name.to_string(), cap })) }
+            Token::ChannelSend { name, value } => {
+                self.advance();
+                Ok(Some(Node::ChannelOp {
+                    name:     name.to_string(),
+                    value:    Some(parse_string_parts(value)),
+                    var_name: None,
+                }))
+            }
+            Token::ChannelOp { name, var_name } => {
+                self.advance();
+                Ok(Some(Node::ChannelOp { name: name.to_string(), value: None, var_name: var_name.map(intern) }))
             }
-            Token::ChannelDecl(name) => { self.advance(); Ok(Some(Node::Channel { name })) }
-            Token::ChannelOp(name)   => { self.advance(); Ok(Some(Node::ChannelOp { name, value: None })) }
 
             Token::ForIn { var, iterable } => {
                 self.advance();
-                Ok(Some(Node::ForIn { var, iterable: parse_string_parts(&iterable), body: self.parse_block()? }))
+                if let Some((from, to)) = Self::split_for_range(iterable) {
+                    return Ok(Some(Node::ForRange { var: intern(var), from, to, body: self.parse_block()? }));
+                }
+                let (iterable, lines) = Self::split_for_in_lines(iterable);
+                if let Some((command, mode)) = Self::split_for_in_cmd(iterable) {
+                    let command = command.to_string();
+                    return Ok(Some(Node::ForInCmd { var: intern(var), command, mode, lines, body: self.parse_block()? }));
+                }
+                let iterable = parse_string_parts(iterable.trim_start());
+                Ok(Some(Node::ForIn { var: intern(var), iterable, lines, body: self.parse_block()? }))
             }
             Token::WhileStart(condition) => {
                 self.advance();
-                Ok(Some(Node::WhileLoop { condition: parse_string_parts(&condition), body: self.parse_block()? }))
+                Ok(Some(Node::WhileLoop {
+                    condition: parse_string_parts(condition),
+                    parsed:    expect_condition(condition)?,
+                    body:      self.parse_block()?,
+                }))
             }
             Token::SwitchStart(subject) => {
                 self.advance();
-                Ok(Some(Node::MatchExpr { subject: parse_string_parts(&subject), arms: self.parse_switch_arms()? }))
+                Ok(Some(Node::MatchExpr { subject: parse_string_parts(subject), arms: self.parse_switch_arms()? }))
             }
 
-            Token::Arithmetic { expr, assign_to } => { self.advance(); Ok(Some(Node::Arithmetic { expr, assign_to })) }
+            Token::Arithmetic { expr, assign_to } => {
+                self.advance();
+                Ok(Some(Node::Arithmetic { expr: expr.to_string(), parsed: parse_arith(expr), assign_to: assign_to.map(intern) }))
+            }
 
             Token::CmdPipeToVar { cmd, mode, var_name } => {
                 self.advance();
@@ -223,60 +353,63 @@ impl Parser {
                     PipeCmdMode::Sudo     => CommandMode::Sudo,
                     PipeCmdMode::WithVars => CommandMode::WithVars,
                 };
-                Ok(Some(Node::PipeToVar { command: cmd, mode: cmd_mode, var_name }))
+                Ok(Some(Node::PipeToVar { command: cmd.to_string(), mode: cmd_mode, var_name: intern(var_name) }))
             }
 
             Token::HackerOsApi { tool, args } => {
                 self.advance();
                 Ok(Some(Node::HackerOsApi {
-                    tool: HackerOsTool::from_str(&tool),
-                        args: parse_string_parts(&args),
+                    tool: HackerOsTool::from_str(tool),
+                        args: parse_string_parts(args),
                 }))
             }
 
-            Token::Cmd(raw)                 => { self.advance(); Ok(Some(Node::Command { raw, mode: CommandMode::Plain,            interpolate: false })) }
-            Token::CmdSudo(raw)             => { self.advance(); Ok(Some(Node::Command { raw, mode: CommandMode::Sudo,             interpolate: false })) }
-            Token::CmdIsolated(raw)         => { self.advance(); Ok(Some(Node::Command { raw, mode: CommandMode::Isolated,         interpolate: false })) }
-            Token::CmdIsolatedSudo(raw)     => { self.advance(); Ok(Some(Node::Command { raw, mode: CommandMode::IsolatedSudo,     interpolate: false })) }
-            Token::CmdWithVars(raw)         => { self.advance(); Ok(Some(Node::Command { raw, mode: CommandMode::WithVars,         interpolate: true  })) }
-            Token::CmdWithVarsSudo(raw)     => { self.advance(); Ok(Some(Node::Command { raw, mode: CommandMode::WithVarsSudo,     interpolate: true  })) }
-            Token::CmdWithVarsIsolated(raw) => { self.advance(); Ok(Some(Node::Command { raw, mode: CommandMode::WithVarsIsolated, interpolate: true  })) }
+            Token::Cmd(raw)                 => { self.advance(); Ok(Some(Node::Command { raw: raw.to_string(), mode: CommandMode::Plain,            interpolate: false })) }
+            Token::CmdSudo(raw)             => { self.advance(); Ok(Some(Node::Command { raw: raw.to_string(), mode: CommandMode::Sudo,             interpolate: false })) }
+            Token::CmdIsolated(raw)         => { self.advance(); Ok(Some(Node::Command { raw: raw.to_string(), mode: CommandMode::Isolated,         interpolate: false })) }
+            Token::CmdIsolatedSudo(raw)     => { self.advance(); Ok(Some(Node::Command { raw: raw.to_string(), mode: CommandMode::IsolatedSudo,     interpolate: false })) }
+            Token::CmdWithVars(raw)         => { self.advance(); Ok(Some(Node::Command { raw: raw.to_string(), mode: CommandMode::WithVars,         interpolate: true  })) }
+            Token::CmdWithVarsSudo(raw)     => { self.advance(); Ok(Some(Node::Command { raw: raw.to_string(), mode: CommandMode::WithVarsSudo,     interpolate: true  })) }
+            Token::CmdWithVarsIsolated(raw) => { self.advance(); Ok(Some(Node::Command { raw: raw.to_string(), mode: CommandMode::WithVarsIsolated, interpolate: true  })) }
 
             Token::VarDecl { name, typ, value } => {
                 self.advance();
-                let var_type = VarType::from_str(&typ);
-                Ok(Some(Node::VarDecl { name, typ: var_type, value: Self::parse_var_value(&value, &typ) }))
+                let var_type = VarType::from_str(typ);
+                Ok(Some(Node::VarDecl { name: intern(name), typ: var_type, value: Self::parse_var_value(value, typ) }))
             }
-            Token::VarRef(name) => { self.advance(); Ok(Some(Node::VarRef(name))) }
+            Token::VarRef(name) => { self.advance(); Ok(Some(Node::VarRef(intern(name)))) }
 
             Token::ExportSingle { name, value } => {
                 self.advance();
-                Ok(Some(Node::Export { name, value: ExportValue::Single(parse_string_parts(&value)) }))
+                Ok(Some(Node::Export { name: intern(name), value: ExportValue::Single(parse_string_parts(value)) }))
             }
             Token::ExportListStart(name) => {
                 self.advance();
-                Ok(Some(Node::Export { name, value: ExportValue::List(self.parse_export_list()?) }))
+                Ok(Some(Node::Export { name: intern(name), value: ExportValue::List(self.parse_export_list()?) }))
             }
             Token::ExportListItem(_) | Token::ExportListEnd => { self.advance(); Ok(None) }
 
-            Token::Dependency(name, apt_package) => { self.advance(); Ok(Some(Node::Dependency { name, apt_package })) }
+            Token::Dependency(name, apt_package) => {
+                self.advance();
+                Ok(Some(Node::Dependency { name: name.to_string(), apt_package: apt_package.map(str::to_string) }))
+            }
             Token::Import { lib, detail } => { self.advance(); Ok(Some(Node::Import { lib, detail })) }
 
             Token::FuncDef(name) => {
                 self.advance();
-                Ok(Some(Node::FuncDef { name, body: self.parse_block()? }))
+                Ok(Some(Node::FuncDef { name: name.to_string(), body: self.parse_block()? }))
             }
-            Token::FuncCall(name) => { self.advance(); Ok(Some(Node::FuncCall { name })) }
+            Token::FuncCall(name) => { self.advance(); Ok(Some(Node::FuncCall { name: name.to_string() })) }
 
             Token::IfOk  => { self.advance(); Ok(Some(Node::Conditional { condition: ConditionKind::Ok,  body: self.parse_block()? })) }
             Token::IfErr => { self.advance(); Ok(Some(Node::Conditional { condition: ConditionKind::Err, body: self.parse_block()? })) }
 
             Token::ExternStart { file, runtime: rt_str } => {
                 self.advance();
-                let runtime = ExternRuntime::from_str(&rt_str)
+                let runtime = ExternRuntime::from_str(rt_str)
                     .unwrap_or(ExternRuntime::Elf);
                 Ok(Some(Node::ExternDef {
-                    file,
+                    file: file.to_string(),
                     runtime,
                     body: self.parse_block()?,
                 }))
@@ -296,23 +429,36 @@ impl Parser {
 
     fn parse_block(&mut self) -> Result<Vec<Node>, ParseError> {
         let mut nodes = Vec::with_capacity(8);
+        let mut line  = 0;
         loop {
             self.skip_newlines();
             match self.peek() {
                 Token::Done => { self.advance(); break; }
                 Token::Eof  => return Err(ParseError::MissingDone),
-                _           => { if let Some(n) = self.parse_node()? { nodes.push(n); } }
+                _           => self.push_node(&mut nodes, &mut line)?,
             }
         }
         Ok(nodes)
     }
 
     pub fn parse(&mut self) -> Result<Vec<Node>, ParseError> {
+        let res = self.parse_nodes();
+        // Błąd leksera wygląda dla parsera jak Eof — zgłoś przyczynę, nie MissingDone
+        if let Some(e) = self.lex_error.take() { return Err(e.into()); }
+        res
+    }
+
+    fn parse_nodes(&mut self) -> Result<Vec<Node>, ParseError> {
         let mut nodes = Vec::with_capacity(32);
+        let mut line  = 0;
         loop {
             self.skip_newlines();
-            if matches!(self.peek(), Token::Eof) { break; }
-            if let Some(n) = self.parse_node()? { nodes.push(n); }
+            match self.peek() {
+                Token::Eof  => break,
+                // Nadmiarowe `done` poza blokiem — parse_node go nie zjada
+                Token::Done => { self.advance(); }
+                _           => self.push_node(&mut nodes, &mut line)?,
+            }
         }
         Ok(nodes)
     }
@@ -323,12 +469,21 @@ pub fn parse_source(source: &str) -> Result<Vec<Node>, ParseError> {
 }
 
 pub fn parse_source_with_meta(source: &str) -> Result<ParseMeta, ParseError> {
+    parse_meta(source, false)
+}
+
+/// Jak `parse_source_with_meta`, z `Node::SourceLine` przed instrukcjami
+/// (numery linii pliku, także ze shebangiem) — `hl run --profile`
+pub fn parse_source_with_lines(source: &str) -> Result<ParseMeta, ParseError> {
+    parse_meta(source, true)
+}
+
+fn parse_meta(source: &str, lines: bool) -> Result<ParseMeta, ParseError> {
     let preprocessed = preprocess(source);
     let (gen, gen_err) = extract_gen(&preprocessed.source);
     if let Some(err) = gen_err { return Err(ParseError::Gen(err)); }
-    let mut lexer  = Lexer::new(&preprocessed.source);
-    let tokens     = lexer.tokenize()?;
-    let mut parser = Parser::new(tokens);
+    let mut parser = Parser::new(Lexer::new(&preprocessed.source));
+    if lines { parser = parser.with_lines(); }
     let nodes      = parser.parse()?;
     Ok(ParseMeta { nodes, gen, shebang: preprocessed.shebang })
 }
@@ -378,7 +533,7 @@ mod tests {
         // Wbudowane quick-calls (nie zdefiniowane jako arena) → QuickCall
         let src = ":: green hello world";
         let nodes = parse_source(src).unwrap();
-        assert!(nodes.iter().any(|n| matches!(n, Node::QuickCall { name, .. } if name == "green")));
+        assert!(nodes.iter().any(|n| matches!(n, Node::QuickCall { name, func: Some(QuickFn::Green), .. } if name == "green")));
     }
 
     #[test]
@@ -394,9 +549,101 @@ mod tests {
         assert!(parse_source(src).is_ok());
     }
 
+    #[test]
+    fn test_for_in_cmd() {
+        let nodes = parse_source("@f in >> find @dir -name x\n~> @f\ndone").unwrap();
+        match &nodes[0] {
+            Node::ForInCmd { var, command, mode, lines, body } => {
+                assert_eq!(var, "f");
+                assert_eq!(command, "find @dir -name x");
+                assert_eq!(*mode, CommandMode::WithVars);
+                assert!(!lines);
+                assert_eq!(body.len(), 1);
+            }
+            other => panic!("oczekiwano ForInCmd, jest {:?}", other),
+        }
+        // Zwykłe słowa nadal dają ForIn
+        assert!(matches!(parse_source("@x in a > b\ndone").unwrap()[0], Node::ForIn { .. }));
+        assert!(matches!(parse_source("@l in lines > cat plik\ndone").unwrap()[0], Node::ForInCmd { lines: true, .. }));
+    }
+
+    #[test]
+    fn test_for_in_lines_and_range() {
+        let nodes = parse_source("@l in lines @tekst\n~> @l\ndone").unwrap();
+        assert!(matches!(&nodes[0], Node::ForIn { lines: true, iterable, .. } if iterable.len() == 1));
+        // Samo słowo `lines` to zwykły element listy
+        assert!(matches!(parse_source("@w in lines\ndone").unwrap()[0], Node::ForIn { lines: false, .. }));
+
+        match &parse_source("@i in 1..@n\n~> @i\ndone").unwrap()[0] {
+            Node::ForRange { var, from, to, .. } => {
+                assert_eq!(var, "i");
+                assert!(matches!(from.as_slice(), [StringPart::Literal(l)] if l == "1"));
+                assert!(matches!(to.as_slice(), [StringPart::Var(v)] if v == "n"));
+            }
+            other => panic!("oczekiwano ForRange, jest {:?}", other),
+        }
+        // Nie-liczby i kilka słów zostają listą słów
+        assert!(matches!(parse_source("@x in a..b\ndone").unwrap()[0], Node::ForIn { .. }));
+        assert!(matches!(parse_source("@x in 1..2 3\ndone").unwrap()[0], Node::ForIn { .. }));
+    }
+
+    #[test]
+    fn test_channels_and_wait() {
+        let src = ":** wyniki 8\n:* worker\n:**: wyniki = gotowe @x\ndone\n*-- wyniki |> @msg\n:*~ worker\n:*~";
+        let nodes = parse_source(src).unwrap();
+        assert!(matches!(&nodes[0], Node::Channel { name, cap: Some(8) } if name == "wyniki"));
+        match &nodes[1] {
+            Node::Goroutine { name, body } => {
+                assert_eq!(name.as_deref(), Some("worker"));
+                assert!(matches!(&body[0], Node::ChannelOp { value: Some(v), var_name: None, .. } if v.len() == 2));
+            }
+            other => panic!("oczekiwano Goroutine, jest {:?}", other),
+        }
+        assert!(matches!(&nodes[2], Node::ChannelOp { value: None, var_name: Some(v), .. } if v == "msg"));
+        assert!(matches!(&nodes[3], Node::GoroutineWait { name: Some(n) } if n == "worker"));
+        assert!(matches!(&nodes[4], Node::GoroutineWait { name: None }));
+    }
+
+    #[test]
+    fn test_lex_error_reported_inside_block() {
+        // Nieznany znak w bloku — przyczyną jest lekser, nie brak `done`
+        let err = parse_source(":: f def\n~> a\n{\ndone").unwrap_err();
+        assert!(matches!(err, ParseError::Lex(_)), "{:?}", err);
+    }
+
+    #[test]
+    fn test_while_and_arith_parsed() {
+        let nodes = parse_source("?~ @i < @n\n$(@i + 1) -> @i\ndone").unwrap();
+        match &nodes[0] {
+            Node::WhileLoop { parsed: crate::expr::Expr::Binary { .. }, body, .. } => {
+                assert!(matches!(&body[0], Node::Arithmetic { parsed: Some(_), assign_to: Some(v), .. } if v == "i"));
+            }
+            other => panic!("oczekiwano WhileLoop z wyrażeniem, jest {:?}", other),
+        }
+        // Komenda jako warunek — błąd parsowania, nie `sh -c` w runtime
+        let err = parse_source("?~ ping -c1 host\ndone").unwrap_err();
+        assert!(matches!(err, ParseError::Expr(ExprError::Condition(_))), "{:?}", err);
+    }
+
     #[test]
     fn test_switch() {
         let src = "? switch @x\n| a\n~> A\n| *\n~> other\ndone";
         assert!(parse_source(src).is_ok());
     }
+
+    #[test]
+    fn test_source_lines_only_on_request() {
+        let src = "~> a\n\n:: f def\n~> b\n~> c\ndone\n";
+        assert!(!parse_source(src).unwrap().iter().any(|n| matches!(n, Node::SourceLine(_))));
+        let nodes = parse_source_with_lines(src).unwrap().nodes;
+        assert!(matches!(nodes[0], Node::SourceLine(1)));
+        assert!(matches!(nodes[2], Node::SourceLine(3)));
+        match &nodes[3] {
+            Node::ArenaFuncDef { body, .. } => {
+                assert!(matches!(body[0], Node::SourceLine(4)));
+                assert!(matches!(body[2], Node::SourceLine(5)));
+            }
+            other => panic!("oczekiwano ArenaFuncDef, jest {:?}", other),
+        }
+    }
 }
@@ -0,0 +1,77 @@
+//! Wbudowane quick-funkcje `:: nazwa args`
+//!
+//! Nazwa rozwiązywana jest raz, w parserze, do `QuickFn` — executor i
+//! bytecode (`CallQuick`, pole `aux` rekordu) dispatchują po numerze, bez
+//! porównywania stringów przy każdym wywołaniu.
+
+use serde::{Deserialize, Serialize};
+
+macro_rules! quick_fns {
+    ($($var:ident = $name:literal),* $(,)?) => {
+        #[derive(Debug, Clone, Copy, Serialize, Deserialize, PartialEq, Eq, Hash)]
+        #[repr(u8)]
+        pub enum QuickFn { $($var),* }
+
+        impl QuickFn {
+            /// Wszystkie funkcje w kolejności numerów (`id`)
+            pub const ALL: &'static [QuickFn] = &[$(QuickFn::$var),*];
+
+            pub fn from_name(name: &str) -> Option<Self> {
+                match name {
+                    $($name => Some(QuickFn::$var),)*
+                    _ => None,
+                }
+            }
+
+            pub fn name(self) -> &'static str {
+                match self { $(QuickFn::$var => $name),* }
+            }
+        }
+    };
+}
+
+quick_fns! {
+    Upper = "upper", Lower = "lower", Len = "len", Trim = "trim", Rev = "rev",
+    Repeat = "repeat", Replace = "replace",
+    Contains = "contains", StartsWith = "startswith", EndsWith = "endswith",
+    Split = "split", Lines = "lines", Words = "words",
+    Abs = "abs", Ceil = "ceil", Floor = "floor", Round = "round", Max = "max", Min = "min",
+    Rand = "rand",
+    Env = "env", EnvPath = "env-path", Getenv = "getenv",
+    Date = "date", Time = "time", Pid = "pid", Which = "which",
+    Exists = "exists", IsDir = "isdir", IsFile = "isfile",
+    Basename = "basename", Dirname = "dirname", Read = "read",
+    Set = "set", Get = "get", Type = "type", Unset = "unset",
+    Nl = "nl", Hr = "hr", Bold = "bold", Red = "red", Green = "green", Yellow = "yellow", Cyan = "cyan",
+}
+
+/// `aux` rekordu `CallQuick` dla nazwy spoza tabeli
+pub const QUICK_UNKNOWN: u8 = u8::MAX;
+
+impl QuickFn {
+    #[inline]
+    pub fn id(self) -> u8 { self as u8 }
+
+    #[inline]
+    pub fn from_id(id: u8) -> Option<Self> {
+        Self::ALL.get(id as usize).copied()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_ids_and_names_roundtrip() {
+        assert!(QuickFn::ALL.len() < QUICK_UNKNOWN as usize);
+        for (i, f) in QuickFn::ALL.iter().enumerate() {
+            assert_eq!(f.id() as usize, i);
+            assert_eq!(QuickFn::from_id(f.id()), Some(*f));
+            assert_eq!(QuickFn::from_name(f.name()), Some(*f));
+        }
+        assert_eq!(QuickFn::from_name("env-path"), Some(QuickFn::EnvPath));
+        assert_eq!(QuickFn::from_name("nope"), None);
+        assert_eq!(QuickFn::from_id(QUICK_UNKNOWN), None);
+    }
+}
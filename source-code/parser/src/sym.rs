@@ -0,0 +1,136 @@
+//! Tablica symboli zmiennych — nazwa → slot, wspólna dla całego procesu
+//!
+//! Parser zamienia każdą nazwę zmiennej w AST na `Ident` (nazwa + slot) już
+//! przy parsowaniu, więc executor AST indeksuje płaską ramkę zmiennych zamiast
+//! hashować i klonować klucze `String` przy każdym dostępie.
+//!
+//! Sloty są globalne (te same dla głównego skryptu, bibliotek, REPL i
+//! goroutines), dlatego AST biblioteki z cache działa w każdym `Env`, a dziecko
+//! może współdzielić ramkę rodzica (copy-on-write). Nazwy nie są nigdy
+//! zwalniane — tablica rośnie tylko o nowe identyfikatory. Ramka nie jest
+//! jednak indeksowana slotem wprost: `hl_core::env` przydziela pozycje tylko
+//! zmiennym ustawionym przez program, więc jej rozmiar nie zależy od liczby
+//! nazw zebranych w procesie (demon, REPL).
+
+use rustc_hash::FxHashMap;
+use serde::{Deserialize, Deserializer, Serialize, Serializer};
+use std::sync::RwLock;
+
+pub type Slot = u32;
+
+struct Table {
+    map:   FxHashMap<&'static str, Slot>,
+    names: Vec<&'static str>,
+}
+
+static TABLE: RwLock<Option<Table>> = RwLock::new(None);
+
+/// Slot nazwy — nadawany przy pierwszym użyciu
+pub fn intern(name: &str) -> Ident {
+    if let Some(id) = lookup(name) { return id; }
+    let mut g = TABLE.write().unwrap_or_else(|e| e.into_inner());
+    let t = g.get_or_insert_with(|| Table { map: FxHashMap::default(), names: Vec::new() });
+    if let Some(&slot) = t.map.get(name) {
+        return Ident { name: t.names[slot as usize], slot };
+    }
+    let name: &'static str = Box::leak(name.into());
+    let slot = t.names.len() as Slot;
+    t.names.push(name);
+    t.map.insert(name, slot);
+    Ident { name, slot }
+}
+
+/// Slot nazwy bez nadawania nowego (odczyt nieznanej zmiennej nie rośnie tablicy)
+pub fn lookup(name: &str) -> Option<Ident> {
+    let g = TABLE.read().unwrap_or_else(|e| e.into_inner());
+    let t = g.as_ref()?;
+    t.map.get(name).map(|&slot| Ident { name: t.names[slot as usize], slot })
+}
+
+/// Nazwa slotu ("" dla nieznanego)
+pub fn name(slot: Slot) -> &'static str {
+    let g = TABLE.read().unwrap_or_else(|e| e.into_inner());
+    g.as_ref().and_then(|t| t.names.get(slot as usize).copied()).unwrap_or("")
+}
+
+/// Nazwa zmiennej z przypisanym slotem. Deref do `&str`; w JSON/bincode
+/// zapisywana jako zwykły string (slot nadawany ponownie przy odczycie).
+#[derive(Clone, Copy)]
+pub struct Ident {
+    name: &'static str,
+    slot: Slot,
+}
+
+impl Ident {
+    #[inline(always)] pub fn slot(&self) -> Slot { self.slot }
+    #[inline(always)] pub fn as_str(&self) -> &'static str { self.name }
+}
+
+impl std::ops::Deref for Ident {
+    type Target = str;
+    #[inline(always)]
+    fn deref(&self) -> &str { self.name }
+}
+
+impl AsRef<str> for Ident {
+    fn as_ref(&self) -> &str { self.name }
+}
+
+impl PartialEq for Ident {
+    fn eq(&self, other: &Self) -> bool { self.slot == other.slot }
+}
+
+impl Eq for Ident {}
+
+impl PartialEq<str> for Ident {
+    fn eq(&self, other: &str) -> bool { self.name == other }
+}
+
+impl PartialEq<&str> for Ident {
+    fn eq(&self, other: &&str) -> bool { self.name == *other }
+}
+
+impl std::fmt::Debug for Ident {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        std::fmt::Debug::fmt(self.name, f)
+    }
+}
+
+impl std::fmt::Display for Ident {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.write_str(self.name)
+    }
+}
+
+impl From<&str> for Ident {
+    fn from(s: &str) -> Self { intern(s) }
+}
+
+impl Serialize for Ident {
+    fn serialize<S: Serializer>(&self, s: S) -> Result<S::Ok, S::Error> {
+        s.serialize_str(self.name)
+    }
+}
+
+impl<'de> Deserialize<'de> for Ident {
+    fn deserialize<D: Deserializer<'de>>(d: D) -> Result<Self, D::Error> {
+        let s = String::deserialize(d)?;
+        Ok(intern(&s))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_same_name_same_slot() {
+        let a = intern("sym_test_a");
+        let b = intern("sym_test_b");
+        assert_ne!(a.slot(), b.slot());
+        assert_eq!(intern("sym_test_a").slot(), a.slot());
+        assert_eq!(name(b.slot()), "sym_test_b");
+        assert!(lookup("sym_test_nieznana").is_none());
+        assert_eq!(a, "sym_test_a");
+    }
+}
@@ -0,0 +1,40 @@
+//! Runtime programów z `hl compile --native` (`libhl_rt.a`)
+//!
+//! Obiekt programu eksportuje `main` (albo `hl_main` przy `--shared`), które
+//! woła `hl_aot_main` z obrazem programu. Tu jest tylko to, czego potrzebuje
+//! wykonanie: interpreter bytecode, interner, spawner i quick-funkcje
+//! (`hl_jit` + `hl_core`). Parser, kompilator i Cranelift nie są na ścieżce
+//! startu — trasy pętli przychodzą gotowe w obiekcie.
+
+use hl_jit::aot::{run_image, AotImage};
+use std::ffi::{c_char, c_int, CStr};
+
+/// Wejście programu AOT: argumenty jak w `main` (argv[0] pomijamy — `@arg0`
+/// to pierwszy argument skryptu, jak w `hl run`).
+///
+/// # Safety
+/// `image` wskazuje obraz zapisany przez `hl_jit::aot::emit_object`, a `argv`
+/// — `argc` wskaźników na stringi C zakończone zerem.
+#[no_mangle]
+pub unsafe extern "C" fn hl_aot_main(image: *const AotImage, argc: c_int, argv: *const *const c_char) -> c_int {
+    hl_core::metrics::init();
+    hl_core::metrics::add_collector(hl_jit::collect_metrics);
+
+    let args: Vec<String> = (1..argc.max(0) as usize)
+        .map(|i| *argv.add(i))
+        .filter(|p| !p.is_null())
+        .map(|p| CStr::from_ptr(p).to_string_lossy().into_owned())
+        .collect();
+
+    let Some(image) = image.as_ref() else {
+        eprintln!("\x1b[31m[hl]\x1b[0m Brak obrazu programu");
+        return 1;
+    };
+    match run_image(image, &args) {
+        Ok(code) => code,
+        Err(e)   => {
+            eprintln!("\x1b[31m[hl]\x1b[0m {}", e);
+            1
+        }
+    }
+}
@@ -1,10 +1,10 @@
 use colored::Colorize;
-use hl_core::env::Env;
+use crate::repl::Repl;
 use std::env as std_env;
 
 pub enum BuiltinResult { Handled(i32), NotBuiltin }
 
-pub fn try_builtin(line: &str, env: &mut Env) -> BuiltinResult {
+pub fn try_builtin(line: &str, repl: &mut Repl) -> BuiltinResult {
     let trimmed = line.trim();
     let mut parts = trimmed.splitn(2, ' ');
     let cmd  = parts.next().unwrap_or("");
@@ -24,17 +24,16 @@ pub fn try_builtin(line: &str, env: &mut Env) -> BuiltinResult {
         "help"          => { print_help(); BuiltinResult::Handled(0) }
         "vars"          => {
             println!("{}", "=== Hacker Lang Variables ===".cyan().bold());
-            let mut names: Vec<&String> = env.vars.keys().collect();
-            names.sort();
-            for name in names {
-                let val = env.get_var(name);
-                println!("  {} {} = {}", "%".yellow(), name.bright_white(), val.to_string_val().green());
+            let mut vars = repl.vars();
+            vars.sort();
+            for (name, val) in vars {
+                println!("  {} {} = {}", "%".yellow(), name.bright_white(), val.green());
             }
             BuiltinResult::Handled(0)
         }
         "funcs" => {
             println!("{}", "=== Defined Functions ===".cyan().bold());
-            let mut names: Vec<&String> = env.functions.keys().collect();
+            let mut names = repl.funcs();
             names.sort();
             for name in names { println!("  {} {}()", ":".yellow(), name.bright_white()); }
             BuiltinResult::Handled(0)
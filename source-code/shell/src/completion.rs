@@ -4,6 +4,9 @@ use rustyline::hint::Hinter;
 use rustyline::validate::Validator;
 use rustyline::{Context, Helper};
 use std::borrow::Cow;
+use std::cell::RefCell;
+use std::ffi::CString;
+use std::os::unix::fs::PermissionsExt;
 
 const HL_KEYWORDS: &[&str] = &[
     // Output
@@ -18,7 +21,7 @@ const HL_KEYWORDS: &[&str] = &[
     // Commands gen 1
     ">", "^>", "->", "^->", ">>", "^>>", "->>",
     // Gen 1 new
-    "&", "*>", ":*", ":**", "*--",
+    "&", "*>", ":*", ":**", ":**:", ":*~", "*--",
     // Gen 2 — pipe do zmiennej
     "|>",
     // Gen 2 — arytmetyka
@@ -56,10 +59,110 @@ const HL_KEYWORDS: &[&str] = &[
     "using", "using <gen 1>", "using <gen 2>",
 ];
 
-pub struct HlCompleter { file: FilenameCompleter }
+/// Tokeny, po których następuje nazwa programu
+const CMD_SIGILS: &[&str] = &[">", "^>", "->", "^->", ">>", "^>>", "->>", "&", "*>", "//"];
+
+/// Programy z PATH. Indeks budujemy raz; inotify na katalogach PATH oznacza
+/// go jako nieaktualny (instalacja, usunięcie, `chmod +x`), a przebudowa
+/// następuje dopiero przy kolejnym dopełnianiu. Bez inotify porównujemy
+/// czasy modyfikacji katalogów.
+struct CommandIndex {
+    /// PATH, dla którego zbudowano indeks
+    path:   String,
+    /// Posortowane, bez powtórzeń
+    names:  Vec<String>,
+    notify: Option<Inotify>,
+    mtimes: Vec<Option<std::time::SystemTime>>,
+}
+
+impl CommandIndex {
+    fn new() -> Self {
+        Self { path: String::new(), names: Vec::new(), notify: None, mtimes: Vec::new() }
+    }
+
+    /// Programy zaczynające się od `prefix`
+    fn matching(&mut self, prefix: &str) -> &[String] {
+        let path = std::env::var("PATH").unwrap_or_default();
+        if path != self.path || self.is_stale() { self.rebuild(path); }
+        let from = self.names.partition_point(|n| n.as_str() < prefix);
+        let to   = from + self.names[from..].partition_point(|n| n.starts_with(prefix));
+        &self.names[from..to]
+    }
+
+    fn is_stale(&mut self) -> bool {
+        match self.notify.as_mut() {
+            Some(n) => n.changed(),
+            None    => dir_mtimes(&self.path) != self.mtimes,
+        }
+    }
+
+    fn rebuild(&mut self, path: String) {
+        let dirs: Vec<&str> = path.split(':').filter(|d| !d.is_empty()).collect();
+        // Watch przed skanem — zmiana w trakcie skanu unieważni indeks
+        self.notify = Inotify::watch(&dirs);
+        self.mtimes = if self.notify.is_some() { Vec::new() } else { dir_mtimes(&path) };
+        let mut names: Vec<String> = dirs.iter()
+        .filter_map(|d| std::fs::read_dir(d).ok())
+        .flat_map(|rd| rd.flatten())
+        .filter(|e| e.metadata().map_or(false, |m| m.is_file() && m.permissions().mode() & 0o111 != 0))
+        .filter_map(|e| e.file_name().into_string().ok())
+        .collect();
+        names.sort_unstable();
+        names.dedup();
+        tracing::debug!("[completion] indeks PATH: {} programów", names.len());
+        self.names = names;
+        self.path  = path;
+    }
+}
+
+fn dir_mtimes(path: &str) -> Vec<Option<std::time::SystemTime>> {
+    path.split(':').filter(|d| !d.is_empty())
+    .map(|d| std::fs::metadata(d).and_then(|m| m.modified()).ok())
+    .collect()
+}
+
+/// Nieblokujący deskryptor inotify obserwujący katalogi PATH
+struct Inotify { fd: i32 }
+
+impl Inotify {
+    fn watch(dirs: &[&str]) -> Option<Self> {
+        let fd = unsafe { libc::inotify_init1(libc::IN_NONBLOCK | libc::IN_CLOEXEC) };
+        if fd < 0 { return None; }
+        let this = Self { fd };
+        let mask = libc::IN_CREATE | libc::IN_DELETE | libc::IN_MOVED_FROM | libc::IN_MOVED_TO | libc::IN_ATTRIB;
+        for d in dirs {
+            let Ok(c) = CString::new(*d) else { continue };
+            // Brakujący katalog w PATH nie jest błędem — nie ma czego obserwować
+            unsafe { libc::inotify_add_watch(fd, c.as_ptr(), mask); }
+        }
+        Some(this)
+    }
+
+    /// Czy od ostatniego sprawdzenia przyszło jakiekolwiek zdarzenie (opróżnia kolejkę)
+    fn changed(&mut self) -> bool {
+        let mut buf = [0u8; 4096];
+        let mut any = false;
+        loop {
+            let n = unsafe { libc::read(self.fd, buf.as_mut_ptr().cast(), buf.len()) };
+            if n <= 0 { return any; }
+            any = true;
+        }
+    }
+}
+
+impl Drop for Inotify {
+    fn drop(&mut self) { unsafe { libc::close(self.fd); } }
+}
+
+pub struct HlCompleter {
+    file:     FilenameCompleter,
+    commands: RefCell<CommandIndex>,
+}
 
 impl HlCompleter {
-    pub fn new() -> Self { Self { file: FilenameCompleter::new() } }
+    pub fn new() -> Self {
+        Self { file: FilenameCompleter::new(), commands: RefCell::new(CommandIndex::new()) }
+    }
 }
 
 impl Default for HlCompleter { fn default() -> Self { Self::new() } }
@@ -69,6 +172,13 @@ impl Completer for HlCompleter {
     fn complete(&self, line: &str, pos: usize, ctx: &Context<'_>) -> rustyline::Result<(usize, Vec<Pair>)> {
         let word_start = line[..pos].rfind(|c: char| c.is_whitespace()).map(|i| i + 1).unwrap_or(0);
         let current_word = &line[word_start..pos];
+        let before = line[..word_start].split_whitespace().last().unwrap_or("");
+        if CMD_SIGILS.contains(&before) && !current_word.contains('/') {
+            let cmds: Vec<Pair> = self.commands.borrow_mut().matching(current_word).iter()
+            .map(|c| Pair { display: c.clone(), replacement: c.clone() })
+            .collect();
+            if !cmds.is_empty() { return Ok((word_start, cmds)); }
+        }
         let kw_matches: Vec<Pair> = HL_KEYWORDS.iter()
             .filter(|kw| kw.starts_with(current_word))
             .map(|kw| Pair { display: kw.to_string(), replacement: kw.to_string() })
@@ -128,8 +238,10 @@ impl Hinter for HlCompleter {
             "&"      => Some(" <cmd>  -- uruchom w tle".into()),
             "*>"     => Some(" <cmd>  -- uruchom przez hsh".into()),
             ":*"     => Some(" [nazwa] def  -- goroutine".into()),
-            ":**"    => Some(" <nazwa>  -- zadeklaruj channel".into()),
-            "*--"    => Some(" <nazwa>  -- channel op".into()),
+            ":**"    => Some(" <nazwa> [pojemnosc]  -- zadeklaruj channel".into()),
+            ":**:"   => Some(" <nazwa> = <wartosc>  -- wyslij do channel".into()),
+            ":*~"    => Some(" [nazwa]  -- czekaj na goroutines".into()),
+            "*--"    => Some(" <nazwa> [|> @var]  -- odbierz z channel".into()),
             "<<"     => Some(" <plik.hl>  -- importuj plik".into()),
             "$("     => Some(" expr )  -- arytmetyka  |  $( expr ) -> @var".into()),
             "||"     => Some(" <narzedzie> [args]  -- HackerOS API".into()),
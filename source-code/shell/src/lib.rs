@@ -1,12 +1,13 @@
 pub mod builtins;
 pub mod completion;
 pub mod prompt;
+pub mod repl;
 
 use anyhow::Result;
 use colored::Colorize;
 use hl_core::diagnostics::{parse_error_to_diag, DiagRenderer, DiagSummary, lint_source, lint_gen};
 use hl_core::env::Env;
-use hl_core::{check_source, run_source};
+use hl_core::{check_source, exec_nodes_pub, Diag, Node};
 use rustyline::error::ReadlineError;
 use rustyline::{CompletionType, Config, EditMode, Editor};
 use std::path::Path;
@@ -15,32 +16,36 @@ use tracing::{debug, warn};
 use builtins::{try_builtin, BuiltinResult};
 use completion::HlCompleter;
 use prompt::Prompt;
+use repl::Repl;
 
 const HISTORY_FILE: &str = ".hl_history";
 const HLRC_FILE:    &str = ".hlrc";
 
 pub fn run_interactive(env: &mut Env) -> Result<()> {
     print_banner();
-    run_editor_loop(env, "<repl>", true)
+    let mut repl = Repl::new(env, "<repl>");
+    run_editor_loop(&mut repl, "<repl>", true)
 }
 
 pub fn run_as_shell(config: Option<&Path>, env: &mut Env) -> Result<()> {
     let rc_path = config.map(|p| p.to_path_buf()).unwrap_or_else(|| {
         dirs::home_dir().unwrap_or_default().join(HLRC_FILE)
     });
+    // Jedna sesja dla .hlrc i linii z promptu — funkcje z rc są gotowe
+    let mut repl = Repl::new(env, "<shell>");
     if rc_path.exists() {
         let rc_src = std::fs::read_to_string(&rc_path).unwrap_or_default();
         let fname  = rc_path.to_string_lossy().into_owned();
-        execute_source(&rc_src, &fname, env);
+        execute_source(&rc_src, &fname, &mut repl);
     }
     if let Ok(exe) = std::env::current_exe() {
-        env.set_var("SHELL", hl_core::Value::String(exe.display().to_string()));
+        repl.set_var("SHELL", hl_core::Value::String(exe.display().to_string()));
     }
-    env.set_var("HL_SHELL_MODE", hl_core::Value::Bool(true));
-    run_editor_loop(env, "<shell>", false)
+    repl.set_var("HL_SHELL_MODE", hl_core::Value::Bool(true));
+    run_editor_loop(&mut repl, "<shell>", false)
 }
 
-fn run_editor_loop(env: &mut Env, ctx: &str, show_hint: bool) -> Result<()> {
+fn run_editor_loop(repl: &mut Repl, ctx: &str, show_hint: bool) -> Result<()> {
     let config = Config::builder()
     .history_ignore_space(true)
     .completion_type(CompletionType::List)
@@ -65,7 +70,7 @@ fn run_editor_loop(env: &mut Env, ctx: &str, show_hint: bool) -> Result<()> {
         let prompt_str = if in_multiline {
             format!("  {} ", "...".bright_blue().bold())
         } else {
-            prompt_renderer.render(env.last_exit)
+            prompt_renderer.render(repl.env.last_exit)
         };
 
         match rl.readline(&prompt_str) {
@@ -75,7 +80,7 @@ fn run_editor_loop(env: &mut Env, ctx: &str, show_hint: bool) -> Result<()> {
                     if in_multiline {
                         let src = multiline_buf.clone();
                         multiline_buf.clear(); in_multiline = false;
-                        execute_source(&src, ctx, env);
+                        execute_source(&src, ctx, repl);
                     }
                     continue;
                 }
@@ -87,11 +92,11 @@ fn run_editor_loop(env: &mut Env, ctx: &str, show_hint: bool) -> Result<()> {
                     if trimmed == "done" {
                         let src = multiline_buf.clone();
                         multiline_buf.clear(); in_multiline = false;
-                        execute_source(&src, ctx, env);
+                        execute_source(&src, ctx, repl);
                     }
                     continue;
                 }
-                execute_source(trimmed, ctx, env);
+                execute_source(trimmed, ctx, repl);
             }
             Err(ReadlineError::Interrupted) => {
                 in_multiline = false; multiline_buf.clear();
@@ -108,12 +113,12 @@ fn run_editor_loop(env: &mut Env, ctx: &str, show_hint: bool) -> Result<()> {
     Ok(())
 }
 
-pub fn execute_source(source: &str, filename: &str, env: &mut Env) {
+pub fn execute_source(source: &str, filename: &str, repl: &mut Repl) {
     let trimmed = source.trim();
     if trimmed.is_empty() { return; }
 
-    match try_builtin(trimmed, env) {
-        BuiltinResult::Handled(code) => { env.last_exit = code; return; }
+    match try_builtin(trimmed, repl) {
+        BuiltinResult::Handled(code) => { repl.env.last_exit = code; return; }
         BuiltinResult::NotBuiltin    => {}
     }
 
@@ -124,21 +129,21 @@ pub fn execute_source(source: &str, filename: &str, env: &mut Env) {
     if !lint_diags.is_empty() {
         renderer.emit_all(&lint_diags);
         let sum = DiagSummary::from_diags(&lint_diags);
-        if sum.has_errors() { sum.print(); env.last_exit = 2; return; }
+        if sum.has_errors() { sum.print(); repl.env.last_exit = 2; return; }
         sum.print();
     }
 
     if let Err(e) = check_source(source) {
         renderer.emit(&parse_error_to_diag(&e));
-        env.last_exit = 2; return;
+        repl.env.last_exit = 2; return;
     }
 
     debug!("exec: {}", trimmed);
-    match run_source(source, env) {
-        Ok(r)  => env.last_exit = r.exit_code,
-        Err(e) => {
+    match repl.run(source) {
+        Ok(code) => repl.env.last_exit = code,
+        Err(e)   => {
             renderer.emit(&hl_core::Diag::error(e.to_string()).with_note("blad runtime"));
-            env.last_exit = 1;
+            repl.env.last_exit = 1;
         }
     }
 }
@@ -146,37 +151,61 @@ pub fn execute_source(source: &str, filename: &str, env: &mut Env) {
 /// Kluczowa funkcja: run_file bez O(n^2) lintera
 /// Uzywa nowego lint_source z HashSet (O(n))
 pub fn run_file(path: &Path, env: &mut Env) -> Result<i32> {
+    Ok(run_prepared(&prepare_file(path)?, env))
+}
+
+/// Skrypt po lintowaniu i parsowaniu — `hl daemon` trzyma go między
+/// uruchomieniami, dopóki plik się nie zmieni
+pub struct PreparedScript {
+    pub source:   String,
+    pub filename: String,
+    lint:         Vec<Diag>,
+    nodes:        std::result::Result<Vec<Node>, Diag>,
+}
+
+pub fn prepare_file(path: &Path) -> Result<PreparedScript> {
     let source   = std::fs::read_to_string(path)?;
-    let filename = path.file_name().and_then(|n| n.to_str()).unwrap_or("<unknown>");
-    let renderer = DiagRenderer::new(filename, &source);
+    let filename = path.file_name().and_then(|n| n.to_str()).unwrap_or("<unknown>").to_string();
 
     // O(n) linter - bez O(n^2) z oryginalnego kodu
-    let mut lint_diags = lint_source(&source);
-    lint_diags.extend(lint_gen(&source));
-    if !lint_diags.is_empty() {
-        renderer.emit_all(&lint_diags);
-        let sum = DiagSummary::from_diags(&lint_diags);
+    let mut lint = lint_source(&source);
+    lint.extend(lint_gen(&source));
+    let nodes = check_source(&source).map_err(|e| parse_error_to_diag(&e));
+    Ok(PreparedScript { source, filename, lint, nodes })
+}
+
+/// Wykonaj przygotowany skrypt: diagnostyki lintera, błąd składni albo
+/// przebieg executora (z czekaniem na goroutines)
+pub fn run_prepared(script: &PreparedScript, env: &mut Env) -> i32 {
+    let renderer = DiagRenderer::new(&script.filename, &script.source);
+    if !script.lint.is_empty() {
+        renderer.emit_all(&script.lint);
+        let sum = DiagSummary::from_diags(&script.lint);
         sum.print();
-        if sum.has_errors() { return Ok(2); }
+        if sum.has_errors() { return 2; }
     }
 
-    if let Err(e) = check_source(&source) {
-        renderer.emit(&parse_error_to_diag(&e)); return Ok(2);
-    }
+    let nodes = match &script.nodes {
+        Ok(nodes) => nodes,
+        Err(d)    => { renderer.emit(d); return 2; }
+    };
 
-    match run_source(&source, env) {
-        Ok(r)  => Ok(r.exit_code),
+    let code = match exec_nodes_pub(nodes, env) {
+        Ok(r)  => r.exit_code,
         Err(e) => {
             let d = hl_core::Diag::error(e.to_string())
-            .with_note(format!("blad runtime w '{}'", filename));
-            renderer.emit(&d); Ok(1)
+            .with_note(format!("blad runtime w '{}'", script.filename));
+            renderer.emit(&d); 1
         }
-    }
+    };
+    // Skrypt kończy się razem z ostatnią goroutine
+    if let Err(e) = hl_core::goroutine::wait_all() { renderer.emit(&hl_core::Diag::error(e.to_string())); }
+    code
 }
 
 fn is_block_start(line: &str) -> bool {
     let is_func_def = line.starts_with(':') && !line.starts_with("::") && !line.starts_with(":*") && line.ends_with("def");
-    let is_goroutine = line.starts_with(":*");
+    let is_goroutine = line.starts_with(":*") && !line.starts_with(":**") && !line.starts_with(":*~");
     let is_cond = line.starts_with("? ok") || line.starts_with("? err");
     let is_for_in  = line.starts_with('@') && line.contains(" in ");
     let is_while   = line.starts_with("?~");
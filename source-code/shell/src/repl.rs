@@ -0,0 +1,71 @@
+//! Silnik wykonujący wejście REPL / `hsh`
+//!
+//! Domyślnie linie trafiają do jednej sesji bytecode (`hl_jit::ReplSession`):
+//! zmienne, funkcje i skompilowane pętle żyją przez całą sesję, a fragment
+//! jest tylko doklejany do modułu. `HL_REPL_AST=1` wraca do executora AST na
+//! `Env` (każda linia od zera) — np. przy porównywaniu zachowania obu ścieżek.
+
+use anyhow::Result;
+use hl_core::env::Env;
+use hl_core::{run_source, Value};
+use hl_jit::{ReplSession, SeedVal};
+use tracing::warn;
+
+pub struct Repl<'e> {
+    pub env: &'e mut Env,
+    session: Option<ReplSession>,
+}
+
+impl<'e> Repl<'e> {
+    /// Sesja startuje ze zmiennymi, które są już w `env` (argumenty, rc)
+    pub fn new(env: &'e mut Env, name: &str) -> Self {
+        let session = if std::env::var_os("HL_REPL_AST").is_some() {
+            None
+        } else {
+            match ReplSession::new(name) {
+                Ok(mut s) => {
+                    for (k, v) in env.iter_vars() { s.set_var(k, seed(v)); }
+                    Some(s)
+                }
+                Err(e) => { warn!("Sesja bytecode niedostępna ({}), executor AST", e); None }
+            }
+        };
+        Self { env, session }
+    }
+
+    /// Wykonaj fragment źródła (już po lintowaniu i sprawdzeniu składni)
+    pub fn run(&mut self, source: &str) -> Result<i32> {
+        match self.session.as_mut() {
+            Some(s) => s.eval(source),
+            None    => run_source(source, &mut *self.env).map(|r| r.exit_code),
+        }
+    }
+
+    pub fn set_var(&mut self, name: &str, val: Value) {
+        if let Some(s) = self.session.as_mut() { s.set_var(name, seed(&val)); }
+        self.env.set_var(name, val);
+    }
+
+    /// Zmienne widoczne dla kolejnych linii: (nazwa, wartość tekstowa)
+    pub fn vars(&self) -> Vec<(String, String)> {
+        match &self.session {
+            Some(s) => s.vars(),
+            None    => self.env.iter_vars().map(|(k, v)| (k.to_string(), v.to_string_val())).collect(),
+        }
+    }
+
+    pub fn funcs(&self) -> Vec<String> {
+        match &self.session {
+            Some(s) => s.funcs().into_iter().map(str::to_string).collect(),
+            None    => self.env.functions.keys().cloned().collect(),
+        }
+    }
+}
+
+fn seed(v: &Value) -> SeedVal {
+    match v {
+        Value::Number(n) => SeedVal::Num(*n),
+        Value::Bool(b)   => SeedVal::Bool(*b),
+        other            => SeedVal::Str(other.to_string_val()),
+    }
+}